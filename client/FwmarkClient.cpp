@@ -40,49 +40,42 @@ bool commandHasFd(int cmdId) {
     return (cmdId != FwmarkCommand::QUERY_USER_ACCESS);
 }
 
-}  // namespace
-
-bool FwmarkClient::shouldSetFwmark(int family) {
-    // Checking whether family is supported before checking whether this can be
-    // disabled. Because there are existing processes using AF_LOCAL socket but it
-    // doesn't have permission to call geteuid(). Reference b/135422468.
-    if (!FwmarkCommand::isSupportedFamily(family)) {
-        return false;
-    }
-
-    // Permit processes running as root to disable marking. This is required, for
-    // example, to run the kernel networking tests.
-    if (getenv(ANDROID_NO_USE_FWMARK_CLIENT) && geteuid() == 0) {
-        return false;
-    }
-
-    return true;
-}
-
-FwmarkClient::FwmarkClient() : mChannel(-1) {
-}
-
-FwmarkClient::~FwmarkClient() {
-    if (mChannel >= 0) {
-        close(mChannel);
+// The channel to the fwmark server is cached per thread and reused across send() calls, so that
+// steady-state marking costs a single sendmsg/recv pair instead of a socket/connect/close cycle
+// around every command. The server keeps connections open for exactly this purpose. The pid is
+// cached alongside because after fork() the child shares the parent's socket and could steal its
+// responses; a stale pid forces the child onto a fresh channel.
+thread_local int gChannel = -1;
+thread_local pid_t gChannelPid = 0;
+
+void closeChannel() {
+    if (gChannel >= 0) {
+        close(gChannel);
+        gChannel = -1;
     }
 }
 
-int FwmarkClient::send(FwmarkCommand* data, int fd, FwmarkConnectInfo* connectInfo) {
-    mChannel = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
-    if (mChannel == -1) {
+int openChannel() {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
         return -errno;
     }
-
-    if (TEMP_FAILURE_RETRY(connect(mChannel, reinterpret_cast<const sockaddr*>(&FWMARK_SERVER_PATH),
+    if (TEMP_FAILURE_RETRY(connect(fd, reinterpret_cast<const sockaddr*>(&FWMARK_SERVER_PATH),
                                    sizeof(FWMARK_SERVER_PATH))) == -1) {
-        // If we are unable to connect to the fwmark server, assume there's no error. This protects
-        // against future changes if the fwmark server goes away.
-        // TODO: This means that fd will very likely be misrouted. See if we can delete this in a
-        //       separate CL.
-        return 0;
+        const int error = -errno;
+        close(fd);
+        return error;
     }
+    gChannel = fd;
+    gChannelPid = getpid();
+    return 0;
+}
 
+// Writes one command to the cached channel, attaching |fdCount| fds from |fds| via SCM_RIGHTS,
+// and reads the server's response. Returns the server's response code, or -ECONNRESET if the
+// server closed the channel before responding.
+int sendAndReceive(FwmarkCommand* data, const int* fds, size_t fdCount,
+                   FwmarkConnectInfo* connectInfo) {
     iovec iov[2] = {
         { data, sizeof(*data) },
         { connectInfo, (connectInfo ? sizeof(*connectInfo) : 0) },
@@ -94,30 +87,112 @@ int FwmarkClient::send(FwmarkCommand* data, int fd, FwmarkConnectInfo* connectIn
 
     union {
         cmsghdr cmh;
-        char cmsg[CMSG_SPACE(sizeof(fd))];
+        char cmsg[CMSG_SPACE(FwmarkCommand::MAX_VECTORED_FDS * sizeof(int))];
     } cmsgu;
 
-    if (commandHasFd(data->cmdId)) {
+    if (fdCount > 0) {
         memset(cmsgu.cmsg, 0, sizeof(cmsgu.cmsg));
         message.msg_control = cmsgu.cmsg;
-        message.msg_controllen = sizeof(cmsgu.cmsg);
+        message.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
 
         cmsghdr* const cmsgh = CMSG_FIRSTHDR(&message);
-        cmsgh->cmsg_len = CMSG_LEN(sizeof(fd));
+        cmsgh->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
         cmsgh->cmsg_level = SOL_SOCKET;
         cmsgh->cmsg_type = SCM_RIGHTS;
-        memcpy(CMSG_DATA(cmsgh), &fd, sizeof(fd));
+        memcpy(CMSG_DATA(cmsgh), fds, fdCount * sizeof(int));
     }
 
-    if (TEMP_FAILURE_RETRY(sendmsg(mChannel, &message, 0)) == -1) {
+    if (TEMP_FAILURE_RETRY(sendmsg(gChannel, &message, 0)) == -1) {
         return -errno;
     }
 
     int error = 0;
 
-    if (TEMP_FAILURE_RETRY(recv(mChannel, &error, sizeof(error), 0)) == -1) {
+    ssize_t received = TEMP_FAILURE_RETRY(recv(gChannel, &error, sizeof(error), 0));
+    if (received == -1) {
         return -errno;
     }
+    if (received == 0) {
+        return -ECONNRESET;
+    }
 
     return error;
 }
+
+}  // namespace
+
+bool FwmarkClient::shouldSetFwmark(int family) {
+    // Checking whether family is supported before checking whether this can be
+    // disabled. Because there are existing processes using AF_LOCAL socket but it
+    // doesn't have permission to call geteuid(). Reference b/135422468.
+    if (!FwmarkCommand::isSupportedFamily(family)) {
+        return false;
+    }
+
+    // Permit processes running as root to disable marking. This is required, for
+    // example, to run the kernel networking tests.
+    if (getenv(ANDROID_NO_USE_FWMARK_CLIENT) && geteuid() == 0) {
+        return false;
+    }
+
+    return true;
+}
+
+namespace {
+
+// Shared channel management and retry logic for send() and sendVectored().
+int sendOverChannel(FwmarkCommand* data, const int* fds, size_t fdCount,
+                    FwmarkConnectInfo* connectInfo) {
+    if (gChannel >= 0 && gChannelPid != getpid()) {
+        // We forked since the channel was opened; it belongs to the parent.
+        closeChannel();
+    }
+
+    bool cached = true;
+    if (gChannel < 0) {
+        cached = false;
+        if (openChannel() != 0) {
+            // If we are unable to connect to the fwmark server, assume there's no error. This
+            // protects against future changes if the fwmark server goes away.
+            // TODO: This means that fd will very likely be misrouted. See if we can delete this in
+            //       a separate CL.
+            return 0;
+        }
+    }
+
+    int error = sendAndReceive(data, fds, fdCount, connectInfo);
+    if (cached && (error == -ECONNRESET || error == -EPIPE || error == -ENOTCONN)) {
+        // The cached channel went stale underneath us (e.g., netd restarted, or the server dropped
+        // an idle connection). Retry the command once on a fresh channel; all commands are safe to
+        // reissue.
+        closeChannel();
+        if (openChannel() != 0) {
+            return 0;
+        }
+        error = sendAndReceive(data, fds, fdCount, connectInfo);
+    }
+
+    if (error == -ECONNRESET || error == -EPIPE || error == -ENOTCONN) {
+        // The server vanished mid-command even after a reconnect. Treat this like a failure to
+        // connect in the first place: assume there's no error.
+        closeChannel();
+        return 0;
+    }
+
+    return error;
+}
+
+}  // namespace
+
+int FwmarkClient::send(FwmarkCommand* data, int fd, FwmarkConnectInfo* connectInfo) {
+    const bool hasFd = commandHasFd(data->cmdId);
+    return sendOverChannel(data, hasFd ? &fd : nullptr, hasFd ? 1 : 0, connectInfo);
+}
+
+int FwmarkClient::sendVectored(FwmarkCommand* data, const int* fds, size_t fdCount) {
+    if (fdCount == 0 || fdCount > FwmarkCommand::MAX_VECTORED_FDS) {
+        return -EINVAL;
+    }
+    data->trafficCtrlInfo = fdCount;
+    return sendOverChannel(data, fds, fdCount, nullptr);
+}
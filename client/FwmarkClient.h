@@ -28,16 +28,19 @@ public:
     // its SO_MARK set.
     static bool shouldSetFwmark(int family);
 
-    FwmarkClient();
-    ~FwmarkClient();
-
     // Sends |data| to the fwmark server, along with |fd| as ancillary data using cmsg(3).
     // For ON_CONNECT_COMPLETE |data| command, |connectInfo| should be provided.
     // Returns 0 on success or a negative errno value on failure.
+    //
+    // The connection to the server is cached per thread and reused by subsequent calls, with
+    // automatic reconnection if the server restarts or the process forks.
     int send(FwmarkCommand* data, int fd, FwmarkConnectInfo* connectInfo);
 
-private:
-    int mChannel;
+    // Sends a vectored |data| command (e.g. SELECT_NETWORK_VECTORED) to the fwmark server, along
+    // with |fdCount| fds (at most FwmarkCommand::MAX_VECTORED_FDS) as ancillary data, so that a
+    // whole pool of sockets is marked in one round-trip. Returns 0 on success or a negative errno
+    // value on failure.
+    int sendVectored(FwmarkCommand* data, const int* fds, size_t fdCount);
 };
 
 #endif  // NETD_CLIENT_FWMARK_CLIENT_H
@@ -18,14 +18,18 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 #include <resolv.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/system_properties.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <string>
 #include <vector>
@@ -37,6 +41,7 @@
 #include "Fwmark.h"
 #include "FwmarkClient.h"
 #include "FwmarkCommand.h"
+#include "FwmarkSnapshot.h"
 #include "netdclient_priv.h"
 #include "netdutils/ResponseCode.h"
 #include "netdutils/Stopwatch.h"
@@ -58,9 +63,47 @@ constexpr char PROPERTY_REDIRECT_SOCKET_CALLS[] = "ro.vendor.redirect_socket_cal
 // System Server at runtime. Note: accept4(), socket(), connect() are always shimmed.
 constexpr char PROPERTY_REDIRECT_SOCKET_CALLS_HOOKED[] = "net.redirect_socket_calls.hooked";
 
-std::atomic_uint netIdForProcess(NETID_UNSET);
-std::atomic_uint netIdForResolv(NETID_UNSET);
-std::atomic_bool allowNetworkingForProcess(true);
+// These are read on every interposed socket()/connect() call but written only by the rare
+// setNetworkFor*() / setAllowNetworkingForProcess() configuration calls. Keep each on its own
+// cache line so that a write to one of them doesn't bounce a line shared with the others
+// between app threads.
+alignas(64) std::atomic_uint netIdForProcess(NETID_UNSET);
+alignas(64) std::atomic_uint netIdForResolv(NETID_UNSET);
+alignas(64) std::atomic_bool allowNetworkingForProcess(true);
+
+// Epoch counter bumped whenever any of the settings above changes. Reader threads keep a
+// thread-local copy of the settings tagged with the epoch it was taken at, so the hot paths do
+// one relaxed load of a line that is only written on (rare) reconfiguration, plus plain
+// thread-local loads, instead of hitting the shared atomics on every call.
+alignas(64) std::atomic<uint32_t> processSettingsEpoch(1);
+
+struct CachedProcessSettings {
+    uint32_t epoch = 0;  // Never matches; the global epoch starts at 1.
+    unsigned netId = NETID_UNSET;         // Raw value, may include NETID_USE_LOCAL_NAMESERVERS.
+    unsigned resolvNetId = NETID_UNSET;   // Likewise.
+    bool networkingAllowed = true;
+};
+thread_local CachedProcessSettings tlsProcessSettings;
+
+// Returns this thread's view of the process network settings, refreshing it if a configuration
+// call has happened since it was last taken.
+const CachedProcessSettings& processSettings() {
+    CachedProcessSettings& cached = tlsProcessSettings;
+    const uint32_t epoch = processSettingsEpoch.load(std::memory_order_acquire);
+    if (cached.epoch != epoch) {
+        cached.netId = netIdForProcess.load(std::memory_order_relaxed);
+        cached.resolvNetId = netIdForResolv.load(std::memory_order_relaxed);
+        cached.networkingAllowed = allowNetworkingForProcess.load(std::memory_order_relaxed);
+        cached.epoch = epoch;
+    }
+    return cached;
+}
+
+// Called after writing any of the settings; the release pairs with the acquire in
+// processSettings() so that a thread observing the new epoch also observes the new values.
+void invalidateProcessSettingsCache() {
+    processSettingsEpoch.fetch_add(1, std::memory_order_release);
+}
 
 typedef int (*Accept4FunctionType)(int, sockaddr*, socklen_t*, int);
 typedef int (*ConnectFunctionType)(int, const sockaddr*, socklen_t);
@@ -123,6 +166,178 @@ int closeFdAndSetErrno(int fd, int error) {
     return -1;
 }
 
+// Maps the read-only fwmark snapshot published by netd, once per process. A null return means the
+// snapshot is unavailable (old netd, no SELinux access) and every command goes to the server.
+const FwmarkSnapshot* fwmarkSnapshot() {
+    static const FwmarkSnapshot* snapshot = []() -> const FwmarkSnapshot* {
+        int fd = open(FWMARK_SNAPSHOT_PATH, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size < static_cast<off_t>(sizeof(FwmarkSnapshot))) {
+            close(fd);
+            return nullptr;
+        }
+        void* mapped = mmap(nullptr, sizeof(FwmarkSnapshot), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        return (mapped == MAP_FAILED) ? nullptr : static_cast<const FwmarkSnapshot*>(mapped);
+    }();
+    return snapshot;
+}
+
+// Memo of the last ON_CONNECT marking decision this thread made. The computed mark depends only
+// on the snapshot contents (identified by its seq counter, which netd bumps on every republish),
+// the socket's existing mark, and this process's uid. Apps typically connect over the same
+// network with the same starting mark thousands of times, so the common case becomes "same seq,
+// same input mark": apply the remembered mark with a single setsockopt and skip the table walks.
+// A seq change - the generation signal from netd - simply misses here and recomputes.
+struct CachedConnectMark {
+    uint32_t seq = 0;
+    uint32_t inMark = 0;
+    uint32_t outMark = 0;
+    bool valid = false;
+};
+thread_local CachedConnectMark tlsConnectMark;
+
+// Computes and applies the ON_CONNECT mark locally from the shared snapshot, mirroring the
+// FwmarkServer ON_CONNECT logic. Returns true only if the socket ends up fully marked; any
+// uncertainty - no snapshot, snapshot mid-update or republished while we worked, or
+// setsockopt(SO_MARK) denied because this process lacks CAP_NET_ADMIN - returns false and the
+// caller must fall back to FwmarkClient::send.
+bool tryMarkSocketLocally(int sockfd) {
+    const FwmarkSnapshot* snap = fwmarkSnapshot();
+    if (!snap) {
+        return false;
+    }
+
+    Fwmark fwmark;
+    socklen_t fwmarkLen = sizeof(fwmark.intValue);
+    if (getsockopt(sockfd, SOL_SOCKET, SO_MARK, &fwmark.intValue, &fwmarkLen) == -1) {
+        return false;
+    }
+
+    const uint32_t seq = __atomic_load_n(&snap->seq, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if ((seq & 1) || !snap->valid) {
+        return false;
+    }
+
+    CachedConnectMark& memo = tlsConnectMark;
+    if (memo.valid && memo.seq == seq && memo.inMark == fwmark.intValue) {
+        if (setsockopt(sockfd, SOL_SOCKET, SO_MARK, &memo.outMark, sizeof(memo.outMark)) == -1) {
+            return false;
+        }
+        // As below: if netd republished meanwhile, let the server recompute the mark.
+        return __atomic_load_n(&snap->seq, __ATOMIC_RELAXED) == seq;
+    }
+    const uint32_t inMark = fwmark.intValue;
+
+    // Clamp the counts so that a torn read can never walk out of the fixed tables; the final seq
+    // check below rejects any result computed from a torn snapshot.
+    const uint32_t spanCount = std::min(snap->uidSpanCount, FwmarkSnapshot::MAX_UID_SPANS);
+    const uint32_t permCount =
+            std::min(snap->permissionEntryCount, FwmarkSnapshot::MAX_PERMISSION_ENTRIES);
+    const uint32_t virtualCount =
+            std::min(snap->virtualNetworkCount, FwmarkSnapshot::MAX_VIRTUAL_NETWORKS);
+
+    const uid_t uid = getuid();
+
+    if (!fwmark.explicitlySelected) {
+        if (!fwmark.protectedFromVpn) {
+            // NetworkController::getNetworkForConnect(): the per-app default network if one
+            // covers this UID, otherwise the default network.
+            unsigned netId = NETID_UNSET;
+            if (spanCount > 0) {
+                const uint32_t* end = snap->uidBoundaries + spanCount + 1;
+                const uint32_t* it = std::upper_bound(snap->uidBoundaries, end, uid);
+                const size_t i = it - snap->uidBoundaries;
+                if (i > 0 && i <= spanCount) {
+                    netId = snap->uidNetIds[i - 1];
+                }
+            }
+            fwmark.netId = (netId != NETID_UNSET) ? netId : snap->defaultNetId;
+        } else {
+            const uint32_t* end = snap->virtualNetIds + virtualCount;
+            if (!std::binary_search(snap->virtualNetIds, end, fwmark.netId)) {
+                fwmark.netId = snap->defaultNetId;
+            }
+        }
+    }
+
+    // NetworkController::getPermissionForUserLocked().
+    uint32_t permission = (uid < FwmarkSnapshot::SNAPSHOT_FIRST_APPLICATION_UID)
+                                  ? PERMISSION_SYSTEM
+                                  : PERMISSION_NONE;
+    const FwmarkSnapshot::PermissionEntry* permEnd = snap->permissionEntries + permCount;
+    const FwmarkSnapshot::PermissionEntry* entry =
+            std::lower_bound(snap->permissionEntries, permEnd, uid,
+                             [](const FwmarkSnapshot::PermissionEntry& lhs, uid_t rhs) {
+                                 return lhs.uid < rhs;
+                             });
+    if (entry != permEnd && entry->uid == uid) {
+        permission = entry->permission;
+    }
+    fwmark.permission = static_cast<Permission>(permission);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (__atomic_load_n(&snap->seq, __ATOMIC_RELAXED) != seq) {
+        return false;
+    }
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_MARK, &fwmark.intValue, sizeof(fwmark.intValue)) == -1) {
+        return false;
+    }
+
+    // If netd republished while the mark was being applied, the mark may be stale; let the server
+    // recompute it.
+    if (__atomic_load_n(&snap->seq, __ATOMIC_RELAXED) != seq) {
+        return false;
+    }
+
+    memo = {seq, inMark, fwmark.intValue, true};
+    return true;
+}
+
+// Mark values for which the ON_ACCEPT round-trip is known to be a no-op in this process.
+//
+// The kernel copies the listening socket's mark to every accepted socket, and all the fwmark
+// server does for ON_ACCEPT is OR this process's own permission bits into that inherited mark.
+// The result therefore depends only on the mark value and this process's uid: once a round-trip
+// for a given mark value comes back with the mark unchanged, every socket later accepted with
+// that same mark can skip the fwmarkd round-trip entirely. A process has very few distinct
+// listener marks, so a tiny fixed table suffices; when it fills up, or when SO_MARK cannot be
+// read, the extra marks simply keep taking the round-trip as before. This assumes the process's
+// permission classification in netd (a function of its uid) does not change while it runs, which
+// also underlies the marks its existing listeners already carry.
+constexpr size_t kAcceptMarkCacheSize = 8;
+std::atomic<uint64_t> acceptMarkCache[kAcceptMarkCacheSize] = {};  // 0 is an empty slot.
+
+constexpr uint64_t acceptMarkCacheEntry(uint32_t mark) {
+    return (1ULL << 32) | mark;
+}
+
+bool isAcceptMarkValidated(uint32_t mark) {
+    const uint64_t entry = acceptMarkCacheEntry(mark);
+    for (const auto& slot : acceptMarkCache) {
+        if (slot.load(std::memory_order_relaxed) == entry) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void recordValidatedAcceptMark(uint32_t mark) {
+    const uint64_t entry = acceptMarkCacheEntry(mark);
+    for (auto& slot : acceptMarkCache) {
+        uint64_t expected = 0;
+        if (slot.load(std::memory_order_relaxed) == entry ||
+            slot.compare_exchange_strong(expected, entry, std::memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
 int netdClientAccept4(int sockfd, sockaddr* addr, socklen_t* addrlen, int flags) {
     int acceptedSocket = libcAccept4(sockfd, addr, addrlen, flags);
     if (acceptedSocket == -1) {
@@ -138,10 +353,26 @@ int netdClientAccept4(int sockfd, sockaddr* addr, socklen_t* addrlen, int flags)
         }
     }
     if (FwmarkClient::shouldSetFwmark(family)) {
+        Fwmark inherited;
+        socklen_t inheritedLen = sizeof(inherited.intValue);
+        const bool haveMark = getsockopt(acceptedSocket, SOL_SOCKET, SO_MARK, &inherited.intValue,
+                                         &inheritedLen) == 0;
+        if (haveMark && isAcceptMarkValidated(inherited.intValue)) {
+            return acceptedSocket;
+        }
         FwmarkCommand command = {FwmarkCommand::ON_ACCEPT, 0, 0, 0};
         if (int error = FwmarkClient().send(&command, acceptedSocket, nullptr)) {
             return closeFdAndSetErrno(acceptedSocket, error);
         }
+        if (haveMark) {
+            Fwmark updated;
+            socklen_t updatedLen = sizeof(updated.intValue);
+            if (getsockopt(acceptedSocket, SOL_SOCKET, SO_MARK, &updated.intValue, &updatedLen) ==
+                        0 &&
+                updated.intValue == inherited.intValue) {
+                recordValidatedAcceptMark(inherited.intValue);
+            }
+        }
     }
     return acceptedSocket;
 }
@@ -150,11 +381,12 @@ int netdClientConnect(int sockfd, const sockaddr* addr, socklen_t addrlen) {
     const bool shouldSetFwmark = shouldMarkSocket(sockfd, addr);
     if (shouldSetFwmark) {
         FwmarkCommand command = {FwmarkCommand::ON_CONNECT, 0, 0, 0};
-        int error;
+        int error = 0;
         if (redirectSocketCallsIsTrue()) {
+            // The server forwards the destination to vendor code, so it must see every connect.
             FwmarkConnectInfo connectInfo(0, 0, addr);
             error = FwmarkClient().send(&command, sockfd, &connectInfo);
-        } else {
+        } else if (!tryMarkSocketLocally(sockfd)) {
             error = FwmarkClient().send(&command, sockfd, nullptr);
         }
 
@@ -183,8 +415,9 @@ int netdClientConnect(int sockfd, const sockaddr* addr, socklen_t addrlen) {
 }
 
 int netdClientSocket(int domain, int type, int protocol) {
+    const CachedProcessSettings& settings = processSettings();
     // Block creating AF_INET/AF_INET6 socket if networking is not allowed.
-    if (FwmarkCommand::isSupportedFamily(domain) && !allowNetworkingForProcess.load()) {
+    if (FwmarkCommand::isSupportedFamily(domain) && !settings.networkingAllowed) {
         errno = EPERM;
         return -1;
     }
@@ -192,7 +425,7 @@ int netdClientSocket(int domain, int type, int protocol) {
     if (socketFd == -1) {
         return -1;
     }
-    unsigned netId = netIdForProcess & ~NETID_USE_LOCAL_NAMESERVERS;
+    unsigned netId = settings.netId & ~NETID_USE_LOCAL_NAMESERVERS;
     if (netId != NETID_UNSET && FwmarkClient::shouldSetFwmark(domain)) {
         if (int error = setNetworkForSocket(netId, socketFd)) {
             return closeFdAndSetErrno(socketFd, error);
@@ -247,15 +480,16 @@ unsigned getNetworkForResolv(unsigned netId) {
     if (netId != NETID_UNSET) {
         return netId;
     }
+    const CachedProcessSettings& settings = processSettings();
     // Special case for DNS-over-TLS bypass; b/72345192 .
-    if ((netIdForResolv & ~NETID_USE_LOCAL_NAMESERVERS) != NETID_UNSET) {
-        return netIdForResolv;
+    if ((settings.resolvNetId & ~NETID_USE_LOCAL_NAMESERVERS) != NETID_UNSET) {
+        return settings.resolvNetId;
     }
-    netId = netIdForProcess;
+    netId = settings.netId;
     if (netId != NETID_UNSET) {
         return netId;
     }
-    return netIdForResolv;
+    return settings.resolvNetId;
 }
 
 int setNetworkForTarget(unsigned netId, std::atomic_uint* target) {
@@ -264,6 +498,7 @@ int setNetworkForTarget(unsigned netId, std::atomic_uint* target) {
 
     if (netId == NETID_UNSET) {
         *target = netId;
+        invalidateProcessSettingsCache();
         return 0;
     }
     // Verify that we are allowed to use |netId|, by creating a socket and trying to have it marked
@@ -278,6 +513,7 @@ int setNetworkForTarget(unsigned netId, std::atomic_uint* target) {
     int error = setNetworkForSocket(netId, socketFd);
     if (!error) {
         *target = requestedNetId;
+        invalidateProcessSettingsCache();
     }
     close(socketFd);
     return error;
@@ -294,7 +530,7 @@ int dns_open_proxy() {
     // If networking is not allowed, dns_open_proxy should just fail here.
     // Then eventually, the DNS related functions in local mode will get
     // EPERM while creating socket.
-    if (!allowNetworkingForProcess.load()) {
+    if (!processSettings().networkingAllowed) {
         errno = EPERM;
         return -1;
     }
@@ -470,7 +706,7 @@ extern "C" int getNetworkForSocket(unsigned* netId, int socketFd) {
 }
 
 extern "C" unsigned getNetworkForProcess() {
-    return netIdForProcess & ~NETID_USE_LOCAL_NAMESERVERS;
+    return processSettings().netId & ~NETID_USE_LOCAL_NAMESERVERS;
 }
 
 extern "C" int setNetworkForSocket(unsigned netId, int socketFd) {
@@ -479,6 +715,27 @@ extern "C" int setNetworkForSocket(unsigned netId, int socketFd) {
     return FwmarkClient().send(&command, socketFd, nullptr);
 }
 
+extern "C" int setNetworkForSocketVector(unsigned netId, const int* socketFds, size_t count) {
+    if (!socketFds || count == 0) {
+        return -EINVAL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        CHECK_SOCKET_IS_MARKABLE(socketFds[i]);
+    }
+    // The server marks all the sockets in a chunk before sending one ack, so a pool of N sockets
+    // costs ceil(N / MAX_VECTORED_FDS) round-trips instead of N.
+    while (count > 0) {
+        const size_t chunk = std::min<size_t>(count, FwmarkCommand::MAX_VECTORED_FDS);
+        FwmarkCommand command = {FwmarkCommand::SELECT_NETWORK_VECTORED, netId, 0, 0};
+        if (int error = FwmarkClient().sendVectored(&command, socketFds, chunk)) {
+            return error;
+        }
+        socketFds += chunk;
+        count -= chunk;
+    }
+    return 0;
+}
+
 extern "C" int setNetworkForProcess(unsigned netId) {
     return setNetworkForTarget(netId, &netIdForProcess);
 }
@@ -606,6 +863,7 @@ extern "C" void resNetworkCancel(int fd) {
 
 extern "C" void setAllowNetworkingForProcess(bool allowNetworking) {
     allowNetworkingForProcess.store(allowNetworking);
+    invalidateProcessSettingsCache();
 }
 
 extern "C" int getNetworkForDns(unsigned* dnsNetId) {
@@ -32,10 +32,22 @@ union Fwmark {
     };
     constexpr Fwmark() : intValue(0) {}
 
-    static inline uint32_t getUidBillingMask() {
-        Fwmark m;
-        m.uidBillingDone = true;
-        return m.intValue;
+    // Encodes a fwmark value as a constant expression. Assigning one of the bitfield members
+    // above and then reading intValue is not usable in constexpr context (it reads an inactive
+    // union member), so code that builds fwmark values or masks at compile time - such as
+    // RouteController's static routing-rule tables - passes the fields here instead. The shifts
+    // must stay in sync with the bitfield layout above.
+    static constexpr uint32_t makeMark(unsigned netId, bool explicitlySelected = false,
+                                       bool protectedFromVpn = false,
+                                       Permission permission = PERMISSION_NONE,
+                                       bool uidBillingDone = false) {
+        return (netId & 0xffff) | (uint32_t(explicitlySelected) << 16) |
+               (uint32_t(protectedFromVpn) << 17) | (uint32_t(permission) << 18) |
+               (uint32_t(uidBillingDone) << 20);
+    }
+
+    static constexpr uint32_t getUidBillingMask() {
+        return makeMark(0, false, false, PERMISSION_NONE, true /* uidBillingDone */);
     }
 };
 
@@ -69,13 +69,21 @@ struct FwmarkCommand {
         ON_SENDMMSG,
         ON_SENDMSG,
         ON_SENDTO,
+        SELECT_NETWORK_VECTORED,
     } cmdId;
-    unsigned netId;  // used only in the SELECT_NETWORK command; ignored otherwise.
+    unsigned netId;  // used only in the SELECT_NETWORK and SELECT_NETWORK_VECTORED commands;
+                     // ignored otherwise.
     uid_t uid;       // used in the SELECT_FOR_USER, QUERY_USER_ACCESS, TAG_SOCKET,
                      // SET_COUNTERSET, and DELETE_TAGDATA command; ignored otherwise.
     uint32_t trafficCtrlInfo;  // used in TAG_SOCKET, SET_COUNTERSET and SET_PACIFIER command;
                                // ignored otherwise. Depend on the case, it can be a tag, a
-                               // counterSet or a pacifier signal.
+                               // counterSet or a pacifier signal. SELECT_NETWORK_VECTORED uses it
+                               // to carry the number of fds attached via SCM_RIGHTS, so the server
+                               // can detect a truncated control message.
+
+    // The maximum number of fds a SELECT_NETWORK_VECTORED command may carry. Sockets beyond this
+    // must be marked with additional commands.
+    static constexpr int MAX_VECTORED_FDS = 32;
 
     static bool isSupportedFamily(int socketFamily) {
         return socketFamily == AF_INET || socketFamily == AF_INET6;
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_INCLUDE_FWMARK_SNAPSHOT_H
+#define NETD_INCLUDE_FWMARK_SNAPSHOT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Read-only shared-memory snapshot of the state needed to compute an ON_CONNECT fwmark locally.
+//
+// netd maps this structure read-write at FWMARK_SNAPSHOT_PATH and republishes it whenever the
+// default network, any per-app default network, any virtual network, or any UID's permission
+// changes. libnetd_client maps it read-only and uses it to compute the connect-time mark without a
+// round-trip to the fwmark server, falling back to FwmarkClient::send whenever the snapshot is
+// unavailable, mid-update, or marked invalid, or when setsockopt(SO_MARK) is denied (processes
+// without CAP_NET_ADMIN cannot set the mark themselves and must always fall back).
+//
+// Consistency is a seqlock: |seq| is incremented to an odd value before netd mutates the tables
+// and to an even value afterwards. Readers snapshot the fields they need and reject the result if
+// |seq| was odd or changed across the read.
+struct FwmarkSnapshot {
+    // The tables are fixed-size so that the file can be mapped once with a known length. If the
+    // live state ever exceeds them, netd publishes the snapshot with |valid| = 0 and every client
+    // falls back to the fwmark server.
+    static constexpr uint32_t MAX_UID_SPANS = 64;
+    static constexpr uint32_t MAX_PERMISSION_ENTRIES = 256;
+    static constexpr uint32_t MAX_VIRTUAL_NETWORKS = 16;
+
+    // Mirrors the fallback in NetworkController::getPermissionForUserLocked(): UIDs below this
+    // have PERMISSION_SYSTEM unless the permission table says otherwise.
+    static constexpr uid_t SNAPSHOT_FIRST_APPLICATION_UID = 10000;
+
+    uint32_t seq;
+    uint32_t valid;
+    uint32_t defaultNetId;
+
+    // Disjoint UID spans mapping to per-app default networks, in ascending UID order. Span i
+    // covers [uidBoundaries[i], uidBoundaries[i + 1]) and resolves to uidNetIds[i]; NETID_UNSET
+    // means "use defaultNetId". UIDs outside every span use defaultNetId.
+    uint32_t uidSpanCount;
+    uint32_t uidBoundaries[MAX_UID_SPANS + 1];
+    uint32_t uidNetIds[MAX_UID_SPANS];
+
+    // UIDs with an explicitly assigned netd permission, sorted by UID.
+    struct PermissionEntry {
+        uint32_t uid;
+        uint32_t permission;
+    };
+    uint32_t permissionEntryCount;
+    PermissionEntry permissionEntries[MAX_PERMISSION_ENTRIES];
+
+    // NetIds of the currently existing virtual networks, sorted.
+    uint32_t virtualNetworkCount;
+    uint32_t virtualNetIds[MAX_VIRTUAL_NETWORKS];
+};
+
+constexpr char FWMARK_SNAPSHOT_DIR[] = "/dev/netd";
+constexpr char FWMARK_SNAPSHOT_PATH[] = "/dev/netd/fwmark_snapshot";
+
+#endif  // NETD_INCLUDE_FWMARK_SNAPSHOT_H
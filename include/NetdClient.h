@@ -28,6 +28,10 @@ __BEGIN_DECLS
 int getNetworkForSocket(unsigned* netId, int socketFd);
 int setNetworkForSocket(unsigned netId, int socketFd);
 
+// Binds all |count| sockets in |socketFds| to the network |netId|, marking them in chunks of
+// FwmarkCommand::MAX_VECTORED_FDS per round-trip to the fwmark server. Stops at the first failure.
+int setNetworkForSocketVector(unsigned netId, const int* socketFds, size_t count);
+
 unsigned getNetworkForProcess(void);
 
 int setNetworkForProcess(unsigned netId);
@@ -41,7 +41,7 @@ enum Permission {
     PERMISSION_SYSTEM  = 0x3,  // Includes PERMISSION_NETWORK.
 };
 
-inline const char *permissionToName(Permission permission) {
+constexpr const char *permissionToName(Permission permission) {
     switch (permission) {
         case PERMISSION_NONE:    return "NONE";
         case PERMISSION_NETWORK: return "NETWORK";
@@ -14,7 +14,6 @@
  * limitations under the License.
  */
 
-#include <regex>
 #include <string>
 
 #include <libgen.h>
@@ -23,8 +22,6 @@
 #include <string.h>
 #include <unistd.h>
 
-#include <android-base/strings.h>
-
 #define LOG_TAG "NetUtilsWrapper"
 #include <log/log.h>
 
@@ -49,7 +46,10 @@ const char *netcmds[] = {
     nullptr,
 };
 
-// List of regular expressions of expected commands.
+// List of patterns of expected commands, in POSIX extended regular expression syntax. They are
+// matched by the built-in matcher below, which supports exactly the constructs used here:
+// literals, (a|b) groups, [..] and [^..] classes, '.', the '?' '+' '*' quantifiers, and the
+// '^'/'$' anchors. No backslash escapes.
 const char *EXPECTED_REGEXPS[] = {
 #define CMD "^" SYSTEM_DIRNAME
     // Create, delete, and manage OEM networks.
@@ -79,22 +79,220 @@ const char *EXPECTED_REGEXPS[] = {
 #undef CMD
 };
 
+// Built-in pattern matcher. std::regex used to compile every pattern on every wrapped exec,
+// which costs milliseconds and a storm of allocations right when vendor scripts burst at RIL
+// events; this recursive backtracking matcher walks the pattern and the command in place, doing
+// no allocation at all. Existence of a match is all that matters here, so the differences
+// between backtracking and POSIX leftmost-longest semantics are irrelevant.
+
+// Returns the position just past the ']' closing the class starting at |p|.
+static const char* findClassEnd(const char* p) {
+    p++;  // '['
+    if (*p == '^') p++;
+    while (*p && *p != ']') p++;
+    return *p ? p + 1 : p;
+}
+
+// Returns the position just past the ')' closing the group starting at |p|.
+static const char* findGroupEnd(const char* p) {
+    int depth = 0;
+    while (*p) {
+        if (*p == '[') {
+            p = findClassEnd(p);
+            continue;
+        }
+        if (*p == '(') {
+            depth++;
+        } else if (*p == ')' && --depth == 0) {
+            return p + 1;
+        }
+        p++;
+    }
+    return p;
+}
+
+// Matches |c| against the class in [p, pEnd), including the brackets.
+static bool matchClass(const char* p, const char* pEnd, char c) {
+    p++;  // '['
+    pEnd--;  // ']'
+    bool negate = false;
+    if (*p == '^') {
+        negate = true;
+        p++;
+    }
+    bool found = false;
+    while (p < pEnd) {
+        if (p + 2 < pEnd && p[1] == '-') {
+            if (*p <= c && c <= p[2]) found = true;
+            p += 3;
+        } else {
+            if (*p == c) found = true;
+            p++;
+        }
+    }
+    return found != negate;
+}
+
+// Continuation describing what must match after the current construct. Continuations are
+// plain function pointer + context pairs chained on the stack, so backtracking needs neither
+// allocation nor unbounded template recursion.
+struct MatchCont {
+    bool (*fn)(const void* ctx, const char* s);
+    const void* ctx;
+    bool operator()(const char* s) const { return fn(ctx, s); }
+};
+
+static bool matchSeq(const char* p, const char* pEnd, const char* s, MatchCont cont);
+static bool matchAtom(const char* p, const char* pEnd, const char* s, MatchCont cont);
+static bool matchStar(const char* atom, const char* atomEnd, const char* next, const char* pEnd,
+                      const char* s, MatchCont cont);
+
+struct SeqArgs {
+    const char* p;
+    const char* pEnd;
+    MatchCont cont;
+};
+
+static bool contMatchSeq(const void* ctx, const char* s) {
+    const SeqArgs* a = static_cast<const SeqArgs*>(ctx);
+    return matchSeq(a->p, a->pEnd, s, a->cont);
+}
+
+struct StarArgs {
+    const char* atom;
+    const char* atomEnd;
+    const char* next;
+    const char* pEnd;
+    // Where the repetition started; a repetition must consume input, or an atom that can match
+    // the empty string would recurse forever.
+    const char* sPrev;
+    MatchCont cont;
+};
+
+static bool contMatchStarProgress(const void* ctx, const char* s) {
+    const StarArgs* a = static_cast<const StarArgs*>(ctx);
+    return s != a->sPrev && matchStar(a->atom, a->atomEnd, a->next, a->pEnd, s, a->cont);
+}
+
+static bool contMatchStar(const void* ctx, const char* s) {
+    const StarArgs* a = static_cast<const StarArgs*>(ctx);
+    return matchStar(a->atom, a->atomEnd, a->next, a->pEnd, s, a->cont);
+}
+
+// Matches the single atom in [p, pEnd) at |s|, then calls |cont| with the remainder of the
+// string. A group atom is tried one top-level alternative at a time.
+static bool matchAtom(const char* p, const char* pEnd, const char* s, MatchCont cont) {
+    if (*p == '(') {
+        const char* alt = p + 1;
+        const char* inner = pEnd - 1;  // ')'
+        for (const char* q = alt; q <= inner; q++) {
+            if (q == inner || *q == '|') {
+                if (matchSeq(alt, q, s, cont)) return true;
+                alt = q + 1;
+            } else if (*q == '(') {
+                q = findGroupEnd(q) - 1;
+            } else if (*q == '[') {
+                q = findClassEnd(q) - 1;
+            }
+        }
+        return false;
+    }
+    if (*p == '[') return *s != '\0' && matchClass(p, pEnd, *s) && cont(s + 1);
+    if (*p == '.') return *s != '\0' && cont(s + 1);
+    if (*p == '$') return *s == '\0' && cont(s);
+    return *s == *p && cont(s + 1);  // Literal character.
+}
+
+// Matches zero or more repetitions of the atom in [atom, atomEnd), then the pattern in
+// [next, pEnd), then calls |cont|.
+static bool matchStar(const char* atom, const char* atomEnd, const char* next, const char* pEnd,
+                      const char* s, MatchCont cont) {
+    if (matchSeq(next, pEnd, s, cont)) return true;
+    const StarArgs args = {atom, atomEnd, next, pEnd, s, cont};
+    return matchAtom(atom, atomEnd, s, MatchCont{contMatchStarProgress, &args});
+}
+
+// Matches the pattern in [p, pEnd) at |s|, then calls |cont| with the remainder of the string.
+static bool matchSeq(const char* p, const char* pEnd, const char* s, MatchCont cont) {
+    if (p == pEnd) return cont(s);
+
+    const char* atomEnd;
+    if (*p == '(') {
+        atomEnd = findGroupEnd(p);
+    } else if (*p == '[') {
+        atomEnd = findClassEnd(p);
+    } else {
+        atomEnd = p + 1;
+    }
+    const char quantifier = (atomEnd < pEnd) ? *atomEnd : '\0';
+    const char* next = atomEnd + 1;
+
+    switch (quantifier) {
+        case '*':
+            return matchStar(p, atomEnd, next, pEnd, s, cont);
+        case '+': {
+            const StarArgs args = {p, atomEnd, next, pEnd, nullptr, cont};
+            return matchAtom(p, atomEnd, s, MatchCont{contMatchStar, &args});
+        }
+        case '?': {
+            const SeqArgs args = {next, pEnd, cont};
+            if (matchAtom(p, atomEnd, s, MatchCont{contMatchSeq, &args})) return true;
+            return matchSeq(next, pEnd, s, cont);
+        }
+        default: {
+            const SeqArgs args = {atomEnd, pEnd, cont};
+            return matchAtom(p, atomEnd, s, MatchCont{contMatchSeq, &args});
+        }
+    }
+}
+
+// Returns true if |cmd| matches |pattern|. Every pattern in the table is '^'-anchored; the end
+// is left open unless the pattern ends in '$', mirroring regex_search semantics.
+static bool matchExpectedPattern(const char* pattern, const char* cmd) {
+    if (*pattern == '^') pattern++;
+    const MatchCont accept = {[](const void*, const char*) { return true; }, nullptr};
+    return matchSeq(pattern, pattern + strlen(pattern), cmd, accept);
+}
+
 bool checkExpectedCommand(int argc, char **argv) {
     static bool loggedError = false;
-    std::vector<const char*> allArgs(argc);
+    // Join the arguments with spaces. Vendor command lines comfortably fit on the stack, which
+    // keeps the whole validation allocation-free; an oversized one falls back to the heap
+    // rather than being rejected on length alone.
+    char stackCmd[4096];
+    std::string heapCmd;
+    size_t total = 0;
     for (int i = 0; i < argc; i++) {
-        allArgs[i] = argv[i];
+        total += strlen(argv[i]) + 1;
+    }
+    const char* fullCmd;
+    if (total <= sizeof(stackCmd)) {
+        char* out = stackCmd;
+        for (int i = 0; i < argc; i++) {
+            if (i > 0) *out++ = ' ';
+            const size_t len = strlen(argv[i]);
+            memcpy(out, argv[i], len);
+            out += len;
+        }
+        *out = '\0';
+        fullCmd = stackCmd;
+    } else {
+        heapCmd.reserve(total);
+        for (int i = 0; i < argc; i++) {
+            if (i > 0) heapCmd += ' ';
+            heapCmd += argv[i];
+        }
+        fullCmd = heapCmd.c_str();
     }
-    std::string fullCmd = android::base::Join(allArgs, ' ');
+
     for (size_t i = 0; i < ARRAY_SIZE(EXPECTED_REGEXPS); i++) {
-        const std::regex expectedRegexp(EXPECTED_REGEXPS[i], std::regex_constants::extended);
-        if (std::regex_search(fullCmd, expectedRegexp)) {
+        if (matchExpectedPattern(EXPECTED_REGEXPS[i], fullCmd)) {
             return true;
         }
     }
     if (!loggedError) {
-        ALOGI("Unexpected command: %s", fullCmd.c_str());
-        fprintf(stderr, LOG_TAG ": Unexpected command: %s\n", fullCmd.c_str());
+        ALOGI("Unexpected command: %s", fullCmd);
+        fprintf(stderr, LOG_TAG ": Unexpected command: %s\n", fullCmd);
         loggedError = true;
     }
     return false;
@@ -39,6 +39,9 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include <endian.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_acct.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <linux/pkt_sched.h>
@@ -55,17 +58,12 @@
 #include "FirewallController.h" /* For makeCriticalCommands */
 #include "Fwmark.h"
 #include "NetdConstants.h"
+#include "NetlinkCommands.h"
 #include "android/net/INetd.h"
 #include "bpf/BpfUtils.h"
 
 /* Alphabetical */
 #define ALERT_IPT_TEMPLATE "%s %s -m quota2 ! --quota %" PRId64" --name %s\n"
-const char BandwidthController::LOCAL_INPUT[] = "bw_INPUT";
-const char BandwidthController::LOCAL_FORWARD[] = "bw_FORWARD";
-const char BandwidthController::LOCAL_OUTPUT[] = "bw_OUTPUT";
-const char BandwidthController::LOCAL_RAW_PREROUTING[] = "bw_raw_PREROUTING";
-const char BandwidthController::LOCAL_MANGLE_POSTROUTING[] = "bw_mangle_POSTROUTING";
-const char BandwidthController::LOCAL_GLOBAL_ALERT[] = "bw_global_alert";
 
 auto BandwidthController::iptablesRestoreFunction = execIptablesRestoreWithOutput;
 
@@ -258,6 +256,44 @@ std::vector<std::string> getBasicAccountingCommands() {
     return ipt_basic_accounting_commands;
 }
 
+// Name prefix for the per-interface nfacct counters attached to the costly chains. The prefix
+// plus the interface name must fit in NFACCT_NAME_MAX.
+const char NFACCT_COUNTER_PREFIX[] = "bw_acct_";
+
+constexpr uint16_t nfAcctMsgType(uint8_t msg) {
+    return (NFNL_SUBSYS_ACCT << 8) | msg;
+}
+
+// Sends a single NFNL_SUBSYS_ACCT request over NETLINK_NETFILTER. |name| selects the counter via
+// an NFACCT_NAME attribute and may be empty for dumps that cover all counters.
+int sendNfAcctRequest(uint8_t msg, uint16_t flags, const std::string& name,
+                      const android::net::NetlinkDumpCallback* callback) {
+    nfgenmsg genmsg = {
+        .nfgen_family = AF_UNSPEC,
+        .version = NFNETLINK_V0,
+        .res_id = 0,
+    };
+    char nameBuf[NFACCT_NAME_MAX] = {};
+    if (name.size() >= sizeof(nameBuf)) {
+        return -EINVAL;
+    }
+    memcpy(nameBuf, name.c_str(), name.size());
+    // The kernel expects the NUL terminator to be part of the attribute payload.
+    uint16_t namePayload = name.empty() ? 0 : RTA_ALIGN(name.size() + 1);
+    rtattr nameAttr = {
+        .rta_len = static_cast<uint16_t>(RTA_LENGTH(name.size() + 1)),
+        .rta_type = NFACCT_NAME,
+    };
+    iovec iov[] = {
+        { nullptr, 0 },
+        { &genmsg, sizeof(genmsg) },
+        { &nameAttr, name.empty() ? 0 : sizeof(nameAttr) },
+        { nameBuf, namePayload },
+    };
+    return android::net::sendNetlinkRequest(NETLINK_NETFILTER, nfAcctMsgType(msg), flags, iov,
+                                            ARRAY_SIZE(iov), callback);
+}
+
 }  // namespace
 
 BandwidthController::BandwidthController() {
@@ -286,6 +322,11 @@ int BandwidthController::enableBandwidthControl() {
 
     flushCleanTables(false);
 
+    // Direct nfnetlink counters are opt-in: they need kernel support for nfnetlink_acct and a
+    // deliberate choice to change the accounting read path.
+    mNfAcctSupported = property_get_bool("persist.netd.nfacct_counters", false) &&
+                       probeNfAcctSupport() == 0;
+
     std::string commands = Join(getBasicAccountingCommands(), '\n');
     return iptablesRestoreFunction(V4V6, commands, nullptr);
 }
@@ -319,7 +360,6 @@ int BandwidthController::enableDataSaver(bool enable) {
 
 int BandwidthController::setInterfaceSharedQuota(const std::string& iface, int64_t maxBytes) {
     int res = 0;
-    std::string quotaCmd;
     constexpr char cost[] = "shared";
     constexpr char chain[] = "bw_costly_shared";
 
@@ -339,20 +379,21 @@ int BandwidthController::setInterfaceSharedQuota(const std::string& iface, int64
 
     if (it == mSharedQuotaIfaces.end()) {
         const int ruleInsertPos = (mGlobalAlertBytes) ? 2 : 1;
-        std::vector<std::string> cmds = {
-                "*filter",
-                StringPrintf("-I bw_INPUT %d -i %s -j %s", ruleInsertPos, iface.c_str(), chain),
-                StringPrintf("-I bw_OUTPUT %d -o %s -j %s", ruleInsertPos, iface.c_str(), chain),
-                StringPrintf("-A bw_FORWARD -i %s -j %s", iface.c_str(), chain),
-                StringPrintf("-A bw_FORWARD -o %s -j %s", iface.c_str(), chain),
-        };
+        mCmdBuffer.assign("*filter\n");
+        StringAppendF(&mCmdBuffer, "-I bw_INPUT %d -i %s -j %s\n", ruleInsertPos, iface.c_str(),
+                      chain);
+        StringAppendF(&mCmdBuffer, "-I bw_OUTPUT %d -o %s -j %s\n", ruleInsertPos, iface.c_str(),
+                      chain);
+        StringAppendF(&mCmdBuffer, "-A bw_FORWARD -i %s -j %s\n", iface.c_str(), chain);
+        StringAppendF(&mCmdBuffer, "-A bw_FORWARD -o %s -j %s\n", iface.c_str(), chain);
         if (mSharedQuotaIfaces.empty()) {
-            cmds.push_back(StringPrintf("-I %s -m quota2 ! --quota %" PRId64 " --name %s -j REJECT",
-                                        chain, maxBytes, cost));
+            StringAppendF(&mCmdBuffer,
+                          "-I %s -m quota2 ! --quota %" PRId64 " --name %s -j REJECT\n", chain,
+                          maxBytes, cost);
         }
-        cmds.push_back("COMMIT\n");
+        mCmdBuffer += "COMMIT\n";
 
-        res |= iptablesRestoreFunction(V4V6, Join(cmds, "\n"), nullptr);
+        res |= iptablesRestoreFunction(V4V6, mCmdBuffer, nullptr);
         if (res) {
             ALOGE("Failed set quota rule");
             removeInterfaceSharedQuota(iface);
@@ -389,20 +430,18 @@ int BandwidthController::removeInterfaceSharedQuota(const std::string& iface) {
         return -1;
     }
 
-    std::vector<std::string> cmds = {
-            "*filter",
-            StringPrintf("-D bw_INPUT -i %s -j %s", iface.c_str(), chain),
-            StringPrintf("-D bw_OUTPUT -o %s -j %s", iface.c_str(), chain),
-            StringPrintf("-D bw_FORWARD -i %s -j %s", iface.c_str(), chain),
-            StringPrintf("-D bw_FORWARD -o %s -j %s", iface.c_str(), chain),
-    };
+    mCmdBuffer.assign("*filter\n");
+    StringAppendF(&mCmdBuffer, "-D bw_INPUT -i %s -j %s\n", iface.c_str(), chain);
+    StringAppendF(&mCmdBuffer, "-D bw_OUTPUT -o %s -j %s\n", iface.c_str(), chain);
+    StringAppendF(&mCmdBuffer, "-D bw_FORWARD -i %s -j %s\n", iface.c_str(), chain);
+    StringAppendF(&mCmdBuffer, "-D bw_FORWARD -o %s -j %s\n", iface.c_str(), chain);
     if (mSharedQuotaIfaces.size() == 1) {
-        cmds.push_back(StringPrintf("-D %s -m quota2 ! --quota %" PRIu64 " --name %s -j REJECT",
-                                    chain, mSharedQuotaBytes, cost));
+        StringAppendF(&mCmdBuffer, "-D %s -m quota2 ! --quota %" PRIu64 " --name %s -j REJECT\n",
+                      chain, mSharedQuotaBytes, cost);
     }
-    cmds.push_back("COMMIT\n");
+    mCmdBuffer += "COMMIT\n";
 
-    if (iptablesRestoreFunction(V4V6, Join(cmds, "\n"), nullptr) != 0) {
+    if (iptablesRestoreFunction(V4V6, mCmdBuffer, nullptr) != 0) {
         ALOGE("Failed to remove shared quota on %s", iface.c_str());
         return -1;
     }
@@ -449,28 +488,49 @@ int BandwidthController::setInterfaceQuota(const std::string& iface, int64_t max
         return 0;
     }
 
-    const std::string chain = "bw_costly_" + iface;
+    // The kernel looks the counter up when the -m nfacct rule is checked in, so it has to exist
+    // before the restore below runs.
+    bool nfAcctCounter = false;
+    if (mNfAcctSupported) {
+        mNameBuffer.assign(NFACCT_COUNTER_PREFIX);
+        mNameBuffer += iface;
+        nfAcctCounter = (createNfAcctCounter(mNameBuffer) == 0);
+        if (!nfAcctCounter) {
+            ALOGW("Failed to create nfacct counter %s; falling back to iptables-only accounting",
+                  mNameBuffer.c_str());
+        }
+    }
+
+    mPathBuffer.assign("bw_costly_");
+    mPathBuffer += iface;
+    const char* chain = mPathBuffer.c_str();
     const int ruleInsertPos = (mGlobalAlertBytes) ? 2 : 1;
-    std::vector<std::string> cmds = {
-            "*filter",
-            StringPrintf(":%s -", chain.c_str()),
-            StringPrintf("-A %s -j bw_penalty_box", chain.c_str()),
-            StringPrintf("-I bw_INPUT %d -i %s -j %s", ruleInsertPos, iface.c_str(), chain.c_str()),
-            StringPrintf("-I bw_OUTPUT %d -o %s -j %s", ruleInsertPos, iface.c_str(),
-                         chain.c_str()),
-            StringPrintf("-A bw_FORWARD -i %s -j %s", iface.c_str(), chain.c_str()),
-            StringPrintf("-A bw_FORWARD -o %s -j %s", iface.c_str(), chain.c_str()),
-            StringPrintf("-A %s -m quota2 ! --quota %" PRId64 " --name %s -j REJECT", chain.c_str(),
-                         maxBytes, cost.c_str()),
-            "COMMIT\n",
-    };
-    if (iptablesRestoreFunction(V4V6, Join(cmds, "\n"), nullptr) != 0) {
+    mCmdBuffer.assign("*filter\n");
+    StringAppendF(&mCmdBuffer, ":%s -\n", chain);
+    StringAppendF(&mCmdBuffer, "-A %s -j bw_penalty_box\n", chain);
+    StringAppendF(&mCmdBuffer, "-I bw_INPUT %d -i %s -j %s\n", ruleInsertPos, iface.c_str(), chain);
+    StringAppendF(&mCmdBuffer, "-I bw_OUTPUT %d -o %s -j %s\n", ruleInsertPos, iface.c_str(),
+                  chain);
+    StringAppendF(&mCmdBuffer, "-A bw_FORWARD -i %s -j %s\n", iface.c_str(), chain);
+    StringAppendF(&mCmdBuffer, "-A bw_FORWARD -o %s -j %s\n", iface.c_str(), chain);
+    StringAppendF(&mCmdBuffer, "-A %s -m quota2 ! --quota %" PRId64 " --name %s -j REJECT\n",
+                  chain, maxBytes, cost.c_str());
+    if (nfAcctCounter) {
+        StringAppendF(&mCmdBuffer, "-A %s -m nfacct --nfacct-name %s\n", chain,
+                      mNameBuffer.c_str());
+    }
+    mCmdBuffer += "COMMIT\n";
+    if (iptablesRestoreFunction(V4V6, mCmdBuffer, nullptr) != 0) {
         ALOGE("Failed set quota rule");
+        if (nfAcctCounter) {
+            // removeInterfaceQuota() won't clean this up because the iface was never mapped.
+            removeNfAcctCounter(mNameBuffer);
+        }
         removeInterfaceQuota(iface);
         return -EREMOTEIO;
     }
 
-    mQuotaIfaces[iface] = QuotaInfo{maxBytes, 0};
+    mQuotaIfaces[iface] = QuotaInfo{maxBytes, 0, nfAcctCounter};
     return 0;
 }
 
@@ -508,21 +568,27 @@ int BandwidthController::removeInterfaceQuota(const std::string& iface) {
         return -ENODEV;
     }
 
-    const std::string chain = "bw_costly_" + iface;
-    std::vector<std::string> cmds = {
-            "*filter",
-            StringPrintf("-D bw_INPUT -i %s -j %s", iface.c_str(), chain.c_str()),
-            StringPrintf("-D bw_OUTPUT -o %s -j %s", iface.c_str(), chain.c_str()),
-            StringPrintf("-D bw_FORWARD -i %s -j %s", iface.c_str(), chain.c_str()),
-            StringPrintf("-D bw_FORWARD -o %s -j %s", iface.c_str(), chain.c_str()),
-            StringPrintf("-F %s", chain.c_str()),
-            StringPrintf("-X %s", chain.c_str()),
-            "COMMIT\n",
-    };
+    mPathBuffer.assign("bw_costly_");
+    mPathBuffer += iface;
+    const char* chain = mPathBuffer.c_str();
+    mCmdBuffer.assign("*filter\n");
+    StringAppendF(&mCmdBuffer, "-D bw_INPUT -i %s -j %s\n", iface.c_str(), chain);
+    StringAppendF(&mCmdBuffer, "-D bw_OUTPUT -o %s -j %s\n", iface.c_str(), chain);
+    StringAppendF(&mCmdBuffer, "-D bw_FORWARD -i %s -j %s\n", iface.c_str(), chain);
+    StringAppendF(&mCmdBuffer, "-D bw_FORWARD -o %s -j %s\n", iface.c_str(), chain);
+    StringAppendF(&mCmdBuffer, "-F %s\n", chain);
+    StringAppendF(&mCmdBuffer, "-X %s\n", chain);
+    mCmdBuffer += "COMMIT\n";
 
-    const int res = iptablesRestoreFunction(V4V6, Join(cmds, "\n"), nullptr);
+    const int res = iptablesRestoreFunction(V4V6, mCmdBuffer, nullptr);
 
     if (res == 0) {
+        if (it->second.nfAcctCounter) {
+            // Best effort: the -X above already removed the rule referencing the counter.
+            mNameBuffer.assign(NFACCT_COUNTER_PREFIX);
+            mNameBuffer += iface;
+            removeNfAcctCounter(mNameBuffer);
+        }
         mQuotaIfaces.erase(it);
     }
 
@@ -531,14 +597,17 @@ int BandwidthController::removeInterfaceQuota(const std::string& iface) {
 
 int BandwidthController::updateQuota(const std::string& quotaName, int64_t bytes) {
     const auto& sys = android::netdutils::sSyscalls.get();
-    const std::string fname = "/proc/net/xt_quota/" + quotaName;
 
     if (!isIfaceName(quotaName)) {
         ALOGE("updateQuota: Invalid quotaName \"%s\"", quotaName.c_str());
         return -EINVAL;
     }
 
-    StatusOr<UniqueFile> file = sys.fopen(fname, "we");
+    // This runs on every stats cycle; assemble the path in the reused buffer.
+    mPathBuffer.assign("/proc/net/xt_quota/");
+    mPathBuffer += quotaName;
+
+    StatusOr<UniqueFile> file = sys.fopen(mPathBuffer, "we");
     if (!isOk(file)) {
         int res = errno;
         ALOGE("Updating quota %s failed (%s)", quotaName.c_str(), toString(file).c_str());
@@ -549,10 +618,113 @@ int BandwidthController::updateQuota(const std::string& quotaName, int64_t bytes
     return 0;
 }
 
+int64_t BandwidthController::readQuotaRemaining(const std::string& quotaName) {
+    const auto& sys = android::netdutils::sSyscalls.get();
+
+    mPathBuffer.assign("/proc/net/xt_quota/");
+    mPathBuffer += quotaName;
+
+    auto file = sys.open(mPathBuffer, O_RDONLY | O_CLOEXEC);
+    if (!isOk(file)) {
+        return -1;
+    }
+
+    char buf[32];
+    const auto result = sys.read(android::netdutils::Fd(file.value()),
+                                 android::netdutils::makeSlice(buf));
+    if (!isOk(result) || result.value().size() == 0 || result.value().size() >= sizeof(buf)) {
+        return -1;
+    }
+    buf[result.value().size()] = '\0';
+
+    char* endPtr = nullptr;
+    const int64_t remaining = strtoll(buf, &endPtr, 10);
+    return (endPtr == buf) ? -1 : remaining;
+}
+
+int BandwidthController::probeNfAcctSupport() {
+    // An empty dump succeeds iff the kernel has nfnetlink_acct; without it the request fails
+    // with EOPNOTSUPP (or EPERM in odd configurations).
+    android::net::NetlinkDumpCallback callback = [](nlmsghdr*) {};
+    int res = sendNfAcctRequest(NFNL_MSG_ACCT_GET, android::net::NETLINK_DUMP_FLAGS, "",
+                                &callback);
+    if (res != 0) {
+        ALOGW("nfnetlink_acct not available (%s)", strerror(-res));
+    }
+    return res;
+}
+
+int BandwidthController::createNfAcctCounter(const std::string& name) {
+    return sendNfAcctRequest(NFNL_MSG_ACCT_NEW,
+                             android::net::NETLINK_REQUEST_FLAGS | NLM_F_CREATE, name, nullptr);
+}
+
+int BandwidthController::removeNfAcctCounter(const std::string& name) {
+    return sendNfAcctRequest(NFNL_MSG_ACCT_DEL, android::net::NETLINK_REQUEST_FLAGS, name,
+                             nullptr);
+}
+
+int BandwidthController::getNfAcctStats(const std::string& iface, uint64_t* packets,
+                                        uint64_t* bytes) {
+    if (!mNfAcctSupported) return -EOPNOTSUPP;
+    if (!isIfaceName(iface)) return -EINVAL;
+
+    mNameBuffer.assign(NFACCT_COUNTER_PREFIX);
+    mNameBuffer += iface;
+    // Counter name as it appears on the wire, including the NUL terminator.
+    const char* wantedName = mNameBuffer.c_str();
+    const size_t wantedLen = mNameBuffer.size() + 1;
+
+    bool found = false;
+    android::net::NetlinkDumpCallback callback = [&](nlmsghdr* nlh) {
+        if (nlh->nlmsg_type != nfAcctMsgType(NFNL_MSG_ACCT_NEW)) return;
+        if (nlh->nlmsg_len < NLMSG_SPACE(sizeof(nfgenmsg))) return;
+
+        // Attributes follow the nfgenmsg header.
+        auto* attrs = reinterpret_cast<rtattr*>(reinterpret_cast<char*>(NLMSG_DATA(nlh)) +
+                                                NLMSG_ALIGN(sizeof(nfgenmsg)));
+        uint32_t attrsLen = nlh->nlmsg_len - NLMSG_SPACE(sizeof(nfgenmsg));
+
+        bool nameMatches = false;
+        uint64_t pkts = 0, byteCount = 0;
+        for (rtattr* rta = attrs; RTA_OK(rta, attrsLen); rta = RTA_NEXT(rta, attrsLen)) {
+            switch (rta->rta_type & NLA_TYPE_MASK) {
+                case NFACCT_NAME:
+                    nameMatches = (RTA_PAYLOAD(rta) == wantedLen &&
+                                   memcmp(RTA_DATA(rta), wantedName, wantedLen) == 0);
+                    break;
+                case NFACCT_PKTS: {
+                    uint64_t value;
+                    if (RTA_PAYLOAD(rta) != sizeof(value)) return;
+                    memcpy(&value, RTA_DATA(rta), sizeof(value));
+                    pkts = be64toh(value);
+                    break;
+                }
+                case NFACCT_BYTES: {
+                    uint64_t value;
+                    if (RTA_PAYLOAD(rta) != sizeof(value)) return;
+                    memcpy(&value, RTA_DATA(rta), sizeof(value));
+                    byteCount = be64toh(value);
+                    break;
+                }
+            }
+        }
+        if (nameMatches) {
+            found = true;
+            *packets = pkts;
+            *bytes = byteCount;
+        }
+    };
+
+    int res = sendNfAcctRequest(NFNL_MSG_ACCT_GET, android::net::NETLINK_DUMP_FLAGS, "",
+                                &callback);
+    if (res != 0) return res;
+    return found ? 0 : -ENOENT;
+}
+
 int BandwidthController::runIptablesAlertCmd(IptOp op, const std::string& alertName,
                                              int64_t bytes) {
     const char *opFlag = opToString(op);
-    std::string alertQuotaCmd = "*filter\n";
 
     // TODO: consider using an alternate template for the delete that does not include the --quota
     // value. This code works because the --quota value is ignored by deletes
@@ -562,11 +734,12 @@ int BandwidthController::runIptablesAlertCmd(IptOp op, const std::string& alertN
      * bw_INPUT, bw_OUTPUT (added by BandwidthController in enableBandwidthControl)
      * bw_FORWARD (added by TetherController in setTetherGlobalAlertRule if nat enable/disable)
      */
-    StringAppendF(&alertQuotaCmd, ALERT_IPT_TEMPLATE, opFlag, LOCAL_GLOBAL_ALERT, bytes,
+    mCmdBuffer.assign("*filter\n");
+    StringAppendF(&mCmdBuffer, ALERT_IPT_TEMPLATE, opFlag, LOCAL_GLOBAL_ALERT, bytes,
                   alertName.c_str());
-    StringAppendF(&alertQuotaCmd, "COMMIT\n");
+    mCmdBuffer += "COMMIT\n";
 
-    return iptablesRestoreFunction(V4V6, alertQuotaCmd, nullptr);
+    return iptablesRestoreFunction(V4V6, mCmdBuffer, nullptr);
 }
 
 int BandwidthController::setGlobalAlert(int64_t bytes) {
@@ -579,6 +752,14 @@ int BandwidthController::setGlobalAlert(int64_t bytes) {
 
     int res = 0;
     if (mGlobalAlertBytes) {
+        // The framework re-arms this alert on every stats poll, usually with an unchanged
+        // threshold. Writing the counter resets its remaining byte count, so the write may only
+        // be elided when nothing has consumed the counter since it was armed: re-check the
+        // kernel's remaining value and skip the rewrite if it still equals the threshold. Any
+        // consumption (or a failed read) makes the values differ and the re-arm proceeds.
+        if (bytes == mGlobalAlertBytes && readQuotaRemaining(alertName) == bytes) {
+            return 0;
+        }
         res = updateQuota(alertName, bytes);
     } else {
         res = runIptablesAlertCmd(IptOpInsert, alertName, bytes);
@@ -671,17 +852,20 @@ int BandwidthController::setCostlyAlert(const std::string& costName, int64_t byt
         return -ERANGE;
     }
 
-    std::string alertName = costName + "Alert";
-    std::string chainName = "bw_costly_" + costName;
+    // The alert name doubles as the xt_quota counter name; it has to stay in its own buffer
+    // because updateQuota() reuses mPathBuffer underneath.
+    mNameBuffer.assign(costName);
+    mNameBuffer += "Alert";
     if (*alertBytes) {
-        res = updateQuota(alertName, *alertBytes);
+        res = updateQuota(mNameBuffer, *alertBytes);
     } else {
-        std::vector<std::string> commands = {
-            "*filter\n",
-            StringPrintf(ALERT_IPT_TEMPLATE, "-A", chainName.c_str(), bytes, alertName.c_str()),
-            "COMMIT\n"
-        };
-        res = iptablesRestoreFunction(V4V6, Join(commands, ""), nullptr);
+        mPathBuffer.assign("bw_costly_");
+        mPathBuffer += costName;
+        mCmdBuffer.assign("*filter\n");
+        StringAppendF(&mCmdBuffer, ALERT_IPT_TEMPLATE, "-A", mPathBuffer.c_str(), bytes,
+                      mNameBuffer.c_str());
+        mCmdBuffer += "COMMIT\n";
+        res = iptablesRestoreFunction(V4V6, mCmdBuffer, nullptr);
         if (res) {
             ALOGE("Failed to set costly alert for %s", costName.c_str());
             res = -EREMOTEIO;
@@ -704,14 +888,15 @@ int BandwidthController::removeCostlyAlert(const std::string& costName, int64_t*
         return -ENOENT;
     }
 
-    std::string alertName = costName + "Alert";
-    std::string chainName = "bw_costly_" + costName;
-    std::vector<std::string> commands = {
-        "*filter\n",
-        StringPrintf(ALERT_IPT_TEMPLATE, "-D", chainName.c_str(), *alertBytes, alertName.c_str()),
-        "COMMIT\n"
-    };
-    if (iptablesRestoreFunction(V4V6, Join(commands, ""), nullptr) != 0) {
+    mNameBuffer.assign(costName);
+    mNameBuffer += "Alert";
+    mPathBuffer.assign("bw_costly_");
+    mPathBuffer += costName;
+    mCmdBuffer.assign("*filter\n");
+    StringAppendF(&mCmdBuffer, ALERT_IPT_TEMPLATE, "-D", mPathBuffer.c_str(), *alertBytes,
+                  mNameBuffer.c_str());
+    mCmdBuffer += "COMMIT\n";
+    if (iptablesRestoreFunction(V4V6, mCmdBuffer, nullptr) != 0) {
         ALOGE("Failed to remove costly alert %s", costName.c_str());
         return -EREMOTEIO;
     }
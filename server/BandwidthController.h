@@ -45,11 +45,6 @@ public:
     int getInterfaceQuota(const std::string& iface, int64_t* bytes);
     int removeInterfaceQuota(const std::string& iface);
 
-    int addNaughtyApps(const std::vector<uint32_t>& appUids);
-    int removeNaughtyApps(const std::vector<uint32_t>& appUids);
-    int addNiceApps(const std::vector<uint32_t>& appUids);
-    int removeNiceApps(const std::vector<uint32_t>& appUids);
-
     int setGlobalAlert(int64_t bytes);
     int removeGlobalAlert();
     int setGlobalAlertInForwardChain();
@@ -61,12 +56,22 @@ public:
     int setInterfaceAlert(const std::string& iface, int64_t bytes);
     int removeInterfaceAlert(const std::string& iface);
 
-    static const char LOCAL_INPUT[];
-    static const char LOCAL_FORWARD[];
-    static const char LOCAL_OUTPUT[];
-    static const char LOCAL_RAW_PREROUTING[];
-    static const char LOCAL_MANGLE_POSTROUTING[];
-    static const char LOCAL_GLOBAL_ALERT[];
+    // Direct nfnetlink accounting (NFNL_SUBSYS_ACCT). When supported and enabled via the
+    // persist.netd.nfacct_counters property (probed in enableBandwidthControl()), per-interface
+    // quota chains additionally feed a named kernel byte counter, which getNfAcctStats() reads
+    // with a single binary netlink dump - no iptables-restore fork and no text parsing. The
+    // iptables chain semantics are unchanged; the counter rides on the existing costly chain.
+    bool supportsNfAcctCounters() const { return mNfAcctSupported; }
+    int getNfAcctStats(const std::string& iface, uint64_t* packets, uint64_t* bytes);
+
+    // constexpr so the chain topology table in Controllers.cpp can reference them at compile
+    // time.
+    static constexpr char LOCAL_INPUT[] = "bw_INPUT";
+    static constexpr char LOCAL_FORWARD[] = "bw_FORWARD";
+    static constexpr char LOCAL_OUTPUT[] = "bw_OUTPUT";
+    static constexpr char LOCAL_RAW_PREROUTING[] = "bw_raw_PREROUTING";
+    static constexpr char LOCAL_MANGLE_POSTROUTING[] = "bw_mangle_POSTROUTING";
+    static constexpr char LOCAL_GLOBAL_ALERT[] = "bw_global_alert";
 
     enum IptJumpOp { IptJumpReject, IptJumpReturn };
     enum IptOp { IptOpInsert, IptOpDelete };
@@ -75,6 +80,8 @@ public:
     struct QuotaInfo {
         int64_t quota;
         int64_t alert;
+        // True if an nfacct counter is attached to this interface's costly chain.
+        bool nfAcctCounter;
     };
 
     enum IptIpVer { IptIpV4, IptIpV6 };
@@ -93,10 +100,16 @@ public:
     int runIptablesAlertFwdCmd(IptOp op, const std::string& alertName, int64_t bytes);
 
     int updateQuota(const std::string& alertName, int64_t bytes);
+    // Returns the remaining byte count of an armed xt_quota counter, or -1 if it cannot be read.
+    int64_t readQuotaRemaining(const std::string& quotaName);
 
     int setCostlyAlert(const std::string& costName, int64_t bytes, int64_t* alertBytes);
     int removeCostlyAlert(const std::string& costName, int64_t* alertBytes);
 
+    static int probeNfAcctSupport();
+    static int createNfAcctCounter(const std::string& name);
+    static int removeNfAcctCounter(const std::string& name);
+
     /*
      * Attempt to find the bw_costly_* tables that need flushing,
      * and flush them.
@@ -125,9 +138,19 @@ public:
     int64_t mSharedQuotaBytes = 0;
     int64_t mSharedAlertBytes = 0;
     int64_t mGlobalAlertBytes = 0;
+    bool mNfAcctSupported = false;
 
     std::map<std::string, QuotaInfo> mQuotaIfaces;
     std::set<std::string> mSharedQuotaIfaces;
+
+    // Reusable assembly buffers for quota and alert updates, which the framework issues on every
+    // stats cycle. Each use overwrites the previous contents but keeps the allocation, so
+    // steady-state updates stop churning through dozens of temporary strings per call.
+    // mCmdBuffer holds iptables-restore command text, mPathBuffer /proc paths and chain names,
+    // and mNameBuffer xt_quota counter names (mPathBuffer and mNameBuffer can be live at once).
+    std::string mCmdBuffer;
+    std::string mPathBuffer;
+    std::string mNameBuffer;
 };
 
 #endif
@@ -21,6 +21,7 @@
 
 #include <inttypes.h>
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -46,6 +47,9 @@ using ::testing::StrictMock;
 using android::base::Join;
 using android::base::StringPrintf;
 using android::net::TunInterface;
+using android::netdutils::Fd;
+using android::netdutils::Slice;
+using android::netdutils::UniqueFd;
 using android::netdutils::UniqueFile;
 using android::netdutils::status::ok;
 
@@ -127,6 +131,16 @@ protected:
         EXPECT_CALL(mSyscalls, fclose(dummyFile)).WillOnce(Return(ok));
     }
 
+    // Expects one read of an xt_quota proc file, returning |contents| as the remaining count.
+    void expectReadQuota(const std::string& contents) {
+        EXPECT_CALL(mSyscalls, open(_, _, _)).WillOnce(Return(ByMove(UniqueFd())));
+        EXPECT_CALL(mSyscalls, read(_, _)).WillOnce(Invoke([contents](Fd, const Slice buf) {
+            const size_t len = contents.size() < buf.size() ? contents.size() : buf.size();
+            memcpy(buf.base(), contents.data(), len);
+            return Slice(buf.base(), len);
+        }));
+    }
+
     StrictMock<android::netdutils::ScopedMockSyscalls> mSyscalls;
 };
 
@@ -432,6 +446,41 @@ TEST_F(BandwidthControllerTest, IptablesAlertCmd) {
     expectIptablesRestoreCommands(expected);
 }
 
+TEST_F(BandwidthControllerTest, GlobalAlertRearm) {
+    constexpr int64_t kBytes = 123456;
+
+    std::vector<std::string> expected = {
+            "*filter\n"
+            "-I bw_global_alert -m quota2 ! --quota 123456 --name globalAlert\n"
+            "COMMIT\n"};
+    EXPECT_EQ(0, mBw.setGlobalAlert(kBytes));
+    expectIptablesRestoreCommands(expected);
+
+    // Re-arming with an unchanged threshold while the counter is untouched is a no-op.
+    expectReadQuota("123456\n");
+    EXPECT_EQ(0, mBw.setGlobalAlert(kBytes));
+    expected = {};
+    expectIptablesRestoreCommands(expected);
+
+    // Once traffic has consumed part of the counter, the same threshold must re-arm it.
+    expectReadQuota("99999\n");
+    expectUpdateQuota(kBytes);
+    EXPECT_EQ(0, mBw.setGlobalAlert(kBytes));
+    expectIptablesRestoreCommands(expected);
+
+    // A changed threshold skips the remaining-count read and just rewrites the counter.
+    expectUpdateQuota(kBytes + 1);
+    EXPECT_EQ(0, mBw.setGlobalAlert(kBytes + 1));
+    expectIptablesRestoreCommands(expected);
+
+    expected = {
+            "*filter\n"
+            "-D bw_global_alert -m quota2 ! --quota 123457 --name globalAlert\n"
+            "COMMIT\n"};
+    EXPECT_EQ(0, mBw.removeGlobalAlert());
+    expectIptablesRestoreCommands(expected);
+}
+
 TEST_F(BandwidthControllerTest, CostlyAlert) {
     const int64_t kQuota = 123456;
     int64_t alertBytes = 0;
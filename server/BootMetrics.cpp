@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BootMetrics"
+
+#include "BootMetrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <log/log.h>
+
+namespace android {
+namespace net {
+
+using android::netdutils::DumpWriter;
+using android::netdutils::ScopedIndent;
+
+BootMetrics* BootMetrics::instance = nullptr;
+
+namespace {
+
+// The peak is fed by every LatencyWatchdog operation, possibly before Controllers::init has
+// created the recorder, so it lives outside the instance.
+std::atomic<int64_t> sPeakOperationUs{0};
+
+int64_t boottimeUs() {
+    timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// Appends the records in |contents| this version understands to |records|. Records from other
+// versions are skipped over via their size field. Stops at the first slot that cannot be a
+// record at all (bad magic or implausible size): past that, resynchronization is guesswork.
+void parseRecords(const std::string& contents, std::vector<BootMetrics::Record>* records) {
+    // The prefix of every record version: magic, version, size.
+    constexpr size_t kHeaderSize = sizeof(uint32_t) + 2 * sizeof(uint16_t);
+    constexpr size_t kMaxRecordSize = 4096;
+
+    size_t offset = 0;
+    while (offset + kHeaderSize <= contents.size()) {
+        BootMetrics::Record record = {};
+        memcpy(&record, contents.data() + offset, kHeaderSize);
+        if (record.magic != BootMetrics::kMagic || record.size < kHeaderSize ||
+            record.size > kMaxRecordSize || offset + record.size > contents.size()) {
+            ALOGE("discarding %zu trailing bytes of boot metrics", contents.size() - offset);
+            return;
+        }
+        if (record.version == BootMetrics::kVersion &&
+            record.size == sizeof(BootMetrics::Record)) {
+            memcpy(&record, contents.data() + offset, sizeof(record));
+            records->push_back(record);
+        }
+        offset += record.size;
+    }
+}
+
+}  // namespace
+
+int BootMetrics::recordInit(int64_t totalUs, int64_t iptablesUs, int64_t routeInitUs) {
+    std::lock_guard guard(mLock);
+
+    std::vector<Record> history;
+    std::string contents;
+    if (android::base::ReadFileToString(mPath, &contents)) {
+        parseRecords(contents, &history);
+    }
+    if (history.size() >= kMaxRecords) {
+        history.erase(history.begin(), history.end() - (kMaxRecords - 1));
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    mRecord = {
+            .magic = kMagic,
+            .version = kVersion,
+            .size = sizeof(Record),
+            .timestamp = now.tv_sec,
+            .initTotalUs = totalUs,
+            .initIptablesUs = iptablesUs,
+            .initRouteUs = routeInitUs,
+            .firstNetworkReadyUs = 0,
+            .peakOperationUs = sPeakOperationUs.load(std::memory_order_relaxed),
+    };
+
+    // Atomic replace, so a crash mid-write leaves the previous history intact.
+    const std::string tmpPath = mPath + ".tmp";
+    android::base::unique_fd fd(
+            open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+    if (fd == -1) {
+        ALOGE("cannot open %s: %s", tmpPath.c_str(), strerror(errno));
+        return -errno;
+    }
+    bool ok = true;
+    for (const Record& record : history) {
+        ok = ok && android::base::WriteFully(fd, &record, sizeof(record));
+    }
+    ok = ok && android::base::WriteFully(fd, &mRecord, sizeof(mRecord));
+    if (!ok || fsync(fd) == -1) {
+        ALOGE("cannot write %s: %s", tmpPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return -EIO;
+    }
+    if (rename(tmpPath.c_str(), mPath.c_str()) == -1) {
+        ALOGE("cannot rename %s to %s: %s", tmpPath.c_str(), mPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return -errno;
+    }
+
+    mRecordOffset = history.size() * sizeof(Record);
+    return 0;
+}
+
+void BootMetrics::recordFirstNetworkReady() {
+    // Fast no-op after the first call: one relaxed load on the interface-attach path.
+    if (mFirstNetworkRecorded.load(std::memory_order_relaxed) ||
+        mFirstNetworkRecorded.exchange(true)) {
+        return;
+    }
+    std::lock_guard guard(mLock);
+    mRecord.firstNetworkReadyUs = boottimeUs();
+    patchRecordLocked();
+}
+
+void BootMetrics::patchRecordLocked() {
+    if (mRecordOffset < 0) {
+        return;
+    }
+    mRecord.peakOperationUs = sPeakOperationUs.load(std::memory_order_relaxed);
+    android::base::unique_fd fd(open(mPath.c_str(), O_WRONLY | O_CLOEXEC));
+    if (fd == -1) {
+        ALOGE("cannot open %s: %s", mPath.c_str(), strerror(errno));
+        return;
+    }
+    if (pwrite(fd, &mRecord, sizeof(mRecord), mRecordOffset) !=
+        static_cast<ssize_t>(sizeof(mRecord))) {
+        ALOGE("cannot update %s: %s", mPath.c_str(), strerror(errno));
+    }
+}
+
+void BootMetrics::noteOperationUs(int64_t us) {
+    int64_t peak = sPeakOperationUs.load(std::memory_order_relaxed);
+    while (us > peak &&
+           !sPeakOperationUs.compare_exchange_weak(peak, us, std::memory_order_relaxed)) {
+    }
+}
+
+void BootMetrics::dump(DumpWriter& dw) {
+    std::lock_guard guard(mLock);
+    // The peak keeps evolving after the last stamp; refresh the artifact before printing it.
+    patchRecordLocked();
+
+    dw.println("Boot metrics (%s):", mPath.c_str());
+    ScopedIndent indent(dw);
+
+    std::vector<Record> history;
+    std::string contents;
+    if (android::base::ReadFileToString(mPath, &contents)) {
+        parseRecords(contents, &history);
+    }
+    if (history.empty()) {
+        dw.println("<none>");
+        return;
+    }
+    for (size_t i = 0; i < history.size(); i++) {
+        const Record& record = history[i];
+        tm tm;
+        const time_t seconds = record.timestamp;
+        localtime_r(&seconds, &tm);
+        dw.println("%04d-%02d-%02d %02d:%02d:%02d init %" PRId64 "us (iptables %" PRId64
+                   "us, route %" PRId64 "us) first network @%" PRId64 "us uptime, peak op %" PRId64
+                   "us%s",
+                   tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                   record.initTotalUs, record.initIptablesUs, record.initRouteUs,
+                   record.firstNetworkReadyUs, record.peakOperationUs,
+                   static_cast<off_t>(i * sizeof(Record)) == mRecordOffset ? " (this boot)" : "");
+    }
+}
+
+}  // namespace net
+}  // namespace android
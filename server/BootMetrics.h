@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_SERVER_BOOT_METRICS_H
+#define NETD_SERVER_BOOT_METRICS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "netdutils/DumpWriter.h"
+
+namespace android {
+namespace net {
+
+// A durable, compact record of netd's per-boot performance, so fleet analysis can trend netd
+// boot over boot without collecting full traces.
+//
+// The file is a sequence of fixed-size binary records, one appended per boot: the init phase
+// timings from Controllers::init, the CLOCK_BOOTTIME at which the first interface joined a
+// network, and the peak operation latency the LatencyWatchdog observed. The append at init
+// rewrites the file atomically (temp file + rename, same pattern as the state journal), trimming
+// it to the newest kMaxRecords boots and dropping records whose layout this version does not
+// understand; the later stamps patch this boot's record in place. "dumpsys netd" prints the
+// retained history.
+class BootMetrics {
+  public:
+    // One boot's metrics, as laid out on disk. |size| lets a reader skip records written by a
+    // netd with a different layout instead of discarding the rest of the file.
+    struct Record {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t size;
+        int64_t timestamp;            // CLOCK_REALTIME seconds when the record was appended.
+        int64_t initTotalUs;          // Controllers::init wall time.
+        int64_t initIptablesUs;       // ... of which the iptables chain and rule setup.
+        int64_t initRouteUs;          // ... of which RouteController::Init (a parallel phase).
+        int64_t firstNetworkReadyUs;  // CLOCK_BOOTTIME when the first interface joined a
+                                      // network; 0 if that never happened.
+        int64_t peakOperationUs;      // Slowest network transition observed that boot.
+    };
+    // The on-disk layout: the header fields pack into one 8-byte unit ahead of the 8-byte
+    // counters, so there is no padding to leak or to differ between builds.
+    static_assert(sizeof(Record) == 56);
+
+    static constexpr uint32_t kMagic = 0x4d42444e;  // "NDBM"
+    static constexpr uint16_t kVersion = 1;
+    // Boots retained; at 56 bytes per record the file stays under 4KB.
+    static constexpr size_t kMaxRecords = 64;
+
+    explicit BootMetrics(const std::string& path) : mPath(path) {}
+
+    // Appends this boot's record with the phase timings measured by Controllers::init, trimming
+    // the file to the newest kMaxRecords boots. Returns 0 on success or negative errno.
+    [[nodiscard]] int recordInit(int64_t totalUs, int64_t iptablesUs, int64_t routeInitUs);
+
+    // Stamps this boot's record with the current CLOCK_BOOTTIME, marking the point at which
+    // netd's boot work has produced a usable network. Only the first call writes.
+    void recordFirstNetworkReady();
+
+    void dump(netdutils::DumpWriter& dw);
+
+    // Folds one completed operation's wall time into this boot's peak. Lock-free; the on-disk
+    // copy of the peak is refreshed whenever the record is next patched or dumped.
+    static void noteOperationUs(int64_t us);
+
+    // The process-wide recorder, created (and never destroyed) by Controllers::init(). Null
+    // before that, and in tests, which construct instances against temporary paths.
+    static BootMetrics* instance;
+
+  private:
+    // Rewrites this boot's on-disk record from the in-memory state, folding in the current peak.
+    void patchRecordLocked();
+
+    const std::string mPath;
+    std::mutex mLock;
+    Record mRecord = {};       // This boot's record, mirrored at mRecordOffset on disk.
+    off_t mRecordOffset = -1;  // -1 until recordInit() has appended the record.
+    std::atomic<bool> mFirstNetworkRecorded = false;
+};
+
+}  // namespace net
+}  // namespace android
+
+#endif  // NETD_SERVER_BOOT_METRICS_H
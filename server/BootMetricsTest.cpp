@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "BootMetrics.h"
+
+namespace android {
+namespace net {
+
+class BootMetricsTest : public ::testing::Test {
+  protected:
+    BootMetricsTest() : mPath(mTempDir.path + std::string("/boot_metrics")) {}
+
+    std::vector<BootMetrics::Record> readRecords() {
+        std::vector<BootMetrics::Record> records;
+        std::string contents;
+        if (!android::base::ReadFileToString(mPath, &contents)) return records;
+        for (size_t offset = 0; offset + sizeof(BootMetrics::Record) <= contents.size();
+             offset += sizeof(BootMetrics::Record)) {
+            BootMetrics::Record record;
+            memcpy(&record, contents.data() + offset, sizeof(record));
+            records.push_back(record);
+        }
+        return records;
+    }
+
+    TemporaryDir mTempDir;
+    const std::string mPath;
+};
+
+TEST_F(BootMetricsTest, AppendsOneRecordPerBoot) {
+    // Each instance stands in for one boot's netd.
+    BootMetrics boot1(mPath);
+    ASSERT_EQ(0, boot1.recordInit(1000, 300, 200));
+    BootMetrics boot2(mPath);
+    ASSERT_EQ(0, boot2.recordInit(2000, 600, 400));
+
+    const auto records = readRecords();
+    ASSERT_EQ(2U, records.size());
+    EXPECT_EQ(BootMetrics::kMagic, records[0].magic);
+    EXPECT_EQ(BootMetrics::kVersion, records[0].version);
+    EXPECT_EQ(sizeof(BootMetrics::Record), records[0].size);
+    EXPECT_EQ(1000, records[0].initTotalUs);
+    EXPECT_EQ(300, records[0].initIptablesUs);
+    EXPECT_EQ(200, records[0].initRouteUs);
+    EXPECT_EQ(2000, records[1].initTotalUs);
+}
+
+TEST_F(BootMetricsTest, FirstNetworkReadyStampsOnlyThisBoot) {
+    BootMetrics boot1(mPath);
+    ASSERT_EQ(0, boot1.recordInit(1000, 300, 200));
+    BootMetrics boot2(mPath);
+    ASSERT_EQ(0, boot2.recordInit(2000, 600, 400));
+
+    boot2.recordFirstNetworkReady();
+    const auto records = readRecords();
+    ASSERT_EQ(2U, records.size());
+    EXPECT_EQ(0, records[0].firstNetworkReadyUs);
+    EXPECT_GT(records[1].firstNetworkReadyUs, 0);
+
+    // Only the first attach stamps; a later one must not move the timestamp.
+    const int64_t stamped = records[1].firstNetworkReadyUs;
+    boot2.recordFirstNetworkReady();
+    EXPECT_EQ(stamped, readRecords()[1].firstNetworkReadyUs);
+}
+
+TEST_F(BootMetricsTest, TrimsToMaxRecords) {
+    for (size_t i = 0; i < BootMetrics::kMaxRecords + 5; i++) {
+        BootMetrics boot(mPath);
+        ASSERT_EQ(0, boot.recordInit(i, 0, 0));
+    }
+
+    const auto records = readRecords();
+    ASSERT_EQ(BootMetrics::kMaxRecords, records.size());
+    // The oldest boots were dropped; the newest survived.
+    EXPECT_EQ(static_cast<int64_t>(BootMetrics::kMaxRecords + 4), records.back().initTotalUs);
+    EXPECT_EQ(static_cast<int64_t>(5), records.front().initTotalUs);
+}
+
+TEST_F(BootMetricsTest, CorruptTailIsDiscarded) {
+    BootMetrics boot1(mPath);
+    ASSERT_EQ(0, boot1.recordInit(1000, 300, 200));
+
+    // Simulate an interrupted append: garbage after the valid record.
+    std::string contents;
+    ASSERT_TRUE(android::base::ReadFileToString(mPath, &contents));
+    contents += "partial garbage";
+    ASSERT_TRUE(android::base::WriteStringToFile(contents, mPath));
+
+    // The next boot keeps the valid record and replaces the tail with its own.
+    BootMetrics boot2(mPath);
+    ASSERT_EQ(0, boot2.recordInit(2000, 600, 400));
+    const auto records = readRecords();
+    ASSERT_EQ(2U, records.size());
+    EXPECT_EQ(1000, records[0].initTotalUs);
+    EXPECT_EQ(2000, records[1].initTotalUs);
+}
+
+TEST_F(BootMetricsTest, PeakOperationLatencyIsMonotonic) {
+    BootMetrics::noteOperationUs(7000);
+    BootMetrics boot(mPath);
+    ASSERT_EQ(0, boot.recordInit(1000, 300, 200));
+    EXPECT_GE(readRecords()[0].peakOperationUs, 7000);
+
+    // A smaller operation must not lower the recorded peak.
+    BootMetrics::noteOperationUs(1);
+    boot.recordFirstNetworkReady();  // Patches the record, folding in the current peak.
+    EXPECT_GE(readRecords()[0].peakOperationUs, 7000);
+}
+
+}  // namespace net
+}  // namespace android
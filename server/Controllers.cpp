@@ -14,22 +14,29 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+
 #include <cinttypes>
+#include <iterator>
 #include <regex>
 #include <set>
 #include <string>
+#include <thread>
 
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <cutils/properties.h>
 #include <netdutils/Stopwatch.h>
 
 #define LOG_TAG "Netd"
 #include <log/log.h>
 
+#include "BootMetrics.h"
 #include "Controllers.h"
 #include "IdletimerController.h"
 #include "NetworkController.h"
 #include "RouteController.h"
+#include "StateJournal.h"
 #include "XfrmController.h"
 #include "oem_iptables_hook.h"
 
@@ -42,6 +49,8 @@ using android::netdutils::Stopwatch;
 
 auto Controllers::execIptablesRestore  = ::execIptablesRestore;
 auto Controllers::execIptablesRestoreWithOutput = ::execIptablesRestoreWithOutput;
+auto Controllers::execIptablesRestoreQueued = ::execIptablesRestoreQueued;
+auto Controllers::flushIptablesRestore = ::flushIptablesRestore;
 
 netdutils::Log gLog("netd");
 netdutils::Log gUnsolicitedLog("netdUnsolicited");
@@ -49,59 +58,131 @@ netdutils::Log gUnsolicitedLog("netdUnsolicited");
 namespace {
 
 /**
- * List of module chains to be created, along with explicit ordering. ORDERING
- * IS CRITICAL, AND SHOULD BE TRIPLE-CHECKED WITH EACH CHANGE.
+ * The startup chain topology: every jump netd programs from a top-level chain into a module
+ * chain, as a single compile-time table. Rows are grouped by (target, table, parent); the row
+ * order within a group is the order of the jumps in the parent chain, i.e. netfilter evaluation
+ * order, and the group order determines how the blocks are concatenated into each protocol's
+ * single startup commit. ORDERING IS CRITICAL, AND SHOULD BE TRIPLE-CHECKED WITH EACH CHANGE.
+ * The static_asserts below catch the structural mistakes (split groups, duplicate jumps,
+ * inconsistent ownership) at compile time.
  */
-static const std::vector<const char*> FILTER_INPUT = {
+constexpr ChainTopologyEntry kChainTopology[] = {
+        // clang-format off
         // Bandwidth should always be early in input chain, to make sure we
         // correctly count incoming traffic against data plan.
-        BandwidthController::LOCAL_INPUT,
-        FirewallController::LOCAL_INPUT,
-};
+        {V4V6, "filter", "INPUT",       BandwidthController::LOCAL_INPUT,           true},
+        {V4V6, "filter", "INPUT",       FirewallController::LOCAL_INPUT,            true},
 
-static const std::vector<const char*> FILTER_FORWARD = {
-        OEM_IPTABLES_FILTER_FORWARD,
-        FirewallController::LOCAL_FORWARD,
-        BandwidthController::LOCAL_FORWARD,
-        TetherController::LOCAL_FORWARD,
-};
+        {V4V6, "filter", "FORWARD",     OEM_IPTABLES_FILTER_FORWARD,                true},
+        {V4V6, "filter", "FORWARD",     FirewallController::LOCAL_FORWARD,          true},
+        {V4V6, "filter", "FORWARD",     BandwidthController::LOCAL_FORWARD,         true},
+        {V4V6, "filter", "FORWARD",     TetherController::LOCAL_FORWARD,            true},
 
-static const std::vector<const char*> FILTER_OUTPUT = {
-        OEM_IPTABLES_FILTER_OUTPUT,
-        FirewallController::LOCAL_OUTPUT,
-        StrictController::LOCAL_OUTPUT,
-        BandwidthController::LOCAL_OUTPUT,
-};
+        {V4V6, "raw",    "PREROUTING",  IdletimerController::LOCAL_RAW_PREROUTING,  true},
+        {V4V6, "raw",    "PREROUTING",  BandwidthController::LOCAL_RAW_PREROUTING,  true},
+        {V4V6, "raw",    "PREROUTING",  TetherController::LOCAL_RAW_PREROUTING,     true},
 
-static const std::vector<const char*> RAW_PREROUTING = {
-        IdletimerController::LOCAL_RAW_PREROUTING,
-        BandwidthController::LOCAL_RAW_PREROUTING,
-        TetherController::LOCAL_RAW_PREROUTING,
-};
+        {V4V6, "mangle", "FORWARD",     TetherController::LOCAL_MANGLE_FORWARD,     true},
 
-static const std::vector<const char*> MANGLE_POSTROUTING = {
-        OEM_IPTABLES_MANGLE_POSTROUTING,
-        BandwidthController::LOCAL_MANGLE_POSTROUTING,
-        IdletimerController::LOCAL_MANGLE_POSTROUTING,
-};
+        {V4V6, "mangle", "INPUT",       WakeupController::LOCAL_MANGLE_INPUT,       true},
+        {V4V6, "mangle", "INPUT",       RouteController::LOCAL_MANGLE_INPUT,        true},
 
-static const std::vector<const char*> MANGLE_INPUT = {
-        WakeupController::LOCAL_MANGLE_INPUT,
-        RouteController::LOCAL_MANGLE_INPUT,
-};
+        {V4,   "nat",    "PREROUTING",  OEM_IPTABLES_NAT_PREROUTING,                true},
 
-static const std::vector<const char*> MANGLE_FORWARD = {
-        TetherController::LOCAL_MANGLE_FORWARD,
-};
+        {V4,   "nat",    "POSTROUTING", TetherController::LOCAL_NAT_POSTROUTING,    true},
 
-static const std::vector<const char*> NAT_PREROUTING = {
-        OEM_IPTABLES_NAT_PREROUTING,
-};
+        // Vendor code modifies filter OUTPUT and mangle POSTROUTING directly, so netd does not
+        // own them exclusively and must list them instead of flushing them (there is no shared
+        // V4V6 listing, hence the per-protocol rows).
+        {V4,   "filter", "OUTPUT",      OEM_IPTABLES_FILTER_OUTPUT,                 false},
+        {V4,   "filter", "OUTPUT",      FirewallController::LOCAL_OUTPUT,           false},
+        {V4,   "filter", "OUTPUT",      StrictController::LOCAL_OUTPUT,             false},
+        {V4,   "filter", "OUTPUT",      BandwidthController::LOCAL_OUTPUT,          false},
+
+        {V4,   "mangle", "POSTROUTING", OEM_IPTABLES_MANGLE_POSTROUTING,            false},
+        {V4,   "mangle", "POSTROUTING", BandwidthController::LOCAL_MANGLE_POSTROUTING, false},
+        {V4,   "mangle", "POSTROUTING", IdletimerController::LOCAL_MANGLE_POSTROUTING, false},
 
-static const std::vector<const char*> NAT_POSTROUTING = {
-        TetherController::LOCAL_NAT_POSTROUTING,
+        {V6,   "filter", "OUTPUT",      OEM_IPTABLES_FILTER_OUTPUT,                 false},
+        {V6,   "filter", "OUTPUT",      FirewallController::LOCAL_OUTPUT,           false},
+        {V6,   "filter", "OUTPUT",      StrictController::LOCAL_OUTPUT,             false},
+        {V6,   "filter", "OUTPUT",      BandwidthController::LOCAL_OUTPUT,          false},
+
+        {V6,   "mangle", "POSTROUTING", OEM_IPTABLES_MANGLE_POSTROUTING,            false},
+        {V6,   "mangle", "POSTROUTING", BandwidthController::LOCAL_MANGLE_POSTROUTING, false},
+        {V6,   "mangle", "POSTROUTING", IdletimerController::LOCAL_MANGLE_POSTROUTING, false},
+        // clang-format on
 };
 
+constexpr bool chainEq(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+constexpr bool sameGroup(const ChainTopologyEntry& a, const ChainTopologyEntry& b) {
+    return a.target == b.target && chainEq(a.table, b.table) && chainEq(a.parent, b.parent);
+}
+
+// The generator emits one table block per group boundary, so a group split across the table
+// would emit two blocks that fight over the same parent chain.
+constexpr bool topologyGroupsAreContiguous() {
+    for (size_t i = 1; i < std::size(kChainTopology); i++) {
+        if (sameGroup(kChainTopology[i], kChainTopology[i - 1])) continue;
+        for (size_t j = 0; j + 1 < i; j++) {
+            if (sameGroup(kChainTopology[i], kChainTopology[j])) return false;
+        }
+    }
+    return true;
+}
+
+// Each protocol's groups must also be contiguous: initChildChains() commits a protocol's blocks
+// the first time it sees the target change.
+constexpr bool topologyTargetsAreContiguous() {
+    for (size_t i = 1; i < std::size(kChainTopology); i++) {
+        if (kChainTopology[i].target == kChainTopology[i - 1].target) continue;
+        for (size_t j = 0; j + 1 < i; j++) {
+            if (kChainTopology[i].target == kChainTopology[j].target) return false;
+        }
+    }
+    return true;
+}
+
+// A parent chain is either exclusively netd's or it is not; a group claiming both would be
+// flushed and listed at the same time.
+constexpr bool topologyOwnershipIsConsistent() {
+    for (size_t i = 1; i < std::size(kChainTopology); i++) {
+        if (sameGroup(kChainTopology[i], kChainTopology[i - 1]) &&
+            kChainTopology[i].exclusive != kChainTopology[i - 1].exclusive) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A child jumped to twice from the same parent would see (and count) every packet twice.
+constexpr bool topologyHasNoDuplicateJumps() {
+    for (size_t i = 0; i < std::size(kChainTopology); i++) {
+        for (size_t j = i + 1; j < std::size(kChainTopology); j++) {
+            if (sameGroup(kChainTopology[i], kChainTopology[j]) &&
+                chainEq(kChainTopology[i].child, kChainTopology[j].child)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static_assert(topologyGroupsAreContiguous(), "kChainTopology: (target, table, parent) groups "
+                                             "must be contiguous");
+static_assert(topologyTargetsAreContiguous(), "kChainTopology: each target's rows must be "
+                                              "contiguous");
+static_assert(topologyOwnershipIsConsistent(), "kChainTopology: a group must be uniformly "
+                                               "exclusive or shared");
+static_assert(topologyHasNoDuplicateJumps(), "kChainTopology: duplicate (parent, child) jump");
+
 // Commands to create child chains and to match created chains in iptables -S output. Keep in sync.
 static const char* CHILD_CHAIN_TEMPLATE = "-A %s -j %s\n";
 static const std::regex CHILD_CHAIN_REGEX("^-A ([^ ]+) -j ([^ ]+)$",
@@ -150,10 +231,12 @@ std::set<std::string> Controllers::findExistingChildChains(const IptablesTarget
 }
 
 /* static */
-void Controllers::createChildChains(IptablesTarget target, const char* table,
-                                    const char* parentChain,
-                                    const std::vector<const char*>& childChains,
-                                    bool exclusive) {
+std::string Controllers::makeChildChainCommands(const ChainTopologyEntry* begin,
+                                                const ChainTopologyEntry* end) {
+    const IptablesTarget target = begin->target;
+    const char* table = begin->table;
+    const char* parentChain = begin->parent;
+    const bool exclusive = begin->exclusive;
     std::string command = StringPrintf("*%s\n", table);
 
     // We cannot just clear all the chains we create because vendor code modifies filter OUTPUT and
@@ -178,21 +261,26 @@ void Controllers::createChildChains(IptablesTarget target, const char* table,
         existingChildChains = findExistingChildChains(target, table, parentChain);
     }
 
-    for (const auto& childChain : childChains) {
+    for (const ChainTopologyEntry* entry = begin; entry != end; entry++) {
         // Always clear the child chain.
-        StringAppendF(&command, ":%s -\n", childChain);
+        StringAppendF(&command, ":%s -\n", entry->child);
         // But only add it to the parent chain if it's not already there.
-        if (existingChildChains.find(childChain) == existingChildChains.end()) {
-            StringAppendF(&command, CHILD_CHAIN_TEMPLATE, parentChain, childChain);
+        if (existingChildChains.find(entry->child) == existingChildChains.end()) {
+            StringAppendF(&command, CHILD_CHAIN_TEMPLATE, parentChain, entry->child);
         }
     }
     command += "COMMIT\n";
-    execIptablesRestore(target, command);
+    return command;
 }
 
 Controllers::Controllers()
     : wakeupCtrl(
               [this](const WakeupController::ReportArgs& args) {
+                  // With a ring consumer attached, metadata travels via shared memory and the
+                  // per-event binder callback is skipped entirely.
+                  if (wakeupEventRing.write(args)) {
+                      return;
+                  }
                   const auto listener = eventReporter.getNetdEventListener();
                   if (listener == nullptr) {
                       gLog.error("getNetdEventListener() returned nullptr. dropping wakeup event");
@@ -220,19 +308,30 @@ void Controllers::initChildChains() {
      * otherwise DROP/REJECT.
      */
 
-    // Create chains for child modules.
-    createChildChains(V4V6, "filter", "INPUT", FILTER_INPUT, true);
-    createChildChains(V4V6, "filter", "FORWARD", FILTER_FORWARD, true);
-    createChildChains(V4V6, "raw", "PREROUTING", RAW_PREROUTING, true);
-    createChildChains(V4V6, "mangle", "FORWARD", MANGLE_FORWARD, true);
-    createChildChains(V4V6, "mangle", "INPUT", MANGLE_INPUT, true);
-    createChildChains(V4, "nat", "PREROUTING", NAT_PREROUTING, true);
-    createChildChains(V4, "nat", "POSTROUTING", NAT_POSTROUTING, true);
-
-    createChildChains(V4, "filter", "OUTPUT", FILTER_OUTPUT, false);
-    createChildChains(V6, "filter", "OUTPUT", FILTER_OUTPUT, false);
-    createChildChains(V4, "mangle", "POSTROUTING", MANGLE_POSTROUTING, false);
-    createChildChains(V6, "mangle", "POSTROUTING", MANGLE_POSTROUTING, false);
+    // Create chains for child modules, generating everything from kChainTopology. All the table
+    // blocks for a given protocol are concatenated into a single restore command, so chain setup
+    // costs one pipe round-trip per protocol instead of one per parent chain. The commands are
+    // queued rather than executed: the restore children parse and commit each protocol's blocks
+    // while this thread builds the next ones (including the listing round-trips for the chains
+    // netd doesn't exclusively own, which remain synchronous because we need their output).
+    std::string commands;
+    const ChainTopologyEntry* groupStart = std::begin(kChainTopology);
+    for (const ChainTopologyEntry* entry = groupStart; entry != std::end(kChainTopology);
+         entry++) {
+        if (sameGroup(*entry, *groupStart)) continue;
+        commands += makeChildChainCommands(groupStart, entry);
+        if (entry->target != groupStart->target) {
+            execIptablesRestoreQueued(groupStart->target, commands);
+            commands.clear();
+        }
+        groupStart = entry;
+    }
+    commands += makeChildChainCommands(groupStart, std::end(kChainTopology));
+    execIptablesRestoreQueued(groupStart->target, commands);
+
+    if (flushIptablesRestore() != 0) {
+        gLog.error("Failed to create one or more child chains");
+    }
 }
 
 void Controllers::initIptablesRules() {
@@ -258,6 +357,15 @@ void Controllers::initIptablesRules() {
      */
     bandwidthCtrl.setupIptablesHooks();
     gLog.info("Setting up BandwidthController hooks: %" PRId64 "us", s.getTimeAndResetUs());
+}
+
+// Sets up the controllers that nothing needs on the boot critical path: their kernel state only
+// matters once the framework starts using them, typically long after the first network is up.
+// Their top-level chains and the jumps into them already exist (initChildChains), so deferring
+// only delays populating chains netd exclusively owns. Runs on a background thread started by
+// init(); entry points into these controllers block on waitForDeferredInit() first.
+void Controllers::initDeferred() {
+    Stopwatch s;
 
     /*
      * Counts in nat: PREROUTING, POSTROUTING.
@@ -273,12 +381,74 @@ void Controllers::initIptablesRules() {
     gLog.info("Setting up StrictController hooks: %" PRId64 "us", s.getTimeAndResetUs());
 }
 
+void Controllers::waitForDeferredInit() {
+    if (mDeferredInit.valid()) {
+        mDeferredInit.wait();
+    }
+}
+
+int Controllers::waitForPendingAsyncCommands() {
+    int ret = 0;
+    if (iptablesRestoreCtrl.flushPipeline() == -1) {
+        ret = -EIO;
+    }
+    if (int res = RouteController::waitForPendingRoutes(); ret == 0) {
+        ret = res;
+    }
+    if (int res = InterfaceController::waitForPendingSysctlWrites(); ret == 0) {
+        ret = res;
+    }
+    return ret;
+}
+
 void Controllers::init() {
-    initIptablesRules();
     Stopwatch s;
 
-    if (int ret = bandwidthCtrl.enableBandwidthControl()) {
-        gLog.error("Failed to initialize BandwidthController (%s)", strerror(-ret));
+    // Initialization is phased by the kernel state each step touches:
+    // - initIptablesRules must finish before enableBandwidthControl, which populates the bw_*
+    //   chains it creates. Both run on this thread, in that order.
+    // - RouteController::Init touches only fib rules and routing tables, and XfrmController::Init
+    //   touches only xfrm state, so each runs on its own thread in parallel with the iptables work
+    //   and with the other.
+    int64_t routeInitUs = 0;
+    std::thread routeThread([&routeInitUs] {
+        Stopwatch st;
+        if (int ret = RouteController::Init(NetworkController::LOCAL_NET_ID)) {
+            gLog.error("Failed to initialize RouteController (%s)", strerror(-ret));
+        }
+        routeInitUs = st.getTimeAndResetUs();
+        gLog.info("Initializing RouteController: %" PRId64 "us", routeInitUs);
+    });
+    std::thread xfrmThread([] {
+        Stopwatch st;
+        netdutils::Status xStatus = XfrmController::Init();
+        if (!isOk(xStatus)) {
+            gLog.error("Failed to initialize XfrmController (%s)",
+                       netdutils::toString(xStatus).c_str());
+        }
+        gLog.info("Initializing XfrmController: %" PRId64 "us", st.getTimeAndResetUs());
+    });
+
+    Stopwatch sIptables;
+    initIptablesRules();
+    const int64_t iptablesInitUs = sIptables.timeTakenUs();
+
+    // The rarely-used controllers finish setting up in the background; the iptables restore
+    // lanes serialize their commands against the bandwidth setup below, and anything dispatching
+    // into them waits via waitForDeferredInit().
+    mDeferredInit = std::async(std::launch::async, &Controllers::initDeferred, this).share();
+
+    Stopwatch sBandwidth;
+    const int bwRet = bandwidthCtrl.enableBandwidthControl();
+    if (!bwRet) {
+        gLog.info("Enabling bandwidth control: %" PRId64 "us", sBandwidth.getTimeAndResetUs());
+    }
+
+    routeThread.join();
+    xfrmThread.join();
+
+    if (bwRet) {
+        gLog.error("Failed to initialize BandwidthController (%s)", strerror(-bwRet));
         // A failure to init almost definitely means that iptables failed to load
         // our static ruleset, which then basically means network accounting will not work.
         // As such simply exit netd.  This may crash loop the system, but by failing
@@ -286,18 +456,34 @@ void Controllers::init() {
         // a mainline update breaking things.
         exit(1);
     }
-    gLog.info("Enabling bandwidth control: %" PRId64 "us", s.getTimeAndResetUs());
 
-    if (int ret = RouteController::Init(NetworkController::LOCAL_NET_ID)) {
-        gLog.error("Failed to initialize RouteController (%s)", strerror(-ret));
+    // Warm restart: replay the network topology journaled by the previous netd instance, so a
+    // netd crash costs one incremental replay instead of seconds of empty networks while the
+    // framework reprograms everything. Runs after RouteController::Init has finished (the joins
+    // above) because the replay programs rules and routes through RouteController. Opt-in while
+    // it soaks.
+    if (property_get_bool("persist.netd.state_journal", false)) {
+        Stopwatch sJournal;
+        // Deliberately never destroyed: netd runs until it is killed.
+        auto* journal = new StateJournal("/data/misc/net/netd_state.journal");
+        if (int ret = netCtrl.restoreFromStateJournal(journal)) {
+            gLog.error("Failed to restore state journal (%s)", strerror(-ret));
+        }
+        netCtrl.enableStateJournal(journal);
+        gLog.info("Restoring state journal: %" PRId64 "us", sJournal.getTimeAndResetUs());
     }
-    gLog.info("Initializing RouteController: %" PRId64 "us", s.getTimeAndResetUs());
 
-    netdutils::Status xStatus = XfrmController::Init();
-    if (!isOk(xStatus)) {
-        gLog.error("Failed to initialize XfrmController (%s)", netdutils::toString(xStatus).c_str());
-    };
-    gLog.info("Initializing XfrmController: %" PRId64 "us", s.getTimeAndResetUs());
+    const int64_t initTotalUs = s.getTimeAndResetUs();
+    gLog.info("Initializing controllers: %" PRId64 "us total", initTotalUs);
+
+    // Append this boot's record to the durable metrics file, outside the timed region. Fleet
+    // analysis reads boot-over-boot netd trends from the file instead of full traces.
+    // Deliberately never destroyed: netd runs until it is killed.
+    auto* bootMetrics = new BootMetrics("/data/misc/net/boot_metrics");
+    if (int ret = bootMetrics->recordInit(initTotalUs, iptablesInitUs, routeInitUs)) {
+        gLog.error("Failed to record boot metrics (%s)", strerror(-ret));
+    }
+    BootMetrics::instance = bootMetrics;
 }
 
 Controllers* gCtls = nullptr;
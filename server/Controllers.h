@@ -20,6 +20,7 @@
 #include "BandwidthController.h"
 #include "EventReporter.h"
 #include "FirewallController.h"
+#include "GenerationRegistry.h"
 #include "IdletimerController.h"
 #include "InterfaceController.h"
 #include "IptablesRestoreController.h"
@@ -29,12 +30,26 @@
 #include "TcpSocketMonitor.h"
 #include "TetherController.h"
 #include "WakeupController.h"
+#include "WakeupEventRing.h"
 #include "XfrmController.h"
 #include "netdutils/Log.h"
 
+#include <future>
+
 namespace android {
 namespace net {
 
+// One (parent, child) jump of the startup iptables chain topology. The full topology is the
+// constexpr kChainTopology table in Controllers.cpp; rows are grouped by (target, table, parent)
+// and ordered within each group by netfilter evaluation order.
+struct ChainTopologyEntry {
+    IptablesTarget target;
+    const char* table;
+    const char* parent;
+    const char* child;
+    bool exclusive;  // True when netd owns |parent| outright and may flush it at boot.
+};
+
 class Controllers {
   public:
     Controllers();
@@ -51,20 +66,45 @@ class Controllers {
     WakeupController wakeupCtrl;
     XfrmController xfrmCtrl;
     TcpSocketMonitor tcpSocketMonitor;
+    GenerationRegistry generationRegistry;
+    WakeupEventRing wakeupEventRing;
 
-    void init();
+    void init() NETD_COLD;
+
+    // Blocks until the deferred controller setup started by init() has finished. Callers that
+    // dispatch into a deferred controller (idletimer, strict mode) wait here first; after the
+    // background phase completes this is a single atomic load. Safe to call from any thread.
+    void waitForDeferredInit();
+
+    // Sync barrier over every asynchronous command path netd runs: the queued iptables-restore
+    // pipeline, the async route worker and the async sysctl worker. Each path applies its queue
+    // strictly in enqueue order, so a sequence of mutations fed to one path stays ordered and
+    // paths are free to overlap (e.g. an iptables commit in flight while rule batches are sent);
+    // this call is the cross-path ordering point for flows that must observe a completed
+    // transition - before reading kernel state back, or before replying to a caller that will.
+    // Returns 0, or the first error any path has seen since its last barrier.
+    int waitForPendingAsyncCommands();
 
   private:
     friend class ControllersTest;
-    void initIptablesRules();
-    static void initChildChains();
+    void initIptablesRules() NETD_COLD;
+    void initDeferred() NETD_COLD;
+    static void initChildChains() NETD_COLD;
     static std::set<std::string> findExistingChildChains(const IptablesTarget target,
                                                          const char* table,
                                                          const char* parentChain);
-    static void createChildChains(IptablesTarget target, const char* table, const char* parentChain,
-                                  const std::vector<const char*>& childChains, bool exclusive);
+    // Renders one (target, table, parent) group of topology rows, [begin, end), into an
+    // iptables-restore table block.
+    static std::string makeChildChainCommands(const ChainTopologyEntry* begin,
+                                              const ChainTopologyEntry* end);
     static int (*execIptablesRestore)(IptablesTarget, const std::string&);
     static int (*execIptablesRestoreWithOutput)(IptablesTarget, const std::string&, std::string *);
+    static int (*execIptablesRestoreQueued)(IptablesTarget, const std::string&);
+    static int (*flushIptablesRestore)();
+
+    // Completion of the background phase run by initDeferred(). Invalid until init() has started
+    // it; shared so several binder threads can wait on it concurrently.
+    std::shared_future<void> mDeferredInit;
 };
 
 extern netdutils::Log gLog;
@@ -38,6 +38,8 @@ class ControllersTest : public IptablesBaseTest {
     ControllersTest() {
         Controllers::execIptablesRestore = fakeExecIptablesRestore;
         Controllers::execIptablesRestoreWithOutput = fakeExecIptablesRestoreWithOutput;
+        Controllers::execIptablesRestoreQueued = fakeExecIptablesRestoreQueued;
+        Controllers::flushIptablesRestore = fakeFlushIptablesRestore;
     }
 
   protected:
@@ -68,7 +70,9 @@ TEST_F(ControllersTest, TestFindExistingChildChains) {
 }
 
 TEST_F(ControllersTest, TestInitIptablesRules) {
-    // Test what happens when we boot and there are no rules.
+    // Test what happens when we boot and there are no rules. All the table blocks for a given
+    // protocol are committed in a single restore command; the only separate commands are the
+    // listing round-trips for the chains netd doesn't exclusively own.
     ExpectedIptablesCommands expected = {
             {V4V6,
              "*filter\n"
@@ -78,8 +82,7 @@ TEST_F(ControllersTest, TestInitIptablesRules) {
              "-A INPUT -j bw_INPUT\n"
              ":fw_INPUT -\n"
              "-A INPUT -j fw_INPUT\n"
-             "COMMIT\n"},
-            {V4V6,
+             "COMMIT\n"
              "*filter\n"
              ":FORWARD -\n"
              "-F FORWARD\n"
@@ -91,8 +94,7 @@ TEST_F(ControllersTest, TestInitIptablesRules) {
              "-A FORWARD -j bw_FORWARD\n"
              ":tetherctrl_FORWARD -\n"
              "-A FORWARD -j tetherctrl_FORWARD\n"
-             "COMMIT\n"},
-            {V4V6,
+             "COMMIT\n"
              "*raw\n"
              ":PREROUTING -\n"
              "-F PREROUTING\n"
@@ -102,15 +104,13 @@ TEST_F(ControllersTest, TestInitIptablesRules) {
              "-A PREROUTING -j bw_raw_PREROUTING\n"
              ":tetherctrl_raw_PREROUTING -\n"
              "-A PREROUTING -j tetherctrl_raw_PREROUTING\n"
-             "COMMIT\n"},
-            {V4V6,
+             "COMMIT\n"
              "*mangle\n"
              ":FORWARD -\n"
              "-F FORWARD\n"
              ":tetherctrl_mangle_FORWARD -\n"
              "-A FORWARD -j tetherctrl_mangle_FORWARD\n"
-             "COMMIT\n"},
-            {V4V6,
+             "COMMIT\n"
              "*mangle\n"
              ":INPUT -\n"
              "-F INPUT\n"
@@ -119,25 +119,27 @@ TEST_F(ControllersTest, TestInitIptablesRules) {
              ":routectrl_mangle_INPUT -\n"
              "-A INPUT -j routectrl_mangle_INPUT\n"
              "COMMIT\n"},
+            {V4,
+             "*filter\n"
+             "-S OUTPUT\n"
+             "COMMIT\n"},
+            {V4,
+             "*mangle\n"
+             "-S POSTROUTING\n"
+             "COMMIT\n"},
             {V4,
              "*nat\n"
              ":PREROUTING -\n"
              "-F PREROUTING\n"
              ":oem_nat_pre -\n"
              "-A PREROUTING -j oem_nat_pre\n"
-             "COMMIT\n"},
-            {V4,
+             "COMMIT\n"
              "*nat\n"
              ":POSTROUTING -\n"
              "-F POSTROUTING\n"
              ":tetherctrl_nat_POSTROUTING -\n"
              "-A POSTROUTING -j tetherctrl_nat_POSTROUTING\n"
-             "COMMIT\n"},
-            {V4,
-             "*filter\n"
-             "-S OUTPUT\n"
-             "COMMIT\n"},
-            {V4,
+             "COMMIT\n"
              "*filter\n"
              ":oem_out -\n"
              "-A OUTPUT -j oem_out\n"
@@ -147,11 +149,23 @@ TEST_F(ControllersTest, TestInitIptablesRules) {
              "-A OUTPUT -j st_OUTPUT\n"
              ":bw_OUTPUT -\n"
              "-A OUTPUT -j bw_OUTPUT\n"
+             "COMMIT\n"
+             "*mangle\n"
+             ":oem_mangle_post -\n"
+             "-A POSTROUTING -j oem_mangle_post\n"
+             ":bw_mangle_POSTROUTING -\n"
+             "-A POSTROUTING -j bw_mangle_POSTROUTING\n"
+             ":idletimer_mangle_POSTROUTING -\n"
+             "-A POSTROUTING -j idletimer_mangle_POSTROUTING\n"
              "COMMIT\n"},
             {V6,
              "*filter\n"
              "-S OUTPUT\n"
              "COMMIT\n"},
+            {V6,
+             "*mangle\n"
+             "-S POSTROUTING\n"
+             "COMMIT\n"},
             {V6,
              "*filter\n"
              ":oem_out -\n"
@@ -162,25 +176,7 @@ TEST_F(ControllersTest, TestInitIptablesRules) {
              "-A OUTPUT -j st_OUTPUT\n"
              ":bw_OUTPUT -\n"
              "-A OUTPUT -j bw_OUTPUT\n"
-             "COMMIT\n"},
-            {V4,
-             "*mangle\n"
-             "-S POSTROUTING\n"
-             "COMMIT\n"},
-            {V4,
-             "*mangle\n"
-             ":oem_mangle_post -\n"
-             "-A POSTROUTING -j oem_mangle_post\n"
-             ":bw_mangle_POSTROUTING -\n"
-             "-A POSTROUTING -j bw_mangle_POSTROUTING\n"
-             ":idletimer_mangle_POSTROUTING -\n"
-             "-A POSTROUTING -j idletimer_mangle_POSTROUTING\n"
-             "COMMIT\n"},
-            {V6,
-             "*mangle\n"
-             "-S POSTROUTING\n"
-             "COMMIT\n"},
-            {V6,
+             "COMMIT\n"
              "*mangle\n"
              ":oem_mangle_post -\n"
              "-A POSTROUTING -j oem_mangle_post\n"
@@ -218,29 +214,29 @@ TEST_F(ControllersTest, TestInitIptablesRules) {
     // Now set test expectations.
 
     // 1. Test that if we find rules that we don't create ourselves, we ignore them.
-    // First check that command #7 is where we list the OUTPUT chain in the (IPv4) filter table:
-    ASSERT_NE(std::string::npos, expected[7].second.find("*filter\n-S OUTPUT\n"));
+    // First check that command #1 is where we list the OUTPUT chain in the (IPv4) filter table:
+    ASSERT_NE(std::string::npos, expected[1].second.find("*filter\n-S OUTPUT\n"));
     // ... and pretend that when we run that command, we find the following rules. Because we don't
     // create any of these rules ourselves, our behaviour is unchanged.
-    sIptablesRestoreOutput[7] =
+    sIptablesRestoreOutput[1] =
         "-P OUTPUT ACCEPT\n"
         "-A OUTPUT -o r_rmnet_data8 -p udp -m udp --dport 1900 -j DROP\n";
 
     // 2. Test that rules that we create ourselves are not added if they already exist.
     // Pretend that when we list the OUTPUT chain in the (IPv6) filter table, we find the oem_out
     // and st_OUTPUT chains:
-    ASSERT_NE(std::string::npos, expected[9].second.find("*filter\n-S OUTPUT\n"));
-    sIptablesRestoreOutput[9] =
+    ASSERT_NE(std::string::npos, expected[4].second.find("*filter\n-S OUTPUT\n"));
+    sIptablesRestoreOutput[4] =
         "-A OUTPUT -j oem_out\n"
         "-A OUTPUT -j st_OUTPUT\n";
-    // ... and expect that when we populate the OUTPUT chain, we do not re-add them.
-    DELETE_SUBSTRING("-A OUTPUT -j oem_out\n", expected[10].second);
-    DELETE_SUBSTRING("-A OUTPUT -j st_OUTPUT\n", expected[10].second);
+    // ... and expect that when the IPv6 commit populates the OUTPUT chain, we do not re-add them.
+    DELETE_SUBSTRING("-A OUTPUT -j oem_out\n", expected[6].second);
+    DELETE_SUBSTRING("-A OUTPUT -j st_OUTPUT\n", expected[6].second);
 
-    // 3. Now test that when we list the POSTROUTING chain in the mangle table, we find a mixture of
-    // netd-created rules and vendor rules:
-    ASSERT_NE(std::string::npos, expected[13].second.find("*mangle\n-S POSTROUTING\n"));
-    sIptablesRestoreOutput[13] =
+    // 3. Now test that when we list the POSTROUTING chain in the (IPv6) mangle table, we find a
+    // mixture of netd-created rules and vendor rules:
+    ASSERT_NE(std::string::npos, expected[5].second.find("*mangle\n-S POSTROUTING\n"));
+    sIptablesRestoreOutput[5] =
         "-P POSTROUTING ACCEPT\n"
         "-A POSTROUTING -j oem_mangle_post\n"
         "-A POSTROUTING -j bw_mangle_POSTROUTING\n"
@@ -248,18 +244,27 @@ TEST_F(ControllersTest, TestInitIptablesRules) {
         "-A POSTROUTING -j qcom_qos_reset_POSTROUTING\n"
         "-A POSTROUTING -j qcom_qos_filter_POSTROUTING\n";
     // and expect that we don't re-add the netd-created rules that already exist.
-    DELETE_SUBSTRING("-A POSTROUTING -j oem_mangle_post\n", expected[14].second);
-    DELETE_SUBSTRING("-A POSTROUTING -j bw_mangle_POSTROUTING\n", expected[14].second);
-    DELETE_SUBSTRING("-A POSTROUTING -j idletimer_mangle_POSTROUTING\n", expected[14].second);
+    DELETE_SUBSTRING("-A POSTROUTING -j oem_mangle_post\n", expected[6].second);
+    DELETE_SUBSTRING("-A POSTROUTING -j bw_mangle_POSTROUTING\n", expected[6].second);
+    DELETE_SUBSTRING("-A POSTROUTING -j idletimer_mangle_POSTROUTING\n", expected[6].second);
 
-    // In this last case, also check that our expectations are reasonable.
-    std::string expectedCmd14 =
+    // In this last case, also check that our expectations are reasonable. Both the filter and
+    // mangle deletions above land in the single IPv6 commit.
+    std::string expectedCmd6 =
+        "*filter\n"
+        ":oem_out -\n"
+        ":fw_OUTPUT -\n"
+        "-A OUTPUT -j fw_OUTPUT\n"
+        ":st_OUTPUT -\n"
+        ":bw_OUTPUT -\n"
+        "-A OUTPUT -j bw_OUTPUT\n"
+        "COMMIT\n"
         "*mangle\n"
         ":oem_mangle_post -\n"
         ":bw_mangle_POSTROUTING -\n"
         ":idletimer_mangle_POSTROUTING -\n"
         "COMMIT\n";
-    ASSERT_EQ(expectedCmd14, expected[14].second);
+    ASSERT_EQ(expectedCmd6, expected[6].second);
 
     // Finally, actually test that initChildChains runs the expected commands, and nothing more.
     initChildChains();
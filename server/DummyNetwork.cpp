@@ -33,7 +33,7 @@ namespace net {
 const char* DummyNetwork::INTERFACE_NAME = "dummy0";
 
 DummyNetwork::DummyNetwork(unsigned netId) : Network(netId) {
-    mInterfaces.insert(INTERFACE_NAME);
+    insertInterface(INTERFACE_NAME);
 }
 
 DummyNetwork::~DummyNetwork() {
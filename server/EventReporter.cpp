@@ -14,6 +14,12 @@
  * limitations under the License.
  */
 
+#define LOG_TAG "Netd"
+
+#include <inttypes.h>
+
+#include <log/log.h>
+
 #include "EventReporter.h"
 
 using android::interface_cast;
@@ -38,11 +44,61 @@ android::sp<INetdEventListener> EventReporter::getNetdEventListener() {
     return mNetdEventListener;
 }
 
+EventReporter::~EventReporter() {
+    std::lock_guard lock(mUnsolicitedMutex);
+    for (auto& [listener, queue] : mUnsolListenerQueues) {
+        {
+            std::lock_guard queueLock(queue->lock);
+            queue->running = false;
+        }
+        queue->cv.notify_all();
+        queue->thread.join();
+    }
+}
+
 EventReporter::UnsolListenerMap EventReporter::getNetdUnsolicitedEventListenerMap() const {
     std::lock_guard lock(mUnsolicitedMutex);
     return mUnsolListenerMap;
 }
 
+void EventReporter::dispatchUnsolEvent(const UnsolEvent& event) {
+    std::lock_guard lock(mUnsolicitedMutex);
+    for (auto& [listener, queue] : mUnsolListenerQueues) {
+        std::lock_guard queueLock(queue->lock);
+        if (queue->events.size() >= kMaxQueuedUnsolEvents) {
+            // The listener is too slow to keep up; dropping here keeps the netlink receive
+            // path from backing up into ENOBUFS on the kernel socket.
+            queue->drops++;
+            continue;
+        }
+        queue->events.push_back(event);
+        queue->cv.notify_one();
+    }
+}
+
+void EventReporter::dispatchLoop(ListenerQueue* queue,
+                                 const android::sp<INetdUnsolicitedEventListener>& listener) {
+    std::unique_lock lock(queue->lock);
+    while (true) {
+        queue->cv.wait(lock, [queue]() REQUIRES(queue->lock) {
+            return !queue->running || !queue->events.empty();
+        });
+        if (!queue->running) return;
+
+        UnsolEvent event = std::move(queue->events.front());
+        queue->events.pop_front();
+        if (queue->events.empty() && queue->drops > 0) {
+            ALOGW("unsolicited event queue overflowed: dropped %" PRIu64 " events for listener",
+                  queue->drops);
+            queue->drops = 0;
+        }
+
+        lock.unlock();
+        event(listener);
+        lock.lock();
+    }
+}
+
 void EventReporter::registerUnsolEventListener(
         const android::sp<INetdUnsolicitedEventListener>& listener) {
     std::lock_guard lock(mUnsolicitedMutex);
@@ -69,10 +125,25 @@ void EventReporter::registerUnsolEventListener(
 
     // TODO: Consider to use remote binder address as registering key
     mUnsolListenerMap.insert({listener, deathRecipient});
+
+    auto queue = std::make_unique<ListenerQueue>();
+    queue->thread = std::thread(&EventReporter::dispatchLoop, queue.get(), listener);
+    mUnsolListenerQueues.emplace(listener, std::move(queue));
 }
 
 void EventReporter::unregisterUnsolEventListener(
         const android::sp<INetdUnsolicitedEventListener>& listener) {
     std::lock_guard lock(mUnsolicitedMutex);
     mUnsolListenerMap.erase(listener);
+
+    auto it = mUnsolListenerQueues.find(listener);
+    if (it == mUnsolListenerQueues.end()) return;
+    std::unique_ptr<ListenerQueue> queue = std::move(it->second);
+    mUnsolListenerQueues.erase(it);
+    {
+        std::lock_guard queueLock(queue->lock);
+        queue->running = false;
+    }
+    queue->cv.notify_all();
+    queue->thread.join();
 }
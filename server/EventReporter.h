@@ -17,8 +17,13 @@
 #ifndef NETD_SERVER_EVENT_REPORTER_H
 #define NETD_SERVER_EVENT_REPORTER_H
 
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <thread>
 
 #include <android-base/thread_annotations.h>
 #include <binder/IServiceManager.h>
@@ -35,6 +40,12 @@ class EventReporter {
             std::map<const android::sp<android::net::INetdUnsolicitedEventListener>,
                      const android::sp<android::IBinder::DeathRecipient>>;
 
+    // A deferred unsolicited event: invokes one listener callback.
+    using UnsolEvent =
+            std::function<void(const android::sp<android::net::INetdUnsolicitedEventListener>&)>;
+
+    ~EventReporter();
+
     // Returns the binder reference to the netd events listener service, attempting to fetch it if
     // we do not have it already. This method is threadsafe.
     android::sp<android::net::metrics::INetdEventListener> getNetdEventListener();
@@ -42,6 +53,13 @@ class EventReporter {
     // Returns a copy of the registered listeners.
     UnsolListenerMap getNetdUnsolicitedEventListenerMap() const EXCLUDES(mUnsolicitedMutex);
 
+    // Queues |event| for asynchronous delivery to every registered listener. Each listener
+    // drains its own bounded queue on a dedicated thread, so the caller never blocks on a
+    // binder transaction and one slow listener cannot delay the others. If a listener's queue
+    // is full the event is dropped for that listener and the overflow is logged once the
+    // queue drains.
+    void dispatchUnsolEvent(const UnsolEvent& event) EXCLUDES(mUnsolicitedMutex);
+
     void registerUnsolEventListener(
             const android::sp<android::net::INetdUnsolicitedEventListener>& listener)
             EXCLUDES(mUnsolicitedMutex);
@@ -50,11 +68,32 @@ class EventReporter {
             EXCLUDES(mUnsolicitedMutex);
 
   private:
+    // Upper bound on events queued per listener before drop-and-mark-overflow kicks in.
+    static constexpr size_t kMaxQueuedUnsolEvents = 512;
+
+    // Per-listener dispatch state. Events are appended by the netlink receive path and drained
+    // by the listener's own thread.
+    struct ListenerQueue {
+        std::mutex lock;
+        std::condition_variable cv;
+        std::deque<UnsolEvent> events GUARDED_BY(lock);
+        uint64_t drops GUARDED_BY(lock) = 0;
+        bool running GUARDED_BY(lock) = true;
+        std::thread thread;
+    };
+
+    static void dispatchLoop(ListenerQueue* queue,
+                             const android::sp<android::net::INetdUnsolicitedEventListener>&
+                                     listener);
+
     std::mutex mEventMutex;
     mutable std::mutex mUnsolicitedMutex;
     android::sp<android::net::metrics::INetdEventListener> mNetdEventListener
             GUARDED_BY(mEventMutex);
     UnsolListenerMap mUnsolListenerMap GUARDED_BY(mUnsolicitedMutex);
+    std::map<const android::sp<android::net::INetdUnsolicitedEventListener>,
+             std::unique_ptr<ListenerQueue>>
+            mUnsolListenerQueues GUARDED_BY(mUnsolicitedMutex);
 };
 
 #endif  // NETD_SERVER_EVENT_REPORTER_H
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <map>
+#include <mutex>
 #include <set>
 
 #include <errno.h>
@@ -47,10 +49,6 @@ auto FirewallController::execIptablesRestore = ::execIptablesRestore;
 
 const char* FirewallController::TABLE = "filter";
 
-const char* FirewallController::LOCAL_INPUT = "fw_INPUT";
-const char* FirewallController::LOCAL_OUTPUT = "fw_OUTPUT";
-const char* FirewallController::LOCAL_FORWARD = "fw_FORWARD";
-
 // ICMPv6 types that are required for any form of IPv6 connectivity to work. Note that because the
 // fw_dozable chain is called from both INPUT and OUTPUT, this includes both packets that we need
 // to be able to send (e.g., RS, NS), and packets that we need to receive (e.g., RA, NA).
@@ -156,14 +154,24 @@ int FirewallController::setInterfaceRule(const char* iface, FirewallRule rule) {
 /* static */
 std::string FirewallController::makeCriticalCommands(IptablesTarget target, const char* chainName) {
     // Allow ICMPv6 packets necessary to make IPv6 connectivity work. http://b/23158230 .
-    std::string commands;
-    if (target == V6) {
+    if (target != V6) {
+        return std::string();
+    }
+
+    // The rule text for a given chain never changes, but callers (e.g. the data saver toggle)
+    // regenerate it on every update. Format it once per chain and serve it from a cache.
+    static std::mutex cacheLock;
+    static std::map<std::string, std::string>* cache = new std::map<std::string, std::string>();
+
+    std::lock_guard guard(cacheLock);
+    auto [it, inserted] = cache->try_emplace(chainName);
+    if (inserted) {
         for (size_t i = 0; i < ARRAY_SIZE(ICMPV6_TYPES); i++) {
-            StringAppendF(&commands, "-A %s -p icmpv6 --icmpv6-type %s -j RETURN\n",
+            StringAppendF(&it->second, "-A %s -p icmpv6 --icmpv6-type %s -j RETURN\n",
                    chainName, ICMPV6_TYPES[i]);
         }
     }
-    return commands;
+    return it->second;
 }
 
 }  // namespace net
@@ -49,8 +49,6 @@ public:
 
   /* Match traffic going in/out over the given iface. */
   int setInterfaceRule(const char*, FirewallRule);
-  /* Match traffic owned by given UID. This is specific to a particular chain. */
-  int setUidRule(ChildChain, int, FirewallRule);
 
   int enableChildChains(ChildChain, bool);
 
@@ -58,9 +56,10 @@ public:
 
   static const char* TABLE;
 
-  static const char* LOCAL_INPUT;
-  static const char* LOCAL_OUTPUT;
-  static const char* LOCAL_FORWARD;
+  // constexpr so the chain topology table in Controllers.cpp can reference them at compile time.
+  static constexpr const char* LOCAL_INPUT = "fw_INPUT";
+  static constexpr const char* LOCAL_OUTPUT = "fw_OUTPUT";
+  static constexpr const char* LOCAL_FORWARD = "fw_FORWARD";
 
   static const char* ICMPV6_TYPES[];
 
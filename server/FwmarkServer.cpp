@@ -16,26 +16,33 @@
 
 #include "FwmarkServer.h"
 
+#include <cinttypes>
 #include <netinet/in.h>
 #include <selinux/selinux.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <utils/String16.h>
 
-#include <android-base/cmsg.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
 #include <binder/IServiceManager.h>
 #include <netd_resolv/resolv.h>  // NETID_UNSET
 
+#include <array>
+#include <map>
+#include <mutex>
+#include <vector>
+
 #include "Fwmark.h"
 #include "FwmarkCommand.h"
 #include "NetdConstants.h"
 #include "NetworkController.h"
+#include "RateLimitedLog.h"
 
 #include "NetdUpdatablePublic.h"
 
-using android::base::ReceiveFileDescriptorVector;
 using android::base::unique_fd;
 using android::net::metrics::INetdEventListener;
 
@@ -78,12 +85,16 @@ bool FwmarkServer::onDataAvailable(SocketClient* client) {
 
     // Always send a response even if there were connection errors or read errors, so that we don't
     // inadvertently cause the client to hang (which always waits for a response).
-    client->sendData(&error, sizeof(error));
-
-    // Always close the client connection (by returning false). This prevents a DoS attack where
-    // the client issues multiple commands on the same connection, never reading the responses,
-    // causing its receive buffer to fill up, and thus causing our client->sendData() to block.
-    return false;
+    //
+    // The connection is then kept open (by returning true): FwmarkClient caches its channel and
+    // reuses it for subsequent commands, making steady-state marking one sendmsg/recv round-trip
+    // instead of a connect/send/recv/close cycle per socket. Keeping connections open reintroduces
+    // a potential DoS, where a client issues multiple commands on the same connection without ever
+    // reading the responses, filling up its receive buffer and causing our sendData() to block. So
+    // bound the send with a short timeout and drop the connection if either trips.
+    const timeval timeout = {.tv_sec = 0, .tv_usec = 500 * 1000};
+    setsockopt(client->getSocket(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return client->sendData(&error, sizeof(error)) == 0;
 }
 
 static bool hasDestinationAddress(FwmarkCommand::CmdId cmdId, bool redirectSocketCalls) {
@@ -96,21 +107,134 @@ static bool hasDestinationAddress(FwmarkCommand::CmdId cmdId, bool redirectSocke
     }
 }
 
+namespace {
+
+constexpr size_t kNumCommands = FwmarkCommand::SELECT_NETWORK_VECTORED + 1;
+
+// Indexed by FwmarkCommand::CmdId; keep in sync with FwmarkCommand.h.
+const char* const kCommandNames[kNumCommands] = {
+        "ON_ACCEPT",      "ON_CONNECT",      "SELECT_NETWORK",      "PROTECT_FROM_VPN",
+        "SELECT_FOR_USER", "QUERY_USER_ACCESS", "ON_CONNECT_COMPLETE", "TAG_SOCKET",
+        "UNTAG_SOCKET",   "SET_COUNTERSET",  "DELETE_TAGDATA",      "ON_SENDMMSG",
+        "ON_SENDMSG",     "ON_SENDTO",       "SELECT_NETWORK_VECTORED",
+};
+
+// Per-UID command statistics. Every accept() and connect() on the device lands in
+// processClient(), so the accounting must cost no more than the work it measures: each worker
+// thread owns a fixed open-addressed table keyed by UID and bumps plain uint64_t counters - no
+// atomics, no locks, no allocation on the command path. Tables register themselves once, and
+// dumpStats() merges them under gFwmarkStatsLock. Dump-time reads race with increments, but the
+// counters are aligned 64-bit values read once; a merge may be an increment behind, which is
+// fine for statistics.
+constexpr size_t kStatsSlots = 256;        // Power of two; comfortably holds a device's live UIDs.
+constexpr size_t kStatsMaxProbes = 16;     // Probe budget before an increment goes to overflow.
+
+struct FwmarkThreadStats {
+    struct Slot {
+        uid_t uid;
+        bool used;
+        uint64_t counts[kNumCommands];
+    };
+    Slot slots[kStatsSlots] = {};
+    // Commands from UIDs that didn't fit in the table, so totals still add up.
+    uint64_t overflow[kNumCommands] = {};
+};
+
+std::mutex gFwmarkStatsLock;
+std::vector<FwmarkThreadStats*> gFwmarkThreadStats;
+
+FwmarkThreadStats* threadStats() {
+    thread_local FwmarkThreadStats* stats = [] {
+        auto* s = new FwmarkThreadStats();
+        std::lock_guard guard(gFwmarkStatsLock);
+        gFwmarkThreadStats.push_back(s);
+        return s;
+    }();
+    return stats;
+}
+
+void countCommand(uid_t uid, FwmarkCommand::CmdId cmdId) {
+    if (cmdId < 0 || static_cast<size_t>(cmdId) >= kNumCommands) return;
+    FwmarkThreadStats* stats = threadStats();
+    for (size_t i = 0; i < kStatsMaxProbes; i++) {
+        auto& slot = stats->slots[(uid + i) & (kStatsSlots - 1)];
+        if (!slot.used) {
+            slot.uid = uid;
+            slot.used = true;
+        } else if (slot.uid != uid) {
+            continue;
+        }
+        slot.counts[cmdId]++;
+        return;
+    }
+    stats->overflow[cmdId]++;
+}
+
+// Fds received via SCM_RIGHTS, closed on destruction unless ownership was taken.
+struct ReceivedFds {
+    int fds[FwmarkCommand::MAX_VECTORED_FDS];
+    size_t count = 0;
+
+    ~ReceivedFds() {
+        for (size_t i = 0; i < count; ++i) {
+            if (fds[i] >= 0) close(fds[i]);
+        }
+    }
+
+    int releaseFirst() {
+        int fd = fds[0];
+        fds[0] = -1;
+        return fd;
+    }
+};
+
+}  // namespace
+
 int FwmarkServer::processClient(SocketClient* client, int* socketFd) {
     FwmarkCommand command;
     FwmarkConnectInfo connectInfo;
 
+    // Receive the command and any attached fds in one recvmsg() into stack buffers. Every
+    // accept() and connect() on the device sends a message here, so the receive path must not
+    // allocate; only the rare multi-fd command (SELECT_NETWORK_VECTORED) touches the heap, below.
     char buf[sizeof(command) + sizeof(connectInfo)];
-    std::vector<unique_fd> received_fds;
-    ssize_t messageLength =
-            ReceiveFileDescriptorVector(client->getSocket(), buf, sizeof(buf), 1, &received_fds);
+    ReceivedFds received;
+    alignas(cmsghdr) char cmsgBuf[CMSG_SPACE(sizeof(received.fds))];
+    iovec iov = {buf, sizeof(buf)};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgBuf;
+    msg.msg_controllen = sizeof(cmsgBuf);
 
+    ssize_t messageLength =
+            TEMP_FAILURE_RETRY(recvmsg(client->getSocket(), &msg, MSG_CMSG_CLOEXEC));
     if (messageLength < 0) {
         return -errno;
     } else if (messageLength == 0) {
         return -ESHUTDOWN;
     }
 
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        const int* cmsgFds = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+        const size_t numFds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < numFds; ++i) {
+            if (received.count < FwmarkCommand::MAX_VECTORED_FDS) {
+                received.fds[received.count++] = cmsgFds[i];
+            } else {
+                close(cmsgFds[i]);
+            }
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC) {
+        // The client attached more fds than any command may carry; ~ReceivedFds closes the ones
+        // that were delivered.
+        return -EMSGSIZE;
+    }
+
     memcpy(&command, buf, sizeof(command));
     memcpy(&connectInfo, buf + sizeof(command), sizeof(connectInfo));
 
@@ -123,20 +247,104 @@ int FwmarkServer::processClient(SocketClient* client, int* socketFd) {
         return -EBADMSG;
     }
 
-    Permission permission = mNetworkController->getPermissionForUser(client->getUid());
+    countCommand(client->getUid(), command.cmdId);
 
-    if (command.cmdId == FwmarkCommand::QUERY_USER_ACCESS) {
-        if ((permission & PERMISSION_SYSTEM) != PERMISSION_SYSTEM) {
-            return -EPERM;
+    if (command.cmdId == FwmarkCommand::ON_ACCEPT || command.cmdId == FwmarkCommand::ON_CONNECT) {
+        if (received.count != 1 || received.fds[0] < 0) {
+            return -EBADF;
         }
-        return mNetworkController->checkUserNetworkAccess(command.uid, command.netId);
+        *socketFd = received.releaseFirst();
+        return markAcceptOrConnect(client, command, *socketFd);
+    }
+
+    Permission permission;
+    {
+        // One consistent state for the permission gate and the QUERY_USER_ACCESS answer; the
+        // per-command lookups further down open their own transactions so the lock is not held
+        // across the socket syscalls in between.
+        NetworkController::ReadTransaction state(*mNetworkController);
+        permission = state.getPermissionForUser(client->getUid());
+
+        if (command.cmdId == FwmarkCommand::QUERY_USER_ACCESS) {
+            if ((permission & PERMISSION_SYSTEM) != PERMISSION_SYSTEM) {
+                return -EPERM;
+            }
+            return state.checkUserNetworkAccess(command.uid, command.netId);
+        }
+    }
+
+    // The remaining commands are infrequent; hand the fds to a vector for the existing logic.
+    std::vector<unique_fd> received_fds;
+    received_fds.reserve(received.count);
+    for (size_t i = 0; i < received.count; ++i) {
+        received_fds.emplace_back(received.fds[i]);
+    }
+    received.count = 0;  // Ownership transferred.
+
+    if (command.cmdId == FwmarkCommand::SELECT_NETWORK_VECTORED) {
+        // Marks every attached socket with the selected network before sending the single ack,
+        // so that socket pools (e.g. HTTP/2 and QUIC connection pools) cost one round-trip
+        // instead of one per socket. The fd count travels in the command so a truncated
+        // SCM_RIGHTS array is detected rather than silently leaving sockets unmarked.
+        if (received_fds.empty() || received_fds.size() != command.trafficCtrlInfo) {
+            return -EBADF;
+        }
+
+        // Check network access once; it depends only on the caller and the netId. Everything in
+        // the new mark except the preserved billing bit is the same for every socket, so compose
+        // it once here and apply it with one AND/OR per socket below.
+        bool explicitlySelected = false;
+        bool protectedFromVpn = false;
+        if (command.netId != NETID_UNSET) {
+            NetworkController::ReadTransaction state(*mNetworkController);
+            if (int ret = state.checkUserNetworkAccess(client->getUid(), command.netId)) {
+                return ret;
+            }
+            explicitlySelected = true;
+            protectedFromVpn = state.canProtect(client->getUid());
+        }
+        const uint32_t newMark = Fwmark::makeMark(
+                command.netId, explicitlySelected, protectedFromVpn,
+                (command.netId == NETID_UNSET) ? PERMISSION_NONE : permission);
+
+        for (const unique_fd& fd : received_fds) {
+            if (fd < 0) {
+                return -EBADF;
+            }
+
+            int family;
+            socklen_t familyLen = sizeof(family);
+            if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &family, &familyLen) == -1) {
+                return -errno;
+            }
+            if (!FwmarkCommand::isSupportedFamily(family)) {
+                return -EAFNOSUPPORT;
+            }
+
+            Fwmark fwmark;
+            socklen_t fwmarkLen = sizeof(fwmark.intValue);
+            if (getsockopt(fd, SOL_SOCKET, SO_MARK, &fwmark.intValue, &fwmarkLen) == -1) {
+                return -errno;
+            }
+
+            fwmark.intValue = (fwmark.intValue & Fwmark::getUidBillingMask()) | newMark;
+
+            if (setsockopt(fd, SOL_SOCKET, SO_MARK, &fwmark.intValue,
+                           sizeof(fwmark.intValue)) == -1) {
+                return -errno;
+            }
+        }
+        return 0;
     }
 
     if (received_fds.size() != 1) {
-        LOG(ERROR) << "FwmarkServer received " << received_fds.size() << " fds from client?";
+        // A misbehaving client can trigger these once per connection; don't let it fill the log.
+        LOG_STATEMENT_RATELIMITED(LOG(ERROR) << "FwmarkServer received " << received_fds.size()
+                                             << " fds from client?");
         return -EBADF;
     } else if (received_fds[0] < 0) {
-        LOG(ERROR) << "FwmarkServer received fd -1 from ReceiveFileDescriptorVector?";
+        LOG_STATEMENT_RATELIMITED(
+                LOG(ERROR) << "FwmarkServer received fd -1 from ReceiveFileDescriptorVector?");
         return -EBADF;
     }
 
@@ -158,57 +366,6 @@ int FwmarkServer::processClient(SocketClient* client, int* socketFd) {
     }
 
     switch (command.cmdId) {
-        case FwmarkCommand::ON_ACCEPT: {
-            // Called after a socket accept(). The kernel would've marked the NetId and necessary
-            // permissions bits, so we just add the rest of the user's permissions here.
-            permission = static_cast<Permission>(permission | fwmark.permission);
-            break;
-        }
-
-        case FwmarkCommand::ON_CONNECT: {
-            // Called before a socket connect() happens. Set an appropriate NetId into the fwmark so
-            // that the socket routes consistently over that network. Do this even if the socket
-            // already has a NetId, so that calling connect() multiple times still works.
-            //
-            // But if the explicit bit was set, the existing NetId was explicitly preferred (and not
-            // a case of connect() being called multiple times). Don't reset the NetId in that case.
-            //
-            // An "appropriate" NetId is the NetId of a bypassable VPN that applies to the user, or
-            // failing that, the default network. We'll never set the NetId of a secure VPN here.
-            // See the comments in the implementation of getNetworkForConnect() for more details.
-            //
-            // If the protect bit is set, this could be either a system proxy (e.g.: the dns proxy
-            // or the download manager) acting on behalf of another user, or a VPN provider. If it's
-            // a proxy, we shouldn't reset the NetId. If it's a VPN provider, we should set the
-            // default network's NetId.
-            //
-            // There's no easy way to tell the difference between a proxy and a VPN app. We can't
-            // use PERMISSION_SYSTEM to identify the proxy because a VPN app may also have those
-            // permissions. So we use the following heuristic:
-            //
-            // If it's a proxy, but the existing NetId is not a VPN, that means the user (that the
-            // proxy is acting on behalf of) is not subject to a VPN, so the proxy must have picked
-            // the default network's NetId. So, it's okay to replace that with the current default
-            // network's NetId (which in all likelihood is the same).
-            //
-            // Conversely, if it's a VPN provider, the existing NetId cannot be a VPN. The only time
-            // we set a VPN's NetId into a socket without setting the explicit bit is here, in
-            // ON_CONNECT, but we won't do that if the socket has the protect bit set. If the VPN
-            // provider connect()ed (and got the VPN NetId set) and then called protect(), we
-            // would've unset the NetId in PROTECT_FROM_VPN below.
-            //
-            // So, overall (when the explicit bit is not set but the protect bit is set), if the
-            // existing NetId is a VPN, don't reset it. Else, set the default network's NetId.
-            if (!fwmark.explicitlySelected) {
-                if (!fwmark.protectedFromVpn) {
-                    fwmark.netId = mNetworkController->getNetworkForConnect(client->getUid());
-                } else if (!mNetworkController->isVirtualNetwork(fwmark.netId)) {
-                    fwmark.netId = mNetworkController->getDefaultNetwork();
-                }
-            }
-            break;
-        }
-
         case FwmarkCommand::ON_CONNECT_COMPLETE: {
             // Called after a socket connect() completes.
             // This reports connect event including netId, destination IP address, destination port,
@@ -247,24 +404,29 @@ int FwmarkServer::processClient(SocketClient* client, int* socketFd) {
         }
 
         case FwmarkCommand::SELECT_NETWORK: {
-            fwmark.netId = command.netId;
+            // Recompose the whole mark in one expression, preserving only the billing bit; the
+            // permission field is filled in by the common store below.
             if (command.netId == NETID_UNSET) {
-                fwmark.explicitlySelected = false;
-                fwmark.protectedFromVpn = false;
                 permission = PERMISSION_NONE;
+                fwmark.intValue = (fwmark.intValue & Fwmark::getUidBillingMask()) |
+                                  Fwmark::makeMark(NETID_UNSET);
             } else {
-                if (int ret = mNetworkController->checkUserNetworkAccess(client->getUid(),
-                                                                         command.netId)) {
+                NetworkController::ReadTransaction state(*mNetworkController);
+                if (int ret = state.checkUserNetworkAccess(client->getUid(), command.netId)) {
                     return ret;
                 }
-                fwmark.explicitlySelected = true;
-                fwmark.protectedFromVpn = mNetworkController->canProtect(client->getUid());
+                fwmark.intValue = (fwmark.intValue & Fwmark::getUidBillingMask()) |
+                                  Fwmark::makeMark(command.netId, true /* explicitlySelected */,
+                                                   state.canProtect(client->getUid()));
             }
             break;
         }
 
         case FwmarkCommand::PROTECT_FROM_VPN: {
-            if (!mNetworkController->canProtect(client->getUid())) {
+            // One consistent state across the protect check, the VPN test and the default-network
+            // read, so a concurrent VPN teardown cannot slip in between them.
+            NetworkController::ReadTransaction state(*mNetworkController);
+            if (!state.canProtect(client->getUid())) {
                 return -EPERM;
             }
             // If a bypassable VPN's provider app calls connect() and then protect(), it will end up
@@ -273,8 +435,8 @@ int FwmarkServer::processClient(SocketClient* client, int* socketFd) {
             //
             // In any case, it's appropriate that if the socket has an implicit VPN NetId mark, the
             // PROTECT_FROM_VPN command should unset it.
-            if (!fwmark.explicitlySelected && mNetworkController->isVirtualNetwork(fwmark.netId)) {
-                fwmark.netId = mNetworkController->getDefaultNetwork();
+            if (!fwmark.explicitlySelected && state.isVirtualNetwork(fwmark.netId)) {
+                fwmark.netId = state.getDefaultNetwork();
             }
             fwmark.protectedFromVpn = true;
             permission = static_cast<Permission>(permission | fwmark.permission);
@@ -324,5 +486,130 @@ int FwmarkServer::processClient(SocketClient* client, int* socketFd) {
     return 0;
 }
 
+int FwmarkServer::markAcceptOrConnect(SocketClient* client, const FwmarkCommand& command,
+                                      int socketFd) {
+    int family;
+    socklen_t familyLen = sizeof(family);
+    if (getsockopt(socketFd, SOL_SOCKET, SO_DOMAIN, &family, &familyLen) == -1) {
+        return -errno;
+    }
+    if (!FwmarkCommand::isSupportedFamily(family)) {
+        return -EAFNOSUPPORT;
+    }
+
+    Fwmark fwmark;
+    socklen_t fwmarkLen = sizeof(fwmark.intValue);
+    if (getsockopt(socketFd, SOL_SOCKET, SO_MARK, &fwmark.intValue, &fwmarkLen) == -1) {
+        return -errno;
+    }
+
+    Permission permission = mNetworkController->getPermissionForUser(client->getUid());
+
+    if (command.cmdId == FwmarkCommand::ON_ACCEPT) {
+        // Called after a socket accept(). The kernel would've marked the NetId and necessary
+        // permissions bits, so we just add the rest of the user's permissions here.
+        permission = static_cast<Permission>(permission | fwmark.permission);
+    } else {  // ON_CONNECT
+        // Called before a socket connect() happens. Set an appropriate NetId into the fwmark so
+        // that the socket routes consistently over that network. Do this even if the socket
+        // already has a NetId, so that calling connect() multiple times still works.
+        //
+        // But if the explicit bit was set, the existing NetId was explicitly preferred (and not
+        // a case of connect() being called multiple times). Don't reset the NetId in that case.
+        //
+        // An "appropriate" NetId is the NetId of a bypassable VPN that applies to the user, or
+        // failing that, the default network. We'll never set the NetId of a secure VPN here.
+        // See the comments in the implementation of getNetworkForConnect() for more details.
+        //
+        // If the protect bit is set, this could be either a system proxy (e.g.: the dns proxy
+        // or the download manager) acting on behalf of another user, or a VPN provider. If it's
+        // a proxy, we shouldn't reset the NetId. If it's a VPN provider, we should set the
+        // default network's NetId.
+        //
+        // There's no easy way to tell the difference between a proxy and a VPN app. We can't
+        // use PERMISSION_SYSTEM to identify the proxy because a VPN app may also have those
+        // permissions. So we use the following heuristic:
+        //
+        // If it's a proxy, but the existing NetId is not a VPN, that means the user (that the
+        // proxy is acting on behalf of) is not subject to a VPN, so the proxy must have picked
+        // the default network's NetId. So, it's okay to replace that with the current default
+        // network's NetId (which in all likelihood is the same).
+        //
+        // Conversely, if it's a VPN provider, the existing NetId cannot be a VPN. The only time
+        // we set a VPN's NetId into a socket without setting the explicit bit is here, in
+        // ON_CONNECT, but we won't do that if the socket has the protect bit set. If the VPN
+        // provider connect()ed (and got the VPN NetId set) and then called protect(), we
+        // would've unset the NetId in PROTECT_FROM_VPN.
+        //
+        // So, overall (when the explicit bit is not set but the protect bit is set), if the
+        // existing NetId is a VPN, don't reset it. Else, set the default network's NetId.
+        if (!fwmark.explicitlySelected) {
+            if (!fwmark.protectedFromVpn) {
+                // Deliberately not under a ReadTransaction: getNetworkForConnect() answers from
+                // the lock-free connect snapshot on the hot path.
+                fwmark.netId = mNetworkController->getNetworkForConnect(client->getUid());
+            } else {
+                // The VPN test and the default-network read must see the same state.
+                NetworkController::ReadTransaction state(*mNetworkController);
+                if (!state.isVirtualNetwork(fwmark.netId)) {
+                    fwmark.netId = state.getDefaultNetwork();
+                }
+            }
+        }
+    }
+
+    fwmark.permission = permission;
+
+    if (setsockopt(socketFd, SOL_SOCKET, SO_MARK, &fwmark.intValue, sizeof(fwmark.intValue)) ==
+        -1) {
+        return -errno;
+    }
+
+    return 0;
+}
+
+void FwmarkServer::dumpStats(netdutils::DumpWriter& dw) {
+    std::map<uid_t, std::array<uint64_t, kNumCommands>> merged;
+    uint64_t overflow[kNumCommands] = {};
+    {
+        std::lock_guard guard(gFwmarkStatsLock);
+        for (const FwmarkThreadStats* stats : gFwmarkThreadStats) {
+            for (const auto& slot : stats->slots) {
+                if (!slot.used) continue;
+                auto& counts = merged[slot.uid];
+                for (size_t c = 0; c < kNumCommands; c++) {
+                    counts[c] += slot.counts[c];
+                }
+            }
+            for (size_t c = 0; c < kNumCommands; c++) {
+                overflow[c] += stats->overflow[c];
+            }
+        }
+    }
+
+    dw.println("Fwmark commands by UID:");
+    netdutils::ScopedIndent indent(dw);
+    if (merged.empty()) {
+        dw.println("<none>");
+    }
+    std::string line;
+    for (const auto& [uid, counts] : merged) {
+        line = android::base::StringPrintf("uid %u:", uid);
+        for (size_t c = 0; c < kNumCommands; c++) {
+            if (counts[c] == 0) continue;
+            android::base::StringAppendF(&line, " %s=%" PRIu64, kCommandNames[c], counts[c]);
+        }
+        dw.println("%s", line.c_str());
+    }
+    line.clear();
+    for (size_t c = 0; c < kNumCommands; c++) {
+        if (overflow[c] == 0) continue;
+        android::base::StringAppendF(&line, " %s=%" PRIu64, kCommandNames[c], overflow[c]);
+    }
+    if (!line.empty()) {
+        dw.println("untracked UIDs:%s", line.c_str());
+    }
+}
+
 }  // namespace net
 }  // namespace android
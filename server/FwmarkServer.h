@@ -18,6 +18,9 @@
 #define NETD_SERVER_FWMARK_SERVER_H
 
 #include "EventReporter.h"
+#include "FwmarkCommand.h"
+#include "NetdConstants.h"
+#include "netdutils/DumpWriter.h"
 #include "sysutils/SocketListener.h"
 
 namespace android {
@@ -31,12 +34,29 @@ public:
 
   static constexpr const char* SOCKET_NAME = "fwmarkd";
 
+  // Number of FwmarkServer instances to run. All instances accept from the same listening socket
+  // (inherited from init), each on its own thread, so fwmark command processing scales across
+  // cores instead of serializing every connect() on the device behind one thread.
+  static constexpr int NUM_WORKERS = 4;
+
+  // Prints per-UID, per-command counts of the fwmark commands processed since boot, for the
+  // "dumpsys netd" stats section. Counters are kept in per-thread tables with no atomics on the
+  // command path and merged here; identifies the apps behind marking storms.
+  static void dumpStats(netdutils::DumpWriter& dw) NETD_COLD;
+
 private:
     // Overridden from SocketListener:
-    bool onDataAvailable(SocketClient* client);
+    bool onDataAvailable(SocketClient* client) NETD_HOT;
 
     // Returns 0 on success or a negative errno value on failure.
-    int processClient(SocketClient* client, int* socketFd);
+    int processClient(SocketClient* client, int* socketFd) NETD_HOT;
+
+    // Fast path for the two highest-rate commands, ON_ACCEPT and ON_CONNECT, which every
+    // accept() and connect() on the device sends: reads the socket's mark, folds in the netId
+    // and permission updates, and writes it back. No allocation, no logging. Returns 0 on
+    // success or a negative errno value on failure.
+    int markAcceptOrConnect(SocketClient* client, const FwmarkCommand& command,
+                            int socketFd) NETD_HOT;
 
     NetworkController* const mNetworkController;
     EventReporter* mEventReporter;
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GenerationRegistry"
+
+#include "GenerationRegistry.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <log/log.h>
+
+namespace android {
+namespace net {
+
+namespace {
+
+const char* domainName(GenerationRegistry::Domain domain) {
+    switch (domain) {
+        case GenerationRegistry::NETWORKS:
+            return "networks";
+        case GenerationRegistry::UID_RANGES:
+            return "uidRanges";
+        case GenerationRegistry::PERMISSIONS:
+            return "permissions";
+        case GenerationRegistry::ROUTES:
+            return "routes";
+        default:
+            return "?";
+    }
+}
+
+}  // namespace
+
+void GenerationRegistry::bump(Domain domain) {
+    mGenerations[domain].fetch_add(1, std::memory_order_release);
+
+    std::lock_guard guard(mSubscribersLock);
+    for (const auto& [subscribedDomain, fd] : mSubscribers) {
+        if (subscribedDomain != domain) continue;
+        const uint64_t one = 1;
+        // EAGAIN means the eventfd counter is already saturated with unconsumed signals, which
+        // is as good as signalled; anything else is a subscriber bug worth logging.
+        if (write(fd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) {
+            ALOGE("failed to signal %s subscriber fd %d: %s", domainName(domain), fd,
+                  strerror(errno));
+        }
+    }
+}
+
+uint64_t GenerationRegistry::get(Domain domain) const {
+    return mGenerations[domain].load(std::memory_order_acquire);
+}
+
+void GenerationRegistry::subscribe(Domain domain, int eventFd) {
+    std::lock_guard guard(mSubscribersLock);
+    mSubscribers.emplace_back(domain, eventFd);
+}
+
+void GenerationRegistry::unsubscribe(int eventFd) {
+    std::lock_guard guard(mSubscribersLock);
+    mSubscribers.erase(std::remove_if(mSubscribers.begin(), mSubscribers.end(),
+                                      [eventFd](const auto& entry) {
+                                          return entry.second == eventFd;
+                                      }),
+                       mSubscribers.end());
+}
+
+void GenerationRegistry::dump(netdutils::DumpWriter& dw) const {
+    dw.println("Generations:");
+    netdutils::ScopedIndent indent(dw);
+    for (uint32_t i = 0; i < DOMAIN_COUNT; i++) {
+        const auto domain = static_cast<Domain>(i);
+        dw.println("%s: %" PRIu64, domainName(domain), get(domain));
+    }
+}
+
+}  // namespace net
+}  // namespace android
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_SERVER_GENERATION_REGISTRY_H
+#define NETD_SERVER_GENERATION_REGISTRY_H
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <netdutils/DumpWriter.h>
+
+namespace android {
+namespace net {
+
+// Central change-generation counters for netd state, one per domain, bumped by the write paths
+// of the owning controllers. A cache validates a stored answer by comparing the generation it
+// captured against the current one, so it invalidates exactly when the guarded state changed
+// instead of conservatively (wholesale flushes, TTLs) or not at all.
+//
+// get() is a single atomic load and never blocks. bump() is a release increment issued after
+// the state change is fully applied (write paths bump while still holding, or just after
+// releasing, their own lock), so a reader that observes the new generation also observes the
+// change behind it. Generations only grow; equality therefore means "nothing changed since the
+// snapshot" with no ABA window.
+//
+// Caches that would otherwise have to poll a generation can register an eventfd instead:
+// subscribe() signals the fd on every bump of the chosen domain, and the subscriber drains the
+// fd and re-snapshots. This also covers client-side caches, whose serving thread can poll the
+// eventfd alongside its socket.
+class GenerationRegistry {
+  public:
+    enum Domain : uint32_t {
+        NETWORKS = 0,     // Network lifetime, interface membership and the default network.
+        UID_RANGES = 1,   // VPN and per-app uid range assignments.
+        PERMISSIONS = 2,  // Per-network and per-uid permission changes.
+        ROUTES = 3,       // Route changes made through NetworkController.
+        DOMAIN_COUNT = 4,
+    };
+
+    // Increments |domain|'s generation and signals its subscribers.
+    void bump(Domain domain);
+
+    // Returns the current generation of |domain|.
+    uint64_t get(Domain domain) const;
+
+    // Registers |eventFd|, an eventfd(2) owned by the caller, to be signalled on every bump of
+    // |domain|. The fd must stay open until unsubscribe(); a full eventfd counter is fine, since
+    // pending signals coalesce and one drain observes them all.
+    void subscribe(Domain domain, int eventFd);
+    void unsubscribe(int eventFd);
+
+    void dump(netdutils::DumpWriter& dw) const;
+
+  private:
+    std::array<std::atomic<uint64_t>, DOMAIN_COUNT> mGenerations = {};
+
+    mutable std::mutex mSubscribersLock;
+    // Small and mutated rarely (subscriptions are long-lived); a flat vector scanned per bump
+    // beats any keyed structure at this size. Guarded by mSubscribersLock.
+    std::vector<std::pair<Domain, int>> mSubscribers;
+};
+
+}  // namespace net
+}  // namespace android
+
+#endif  // NETD_SERVER_GENERATION_REGISTRY_H
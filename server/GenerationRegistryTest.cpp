@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GenerationRegistry.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <android-base/unique_fd.h>
+
+namespace android {
+namespace net {
+
+namespace {
+
+uint64_t drain(int fd) {
+    uint64_t value = 0;
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) return 0;
+    return value;
+}
+
+}  // namespace
+
+TEST(GenerationRegistryTest, BumpIsPerDomain) {
+    GenerationRegistry registry;
+
+    EXPECT_EQ(0U, registry.get(GenerationRegistry::NETWORKS));
+    EXPECT_EQ(0U, registry.get(GenerationRegistry::ROUTES));
+
+    registry.bump(GenerationRegistry::NETWORKS);
+    registry.bump(GenerationRegistry::NETWORKS);
+    registry.bump(GenerationRegistry::ROUTES);
+
+    EXPECT_EQ(2U, registry.get(GenerationRegistry::NETWORKS));
+    EXPECT_EQ(1U, registry.get(GenerationRegistry::ROUTES));
+    EXPECT_EQ(0U, registry.get(GenerationRegistry::UID_RANGES));
+    EXPECT_EQ(0U, registry.get(GenerationRegistry::PERMISSIONS));
+}
+
+TEST(GenerationRegistryTest, SubscribersAreSignalledAndCoalesce) {
+    GenerationRegistry registry;
+    base::unique_fd fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    ASSERT_LE(0, fd.get());
+
+    registry.subscribe(GenerationRegistry::UID_RANGES, fd.get());
+
+    // A bump of another domain must not signal this subscriber.
+    registry.bump(GenerationRegistry::NETWORKS);
+    EXPECT_EQ(0U, drain(fd.get()));
+
+    // Multiple bumps coalesce into one pending eventfd value.
+    registry.bump(GenerationRegistry::UID_RANGES);
+    registry.bump(GenerationRegistry::UID_RANGES);
+    EXPECT_EQ(2U, drain(fd.get()));
+    EXPECT_EQ(0U, drain(fd.get()));  // Drained.
+
+    registry.unsubscribe(fd.get());
+    registry.bump(GenerationRegistry::UID_RANGES);
+    EXPECT_EQ(0U, drain(fd.get()));
+    EXPECT_EQ(3U, registry.get(GenerationRegistry::UID_RANGES));
+}
+
+}  // namespace net
+}  // namespace android
@@ -122,9 +122,6 @@
 using android::base::Join;
 using android::base::StringPrintf;
 
-const char* IdletimerController::LOCAL_RAW_PREROUTING = "idletimer_raw_PREROUTING";
-const char* IdletimerController::LOCAL_MANGLE_POSTROUTING = "idletimer_mangle_POSTROUTING";
-
 auto IdletimerController::execIptablesRestore = ::execIptablesRestore;
 
 IdletimerController::IdletimerController() {
@@ -140,22 +137,39 @@ bool IdletimerController::setupIptablesHooks() {
 int IdletimerController::modifyInterfaceIdletimer(IptOp op, const char *iface,
                                                   uint32_t timeout,
                                                   const char *classLabel) {
-    if (!isIfaceName(iface)) {
-        errno = ENOENT;
-        return -1;
+    return updateInterfaceIdletimers({{op == IptOpAdd, iface, timeout, classLabel}});
+}
+
+int IdletimerController::updateInterfaceIdletimers(const std::vector<IdletimerChange>& changes) {
+    if (changes.empty()) return 0;
+
+    for (const auto& change : changes) {
+        if (!isIfaceName(change.iface)) {
+            errno = ENOENT;
+            return -1;
+        }
     }
 
-    const char *addRemove = (op == IptOpAdd) ? "-A" : "-D";
-    std::vector<std::string> cmds = {
-            "*raw",
-            StringPrintf("%s %s -i %s -j IDLETIMER --timeout %u --label %s --send_nl_msg",
-                         addRemove, LOCAL_RAW_PREROUTING, iface, timeout, classLabel),
-            "COMMIT",
-            "*mangle",
-            StringPrintf("%s %s -o %s -j IDLETIMER --timeout %u --label %s --send_nl_msg",
-                         addRemove, LOCAL_MANGLE_POSTROUTING, iface, timeout, classLabel),
-            "COMMIT\n",
-    };
+    // All the raw rules share one table block and all the mangle rules another, so the batch
+    // costs two commits no matter how many timers it touches.
+    std::vector<std::string> cmds = {"*raw"};
+    for (const auto& change : changes) {
+        cmds.push_back(StringPrintf("%s %s -i %s -j IDLETIMER --timeout %u --label %s"
+                                    " --send_nl_msg",
+                                    change.add ? "-A" : "-D", LOCAL_RAW_PREROUTING,
+                                    change.iface.c_str(), change.timeout,
+                                    change.classLabel.c_str()));
+    }
+    cmds.push_back("COMMIT");
+    cmds.push_back("*mangle");
+    for (const auto& change : changes) {
+        cmds.push_back(StringPrintf("%s %s -o %s -j IDLETIMER --timeout %u --label %s"
+                                    " --send_nl_msg",
+                                    change.add ? "-A" : "-D", LOCAL_MANGLE_POSTROUTING,
+                                    change.iface.c_str(), change.timeout,
+                                    change.classLabel.c_str()));
+    }
+    cmds.push_back("COMMIT\n");
 
     return (execIptablesRestore(V4V6, Join(cmds, '\n')) == 0) ? 0 : -EREMOTEIO;
 }
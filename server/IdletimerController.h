@@ -18,11 +18,23 @@
 
 #include <stdint.h>
 
+#include <string>
+#include <vector>
+
 #include "NetdConstants.h"
 
 class IdletimerController {
 public:
 
+    // One idletimer rule change: add (or remove) the timer on |iface| with the given timeout
+    // and class label. Passed to updateInterfaceIdletimers() to commit several changes at once.
+    struct IdletimerChange {
+        bool add;
+        std::string iface;
+        uint32_t timeout;
+        std::string classLabel;
+    };
+
     IdletimerController();
     virtual ~IdletimerController();
 
@@ -30,10 +42,20 @@ public:
                               const char *classLabel);
     int removeInterfaceIdletimer(const char *iface, uint32_t timeout,
                                  const char *classLabel);
+
+    // Applies all of |changes| in a single iptables-restore transaction: two table commits in
+    // total rather than two per timer. Interface transitions (e.g. cellular <-> wifi) add and
+    // remove several timers back-to-back, and belong on this path. Returns 0 on success, -1
+    // with errno set to ENOENT if any interface name is invalid (in which case nothing is
+    // changed), or -EREMOTEIO if the restore fails.
+    int updateInterfaceIdletimers(const std::vector<IdletimerChange>& changes);
+
     bool setupIptablesHooks();
 
-    static const char* LOCAL_RAW_PREROUTING;
-    static const char* LOCAL_MANGLE_POSTROUTING;
+    // constexpr so the chain topology table in Controllers.cpp can reference them at compile
+    // time.
+    static constexpr const char* LOCAL_RAW_PREROUTING = "idletimer_raw_PREROUTING";
+    static constexpr const char* LOCAL_MANGLE_POSTROUTING = "idletimer_mangle_POSTROUTING";
     std::mutex lock;
 
   private:
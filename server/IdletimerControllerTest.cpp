@@ -57,6 +57,38 @@ const std::vector<std::string> makeAddRemoveCommands(bool add) {
     return { Join(cmds, '\n') };
 }
 
+TEST_F(IdletimerControllerTest, TestBatchUpdate) {
+    std::vector<IdletimerController::IdletimerChange> changes = {
+            {true, "wlan0", 12345, "hello"},
+            {false, "rmnet0", 54321, "world"},
+    };
+    std::vector<std::string> cmds = {
+            "*raw",
+            "-A idletimer_raw_PREROUTING -i wlan0 -j IDLETIMER"
+            " --timeout 12345 --label hello --send_nl_msg",
+            "-D idletimer_raw_PREROUTING -i rmnet0 -j IDLETIMER"
+            " --timeout 54321 --label world --send_nl_msg",
+            "COMMIT",
+            "*mangle",
+            "-A idletimer_mangle_POSTROUTING -o wlan0 -j IDLETIMER"
+            " --timeout 12345 --label hello --send_nl_msg",
+            "-D idletimer_mangle_POSTROUTING -o rmnet0 -j IDLETIMER"
+            " --timeout 54321 --label world --send_nl_msg",
+            "COMMIT\n",
+    };
+    std::vector<std::string> expected = { Join(cmds, '\n') };
+    EXPECT_EQ(0, mIt.updateInterfaceIdletimers(changes));
+    expectIptablesRestoreCommands(expected);
+
+    // An empty batch runs no commands at all.
+    EXPECT_EQ(0, mIt.updateInterfaceIdletimers({}));
+    expectIptablesRestoreCommands(ExpectedIptablesCommands{});
+
+    // An invalid interface name anywhere in the batch rejects the whole batch.
+    EXPECT_EQ(-1, mIt.updateInterfaceIdletimers({{true, "not an iface", 1, "x"}}));
+    expectIptablesRestoreCommands(ExpectedIptablesCommands{});
+}
+
 TEST_F(IdletimerControllerTest, TestAddRemove) {
     auto expected = makeAddRemoveCommands(true);
     mIt.addInterfaceIdletimer("wlan0", 12345, "hello");
@@ -14,21 +14,30 @@
  * limitations under the License.
  */
 
+#include <arpa/inet.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <malloc.h>
 #include <net/if.h>
 #include <net/if_arp.h>
 #include <sys/socket.h>
 
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #define LOG_TAG "InterfaceController"
 #include <android-base/file.h>
 #include <android-base/properties.h>
+#include <android-base/unique_fd.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <linux/if_ether.h>
+#include <linux/if_link.h>
 #include <log/log.h>
 #include <netutils/ifc.h>
 
@@ -38,11 +47,13 @@
 #include <netdutils/Syscalls.h>
 
 #include "InterfaceController.h"
+#include "NetlinkCommands.h"
 #include "RouteController.h"
 
 using android::base::ReadFileToString;
 using android::base::StringPrintf;
 using android::base::Trim;
+using android::base::WriteStringToFd;
 using android::base::WriteStringToFile;
 using android::netdutils::isOk;
 using android::netdutils::makeSlice;
@@ -100,11 +111,145 @@ inline bool isInterfaceName(const char *name) {
            (strcmp(name, "all") != 0);
 }
 
+// Cache of directory fds for /proc/sys/net/<family>/<which>/<interface> directories, so
+// repeated parameter writes during interface bring-up skip path resolution and open one fd
+// per file instead of resolving the full path each time. A cached fd can go stale when its
+// interface is deleted and recreated; writes then fail with ENOENT and the entry is reopened.
+constexpr size_t kMaxCachedDirFds = 64;
+std::mutex gDirFdLock;
+std::map<std::string, android::base::unique_fd> gDirFds;
+
+android::base::unique_fd openParameterDir(const std::string& dirPath) {
+    return android::base::unique_fd(open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+}
+
+int writeValueInDir(const std::string& dirPath, const char* basename, const char* value) {
+    std::lock_guard guard(gDirFdLock);
+    bool cached = true;
+    auto it = gDirFds.find(dirPath);
+    if (it == gDirFds.end()) {
+        auto dirFd = openParameterDir(dirPath);
+        if (dirFd < 0) return -errno;
+        if (gDirFds.size() >= kMaxCachedDirFds) {
+            gDirFds.clear();
+        }
+        it = gDirFds.emplace(dirPath, std::move(dirFd)).first;
+        cached = false;
+    }
+
+    android::base::unique_fd fd(openat(it->second, basename, O_WRONLY | O_CLOEXEC));
+    if (fd < 0 && cached) {
+        // The interface may have been deleted and recreated since the directory fd was
+        // cached; reopen the directory and try once more.
+        gDirFds.erase(it);
+        auto dirFd = openParameterDir(dirPath);
+        if (dirFd < 0) return -errno;
+        it = gDirFds.emplace(dirPath, std::move(dirFd)).first;
+        fd.reset(openat(it->second, basename, O_WRONLY | O_CLOEXEC));
+    }
+    if (fd < 0) return -errno;
+
+    return WriteStringToFd(value, fd) ? 0 : -errno;
+}
+
 int writeValueToPath(
         const char* dirname, const char* subdirname, const char* basename,
         const char* value) {
-    std::string path(StringPrintf("%s/%s/%s", dirname, subdirname, basename));
-    return WriteStringToFile(value, path) ? 0 : -EREMOTEIO;
+    std::string dirPath(StringPrintf("%s/%s", dirname, subdirname));
+    return writeValueInDir(dirPath, basename, value) == 0 ? 0 : -EREMOTEIO;
+}
+
+// Whether per-interface sysctl toggles are applied asynchronously on a dedicated thread instead
+// of blocking the calling (binder) thread on one procfs write per setting. Set once by
+// initializeAll() from persist.netd.async_sysctl. See SysctlWorker and
+// InterfaceController::waitForPendingSysctlWrites().
+bool sAsyncSysctl = false;
+
+// Applies sysctl writes on a dedicated thread. Writes are combined per file: if a setting is
+// toggled again before the worker gets to it, only the latest value is written. Pending writes
+// are drained in one pass, so the several settings the framework flips together on a network
+// attach hit the same cached directory fd back to back. Only engaged when
+// persist.netd.async_sysctl is set; callers that need to observe their writes (or their errors)
+// call sync().
+class SysctlWorker {
+  public:
+    static SysctlWorker& instance() {
+        // Deliberately never destroyed.
+        static SysctlWorker* sInstance = new SysctlWorker();
+        return *sInstance;
+    }
+
+    void enqueue(std::string dirPath, std::string basename, std::string value) {
+        {
+            std::lock_guard lock(mLock);
+            mPending[{std::move(dirPath), std::move(basename)}] = std::move(value);
+        }
+        mWork.notify_one();
+    }
+
+    // Blocks until every write enqueued so far has reached procfs, then returns the first error
+    // seen since the last call (0 if none).
+    int sync() {
+        std::unique_lock lock(mLock);
+        mIdle.wait(lock, [this] { return mPending.empty() && !mBusy; });
+        const int ret = mFirstError;
+        mFirstError = 0;
+        return ret;
+    }
+
+  private:
+    SysctlWorker() { std::thread(&SysctlWorker::loop, this).detach(); }
+
+    void loop() {
+        std::unique_lock lock(mLock);
+        while (true) {
+            mWork.wait(lock, [this] { return !mPending.empty(); });
+            decltype(mPending) batch;
+            batch.swap(mPending);
+            mBusy = true;
+            lock.unlock();
+
+            for (const auto& [file, value] : batch) {
+                const auto& [dirPath, basename] = file;
+                int ret = writeValueInDir(dirPath, basename.c_str(), value.c_str());
+                if (ret != 0) {
+                    ALOGE("cannot write %s to %s/%s: %s", value.c_str(), dirPath.c_str(),
+                          basename.c_str(), strerror(-ret));
+                }
+                std::lock_guard errLock(mLock);
+                if (mFirstError == 0) mFirstError = ret;
+            }
+
+            lock.lock();
+            mBusy = false;
+            if (mPending.empty()) {
+                mIdle.notify_all();
+            }
+        }
+    }
+
+    std::mutex mLock;
+    std::condition_variable mWork;
+    std::condition_variable mIdle;
+    // Keyed by (directory, file), so a newer value for the same setting replaces the queued one.
+    // Map order keeps writes for the same interface adjacent in a drain pass.
+    std::map<std::pair<std::string, std::string>, std::string> mPending;
+    bool mBusy = false;
+    int mFirstError = 0;
+};
+
+// Writes one per-interface setting, asynchronously when persist.netd.async_sysctl is set. In
+// async mode anything a synchronous call would have rejected up front (a bad interface name) was
+// already checked by the caller; the kernel's verdict on the queued write can only be logged and
+// collected by waitForPendingSysctlWrites().
+int writeIfaceValue(const char* dirname, const char* interface, const char* basename,
+                    const char* value) {
+    if (sAsyncSysctl) {
+        SysctlWorker::instance().enqueue(StringPrintf("%s/%s", dirname, interface), basename,
+                                         value);
+        return 0;
+    }
+    return writeValueToPath(dirname, interface, basename, value);
 }
 
 // Run @fn on each interface as well as 'default' in the path @dirname.
@@ -234,6 +379,8 @@ android::netdutils::Status InterfaceController::enableStablePrivacyAddresses(
 }
 
 void InterfaceController::initializeAll() {
+    sAsyncSysctl = android::base::GetBoolProperty("persist.netd.async_sysctl", false);
+
     // Initial IPv6 settings.
     // By default, accept_ra is set to 1 (accept RAs unless forwarding is on) on all interfaces.
     // This causes RAs to work or not work based on whether forwarding is on, and causes routes
@@ -304,7 +451,7 @@ int InterfaceController::setAcceptIPv6Ra(const char *interface, const int on) {
     // Because forwarding can be enabled even when tethering is off, we always
     // use mode "2" (accept RAs, even if forwarding is enabled).
     const char *accept_ra = on ? "2" : "0";
-    return writeValueToPath(ipv6_proc_path, interface, "accept_ra", accept_ra);
+    return writeIfaceValue(ipv6_proc_path, interface, "accept_ra", accept_ra);
 }
 
 int InterfaceController::setAcceptIPv6Dad(const char *interface, const int on) {
@@ -313,7 +460,7 @@ int InterfaceController::setAcceptIPv6Dad(const char *interface, const int on) {
         return -1;
     }
     const char *accept_dad = on ? "1" : "0";
-    return writeValueToPath(ipv6_proc_path, interface, "accept_dad", accept_dad);
+    return writeIfaceValue(ipv6_proc_path, interface, "accept_dad", accept_dad);
 }
 
 int InterfaceController::setIPv6DadTransmits(const char *interface, const char *value) {
@@ -321,7 +468,7 @@ int InterfaceController::setIPv6DadTransmits(const char *interface, const char *
         errno = ENOENT;
         return -1;
     }
-    return writeValueToPath(ipv6_proc_path, interface, "dad_transmits", value);
+    return writeIfaceValue(ipv6_proc_path, interface, "dad_transmits", value);
 }
 
 int InterfaceController::setIPv6PrivacyExtensions(const char *interface, const int on) {
@@ -331,7 +478,7 @@ int InterfaceController::setIPv6PrivacyExtensions(const char *interface, const i
     }
     // 0: disable IPv6 privacy addresses
     // 2: enable IPv6 privacy addresses and prefer them over non-privacy ones.
-    return writeValueToPath(ipv6_proc_path, interface, "use_tempaddr", on ? "2" : "0");
+    return writeIfaceValue(ipv6_proc_path, interface, "use_tempaddr", on ? "2" : "0");
 }
 
 void InterfaceController::setAcceptRA(const char *value) {
@@ -386,6 +533,9 @@ int InterfaceController::getParameter(
     if (path.empty()) {
         return -errno;
     }
+    // Settings still queued for asynchronous application must be visible to a read that follows
+    // the write.
+    waitForPendingSysctlWrites();
     if (ReadFileToString(path, value)) {
         *value = Trim(*value);
         return 0;
@@ -396,11 +546,106 @@ int InterfaceController::getParameter(
 int InterfaceController::setParameter(
         const char *family, const char *which, const char *interface, const char *parameter,
         const char *value) {
-    const std::string path(getParameterPathname(family, which, interface, parameter));
-    if (path.empty()) {
-        return -errno;
+    if (!isAddressFamilyPathComponent(family)) {
+        return -EAFNOSUPPORT;
+    } else if (!isNormalPathComponent(which) ||
+               !isInterfaceName(interface) ||
+               !isNormalPathComponent(parameter)) {
+        return -EINVAL;
+    }
+    return writeValueInDir(StringPrintf("%s/%s/%s/%s", proc_net_path, family, which, interface),
+                           parameter, value);
+}
+
+int InterfaceController::setParameters(
+        const char* family, const char* which, const char* interface,
+        const std::vector<std::pair<std::string, std::string>>& parameters) {
+    if (!isAddressFamilyPathComponent(family)) {
+        return -EAFNOSUPPORT;
+    } else if (!isNormalPathComponent(which) || !isInterfaceName(interface)) {
+        return -EINVAL;
+    }
+
+    const std::string dirPath(StringPrintf("%s/%s/%s/%s", proc_net_path, family, which, interface));
+    int ret = 0;
+    for (const auto& [parameter, value] : parameters) {
+        int rv = isNormalPathComponent(parameter.c_str())
+                ? writeValueInDir(dirPath, parameter.c_str(), value.c_str())
+                : -EINVAL;
+        // Apply the remaining parameters anyway but report the first failure.
+        if (ret == 0) ret = rv;
+    }
+    return ret;
+}
+
+void InterfaceController::SysctlTransaction::set(const char* family, const char* which,
+                                                 const char* ifName, const char* parameter,
+                                                 const char* value) {
+    if (!isAddressFamilyPathComponent(family)) {
+        if (mError == 0) mError = -EAFNOSUPPORT;
+        return;
+    }
+    if (!isNormalPathComponent(which) || !isInterfaceName(ifName) ||
+        !isNormalPathComponent(parameter)) {
+        if (mError == 0) mError = -EINVAL;
+        return;
+    }
+    mWrites.push_back({StringPrintf("%s/%s/%s/%s", proc_net_path, family, which, ifName),
+                       parameter, value});
+}
+
+int InterfaceController::SysctlTransaction::commit() {
+    std::vector<Write> writes;
+    writes.swap(mWrites);
+    if (mError != 0) {
+        const int ret = mError;
+        mError = 0;
+        return ret;
+    }
+
+    // Queued asynchronous writes must land first, so the values read back here (and restored on
+    // rollback) are the ones actually in effect.
+    waitForPendingSysctlWrites();
+
+    struct Applied {
+        size_t index;
+        std::string oldValue;
+    };
+    std::vector<Applied> applied;
+    applied.reserve(writes.size());
+
+    int ret = 0;
+    for (size_t i = 0; i < writes.size(); ++i) {
+        const Write& w = writes[i];
+        std::string oldValue;
+        const bool haveOld = ReadFileToString(w.dirPath + "/" + w.parameter, &oldValue);
+        ret = writeValueInDir(w.dirPath, w.parameter.c_str(), w.value.c_str());
+        if (ret != 0) {
+            ALOGE("cannot write %s to %s/%s: %s", w.value.c_str(), w.dirPath.c_str(),
+                  w.parameter.c_str(), strerror(-ret));
+            break;
+        }
+        if (haveOld) applied.push_back({i, Trim(oldValue)});
+    }
+    if (ret != 0) {
+        // Roll back in reverse order, so a file the transaction wrote more than once ends up
+        // restored to its original value.
+        for (auto it = applied.rbegin(); it != applied.rend(); ++it) {
+            const Write& w = writes[it->index];
+            if (int rv = writeValueInDir(w.dirPath, w.parameter.c_str(), it->oldValue.c_str())) {
+                ALOGE("cannot roll back %s/%s to %s: %s", w.dirPath.c_str(), w.parameter.c_str(),
+                      it->oldValue.c_str(), strerror(-rv));
+            }
+        }
+    }
+    return ret;
+}
+
+int InterfaceController::waitForPendingSysctlWrites() {
+    if (!sAsyncSysctl) {
+        return 0;
     }
-    return WriteStringToFile(value, path) ? 0 : -errno;
+    return SysctlWorker::instance().sync();
 }
 
 void InterfaceController::setBaseReachableTimeMs(unsigned int millis) {
@@ -435,39 +680,127 @@ std::string toStdString(const String16& s) {
     return std::string(String8(s.string()));
 }
 
+constexpr uint16_t U16_RTA_LENGTH(uint16_t x) {
+    return RTA_LENGTH(x);
+}
+
+// An IPv4 address currently assigned to an interface, as found by an RTM_GETADDR dump.
+struct AssignedIpv4Address {
+    in_addr addr;
+    uint8_t prefixLength;
+};
+
+// Collects the IPv4 addresses assigned to interface |ifindex|.
+int getAssignedIpv4Addresses(uint32_t ifindex, std::vector<AssignedIpv4Address>* addresses) {
+    ifaddrmsg getMsg = {
+            .ifa_family = AF_INET,
+    };
+    iovec iov[] = {
+            {nullptr, 0},
+            {&getMsg, sizeof(getMsg)},
+    };
+
+    NetlinkDumpCallback callback = [ifindex, addresses](nlmsghdr* nlh) {
+        if (nlh->nlmsg_type != RTM_NEWADDR) return;
+        ifaddrmsg* ifaddr = reinterpret_cast<ifaddrmsg*>(NLMSG_DATA(nlh));
+        if (ifaddr->ifa_index != ifindex || ifaddr->ifa_family != AF_INET) return;
+        int len = IFA_PAYLOAD(nlh);
+        for (rtattr* rta = IFA_RTA(ifaddr); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+            if (rta->rta_type == IFA_LOCAL && RTA_PAYLOAD(rta) == sizeof(in_addr)) {
+                AssignedIpv4Address assigned;
+                memcpy(&assigned.addr, RTA_DATA(rta), sizeof(in_addr));
+                assigned.prefixLength = ifaddr->ifa_prefixlen;
+                addresses->push_back(assigned);
+            }
+        }
+    };
+
+    return sendNetlinkRequest(RTM_GETADDR, NETLINK_DUMP_FLAGS, iov, ARRAY_SIZE(iov), &callback);
+}
+
+// Appends an RTM_DELADDR or RTM_NEWADDR request for an IPv4 address to |batch|.
+void appendAddressRequest(NetlinkRequestBatch* batch, uint16_t action, uint16_t flags,
+                          uint32_t ifindex, const in_addr& addr, uint8_t prefixLength) {
+    ifaddrmsg addrMsg = {
+            .ifa_family = AF_INET,
+            .ifa_prefixlen = prefixLength,
+            .ifa_index = ifindex,
+    };
+    rtattr rtaLocal = {U16_RTA_LENGTH(sizeof(in_addr)), IFA_LOCAL};
+    rtattr rtaAddress = {U16_RTA_LENGTH(sizeof(in_addr)), IFA_ADDRESS};
+    iovec iov[] = {
+            {nullptr, 0},
+            {&addrMsg, sizeof(addrMsg)},
+            {&rtaLocal, sizeof(rtaLocal)},
+            {const_cast<in_addr*>(&addr), sizeof(addr)},
+            {&rtaAddress, action == RTM_NEWADDR ? sizeof(rtaAddress) : 0},
+            {const_cast<in_addr*>(&addr), action == RTM_NEWADDR ? sizeof(addr) : 0},
+    };
+    batch->append(action, flags, iov, ARRAY_SIZE(iov));
+}
+
 }  // namespace
 
+// Applies the entire configuration - address removal, flag change and address assignment - as one
+// batch of rtnetlink messages written to the kernel in a single syscall, instead of the serial
+// SIOCSIFADDR/SIOCGIFFLAGS/SIOCSIFFLAGS ioctl round-trips this used to take.
 Status InterfaceController::setCfg(const InterfaceConfigurationParcel& cfg) {
-    const auto& sys = sSyscalls.get();
-    ASSIGN_OR_RETURN(auto fd, sys.socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0));
-    struct ifreq ifr = {
-            .ifr_addr = {.sa_family = AF_INET},  // Clear the IPv4 address.
-    };
-    strlcpy(ifr.ifr_name, cfg.ifName.c_str(), IFNAMSIZ);
+    const uint32_t ifindex = if_nametoindex(cfg.ifName.c_str());
+    if (ifindex == 0) {
+        return statusFromErrno(ENODEV, "Unknown interface " + cfg.ifName);
+    }
 
-    // Make sure that clear IPv4 address before set flag
-    // SIOCGIFFLAGS might override ifr and caused clear IPv4 addr ioctl error
-    RETURN_IF_NOT_OK(sys.ioctl(fd, SIOCSIFADDR, &ifr));
+    // The legacy SIOCSIFADDR-with-zero call cleared any existing primary IPv4 address before the
+    // new one was assigned. RTM_NEWADDR alone would leave a different old address in place, so
+    // find the currently assigned addresses and queue their removal ahead of the new assignment.
+    std::vector<AssignedIpv4Address> oldAddresses;
+    if (int ret = getAssignedIpv4Addresses(ifindex, &oldAddresses)) {
+        return statusFromErrno(-ret, "Failed to list addresses on " + cfg.ifName);
+    }
 
-    if (!cfg.flags.empty()) {
-        RETURN_IF_NOT_OK(sys.ioctl(fd, SIOCGIFFLAGS, &ifr));
-        uint16_t flags = ifr.ifr_flags;
+    NetlinkRequestBatch batch;
+    for (const auto& old : oldAddresses) {
+        appendAddressRequest(&batch, RTM_DELADDR, NETLINK_REQUEST_FLAGS, ifindex, old.addr,
+                             old.prefixLength);
+    }
 
+    if (!cfg.flags.empty()) {
+        bool up = false;
+        bool changeState = false;
         for (const auto& flag : cfg.flags) {
             if (flag == toStdString(INetd::IF_STATE_UP())) {
-                ifr.ifr_flags = ifr.ifr_flags | IFF_UP;
+                up = true;
+                changeState = true;
             } else if (flag == toStdString(INetd::IF_STATE_DOWN())) {
-                ifr.ifr_flags = (ifr.ifr_flags & (~IFF_UP));
+                up = false;
+                changeState = true;
             }
         }
-
-        if (ifr.ifr_flags != flags) {
-            RETURN_IF_NOT_OK(sys.ioctl(fd, SIOCSIFFLAGS, &ifr));
+        if (changeState) {
+            ifinfomsg linkMsg = {
+                    .ifi_family = AF_UNSPEC,
+                    .ifi_index = static_cast<int>(ifindex),
+                    .ifi_flags = up ? IFF_UP : 0u,
+                    .ifi_change = IFF_UP,
+            };
+            iovec iov[] = {
+                    {nullptr, 0},
+                    {&linkMsg, sizeof(linkMsg)},
+            };
+            batch.append(RTM_NEWLINK, NETLINK_REQUEST_FLAGS, iov, ARRAY_SIZE(iov));
         }
     }
 
-    if (int ret = ifc_add_address(cfg.ifName.c_str(), cfg.ipv4Addr.c_str(), cfg.prefixLength)) {
-        return statusFromErrno(-ret, "Failed to add addr");
+    // An unparseable or zero address (e.g. "0.0.0.0" from callers that only want to clear the
+    // interface) skips the assignment, like the legacy ifc_add_address() path effectively did.
+    in_addr newAddr;
+    if (inet_pton(AF_INET, cfg.ipv4Addr.c_str(), &newAddr) == 1 && newAddr.s_addr != INADDR_ANY) {
+        appendAddressRequest(&batch, RTM_NEWADDR, NETLINK_ROUTE_CREATE_FLAGS, ifindex, newAddr,
+                             cfg.prefixLength);
+    }
+
+    if (int ret = batch.flush()) {
+        return statusFromErrno(-ret, "Failed to configure " + cfg.ifName);
     }
 
     return ok;
@@ -528,5 +861,103 @@ int InterfaceController::clearAddrs(const std::string& ifName) {
     return ifc_clear_addresses(ifName.c_str());
 }
 
+namespace {
+
+// Cache for getIfaceStats(). One RTM_GETSTATS dump returns the counters for every interface, so
+// a burst of per-interface polls is served by a single dump instead of one netlink round trip
+// each. Counters drift the moment they are read, so a short lifetime loses no accuracy that the
+// uncached path would have had.
+constexpr auto kIfaceStatsCacheTimeout = std::chrono::milliseconds(100);
+
+struct IfaceStatsCache {
+    std::mutex mutex;
+    std::map<uint32_t, InterfaceController::IfaceStats> stats;  // Keyed by ifindex.
+    std::chrono::steady_clock::time_point when;
+    bool valid = false;
+};
+
+IfaceStatsCache& ifaceStatsCache() {
+    static IfaceStatsCache* cache = new IfaceStatsCache;
+    return *cache;
+}
+
+}  // namespace
+
+StatusOr<InterfaceController::IfaceStats> InterfaceController::getIfaceStats(
+        const std::string& ifName) {
+    const uint32_t ifindex = if_nametoindex(ifName.c_str());
+    if (ifindex == 0) {
+        return statusFromErrno(ENODEV, "no such interface: " + ifName);
+    }
+
+    IfaceStatsCache& cache = ifaceStatsCache();
+    std::lock_guard guard(cache.mutex);
+    const auto now = std::chrono::steady_clock::now();
+    const auto refresh = [&cache, now]() -> int {
+        if_stats_msg getMsg = {
+                .family = AF_UNSPEC,
+                .filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64),
+        };
+        iovec iov[] = {
+                {nullptr, 0},
+                {&getMsg, sizeof(getMsg)},
+        };
+
+        std::map<uint32_t, IfaceStats> freshStats;
+        NetlinkDumpCallback callback = [&freshStats](nlmsghdr* nlh) {
+            if (nlh->nlmsg_type != RTM_NEWSTATS) return;
+            const if_stats_msg* msg = reinterpret_cast<if_stats_msg*>(NLMSG_DATA(nlh));
+            // There is no RTA iteration macro for if_stats_msg; attributes start at the next
+            // NLMSG_ALIGN boundary after it, just as for the other rtnetlink headers.
+            uint32_t len = NLMSG_PAYLOAD(nlh, sizeof(if_stats_msg));
+            rtattr* rta = reinterpret_cast<rtattr*>(reinterpret_cast<char*>(NLMSG_DATA(nlh)) +
+                                                    NLMSG_ALIGN(sizeof(if_stats_msg)));
+            for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+                if (rta->rta_type != IFLA_STATS_LINK_64 ||
+                    RTA_PAYLOAD(rta) < sizeof(rtnl_link_stats64)) {
+                    continue;
+                }
+                const auto* s = static_cast<const rtnl_link_stats64*>(RTA_DATA(rta));
+                freshStats[msg->ifindex] = {
+                        .rxBytes = s->rx_bytes,
+                        .rxPackets = s->rx_packets,
+                        .txBytes = s->tx_bytes,
+                        .txPackets = s->tx_packets,
+                };
+            }
+        };
+
+        if (int ret = sendNetlinkRequest(RTM_GETSTATS, NETLINK_DUMP_FLAGS, iov, ARRAY_SIZE(iov),
+                                         &callback)) {
+            return ret;
+        }
+        cache.stats = std::move(freshStats);
+        cache.when = now;
+        cache.valid = true;
+        return 0;
+    };
+
+    bool refreshed = false;
+    if (!cache.valid || now - cache.when >= kIfaceStatsCacheTimeout) {
+        if (int ret = refresh()) {
+            return statusFromErrno(-ret, "RTM_GETSTATS dump failed");
+        }
+        refreshed = true;
+    }
+
+    auto it = cache.stats.find(ifindex);
+    if (it == cache.stats.end() && !refreshed) {
+        // The interface appeared after the cached dump was taken; take a fresh one for it.
+        if (int ret = refresh()) {
+            return statusFromErrno(-ret, "RTM_GETSTATS dump failed");
+        }
+        it = cache.stats.find(ifindex);
+    }
+    if (it == cache.stats.end()) {
+        return statusFromErrno(ENODEV, "no stats for interface: " + ifName);
+    }
+    return it->second;
+}
+
 }  // namespace net
 }  // namespace android
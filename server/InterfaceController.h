@@ -20,6 +20,8 @@
 #include <functional>
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <android/net/InterfaceConfigurationParcel.h>
 #include <netdutils/Status.h>
@@ -32,6 +34,33 @@ class StablePrivacyTest;
 
 class InterfaceController {
 public:
+    // Collects sysctl writes and applies them in one pass with rollback-on-failure: the previous
+    // value of each file is read back just before it is written, and the first failed write
+    // restores every already-applied one in reverse order. Callers that flip several settings
+    // that only make sense together (e.g. putting an interface into IPv6 router mode) get one
+    // pass over the cached directory fds and never leave a partially-applied intermediate state.
+    // Writes are applied in the order they were queued; the same file may be queued repeatedly.
+    class SysctlTransaction {
+      public:
+        // Queues /proc/sys/net/<family>/<which>/<ifName>/<parameter> := |value|. An invalid path
+        // component poisons the transaction: nothing is written and commit() returns the error.
+        void set(const char* family, const char* which, const char* ifName, const char* parameter,
+                 const char* value);
+
+        // Applies the queued writes and returns 0, or rolls back and returns the first error
+        // (negative errno). Leaves the transaction empty, ready for reuse.
+        [[nodiscard]] int commit();
+
+      private:
+        struct Write {
+            std::string dirPath;
+            std::string parameter;
+            std::string value;
+        };
+        std::vector<Write> mWrites;
+        int mError = 0;
+    };
+
     static void initializeAll();
 
     static int setEnableIPv6(const char* ifName, const int on);
@@ -58,6 +87,34 @@ public:
                             const char* parameter, std::string* value);
     static int setParameter(const char* family, const char* which, const char* ifName,
                             const char* parameter, const char* value);
+    // Writes a list of (parameter, value) pairs under the same
+    // /proc/sys/net/<family>/<which>/<ifName>/ directory in one pass over a single cached
+    // directory fd. All writes are attempted; returns 0 or the first error (-errno).
+    static int setParameters(const char* family, const char* which, const char* ifName,
+                             const std::vector<std::pair<std::string, std::string>>& parameters);
+
+    // Byte and packet counters for one interface, as reported by the kernel's 64-bit link
+    // statistics (RTM_GETSTATS with IFLA_STATS_LINK_64). Reading these over netlink hands the
+    // caller binary counters directly; there is no text to format on the kernel side or to
+    // parse here, unlike the /proc/net/dev path.
+    struct IfaceStats {
+        uint64_t rxBytes = 0;
+        uint64_t rxPackets = 0;
+        uint64_t txBytes = 0;
+        uint64_t txPackets = 0;
+    };
+
+    // Returns the current counters for |ifName|, or ENODEV if no such interface exists. Results
+    // are cached briefly per interface so that a burst of polls (e.g. the framework sampling
+    // several interfaces in quick succession) costs one netlink dump, not one per call.
+    static android::netdutils::StatusOr<IfaceStats> getIfaceStats(const std::string& ifName);
+
+    // When asynchronous sysctl writes are enabled (persist.netd.async_sysctl), the per-interface
+    // IPv6 RA/DAD/privacy toggles return once enqueued and a dedicated thread applies them,
+    // combining repeated writes to the same setting. This call blocks until every write enqueued
+    // so far has been applied, and returns the first error seen since the last call, for callers
+    // that need ordering. In the default synchronous mode it is a no-op returning 0.
+    static int waitForPendingSysctlWrites();
 
     static std::mutex mutex;
 
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InterfaceNames"
+
+#include "InterfaceNames.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <log/log.h>
+
+namespace android {
+namespace net {
+
+namespace {
+
+struct Entry {
+    std::string name;
+    uint32_t ifindex = 0;
+};
+
+std::mutex sMutex;
+
+// Indexed by id. Slot 0 is the unused INVALID_ID slot, so |sEntries.size() - 1| live entries.
+std::vector<Entry>& entries() {
+    static std::vector<Entry>* entries = new std::vector<Entry>(1);
+    return *entries;
+}
+
+std::unordered_map<std::string, uint16_t>& idsByName() {
+    static auto* ids = new std::unordered_map<std::string, uint16_t>();
+    return *ids;
+}
+
+}  // namespace
+
+uint16_t InterfaceNames::intern(const char* name) {
+    std::lock_guard guard(sMutex);
+    auto& ids = idsByName();
+    if (auto iter = ids.find(name); iter != ids.end()) {
+        return iter->second;
+    }
+    auto& table = entries();
+    if (table.size() > UINT16_MAX) {
+        // Only reachable if something churns through 65535 distinct names; real devices see a
+        // few dozen. Callers treat INVALID_ID like a name they have never seen.
+        ALOGE("interning table full, cannot intern %s", name);
+        return INVALID_ID;
+    }
+    const uint16_t id = static_cast<uint16_t>(table.size());
+    table.push_back({name, 0});
+    ids.emplace(name, id);
+    return id;
+}
+
+uint16_t InterfaceNames::lookup(const char* name) {
+    std::lock_guard guard(sMutex);
+    const auto& ids = idsByName();
+    auto iter = ids.find(name);
+    return (iter != ids.end()) ? iter->second : INVALID_ID;
+}
+
+std::string InterfaceNames::nameOf(uint16_t id) {
+    std::lock_guard guard(sMutex);
+    const auto& table = entries();
+    return (id != INVALID_ID && id < table.size()) ? table[id].name : std::string();
+}
+
+void InterfaceNames::setIfindex(uint16_t id, uint32_t ifindex) {
+    std::lock_guard guard(sMutex);
+    auto& table = entries();
+    if (id != INVALID_ID && id < table.size()) {
+        table[id].ifindex = ifindex;
+    }
+}
+
+uint32_t InterfaceNames::ifindexOf(uint16_t id) {
+    std::lock_guard guard(sMutex);
+    const auto& table = entries();
+    return (id != INVALID_ID && id < table.size()) ? table[id].ifindex : 0;
+}
+
+std::string InterfaceNames::toString() {
+    std::lock_guard guard(sMutex);
+    const auto& table = entries();
+    std::string out;
+    for (size_t id = 1; id < table.size(); id++) {
+        base::StringAppendF(&out, "%s%s=%zu(idx %u)", out.empty() ? "" : " ",
+                            table[id].name.c_str(), id, table[id].ifindex);
+    }
+    return out;
+}
+
+}  // namespace net
+}  // namespace android
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_SERVER_INTERFACE_NAMES_H
+#define NETD_SERVER_INTERFACE_NAMES_H
+
+#include <stdint.h>
+
+#include <string>
+
+namespace android {
+namespace net {
+
+// Process-wide interning table for interface names.
+//
+// Every interface name netd has seen is assigned a small stable id, so controllers can key their
+// own maps by the id and cross-controller calls pay one hash in this table instead of re-hashing
+// the same "rmnet_data7" at every boundary. The last ifindex observed for the name can be attached
+// to the entry by whichever controller learns it.
+//
+// Ids are never reused for the life of the process. A device has a small, mostly recycled set of
+// interface names, so the table stops growing once every name has been seen once. All methods are
+// thread-safe.
+class InterfaceNames {
+  public:
+    // Never assigned to a name; returned by lookup() for names that were never interned.
+    static constexpr uint16_t INVALID_ID = 0;
+
+    // Returns the id for |name|, assigning the next free one the first time |name| is seen.
+    static uint16_t intern(const char* name);
+
+    // Returns the id for |name| without creating one, or INVALID_ID if it was never interned.
+    static uint16_t lookup(const char* name);
+
+    // Returns the name interned under |id|, or an empty string for INVALID_ID and unknown ids.
+    static std::string nameOf(uint16_t id);
+
+    // Attaches the current ifindex to an entry. An interface name can map to different indices
+    // over time; the table keeps whatever the last caller recorded.
+    static void setIfindex(uint16_t id, uint32_t ifindex);
+
+    // Returns the last ifindex recorded for |id|, or 0 if none was ever recorded.
+    static uint32_t ifindexOf(uint16_t id);
+
+    // One-line summary of the table ("wlan0=1(idx 5) rmnet_data7=2(idx 12) ..."), for dumpsys.
+    static std::string toString();
+};
+
+}  // namespace net
+}  // namespace android
+
+#endif  // NETD_SERVER_INTERFACE_NAMES_H
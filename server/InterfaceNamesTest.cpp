@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+
+#include "InterfaceNames.h"
+
+namespace android {
+namespace net {
+
+// The table is process-wide and ids are never reused, so these tests use names unlikely to
+// collide with other tests and never assume specific id values.
+
+TEST(InterfaceNamesTest, InternIsStable) {
+    const uint16_t id = InterfaceNames::intern("ifnamestest0");
+    ASSERT_NE(InterfaceNames::INVALID_ID, id);
+    EXPECT_EQ(id, InterfaceNames::intern("ifnamestest0"));
+    EXPECT_EQ(id, InterfaceNames::lookup("ifnamestest0"));
+    EXPECT_EQ("ifnamestest0", InterfaceNames::nameOf(id));
+
+    const uint16_t other = InterfaceNames::intern("ifnamestest1");
+    ASSERT_NE(InterfaceNames::INVALID_ID, other);
+    EXPECT_NE(id, other);
+}
+
+TEST(InterfaceNamesTest, LookupNeverInterns) {
+    EXPECT_EQ(InterfaceNames::INVALID_ID, InterfaceNames::lookup("ifnamestest-never-seen"));
+    // Still not present after the failed lookup.
+    EXPECT_EQ(InterfaceNames::INVALID_ID, InterfaceNames::lookup("ifnamestest-never-seen"));
+}
+
+TEST(InterfaceNamesTest, InvalidId) {
+    EXPECT_EQ("", InterfaceNames::nameOf(InterfaceNames::INVALID_ID));
+    EXPECT_EQ(0U, InterfaceNames::ifindexOf(InterfaceNames::INVALID_ID));
+    // Silently ignored rather than crashing.
+    InterfaceNames::setIfindex(InterfaceNames::INVALID_ID, 42);
+    EXPECT_EQ(0U, InterfaceNames::ifindexOf(InterfaceNames::INVALID_ID));
+}
+
+TEST(InterfaceNamesTest, IfindexTracksLastWrite) {
+    const uint16_t id = InterfaceNames::intern("ifnamestest2");
+    ASSERT_NE(InterfaceNames::INVALID_ID, id);
+    EXPECT_EQ(0U, InterfaceNames::ifindexOf(id));
+
+    InterfaceNames::setIfindex(id, 17);
+    EXPECT_EQ(17U, InterfaceNames::ifindexOf(id));
+
+    // The same name can come back with a different index; the table keeps the latest.
+    InterfaceNames::setIfindex(id, 23);
+    EXPECT_EQ(23U, InterfaceNames::ifindexOf(id));
+}
+
+TEST(InterfaceNamesTest, ToStringContainsEntries) {
+    const uint16_t id = InterfaceNames::intern("ifnamestest3");
+    ASSERT_NE(InterfaceNames::INVALID_ID, id);
+    InterfaceNames::setIfindex(id, 5);
+
+    const std::string expected = base::StringPrintf("ifnamestest3=%u(idx 5)", id);
+    EXPECT_NE(std::string::npos, InterfaceNames::toString().find(expected));
+}
+
+}  // namespace net
+}  // namespace android
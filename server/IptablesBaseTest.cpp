@@ -88,6 +88,16 @@ int IptablesBaseTest::fakeExecIptablesRestore(IptablesTarget target, const std::
     return fakeExecIptablesRestoreWithOutput(target, commands, nullptr);
 }
 
+int IptablesBaseTest::fakeExecIptablesRestoreQueued(IptablesTarget target,
+                                                    const std::string& commands) {
+    // Queued commands are recorded in write order, which is also the order they execute in.
+    return fakeExecIptablesRestoreWithOutput(target, commands, nullptr);
+}
+
+int IptablesBaseTest::fakeFlushIptablesRestore() {
+    return 0;
+}
+
 int IptablesBaseTest::fakeExecIptablesRestoreCommand(IptablesTarget target,
                                                      const std::string& table,
                                                      const std::string& command,
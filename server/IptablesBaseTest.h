@@ -31,6 +31,8 @@ public:
     static int fakeExecIptablesRestore(IptablesTarget target, const std::string& commands);
     static int fakeExecIptablesRestoreWithOutput(IptablesTarget target, const std::string& commands,
                                                  std::string *output);
+    static int fakeExecIptablesRestoreQueued(IptablesTarget target, const std::string& commands);
+    static int fakeFlushIptablesRestore();
     static int fakeExecIptablesRestoreCommand(IptablesTarget target, const std::string& table,
                                               const std::string& commands, std::string *output);
     static FILE *fake_popen(const char *cmd, const char *type);
@@ -15,21 +15,36 @@
  */
 
 #define LOG_TAG "IptablesRestoreController"
+#define ATRACE_TAG ATRACE_TAG_NETWORK
 #include "IptablesRestoreController.h"
 
+#include <inttypes.h>
+#include <limits.h>
 #include <poll.h>
 #include <signal.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <deque>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include <android-base/logging.h>
 #include <android-base/file.h>
+#include <netdutils/Stopwatch.h>
 #include <netdutils/Syscalls.h>
 
 #include "Controllers.h"
+#include "LatencyWatchdog.h"
 #include "NetdConstants.h"
 
+using android::netdutils::ScopedIndent;
 using android::netdutils::StatusOr;
+using android::netdutils::Stopwatch;
 using android::netdutils::sSyscalls;
 
 constexpr char IPTABLES_RESTORE_PATH[] = "/system/bin/iptables-restore";
@@ -43,6 +58,142 @@ constexpr size_t PING_SIZE = sizeof(PING) - 1;
 int IptablesRestoreController::MAX_RETRIES = 50;
 int IptablesRestoreController::POLL_TIMEOUT_MS = 100;
 
+namespace {
+
+// The helpers below take a command as a list of fragments whose concatenation is the command
+// text; their results must never depend on how the caller happened to fragment it.
+
+// Calls |lineFn| with each line of the concatenated fragments (without its trailing newline).
+// Lines that span a fragment boundary are assembled into a temporary first; callers mostly
+// fragment on line or table-block boundaries, so this is rare.
+template <typename LineFn>
+void forEachLine(const std::vector<std::string_view>& command, LineFn lineFn) {
+    std::string spill;
+    for (std::string_view rest : command) {
+        while (!rest.empty()) {
+            const size_t eol = rest.find('\n');
+            if (eol == std::string_view::npos) {
+                spill += rest;
+                break;
+            }
+            if (spill.empty()) {
+                lineFn(rest.substr(0, eol));
+            } else {
+                spill += rest.substr(0, eol);
+                lineFn(std::string_view(spill));
+                spill.clear();
+            }
+            rest.remove_prefix(eol + 1);
+        }
+    }
+    if (!spill.empty()) lineFn(std::string_view(spill));
+}
+
+// FNV-1a over the concatenated bytes of |command|. Unlike std::hash, this can consume the
+// fragments in place, without materializing the concatenation.
+size_t hashCommand(const std::vector<std::string_view>& command) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const std::string_view fragment : command) {
+        for (const char c : fragment) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+        }
+    }
+    return static_cast<size_t>(hash);
+}
+
+// Returns true if the concatenation of |command| contains |needle|. Each fragment is searched
+// directly; a sliding window over the fragment junctions catches matches that span a boundary.
+bool commandContains(const std::vector<std::string_view>& command, const std::string& needle) {
+    if (needle.empty()) return true;
+    const size_t overlap = needle.size() - 1;
+    std::string tail;  // The last |overlap| bytes of the fragments processed so far.
+    for (const std::string_view fragment : command) {
+        if (fragment.find(needle) != std::string_view::npos) return true;
+        if (!tail.empty()) {
+            std::string junction = tail;
+            junction += fragment.substr(0, std::min(overlap, fragment.size()));
+            if (junction.find(needle) != std::string::npos) return true;
+        }
+        if (fragment.size() >= overlap) {
+            tail.assign(fragment.substr(fragment.size() - overlap));
+        } else {
+            tail += fragment;
+            if (tail.size() > overlap) tail.erase(0, tail.size() - overlap);
+        }
+    }
+    return false;
+}
+
+// If |command| is a full replacement of exactly one chain - a single table block that flushes one
+// chain (":<chain> -") and otherwise only appends to that same chain - returns "<table>/<chain>".
+// Otherwise returns an empty string. Only such commands are idempotent, so only they are eligible
+// for the shadow cache: skipping a repeated "-A"/"-D"/"-I" command would change kernel state.
+std::string replacedChainKey(const std::vector<std::string_view>& command) {
+    std::string table;
+    std::string chain;
+    bool eligible = true;
+    forEachLine(command, [&](std::string_view line) {
+        if (!eligible || line.empty() || line == "COMMIT") {
+            return;
+        } else if (line[0] == '*') {
+            if (!table.empty()) {
+                eligible = false;  // More than one table.
+                return;
+            }
+            table = line.substr(1);
+        } else if (line[0] == ':') {
+            const size_t space = line.find(' ');
+            if (space == std::string_view::npos || line.substr(space) != " -" || !chain.empty()) {
+                eligible = false;  // Not a flush, or more than one chain.
+                return;
+            }
+            chain = line.substr(1, space - 1);
+        } else if (line.size() > 3 && line.compare(0, 3, "-A ") == 0) {
+            if (chain.empty() || line.compare(3, chain.size(), chain) != 0 ||
+                (line.size() > 3 + chain.size() && line[3 + chain.size()] != ' ')) {
+                eligible = false;  // Appends to a chain other than the one being replaced.
+            }
+        } else {
+            eligible = false;
+        }
+    });
+    return (!eligible || table.empty() || chain.empty()) ? "" : table + "/" + chain;
+}
+
+// Like android::base::WriteFully, but vectored: writes every iovec in order, retrying partial
+// writes and submitting at most IOV_MAX iovecs per writev() call. Consumes |iov|.
+bool writeFullyV(int fd, iovec* iov, size_t iovcnt) {
+    while (iovcnt > 0) {
+        if (iov->iov_len == 0) {
+            ++iov;
+            --iovcnt;
+            continue;
+        }
+        const int count = static_cast<int>(std::min<size_t>(iovcnt, IOV_MAX));
+        ssize_t written = TEMP_FAILURE_RETRY(writev(fd, iov, count));
+        if (written == -1) return false;
+        while (written > 0) {
+            if (static_cast<size_t>(written) >= iov->iov_len) {
+                written -= iov->iov_len;
+                ++iov;
+                --iovcnt;
+            } else {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+                iov->iov_len -= written;
+                written = 0;
+            }
+        }
+    }
+    return true;
+}
+
+std::string chainCacheKey(const IptablesTarget target, const std::string& chainKey) {
+    // V4, V6 and V4V6 commands program different kernel state, so cache them separately.
+    return std::to_string(target) + "|" + chainKey;
+}
+
+}  // namespace
+
 class IptablesProcess {
 public:
     IptablesProcess(const IptablesRestoreController::IptablesProcessType type,
@@ -72,6 +223,16 @@ public:
         return (ret == 1) && !(pollfd.revents & POLLERR);
     }
 
+    // If outBuf contains a complete ping echo, moves the output that precedes it into |output|,
+    // consumes the buffer through the echo, and returns true.
+    bool consumeAck(std::string* output) {
+        const size_t pos = outBuf.find(PING);
+        if (pos == std::string::npos) return false;
+        output->append(outBuf, 0, pos);
+        outBuf.erase(0, pos + PING_SIZE);
+        return true;
+    }
+
     void stop() {
         if (processTerminated) return;
 
@@ -92,6 +253,14 @@ public:
     struct pollfd pollFds[2];
     std::string errBuf;
 
+    // Output read from stdout but not yet attributed to a command. With pipelined commands in
+    // flight, bytes after one command's ping echo belong to the next command's response.
+    std::string outBuf;
+
+    // Commands written but whose acks have not yet been drained, oldest first. Kept so a deferred
+    // failure can still be logged against the command that caused it.
+    std::deque<std::string> inFlight;
+
     std::atomic_bool processTerminated;
 
     static constexpr size_t STDOUT_IDX = 0;
@@ -112,6 +281,11 @@ void IptablesRestoreController::Init() {
     // forkAndExec, which is sub-millisecond, and the child processes then call exec() in parallel.
     mIpRestore.reset(forkAndExec(IPTABLES_PROCESS));
     mIp6Restore.reset(forkAndExec(IP6TABLES_PROCESS));
+    // Standby children, promoted by takeStandby() when an active child dies. They exec and warm
+    // the iptables parser now, while the rest of netd finishes booting, rather than on the first
+    // firewall command after a crash.
+    mStandby[IPTABLES_PROCESS].reset(forkAndExec(IPTABLES_PROCESS));
+    mStandby[IP6TABLES_PROCESS].reset(forkAndExec(IP6TABLES_PROCESS));
 }
 
 /* static */
@@ -183,12 +357,43 @@ IptablesProcess* IptablesRestoreController::forkAndExec(const IptablesProcessTyp
             child_pid.value(), stdin_pipe[1], stdout_pipe[0], stderr_pipe[0]);
 }
 
+IptablesProcess* IptablesRestoreController::takeStandby(const IptablesProcessType type) {
+    std::unique_ptr<IptablesProcess> standby = std::move(mStandby[type]);
+    // Refill the slot immediately: the fork itself is sub-millisecond, and the new standby execs
+    // and warms up in parallel while the promoted child serves the pending command.
+    mStandby[type].reset(forkAndExec(type));
+    if (standby != nullptr && standby->outputReady()) {
+        return standby.release();
+    }
+    // The standby died while idle, or was never forked. Fall back to a cold fork.
+    if (standby != nullptr) {
+        standby->stop();
+    }
+    return forkAndExec(type);
+}
+
+void IptablesRestoreController::retireAndPromote(const IptablesProcessType type) {
+    std::unique_ptr<IptablesProcess>& process =
+            (type == IPTABLES_PROCESS) ? mIpRestore : mIp6Restore;
+    std::unique_ptr<IptablesProcess> retired = std::move(process);
+    process.reset(takeStandby(type));
+    if (retired == nullptr || retired->processTerminated) {
+        // Already stopped and reaped; destruction just closes the pipes.
+        return;
+    }
+    // A wedged child can ignore SIGTERM for as long as it sits in the kernel, and stopProcess()
+    // waits it out before escalating to SIGKILL. Do that on a detached thread: the promoted
+    // standby is already serving this lane, so nobody benefits from blocking on the teardown.
+    // The retired pipes no longer belong to any lane, so even if the child recovers and echoes
+    // the command it wedged on, that output cannot be misread as a successor's response.
+    std::thread([retired = std::move(retired)]() { retired->stop(); }).detach();
+}
+
 // TODO: Return -errno on failure instead of -1.
 // TODO: Maybe we should keep a rotating buffer of the last N commands
 // so that they can be dumped on dumpsys.
-int IptablesRestoreController::sendCommand(const IptablesProcessType type,
-                                           const std::string& command,
-                                           std::string *output) {
+int IptablesRestoreController::writeCommand(const IptablesProcessType type,
+                                            const std::vector<std::string_view>& command) {
    std::unique_ptr<IptablesProcess> *process =
            (type == IPTABLES_PROCESS) ? &mIpRestore : &mIp6Restore;
 
@@ -200,15 +405,19 @@ int IptablesRestoreController::sendCommand(const IptablesProcessType type,
     // recover from a child death. If the child dies at some later point during
     // the execution of this method, we will receive an EPIPE and return an
     // error. The command will then need to be retried at a higher level.
+    // An unwritable stdin is only evidence of death when no commands are in flight: with a
+    // non-empty pipeline it usually just means the pipe is full while the child parses, and an
+    // actually-dead child surfaces as EPIPE from the writes below.
     IptablesProcess *existingProcess = process->get();
-    if (existingProcess != nullptr && !existingProcess->outputReady()) {
+    if (existingProcess != nullptr && existingProcess->inFlight.empty() &&
+        !existingProcess->outputReady()) {
         existingProcess->stop();
         existingProcess = nullptr;
     }
 
     if (existingProcess == nullptr) {
-        // Fork a new iptables[6]-restore process.
-        IptablesProcess *newProcess = IptablesRestoreController::forkAndExec(type);
+        // Promote the prewarmed standby (takeStandby falls back to a cold fork if needed).
+        IptablesProcess *newProcess = takeStandby(type);
         if (newProcess == nullptr) {
             LOG(ERROR) << "Unable to fork ip[6]tables-restore, type: " << type;
             return -1;
@@ -217,44 +426,84 @@ int IptablesRestoreController::sendCommand(const IptablesProcessType type,
         process->reset(newProcess);
     }
 
-    if (!android::base::WriteFully((*process)->stdIn, command.data(), command.length())) {
+    // Gather the caller's fragments and the ping marker into a single vectored write, so a large
+    // command is never copied into an intermediate buffer on the netd side.
+    std::vector<iovec> iov;
+    iov.reserve(command.size() + 1);
+    size_t commandLength = 0;
+    for (const std::string_view fragment : command) {
+        iov.push_back({const_cast<char*>(fragment.data()), fragment.size()});
+        commandLength += fragment.size();
+    }
+    iov.push_back({const_cast<char*>(PING), PING_SIZE});
+
+    if (!writeFullyV((*process)->stdIn, iov.data(), iov.size())) {
         ALOGE("Unable to send command: %s", strerror(errno));
         return -1;
     }
 
-    if (!android::base::WriteFully((*process)->stdIn, PING, PING_SIZE)) {
-        ALOGE("Unable to send ping command: %s", strerror(errno));
+    mStats[type].bytesWritten.fetch_add(commandLength + PING_SIZE, std::memory_order_relaxed);
+
+    return 0;
+}
+
+int IptablesRestoreController::writeCommand(const IptablesProcessType type,
+                                            const std::string& command) {
+    return writeCommand(type, std::vector<std::string_view>{command});
+}
+
+void IptablesRestoreController::recordAck(IptablesProcessType type, uint64_t waitUs) {
+    ProcessStats& stats = mStats[type];
+    stats.commands.fetch_add(1, std::memory_order_relaxed);
+    stats.ackWaitUs.fetch_add(waitUs, std::memory_order_relaxed);
+    // The lane lock serializes writers for a given type, so a racing larger value can't be lost.
+    if (waitUs > stats.maxAckWaitUs.load(std::memory_order_relaxed)) {
+        stats.maxAckWaitUs.store(waitUs, std::memory_order_relaxed);
+    }
+}
+
+int IptablesRestoreController::sendCommand(const IptablesProcessType type,
+                                           const std::vector<std::string_view>& command,
+                                           std::string *output) {
+    if (writeCommand(type, command) != 0) {
         return -1;
     }
 
-    if (!drainAndWaitForAck(*process, command, output)) {
-        // drainAndWaitForAck has already logged an error.
+    Stopwatch s;
+    if (!drainAndWaitForAck(type, command, output)) {
+        // drainAndWaitForAck has already logged an error and promoted the standby child.
         return -1;
     }
+    recordAck(type, s.timeTakenUs());
 
     return 0;
 }
 
 void IptablesRestoreController::maybeLogStderr(const std::unique_ptr<IptablesProcess> &process,
-                                               const std::string& command) {
+                                               const std::vector<std::string_view>& command) {
     if (process->errBuf.empty()) {
         return;
     }
 
     ALOGE("iptables error:\n");
     ALOGE("------- COMMAND -------\n");
-    ALOGE("%s\n", command.c_str());
+    for (const std::string_view fragment : command) {
+        ALOGE("%.*s", static_cast<int>(fragment.size()), fragment.data());
+    }
     ALOGE("-------  ERROR -------\n");
     ALOGE("%s", process->errBuf.c_str());
     ALOGE("----------------------\n");
     process->errBuf.clear();
 }
 
-/* static */
-bool IptablesRestoreController::drainAndWaitForAck(const std::unique_ptr<IptablesProcess> &process,
-                                                   const std::string& command,
-                                                   std::string *output) {
-    bool receivedAck = false;
+bool IptablesRestoreController::drainAndWaitForAck(const IptablesProcessType type,
+                                                   const std::vector<std::string_view>& command,
+                                                   std::string* output) {
+    const std::unique_ptr<IptablesProcess>& process =
+            (type == IPTABLES_PROCESS) ? mIpRestore : mIp6Restore;
+
+    // A previous drain may already have read past this command's ack.
+    bool receivedAck = process->consumeAck(output);
     int timeout = 0;
     while (!receivedAck && (timeout++ < MAX_RETRIES)) {
         int numEvents = TEMP_FAILURE_RETRY(
@@ -287,18 +536,11 @@ bool IptablesRestoreController::drainAndWaitForAck(const std::unique_ptr<Iptable
                     }
 
                     if (i == IptablesProcess::STDOUT_IDX) {
-                        // i == STDOUT_IDX: accumulate stdout into *output, and look
-                        // for the ping response.
-                        output->append(buffer, size);
-                        size_t pos = output->find(PING);
-                        if (pos != std::string::npos) {
-                            if (output->size() > pos + PING_SIZE) {
-                                size_t extra = output->size() - (pos + PING_SIZE);
-                                ALOGW("%zd extra characters after iptables response: '%s...'",
-                                      extra, output->substr(pos + PING_SIZE, 128).c_str());
-                            }
-                            output->resize(pos);
-                            receivedAck = true;
+                        // i == STDOUT_IDX: accumulate stdout, and look for the ping response.
+                        // Anything read beyond it stays in outBuf for the next drain.
+                        process->outBuf.append(buffer, size);
+                        if (!receivedAck) {
+                            receivedAck = process->consumeAck(output);
                         }
                     } else {
                         // i == STDERR_IDX: accumulate stderr into errBuf.
@@ -315,21 +557,51 @@ bool IptablesRestoreController::drainAndWaitForAck(const std::unique_ptr<Iptable
         }
     }
 
-    if (!receivedAck && !process->processTerminated) {
-        ALOGE("Timed out waiting for response from iptables process %d", process->pid);
-        // Kill the process so that if it eventually recovers, we don't misinterpret the ping
-        // response (or any output) of the command we just sent as coming from future commands.
-        process->stop();
+    if (receivedAck && process->inFlight.empty() && !process->outBuf.empty()) {
+        // No further command is awaiting output, so these bytes belong to nothing.
+        ALOGW("%zu extra characters after iptables response: '%s...'", process->outBuf.size(),
+              process->outBuf.substr(0, 128).c_str());
+        process->outBuf.clear();
     }
 
     maybeLogStderr(process, command);
 
+    if (!receivedAck) {
+        if (!process->processTerminated) {
+            ALOGE("Timed out waiting for response from iptables process %d", process->pid);
+        }
+        // Whether the child wedged or died, switch this lane to the prewarmed standby now rather
+        // than on the next command: promotion is a pointer swap, and the old child's teardown
+        // (which can take seconds) happens off this thread, so the caller's retry - and every
+        // unrelated command queued behind it - finds a working child immediately.
+        retireAndPromote(type);
+    }
+
     return receivedAck;
 }
 
 int IptablesRestoreController::execute(const IptablesTarget target, const std::string& command,
                                        std::string *output) {
-    std::lock_guard lock(mLock);
+    return execute(target, std::vector<std::string_view>{command}, output);
+}
+
+int IptablesRestoreController::execute(const IptablesTarget target,
+                                       const std::vector<std::string_view>& command,
+                                       std::string *output) {
+    ATRACE_CALL();
+    android::net::LatencyWatchdog::Stage stage("iptablesRestore");
+
+    // Lock the lanes this command targets (V4 before V6, matching every other taker of both), so
+    // that commands for different protocols proceed in parallel.
+    std::unique_lock<std::mutex> lock4(mLane[IPTABLES_PROCESS], std::defer_lock);
+    std::unique_lock<std::mutex> lock6(mLane[IP6TABLES_PROCESS], std::defer_lock);
+    if (target == V4 || target == V4V6) lock4.lock();
+    if (target == V6 || target == V4V6) lock6.lock();
+
+    // Drain any queued commands on the processes this command targets, so that its output and ack
+    // cannot be interleaved with theirs. Queued failures are reported by the next flushPipeline().
+    if (target == V4 || target == V4V6) drainPipeline(IPTABLES_PROCESS);
+    if (target == V6 || target == V4V6) drainPipeline(IP6TABLES_PROCESS);
 
     std::string buffer;
     if (output == nullptr) {
@@ -338,16 +610,183 @@ int IptablesRestoreController::execute(const IptablesTarget target, const std::s
         output->clear();
     }
 
+    const std::string chainKey = replacedChainKey(command);
+    size_t commandLength = 0;
+    for (const std::string_view fragment : command) commandLength += fragment.size();
+    const ChainCommandId commandId = {hashCommand(command), commandLength};
+    if (!chainKey.empty()) {
+        std::lock_guard cacheLock(mCacheLock);
+        const auto it = mChainCache.find(chainCacheKey(target, chainKey));
+        if (it != mChainCache.end() && it->second == commandId) {
+            // The chain already holds exactly these contents; skip the restore round-trip.
+            return 0;
+        }
+    }
+
     int res = 0;
-    if (target == V4 || target == V4V6) {
+    if (target == V4V6) {
+        // The two restore processes are independent, so overlap them: write the command to both
+        // children first, then drain both acks. Each child parses and commits its table while the
+        // other does the same, roughly halving the wall time of a V4V6 call compared to running
+        // the two restores back to back.
+        const bool v4Sent = (writeCommand(IPTABLES_PROCESS, command) == 0);
+        const bool v6Sent = (writeCommand(IP6TABLES_PROCESS, command) == 0);
+        Stopwatch s4;
+        if (v4Sent && drainAndWaitForAck(IPTABLES_PROCESS, command, output)) {
+            recordAck(IPTABLES_PROCESS, s4.timeTakenUs());
+        } else {
+            res = -1;
+        }
+        Stopwatch s6;
+        if (v6Sent && drainAndWaitForAck(IP6TABLES_PROCESS, command, output)) {
+            recordAck(IP6TABLES_PROCESS, s6.timeTakenUs());
+        } else {
+            res = -1;
+        }
+    } else if (target == V4) {
         res |= sendCommand(IPTABLES_PROCESS, command, output);
+    } else if (target == V6) {
+        res |= sendCommand(IP6TABLES_PROCESS, command, output);
+    }
+
+    std::lock_guard cacheLock(mCacheLock);
+    if (chainKey.empty()) {
+        // The command may have mutated chains incrementally; drop any entries it affects.
+        invalidateChainCache(command);
+    } else {
+        // This replacement supersedes whatever was last committed to the chain, including entries
+        // recorded under a different target. Recording here can't race a concurrent command into
+        // staleness: every command that could change this target's kernel state for the chain
+        // shares a lane with us, and is therefore ordered before or after this whole call.
+        for (const IptablesTarget t : {V4, V6, V4V6}) {
+            mChainCache.erase(chainCacheKey(t, chainKey));
+        }
+        if (res == 0) {
+            mChainCache[chainCacheKey(target, chainKey)] = commandId;
+        }
+    }
+    return res;
+}
+
+int IptablesRestoreController::executeQueued(const IptablesTarget target,
+                                             const std::string& commands) {
+    ATRACE_CALL();
+
+    {
+        // Whether a queued command succeeds is not known until its ack is drained, so it can
+        // never be recorded in the chain cache; conservatively drop any entries it may supersede.
+        std::lock_guard cacheLock(mCacheLock);
+        invalidateChainCache({std::string_view(commands)});
+    }
+
+    int res = 0;
+    if (target == V4 || target == V4V6) {
+        std::lock_guard lane(mLane[IPTABLES_PROCESS]);
+        res |= queueCommand(IPTABLES_PROCESS, commands);
     }
     if (target == V6 || target == V4V6) {
-        res |= sendCommand(IP6TABLES_PROCESS, command, output);
+        std::lock_guard lane(mLane[IP6TABLES_PROCESS]);
+        res |= queueCommand(IP6TABLES_PROCESS, commands);
     }
     return res;
 }
 
+int IptablesRestoreController::flushPipeline() {
+    ATRACE_CALL();
+    std::scoped_lock lock(mLane[IPTABLES_PROCESS], mLane[IP6TABLES_PROCESS]);
+
+    drainPipeline(IPTABLES_PROCESS);
+    drainPipeline(IP6TABLES_PROCESS);
+
+    const int res =
+            (mPipelineError[IPTABLES_PROCESS] || mPipelineError[IP6TABLES_PROCESS]) ? -1 : 0;
+    mPipelineError[IPTABLES_PROCESS] = false;
+    mPipelineError[IP6TABLES_PROCESS] = false;
+    return res;
+}
+
+int IptablesRestoreController::queueCommand(const IptablesProcessType type,
+                                            const std::string& command) {
+    std::unique_ptr<IptablesProcess>& process =
+            (type == IPTABLES_PROCESS) ? mIpRestore : mIp6Restore;
+
+    if (process != nullptr && process->inFlight.size() >= MAX_PIPELINE_DEPTH) {
+        // Pipeline full. The oldest command has had the longest time to complete, so draining it
+        // rarely blocks. Even if it failed, keep queueing: the write below goes to the respawned
+        // process and the failure is reported at flush time.
+        (void) drainOldestAck(type);
+    }
+
+    if (writeCommand(type, command) != 0) {
+        mPipelineError[type] = true;
+        return -1;
+    }
+    process->inFlight.push_back(command);
+    return 0;
+}
+
+int IptablesRestoreController::drainOldestAck(const IptablesProcessType type) {
+    std::unique_ptr<IptablesProcess>& process =
+            (type == IPTABLES_PROCESS) ? mIpRestore : mIp6Restore;
+    if (process == nullptr || process->inFlight.empty()) {
+        return 0;
+    }
+
+    const std::string command = std::move(process->inFlight.front());
+    process->inFlight.pop_front();
+
+    std::string output;
+    Stopwatch s;
+    if (!drainAndWaitForAck(type, {std::string_view(command)}, &output)) {
+        // drainAndWaitForAck retires the process on failure, taking its remaining in-flight
+        // commands with it: their acks will never arrive, and they are reported as one error.
+        // The promoted standby starts with an empty pipeline.
+        mPipelineError[type] = true;
+        return -1;
+    }
+    recordAck(type, s.timeTakenUs());
+    return 0;
+}
+
+void IptablesRestoreController::drainPipeline(const IptablesProcessType type) {
+    std::unique_ptr<IptablesProcess>& process =
+            (type == IPTABLES_PROCESS) ? mIpRestore : mIp6Restore;
+    while (process != nullptr && !process->inFlight.empty()) {
+        (void) drainOldestAck(type);
+    }
+}
+
+void IptablesRestoreController::invalidateChainCache(
+        const std::vector<std::string_view>& command) {
+    for (auto it = mChainCache.begin(); it != mChainCache.end();) {
+        const std::string chain = it->first.substr(it->first.rfind('/') + 1);
+        if (commandContains(command, chain)) {
+            it = mChainCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 int IptablesRestoreController::getIpRestorePid(const IptablesProcessType type) {
     return type == IPTABLES_PROCESS ? mIpRestore->pid : mIp6Restore->pid;
 }
+
+int IptablesRestoreController::getStandbyRestorePid(const IptablesProcessType type) {
+    return mStandby[type] != nullptr ? mStandby[type]->pid : 0;
+}
+
+void IptablesRestoreController::dump(android::netdutils::DumpWriter& dw) {
+    dw.println("IptablesRestoreController:");
+    ScopedIndent indentStats(dw);
+    for (const auto type : {IPTABLES_PROCESS, IP6TABLES_PROCESS}) {
+        const ProcessStats& stats = mStats[type];
+        const uint64_t commands = stats.commands.load(std::memory_order_relaxed);
+        dw.println("%s: %" PRIu64 " commands, %" PRIu64 " bytes written, ack wait %" PRIu64
+                   "us total / %" PRIu64 "us max",
+                   type == IPTABLES_PROCESS ? "iptables-restore" : "ip6tables-restore", commands,
+                   stats.bytesWritten.load(std::memory_order_relaxed),
+                   stats.ackWaitUs.load(std::memory_order_relaxed),
+                   stats.maxAckWaitUs.load(std::memory_order_relaxed));
+    }
+}
@@ -17,9 +17,16 @@
 #ifndef NETD_SERVER_IPTABLES_RESTORE_CONTROLLER_H
 #define NETD_SERVER_IPTABLES_RESTORE_CONTROLLER_H
 
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <string_view>
 #include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+#include <netdutils/DumpWriter.h>
 
 #include "NetdConstants.h"
 
@@ -45,6 +52,26 @@ class IptablesRestoreController final : public IptablesRestoreInterface {
     int execute(const IptablesTarget target, const std::string& commands,
                 std::string* output) override;
 
+    // As above, but takes the command as a list of fragments whose concatenation is the command
+    // text. The fragments are handed to writev() as-is, so a large command built from many pieces
+    // need not be joined into one string first. Fragment boundaries are otherwise meaningless:
+    // execution and chain caching behave exactly as for the joined string.
+    int execute(const IptablesTarget target, const std::vector<std::string_view>& commands,
+                std::string* output);
+
+    // Like execute(), but does not wait for the ack: the command is written to the restore
+    // process(es) and its ack is drained by a later queued write, synchronous execute() or
+    // flushPipeline() call. While an ack is outstanding the child parses the previous command
+    // as the caller prepares the next one, instead of netd sitting idle during the parse.
+    // Queued commands cannot return output, and errors (other than a failed write) are deferred
+    // to flushPipeline(). Acks are always drained oldest-first, so at most MAX_PIPELINE_DEPTH
+    // commands per process are in flight at any time.
+    int executeQueued(const IptablesTarget target, const std::string& commands);
+
+    // Drains the acks of all queued commands. Returns 0 if every queued command since the last
+    // flush succeeded, -1 otherwise.
+    int flushPipeline();
+
     enum IptablesProcessType {
         IPTABLES_PROCESS,
         IP6TABLES_PROCESS,
@@ -55,9 +82,14 @@ class IptablesRestoreController final : public IptablesRestoreInterface {
     // of the forked iptables[6]-restore process has died.
     IptablesProcessType notifyChildTermination(pid_t pid);
 
+    // Prints the aggregate restore-process statistics. Reads the relaxed atomic counters only,
+    // so it never blocks behind an in-flight restore.
+    void dump(android::netdutils::DumpWriter& dw);
+
 protected:
     friend class IptablesRestoreControllerTest;
     pid_t getIpRestorePid(const IptablesProcessType type);
+    pid_t getStandbyRestorePid(const IptablesProcessType type);
 
     // The maximum number of times we poll(2) for a response on our set of polled
     // fds. Chosen so that the overall timeout is 5s. The timeout is so high because
@@ -73,21 +105,106 @@ protected:
 private:
     static IptablesProcess* forkAndExec(const IptablesProcessType type);
 
-    int sendCommand(const IptablesProcessType type, const std::string& command,
+    // Returns the prewarmed standby child for |type| and forks a fresh standby into its slot.
+    // Falls back to a cold fork if the standby died while idle. Call with the lane lock held.
+    IptablesProcess* takeStandby(const IptablesProcessType type);
+
+    // Swaps the prewarmed standby into the active slot for |type|. The old child, if still
+    // running, is torn down on a detached thread: stopProcess() waits for it to exit, which for
+    // a child wedged in the kernel can take seconds, and none of that wait helps the caller.
+    // Call with the lane lock held.
+    void retireAndPromote(const IptablesProcessType type);
+
+    // Writes |command| (and the trailing ping) to the given process, respawning it first if
+    // needed. Does not wait for the ack; callers overlap multiple processes by writing to all of
+    // them before draining any. The fragments and the ping marker are submitted as one vectored
+    // write. Returns 0 on success or -1 on failure.
+    int writeCommand(const IptablesProcessType type, const std::vector<std::string_view>& command);
+    int writeCommand(const IptablesProcessType type, const std::string& command);
+
+    int sendCommand(const IptablesProcessType type, const std::vector<std::string_view>& command,
                     std::string *output);
 
-    static bool drainAndWaitForAck(const std::unique_ptr<IptablesProcess> &process,
-                                   const std::string& command,
-                                   std::string *output);
+    // Upper bound on the number of commands written to one restore process before its oldest ack
+    // must be drained. This bounds the bookkeeping per process and, for typically-sized commands,
+    // the unread echo output sitting in the child's stdout pipe.
+    static constexpr size_t MAX_PIPELINE_DEPTH = 8;
+
+    // Writes |command| to the given process without waiting for its ack, draining the oldest ack
+    // first if the pipeline is full. Returns -1 if the write failed, 0 otherwise.
+    int queueCommand(const IptablesProcessType type, const std::string& command);
+
+    // Drains the ack of the oldest in-flight command on the given process, recording any failure
+    // in mPipelineError. Draining in order is what lets each ack be matched to its command.
+    int drainOldestAck(const IptablesProcessType type);
+
+    // Drains all in-flight acks on the given process.
+    void drainPipeline(const IptablesProcessType type);
+
+    // Drains output from the process for |type| until |command|'s ack arrives or the overall
+    // timeout elapses. On failure - whether the child died or merely stopped responding - it is
+    // retired and the standby promoted in its place, so the caller's retry and every command
+    // behind it find a working child immediately. Call with the lane lock for |type| held.
+    bool drainAndWaitForAck(const IptablesProcessType type,
+                            const std::vector<std::string_view>& command, std::string* output);
 
     static void maybeLogStderr(const std::unique_ptr<IptablesProcess> &process,
-                               const std::string& command);
+                               const std::vector<std::string_view>& command);
 
-    // Guards calls to execute().
-    std::mutex mLock;
+    // Each restore process forms an independent execution lane with its own lock: a V4-only and
+    // a V6-only command run concurrently, since they talk to different children programming
+    // disjoint kernel state. V4V6 commands hold both lanes, V4 before V6. (Finer-grained lanes,
+    // e.g. one child per table, would buy little: the xtables lock serializes commits globally,
+    // and startup commands span several tables.)
+    std::mutex mLane[2];  // Indexed by IptablesProcessType.
+
+    // Guards mChainCache, which is shared between the lanes.
+    std::mutex mCacheLock;
 
     std::unique_ptr<IptablesProcess> mIpRestore;
     std::unique_ptr<IptablesProcess> mIp6Restore;
+
+    // Prewarmed replacement children, one per type, forked at construction and refilled on every
+    // promotion. When an active child dies or wedges, its replacement has already paid fork+exec
+    // and the iptables parser startup, so recovery costs a pointer swap instead of a cold spawn.
+    // An idle child holds no xtables lock and only a few pages. Guarded by the lane lock.
+    std::unique_ptr<IptablesProcess> mStandby[2];  // Indexed by IptablesProcessType.
+
+    // True when a queued command on the given process failed (or its process died with commands
+    // in flight) since the last flushPipeline() call. Guarded by the process's lane lock.
+    bool mPipelineError[2] = {false, false};  // Indexed by IptablesProcessType.
+
+    // Shadow cache of the chains we have fully replaced, so that re-sending byte-identical chain
+    // contents (a common pattern in FirewallController::setUidRule and the BandwidthController
+    // quota updates) short-circuits without a restore round-trip. Keyed by target/table/chain;
+    // the value identifies the exact command last committed for that chain. Only full single-chain
+    // replacements are cached, because only those are idempotent; commands that mutate a chain
+    // incrementally invalidate its cache entries instead. Guarded by mCacheLock.
+    struct ChainCommandId {
+        size_t hash;
+        size_t length;
+        bool operator==(const ChainCommandId& other) const {
+            return hash == other.hash && length == other.length;
+        }
+    };
+    std::unordered_map<std::string, ChainCommandId> mChainCache;
+
+    // Removes cache entries for every chain mentioned in |command|. Call with mCacheLock held.
+    void invalidateChainCache(const std::vector<std::string_view>& command);
+
+    // Aggregate cost counters per restore process, for quantifying rule churn across releases.
+    // Writers for a given process are serialized by its lane lock; the relaxed atomics let
+    // dump() read without taking it.
+    struct ProcessStats {
+        std::atomic<uint64_t> commands{0};
+        std::atomic<uint64_t> bytesWritten{0};
+        std::atomic<uint64_t> ackWaitUs{0};
+        std::atomic<uint64_t> maxAckWaitUs{0};
+    };
+    ProcessStats mStats[2];  // Indexed by IptablesProcessType.
+
+    // Records one drained command against |type|.
+    void recordAck(IptablesProcessType type, uint64_t waitUs);
 };
 
 #endif  // NETD_SERVER_IPTABLES_RESTORE_CONTROLLER_H
@@ -27,6 +27,7 @@
 #include <cinttypes>
 #include <iostream>
 #include <string>
+#include <thread>
 
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
@@ -83,6 +84,10 @@ public:
       return con.getIpRestorePid(type);
   };
 
+  pid_t getStandbyRestorePid(const IptablesRestoreController::IptablesProcessType type) {
+      return con.getStandbyRestorePid(type);
+  };
+
   const std::string getProcStatPath(pid_t pid) { return StringPrintf("/proc/%d/stat", pid); }
 
   std::vector<std::string> parseProcStat(int fd, const std::string& path) {
@@ -256,6 +261,88 @@ TEST_F(IptablesRestoreControllerTest, TestRestartOnProcessDeath) {
   expectNoIptablesRestoreProcess(pid6);
 }
 
+TEST_F(IptablesRestoreControllerTest, TestStandbyPromotionOnProcessDeath) {
+  // Run a command to ensure that the processes are running.
+  EXPECT_EQ(0, con.execute(IptablesTarget::V4V6, "#Test\n", nullptr));
+
+  pid_t pid4 = getIpRestorePid(IptablesRestoreController::IPTABLES_PROCESS);
+  pid_t standby4 = getStandbyRestorePid(IptablesRestoreController::IPTABLES_PROCESS);
+  ASSERT_NE(0, standby4);
+  ASSERT_EQ(0, kill(pid4, SIGTERM)) << "Failed to send SIGTERM to iptables-restore pid " << pid4;
+
+  // Wait 100ms for the process to terminate.
+  TEMP_FAILURE_RETRY(usleep(100 * 1000));
+
+  // The next command must be served by the prewarmed standby, with a fresh standby in its place.
+  EXPECT_EQ(0, con.execute(IptablesTarget::V4, "#Test\n", nullptr));
+  EXPECT_EQ(standby4, getIpRestorePid(IptablesRestoreController::IPTABLES_PROCESS));
+  EXPECT_NE(standby4, getStandbyRestorePid(IptablesRestoreController::IPTABLES_PROCESS));
+  EXPECT_NE(0, getStandbyRestorePid(IptablesRestoreController::IPTABLES_PROCESS));
+}
+
+TEST_F(IptablesRestoreControllerTest, TestConcurrentLanes) {
+  // V4-only and V6-only commands take different lanes and may run fully in parallel.
+  std::thread v6Thread([&] {
+    for (int i = 0; i < 10; i++) {
+      EXPECT_EQ(0, con.execute(IptablesTarget::V6, "#Test\n", nullptr));
+    }
+  });
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(0, con.execute(IptablesTarget::V4, "#Test\n", nullptr));
+  }
+  v6Thread.join();
+
+  // A V4V6 command locks both lanes, so its combined output is still well-formed.
+  std::string output;
+  EXPECT_EQ(0, con.execute(IptablesTarget::V4V6, "#Test\n", &output));
+  EXPECT_EQ("#Test\n#Test\n", output);
+}
+
+TEST_F(IptablesRestoreControllerTest, TestFragmentedCommand) {
+  // A command may be passed as fragments of arbitrary sizes; their concatenation is what executes,
+  // even when a fragment boundary falls in the middle of a line.
+  std::string output;
+  const std::vector<std::string_view> fragments = {"#Test1\n#Te", "st2\n"};
+  EXPECT_EQ(0, con.execute(IptablesTarget::V4V6, fragments, &output));
+  EXPECT_EQ("#Test1\n#Test2\n#Test1\n#Test2\n", output);  // Echoed once per protocol.
+
+  // A chain replacement spelled as fragments (with boundaries inside lines) must execute the same
+  // as the joined string: both are parsed for the chain cache, and both must succeed.
+  const std::string flush = StringPrintf(":%s -", mChainName.c_str());
+  const std::string append = StringPrintf("-A %s -j RETURN", mChainName.c_str());
+  const std::vector<std::string_view> replaceFragments = {"*filter\n", flush, "\n", append,
+                                                          "\nCOMMIT\n"};
+  const std::string replaceString =
+      StringPrintf("*filter\n%s\n%s\nCOMMIT\n", flush.c_str(), append.c_str());
+  pid_t pid4 = getIpRestorePid(IptablesRestoreController::IPTABLES_PROCESS);
+  EXPECT_EQ(0, con.execute(IptablesTarget::V4V6, replaceFragments, nullptr));
+  EXPECT_EQ(0, con.execute(IptablesTarget::V4V6, replaceString, nullptr));
+  EXPECT_EQ(pid4, getIpRestorePid(IptablesRestoreController::IPTABLES_PROCESS));
+}
+
+TEST_F(IptablesRestoreControllerTest, TestPipelinedCommands) {
+  // Queue more commands than the pipeline depth to exercise the drain-on-full path.
+  for (int i = 0; i < 20; i++) {
+    ASSERT_EQ(0, con.executeQueued(V4V6, "#Test\n")) << "Queued write failed at iteration " << i;
+  }
+  EXPECT_EQ(0, con.flushPipeline());
+
+  // A synchronous execute drains queued acks first, so its output must contain only its own echo.
+  for (int i = 0; i < 5; i++) {
+    ASSERT_EQ(0, con.executeQueued(V4V6, "#Queued\n"));
+  }
+  std::string output;
+  EXPECT_EQ(0, con.execute(V4V6, "#Test\n", &output));
+  EXPECT_EQ("#Test\n#Test\n", output);  // One for IPv4 and one for IPv6.
+
+  // A queued malformed command kills its restore process. The failure must surface at flush time,
+  // be reported only once, and not affect commands sent afterwards.
+  EXPECT_EQ(0, con.executeQueued(V4, "malformed command\n"));
+  EXPECT_EQ(-1, con.flushPipeline());
+  EXPECT_EQ(0, con.flushPipeline());
+  EXPECT_EQ(0, con.execute(V4V6, "#Test\n", nullptr));
+}
+
 TEST_F(IptablesRestoreControllerTest, TestCommandTimeout) {
   // Don't wait 10 seconds for this test to fail.
   setRetryParameters(3, 100);
@@ -284,8 +371,14 @@ TEST_F(IptablesRestoreControllerTest, TestCommandTimeout) {
   EXPECT_EQ(0, con.execute(IptablesTarget::V4V6, commandString, &output));
   EXPECT_EQ(expected, output);
 
+  pid_t standby4 = getStandbyRestorePid(IptablesRestoreController::IPTABLES_PROCESS);
+  ASSERT_NE(0, standby4);
+
   ASSERT_EQ(0, acquireIptablesLock());
   EXPECT_EQ(-1, con.execute(IptablesTarget::V4V6, commandString, &output));
+  // The wedged child is retired on the first timeout and the prewarmed standby promoted in its
+  // place, so the retry below goes straight to a fresh child.
+  EXPECT_EQ(standby4, getIpRestorePid(IptablesRestoreController::IPTABLES_PROCESS));
   EXPECT_EQ(-1, con.execute(IptablesTarget::V4V6, commandString, &output));
   releaseIptablesLock();
 
@@ -325,7 +418,8 @@ TEST_F(IptablesRestoreControllerTest, TestStartup) {
     constexpr pid_t FAKE_PID = 2000000001;
     StrictMock<ScopedMockSyscalls> sys;
 
-    EXPECT_CALL(sys, fork()).Times(NUM_ITERATIONS * 2).WillRepeatedly(Return(FAKE_PID));
+    // Init forks four children: the two active processes and their two standbys.
+    EXPECT_CALL(sys, fork()).Times(NUM_ITERATIONS * 4).WillRepeatedly(Return(FAKE_PID));
     for (int i = 0; i < NUM_ITERATIONS; i++) {
       Init();
       EXPECT_NE(0, getIpRestorePid(IptablesRestoreController::IPTABLES_PROCESS));
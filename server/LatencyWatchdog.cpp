@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LatencyWatchdog"
+
+#include "LatencyWatchdog.h"
+
+#include <time.h>
+
+#include <mutex>
+#include <vector>
+
+#include <log/log.h>
+
+#include <android-base/stringprintf.h>
+#include <cutils/properties.h>
+
+#include "BootMetrics.h"
+
+using android::base::StringAppendF;
+
+namespace android {
+namespace net {
+
+namespace {
+
+// The innermost operation in flight on this thread, if any. Stages attribute to it without
+// taking any lock; a null pointer means stage timing is discarded.
+thread_local LatencyWatchdog::Operation* gCurrentOp = nullptr;
+
+int32_t budgetMsFromProperty() {
+    return property_get_int32("persist.netd.latency_budget_ms",
+                              LatencyWatchdog::kDefaultBudgetMs);
+}
+
+// Recent over-budget events, retained for dumpsys. Guarded by gEventsLock, which only
+// over-budget operations and dump() ever take.
+constexpr size_t kMaxEvents = 32;
+std::mutex gEventsLock;
+std::vector<std::string> gEvents;
+size_t gOldestEvent = 0;
+
+void recordEvent(std::string event) {
+    std::lock_guard guard(gEventsLock);
+    if (gEvents.size() < kMaxEvents) {
+        gEvents.push_back(std::move(event));
+    } else {
+        gEvents[gOldestEvent] = std::move(event);
+        gOldestEvent = (gOldestEvent + 1) % kMaxEvents;
+    }
+}
+
+}  // namespace
+
+int32_t (*LatencyWatchdog::budgetMsFunction)() = budgetMsFromProperty;
+
+LatencyWatchdog::Operation::Operation(const char* name, unsigned netId)
+    : mName(name), mNetId(netId), mBudgetMs(budgetMsFunction()), mParent(gCurrentOp) {
+    gCurrentOp = this;
+}
+
+LatencyWatchdog::Operation::~Operation() {
+    gCurrentOp = mParent;
+    const int64_t totalUs = mStopwatch.timeTakenUs();
+    // The boot metrics peak covers every operation, not just over-budget ones, and is tracked
+    // even with the watchdog disabled; it costs this clock read and a relaxed atomic max.
+    BootMetrics::noteOperationUs(totalUs);
+    if (mBudgetMs <= 0) return;
+    if (totalUs < mBudgetMs * 1000LL) return;
+
+    // Whatever the stages don't account for - lock waits, fwmark/permission bookkeeping, stages
+    // past kMaxStages - shows up as "other" so the breakdown always sums to the total.
+    int64_t stagedUs = 0;
+    std::string breakdown;
+    for (size_t i = 0; i < mStageCount; ++i) {
+        const StageStats& stage = mStages[i];
+        StringAppendF(&breakdown, " %s=%lldus/%u", stage.name,
+                      static_cast<long long>(stage.totalUs), stage.count);
+        stagedUs += stage.totalUs;
+    }
+    StringAppendF(&breakdown, " other=%lldus", static_cast<long long>(totalUs - stagedUs));
+
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    tm tm;
+    localtime_r(&ts.tv_sec, &tm);
+    std::string event;
+    StringAppendF(&event, "%02d-%02d %02d:%02d:%02d %s netId=%u took %lldus (budget %dms):%s",
+                  tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, mName, mNetId,
+                  static_cast<long long>(totalUs), mBudgetMs, breakdown.c_str());
+    ALOGW("%s", event.c_str());
+    recordEvent(std::move(event));
+}
+
+void LatencyWatchdog::Operation::addStage(const char* name, int64_t durationUs) {
+    // Stage names are string literals, so pointer comparison is sufficient to aggregate the
+    // repeated stages of one operation (one rule flush per table, one commit per lane).
+    for (size_t i = 0; i < mStageCount; ++i) {
+        if (mStages[i].name == name) {
+            mStages[i].count++;
+            mStages[i].totalUs += durationUs;
+            return;
+        }
+    }
+    if (mStageCount < kMaxStages) {
+        mStages[mStageCount++] = {name, 1, durationUs};
+    }
+}
+
+LatencyWatchdog::Stage::~Stage() {
+    if (gCurrentOp != nullptr) {
+        gCurrentOp->addStage(mName, mStopwatch.timeTakenUs());
+    }
+}
+
+void LatencyWatchdog::forEachEvent(const std::function<void(const std::string&)>& callback) {
+    std::lock_guard guard(gEventsLock);
+    for (size_t i = 0; i < gEvents.size(); ++i) {
+        callback(gEvents[(gOldestEvent + i) % gEvents.size()]);
+    }
+}
+
+void LatencyWatchdog::dump(netdutils::DumpWriter& dw) {
+    dw.println("LatencyWatchdog: (operations that exceeded persist.netd.latency_budget_ms)");
+    netdutils::ScopedIndent indent(dw);
+    size_t count = 0;
+    forEachEvent([&](const std::string& event) {
+        dw.println(event);
+        ++count;
+    });
+    if (count == 0) {
+        dw.println("none");
+    }
+}
+
+}  // namespace net
+}  // namespace android
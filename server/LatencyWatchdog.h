@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_SERVER_LATENCY_WATCHDOG_H
+#define NETD_SERVER_LATENCY_WATCHDOG_H
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+
+#include <netdutils/DumpWriter.h>
+#include <netdutils/Stopwatch.h>
+
+namespace android {
+namespace net {
+
+// Self-reporting latency budgets for multi-stage network transitions.
+//
+// An Operation scopes one user-visible transition (network creation, destruction, interface
+// attach); a Stage scopes one unit of work performed under it (rule programming, a route table
+// flush, an iptables-restore commit). Stages that run on the operation's thread attribute their
+// wall time to it. When an operation finishes over its budget, a per-stage timing breakdown is
+// logged and retained in a small ring that dumpsys prints, so a latency regression in the field
+// names the stage that regressed without anyone having to reproduce it.
+//
+// The budget comes from persist.netd.latency_budget_ms (0 disables reporting). On-budget
+// operations cost a handful of clock reads and touch no locks; the event ring's lock is only
+// taken when an operation actually blows its budget. Stages handed off to worker threads
+// (asynchronous route and sysctl writes) are deliberately not attributed: the operation returns
+// to the caller before they run, so they are not part of its latency.
+class LatencyWatchdog {
+  public:
+    // Budget applied when persist.netd.latency_budget_ms is unset. Network transitions normally
+    // complete in tens of milliseconds; anything past this is worth a breakdown in the log.
+    static constexpr int32_t kDefaultBudgetMs = 500;
+
+    class Operation {
+      public:
+        // |name| must be a string literal; it is referenced, not copied.
+        Operation(const char* name, unsigned netId);
+        ~Operation();
+
+        Operation(const Operation&) = delete;
+        Operation& operator=(const Operation&) = delete;
+
+      private:
+        friend class LatencyWatchdog;
+
+        void addStage(const char* name, int64_t durationUs);
+
+        // More distinct stage names than any single transition executes. Stages past the limit
+        // fold into the "other" bucket of the breakdown.
+        static constexpr size_t kMaxStages = 16;
+        struct StageStats {
+            const char* name;
+            uint32_t count;
+            int64_t totalUs;
+        };
+
+        const char* const mName;
+        const unsigned mNetId;
+        const int32_t mBudgetMs;
+        netdutils::Stopwatch mStopwatch;
+        // The operation this one interrupted on the same thread, restored on destruction.
+        // Stages attribute to the innermost live operation only.
+        Operation* const mParent;
+        StageStats mStages[kMaxStages];
+        size_t mStageCount = 0;
+    };
+
+    // Attributes the enclosed scope's wall time to the innermost live Operation on this thread.
+    // A Stage constructed with no operation in flight is free and records nothing.
+    class Stage {
+      public:
+        // |name| must be a string literal; stages are aggregated by pointer identity.
+        explicit Stage(const char* name) : mName(name) {}
+        ~Stage();
+
+        Stage(const Stage&) = delete;
+        Stage& operator=(const Stage&) = delete;
+
+      private:
+        const char* const mName;
+        netdutils::Stopwatch mStopwatch;
+    };
+
+    // Invokes |callback| once per retained over-budget event, oldest first.
+    static void forEachEvent(const std::function<void(const std::string&)>& callback);
+
+    static void dump(netdutils::DumpWriter& dw);
+
+    // The budget source, replaceable for testing. Defaults to reading
+    // persist.netd.latency_budget_ms.
+    static int32_t (*budgetMsFunction)();
+};
+
+}  // namespace net
+}  // namespace android
+
+#endif  // NETD_SERVER_LATENCY_WATCHDOG_H
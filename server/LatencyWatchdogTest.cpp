@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LatencyWatchdog.h"
+
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::HasSubstr;
+
+namespace android {
+namespace net {
+
+namespace {
+
+int32_t oneMillisecondBudget() {
+    return 1;
+}
+
+int32_t disabledBudget() {
+    return 0;
+}
+
+std::vector<std::string> collectEvents() {
+    std::vector<std::string> events;
+    LatencyWatchdog::forEachEvent([&](const std::string& event) { events.push_back(event); });
+    return events;
+}
+
+}  // namespace
+
+class LatencyWatchdogTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mSavedBudgetFunction = LatencyWatchdog::budgetMsFunction;
+        // The event ring is process-global, so tests compare against the count they started with.
+        mEventsBefore = collectEvents().size();
+    }
+
+    void TearDown() override { LatencyWatchdog::budgetMsFunction = mSavedBudgetFunction; }
+
+    int32_t (*mSavedBudgetFunction)();
+    size_t mEventsBefore;
+};
+
+TEST_F(LatencyWatchdogTest, OverBudgetOperationRecordsBreakdown) {
+    LatencyWatchdog::budgetMsFunction = oneMillisecondBudget;
+    {
+        LatencyWatchdog::Operation op("createPhysicalNetwork", 101);
+        {
+            LatencyWatchdog::Stage stage("physicalNetworkRules");
+            usleep(2000);
+        }
+        {
+            LatencyWatchdog::Stage stage("iptablesRestore");
+        }
+    }
+
+    std::vector<std::string> events = collectEvents();
+    ASSERT_EQ(mEventsBefore + 1, events.size());
+    const std::string& event = events.back();
+    EXPECT_THAT(event, HasSubstr("createPhysicalNetwork netId=101 took "));
+    EXPECT_THAT(event, HasSubstr("(budget 1ms)"));
+    EXPECT_THAT(event, HasSubstr(" physicalNetworkRules="));
+    EXPECT_THAT(event, HasSubstr(" iptablesRestore="));
+    EXPECT_THAT(event, HasSubstr(" other="));
+}
+
+TEST_F(LatencyWatchdogTest, RepeatedStagesAggregate) {
+    LatencyWatchdog::budgetMsFunction = oneMillisecondBudget;
+    {
+        LatencyWatchdog::Operation op("destroyNetwork", 102);
+        for (int i = 0; i < 3; ++i) {
+            LatencyWatchdog::Stage stage("flushRoutes");
+            usleep(1000);
+        }
+    }
+
+    std::vector<std::string> events = collectEvents();
+    ASSERT_EQ(mEventsBefore + 1, events.size());
+    // Three flushes fold into one stage entry with a count of 3.
+    EXPECT_THAT(events.back(), HasSubstr("us/3 other="));
+}
+
+TEST_F(LatencyWatchdogTest, OnBudgetOperationRecordsNothing) {
+    {
+        LatencyWatchdog::Operation op("createVirtualNetwork", 103);
+        LatencyWatchdog::Stage stage("virtualNetworkRules");
+    }
+    EXPECT_EQ(mEventsBefore, collectEvents().size());
+}
+
+TEST_F(LatencyWatchdogTest, ZeroBudgetDisablesReporting) {
+    LatencyWatchdog::budgetMsFunction = disabledBudget;
+    {
+        LatencyWatchdog::Operation op("destroyNetwork", 104);
+        usleep(2000);
+    }
+    EXPECT_EQ(mEventsBefore, collectEvents().size());
+}
+
+TEST_F(LatencyWatchdogTest, StageWithoutOperationIsIgnored) {
+    LatencyWatchdog::budgetMsFunction = oneMillisecondBudget;
+    {
+        // Worker threads run stages with no operation in flight; they must record nothing.
+        LatencyWatchdog::Stage stage("iptablesRestore");
+        usleep(2000);
+    }
+    EXPECT_EQ(mEventsBefore, collectEvents().size());
+}
+
+}  // namespace net
+}  // namespace android
@@ -39,7 +39,7 @@ int LocalNetwork::addInterface(const std::string& interface) {
         ALOGE("failed to add interface %s to local netId %u", interface.c_str(), mNetId);
         return ret;
     }
-    mInterfaces.insert(interface);
+    insertInterface(interface);
     return 0;
 }
 
@@ -51,7 +51,7 @@ int LocalNetwork::removeInterface(const std::string& interface) {
         ALOGE("failed to remove interface %s from local netId %u", interface.c_str(), mNetId);
         return ret;
     }
-    mInterfaces.erase(interface);
+    eraseInterface(interface);
     return 0;
 }
 
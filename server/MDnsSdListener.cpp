@@ -27,7 +27,7 @@
 #include <resolv.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
@@ -51,7 +51,8 @@ using android::net::gCtls;
 
 #define CEIL(x, y) (((x) + (y) - 1) / (y))
 
-constexpr char RESCAN[] = "1";
+// Control byte written to wake the monitor thread so it can sweep deferred deletions.
+constexpr char SWEEP[] = "1";
 
 using android::net::mdns::aidl::DiscoveryInfo;
 using android::net::mdns::aidl::GetAddressInfo;
@@ -364,13 +365,14 @@ int MDnsSdListener::stopDaemon() {
 }
 
 MDnsSdListener::Monitor::Monitor() {
-    mHead = nullptr;
-    mLiveCount = 0;
-    mPollFds = nullptr;
-    mPollRefs = nullptr;
-    mPollSize = 10;
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    LOG_ALWAYS_FATAL_IF(mEpollFd < 0, "epoll_create1 failed: %s", strerror(errno));
     socketpair(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0, mCtrlSocketPair);
 
+    epoll_event ev = {.events = EPOLLIN, .data = {.ptr = nullptr}};
+    LOG_ALWAYS_FATAL_IF(epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mCtrlSocketPair[0], &ev) == -1,
+                        "failed to watch control socket: %s", strerror(errno));
+
     const int rval = ::android::netdutils::threadLaunch(this);
     if (rval != 0) {
         ALOGW("Error spawning monitor thread: %s (%d)", strerror(-rval), -rval);
@@ -413,7 +415,7 @@ int MDnsSdListener::Monitor::startService() {
 
 int MDnsSdListener::Monitor::stopService() {
     std::lock_guard guard(mMutex);
-    if (mHead == nullptr) {
+    if (mElements.empty()) {
         ALOGD("Stopping MDNSD");
         property_set("ctl.stop", MDNS_SERVICE_NAME);
         wait_for_property(MDNS_SERVICE_STATUS, "stopped", 5);
@@ -423,174 +425,124 @@ int MDnsSdListener::Monitor::stopService() {
 }
 
 void MDnsSdListener::Monitor::run() {
-    int pollCount = 1;
-
-    mPollFds = (struct pollfd *)calloc(sizeof(struct pollfd), mPollSize);
-    mPollRefs = (DNSServiceRef **)calloc(sizeof(DNSServiceRef *), mPollSize);
-    LOG_ALWAYS_FATAL_IF((mPollFds == nullptr), "initial calloc failed on mPollFds with a size of %d",
-            ((int)sizeof(struct pollfd)) * mPollSize);
-    LOG_ALWAYS_FATAL_IF((mPollRefs == nullptr), "initial calloc failed on mPollRefs with a size of %d",
-            ((int)sizeof(DNSServiceRef *)) * mPollSize);
-
-    mPollFds[0].fd = mCtrlSocketPair[0];
-    mPollFds[0].events = POLLIN;
-
     if (VDBG) ALOGD("MDnsSdListener starting to monitor");
     while (1) {
-        if (VDBG) ALOGD("Going to poll with pollCount %d", pollCount);
-        int pollResults = poll(mPollFds, pollCount, 10000000);
-        if (VDBG) ALOGD("pollResults=%d", pollResults);
-        if (pollResults < 0) {
-            ALOGE("Error in poll - got %d", errno);
-        } else if (pollResults > 0) {
-            if (VDBG) ALOGD("Monitor poll got data pollCount = %d, %d", pollCount, pollResults);
-            for(int i = 1; i < pollCount; i++) {
-                if (mPollFds[i].revents != 0) {
-                    if (VDBG) {
-                        ALOGD("Monitor found [%d].revents = %d - calling ProcessResults",
-                                i, mPollFds[i].revents);
-                    }
-                    std::lock_guard guard(mMutex);
-                    DNSServiceProcessResult(*(mPollRefs[i]));
-                    mPollFds[i].revents = 0;
-                }
+        epoll_event events[16];
+        int numEvents = TEMP_FAILURE_RETRY(
+                epoll_wait(mEpollFd, events, sizeof(events) / sizeof(events[0]), -1));
+        if (numEvents < 0) {
+            ALOGE("Error in epoll_wait - got %d", errno);
+            continue;
+        }
+        if (VDBG) ALOGD("Monitor wakeup with %d ready fds", numEvents);
+
+        // Process service refs before the control socket so that a sweep triggered in this
+        // batch cannot delete an element another event in the batch still points at.
+        bool sweep = false;
+        for (int i = 0; i < numEvents; i++) {
+            Element* element = static_cast<Element*>(events[i].data.ptr);
+            if (element == nullptr) {
+                sweep = true;
+                continue;
             }
-            if (VDBG) ALOGD("controlSocket shows revent= %d", mPollFds[0].revents);
-            switch (mPollFds[0].revents) {
-                case POLLIN: {
-                    char readBuf[2];
-                    read(mCtrlSocketPair[0], &readBuf, 1);
-                    if (DBG) ALOGD("MDnsSdListener::Monitor got %c", readBuf[0]);
-                    if (memcmp(RESCAN, readBuf, 1) == 0) {
-                        pollCount = rescan();
-                    }
-                }
+            if (VDBG) ALOGD("Monitor found %p ready - calling ProcessResults", element);
+            std::lock_guard guard(mMutex);
+            // The element may have been marked for deletion after this event was harvested;
+            // it is only freed by sweepDeferred() on this thread, so the check is safe.
+            if (element->mReady == 1 && element->mRef != nullptr) {
+                DNSServiceProcessResult(element->mRef);
+            }
+        }
+        if (sweep) {
+            char readBuf[2];
+            read(mCtrlSocketPair[0], &readBuf, 1);
+            if (DBG) ALOGD("MDnsSdListener::Monitor got %c", readBuf[0]);
+            if (memcmp(SWEEP, readBuf, 1) == 0) {
+                sweepDeferred();
             }
-            mPollFds[0].revents = 0;
-        } else {
-            if (VDBG) ALOGD("MDnsSdListener::Monitor poll timed out");
         }
     }
-    free(mPollFds);
-    free(mPollRefs);
 }
 
-#define DBG_RESCAN 0
+#define DBG_SWEEP 0
 
-int MDnsSdListener::Monitor::rescan() {
-// rescan the list from mHead and make new pollfds and serviceRefs
-    if (VDBG) {
-        ALOGD("MDnsSdListener::Monitor poll rescanning - size=%d, live=%d", mPollSize, mLiveCount);
-    }
+void MDnsSdListener::Monitor::sweepDeferred() {
     std::lock_guard guard(mMutex);
-    Element **prevPtr = &mHead;
-    int i = 1;
-    if (mPollSize <= mLiveCount) {
-        mPollSize = mLiveCount + 5;
-        free(mPollFds);
-        free(mPollRefs);
-        mPollFds = (struct pollfd *)calloc(sizeof(struct pollfd), mPollSize);
-        mPollRefs = (DNSServiceRef **)calloc(sizeof(DNSServiceRef *), mPollSize);
-        LOG_ALWAYS_FATAL_IF((mPollFds == nullptr), "calloc failed on mPollFds with a size of %d",
-                ((int)sizeof(struct pollfd)) * mPollSize);
-        LOG_ALWAYS_FATAL_IF((mPollRefs == nullptr), "calloc failed on mPollRefs with a size of %d",
-                ((int)sizeof(DNSServiceRef *)) * mPollSize);
-    } else {
-        memset(mPollFds, 0, sizeof(struct pollfd) * mPollSize);
-        memset(mPollRefs, 0, sizeof(DNSServiceRef *) * mPollSize);
-    }
-    mPollFds[0].fd = mCtrlSocketPair[0];
-    mPollFds[0].events = POLLIN;
-    if (DBG_RESCAN) ALOGD("mHead = %p", mHead);
-    while (*prevPtr != nullptr) {
-        if (DBG_RESCAN) ALOGD("checking %p, mReady = %d", *prevPtr, (*prevPtr)->mReady);
-        if ((*prevPtr)->mReady == 1) {
-            int fd = DNSServiceRefSockFD((*prevPtr)->mRef);
-            if (fd != -1) {
-                if (DBG_RESCAN) ALOGD("  adding FD %d", fd);
-                mPollFds[i].fd = fd;
-                mPollFds[i].events = POLLIN;
-                mPollRefs[i] = &((*prevPtr)->mRef);
-                i++;
-            } else {
-                ALOGE("Error retreving socket FD for live ServiceRef");
-            }
-            prevPtr = &((*prevPtr)->mNext); // advance to the next element
-        } else if ((*prevPtr)->mReady == -1) {
-            if (DBG_RESCAN) ALOGD("  removing %p from  play", *prevPtr);
-            Element *cur = *prevPtr;
-            *prevPtr = (cur)->mNext; // change our notion of this element and don't advance
+    for (auto it = mElements.begin(); it != mElements.end();) {
+        Element* cur = it->second;
+        if (cur->mReady == -1) {
+            if (DBG_SWEEP) ALOGD("  removing %p from  play", cur);
+            it = mElements.erase(it);
             delete cur;
-        } else if ((*prevPtr)->mReady == 0) {
-            // Not ready so just skip this node and continue on
-            if (DBG_RESCAN) ALOGD("%p not ready.  Continuing.", *prevPtr);
-            prevPtr = &((*prevPtr)->mNext);
+        } else {
+            ++it;
         }
     }
-
-    return i;
+    // One wakeup byte covers every element marked since the last sweep, so the next free can
+    // start a new one.
+    mSweepPending = false;
 }
 
 DNSServiceRef *MDnsSdListener::Monitor::allocateServiceRef(int id, Context *context) {
-    if (lookupServiceRef(id) != nullptr) {
+    std::lock_guard guard(mMutex);
+    auto [it, inserted] = mElements.emplace(id, nullptr);
+    if (!inserted) {
         delete(context);
         return nullptr;
     }
     Element *e = new Element(id, context);
-    std::lock_guard guard(mMutex);
-    e->mNext = mHead;
-    mHead = e;
+    it->second = e;
     return &(e->mRef);
 }
 
 DNSServiceRef *MDnsSdListener::Monitor::lookupServiceRef(int id) {
     std::lock_guard guard(mMutex);
-    Element *cur = mHead;
-    while (cur != nullptr) {
-        if (cur->mId == id) {
-            DNSServiceRef *result = &(cur->mRef);
-            return result;
-        }
-        cur = cur->mNext;
-    }
-    return nullptr;
+    auto it = mElements.find(id);
+    if (it == mElements.end()) return nullptr;
+    return &(it->second->mRef);
 }
 
 void MDnsSdListener::Monitor::startMonitoring(int id) {
     if (VDBG) ALOGD("startMonitoring %d", id);
     std::lock_guard guard(mMutex);
-    for (Element* cur = mHead; cur != nullptr; cur = cur->mNext) {
-        if (cur->mId == id) {
-            if (DBG_RESCAN) ALOGD("marking %p as ready to be added", cur);
-            mLiveCount++;
-            cur->mReady = 1;
-            write(mCtrlSocketPair[1], RESCAN, 1);  // trigger a rescan for a fresh poll
-            if (VDBG) ALOGD("triggering rescan");
-            return;
-        }
+    auto it = mElements.find(id);
+    if (it == mElements.end()) return;
+    Element* cur = it->second;
+    int fd = DNSServiceRefSockFD(cur->mRef);
+    if (fd == -1) {
+        ALOGE("Error retreving socket FD for live ServiceRef");
+        return;
+    }
+    if (DBG_SWEEP) ALOGD("adding FD %d for %p", fd, cur);
+    cur->mReady = 1;
+    cur->mFd = fd;
+    epoll_event ev = {.events = EPOLLIN, .data = {.ptr = cur}};
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        ALOGE("failed to watch fd %d: %s", fd, strerror(errno));
     }
 }
 
 void MDnsSdListener::Monitor::freeServiceRef(int id) {
     if (VDBG) ALOGD("freeServiceRef %d", id);
     std::lock_guard guard(mMutex);
-    Element* cur;
-    for (Element** prevPtr = &mHead; *prevPtr != nullptr; prevPtr = &(cur->mNext)) {
-        cur = *prevPtr;
-        if (cur->mId == id) {
-            if (DBG_RESCAN) ALOGD("marking %p as ready to be removed", cur);
-            mLiveCount--;
-            if (cur->mReady == 1) {
-                cur->mReady = -1; // tell poll thread to delete
-                cur->mRef = nullptr; // do not process further results
-                write(mCtrlSocketPair[1], RESCAN, 1); // trigger a rescan for a fresh poll
-                if (VDBG) ALOGD("triggering rescan");
-            } else {
-                *prevPtr = cur->mNext;
-                delete cur;
-            }
-            return;
+    auto it = mElements.find(id);
+    if (it == mElements.end()) return;
+    Element* cur = it->second;
+    if (DBG_SWEEP) ALOGD("marking %p as ready to be removed", cur);
+    if (cur->mReady == 1) {
+        // Best effort: if the ref was already deallocated, closing its socket removed
+        // it from the epoll set for us.
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, cur->mFd, nullptr);
+        cur->mReady = -1; // tell the monitor thread to delete
+        cur->mRef = nullptr; // do not process further results
+        if (!mSweepPending) {
+            write(mCtrlSocketPair[1], SWEEP, 1); // wake the monitor thread to sweep
+            mSweepPending = true;
+            if (VDBG) ALOGD("triggering sweep");
         }
+    } else {
+        mElements.erase(it);
+        delete cur;
     }
 }
 
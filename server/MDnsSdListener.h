@@ -20,6 +20,7 @@
 #include <android-base/thread_annotations.h>
 #include <dns_sd.h>
 #include <sysutils/FrameworkListener.h>
+#include <map>
 #include <mutex>
 #include <string>
 
@@ -95,23 +96,33 @@ class MDnsSdListener {
         std::string threadName() { return std::string("MDnsSdMonitor"); }
 
       private:
-        int rescan(); // returns the number of elements in the poll
+        // Unlinks and deletes every element marked for deferred deletion. Runs on the monitor
+        // thread only, so events harvested before an element was marked can still be checked
+        // against it safely.
+        void sweepDeferred();
 
         struct Element {
             Element(int id, Context* context) : mId(id), mContext(context) {}
             ~Element() { delete mContext; }
 
             int mId;
-            Element* mNext = nullptr;
             DNSServiceRef mRef = nullptr;
             Context *mContext;
             int mReady = 0;
+            // The DNSServiceRef's socket, remembered so the fd can be deregistered after the
+            // ref has been deallocated.
+            int mFd = -1;
         };
-        Element* mHead GUARDED_BY(mMutex);
-        int mLiveCount;
-        struct pollfd *mPollFds;
-        DNSServiceRef **mPollRefs;
-        int mPollSize;
+        // Outstanding requests keyed by id, so a burst of operations pays one lookup each
+        // instead of scanning every live request under the lock. Elements marked for deferred
+        // deletion stay in the map until the monitor thread sweeps them.
+        std::map<int, Element*> mElements GUARDED_BY(mMutex);
+        // True while a sweep wakeup is in flight on the control socket; coalesces wakeup writes
+        // when many requests are stopped back to back.
+        bool mSweepPending GUARDED_BY(mMutex) = false;
+        // Monitored elements are registered with their Element as the epoll context pointer;
+        // the control socket is registered with nullptr.
+        int mEpollFd;
         int mCtrlSocketPair[2];
         std::mutex mMutex;
     };
@@ -21,6 +21,7 @@
 
 #include <arpa/inet.h>
 #include <linux/netfilter/nfnetlink_log.h>
+#include <sched.h>
 
 #include <log/log.h>
 #include <netdutils/Misc.h>
@@ -33,7 +34,6 @@ namespace android {
 namespace net {
 
 using netdutils::extract;
-using netdutils::findWithDefault;
 using netdutils::makeSlice;
 using netdutils::NetlinkListener;
 using netdutils::NetlinkListenerInterface;
@@ -145,13 +145,24 @@ Status cfgCmdUnbind(const SendFn& send, uint16_t nfLogGroup) {
 
 NFLogListener::NFLogListener(std::shared_ptr<NetlinkListenerInterface> listener)
     : mListener(std::move(listener)) {
-    // Rx handler extracts nfgenmsg looks up and invokes registered dispatch function.
+    // Rx handler extracts nfgenmsg, looks up and invokes the registered dispatch function.
+    // The attributes stay in the recv buffer; dispatch functions parse them in place from the
+    // Slice. The slot scan and the dispatch itself run without any lock: the in-flight counter
+    // is what writers use to keep the table stable underneath us.
     const auto rxHandler = [this](const nlmsghdr& nlmsg, const Slice msg) {
         nfgenmsg nfmsg = {};
         extract(msg, nfmsg);
-        std::lock_guard guard(mMutex);
-        const auto& fn = findWithDefault(mDispatchMap, ntohs(nfmsg.res_id), kDefaultDispatchFn);
-        fn(nlmsg, nfmsg, drop(msg, sizeof(nfmsg)));
+        const int32_t group = ntohs(nfmsg.res_id);
+        mDispatchesInFlight++;
+        const DispatchFn* fn = &kDefaultDispatchFn;
+        for (auto& slot : mDispatch) {
+            if (slot.group == group) {
+                fn = &slot.fn;
+                break;
+            }
+        }
+        (*fn)(nlmsg, nfmsg, drop(msg, sizeof(nfmsg)));
+        mDispatchesInFlight--;
     };
     expectOk(mListener->subscribe(kNFLogPacketMsgType, rxHandler));
 
@@ -169,8 +180,17 @@ NFLogListener::~NFLogListener() {
     expectOk(mListener->unsubscribe(kNFLogPacketMsgType));
     expectOk(mListener->unsubscribe(kNetlinkDoneMsgType));
     const auto sendFn = [this](const Slice msg) { return mListener->send(msg); };
-    for (const auto& [key, value] : mDispatchMap) {
-        expectOk(cfgCmdUnbind(sendFn, key));
+    for (const auto& slot : mDispatch) {
+        const int32_t group = slot.group;
+        if (group != kUnusedGroup) {
+            expectOk(cfgCmdUnbind(sendFn, group));
+        }
+    }
+}
+
+void NFLogListener::quiesceDispatch() {
+    while (mDispatchesInFlight != 0) {
+        sched_yield();
     }
 }
 
@@ -181,10 +201,35 @@ Status NFLogListener::subscribe(uint16_t nfLogGroup, const DispatchFn& fn) {
 Status NFLogListener::subscribe(
         uint16_t nfLogGroup, uint32_t copyRange, const DispatchFn& fn) {
     const auto sendFn = [this](const Slice msg) { return mListener->send(msg); };
-    // Install fn into the dispatch map BEFORE requesting delivery of messages
+    // Install fn into the dispatch table BEFORE requesting delivery of messages
     {
         std::lock_guard guard(mMutex);
-        mDispatchMap[nfLogGroup] = fn;
+        DispatchSlot* slot = nullptr;
+        for (auto& s : mDispatch) {
+            if (s.group == nfLogGroup) {
+                slot = &s;
+                break;
+            }
+        }
+        if (slot != nullptr) {
+            // Resubscribing a published group: take the slot out of service before replacing
+            // its function, so the service thread cannot be inside the old one.
+            slot->group = kUnusedGroup;
+            quiesceDispatch();
+        } else {
+            for (auto& s : mDispatch) {
+                if (s.group == kUnusedGroup) {
+                    slot = &s;
+                    break;
+                }
+            }
+        }
+        if (slot == nullptr) {
+            return Status(ENOSPC, "too many NFLOG group subscriptions");
+        }
+        slot->fn = fn;
+        // Publish only once the function is in place.
+        slot->group = nfLogGroup;
     }
     RETURN_IF_NOT_OK(cfgCmdBind(sendFn, nfLogGroup));
 
@@ -196,10 +241,18 @@ Status NFLogListener::subscribe(
 Status NFLogListener::unsubscribe(uint16_t nfLogGroup) {
     const auto sendFn = [this](const Slice msg) { return mListener->send(msg); };
     RETURN_IF_NOT_OK(cfgCmdUnbind(sendFn, nfLogGroup));
-    // Remove from the dispatch map AFTER stopping message delivery.
+    // Remove from the dispatch table AFTER stopping message delivery. Messages already queued
+    // on the socket may still be dispatched until the unpublish below is observed.
     {
         std::lock_guard guard(mMutex);
-        mDispatchMap.erase(nfLogGroup);
+        for (auto& slot : mDispatch) {
+            if (slot.group == nfLogGroup) {
+                slot.group = kUnusedGroup;
+                quiesceDispatch();
+                slot.fn = nullptr;
+                break;
+            }
+        }
     }
     return ok;
 }
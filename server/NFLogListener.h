@@ -17,6 +17,8 @@
 #ifndef NFLOG_LISTENER_H
 #define NFLOG_LISTENER_H
 
+#include <atomic>
+
 #include <netdutils/Netfilter.h>
 
 #include "netdutils/NetlinkListener.h"
@@ -53,7 +55,10 @@ class NFLogListenerInterface {
 };
 
 // NFLogListener manages a single netlink socket with specialized
-// settings required for processing of NFLOG messages.
+// settings required for processing of NFLOG messages. All of netd's
+// NFLOG groups (wakeup events, strict cleartext detection) share this
+// one socket, so each logged packet costs the kernel a single delivery
+// regardless of how many features subscribe.
 //
 // NFLogListener currently assumes that it is ok to drop messages
 // generated by the kernel when under heavy load. This makes the
@@ -76,9 +81,32 @@ class NFLogListener : public NFLogListenerInterface {
     netdutils::Status unsubscribe(uint16_t nfLogGroup) override;
 
   private:
+    // Dispatch functions live in a small flat table rather than a map: netd subscribes to a
+    // handful of NFLOG groups at most, and scanning a few slots is cheaper per packet than a
+    // tree lookup. More importantly, the packet path reads the table without taking mMutex, so
+    // a burst of logged packets never contends with (or holds off) subscribe()/unsubscribe().
+    //
+    // A slot is "published" when group != kUnusedGroup. The packet path pins the table by
+    // incrementing mDispatchesInFlight around each dispatch; writers unpublish a slot and then
+    // wait for in-flight dispatches to drain before touching its function. All of these
+    // operations use the default sequentially-consistent ordering, which the unpublish-then-
+    // check-in-flight handshake relies on.
+    static constexpr int32_t kUnusedGroup = -1;
+    static constexpr size_t kMaxDispatchSlots = 8;
+
+    struct DispatchSlot {
+        std::atomic<int32_t> group{kUnusedGroup};
+        DispatchFn fn;
+    };
+
+    // Blocks until no dispatch is running. Call with mMutex held, after unpublishing the slot
+    // about to be modified. Must not be called from the stack of a dispatch function.
+    void quiesceDispatch();
+
     std::shared_ptr<netdutils::NetlinkListenerInterface> mListener;
-    std::mutex mMutex;
-    std::map<uint16_t, DispatchFn> mDispatchMap;  // guarded by mMutex
+    std::mutex mMutex;  // serializes writers of mDispatch; the packet path never takes it
+    DispatchSlot mDispatch[kMaxDispatchSlots];
+    std::atomic<uint32_t> mDispatchesInFlight{0};
 };
 
 // Allocate and return a new NFLogListener. On success, the returned
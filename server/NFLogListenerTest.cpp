@@ -126,6 +126,27 @@ TEST_F(NFLogListenerTest, dispatchOk) {
     EXPECT_EQ(1, invocations);
 }
 
+TEST_F(NFLogListenerTest, resubscribe) {
+    constexpr uint16_t kType = 38;
+    int invocationsA = 0;
+    int invocationsB = 0;
+    const auto dispatchFnA = [&invocationsA](const nlmsghdr&, const nfgenmsg&, const Slice) {
+        ++invocationsA;
+    };
+    const auto dispatchFnB = [&invocationsB](const nlmsghdr&, const nfgenmsg&, const Slice) {
+        ++invocationsB;
+    };
+    // Two sends per subscribe() for cfgCmdBind() & cfgMode(), plus one send at destruction time
+    // for the single cfgCmdUnbind() of the still-subscribed group.
+    EXPECT_CALL(*mNLListener, send(_)).Times(Exactly(5)).WillRepeatedly(Invoke(sendOk));
+    EXPECT_OK(mListener->subscribe(kType, dispatchFnA));
+    sendEmptyMsg(kType);
+    EXPECT_OK(mListener->subscribe(kType, dispatchFnB));
+    sendEmptyMsg(kType);
+    EXPECT_EQ(1, invocationsA);
+    EXPECT_EQ(1, invocationsB);
+}
+
 TEST_F(NFLogListenerTest, dispatchUnknownType) {
     constexpr uint16_t kType = 38;
     constexpr uint16_t kBadType = kType + 1;
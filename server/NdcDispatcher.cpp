@@ -26,8 +26,10 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <cinttypes>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <android-base/logging.h>
@@ -113,6 +115,163 @@ int stringToINetdPermission(const char* arg) {
     return INetd::PERMISSION_NONE;
 }
 
+// Compile-time table mapping a subcommand name to a small integer id. findSubcommand() is a
+// binary search, so dispatching costs O(log n) string comparisons however many names a command
+// grows, where the old if/strcmp chains walked every name on a miss. Tables must be written in
+// sorted order; each one is static_asserted below because lookup silently misbehaves otherwise.
+struct SubcommandEntry {
+    std::string_view name;
+    int id;
+};
+
+template <size_t N>
+constexpr bool isSortedByName(const SubcommandEntry (&table)[N]) {
+    for (size_t i = 1; i < N; ++i) {
+        if (table[i].name <= table[i - 1].name) return false;
+    }
+    return true;
+}
+
+// Returns the id of |name| in |table|, or -1 if it is not present.
+template <size_t N>
+int findSubcommand(const SubcommandEntry (&table)[N], const char* name) {
+    const std::string_view key(name);
+    size_t lo = 0;
+    size_t hi = N;
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (table[mid].name < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < N && table[lo].name == key) ? table[lo].id : -1;
+}
+
+enum InterfaceSubcommand {
+    INTERFACE_CLEARADDRS,
+    INTERFACE_GETCFG,
+    INTERFACE_IPV6,
+    INTERFACE_IPV6PRIVACYEXTENSIONS,
+    INTERFACE_LIST,
+    INTERFACE_SETCFG,
+    INTERFACE_SETMTU,
+};
+
+constexpr SubcommandEntry kInterfaceSubcommands[] = {
+        {"clearaddrs", INTERFACE_CLEARADDRS},
+        {"getcfg", INTERFACE_GETCFG},
+        {"ipv6", INTERFACE_IPV6},
+        {"ipv6privacyextensions", INTERFACE_IPV6PRIVACYEXTENSIONS},
+        {"list", INTERFACE_LIST},
+        {"setcfg", INTERFACE_SETCFG},
+        {"setmtu", INTERFACE_SETMTU},
+};
+static_assert(isSortedByName(kInterfaceSubcommands));
+
+// Long names and their legacy short aliases map to the same id.
+enum BandwidthSubcommand {
+    BANDWIDTH_ADD_NAUGHTY_APPS,
+    BANDWIDTH_ADD_NICE_APPS,
+    BANDWIDTH_REMOVE_INTERFACE_ALERT,
+    BANDWIDTH_REMOVE_INTERFACE_QUOTA,
+    BANDWIDTH_REMOVE_NAUGHTY_APPS,
+    BANDWIDTH_REMOVE_NICE_APPS,
+    BANDWIDTH_SET_GLOBAL_ALERT,
+    BANDWIDTH_SET_INTERFACE_ALERT,
+    BANDWIDTH_SET_INTERFACE_QUOTA,
+};
+
+constexpr SubcommandEntry kBandwidthSubcommands[] = {
+        {"addnaughtyapps", BANDWIDTH_ADD_NAUGHTY_APPS},
+        {"addniceapps", BANDWIDTH_ADD_NICE_APPS},
+        {"aha", BANDWIDTH_ADD_NICE_APPS},
+        {"ana", BANDWIDTH_ADD_NAUGHTY_APPS},
+        {"removeinterfacealert", BANDWIDTH_REMOVE_INTERFACE_ALERT},
+        {"removeiquota", BANDWIDTH_REMOVE_INTERFACE_QUOTA},
+        {"removenaughtyapps", BANDWIDTH_REMOVE_NAUGHTY_APPS},
+        {"removeniceapps", BANDWIDTH_REMOVE_NICE_APPS},
+        {"rha", BANDWIDTH_REMOVE_NICE_APPS},
+        {"ria", BANDWIDTH_REMOVE_INTERFACE_ALERT},
+        {"riq", BANDWIDTH_REMOVE_INTERFACE_QUOTA},
+        {"rna", BANDWIDTH_REMOVE_NAUGHTY_APPS},
+        {"setglobalalert", BANDWIDTH_SET_GLOBAL_ALERT},
+        {"setinterfacealert", BANDWIDTH_SET_INTERFACE_ALERT},
+        {"setiquota", BANDWIDTH_SET_INTERFACE_QUOTA},
+        {"sga", BANDWIDTH_SET_GLOBAL_ALERT},
+        {"sia", BANDWIDTH_SET_INTERFACE_ALERT},
+        {"siq", BANDWIDTH_SET_INTERFACE_QUOTA},
+};
+static_assert(isSortedByName(kBandwidthSubcommands));
+
+enum FirewallSubcommand {
+    FIREWALL_DISABLE_CHAIN,
+    FIREWALL_ENABLE,
+    FIREWALL_ENABLE_CHAIN,
+    FIREWALL_SET_INTERFACE_RULE,
+    FIREWALL_SET_UID_RULE,
+};
+
+constexpr SubcommandEntry kFirewallSubcommands[] = {
+        {"disable_chain", FIREWALL_DISABLE_CHAIN},
+        {"enable", FIREWALL_ENABLE},
+        {"enable_chain", FIREWALL_ENABLE_CHAIN},
+        {"set_interface_rule", FIREWALL_SET_INTERFACE_RULE},
+        {"set_uid_rule", FIREWALL_SET_UID_RULE},
+};
+static_assert(isSortedByName(kFirewallSubcommands));
+
+enum NetworkSubcommand {
+    NETWORK_CREATE,
+    NETWORK_DEFAULT,
+    NETWORK_DESTROY,
+    NETWORK_INTERFACE,
+    NETWORK_PERMISSION,
+    NETWORK_PROTECT,
+    NETWORK_ROUTE,
+    NETWORK_USERS,
+};
+
+constexpr SubcommandEntry kNetworkSubcommands[] = {
+        {"create", NETWORK_CREATE},
+        {"default", NETWORK_DEFAULT},
+        {"destroy", NETWORK_DESTROY},
+        {"interface", NETWORK_INTERFACE},
+        {"permission", NETWORK_PERMISSION},
+        {"protect", NETWORK_PROTECT},
+        {"route", NETWORK_ROUTE},
+        {"users", NETWORK_USERS},
+};
+static_assert(isSortedByName(kNetworkSubcommands));
+
+// Builds "name|name|..." from |table| so usage text cannot drift from what the dispatcher
+// actually accepts.
+template <size_t N>
+std::string subcommandList(const SubcommandEntry (&table)[N]) {
+    std::string list;
+    for (const SubcommandEntry& entry : table) {
+        if (!list.empty()) list += '|';
+        list += entry.name;
+    }
+    return list;
+}
+
+// Splits |line| into whitespace-delimited tokens by overwriting the separators with NULs and
+// storing a pointer to each token in |argv|. The tokens alias |line|; nothing is copied.
+// Returns the number of tokens found, or -1 if there are more than |maxArgs| of them.
+int tokenizeInPlace(char* line, char** argv, int maxArgs) {
+    int argc = 0;
+    for (char* p = line; *p;) {
+        while (*p == ' ' || *p == '\t') *p++ = '\0';
+        if (!*p) break;
+        if (argc == maxArgs) return -1;
+        argv[argc++] = p;
+        while (*p && *p != ' ' && *p != '\t') ++p;
+    }
+    return argc;
+}
+
 }  // namespace
 
 sp<INetd> NdcDispatcher::mNetd;
@@ -141,7 +300,12 @@ NdcDispatcher::NdcDispatcher() {
 }
 
 void NdcDispatcher::registerCmd(NdcNetdCommand* cmd) {
-    mCommands.push_back(cmd);
+    // Keep mCommands sorted by name so dispatchCommand() can binary search it.
+    mCommands.insert(std::upper_bound(mCommands.begin(), mCommands.end(), cmd,
+                                      [](const NdcNetdCommand* a, const NdcNetdCommand* b) {
+                                          return a->getCommand() < b->getCommand();
+                                      }),
+                     cmd);
 }
 
 int NdcDispatcher::dispatchCommand(int argc, char** argv) {
@@ -149,18 +313,34 @@ int NdcDispatcher::dispatchCommand(int argc, char** argv) {
         mNdc.sendMsg(500, "Command too long", false);
     }
 
-    for (const auto* c : mCommands) {
-        if (c->getCommand() == argv[0]) {
-            if (c->runCommand(&mNdc, argc, argv)) {
-                mNdc.sendMsg(500, "Handler error", true);
-            }
-            return 0;
+    const auto it = std::lower_bound(mCommands.begin(), mCommands.end(), argv[0],
+                                     [](const NdcNetdCommand* c, const char* name) {
+                                         return c->getCommand() < name;
+                                     });
+    if (it != mCommands.end() && (*it)->getCommand() == argv[0]) {
+        if ((*it)->runCommand(&mNdc, argc, argv)) {
+            mNdc.sendMsg(500, "Handler error", true);
         }
+        return 0;
     }
     mNdc.sendMsg(500, "Command not recognized", false);
     return 0;
 }
 
+int NdcDispatcher::dispatchCommand(char* commandLine) {
+    char* argv[CMD_ARGS_MAX];
+    const int argc = tokenizeInPlace(commandLine, argv, CMD_ARGS_MAX);
+    if (argc < 0) {
+        mNdc.sendMsg(500, "Command too long", false);
+        return 0;
+    }
+    if (argc == 0) {
+        mNdc.sendMsg(500, "Command not recognized", false);
+        return 0;
+    }
+    return dispatchCommand(argc, argv);
+}
+
 NdcDispatcher::InterfaceCmd::InterfaceCmd() : NdcNetdCommand("interface") {}
 
 int NdcDispatcher::InterfaceCmd::runCommand(NdcClient* cli, int argc, char** argv) const {
@@ -169,7 +349,8 @@ int NdcDispatcher::InterfaceCmd::runCommand(NdcClient* cli, int argc, char** arg
         return 0;
     }
 
-    if (!strcmp(argv[1], "list")) {
+    const int cmd = findSubcommand(kInterfaceSubcommands, argv[1]);
+    if (cmd == INTERFACE_LIST) {
         std::vector<std::string> interfaceGetList;
         Status status = mNetd->interfaceGetList(&interfaceGetList);
 
@@ -193,7 +374,7 @@ int NdcDispatcher::InterfaceCmd::runCommand(NdcClient* cli, int argc, char** arg
             return 0;
         }
 
-        if (!strcmp(argv[1], "getcfg")) {
+        if (cmd == INTERFACE_GETCFG) {
             InterfaceConfigurationParcel interfaceCfgResult;
             Status status = mNetd->interfaceGetCfg(std::string(argv[2]), &interfaceCfgResult);
 
@@ -212,7 +393,7 @@ int NdcDispatcher::InterfaceCmd::runCommand(NdcClient* cli, int argc, char** arg
             cli->sendMsg(ResponseCode::InterfaceGetCfgResult, msg.c_str(), false);
 
             return 0;
-        } else if (!strcmp(argv[1], "setcfg")) {
+        } else if (cmd == INTERFACE_SETCFG) {
             // arglist: iface [addr prefixLength] flags
             if (argc < 4) {
                 cli->sendMsg(ResponseCode::CommandSyntaxError, "Missing argument", false);
@@ -282,7 +463,7 @@ int NdcDispatcher::InterfaceCmd::runCommand(NdcClient* cli, int argc, char** arg
 
             cli->sendMsg(ResponseCode::CommandOkay, "Interface configuration set", false);
             return 0;
-        } else if (!strcmp(argv[1], "clearaddrs")) {
+        } else if (cmd == INTERFACE_CLEARADDRS) {
             // arglist: iface
             LOG(LOGLEVEL) << "Clearing all IP addresses on " << argv[2];
 
@@ -290,7 +471,7 @@ int NdcDispatcher::InterfaceCmd::runCommand(NdcClient* cli, int argc, char** arg
 
             cli->sendMsg(ResponseCode::CommandOkay, "Interface IP addresses cleared", false);
             return 0;
-        } else if (!strcmp(argv[1], "ipv6privacyextensions")) {
+        } else if (cmd == INTERFACE_IPV6PRIVACYEXTENSIONS) {
             if (argc != 4) {
                 cli->sendMsg(ResponseCode::CommandSyntaxError,
                              "Usage: interface ipv6privacyextensions <interface> <enable|disable>",
@@ -307,7 +488,7 @@ int NdcDispatcher::InterfaceCmd::runCommand(NdcClient* cli, int argc, char** arg
                              true);
             }
             return 0;
-        } else if (!strcmp(argv[1], "ipv6")) {
+        } else if (cmd == INTERFACE_IPV6) {
             if (argc != 4) {
                 cli->sendMsg(ResponseCode::CommandSyntaxError,
                              "Usage: interface ipv6 <interface> <enable|disable>", false);
@@ -323,7 +504,7 @@ int NdcDispatcher::InterfaceCmd::runCommand(NdcClient* cli, int argc, char** arg
                 cli->sendMsg(ResponseCode::OperationFailed, "Failed to change IPv6 state", true);
             }
             return 0;
-        } else if (!strcmp(argv[1], "setmtu")) {
+        } else if (cmd == INTERFACE_SETMTU) {
             if (argc != 4) {
                 cli->sendMsg(ResponseCode::CommandSyntaxError,
                              "Usage: interface setmtu <interface> <val>", false);
@@ -559,7 +740,8 @@ int NdcDispatcher::BandwidthControlCmd::runCommand(NdcClient* cli, int argc, cha
 
     LOG(LOGLEVEL) << StringPrintf("bwctrlcmd: argc=%d %s %s ...", argc, argv[0], argv[1]).c_str();
 
-    if (!strcmp(argv[1], "removeiquota") || !strcmp(argv[1], "riq")) {
+    const int cmd = findSubcommand(kBandwidthSubcommands, argv[1]);
+    if (cmd == BANDWIDTH_REMOVE_INTERFACE_QUOTA) {
         if (argc != 3) {
             sendGenericSyntaxError(cli, "removeiquota <interface>");
             return 0;
@@ -568,7 +750,7 @@ int NdcDispatcher::BandwidthControlCmd::runCommand(NdcClient* cli, int argc, cha
         sendGenericOkFail(cli, rc);
         return 0;
     }
-    if (!strcmp(argv[1], "setiquota") || !strcmp(argv[1], "siq")) {
+    if (cmd == BANDWIDTH_SET_INTERFACE_QUOTA) {
         if (argc != 4) {
             sendGenericSyntaxError(cli, "setiquota <interface> <bytes>");
             return 0;
@@ -579,7 +761,7 @@ int NdcDispatcher::BandwidthControlCmd::runCommand(NdcClient* cli, int argc, cha
         sendGenericOkFail(cli, rc);
         return 0;
     }
-    if (!strcmp(argv[1], "addnaughtyapps") || !strcmp(argv[1], "ana")) {
+    if (cmd == BANDWIDTH_ADD_NAUGHTY_APPS) {
         if (argc < 3) {
             sendGenericSyntaxError(cli, "addnaughtyapps <appUid> ...");
             return 0;
@@ -594,7 +776,7 @@ int NdcDispatcher::BandwidthControlCmd::runCommand(NdcClient* cli, int argc, cha
         sendGenericOkFail(cli, rc);
         return 0;
     }
-    if (!strcmp(argv[1], "removenaughtyapps") || !strcmp(argv[1], "rna")) {
+    if (cmd == BANDWIDTH_REMOVE_NAUGHTY_APPS) {
         if (argc < 3) {
             sendGenericSyntaxError(cli, "removenaughtyapps <appUid> ...");
             return 0;
@@ -609,7 +791,7 @@ int NdcDispatcher::BandwidthControlCmd::runCommand(NdcClient* cli, int argc, cha
         sendGenericOkFail(cli, rc);
         return 0;
     }
-    if (!strcmp(argv[1], "addniceapps") || !strcmp(argv[1], "aha")) {
+    if (cmd == BANDWIDTH_ADD_NICE_APPS) {
         if (argc < 3) {
             sendGenericSyntaxError(cli, "addniceapps <appUid> ...");
             return 0;
@@ -624,7 +806,7 @@ int NdcDispatcher::BandwidthControlCmd::runCommand(NdcClient* cli, int argc, cha
         sendGenericOkFail(cli, rc);
         return 0;
     }
-    if (!strcmp(argv[1], "removeniceapps") || !strcmp(argv[1], "rha")) {
+    if (cmd == BANDWIDTH_REMOVE_NICE_APPS) {
         if (argc < 3) {
             sendGenericSyntaxError(cli, "removeniceapps <appUid> ...");
             return 0;
@@ -639,7 +821,7 @@ int NdcDispatcher::BandwidthControlCmd::runCommand(NdcClient* cli, int argc, cha
         sendGenericOkFail(cli, rc);
         return 0;
     }
-    if (!strcmp(argv[1], "setglobalalert") || !strcmp(argv[1], "sga")) {
+    if (cmd == BANDWIDTH_SET_GLOBAL_ALERT) {
         if (argc != 3) {
             sendGenericSyntaxError(cli, "setglobalalert <bytes>");
             return 0;
@@ -650,7 +832,7 @@ int NdcDispatcher::BandwidthControlCmd::runCommand(NdcClient* cli, int argc, cha
         sendGenericOkFail(cli, rc);
         return 0;
     }
-    if (!strcmp(argv[1], "setinterfacealert") || !strcmp(argv[1], "sia")) {
+    if (cmd == BANDWIDTH_SET_INTERFACE_ALERT) {
         if (argc != 4) {
             sendGenericSyntaxError(cli, "setinterfacealert <interface> <bytes>");
             return 0;
@@ -661,7 +843,7 @@ int NdcDispatcher::BandwidthControlCmd::runCommand(NdcClient* cli, int argc, cha
         sendGenericOkFail(cli, rc);
         return 0;
     }
-    if (!strcmp(argv[1], "removeinterfacealert") || !strcmp(argv[1], "ria")) {
+    if (cmd == BANDWIDTH_REMOVE_INTERFACE_ALERT) {
         if (argc != 3) {
             sendGenericSyntaxError(cli, "removeinterfacealert <interface>");
             return 0;
@@ -671,7 +853,9 @@ int NdcDispatcher::BandwidthControlCmd::runCommand(NdcClient* cli, int argc, cha
         return 0;
     }
 
-    cli->sendMsg(ResponseCode::CommandSyntaxError, "Unknown bandwidth cmd", false);
+    // Generate the list of accepted subcommands from the dispatch table so it cannot drift.
+    const std::string usage = "<" + subcommandList(kBandwidthSubcommands) + "> <args...>";
+    sendGenericSyntaxError(cli, usage.c_str());
     return 0;
 }
 
@@ -779,7 +963,8 @@ int NdcDispatcher::FirewallCmd::runCommand(NdcClient* cli, int argc, char** argv
         return 0;
     }
 
-    if (!strcmp(argv[1], "enable")) {
+    const int cmd = findSubcommand(kFirewallSubcommands, argv[1]);
+    if (cmd == FIREWALL_ENABLE) {
         if (argc != 3) {
             cli->sendMsg(ResponseCode::CommandSyntaxError,
                          "Usage: firewall enable <allowlist|denylist>", false);
@@ -789,7 +974,7 @@ int NdcDispatcher::FirewallCmd::runCommand(NdcClient* cli, int argc, char** argv
         return sendGenericOkFail(cli, res);
     }
 
-    if (!strcmp(argv[1], "set_interface_rule")) {
+    if (cmd == FIREWALL_SET_INTERFACE_RULE) {
         if (argc != 4) {
             cli->sendMsg(ResponseCode::CommandSyntaxError,
                          "Usage: firewall set_interface_rule <rmnet0> <allow|deny>", false);
@@ -799,7 +984,7 @@ int NdcDispatcher::FirewallCmd::runCommand(NdcClient* cli, int argc, char** argv
         return sendGenericOkFail(cli, res);
     }
 
-    if (!strcmp(argv[1], "set_uid_rule")) {
+    if (cmd == FIREWALL_SET_UID_RULE) {
         if (argc != 5) {
             cli->sendMsg(ResponseCode::CommandSyntaxError,
                          "Usage: firewall set_uid_rule <dozable|standby|none> <1000> <allow|deny>",
@@ -819,7 +1004,7 @@ int NdcDispatcher::FirewallCmd::runCommand(NdcClient* cli, int argc, char** argv
         return sendGenericOkFail(cli, res);
     }
 
-    if (!strcmp(argv[1], "enable_chain")) {
+    if (cmd == FIREWALL_ENABLE_CHAIN) {
         if (argc != 3) {
             cli->sendMsg(ResponseCode::CommandSyntaxError,
                          "Usage: firewall enable_chain <dozable|standby>", false);
@@ -829,7 +1014,7 @@ int NdcDispatcher::FirewallCmd::runCommand(NdcClient* cli, int argc, char** argv
         return sendGenericOkFail(cli, res);
     }
 
-    if (!strcmp(argv[1], "disable_chain")) {
+    if (cmd == FIREWALL_DISABLE_CHAIN) {
         if (argc != 3) {
             cli->sendMsg(ResponseCode::CommandSyntaxError,
                          "Usage: firewall disable_chain <dozable|standby>", false);
@@ -925,12 +1110,14 @@ int NdcDispatcher::NetworkCommand::runCommand(NdcClient* cli, int argc, char** a
         return syntaxError(cli, "Missing argument");
     }
 
+    const int cmd = findSubcommand(kNetworkSubcommands, argv[1]);
+
     //    0      1      2      3      4       5         6            7           8
     // network route [legacy <uid>]  add   <netId> <interface> <destination> [nexthop]
     // network route [legacy <uid>] remove <netId> <interface> <destination> [nexthop]
     //
     // nexthop may be either an IPv4/IPv6 address or one of "unreachable" or "throw".
-    if (!strcmp(argv[1], "route")) {
+    if (cmd == NETWORK_ROUTE) {
         if (argc < 6 || argc > 9) {
             return syntaxError(cli, "Incorrect number of arguments");
         }
@@ -983,7 +1170,7 @@ int NdcDispatcher::NetworkCommand::runCommand(NdcClient* cli, int argc, char** a
     //    0        1       2       3         4
     // network interface  add   <netId> <interface>
     // network interface remove <netId> <interface>
-    if (!strcmp(argv[1], "interface")) {
+    if (cmd == NETWORK_INTERFACE) {
         if (argc != 5) {
             return syntaxError(cli, "Missing argument");
         }
@@ -1009,7 +1196,7 @@ int NdcDispatcher::NetworkCommand::runCommand(NdcClient* cli, int argc, char** a
     //
     //    0      1       2     3      4
     // network create <netId> vpn <secure>
-    if (!strcmp(argv[1], "create")) {
+    if (cmd == NETWORK_CREATE) {
         if (argc < 3) {
             return syntaxError(cli, "Missing argument");
         }
@@ -1046,7 +1233,7 @@ int NdcDispatcher::NetworkCommand::runCommand(NdcClient* cli, int argc, char** a
 
     //    0       1       2
     // network destroy <netId>
-    if (!strcmp(argv[1], "destroy")) {
+    if (cmd == NETWORK_DESTROY) {
         if (argc != 3) {
             return syntaxError(cli, "Incorrect number of arguments");
         }
@@ -1063,7 +1250,7 @@ int NdcDispatcher::NetworkCommand::runCommand(NdcClient* cli, int argc, char** a
     //    0       1      2      3
     // network default  set  <netId>
     // network default clear
-    if (!strcmp(argv[1], "default")) {
+    if (cmd == NETWORK_DEFAULT) {
         if (argc < 3) {
             return syntaxError(cli, "Missing argument");
         }
@@ -1088,7 +1275,7 @@ int NdcDispatcher::NetworkCommand::runCommand(NdcClient* cli, int argc, char** a
     // network permission   user  clear    <uid> ...
     // network permission network  set  <permission> <netId> ...
     // network permission network clear   <netId> ...
-    if (!strcmp(argv[1], "permission")) {
+    if (cmd == NETWORK_PERMISSION) {
         if (argc < 5) {
             return syntaxError(cli, "Missing argument");
         }
@@ -1145,7 +1332,7 @@ int NdcDispatcher::NetworkCommand::runCommand(NdcClient* cli, int argc, char** a
     //    0      1     2       3           4
     // network users  add   <netId> [<uid>[-<uid>]] ...
     // network users remove <netId> [<uid>[-<uid>]] ...
-    if (!strcmp(argv[1], "users")) {
+    if (cmd == NETWORK_USERS) {
         if (argc < 4) {
             return syntaxError(cli, "Missing argument");
         }
@@ -1175,7 +1362,7 @@ int NdcDispatcher::NetworkCommand::runCommand(NdcClient* cli, int argc, char** a
     //    0       1      2     3
     // network protect allow <uid> ...
     // network protect  deny <uid> ...
-    if (!strcmp(argv[1], "protect")) {
+    if (cmd == NETWORK_PROTECT) {
         if (argc < 4) {
             return syntaxError(cli, "Missing argument");
         }
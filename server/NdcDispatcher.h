@@ -72,6 +72,11 @@ class NdcDispatcher {
     NdcClient mNdc;
 
     int dispatchCommand(int argc, char** argv);
+    // Tokenizes |commandLine| in place on whitespace and dispatches the result. The tokens alias
+    // the buffer (separators are overwritten with NULs), so no per-command allocation happens and
+    // |commandLine| must stay alive and writable for the duration of the call. At most
+    // CMD_ARGS_MAX arguments are accepted.
+    int dispatchCommand(char* commandLine);
     void registerCmd(NdcNetdCommand* cmd);
 
   private:
@@ -43,6 +43,14 @@ int execIptablesRestore(IptablesTarget target, const std::string& commands) {
     return execIptablesRestoreWithOutput(target, commands, nullptr);
 }
 
+int execIptablesRestoreQueued(IptablesTarget target, const std::string& commands) {
+    return android::net::gCtls->iptablesRestoreCtrl.executeQueued(target, commands);
+}
+
+int flushIptablesRestore() {
+    return android::net::gCtls->iptablesRestoreCtrl.flushPipeline();
+}
+
 int execIptablesRestoreCommand(IptablesTarget target, const std::string& table,
                                const std::string& command, std::string *output) {
     std::string fullCmd = android::base::StringPrintf("*%s\n%s\nCOMMIT\n", table.c_str(),
@@ -150,6 +158,114 @@ int parsePrefix(const char *prefix, uint8_t *family, void *address, int size, ui
     return rawLength;
 }
 
+namespace {
+
+// Writes |value| in decimal without a %-format round-trip; at most one division per digit.
+char* putDecimal(char* p, uint8_t value) {
+    if (value >= 100) {
+        *p++ = '0' + value / 100;
+        *p++ = '0' + (value / 10) % 10;
+        *p++ = '0' + value % 10;
+    } else if (value >= 10) {
+        *p++ = '0' + value / 10;
+        *p++ = '0' + value % 10;
+    } else {
+        *p++ = '0' + value;
+    }
+    return p;
+}
+
+// Writes |word| in lower-case hex with leading zeroes suppressed, as inet_ntop does.
+char* putHexWord(char* p, uint16_t word) {
+    static const char kHexDigits[] = "0123456789abcdef";
+    bool started = false;
+    for (int shift = 12; shift >= 0; shift -= 4) {
+        const unsigned nibble = (word >> shift) & 0xf;
+        if (nibble != 0 || started || shift == 0) {
+            *p++ = kHexDigits[nibble];
+            started = true;
+        }
+    }
+    return p;
+}
+
+}  // namespace
+
+size_t formatIpv4(const void* addr, char* out) {
+    const uint8_t* a = static_cast<const uint8_t*>(addr);
+    char* p = out;
+    p = putDecimal(p, a[0]);
+    *p++ = '.';
+    p = putDecimal(p, a[1]);
+    *p++ = '.';
+    p = putDecimal(p, a[2]);
+    *p++ = '.';
+    p = putDecimal(p, a[3]);
+    *p = '\0';
+    return p - out;
+}
+
+size_t formatIpv6(const void* addr, char* out) {
+    const uint8_t* a = static_cast<const uint8_t*>(addr);
+    uint16_t words[8];
+    for (int i = 0; i < 8; i++) {
+        words[i] = (a[2 * i] << 8) | a[2 * i + 1];
+    }
+
+    // Find the longest run of zero words; per RFC 5952, runs of a single word are not
+    // compressed.
+    int bestBase = -1, bestLen = 0, curBase = -1, curLen = 0;
+    for (int i = 0; i < 8; i++) {
+        if (words[i] != 0) {
+            curBase = -1;
+            continue;
+        }
+        if (curBase == -1) {
+            curBase = i;
+            curLen = 1;
+        } else {
+            curLen++;
+        }
+        if (curLen > bestLen) {
+            bestBase = curBase;
+            bestLen = curLen;
+        }
+    }
+    if (bestLen < 2) {
+        bestBase = -1;
+    }
+
+    char* p = out;
+    for (int i = 0; i < 8; i++) {
+        if (bestBase != -1 && i >= bestBase && i < bestBase + bestLen) {
+            if (i == bestBase) *p++ = ':';
+            continue;
+        }
+        if (i != 0) *p++ = ':';
+        // IPv4-mapped/compatible addresses end in a dotted quad, matching inet_ntop.
+        if (i == 6 && bestBase == 0 && (bestLen == 6 || (bestLen == 5 && words[5] == 0xffff))) {
+            p += formatIpv4(a + 12, p);
+            break;
+        }
+        p = putHexWord(p, words[i]);
+    }
+    if (bestBase != -1 && bestBase + bestLen == 8) *p++ = ':';
+    *p = '\0';
+    return p - out;
+}
+
+size_t formatIpAddress(uint8_t family, const void* addr, char* out) {
+    return (family == AF_INET) ? formatIpv4(addr, out) : formatIpv6(addr, out);
+}
+
+size_t formatIpPrefix(uint8_t family, const void* addr, uint8_t prefixlen, char* out) {
+    char* p = out + formatIpAddress(family, addr, out);
+    *p++ = '/';
+    p = putDecimal(p, prefixlen);
+    *p = '\0';
+    return p - out;
+}
+
 void blockSigpipe() {
     sigset_t mask;
 
@@ -172,6 +288,19 @@ void setCloseOnExec(const char *sock) {
     }
 }
 
+void setNonBlocking(const char *sock) {
+    int fd = android_get_control_socket(sock);
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) {
+        ALOGE("Can't get status flags for control socket %s", sock);
+        flags = 0;
+    }
+    flags |= O_NONBLOCK;
+    if (fcntl(fd, F_SETFL, flags) == -1) {
+        ALOGE("Can't set control socket %s to O_NONBLOCK", sock);
+    }
+}
+
 // SIGTERM with timeout first, if fail, SIGKILL
 void stopProcess(int pid, const char* processName) {
     int err = kill(pid, SIGTERM);
@@ -34,15 +34,40 @@ enum IptablesTarget { V4, V6, V4V6 };
 int execIptablesRestore(IptablesTarget target, const std::string& commands);
 int execIptablesRestoreWithOutput(IptablesTarget target, const std::string& commands,
                                   std::string *output);
+// Queues |commands| without waiting for completion; errors surface via flushIptablesRestore().
+int execIptablesRestoreQueued(IptablesTarget target, const std::string& commands);
+int flushIptablesRestore();
 int execIptablesRestoreCommand(IptablesTarget target, const std::string& table,
                                const std::string& command, std::string *output);
 bool isIfaceName(const std::string& name);
 int parsePrefix(const char *prefix, uint8_t *family, void *address, int size, uint8_t *prefixlen);
+
+// Fixed-buffer address formatting for hot logging and event-reporting paths. Each function
+// writes a NUL-terminated string into |out| and returns the number of characters written
+// (excluding the NUL), so callers can build larger strings without a strlen() pass and without
+// allocating. |out| must have room for INET_ADDRSTRLEN, INET6_ADDRSTRLEN or INET6_PREFIXSTRLEN
+// bytes respectively. Output matches inet_ntop(): lower-case hex, the longest zero run
+// compressed to "::", and a dotted-quad tail for IPv4-mapped/compatible IPv6 addresses.
+#define INET6_PREFIXSTRLEN (INET6_ADDRSTRLEN + sizeof("/128") - 1)
+size_t formatIpv4(const void* addr, char* out);
+size_t formatIpv6(const void* addr, char* out);
+// Dispatches on |family| (AF_INET or AF_INET6).
+size_t formatIpAddress(uint8_t family, const void* addr, char* out);
+size_t formatIpPrefix(uint8_t family, const void* addr, uint8_t prefixlen, char* out);
 void blockSigpipe();
 void setCloseOnExec(const char *sock);
+void setNonBlocking(const char *sock);
 
 void stopProcess(int pid, const char* processName);
 
+// Code-layout hints for the linker. NETD_HOT marks the functions on the per-connection marking
+// and lookup paths so they are laid out together in .text.hot; NETD_COLD marks boot-only and
+// dump-only code so it lands in .text.unlikely, away from the steady-state working set. These
+// seed the layout even in builds without a PGO profile; when the netd profile (trained on
+// netd_benchmark, see Android.bp) is present, the sample counts refine the same placement.
+#define NETD_HOT __attribute__((hot))
+#define NETD_COLD __attribute__((cold))
+
 // TODO: use std::size() instead.
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
 
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * NetdConstantsTest.cpp - unit tests for NetdConstants.cpp
+ */
+
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "NetdConstants.h"
+
+namespace {
+
+// Formats |addrString| through the fixed-buffer helpers and checks the result against both the
+// expected text and inet_ntop's output for the same bytes.
+void expectFormatsAs(int family, const char* addrString, const std::string& expected) {
+    uint8_t addr[sizeof(in6_addr)] = {};
+    ASSERT_EQ(1, inet_pton(family, addrString, addr));
+
+    char out[INET6_ADDRSTRLEN];
+    const size_t len = formatIpAddress(family, addr, out);
+    EXPECT_EQ(expected, std::string(out));
+    EXPECT_EQ(expected.size(), len);
+
+    char reference[INET6_ADDRSTRLEN];
+    ASSERT_NE(nullptr, inet_ntop(family, addr, reference, sizeof(reference)));
+    EXPECT_EQ(std::string(reference), std::string(out));
+}
+
+}  // namespace
+
+TEST(NetdConstantsTest, FormatIpv4) {
+    expectFormatsAs(AF_INET, "0.0.0.0", "0.0.0.0");
+    expectFormatsAs(AF_INET, "8.8.8.8", "8.8.8.8");
+    expectFormatsAs(AF_INET, "192.0.2.1", "192.0.2.1");
+    expectFormatsAs(AF_INET, "255.255.255.255", "255.255.255.255");
+}
+
+TEST(NetdConstantsTest, FormatIpv6) {
+    expectFormatsAs(AF_INET6, "::", "::");
+    expectFormatsAs(AF_INET6, "::1", "::1");
+    expectFormatsAs(AF_INET6, "2001:db8::", "2001:db8::");
+    expectFormatsAs(AF_INET6, "2001:db8::1", "2001:db8::1");
+    expectFormatsAs(AF_INET6, "2001:db8:0:0:1::1", "2001:db8::1:0:0:1");
+    expectFormatsAs(AF_INET6, "fe80::210:5aff:feaa:20a2", "fe80::210:5aff:feaa:20a2");
+    expectFormatsAs(AF_INET6, "2001:db8:1:2:3:4:5:6", "2001:db8:1:2:3:4:5:6");
+    // A single zero word is not compressed.
+    expectFormatsAs(AF_INET6, "2001:db8:0:1:1:1:1:1", "2001:db8:0:1:1:1:1:1");
+    // IPv4-mapped and -compatible addresses keep their dotted-quad tail.
+    expectFormatsAs(AF_INET6, "::ffff:192.0.2.1", "::ffff:192.0.2.1");
+    expectFormatsAs(AF_INET6, "::192.0.2.1", "::192.0.2.1");
+}
+
+TEST(NetdConstantsTest, FormatIpPrefix) {
+    uint8_t addr[sizeof(in6_addr)] = {};
+    char out[INET6_PREFIXSTRLEN];
+
+    ASSERT_EQ(1, inet_pton(AF_INET, "192.0.2.0", addr));
+    EXPECT_EQ(strlen("192.0.2.0/24"), formatIpPrefix(AF_INET, addr, 24, out));
+    EXPECT_STREQ("192.0.2.0/24", out);
+
+    ASSERT_EQ(1, inet_pton(AF_INET6, "2001:db8::", addr));
+    EXPECT_EQ(strlen("2001:db8::/64"), formatIpPrefix(AF_INET6, addr, 64, out));
+    EXPECT_STREQ("2001:db8::/64", out);
+
+    ASSERT_EQ(1, inet_pton(AF_INET6, "::1", addr));
+    EXPECT_EQ(strlen("::1/128"), formatIpPrefix(AF_INET6, addr, 128, out));
+    EXPECT_STREQ("::1/128", out);
+}
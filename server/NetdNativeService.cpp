@@ -16,7 +16,11 @@
 
 #define LOG_TAG "Netd"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cinttypes>
+#include <mutex>
 #include <numeric>
 #include <set>
 #include <string>
@@ -36,10 +40,15 @@
 #include <utils/Errors.h>
 #include <utils/String16.h>
 
+#include "BootMetrics.h"
 #include "Controllers.h"
 #include "Fwmark.h"
+#include "FwmarkServer.h"
 #include "InterfaceController.h"
+#include "LatencyWatchdog.h"
 #include "NetdNativeService.h"
+#include "NetlinkCommands.h"
+#include "NetlinkManager.h"
 #include "OemNetdListener.h"
 #include "Permission.h"
 #include "Process.h"
@@ -51,6 +60,7 @@
 #include "binder_utils/NetdPermissions.h"
 #include "netid_client.h"  // NETID_UNSET
 
+using android::base::StringAppendF;
 using android::base::StringPrintf;
 using android::base::WriteStringToFile;
 using android::net::TetherStatsParcel;
@@ -67,7 +77,97 @@ namespace net {
 namespace {
 const char OPT_SHORT[] = "--short";
 
+// Always-on visibility into where binder time goes: every entry point records its call count and
+// a log2-bucket latency histogram, shown in `dumpsys netd`. Each method owns a function-local
+// static Method (registered once), so the per-call cost is two clock reads and a few relaxed
+// atomic increments.
+class BinderCallStats {
+  public:
+    // log2(microseconds); the top bucket collects everything >= ~0.5s.
+    static constexpr size_t kBuckets = 20;
+
+    struct Method {
+        explicit Method(const char* name) : name(name) { registerMethod(this); }
+        const char* const name;
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> totalUs{0};
+        std::atomic<uint64_t> buckets[kBuckets] = {};
+    };
+
+    class Recorder {
+      public:
+        explicit Recorder(Method* method)
+            : mMethod(method), mStart(std::chrono::steady_clock::now()) {}
+        ~Recorder() {
+            const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                        std::chrono::steady_clock::now() - mStart)
+                                        .count();
+            const size_t bucket =
+                    us ? std::min<size_t>(63 - __builtin_clzll(us), kBuckets - 1) : 0;
+            mMethod->count.fetch_add(1, std::memory_order_relaxed);
+            mMethod->totalUs.fetch_add(us, std::memory_order_relaxed);
+            mMethod->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+
+      private:
+        Method* const mMethod;
+        const std::chrono::steady_clock::time_point mStart;
+    };
+
+    static void dump(DumpWriter& dw) {
+        std::vector<const Method*> methods;
+        {
+            std::lock_guard guard(sLock);
+            methods.assign(sMethods.begin(), sMethods.end());
+        }
+        std::sort(methods.begin(), methods.end(), [](const Method* a, const Method* b) {
+            return a->totalUs.load(std::memory_order_relaxed) >
+                   b->totalUs.load(std::memory_order_relaxed);
+        });
+
+        dw.println("BinderCalls: (calls, total time, count per log2(us) bucket)");
+        ScopedIndent indentEntries(dw);
+        for (const Method* m : methods) {
+            const uint64_t count = m->count.load(std::memory_order_relaxed);
+            if (count == 0) continue;
+            std::string histogram;
+            for (size_t i = 0; i < kBuckets; ++i) {
+                const uint64_t n = m->buckets[i].load(std::memory_order_relaxed);
+                if (n == 0) continue;
+                if (i == kBuckets - 1) {
+                    StringAppendF(&histogram, " >=%" PRIu64 "us:%" PRIu64,
+                                  uint64_t(1) << (kBuckets - 1), n);
+                } else {
+                    StringAppendF(&histogram, " <%" PRIu64 "us:%" PRIu64, uint64_t(1) << (i + 1),
+                                  n);
+                }
+            }
+            dw.println("%s: %" PRIu64 " calls %" PRIu64 "us%s", m->name, count,
+                       m->totalUs.load(std::memory_order_relaxed), histogram.c_str());
+        }
+    }
+
+  private:
+    static void registerMethod(Method* method) {
+        std::lock_guard guard(sLock);
+        sMethods.push_back(method);
+    }
+
+    static std::mutex sLock;
+    // Entries are function-local statics and live forever.
+    static std::vector<Method*> sMethods;
+};
+
+std::mutex BinderCallStats::sLock;
+std::vector<BinderCallStats::Method*> BinderCallStats::sMethods;
+
+// Must be expanded at most once per method: the Method static is keyed by the enclosing function.
+#define RECORD_BINDER_CALL()                                         \
+    static BinderCallStats::Method _binderCallMethod(__func__);      \
+    BinderCallStats::Recorder _binderCallRecorder(&_binderCallMethod)
+
 #define ENFORCE_ANY_PERMISSION(...)                                \
+    RECORD_BINDER_CALL();                                          \
     do {                                                           \
         binder::Status status = checkAnyPermission({__VA_ARGS__}); \
         if (!status.isOk()) {                                      \
@@ -135,6 +235,15 @@ status_t NetdNativeService::start() {
         return ret;
     }
     sp<ProcessState> ps(ProcessState::self());
+    // Size the pool before spawning it. Bulk calls like tetherGetStats can occupy a thread for a
+    // long time, and with too few threads a burst of them adds tail latency to the short
+    // network-transition calls queued behind them (the per-socket marking path doesn't ride
+    // binder at all; see FwmarkServer). The default matches libbinder's; devices that see heavy
+    // stats polling can raise it without a rebuild.
+    int32_t numThreads = property_get_int32("persist.netd.binder_threads", 0);
+    if (numThreads > 0) {
+        ps->setThreadPoolMaxThreadCount(std::min(numThreads, 32));
+    }
     ps->startThreadPool();
     ps->giveThreadPoolName();
 
@@ -152,6 +261,10 @@ status_t NetdNativeService::dump(int fd, const Vector<String16> &args) {
     // This method does not grab any locks. If individual classes need locking
     // their dump() methods MUST handle locking appropriately.
 
+    // Drain queued asynchronous work first, so the dump shows the state the kernel has actually
+    // settled into rather than a snapshot with mutations still in flight.
+    (void) gCtls->waitForPendingAsyncCommands();
+
     DumpWriter dw(fd);
 
     if (!args.isEmpty() && args[0] == TcpSocketMonitor::DUMP_KEYWORD) {
@@ -166,6 +279,9 @@ status_t NetdNativeService::dump(int fd, const Vector<String16> &args) {
     gCtls->netCtrl.dump(dw);
     dw.blankline();
 
+    gCtls->generationRegistry.dump(dw);
+    dw.blankline();
+
     gCtls->xfrmCtrl.dump(dw);
     dw.blankline();
 
@@ -197,6 +313,36 @@ status_t NetdNativeService::dump(int fd, const Vector<String16> &args) {
         dw.blankline();
     }
 
+    {
+        ScopedIndent indentLog(dw);
+        if (contains(args, String16(OPT_SHORT))) {
+            dw.println("RouteIntentLog: <omitted>");
+        } else {
+            RouteController::dump(dw);
+        }
+        dw.blankline();
+    }
+
+    {
+        ScopedIndent indentStats(dw);
+        BinderCallStats::dump(dw);
+        dw.blankline();
+        gCtls->iptablesRestoreCtrl.dump(dw);
+        dw.blankline();
+        LatencyWatchdog::dump(dw);
+        dw.blankline();
+        dumpNetlinkStats(dw);
+        dw.blankline();
+        NetlinkManager::Instance()->dump(dw);
+        dw.blankline();
+        FwmarkServer::dumpStats(dw);
+        dw.blankline();
+        if (BootMetrics::instance != nullptr) {
+            BootMetrics::instance->dump(dw);
+            dw.blankline();
+        }
+    }
+
     return NO_ERROR;
 }
 
@@ -210,6 +356,8 @@ binder::Status NetdNativeService::isAlive(bool *alive) {
 
 binder::Status NetdNativeService::firewallReplaceUidChain(const std::string&, bool,
                                                           const std::vector<int32_t>&, bool*) {
+    // Per-UID firewall chains are implemented in eBPF by the network stack; netd no longer
+    // programs (or incrementally updates) iptables chain text for UID rules.
     return binder::Status::fromExceptionCode(binder::Status::EX_UNSUPPORTED_OPERATION);
 }
 
@@ -434,6 +582,7 @@ void setTetherStatsParcelVecByInterface(std::vector<TetherStatsParcel>* tetherSt
                     std::pair<std::string, TetherController::TetherStats>(stats.extIface, stats));
         }
     }
+    tetherStatsVec->reserve(statsMap.size());
     for (auto iter = statsMap.begin(); iter != statsMap.end(); iter++) {
         tetherStatsVec->push_back(toTetherStatsParcel(iter->second));
     }
@@ -441,6 +590,7 @@ void setTetherStatsParcelVecByInterface(std::vector<TetherStatsParcel>* tetherSt
 
 std::vector<std::string> tetherStatsParcelVecToStringVec(std::vector<TetherStatsParcel>* tVec) {
     std::vector<std::string> result;
+    result.reserve(tVec->size());
     for (const auto& t : *tVec) {
         result.push_back(StringPrintf("%s:%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64,
                                       t.iface.c_str(), t.rxBytes, t.rxPackets, t.txBytes,
@@ -715,6 +865,7 @@ binder::Status NetdNativeService::trafficSwapActiveStatsMap() {
 binder::Status NetdNativeService::idletimerAddInterface(const std::string& ifName, int32_t timeout,
                                                         const std::string& classLabel) {
     NETD_LOCKING_RPC(gCtls->idletimerCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    gCtls->waitForDeferredInit();
     int res =
             gCtls->idletimerCtrl.addInterfaceIdletimer(ifName.c_str(), timeout, classLabel.c_str());
     return statusFromErrcode(res);
@@ -724,6 +875,7 @@ binder::Status NetdNativeService::idletimerRemoveInterface(const std::string& if
                                                            int32_t timeout,
                                                            const std::string& classLabel) {
     NETD_LOCKING_RPC(gCtls->idletimerCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    gCtls->waitForDeferredInit();
     int res = gCtls->idletimerCtrl.removeInterfaceIdletimer(ifName.c_str(), timeout,
                                                             classLabel.c_str());
     return statusFromErrcode(res);
@@ -731,6 +883,7 @@ binder::Status NetdNativeService::idletimerRemoveInterface(const std::string& if
 
 binder::Status NetdNativeService::strictUidCleartextPenalty(int32_t uid, int32_t policyPenalty) {
     NETD_LOCKING_RPC(gCtls->strictCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    gCtls->waitForDeferredInit();
     StrictPenalty penalty;
     switch (policyPenalty) {
         case INetd::PENALTY_POLICY_REJECT:
@@ -774,7 +927,9 @@ binder::Status NetdNativeService::ipfwdEnabled(bool* status) {
 
 binder::Status NetdNativeService::ipfwdGetRequesterList(std::vector<std::string>* requesterList) {
     NETD_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
-    for (const auto& requester : gCtls->tetherCtrl.getIpfwdRequesterList()) {
+    const auto& requesters = gCtls->tetherCtrl.getIpfwdRequesterList();
+    requesterList->reserve(requesters.size());
+    for (const auto& requester : requesters) {
         requesterList->push_back(requester);
     }
     return binder::Status::ok();
@@ -929,7 +1084,9 @@ binder::Status NetdNativeService::tetherInterfaceRemove(const std::string& ifNam
 
 binder::Status NetdNativeService::tetherInterfaceList(std::vector<std::string>* ifList) {
     NETD_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
-    for (const auto& ifname : gCtls->tetherCtrl.getTetheredInterfaceList()) {
+    const auto& tetheredIfaces = gCtls->tetherCtrl.getTetheredInterfaceList();
+    ifList->reserve(tetheredIfaces.size());
+    for (const auto& ifname : tetheredIfaces) {
         ifList->push_back(ifname);
     }
     return binder::Status::ok();
@@ -944,7 +1101,9 @@ binder::Status NetdNativeService::tetherDnsSet(int32_t netId,
 
 binder::Status NetdNativeService::tetherDnsList(std::vector<std::string>* dnsList) {
     NETD_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
-    for (const auto& fwdr : gCtls->tetherCtrl.getDnsForwarders()) {
+    const auto& forwarders = gCtls->tetherCtrl.getDnsForwarders();
+    dnsList->reserve(forwarders.size());
+    for (const auto& fwdr : forwarders) {
         dnsList->push_back(fwdr);
     }
     return binder::Status::ok();
@@ -15,6 +15,11 @@
  */
 
 #include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <atomic>
+
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <sys/socket.h>
@@ -31,6 +36,107 @@
 namespace android {
 namespace net {
 
+namespace {
+
+// Per-message-type request/error totals. Slots are claimed with a compare-and-swap on first use
+// and then only ever incremented, so recording is lock-free; netd uses only a handful of message
+// types, so a small fixed table suffices (overflow drops the sample rather than locking).
+struct NetlinkTypeStats {
+    std::atomic<uint32_t> type{0};  // 0 = unclaimed slot; real message types are nonzero.
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};
+};
+
+constexpr size_t kNetlinkStatsSlots = 32;
+NetlinkTypeStats sNetlinkStats[kNetlinkStatsSlots];
+
+// Upper bound on a single deletion burst in rtNetlinkFlush(). Comfortably below the default
+// netlink send buffer, so one send() always takes the whole burst.
+constexpr size_t kFlushBatchBytes = 64 * 1024;
+
+// One cached, connected NETLINK_ROUTE request socket per thread. Rule-heavy operations (a VPN
+// transition programs thousands of rules) otherwise pay socket()/connect()/close() per request.
+// Threads never share a cached socket, so no locking is needed. The wrapper closes the socket
+// when its owning thread exits.
+struct PooledSocket {
+    int fd = -1;
+    ~PooledSocket() {
+        if (fd >= 0) close(fd);
+    }
+};
+thread_local PooledSocket sRouteSocketPool;
+
+int acquireRouteSocket() {
+    const int sock = sRouteSocketPool.fd;
+    if (sock >= 0) {
+        sRouteSocketPool.fd = -1;
+        return sock;
+    }
+    return openNetlinkSocket(NETLINK_ROUTE);
+}
+
+// Returns |sock| to the thread's pool, or closes it if it is not safe to reuse. A request that
+// ended early (e.g. a dump aborted by an NLMSG_ERROR mid-buffer) can leave queued messages that
+// would corrupt the next request's ack parsing, so a socket is only cached after a health check
+// shows nothing left to read.
+void releaseRouteSocket(int sock) {
+    char byte;
+    if (sRouteSocketPool.fd == -1 &&
+        recv(sock, &byte, sizeof(byte), MSG_DONTWAIT | MSG_PEEK) == -1 && errno == EAGAIN) {
+        sRouteSocketPool.fd = sock;
+        return;
+    }
+    close(sock);
+}
+
+// Receive ring for processNetlinkDump(): a fixed set of buffers recvmmsg() fills in one syscall.
+// Allocated once per thread and reused by every dump that thread runs.
+constexpr int kDumpRingBuffers = 8;
+struct DumpRing {
+    std::vector<uint8_t> buffers;
+    iovec iovs[kDumpRingBuffers];
+    mmsghdr msgs[kDumpRingBuffers];
+    DumpRing() : buffers(kDumpRingBuffers * kNetlinkDumpBufferSize) {
+        for (int i = 0; i < kDumpRingBuffers; ++i) {
+            iovs[i] = {buffers.data() + i * kNetlinkDumpBufferSize, kNetlinkDumpBufferSize};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+};
+
+}  // namespace
+
+void recordNetlinkStats(uint16_t type, bool isError) {
+    for (size_t i = 0; i < kNetlinkStatsSlots; ++i) {
+        NetlinkTypeStats& slot = sNetlinkStats[i];
+        uint32_t slotType = slot.type.load(std::memory_order_acquire);
+        if (slotType == 0) {
+            uint32_t expected = 0;
+            slot.type.compare_exchange_strong(expected, type);
+            slotType = expected ? expected : type;
+        }
+        if (slotType == type) {
+            slot.requests.fetch_add(1, std::memory_order_relaxed);
+            if (isError) slot.errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+void dumpNetlinkStats(netdutils::DumpWriter& dw) {
+    dw.println("Netlink requests:");
+    netdutils::ScopedIndent indentStats(dw);
+    for (const NetlinkTypeStats& slot : sNetlinkStats) {
+        const uint32_t type = slot.type.load(std::memory_order_acquire);
+        if (type == 0) continue;
+        dw.println("type %u: %" PRIu64 " requests, %" PRIu64 " errors", type,
+                   slot.requests.load(std::memory_order_relaxed),
+                   slot.errors.load(std::memory_order_relaxed));
+    }
+}
+
 int openNetlinkSocket(int protocol) {
     int sock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, protocol);
     if (sock == -1) {
@@ -82,10 +188,12 @@ int recvNetlinkAck(int sock) {
 // |iov| is an array of struct iovec that contains the netlink message payload.
 // The netlink header is generated by this function based on |action| and |flags|.
 // Returns -errno if there was an error or if the kernel reported an error.
-OPTNONE int sendNetlinkRequest(uint16_t action, uint16_t flags, iovec* iov, int iovlen,
-                               const NetlinkDumpCallback* callback) {
-    int sock = openNetlinkSocket(NETLINK_ROUTE);
+OPTNONE int sendNetlinkRequest(int protocol, uint16_t action, uint16_t flags, iovec* iov,
+                               int iovlen, const NetlinkDumpCallback* callback) {
+    const bool pooled = (protocol == NETLINK_ROUTE);
+    int sock = pooled ? acquireRouteSocket() : openNetlinkSocket(protocol);
     if (sock < 0) {
+        recordNetlinkStats(action, true);
         return sock;
     }
 
@@ -107,6 +215,7 @@ OPTNONE int sendNetlinkRequest(uint16_t action, uint16_t flags, iovec* iov, int
         ret = -errno;
         ALOGE("netlink socket connect/writev failed (%s)", strerror(-ret));
         close(sock);
+        recordNetlinkStats(action, true);
         return ret;
     }
 
@@ -116,44 +225,148 @@ OPTNONE int sendNetlinkRequest(uint16_t action, uint16_t flags, iovec* iov, int
         ret = processNetlinkDump(sock, *callback);
     }
 
-    close(sock);
+    if (pooled) {
+        releaseRouteSocket(sock);
+    } else {
+        close(sock);
+    }
+    recordNetlinkStats(action, ret != 0);
 
     return ret;
 }
 
+int sendNetlinkRequest(uint16_t action, uint16_t flags, iovec* iov, int iovlen,
+                       const NetlinkDumpCallback* callback) {
+    return sendNetlinkRequest(NETLINK_ROUTE, action, flags, iov, iovlen, callback);
+}
+
 int sendNetlinkRequest(uint16_t action, uint16_t flags, iovec* iov, int iovlen) {
     return sendNetlinkRequest(action, flags, iov, iovlen, nullptr);
 }
 
 int processNetlinkDump(int sock, const NetlinkDumpCallback& callback) {
-    char buf[kNetlinkDumpBufferSize];
+    // Large dumps (e.g. a full route table in flushRoutes) span many datagrams; draining them
+    // through the per-thread ring costs a few recvmmsg() syscalls instead of one read() each.
+    static thread_local DumpRing ring;
+
+    while (true) {
+        // Block for the first datagram, then opportunistically take whatever else the kernel has
+        // already queued.
+        const int numMsgs = TEMP_FAILURE_RETRY(
+                recvmmsg(sock, ring.msgs, kDumpRingBuffers, MSG_WAITFORONE, nullptr));
+        if (numMsgs == -1) {
+            return -errno;
+        }
 
-    ssize_t bytesread;
-    do {
-        bytesread = read(sock, buf, sizeof(buf));
+        for (int i = 0; i < numMsgs; ++i) {
+            uint32_t len = ring.msgs[i].msg_len;
+            if (len == 0) {
+                return 0;
+            }
+            for (nlmsghdr* nlh = reinterpret_cast<nlmsghdr*>(ring.iovs[i].iov_base);
+                 NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+                switch (nlh->nlmsg_type) {
+                    case NLMSG_DONE:
+                        return 0;
+                    case NLMSG_ERROR: {
+                        nlmsgerr* err = reinterpret_cast<nlmsgerr*>(NLMSG_DATA(nlh));
+                        return err->error;
+                    }
+                    default:
+                        callback(nlh);
+                }
+            }
+        }
+    }
+}
 
-        if (bytesread < 0) {
-            return -errno;
+void NetlinkRequestBatch::append(uint16_t action, uint16_t flags, const iovec* iov, int iovlen) {
+    nlmsghdr nlmsg = {
+        .nlmsg_len = static_cast<uint32_t>(sizeof(nlmsghdr)),
+        .nlmsg_type = action,
+        .nlmsg_flags = static_cast<uint16_t>(flags | NLM_F_ACK),
+        // Number requests from 1 so an ack with a zero sequence number is never one of ours.
+        .nlmsg_seq = static_cast<uint32_t>(++mCount),
+    };
+    for (int i = 1; i < iovlen; ++i) {
+        nlmsg.nlmsg_len += iov[i].iov_len;
+    }
+
+    mTypes.push_back(action);
+    size_t offset = mBuffer.size();
+    mBuffer.resize(offset + NLMSG_ALIGN(nlmsg.nlmsg_len));
+    memcpy(mBuffer.data() + offset, &nlmsg, sizeof(nlmsg));
+    offset += sizeof(nlmsg);
+    for (int i = 1; i < iovlen; ++i) {
+        memcpy(mBuffer.data() + offset, iov[i].iov_base, iov[i].iov_len);
+        offset += iov[i].iov_len;
+    }
+}
+
+int NetlinkRequestBatch::flush() {
+    if (mCount == 0) {
+        return 0;
+    }
+
+    int sock = acquireRouteSocket();
+    if (sock >= 0) {
+        if (send(sock, mBuffer.data(), mBuffer.size(), 0) == -1) {
+            int err = -errno;
+            ALOGE("netlink batch send failed (%s)", strerror(-err));
+            close(sock);
+            sock = err;
         }
+    }
+    if (sock < 0) {
+        for (const uint16_t type : mTypes) {
+            recordNetlinkStats(type, true);
+        }
+        mBuffer.clear();
+        mTypes.clear();
+        mCount = 0;
+        return sock;
+    }
 
+    // The kernel acks each request individually, in order. Scan until we've seen them all, and
+    // keep going past failures so the result covers the entire batch.
+    int ret = 0;
+    size_t acksSeen = 0;
+    char buf[kNetlinkDumpBufferSize];
+    while (acksSeen < mCount) {
+        ssize_t bytesread = recv(sock, buf, sizeof(buf), 0);
+        if (bytesread < 0) {
+            if (ret == 0) ret = -errno;
+            ALOGE("netlink batch recv failed after %zu/%zu acks (%s)", acksSeen, mCount,
+                  strerror(errno));
+            break;
+        }
         uint32_t len = bytesread;
-        for (nlmsghdr *nlh = reinterpret_cast<nlmsghdr *>(buf);
-             NLMSG_OK(nlh, len);
+        for (nlmsghdr* nlh = reinterpret_cast<nlmsghdr*>(buf); NLMSG_OK(nlh, len);
              nlh = NLMSG_NEXT(nlh, len)) {
-            switch (nlh->nlmsg_type) {
-              case NLMSG_DONE:
-                return 0;
-              case NLMSG_ERROR: {
-                nlmsgerr *err = reinterpret_cast<nlmsgerr *>(NLMSG_DATA(nlh));
-                return err->error;
-              }
-              default:
-                callback(nlh);
+            if (nlh->nlmsg_type != NLMSG_ERROR) continue;
+            ++acksSeen;
+            nlmsgerr* err = reinterpret_cast<nlmsgerr*>(NLMSG_DATA(nlh));
+            // With mTolerateExisting, an add that hit an identical surviving object is success;
+            // with mTolerateMissing, a delete that found its object already gone is too.
+            const bool failed = err->error != 0 &&
+                                !(mTolerateExisting && err->error == -EEXIST) &&
+                                !(mTolerateMissing && err->error == -ENOENT);
+            if (nlh->nlmsg_seq >= 1 && nlh->nlmsg_seq <= mTypes.size()) {
+                recordNetlinkStats(mTypes[nlh->nlmsg_seq - 1], failed);
+            }
+            if (failed) {
+                ALOGE("netlink batch request %u failed (%s)", nlh->nlmsg_seq,
+                      strerror(-err->error));
+                if (ret == 0) ret = err->error;
             }
         }
-    } while (bytesread > 0);
+    }
 
-    return 0;
+    releaseRouteSocket(sock);
+    mBuffer.clear();
+    mTypes.clear();
+    mCount = 0;
+    return ret;
 }
 
 int rtNetlinkFlush(uint16_t getAction, uint16_t deleteAction, const char* what,
@@ -164,28 +377,37 @@ int rtNetlinkFlush(uint16_t getAction, uint16_t deleteAction, const char* what,
         return -EINVAL;
     }
 
-    int writeSock = openNetlinkSocket(NETLINK_ROUTE);
-    if (writeSock < 0) {
-        return writeSock;
-    }
+    // Queue a delete for each matching object as the dump returns it, and send them in batched
+    // bursts rather than one request/ack round trip per object. A full routing table can outgrow
+    // the socket's send buffer, so don't let a burst get bigger than kFlushBatchBytes.
+    //
+    // A flush can race with something else deleting the same objects - for example, the kernel
+    // itself drops routes when an interface goes down - so a delete that finds its object already
+    // gone is not a failure.
+    NetlinkRequestBatch batch;
+    batch.tolerateMissing();
+
+    // As before the deletions were batched, a failed delete is logged but does not fail the
+    // flush; only a failed dump does.
+    auto flushBatch = [&batch, what] {
+        if (int err = batch.flush()) {
+            ALOGW("Flushing %s: %s", what, strerror(-err));
+        }
+    };
 
-    NetlinkDumpCallback callback = [writeSock, deleteAction, shouldDelete, what] (nlmsghdr *nlh) {
+    NetlinkDumpCallback callback = [&batch, &flushBatch, deleteAction,
+                                    shouldDelete](nlmsghdr* nlh) {
         if (!shouldDelete(nlh)) return;
 
-        nlh->nlmsg_type = deleteAction;
-        nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-        if (write(writeSock, nlh, nlh->nlmsg_len) == -1) {
-            ALOGE("Error writing flush request: %s", strerror(errno));
-            return;
-        }
-
-        int ret = recvNetlinkAck(writeSock);
-        // A flush works by dumping routes and deleting each route as it's returned, and it can
-        // fail if something else deletes the route between the dump and the delete. This can
-        // happen, for example, if an interface goes down while we're trying to flush its routes.
-        // So ignore ENOENT.
-        if (ret != 0 && ret != -ENOENT) {
-            ALOGW("Flushing %s: %s", what, strerror(-ret));
+        // The dumped payload (header struct plus attributes) identifies the object exactly, so it
+        // doubles as the delete request.
+        iovec iov[] = {
+            { nullptr,          0 },
+            { NLMSG_DATA(nlh),  nlh->nlmsg_len - NLMSG_HDRLEN },
+        };
+        batch.append(deleteAction, NETLINK_REQUEST_FLAGS, iov, ARRAY_SIZE(iov));
+        if (batch.byteSize() >= kFlushBatchBytes) {
+            flushBatch();
         }
     };
 
@@ -206,7 +428,8 @@ int rtNetlinkFlush(uint16_t getAction, uint16_t deleteAction, const char* what,
         }
     }
 
-    close(writeSock);
+    // Push whatever is still queued, including anything seen before a failed dump bailed out.
+    flushBatch();
 
     return ret;
 }
@@ -17,9 +17,13 @@
 #pragma once
 
 #include <functional>
+#include <vector>
+
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 
+#include <netdutils/DumpWriter.h>
+
 #include "NetdConstants.h"
 
 namespace android::net {
@@ -55,9 +59,60 @@ typedef std::function<bool(nlmsghdr *)> NetlinkDumpFilter;
 [[nodiscard]] int sendNetlinkRequest(uint16_t action, uint16_t flags, iovec* iov, int iovlen,
                                      const NetlinkDumpCallback* callback);
 
+// Same as above, but over an arbitrary netlink protocol (e.g. NETLINK_NETFILTER) instead of
+// NETLINK_ROUTE.
+[[nodiscard]] int sendNetlinkRequest(int protocol, uint16_t action, uint16_t flags, iovec* iov,
+                                     int iovlen, const NetlinkDumpCallback* callback);
+
 // Processes a netlink dump, passing every message to the specified |callback|.
 [[nodiscard]] int processNetlinkDump(int sock, const NetlinkDumpCallback& callback);
 
+// Accumulates rtnetlink requests and sends them to the kernel as one stream of messages in a
+// single syscall, followed by a single pass over the acks. This turns operations that program
+// many FIB rules (e.g. VPN bring-up with large UID ranges) from one request/ack round-trip per
+// rule into a handful of syscalls for the whole batch.
+//
+// Each appended request is serialized immediately, so the iovec contents need not outlive the
+// append() call. All requests are sent with NLM_F_ACK; flush() scans one ack per request and
+// returns the first error seen, so a batch has the same error surface as sending its requests
+// one at a time (but does not stop programming at the first failure).
+class NetlinkRequestBatch {
+  public:
+    // Appends a request to the batch. |iov| has the same layout as for sendNetlinkRequest():
+    // iov[0] is reserved for the header and the subsequent elements are the request contents.
+    void append(uint16_t action, uint16_t flags, const iovec* iov, int iovlen);
+
+    // Sends the accumulated requests and receives their acks. Returns 0 if every request
+    // succeeded, or the first nonzero kernel error (negative errno) otherwise. The batch is
+    // empty again when this returns, regardless of the result.
+    [[nodiscard]] int flush();
+
+    size_t size() const { return mCount; }
+
+    // Number of serialized bytes waiting to be sent. Callers queueing an unbounded number of
+    // requests (e.g. a table flush) use this to flush() in bounded bursts that fit comfortably in
+    // the socket's send buffer.
+    size_t byteSize() const { return mBuffer.size(); }
+
+    // Treat -EEXIST acks for add requests as success. Used when reconciling against kernel state
+    // that survived a netd restart: an add that finds an identical object already programmed has
+    // converged on the intended state rather than failed.
+    void tolerateExisting() { mTolerateExisting = true; }
+
+    // Treat -ENOENT acks for delete requests as success. Used by flushes, where an object can
+    // legitimately disappear between the dump and the delete (e.g. the kernel drops routes itself
+    // when an interface goes down).
+    void tolerateMissing() { mTolerateMissing = true; }
+
+  private:
+    std::vector<uint8_t> mBuffer;
+    // Message type of each request, indexed by sequence number - 1, for the stats counters.
+    std::vector<uint16_t> mTypes;
+    size_t mCount = 0;
+    bool mTolerateExisting = false;
+    bool mTolerateMissing = false;
+};
+
 // Flushes netlink objects that take an rtmsg structure (FIB rules, routes...). |getAction| and
 // |deleteAction| specify the netlink message types, e.g., RTM_GETRULE and RTM_DELRULE.
 // |shouldDelete| specifies whether a given object should be deleted or not. |what| is a
@@ -68,4 +123,11 @@ typedef std::function<bool(nlmsghdr *)> NetlinkDumpFilter;
 // Returns the value of the specific __u32 attribute, or 0 if the attribute was not present.
 uint32_t getRtmU32Attribute(const nlmsghdr *nlh, int attribute);
 
+// Records one netlink request of message type |type| and whether it failed. Lock-free (a fixed
+// table of relaxed atomics), so it is safe from any thread and adds no contention to the senders.
+void recordNetlinkStats(uint16_t type, bool isError);
+
+// Prints the accumulated per-message-type request/error totals.
+void dumpNetlinkStats(netdutils::DumpWriter& dw);
+
 }  // namespace android::net
@@ -14,11 +14,16 @@
  * limitations under the License.
  */
 
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/netfilter/nfnetlink_log.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <errno.h>
+
+#include <algorithm>
 
 #define LOG_TAG "Netd"
 
@@ -26,11 +31,13 @@
 
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
+#include <netdutils/Netlink.h>
 #include <netutils/ifc.h>
 #include <sysutils/NetlinkEvent.h>
 #include "Controllers.h"
 #include "NetlinkHandler.h"
 #include "NetlinkManager.h"
+#include "RateLimitedLog.h"
 #include "SockDiag.h"
 
 #include <charconv>
@@ -51,15 +58,16 @@
         res;                                                                    \
     })
 
+// Queues the callback for asynchronous per-listener dispatch so the netlink receive path
+// never blocks on a binder transaction. Arguments are captured by value.
 #define LOG_EVENT_FUNC(retry, func, ...)                                                    \
     do {                                                                                    \
-        const auto listenerMap = gCtls->eventReporter.getNetdUnsolicitedEventListenerMap(); \
-        for (auto& listener : listenerMap) {                                                \
+        gCtls->eventReporter.dispatchUnsolEvent([=](const auto& listener) {                 \
             auto entry = gUnsolicitedLog.newEntry().function(#func).args(__VA_ARGS__);      \
-            if (retry(listener.first->func(__VA_ARGS__))) {                                 \
+            if (retry(listener->func(__VA_ARGS__))) {                                       \
                 gUnsolicitedLog.log(entry.withAutomaticDuration());                         \
             }                                                                               \
-        }                                                                                   \
+        });                                                                                 \
     } while (0)
 
 namespace android {
@@ -68,21 +76,166 @@ namespace net {
 constexpr int RETRY_ATTEMPTS = 2;
 constexpr int RETRY_INTERVAL_MICRO_S = 100000;
 
-NetlinkHandler::NetlinkHandler(NetlinkManager *nm, int listenerSocket,
-                               int format) :
-                        NetlinkListener(listenerSocket, format) {
+NetlinkHandler::NetlinkHandler(NetlinkManager* nm, std::chrono::milliseconds coalescingWindow)
+    : mCoalescingWindow(coalescingWindow), mCurrentWindow(coalescingWindow) {
     mNm = nm;
+    if (mCoalescingWindow.count() > 0) {
+        mFlushThread = std::thread([this] { flushLoop(); });
+    }
 }
 
 NetlinkHandler::~NetlinkHandler() {
+    if (mFlushThread.joinable()) {
+        {
+            std::lock_guard guard(mCoalesceLock);
+            mRunning = false;
+        }
+        mCoalesceCv.notify_all();
+        mFlushThread.join();
+        // Deliver whatever was still staged so shutdown does not drop final states.
+        flushPendingChanges();
+    }
+}
+
+void NetlinkHandler::queueAddressChange(bool updated, std::string_view addr,
+                                        std::string_view ifName, int flags, int scope) {
+    if (mCoalescingWindow.count() == 0) {
+        if (updated) {
+            notifyAddressUpdated(addr, ifName, flags, scope);
+        } else {
+            notifyAddressRemoved(addr, ifName, flags, scope);
+        }
+        return;
+    }
+
+    std::lock_guard guard(mCoalesceLock);
+    mPendingAddressChanges[{std::string(ifName), std::string(addr)}] = {updated, flags, scope};
+    scheduleFlushLocked();
+}
+
+void NetlinkHandler::queueRouteChange(bool updated, std::string_view route,
+                                      std::string_view gateway, std::string_view ifName) {
+    if (mCoalescingWindow.count() == 0) {
+        notifyRouteChange(updated, route, gateway, ifName);
+        return;
+    }
+
+    std::lock_guard guard(mCoalesceLock);
+    mPendingRouteChanges[{std::string(route), std::string(ifName)}] = {updated,
+                                                                       std::string(gateway)};
+    scheduleFlushLocked();
+}
+
+void NetlinkHandler::queueDnsServerChange(std::string_view ifName, int64_t lifetime,
+                                          const std::vector<std::string>& servers) {
+    if (mCoalescingWindow.count() == 0) {
+        notifyInterfaceDnsServers(ifName, lifetime, servers);
+        return;
+    }
+
+    std::lock_guard guard(mCoalesceLock);
+    mPendingDnsServerChanges[{std::string(ifName), android::base::Join(servers, ',')}] = {
+            lifetime, servers};
+    scheduleFlushLocked();
+}
+
+void NetlinkHandler::scheduleFlushLocked() {
+    mEventsSinceFlush++;
+    if (!mFlushScheduled) {
+        // The window runs from the first staged change of a burst, so a sustained storm
+        // cannot postpone delivery indefinitely.
+        mFlushScheduled = true;
+        mFlushDeadline = std::chrono::steady_clock::now() + mCurrentWindow;
+        mCoalesceCv.notify_all();
+    }
 }
 
-int NetlinkHandler::start() {
-    return this->startListener();
+void NetlinkHandler::flushPendingChanges() {
+    std::map<std::pair<std::string, std::string>, AddressChange> addressChanges;
+    std::map<std::pair<std::string, std::string>, RouteChange> routeChanges;
+    std::map<std::pair<std::string, std::string>, DnsServerChange> dnsServerChanges;
+    {
+        std::lock_guard guard(mCoalesceLock);
+        mFlushScheduled = false;
+        addressChanges.swap(mPendingAddressChanges);
+        routeChanges.swap(mPendingRouteChanges);
+        dnsServerChanges.swap(mPendingDnsServerChanges);
+
+        const uint64_t staged = mEventsSinceFlush;
+        mEventsSinceFlush = 0;
+        mFlushCount++;
+        mEventsStaged += staged;
+        mNotificationsEmitted +=
+                addressChanges.size() + routeChanges.size() + dnsServerChanges.size();
+
+        // Adapt the window from the batch just collected: a window that merged a storm is
+        // probably mid-burst, so widen the next one to merge more of what follows; a window
+        // that merged next to nothing is charging sparse traffic latency for no benefit, so
+        // narrow back toward the configured floor.
+        if (staged >= kGrowEventsPerWindow) {
+            const auto ceiling = mCoalescingWindow * kMaxWindowMultiplier;
+            if (mCurrentWindow < ceiling) {
+                mCurrentWindow = std::min(mCurrentWindow * 2, ceiling);
+                mWindowGrowths++;
+            }
+        } else if (staged <= kShrinkEventsPerWindow && mCurrentWindow > mCoalescingWindow) {
+            mCurrentWindow = std::max(mCurrentWindow / 2, mCoalescingWindow);
+            mWindowShrinks++;
+        }
+    }
+
+    for (const auto& [key, change] : addressChanges) {
+        const auto& [ifName, addr] = key;
+        if (change.updated) {
+            notifyAddressUpdated(addr, ifName, change.flags, change.scope);
+        } else {
+            notifyAddressRemoved(addr, ifName, change.flags, change.scope);
+        }
+    }
+    for (const auto& [key, change] : routeChanges) {
+        const auto& [route, ifName] = key;
+        notifyRouteChange(change.updated, route, change.gateway, ifName);
+    }
+    for (const auto& [key, change] : dnsServerChanges) {
+        notifyInterfaceDnsServers(key.first, change.lifetime, change.servers);
+    }
 }
 
-int NetlinkHandler::stop() {
-    return this->stopListener();
+void NetlinkHandler::flushLoop() {
+    std::unique_lock lock(mCoalesceLock);
+    while (mRunning) {
+        mCoalesceCv.wait(lock, [this]() REQUIRES(mCoalesceLock) {
+            return !mRunning || mFlushScheduled;
+        });
+        if (!mRunning) return;
+        const auto deadline = mFlushDeadline;
+        if (mCoalesceCv.wait_until(lock, deadline,
+                                   [this]() REQUIRES(mCoalesceLock) { return !mRunning; })) {
+            return;
+        }
+        lock.unlock();
+        flushPendingChanges();
+        lock.lock();
+    }
+}
+
+void NetlinkHandler::dump(netdutils::DumpWriter& dw) {
+    std::lock_guard guard(mCoalesceLock);
+    dw.println("Netlink event coalescing:");
+    netdutils::ScopedIndent indentStats(dw);
+    if (mCoalescingWindow.count() == 0) {
+        dw.println("disabled");
+        return;
+    }
+    dw.println("window %lldms (floor %lldms, ceiling %lldms)",
+               static_cast<long long>(mCurrentWindow.count()),
+               static_cast<long long>(mCoalescingWindow.count()),
+               static_cast<long long>((mCoalescingWindow * kMaxWindowMultiplier).count()));
+    dw.println("%" PRIu64 " events merged into %" PRIu64 " notifications over %" PRIu64
+               " flushes",
+               mEventsStaged, mNotificationsEmitted, mFlushCount);
+    dw.println("window grew %" PRIu64 " times, shrank %" PRIu64 " times", mWindowGrowths,
+               mWindowShrinks);
 }
 
 static long parseIfIndex(const char* ifIndex) {
@@ -100,7 +253,7 @@ static long parseIfIndex(const char* ifIndex) {
 void NetlinkHandler::onEvent(NetlinkEvent *evt) {
     const char *subsys = evt->getSubsystem();
     if (!subsys) {
-        ALOGW("No subsystem found in netlink event");
+        ALOGW_RATELIMITED("No subsystem found in netlink event");
         return;
     }
 
@@ -110,6 +263,8 @@ void NetlinkHandler::onEvent(NetlinkEvent *evt) {
         if (action == NetlinkEvent::Action::kAdd) {
             notifyInterfaceAdded(iface);
         } else if (action == NetlinkEvent::Action::kRemove) {
+            // Keep XfrmController's tunnel interface cache honest before telling listeners.
+            XfrmController::onInterfaceRemoved(iface);
             notifyInterfaceRemoved(iface);
         } else if (action == NetlinkEvent::Action::kChange) {
             evt->dump();
@@ -133,7 +288,7 @@ void NetlinkHandler::onEvent(NetlinkEvent *evt) {
 
             long ifaceIndex = parseIfIndex(ifIndex);
             if (!ifaceIndex) {
-                ALOGE("invalid interface index: %s(%s)", iface, ifIndex);
+                ALOGE_RATELIMITED("invalid interface index: %s(%s)", iface, ifIndex);
             }
             const bool addrUpdated = (action == NetlinkEvent::Action::kAddressUpdated);
             if (addrUpdated) {
@@ -149,27 +304,28 @@ void NetlinkHandler::onEvent(NetlinkEvent *evt) {
                                 std::string_view(addrstr).starts_with("fe80:") ? ifaceIndex : 0;
                         int ret = sd.destroySockets(addrstr, destroyIfaceIndex);
                         if (ret < 0) {
-                            ALOGE("Error destroying sockets: %s", strerror(-ret));
+                            ALOGE_RATELIMITED("Error destroying sockets: %s", strerror(-ret));
                         }
                     } else {
-                        ALOGE("Error opening NETLINK_SOCK_DIAG socket: %s", strerror(errno));
+                        ALOGE_RATELIMITED("Error opening NETLINK_SOCK_DIAG socket: %s",
+                                          strerror(errno));
                     }
                 }
             }
             // Note: if this interface was deleted, iface is "" and we don't notify.
-            if (iface && iface[0] && address && flags && scope) {
-                if (addrUpdated) {
-                    notifyAddressUpdated(address, iface, std::stoi(flags), std::stoi(scope));
-                } else {
-                    notifyAddressRemoved(address, iface, std::stoi(flags), std::stoi(scope));
-                }
+            int flagsValue;
+            int scopeValue;
+            if (iface && iface[0] && address && flags && scope &&
+                android::base::ParseInt(flags, &flagsValue) &&
+                android::base::ParseInt(scope, &scopeValue)) {
+                queueAddressChange(addrUpdated, address, iface, flagsValue, scopeValue);
             }
         } else if (action == NetlinkEvent::Action::kRdnss) {
             const char *lifetime = evt->findParam("LIFETIME");
             const char *servers = evt->findParam("SERVERS");
             if (lifetime && servers) {
-                notifyInterfaceDnsServers(iface, strtol(lifetime, nullptr, 10),
-                                          android::base::Split(servers, ","));
+                queueDnsServerChange(iface, strtol(lifetime, nullptr, 10),
+                                     android::base::Split(servers, ","));
             }
         } else if (action == NetlinkEvent::Action::kRouteUpdated ||
                    action == NetlinkEvent::Action::kRouteRemoved) {
@@ -177,9 +333,9 @@ void NetlinkHandler::onEvent(NetlinkEvent *evt) {
             const char *gateway = evt->findParam("GATEWAY");
             const char *iface = evt->findParam("INTERFACE");
             if (route && (gateway || iface)) {
-                notifyRouteChange((action == NetlinkEvent::Action::kRouteUpdated) ? true : false,
-                                  route, (gateway == nullptr) ? "" : gateway,
-                                  (iface == nullptr) ? "" : iface);
+                queueRouteChange((action == NetlinkEvent::Action::kRouteUpdated) ? true : false,
+                                 route, (gateway == nullptr) ? "" : gateway,
+                                 (iface == nullptr) ? "" : iface);
             }
         }
 
@@ -190,13 +346,6 @@ void NetlinkHandler::onEvent(NetlinkEvent *evt) {
             notifyQuotaLimitReached(alertName, iface);
         }
 
-    } else if (!strcmp(subsys, "strict")) {
-        const char *uid = evt->findParam("UID");
-        const char *hex = evt->findParam("HEX");
-        if (uid && hex) {
-            notifyStrictCleartext(strtol(uid, nullptr, 10), hex);
-        }
-
     } else if (!strcmp(subsys, "xt_idletimer")) {
         const char *label = evt->findParam("INTERFACE");
         const char *state = evt->findParam("STATE");
@@ -224,25 +373,31 @@ void NetlinkHandler::onEvent(NetlinkEvent *evt) {
     }
 }
 
-void NetlinkHandler::notifyInterfaceAdded(const std::string& ifName) {
-    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceAdded, ifName);
+void NetlinkHandler::notifyInterfaceAdded(std::string_view ifName) {
+    const std::string iface(ifName);
+    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceAdded, iface);
 }
 
-void NetlinkHandler::notifyInterfaceRemoved(const std::string& ifName) {
-    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceRemoved, ifName);
+void NetlinkHandler::notifyInterfaceRemoved(std::string_view ifName) {
+    const std::string iface(ifName);
+    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceRemoved, iface);
 }
 
-void NetlinkHandler::notifyInterfaceChanged(const std::string& ifName, bool up) {
-    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceChanged, ifName, up);
+void NetlinkHandler::notifyInterfaceChanged(std::string_view ifName, bool up) {
+    const std::string iface(ifName);
+    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceChanged, iface, up);
 }
 
-void NetlinkHandler::notifyInterfaceLinkChanged(const std::string& ifName, bool up) {
-    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceLinkStateChanged, ifName, up);
+void NetlinkHandler::notifyInterfaceLinkChanged(std::string_view ifName, bool up) {
+    const std::string iface(ifName);
+    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceLinkStateChanged, iface, up);
 }
 
-void NetlinkHandler::notifyQuotaLimitReached(const std::string& labelName,
-                                             const std::string& ifName) {
-    LOG_EVENT_FUNC(BINDER_RETRY, onQuotaLimitReached, labelName, ifName);
+void NetlinkHandler::notifyQuotaLimitReached(std::string_view labelName,
+                                             std::string_view ifName) {
+    const std::string label(labelName);
+    const std::string iface(ifName);
+    LOG_EVENT_FUNC(BINDER_RETRY, onQuotaLimitReached, label, iface);
 }
 
 void NetlinkHandler::notifyInterfaceClassActivityChanged(int label, bool isActive,
@@ -250,28 +405,67 @@ void NetlinkHandler::notifyInterfaceClassActivityChanged(int label, bool isActiv
     LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceClassActivityChanged, isActive, label, timestamp, uid);
 }
 
-void NetlinkHandler::notifyAddressUpdated(const std::string& addr, const std::string& ifName,
+void NetlinkHandler::notifyAddressUpdated(std::string_view addr, std::string_view ifName,
                                           int flags, int scope) {
-    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceAddressUpdated, addr, ifName, flags, scope);
+    const std::string address(addr);
+    const std::string iface(ifName);
+    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceAddressUpdated, address, iface, flags, scope);
 }
 
-void NetlinkHandler::notifyAddressRemoved(const std::string& addr, const std::string& ifName,
+void NetlinkHandler::notifyAddressRemoved(std::string_view addr, std::string_view ifName,
                                           int flags, int scope) {
-    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceAddressRemoved, addr, ifName, flags, scope);
+    const std::string address(addr);
+    const std::string iface(ifName);
+    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceAddressRemoved, address, iface, flags, scope);
 }
 
-void NetlinkHandler::notifyInterfaceDnsServers(const std::string& ifName, int64_t lifetime,
+void NetlinkHandler::notifyInterfaceDnsServers(std::string_view ifName, int64_t lifetime,
                                                const std::vector<std::string>& servers) {
-    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceDnsServerInfo, ifName, lifetime, servers);
+    const std::string iface(ifName);
+    LOG_EVENT_FUNC(BINDER_RETRY, onInterfaceDnsServerInfo, iface, lifetime, servers);
 }
 
-void NetlinkHandler::notifyRouteChange(bool updated, const std::string& route,
-                                       const std::string& gateway, const std::string& ifName) {
-    LOG_EVENT_FUNC(BINDER_RETRY, onRouteChanged, updated, route, gateway, ifName);
+void NetlinkHandler::notifyRouteChange(bool updated, std::string_view route,
+                                       std::string_view gateway, std::string_view ifName) {
+    const std::string routeStr(route);
+    const std::string gatewayStr(gateway);
+    const std::string iface(ifName);
+    LOG_EVENT_FUNC(BINDER_RETRY, onRouteChanged, updated, routeStr, gatewayStr, iface);
 }
 
-void NetlinkHandler::notifyStrictCleartext(uid_t uid, const std::string& hex) {
-    LOG_EVENT_FUNC(BINDER_RETRY, onStrictCleartextDetected, uid, hex);
+netdutils::Status NetlinkHandler::subscribeStrictCleartext(NFLogListenerInterface* listener) {
+    // Listeners only inspect the transport headers of an offending packet; 256 bytes matches
+    // the cap the old dedicated-socket path applied when hex-encoding the payload, and keeps
+    // the kernel from copying full packets.
+    constexpr uint32_t kStrictCopyRange = 256;
+
+    const auto msgHandler = [](const nlmsghdr&, const nfgenmsg&, const netdutils::Slice msg) {
+        int32_t uid = -1;
+        std::string hex;
+        const auto attrHandler = [&uid, &hex](const nlattr attr, const netdutils::Slice payload) {
+            switch (attr.nla_type) {
+                case NFULA_UID:
+                    extract(payload, uid);
+                    uid = ntohl(uid);
+                    break;
+                case NFULA_PAYLOAD: {
+                    static const char kHexChars[] = "0123456789abcdef";
+                    const uint8_t* data = payload.base();
+                    hex.reserve(payload.size() * 2);
+                    for (size_t i = 0; i < payload.size(); i++) {
+                        hex += kHexChars[data[i] >> 4];
+                        hex += kHexChars[data[i] & 0xf];
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        };
+        forEachNetlinkAttribute(msg, attrHandler);
+        LOG_EVENT_FUNC(BINDER_RETRY, onStrictCleartextDetected, uid, hex);
+    };
+    return listener->subscribe(NetlinkManager::NFLOG_STRICT_GROUP, kStrictCopyRange, msgHandler);
 }
 
 }  // namespace net
@@ -17,45 +17,139 @@
 #ifndef _NETLINKHANDLER_H
 #define _NETLINKHANDLER_H
 
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include <android-base/thread_annotations.h>
+#include <netdutils/DumpWriter.h>
 #include <sysutils/NetlinkEvent.h>
-// TODO: stop depending on sysutils/NetlinkListener.h
-#include <sysutils/NetlinkListener.h>
+#include "NFLogListener.h"
 #include "NetlinkManager.h"
 
 namespace android {
 namespace net {
 
-class NetlinkHandler : public ::NetlinkListener {
+class NetlinkHandler {
     NetlinkManager *mNm;
 
 public:
-    NetlinkHandler(NetlinkManager *nm, int listenerSocket, int format);
+    // How long address, route and RDNSS churn is merged before notifying listeners. Wi-Fi
+    // roams and RA bursts deliver hundreds of RTM_NEWADDR/RTM_NEWROUTE/RDNSS messages;
+    // listeners only need the final state per (interface, address), per (route, interface)
+    // and per (interface, server set). A window of zero disables coalescing.
+    static constexpr std::chrono::milliseconds kDefaultCoalescingWindow{10};
+
+    // Bounds of the adaptive window. The configured window is the floor, so an idle device pays
+    // at most that much extra notification latency. Each flush that merged at least
+    // kGrowEventsPerWindow raw events doubles the window (up to kMaxWindowMultiplier times the
+    // floor) on the theory that the burst is still in progress; each flush that merged no more
+    // than kShrinkEventsPerWindow halves it back toward the floor, so the extra latency decays
+    // as soon as the storm ends.
+    static constexpr int kMaxWindowMultiplier = 16;
+    static constexpr uint64_t kGrowEventsPerWindow = 32;
+    static constexpr uint64_t kShrinkEventsPerWindow = 4;
+
+    explicit NetlinkHandler(NetlinkManager* nm,
+                            std::chrono::milliseconds coalescingWindow = kDefaultCoalescingWindow);
     virtual ~NetlinkHandler();
 
-    int start();
-    int stop();
+    // Prints the current coalescing window, its bounds, and the merge ratio achieved since
+    // start, for "dumpsys netd".
+    void dump(netdutils::DumpWriter& dw);
 
-  protected:
-    virtual void onEvent(NetlinkEvent *evt);
+    // Called by NetlinkManager's reactor for every event decoded from this handler's socket.
+    void onEvent(NetlinkEvent *evt);
+
+    // Routes strict-mode cleartext notifications (NFLOG_STRICT_GROUP) through |listener|'s
+    // shared NFLOG socket instead of a dedicated one, so every NFLOG group netd consumes costs
+    // the kernel a single delivery per logged packet. Dispatch functions run on the listener's
+    // service thread; the binder fan-out itself is still asynchronous.
+    static netdutils::Status subscribeStrictCleartext(NFLogListenerInterface* listener);
 
-    void notifyInterfaceAdded(const std::string& ifName);
-    void notifyInterfaceRemoved(const std::string& ifName);
-    void notifyInterfaceChanged(const std::string& ifName, bool isUp);
-    void notifyInterfaceLinkChanged(const std::string& ifName, bool isUp);
-    void notifyQuotaLimitReached(const std::string& labelName, const std::string& ifName);
+  protected:
+    // The notify helpers take string_views slicing the original receive buffer; std::strings
+    // are only materialized here, at the binder boundary.
+    void notifyInterfaceAdded(std::string_view ifName);
+    void notifyInterfaceRemoved(std::string_view ifName);
+    void notifyInterfaceChanged(std::string_view ifName, bool isUp);
+    void notifyInterfaceLinkChanged(std::string_view ifName, bool isUp);
+    void notifyQuotaLimitReached(std::string_view labelName, std::string_view ifName);
     void notifyInterfaceClassActivityChanged(int label, bool isActive, int64_t timestamp, int uid);
-    void notifyAddressUpdated(const std::string& addr, const std::string& ifName, int flags,
+    void notifyAddressUpdated(std::string_view addr, std::string_view ifName, int flags,
                               int scope);
-    void notifyAddressRemoved(const std::string& addr, const std::string& ifName, int flags,
+    void notifyAddressRemoved(std::string_view addr, std::string_view ifName, int flags,
                               int scope);
-    void notifyInterfaceDnsServers(const std::string& ifName, int64_t lifetime,
+    void notifyInterfaceDnsServers(std::string_view ifName, int64_t lifetime,
                                    const std::vector<std::string>& servers);
-    void notifyRouteChange(bool updated, const std::string& route, const std::string& gateway,
-                           const std::string& ifName);
-    void notifyStrictCleartext(uid_t uid, const std::string& hex);
+    void notifyRouteChange(bool updated, std::string_view route, std::string_view gateway,
+                           std::string_view ifName);
+
+  private:
+    // Last observed state of a coalesced address change. updated == false means removed.
+    struct AddressChange {
+        bool updated;
+        int flags;
+        int scope;
+    };
+    // Last observed state of a coalesced route change. updated == false means removed.
+    struct RouteChange {
+        bool updated;
+        std::string gateway;
+    };
+    // Last observed state of a coalesced RDNSS advertisement.
+    struct DnsServerChange {
+        int64_t lifetime;
+        std::vector<std::string> servers;
+    };
+
+    // Stages a change and arms the flush timer. Only the binder fan-out is deferred; local
+    // state (NetworkController, socket destruction) is updated synchronously in onEvent.
+    void queueAddressChange(bool updated, std::string_view addr, std::string_view ifName,
+                            int flags, int scope);
+    void queueRouteChange(bool updated, std::string_view route, std::string_view gateway,
+                          std::string_view ifName);
+    void queueDnsServerChange(std::string_view ifName, int64_t lifetime,
+                              const std::vector<std::string>& servers);
+    void scheduleFlushLocked() REQUIRES(mCoalesceLock);
+    // Emits the final state of everything staged and clears the stage.
+    void flushPendingChanges();
+    void flushLoop();
+
+    const std::chrono::milliseconds mCoalescingWindow;
+    std::mutex mCoalesceLock;
+    std::condition_variable mCoalesceCv;
+    bool mRunning GUARDED_BY(mCoalesceLock) = true;
+    bool mFlushScheduled GUARDED_BY(mCoalesceLock) = false;
+    std::chrono::steady_clock::time_point mFlushDeadline GUARDED_BY(mCoalesceLock);
+    // The window currently in force, adapted per flush between mCoalescingWindow and
+    // mCoalescingWindow * kMaxWindowMultiplier.
+    std::chrono::milliseconds mCurrentWindow GUARDED_BY(mCoalesceLock);
+    uint64_t mEventsSinceFlush GUARDED_BY(mCoalesceLock) = 0;
+    uint64_t mEventsStaged GUARDED_BY(mCoalesceLock) = 0;
+    uint64_t mNotificationsEmitted GUARDED_BY(mCoalesceLock) = 0;
+    uint64_t mFlushCount GUARDED_BY(mCoalesceLock) = 0;
+    uint64_t mWindowGrowths GUARDED_BY(mCoalesceLock) = 0;
+    uint64_t mWindowShrinks GUARDED_BY(mCoalesceLock) = 0;
+    // Keyed by (interface, address) and (route, interface) respectively; overwriting an entry
+    // is what merges a burst down to its final state.
+    std::map<std::pair<std::string, std::string>, AddressChange> mPendingAddressChanges
+            GUARDED_BY(mCoalesceLock);
+    std::map<std::pair<std::string, std::string>, RouteChange> mPendingRouteChanges
+            GUARDED_BY(mCoalesceLock);
+    // Keyed by (interface, joined server list), so a router re-advertising the same RDNSS set
+    // throughout a burst collapses to one notification while distinct sets all get delivered.
+    std::map<std::pair<std::string, std::string>, DnsServerChange> mPendingDnsServerChanges
+            GUARDED_BY(mCoalesceLock);
+    std::thread mFlushThread;
 };
 
 }  // namespace net
@@ -32,7 +32,6 @@
 #include <log/log.h>
 
 #include <linux/netfilter/nfnetlink.h>
-#include <linux/netfilter/nfnetlink_log.h>
 #include <linux/netfilter/nfnetlink_compat.h>
 
 #include <arpa/inet.h>
@@ -40,13 +39,11 @@
 #include "NetlinkManager.h"
 #include "NetlinkHandler.h"
 
-#include "pcap-netfilter-linux-android.h"
-
 namespace android {
 namespace net {
 
 const int NetlinkManager::NFLOG_QUOTA_GROUP = 1;
-const int NetlinkManager::NETFILTER_STRICT_GROUP = 2;
+const int NetlinkManager::NFLOG_STRICT_GROUP = 0;
 const int NetlinkManager::NFLOG_WAKEUP_GROUP = 3;
 
 NetlinkManager *NetlinkManager::sInstance = nullptr;
@@ -59,13 +56,22 @@ NetlinkManager *NetlinkManager::Instance() {
 
 NetlinkManager::NetlinkManager() {
     mBroadcaster = nullptr;
+    mUeventHandler = nullptr;
+    mRouteHandler = nullptr;
+    mQuotaHandler = nullptr;
 }
 
 NetlinkManager::~NetlinkManager() {
 }
 
+void NetlinkManager::dump(netdutils::DumpWriter& dw) {
+    if (mRouteHandler) {
+        mRouteHandler->dump(dw);
+    }
+}
+
 NetlinkHandler *NetlinkManager::setupSocket(int *sock, int netlinkFamily,
-    int groups, int format, bool configNflog) {
+    int groups, int format) {
 
     struct sockaddr_nl nladdr;
     int sz = 64 * 1024;
@@ -104,34 +110,15 @@ NetlinkHandler *NetlinkManager::setupSocket(int *sock, int netlinkFamily,
         return nullptr;
     }
 
-    if (configNflog) {
-        if (android_nflog_send_config_cmd(*sock, 0, NFULNL_CFG_CMD_PF_UNBIND, AF_INET) < 0) {
-            ALOGE("Failed NFULNL_CFG_CMD_PF_UNBIND: %s", strerror(errno));
-            return nullptr;
-        }
-        if (android_nflog_send_config_cmd(*sock, 0, NFULNL_CFG_CMD_PF_BIND, AF_INET) < 0) {
-            ALOGE("Failed NFULNL_CFG_CMD_PF_BIND: %s", strerror(errno));
-            return nullptr;
-        }
-        if (android_nflog_send_config_cmd(*sock, 0, NFULNL_CFG_CMD_BIND, AF_UNSPEC) < 0) {
-            ALOGE("Failed NFULNL_CFG_CMD_BIND: %s", strerror(errno));
-            return nullptr;
-        }
-    }
-
-    NetlinkHandler *handler = new NetlinkHandler(this, *sock, format);
-    if (handler->start()) {
-        ALOGE("Unable to start NetlinkHandler: %s", strerror(errno));
-        close(*sock);
-        return nullptr;
-    }
+    NetlinkHandler *handler = new NetlinkHandler(this);
+    mReactor.addSocket(*sock, netlinkFamily, format, handler);
 
     return handler;
 }
 
 int NetlinkManager::start() {
     if ((mUeventHandler = setupSocket(&mUeventSock, NETLINK_KOBJECT_UEVENT,
-         0xffffffff, NetlinkListener::NETLINK_FORMAT_ASCII, false)) == nullptr) {
+         0xffffffff, NetlinkListener::NETLINK_FORMAT_ASCII)) == nullptr) {
         return -1;
     }
 
@@ -141,32 +128,31 @@ int NetlinkManager::start() {
                                      RTMGRP_IPV6_IFADDR |
                                      RTMGRP_IPV6_ROUTE |
                                      (1 << (RTNLGRP_ND_USEROPT - 1)),
-         NetlinkListener::NETLINK_FORMAT_BINARY, false)) == nullptr) {
+         NetlinkListener::NETLINK_FORMAT_BINARY)) == nullptr) {
         return -1;
     }
 
     if ((mQuotaHandler = setupSocket(&mQuotaSock, NETLINK_NFLOG,
-            NFLOG_QUOTA_GROUP, NetlinkListener::NETLINK_FORMAT_BINARY, false)) == nullptr) {
+            NFLOG_QUOTA_GROUP, NetlinkListener::NETLINK_FORMAT_BINARY)) == nullptr) {
         ALOGW("Unable to open qlog quota socket, check if xt_quota2 can send via UeventHandler");
         // TODO: return -1 once the emulator gets a new kernel.
     }
 
-    if ((mStrictHandler = setupSocket(&mStrictSock, NETLINK_NETFILTER,
-            0, NetlinkListener::NETLINK_FORMAT_BINARY_UNICAST, true)) == nullptr) {
-        ALOGE("Unable to open strict socket");
-        // TODO: return -1 once the emulator gets a new kernel.
+    // NFLOG_STRICT_GROUP is not bound here: strict cleartext messages arrive on the shared
+    // NFLOG socket owned by NFLogListener, alongside NFLOG_WAKEUP_GROUP. One socket per logged
+    // packet family keeps kernel-side delivery work constant as more features subscribe.
+
+    if (mReactor.start()) {
+        ALOGE("Unable to start netlink reactor: %s", strerror(errno));
+        return -1;
     }
 
     return 0;
 }
 
 int NetlinkManager::stop() {
-    int status = 0;
-
-    if (mUeventHandler->stop()) {
-        ALOGE("Unable to stop uevent NetlinkHandler: %s", strerror(errno));
-        status = -1;
-    }
+    // Stop dispatching before tearing down the handlers and sockets.
+    int status = mReactor.stop();
 
     delete mUeventHandler;
     mUeventHandler = nullptr;
@@ -174,11 +160,6 @@ int NetlinkManager::stop() {
     close(mUeventSock);
     mUeventSock = -1;
 
-    if (mRouteHandler->stop()) {
-        ALOGE("Unable to stop route NetlinkHandler: %s", strerror(errno));
-        status = -1;
-    }
-
     delete mRouteHandler;
     mRouteHandler = nullptr;
 
@@ -186,11 +167,6 @@ int NetlinkManager::stop() {
     mRouteSock = -1;
 
     if (mQuotaHandler) {
-        if (mQuotaHandler->stop()) {
-            ALOGE("Unable to stop quota NetlinkHandler: %s", strerror(errno));
-            status = -1;
-        }
-
         delete mQuotaHandler;
         mQuotaHandler = nullptr;
 
@@ -198,19 +174,6 @@ int NetlinkManager::stop() {
         mQuotaSock = -1;
     }
 
-    if (mStrictHandler) {
-        if (mStrictHandler->stop()) {
-            ALOGE("Unable to stop strict NetlinkHandler: %s", strerror(errno));
-            status = -1;
-        }
-
-        delete mStrictHandler;
-        mStrictHandler = nullptr;
-
-        close(mStrictSock);
-        mStrictSock = -1;
-    }
-
     return status;
 }
 
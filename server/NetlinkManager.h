@@ -17,9 +17,15 @@
 #ifndef _NETLINKMANAGER_H
 #define _NETLINKMANAGER_H
 
+#include <functional>
+#include <utility>
+
+#include <netdutils/DumpWriter.h>
 #include <sysutils/SocketListener.h>
 #include <sysutils/NetlinkListener.h>
 
+#include "NetlinkReactor.h"
+
 namespace android {
 namespace net {
 
@@ -34,11 +40,11 @@ private:
     NetlinkHandler       *mUeventHandler;
     NetlinkHandler       *mRouteHandler;
     NetlinkHandler       *mQuotaHandler;
-    NetlinkHandler       *mStrictHandler;
     int                  mUeventSock;
     int                  mRouteSock;
     int                  mQuotaSock;
-    int                  mStrictSock;
+    // One epoll thread drives all of the sockets above.
+    NetlinkReactor       mReactor;
 
 public:
     virtual ~NetlinkManager();
@@ -46,22 +52,32 @@ public:
     int start();
     int stop();
 
+    // Prints the route handler's event coalescing state; the uevent and quota handlers never
+    // stage coalesced events, so only the RTNETLINK socket is worth reporting.
+    void dump(netdutils::DumpWriter& dw);
+
     void setBroadcaster(SocketListener *sl) { mBroadcaster = sl; }
     SocketListener *getBroadcaster() { return mBroadcaster; }
 
+    // Installs the callback the reactor invokes when one of the sockets overflows and drops
+    // events; the NETLINK_* family of the overflowed socket is passed so consumers can resync
+    // just that event stream. Must be called before start().
+    void setOverflowHandler(std::function<void(int netlinkFamily)> handler) {
+        mReactor.setOverflowHandler(std::move(handler));
+    }
+
     static NetlinkManager *Instance();
 
     /* Group used by xt_quota2 */
     static const int NFLOG_QUOTA_GROUP;
-    /* Group used by StrictController rules */
-    static const int NETFILTER_STRICT_GROUP;
+    /* Group used by StrictController rules; delivered via the shared NFLogListener socket */
+    static const int NFLOG_STRICT_GROUP;
     /* Group used by WakeupController rules */
     static const int NFLOG_WAKEUP_GROUP;
 
 private:
     NetlinkManager();
-    NetlinkHandler* setupSocket(int *sock, int netlinkFamily, int groups,
-        int format, bool configNflog);
+    NetlinkHandler* setupSocket(int *sock, int netlinkFamily, int groups, int format);
 };
 
 }  // namespace net
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <utility>
+
+#define LOG_TAG "Netd"
+
+#include <log/log.h>
+
+#include <cutils/uevent.h>
+#include <sysutils/NetlinkEvent.h>
+#include <sysutils/NetlinkListener.h>
+
+#include "NetlinkHandler.h"
+#include "NetlinkReactor.h"
+
+namespace android {
+namespace net {
+
+namespace {
+
+// Maximum number of epoll events handled per wakeup. Larger bursts are picked up by the next
+// epoll_wait() call.
+constexpr int kMaxEvents = 8;
+
+// Maximum messages drained from one socket per epoll event, so one flooding socket cannot
+// starve the others; anything left is re-reported by the next (level-triggered) epoll_wait().
+constexpr int kMaxReadsPerEvent = 64;
+
+}  // namespace
+
+NetlinkReactor::NetlinkReactor() {}
+
+NetlinkReactor::~NetlinkReactor() {
+    stop();
+}
+
+void NetlinkReactor::addSocket(int sock, int netlinkFamily, int format, NetlinkHandler* handler) {
+    mRegistrations.push_back({sock, netlinkFamily, format, handler,
+                              std::chrono::steady_clock::time_point::min()});
+}
+
+void NetlinkReactor::setOverflowHandler(std::function<void(int)> handler) {
+    mOverflowHandler = std::move(handler);
+}
+
+int NetlinkReactor::start() {
+    if (mThread.joinable()) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    mEpollFd.reset(epoll_create1(EPOLL_CLOEXEC));
+    if (mEpollFd < 0) {
+        ALOGE("Unable to create netlink reactor epoll fd: %s", strerror(errno));
+        return -1;
+    }
+
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) == -1) {
+        ALOGE("Unable to create netlink reactor wakeup pipe: %s", strerror(errno));
+        mEpollFd.reset();
+        return -1;
+    }
+    mWakeupReadFd.reset(pipeFds[0]);
+    mWakeupWriteFd.reset(pipeFds[1]);
+
+    // A null data pointer identifies the wakeup pipe in the event loop.
+    epoll_event ev = {.events = EPOLLIN, .data = {.ptr = nullptr}};
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeupReadFd, &ev) == -1) {
+        ALOGE("Unable to watch netlink reactor wakeup pipe: %s", strerror(errno));
+        mWakeupWriteFd.reset();
+        mWakeupReadFd.reset();
+        mEpollFd.reset();
+        return -1;
+    }
+    for (Registration& reg : mRegistrations) {
+        // Non-blocking from here on: registration-time setup (e.g. the NFLOG config handshake)
+        // is done, and the drain loop below needs recv to return EAGAIN at an empty queue.
+        if (fcntl(reg.sock, F_SETFL, fcntl(reg.sock, F_GETFL) | O_NONBLOCK) == -1) {
+            ALOGE("Unable to set netlink socket %d non-blocking: %s", reg.sock, strerror(errno));
+        }
+        ev.data.ptr = &reg;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, reg.sock, &ev) == -1) {
+            ALOGE("Unable to watch netlink socket %d: %s", reg.sock, strerror(errno));
+            mWakeupWriteFd.reset();
+            mWakeupReadFd.reset();
+            mEpollFd.reset();
+            return -1;
+        }
+    }
+
+    mThread = std::thread([this] { reactorLoop(); });
+    return 0;
+}
+
+int NetlinkReactor::stop() {
+    if (!mThread.joinable()) {
+        return 0;
+    }
+
+    const char byte = 0;
+    TEMP_FAILURE_RETRY(write(mWakeupWriteFd, &byte, sizeof(byte)));
+    mThread.join();
+
+    mWakeupWriteFd.reset();
+    mWakeupReadFd.reset();
+    mEpollFd.reset();
+    mRegistrations.clear();
+    return 0;
+}
+
+void NetlinkReactor::reactorLoop() {
+    while (true) {
+        epoll_event events[kMaxEvents];
+        int numEvents = TEMP_FAILURE_RETRY(epoll_wait(mEpollFd, events, kMaxEvents, -1));
+        if (numEvents == -1) {
+            ALOGE("epoll_wait failed in netlink reactor: %s", strerror(errno));
+            return;
+        }
+        for (int i = 0; i < numEvents; i++) {
+            if (events[i].data.ptr == nullptr) {
+                // Woken up by stop().
+                return;
+            }
+            processSocket(*static_cast<Registration*>(events[i].data.ptr));
+        }
+    }
+}
+
+void NetlinkReactor::processSocket(Registration& reg) {
+    // Unicast sockets receive messages addressed to our pid, which carry no multicast group.
+    const bool requireGroup = (reg.format != NetlinkListener::NETLINK_FORMAT_BINARY_UNICAST);
+
+    // Drain the socket rather than taking one message per epoll round trip: under churn this
+    // empties the receive queue while it is under pressure, which is the cheapest way to avoid
+    // the next overflow.
+    for (int reads = 0; reads < kMaxReadsPerEvent; reads++) {
+        uid_t uid = -1;
+        ssize_t count = TEMP_FAILURE_RETRY(
+                uevent_kernel_recv(reg.sock, mBuffer, sizeof(mBuffer), requireGroup, &uid));
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if (errno == ENOBUFS) {
+                // The receive queue overflowed and an unknown number of events is gone. Grow
+                // the buffer and tell consumers so they resync this stream; the queued
+                // messages that survived are still readable, so keep draining.
+                handleOverflow(reg);
+                continue;
+            }
+            ALOGE("recvmsg failed on netlink socket %d (%s)", reg.sock, strerror(errno));
+            return;
+        }
+
+        NetlinkEvent evt;
+        if (evt.decode(mBuffer, count, reg.format)) {
+            reg.handler->onEvent(&evt);
+        } else if (reg.format != NetlinkListener::NETLINK_FORMAT_BINARY) {
+            // Binary messages are decoded on a best-effort basis; uninteresting message types
+            // fail to decode and that is expected.
+            ALOGE("Error decoding NetlinkEvent");
+        }
+    }
+}
+
+void NetlinkReactor::handleOverflow(Registration& reg) {
+    int rcvBuf = 0;
+    socklen_t optlen = sizeof(rcvBuf);
+    if (getsockopt(reg.sock, SOL_SOCKET, SO_RCVBUF, &rcvBuf, &optlen) == 0 &&
+        rcvBuf < kMaxRcvBufSize) {
+        // getsockopt reports the kernel's doubled accounting value; asking for that value again
+        // doubles the effective buffer. SO_RCVBUFFORCE needs CAP_NET_ADMIN in the root
+        // namespace, so fall back to SO_RCVBUF like setupSocket() does.
+        if (setsockopt(reg.sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvBuf, sizeof(rcvBuf)) == 0 ||
+            setsockopt(reg.sock, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf)) == 0) {
+            ALOGW("netlink socket %d (family %d) overflowed, growing receive buffer to %d",
+                  reg.sock, reg.netlinkFamily, rcvBuf * 2);
+        }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (mOverflowHandler && now - reg.lastOverflowNotify >= kOverflowNotifyInterval) {
+        reg.lastOverflowNotify = now;
+        mOverflowHandler(reg.netlinkFamily);
+    }
+}
+
+}  // namespace net
+}  // namespace android
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NETLINKREACTOR_H
+#define _NETLINKREACTOR_H
+
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+namespace android {
+namespace net {
+
+class NetlinkHandler;
+
+// Single-threaded epoll reactor driving all of NetlinkManager's netlink sockets.
+//
+// Each socket used to get its own NetlinkListener thread blocking in recv(). One thread
+// waiting in epoll_wait() serves the same event streams with a single stack and a single
+// receive buffer, and handles bursts on every socket with the same semantics: messages
+// queue in the socket's receive buffer until the reactor gets to them.
+class NetlinkReactor {
+  public:
+    NetlinkReactor();
+    ~NetlinkReactor();
+
+    // Registers |handler| to receive events decoded from |sock| using the given
+    // NetlinkListener::NETLINK_FORMAT_* format. |netlinkFamily| is the socket's NETLINK_*
+    // protocol, reported to the overflow handler so consumers know which event stream lost
+    // messages. The caller retains ownership of the socket and the handler and must keep both
+    // alive until stop() returns.
+    // Must not be called after start().
+    void addSocket(int sock, int netlinkFamily, int format, NetlinkHandler* handler);
+
+    // Installs a callback invoked (from the reactor thread, at most once per
+    // kOverflowNotifyInterval per socket) when a socket's receive queue overflowed and events
+    // were dropped. Must not be called after start().
+    void setOverflowHandler(std::function<void(int netlinkFamily)> handler);
+
+    // Starts the reactor thread. Also switches every registered socket to non-blocking mode so
+    // the drain loop can stop cleanly at an empty queue. Returns 0 on success, -1 on failure.
+    int start();
+    // Wakes and joins the reactor thread and forgets all registrations. Returns 0.
+    int stop();
+
+    // Ceiling for adaptive receive buffer growth, in the kernel's (doubled) SO_RCVBUF
+    // accounting. Every overflow doubles the overflowed socket's buffer up to this bound, so a
+    // socket that keeps up stays at the small default while one that bursts earns headroom.
+    static constexpr int kMaxRcvBufSize = 2 * 1024 * 1024;
+    // Minimum spacing between overflow notifications per socket; sustained overflow otherwise
+    // turns into a binder storm aimed at the listeners trying to resync.
+    static constexpr std::chrono::seconds kOverflowNotifyInterval{1};
+
+  private:
+    struct Registration {
+        int sock;
+        int netlinkFamily;
+        int format;
+        NetlinkHandler* handler;
+        // Last time the overflow handler ran for this socket.
+        std::chrono::steady_clock::time_point lastOverflowNotify;
+    };
+
+    void reactorLoop();
+    void processSocket(Registration& reg);
+    // ENOBUFS recovery: doubles the socket's receive buffer (up to kMaxRcvBufSize) and tells
+    // the overflow handler which event stream dropped messages.
+    void handleOverflow(Registration& reg);
+
+    // Stable once start() has been called; epoll events carry pointers into this vector.
+    std::vector<Registration> mRegistrations;
+    std::function<void(int)> mOverflowHandler;
+    base::unique_fd mEpollFd;
+    base::unique_fd mWakeupReadFd;
+    base::unique_fd mWakeupWriteFd;
+    std::thread mThread;
+    // Receive buffer shared by all registered sockets; the reactor is single-threaded.
+    char mBuffer[64 * 1024] __attribute__((aligned(4)));
+};
+
+}  // namespace net
+}  // namespace android
+
+#endif
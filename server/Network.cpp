@@ -22,11 +22,120 @@
 #include "log/log.h"
 
 #include <android-base/strings.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <vector>
 
 namespace android {
 namespace net {
 
+namespace {
+
+// Class slab for Network instances. Networks are created and destroyed rarely but walked on
+// every per-UID network resolution, so they are carved out of shared slabs instead of being
+// scattered across the heap by the general-purpose allocator. Slots are large enough for the
+// biggest subclass and are recycled through an intrusive free list threaded through the free
+// slots themselves.
+constexpr size_t kSlotSize = 256;
+constexpr size_t kSlotsPerSlab = 32;
+
+struct Slab {
+    alignas(std::max_align_t) char bytes[kSlotSize * kSlotsPerSlab];
+};
+
+std::mutex gSlabLock;
+std::vector<std::unique_ptr<Slab>> gSlabs;
+void* gFreeSlots = nullptr;
+size_t gSlotsInUse = 0;
+
+bool isSlabSlot(void* ptr) {
+    for (const auto& slab : gSlabs) {
+        if (ptr >= slab->bytes && ptr < slab->bytes + sizeof(slab->bytes)) return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+void* Network::operator new(size_t size) {
+    if (size > kSlotSize) {
+        // A subclass outgrew the slot size; fall back rather than corrupting the slab.
+        return ::operator new(size);
+    }
+    std::lock_guard guard(gSlabLock);
+    if (gFreeSlots == nullptr) {
+        Slab* slab = gSlabs.emplace_back(std::make_unique<Slab>()).get();
+        // Thread the new slots onto the free list in reverse, so they are handed out in
+        // ascending address order.
+        for (size_t i = kSlotsPerSlab; i-- > 0;) {
+            void* slot = slab->bytes + i * kSlotSize;
+            *static_cast<void**>(slot) = gFreeSlots;
+            gFreeSlots = slot;
+        }
+    }
+    void* slot = gFreeSlots;
+    gFreeSlots = *static_cast<void**>(slot);
+    gSlotsInUse++;
+    return slot;
+}
+
+void Network::operator delete(void* ptr) {
+    if (ptr == nullptr) return;
+    std::lock_guard guard(gSlabLock);
+    if (!isSlabSlot(ptr)) {
+        ::operator delete(ptr);
+        return;
+    }
+    *static_cast<void**>(ptr) = gFreeSlots;
+    gFreeSlots = ptr;
+    gSlotsInUse--;
+}
+
+Network::SlabStats Network::getSlabStats() {
+    std::lock_guard guard(gSlabLock);
+    return {.slabs = gSlabs.size(),
+            .slotsInUse = gSlotsInUse,
+            .bytesReserved = gSlabs.size() * sizeof(Slab)};
+}
+
+UidRangeMap::iterator UidRangeMap::find(int32_t subPriority) {
+    return std::find_if(mEntries.begin(), mEntries.end(),
+                        [subPriority](const value_type& entry) {
+                            return entry.first == subPriority;
+                        });
+}
+
+UidRangeMap::const_iterator UidRangeMap::find(int32_t subPriority) const {
+    return std::find_if(mEntries.begin(), mEntries.end(),
+                        [subPriority](const value_type& entry) {
+                            return entry.first == subPriority;
+                        });
+}
+
+void UidRangeMap::emplace(int32_t subPriority, UidRanges uidRanges) {
+    const auto it = std::lower_bound(
+            mEntries.begin(), mEntries.end(), subPriority,
+            [](const value_type& entry, int32_t key) { return entry.first < key; });
+    if (it != mEntries.end() && it->first == subPriority) return;
+    mEntries.emplace(it, subPriority, std::move(uidRanges));
+}
+
+void UidRangeMap::erase(int32_t subPriority) {
+    const auto it = find(subPriority);
+    if (it != mEntries.end()) {
+        mEntries.erase(it);
+    }
+    if (mEntries.empty()) {
+        // Most networks never regain UID ranges once the last set is removed; hand the backing
+        // allocation back rather than holding it for the network's lifetime.
+        mEntries.shrink_to_fit();
+    }
+}
+
 Network::~Network() {
     if (!mInterfaces.empty()) {
         ALOGE("deleting network with netId %u without clearing its interfaces", mNetId);
@@ -38,18 +147,18 @@ unsigned Network::getNetId() const {
 }
 
 bool Network::hasInterface(const std::string& interface) const {
-    return mInterfaces.find(interface) != mInterfaces.end();
+    return std::binary_search(mInterfaces.begin(), mInterfaces.end(), interface);
 }
 
-const std::set<std::string>& Network::getInterfaces() const {
+const std::vector<std::string>& Network::getInterfaces() const {
     return mInterfaces;
 }
 
 int Network::clearInterfaces() {
     while (!mInterfaces.empty()) {
         // Make a copy of the string, so removeInterface() doesn't lose its parameter when it
-        // removes the string from the set.
-        std::string interface = *mInterfaces.begin();
+        // removes the string from the list.
+        std::string interface = mInterfaces.front();
         if (int ret = removeInterface(interface)) {
             return ret;
         }
@@ -96,12 +205,12 @@ bool Network::appliesToUser(uid_t uid, int32_t* subPriority) const {
     return false;
 }
 
-void Network::addToUidRangeMap(const UidRanges& uidRanges, int32_t subPriority) {
+void Network::addToUidRangeMap(UidRanges uidRanges, int32_t subPriority) {
     auto iter = mUidRangeMap.find(subPriority);
     if (iter != mUidRangeMap.end()) {
         iter->second.add(uidRanges);
     } else {
-        mUidRangeMap[subPriority] = uidRanges;
+        mUidRangeMap.emplace(subPriority, std::move(uidRanges));
     }
 }
 
@@ -117,6 +226,27 @@ void Network::removeFromUidRangeMap(const UidRanges& uidRanges, int32_t subPrior
     }
 }
 
+int Network::updateUsers(const UidRanges& newUidRanges, int32_t subPriority) {
+    UidRanges toRemove;
+    UidRanges toAdd;
+    auto iter = mUidRangeMap.find(subPriority);
+    UidRanges::diff(iter != mUidRangeMap.end() ? iter->second : UidRanges(), newUidRanges,
+                    &toRemove, &toAdd);
+
+    // addUsers()/removeUsers() update mUidRangeMap themselves.
+    if (!toAdd.empty()) {
+        if (int ret = addUsers(std::move(toAdd), subPriority)) {
+            return ret;
+        }
+    }
+    if (!toRemove.empty()) {
+        if (int ret = removeUsers(toRemove, subPriority)) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
 bool Network::canAddUidRanges(const UidRanges& uidRanges) const {
     if (uidRanges.overlapsSelf()) {
         ALOGE("uid range %s overlaps self", uidRanges.toString().c_str());
@@ -130,6 +260,20 @@ bool Network::isSecure() const {
     return mSecure;
 }
 
+void Network::insertInterface(const std::string& interface) {
+    const auto it = std::lower_bound(mInterfaces.begin(), mInterfaces.end(), interface);
+    if (it == mInterfaces.end() || *it != interface) {
+        mInterfaces.insert(it, interface);
+    }
+}
+
+void Network::eraseInterface(const std::string& interface) {
+    const auto it = std::lower_bound(mInterfaces.begin(), mInterfaces.end(), interface);
+    if (it != mInterfaces.end() && *it == interface) {
+        mInterfaces.erase(it);
+    }
+}
+
 Network::Network(unsigned netId, bool secure) : mNetId(netId), mSecure(secure) {}
 
 }  // namespace net
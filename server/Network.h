@@ -19,12 +19,44 @@
 #include "NetdConstants.h"
 #include "UidRanges.h"
 
-#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace android::net {
 
-typedef std::map<int32_t, UidRanges> UidRangeMap;
+// Maps each subsidiary priority to the UID ranges assigned at that priority. A drop-in for the
+// std::map this used to be, but stored as a flat vector sorted by sub-priority: a network
+// carries at most a handful of entries, and per-UID network resolution walks every entry of
+// every network, so keeping them in one contiguous block beats chasing tree nodes around the
+// heap. Lookup and insertion are linear, which is faster than a tree at these sizes anyway.
+class UidRangeMap {
+  public:
+    using value_type = std::pair<int32_t, UidRanges>;
+    using iterator = std::vector<value_type>::iterator;
+    using const_iterator = std::vector<value_type>::const_iterator;
+
+    UidRangeMap() = default;
+    UidRangeMap(std::initializer_list<value_type> init) {
+        for (const value_type& entry : init) emplace(entry.first, entry.second);
+    }
+
+    iterator begin() { return mEntries.begin(); }
+    iterator end() { return mEntries.end(); }
+    const_iterator begin() const { return mEntries.begin(); }
+    const_iterator end() const { return mEntries.end(); }
+    bool empty() const { return mEntries.empty(); }
+    size_t size() const { return mEntries.size(); }
+
+    iterator find(int32_t subPriority);
+    const_iterator find(int32_t subPriority) const;
+    // Inserts if |subPriority| is absent; does nothing if it is present, like std::map.
+    void emplace(int32_t subPriority, UidRanges uidRanges);
+    void erase(int32_t subPriority);
+
+  private:
+    std::vector<value_type> mEntries;
+};
 
 // A Network represents a collection of interfaces participating as a single administrative unit.
 class Network {
@@ -34,11 +66,25 @@ public:
     // automatically removed interfaces in the destructor, you wouldn't know if it failed.
     virtual ~Network();
 
+    // Networks are allocated from a class-level slab (see Network.cpp) so that the instances
+    // walked on every per-UID network resolution sit in a few contiguous cache lines instead of
+    // wherever the general-purpose heap scattered them.
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
+
+    // Point-in-time occupancy of the class slab, for the memory section of dumpsys.
+    struct SlabStats {
+        size_t slabs;          // Slabs allocated so far (slabs are never returned to the OS).
+        size_t slotsInUse;     // Live Network instances carved from the slabs.
+        size_t bytesReserved;  // Total bytes held by the slabs.
+    };
+    static SlabStats getSlabStats();
+
     virtual std::string getTypeString() const = 0;
     unsigned getNetId() const;
 
     bool hasInterface(const std::string& interface) const;
-    const std::set<std::string>& getInterfaces() const;
+    const std::vector<std::string>& getInterfaces() const;
 
     // These return 0 on success or negative errno on failure.
     [[nodiscard]] virtual int addInterface(const std::string&) { return -EINVAL; }
@@ -48,29 +94,45 @@ public:
     std::string toString() const;
     std::string uidRangesToString() const;
     bool appliesToUser(uid_t uid, int32_t* subPriority) const;
-    [[nodiscard]] virtual int addUsers(const UidRanges&, int32_t /*subPriority*/) {
+    // Takes |uidRanges| by value: the ranges end up stored in mUidRangeMap, so callers that are
+    // done with their copy can std::move() it all the way into the map.
+    [[nodiscard]] virtual int addUsers(UidRanges /*uidRanges*/, int32_t /*subPriority*/) {
         return -EINVAL;
     };
     [[nodiscard]] virtual int removeUsers(const UidRanges&, int32_t /*subPriority*/) {
         return -EINVAL;
     };
+    // Transitions the UID ranges at |subPriority| from whatever is currently programmed to
+    // |newUidRanges|, computing the minimal delta and programming only that. New rules are added
+    // before stale ones are removed, so UIDs in both the old and new sets never observe a window
+    // without rules. Replaces remove-all/re-add-all update patterns, which cause rule storms and
+    // transient routing gaps when only a few ranges actually changed.
+    [[nodiscard]] int updateUsers(const UidRanges& newUidRanges, int32_t subPriority);
     bool isSecure() const;
     virtual bool isPhysical() { return false; }
     virtual bool isUnreachable() { return false; }
     virtual bool isVirtual() { return false; }
     virtual bool canAddUsers() { return false; }
     virtual bool isValidSubPriority(int32_t /*priority*/) { return false; }
-    virtual void addToUidRangeMap(const UidRanges& uidRanges, int32_t subPriority);
+    virtual void addToUidRangeMap(UidRanges uidRanges, int32_t subPriority);
     virtual void removeFromUidRangeMap(const UidRanges& uidRanges, int32_t subPriority);
+    const UidRangeMap& getUidRangeMap() const { return mUidRangeMap; }
 
 protected:
     explicit Network(unsigned netId, bool secure = false);
     bool canAddUidRanges(const UidRanges& uidRanges) const;
 
+    // Keep mInterfaces sorted, so that hasInterface() can binary-search it and enumeration
+    // order is stable. Subclasses must use these rather than touching the vector directly.
+    void insertInterface(const std::string& interface);
+    void eraseInterface(const std::string& interface);
+
     const unsigned mNetId;
-    std::set<std::string> mInterfaces;
+    // Sorted; a network rarely has more than one or two interfaces, so a flat vector keeps them
+    // (and their short strings) adjacent in memory.
+    std::vector<std::string> mInterfaces;
     // Each subsidiary priority maps to a set of UID ranges of a feature.
-    std::map<int32_t, UidRanges> mUidRangeMap;
+    UidRangeMap mUidRangeMap;
     const bool mSecure;
 
 private:
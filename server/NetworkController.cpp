@@ -27,17 +27,32 @@
 
 #include "NetworkController.h"
 
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+
 #include <android-base/strings.h>
 #include <cutils/misc.h>  // FIRST_APPLICATION_UID
 #include <netd_resolv/resolv.h>
 #include "log/log.h"
 
+#include "BootMetrics.h"
 #include "Controllers.h"
 #include "DummyNetwork.h"
 #include "Fwmark.h"
+#include "FwmarkSnapshot.h"
+#include "InterfaceNames.h"
+#include "LatencyWatchdog.h"
 #include "LocalNetwork.h"
 #include "PhysicalNetwork.h"
 #include "RouteController.h"
+#include "SockDiag.h"
+#include "StateJournal.h"
 #include "TcUtils.h"
 #include "UnreachableNetwork.h"
 #include "VirtualNetwork.h"
@@ -58,6 +73,13 @@ namespace {
 const unsigned MIN_NET_ID = 100;
 const unsigned MAX_NET_ID = 65535;
 
+// Bumps the given change-generation domain. Write paths call this after the mutation is fully
+// applied, while still holding the write lock. Null gCtls only happens while the Controllers
+// object itself is being constructed, before any mutation can arrive.
+void bumpGeneration(GenerationRegistry::Domain domain) {
+    if (gCtls) gCtls->generationRegistry.bump(domain);
+}
+
 }  // namespace
 
 // All calls to methods here are made while holding a write lock on mRWLock.
@@ -161,9 +183,82 @@ NetworkController::NetworkController() :
             }
         }
     }
+    initSharedSnapshot();
+    publishConnectSnapshotLocked();
     gLog.info("leave NetworkController ctor");
 }
 
+// Creates and maps the shared fwmark snapshot consumed by libnetd_client. Failure is not fatal:
+// the pointer stays null, nothing is published, and clients keep using the fwmark server for
+// every command.
+void NetworkController::initSharedSnapshot() {
+    if (mkdir(FWMARK_SNAPSHOT_DIR, 0755) == -1 && errno != EEXIST) {
+        ALOGE("cannot create %s (%s)", FWMARK_SNAPSHOT_DIR, strerror(errno));
+        return;
+    }
+    int fd = open(FWMARK_SNAPSHOT_PATH, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        ALOGE("cannot open %s (%s)", FWMARK_SNAPSHOT_PATH, strerror(errno));
+        return;
+    }
+    if (ftruncate(fd, sizeof(FwmarkSnapshot)) == -1) {
+        ALOGE("cannot size %s (%s)", FWMARK_SNAPSHOT_PATH, strerror(errno));
+        close(fd);
+        return;
+    }
+    void* shared = mmap(nullptr, sizeof(FwmarkSnapshot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        ALOGE("cannot map %s (%s)", FWMARK_SNAPSHOT_PATH, strerror(errno));
+        return;
+    }
+    mSharedSnapshot = static_cast<FwmarkSnapshot*>(shared);
+    memset(mSharedSnapshot, 0, sizeof(FwmarkSnapshot));
+}
+
+void NetworkController::writeSharedSnapshotLocked(const ConnectSnapshot& snapshot) {
+    FwmarkSnapshot* out = mSharedSnapshot;
+    if (!out) {
+        return;
+    }
+
+    std::vector<unsigned> virtualNetIds;
+    for (const auto& [netId, network] : mNetworks) {
+        if (network->isVirtual()) {
+            virtualNetIds.push_back(netId);
+        }
+    }
+
+    const bool fits = snapshot.uidNetIds.size() <= FwmarkSnapshot::MAX_UID_SPANS &&
+                      mUsers.size() <= FwmarkSnapshot::MAX_PERMISSION_ENTRIES &&
+                      virtualNetIds.size() <= FwmarkSnapshot::MAX_VIRTUAL_NETWORKS;
+
+    // Seqlock write: readers that observe an odd or changed seq discard their computation and
+    // fall back to the fwmark server.
+    out->seq++;
+    std::atomic_thread_fence(std::memory_order_release);
+
+    out->valid = fits ? 1 : 0;
+    if (fits) {
+        out->defaultNetId = snapshot.defaultNetId;
+        out->uidSpanCount = snapshot.uidNetIds.size();
+        std::copy(snapshot.uidBoundaries.begin(), snapshot.uidBoundaries.end(),
+                  out->uidBoundaries);
+        std::copy(snapshot.uidNetIds.begin(), snapshot.uidNetIds.end(), out->uidNetIds);
+        out->permissionEntryCount = mUsers.size();
+        size_t i = 0;
+        for (const auto& [uid, permission] : mUsers) {
+            out->permissionEntries[i++] = {static_cast<uint32_t>(uid),
+                                           static_cast<uint32_t>(permission)};
+        }
+        out->virtualNetworkCount = virtualNetIds.size();
+        std::copy(virtualNetIds.begin(), virtualNetIds.end(), out->virtualNetIds);
+    }
+
+    std::atomic_thread_fence(std::memory_order_release);
+    out->seq++;
+}
+
 unsigned NetworkController::getDefaultNetwork() const {
     ScopedRLock lock(mRWLock);
     return mDefaultNetId;
@@ -203,6 +298,9 @@ int NetworkController::setDefaultNetwork(unsigned netId) {
     }
 
     mDefaultNetId = netId;
+    publishConnectSnapshotLocked();
+    saveStateLocked();
+    bumpGeneration(GenerationRegistry::NETWORKS);
     return 0;
 }
 
@@ -211,6 +309,18 @@ uint32_t NetworkController::getNetworkForDnsLocked(unsigned* netId, uid_t uid) c
     fwmark.protectedFromVpn = true;
     fwmark.permission = PERMISSION_SYSTEM;
 
+    if (*netId == NETID_UNSET) {
+        // Memo hit: repeated queries from the same app (e.g. during a page load) resolve their
+        // network in a couple of loads instead of rescanning every network's uid ranges.
+        const uint64_t entry = mDnsMemo[uid % kDnsMemoSize].load(std::memory_order_relaxed);
+        if (entry != 0 && static_cast<uint32_t>(entry) == uid) {
+            *netId = static_cast<unsigned>(entry >> 32);
+            fwmark.netId = *netId;
+            fwmark.explicitlySelected = true;
+            return fwmark.intValue;
+        }
+    }
+
     Network* appDefaultNetwork = getPhysicalOrUnreachableNetworkForUserLocked(uid);
     unsigned defaultNetId = appDefaultNetwork ? appDefaultNetwork->getNetId() : mDefaultNetId;
 
@@ -223,6 +333,11 @@ uint32_t NetworkController::getNetworkForDnsLocked(unsigned* netId, uid_t uid) c
         *netId = defaultNetId;
         fwmark.netId = *netId;
         fwmark.explicitlySelected = true;
+        // Only this branch is memoized: its result depends solely on state that republishes the
+        // connect snapshot when it changes, never on resolver state (resolv_has_nameservers), so
+        // clearing the memo in publishConnectSnapshotLocked() is a sufficient invalidation.
+        mDnsMemo[uid % kDnsMemoSize].store((static_cast<uint64_t>(defaultNetId) << 32) | uid,
+                                           std::memory_order_relaxed);
         return fwmark.intValue;
     }
 
@@ -262,6 +377,10 @@ uint32_t NetworkController::getNetworkForDnsLocked(unsigned* netId, uid_t uid) c
 // unreachable network that applies to the UID; lastly, the default network.
 unsigned NetworkController::getNetworkForUser(uid_t uid) const {
     ScopedRLock lock(mRWLock);
+    return getNetworkForUserLocked(uid);
+}
+
+unsigned NetworkController::getNetworkForUserLocked(uid_t uid) const {
     if (VirtualNetwork* virtualNetwork = getVirtualNetworkForUserLocked(uid)) {
         return virtualNetwork->getNetId();
     }
@@ -301,10 +420,102 @@ unsigned NetworkController::getNetworkForConnectLocked(uid_t uid) const {
 }
 
 unsigned NetworkController::getNetworkForConnect(uid_t uid) const {
+    // Fast path: consult the published snapshot instead of taking mRWLock. This runs for every
+    // marked connect() on the device, and under heavy connection load the reader side of the lock
+    // alone causes measurable cache-line contention.
+    const std::shared_ptr<const ConnectSnapshot> snapshot = std::atomic_load(&mConnectSnapshot);
+    if (snapshot) {
+        // One binary search over the precomputed interval index; see ConnectSnapshot.
+        const std::vector<uid_t>& bounds = snapshot->uidBoundaries;
+        const size_t i = std::upper_bound(bounds.begin(), bounds.end(), uid) - bounds.begin();
+        if (i > 0 && i <= snapshot->uidNetIds.size()) {
+            const unsigned netId = snapshot->uidNetIds[i - 1];
+            if (netId != NETID_UNSET) {
+                return netId;
+            }
+        }
+        return snapshot->defaultNetId;
+    }
+
     ScopedRLock lock(mRWLock);
     return getNetworkForConnectLocked(uid);
 }
 
+// Rebuilds and publishes the snapshot used by getNetworkForConnect(), and mirrors it (plus the
+// permission and virtual-network tables) into the shared-memory snapshot read by libnetd_client.
+// Must be called by every write operation that changes the default network, creates or destroys a
+// network, changes the UID ranges of a network, or changes a UID's permission. Readers holding a previous snapshot keep using it until they drop it;
+// that is no different from a reader that acquired mRWLock just before the writer.
+void NetworkController::publishConnectSnapshotLocked() {
+    // Any change that warrants a new snapshot may also change which network a uid's DNS queries
+    // use, so drop the per-uid DNS memo wholesale. This runs under the write lock, so no reader
+    // is concurrently filling entries.
+    for (auto& entry : mDnsMemo) {
+        entry.store(0, std::memory_order_relaxed);
+    }
+
+    // Collect the per-app default network entries (physical or unreachable networks with UID
+    // ranges) and sort them in selection order.
+    struct AppDefaultEntry {
+        int32_t subPriority;
+        unsigned netId;
+        const UidRanges* uidRanges;
+    };
+    std::vector<AppDefaultEntry> entries;
+    for (const auto& [netId, network] : mNetworks) {
+        if (!network->isPhysical() && !network->isUnreachable()) continue;
+        for (const auto& [subPriority, uidRanges] : network->getUidRangeMap()) {
+            // SUB_PRIORITY_NO_DEFAULT entries never provide a default network; see
+            // getPhysicalOrUnreachableNetworkForUserLocked().
+            if (subPriority == UidRanges::SUB_PRIORITY_NO_DEFAULT) continue;
+            entries.push_back({subPriority, netId, &uidRanges});
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const AppDefaultEntry& lhs, const AppDefaultEntry& rhs) {
+                  return lhs.subPriority != rhs.subPriority ? lhs.subPriority < rhs.subPriority
+                                                            : lhs.netId < rhs.netId;
+              });
+
+    // Flatten the possibly-overlapping ranges into disjoint UID spans. Every range start/end is a
+    // span boundary; within a span the winning network is constant, so probing the span's first
+    // UID against the entries in selection order resolves the overlap once, at build time.
+    std::vector<uid_t> points;
+    for (const AppDefaultEntry& entry : entries) {
+        for (const UidRangeParcel& range : entry.uidRanges->getRanges()) {
+            points.push_back(range.start);
+            points.push_back(static_cast<uid_t>(range.stop) + 1);
+        }
+    }
+    std::sort(points.begin(), points.end());
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+
+    auto snapshot = std::make_shared<ConnectSnapshot>();
+    snapshot->defaultNetId = mDefaultNetId;
+    for (size_t i = 0; i + 1 < points.size(); ++i) {
+        unsigned netId = NETID_UNSET;
+        for (const AppDefaultEntry& entry : entries) {
+            if (entry.uidRanges->hasUid(points[i])) {
+                netId = entry.netId;
+                break;
+            }
+        }
+        // Merge adjacent spans that resolve to the same network.
+        if (!snapshot->uidNetIds.empty() && snapshot->uidNetIds.back() == netId) {
+            continue;
+        }
+        snapshot->uidBoundaries.push_back(points[i]);
+        snapshot->uidNetIds.push_back(netId);
+    }
+    if (!points.empty()) {
+        snapshot->uidBoundaries.push_back(points.back());
+    }
+
+    writeSharedSnapshotLocked(*snapshot);
+    std::atomic_store(&mConnectSnapshot,
+                      std::shared_ptr<const ConnectSnapshot>(std::move(snapshot)));
+}
+
 void NetworkController::getNetworkContext(
         unsigned netId, uid_t uid, struct android_net_context* netcontext) const {
     ScopedRLock lock(mRWLock);
@@ -355,12 +566,12 @@ void NetworkController::getNetworkContext(
 }
 
 unsigned NetworkController::getNetworkForInterfaceLocked(const char* interface) const {
-    for (const auto& entry : mNetworks) {
-        if (entry.second->hasInterface(interface)) {
-            return entry.first;
-        }
+    const uint16_t ifaceId = InterfaceNames::lookup(interface);
+    if (ifaceId == InterfaceNames::INVALID_ID) {
+        return NETID_UNSET;
     }
-    return NETID_UNSET;
+    auto iter = mIfaceIdToNetId.find(ifaceId);
+    return (iter != mIfaceIdToNetId.end()) ? iter->second : NETID_UNSET;
 }
 
 unsigned NetworkController::getNetworkForInterface(const char* interface) const {
@@ -378,6 +589,33 @@ bool NetworkController::isVirtualNetworkLocked(unsigned netId) const {
     return network && network->isVirtual();
 }
 
+// ReadTransaction lookups: the constructor already holds mRWLock shared, so these go straight to
+// the Locked implementations their standalone counterparts wrap.
+
+unsigned NetworkController::ReadTransaction::getDefaultNetwork() const {
+    return mController.mDefaultNetId;
+}
+
+unsigned NetworkController::ReadTransaction::getNetworkForUser(uid_t uid) const {
+    return mController.getNetworkForUserLocked(uid);
+}
+
+Permission NetworkController::ReadTransaction::getPermissionForUser(uid_t uid) const {
+    return mController.getPermissionForUserLocked(uid);
+}
+
+int NetworkController::ReadTransaction::checkUserNetworkAccess(uid_t uid, unsigned netId) const {
+    return mController.checkUserNetworkAccessLocked(uid, netId);
+}
+
+bool NetworkController::ReadTransaction::canProtect(uid_t uid) const {
+    return mController.canProtectLocked(uid);
+}
+
+bool NetworkController::ReadTransaction::isVirtualNetwork(unsigned netId) const {
+    return mController.isVirtualNetworkLocked(netId);
+}
+
 int NetworkController::createPhysicalNetworkLocked(unsigned netId, Permission permission) {
     if (!((MIN_NET_ID <= netId && netId <= MAX_NET_ID) ||
           (MIN_OEM_ID <= netId && netId <= MAX_OEM_ID))) {
@@ -400,11 +638,17 @@ int NetworkController::createPhysicalNetworkLocked(unsigned netId, Permission pe
     mNetworks[netId] = physicalNetwork;
 
     updateTcpSocketMonitorPolling();
+    publishConnectSnapshotLocked();
+    saveStateLocked();
+    bumpGeneration(GenerationRegistry::NETWORKS);
 
     return 0;
 }
 
 int NetworkController::createPhysicalNetwork(unsigned netId, Permission permission) {
+    // The watchdog operations start before the lock so that contention on mRWLock counts against
+    // the budget: to the caller, waiting for the lock is part of the transition.
+    LatencyWatchdog::Operation op("createPhysicalNetwork", netId);
     ScopedWLock lock(mRWLock);
     return createPhysicalNetworkLocked(netId, permission);
 }
@@ -437,6 +681,7 @@ int NetworkController::createPhysicalOemNetwork(Permission permission, unsigned
 
 int NetworkController::createVirtualNetwork(unsigned netId, bool secure, NativeVpnType vpnType,
                                             bool excludeLocalRoutes) {
+    LatencyWatchdog::Operation op("createVirtualNetwork", netId);
     ScopedWLock lock(mRWLock);
 
     if (!(MIN_NET_ID <= netId && netId <= MAX_NET_ID)) {
@@ -458,10 +703,14 @@ int NetworkController::createVirtualNetwork(unsigned netId, bool secure, NativeV
         return ret;
     }
     mNetworks[netId] = new VirtualNetwork(netId, secure, excludeLocalRoutes);
+    publishConnectSnapshotLocked();
+    saveStateLocked();
+    bumpGeneration(GenerationRegistry::NETWORKS);
     return 0;
 }
 
 int NetworkController::destroyNetwork(unsigned netId) {
+    LatencyWatchdog::Operation op("destroyNetwork", netId);
     ScopedWLock lock(mRWLock);
 
     if (netId == LOCAL_NET_ID || netId == UNREACHABLE_NET_ID) {
@@ -507,13 +756,35 @@ int NetworkController::destroyNetwork(unsigned netId) {
             ++iter;
         }
     }
+    // clearInterfaces() may have partially failed, but the network is gone either way, so drop
+    // every interface that pointed at it.
+    for (auto iter = mIfaceIdToNetId.begin(); iter != mIfaceIdToNetId.end();) {
+        if (iter->second == netId) {
+            iter = mIfaceIdToNetId.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    // Forget uid range versions so a reused netId starts its version sequence from scratch.
+    for (auto iter = mUidRangeVersions.begin(); iter != mUidRangeVersions.end();) {
+        if (iter->first.first == netId) {
+            iter = mUidRangeVersions.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
 
     updateTcpSocketMonitorPolling();
+    publishConnectSnapshotLocked();
+    // Even a partially failed destroy changed the topology, so journal the new state.
+    saveStateLocked();
+    bumpGeneration(GenerationRegistry::NETWORKS);
 
     return ret;
 }
 
 int NetworkController::addInterfaceToNetwork(unsigned netId, const char* interface) {
+    LatencyWatchdog::Operation op("addInterfaceToNetwork", netId);
     ScopedWLock lock(mRWLock);
 
     if (!isValidNetworkLocked(netId)) {
@@ -529,6 +800,10 @@ int NetworkController::addInterfaceToNetwork(unsigned netId, const char* interfa
     if (int ret = getNetworkLocked(netId)->addInterface(interface)) {
         return ret;
     }
+    const uint16_t ifaceId = InterfaceNames::intern(interface);
+    if (ifaceId != InterfaceNames::INVALID_ID) {
+        mIfaceIdToNetId[ifaceId] = netId;
+    }
 
     // Only populate mIfindexToLastNetId for non-local networks, because for these getIfIndex will
     // return 0. That's fine though, because that map is only used to prevent force-closing sockets
@@ -540,15 +815,25 @@ int NetworkController::addInterfaceToNetwork(unsigned netId, const char* interfa
         int ifIndex = RouteController::getIfIndex(interface);
         if (ifIndex) {
             mIfindexToLastNetId[ifIndex] = netId;
+            InterfaceNames::setIfindex(ifaceId, ifIndex);
         } else {
             // Cannot happen, since addInterface() above will have failed.
             ALOGE("inconceivable! added interface %s with no index", interface);
         }
     }
+    saveStateLocked();
+    bumpGeneration(GenerationRegistry::NETWORKS);
+    // The first interface joining a real network is the point at which netd's boot work has
+    // produced a usable network; stamp it into the durable boot metrics. Repeat calls are a
+    // single atomic load.
+    if (netId != LOCAL_NET_ID && BootMetrics::instance != nullptr) {
+        BootMetrics::instance->recordFirstNetworkReady();
+    }
     return 0;
 }
 
 int NetworkController::removeInterfaceFromNetwork(unsigned netId, const char* interface) {
+    LatencyWatchdog::Operation op("removeInterfaceFromNetwork", netId);
     ScopedWLock lock(mRWLock);
 
     if (!isValidNetworkLocked(netId)) {
@@ -556,7 +841,13 @@ int NetworkController::removeInterfaceFromNetwork(unsigned netId, const char* in
         return -ENONET;
     }
 
-    return getNetworkLocked(netId)->removeInterface(interface);
+    if (int ret = getNetworkLocked(netId)->removeInterface(interface)) {
+        return ret;
+    }
+    mIfaceIdToNetId.erase(InterfaceNames::lookup(interface));
+    saveStateLocked();
+    bumpGeneration(GenerationRegistry::NETWORKS);
+    return 0;
 }
 
 Permission NetworkController::getPermissionForUser(uid_t uid) const {
@@ -570,6 +861,9 @@ void NetworkController::setPermissionForUsers(Permission permission,
     for (uid_t uid : uids) {
         mUsers[uid] = permission;
     }
+    rebuildPermissionIndexLocked();
+    publishConnectSnapshotLocked();
+    bumpGeneration(GenerationRegistry::PERMISSIONS);
 }
 
 int NetworkController::checkUserNetworkAccess(uid_t uid, unsigned netId) const {
@@ -580,6 +874,8 @@ int NetworkController::checkUserNetworkAccess(uid_t uid, unsigned netId) const {
 int NetworkController::setPermissionForNetworks(Permission permission,
                                                 const std::vector<unsigned>& netIds) {
     ScopedWLock lock(mRWLock);
+    // Validate every netId before reprogramming anything, so a bad entry in a bulk permission
+    // push doesn't leave half the networks changed.
     for (unsigned netId : netIds) {
         Network* network = getNetworkLocked(netId);
         if (!network) {
@@ -590,11 +886,44 @@ int NetworkController::setPermissionForNetworks(Permission permission,
             ALOGE("cannot set permissions on non-physical network with netId %u", netId);
             return -EINVAL;
         }
+    }
 
+    // Queue every network's rule changes into one batched netlink send. OEM provisioning pushes
+    // permissions for many networks at boot; without the batch, each network pays one kernel
+    // round trip per rule it reprograms.
+    RouteController::RuleBatch batch;
+    for (unsigned netId : netIds) {
+        Network* network = getNetworkLocked(netId);
         if (int ret = static_cast<PhysicalNetwork*>(network)->setPermission(permission)) {
             return ret;
         }
     }
+    if (int ret = batch.flush()) {
+        return ret;
+    }
+
+    // The rules only reached the kernel at flush(), so repeat the socket sweep that
+    // setPermission() already did: a socket opened between that sweep and the flush would
+    // otherwise survive without the new permission. All the networks in the batch share one
+    // composite sweep; a destroySocketsLackingPermission() call per netId would re-dump the
+    // same socket tables each time.
+    if (permission != PERMISSION_NONE) {
+        SockDiag::DestroySpec spec;
+        spec.permissionChecks.reserve(netIds.size());
+        for (unsigned netId : netIds) {
+            spec.permissionChecks.push_back({netId, permission});
+        }
+        spec.excludeLoopback = true;
+        SockDiag sd;
+        if (!sd.open()) {
+            ALOGE("Error closing sockets for permission change on %zu networks", netIds.size());
+        } else if (int ret = sd.destroySockets(spec)) {
+            ALOGE("Failed to close sockets on permission change to %d: %s", permission,
+                  strerror(-ret));
+        }
+    }
+    saveStateLocked();
+    bumpGeneration(GenerationRegistry::PERMISSIONS);
     return 0;
 }
 
@@ -615,14 +944,56 @@ int isWrongNetworkForUidRanges(unsigned netId, Network* network) {
 
 }  // namespace
 
-int NetworkController::addUsersToNetwork(unsigned netId, const UidRanges& uidRanges,
+int NetworkController::addUsersToNetwork(unsigned netId, UidRanges uidRanges,
                                          int32_t subPriority) {
     ScopedWLock lock(mRWLock);
     Network* network = getNetworkLocked(netId);
     if (int ret = isWrongNetworkForUidRanges(netId, network)) {
         return ret;
     }
-    return network->addUsers(uidRanges, subPriority);
+    int ret = network->addUsers(std::move(uidRanges), subPriority);
+    publishConnectSnapshotLocked();
+    if (!ret) bumpGeneration(GenerationRegistry::UID_RANGES);
+    return ret;
+}
+
+int NetworkController::updateUsersOnNetwork(unsigned netId, const UidRanges& uidRanges,
+                                            int32_t subPriority) {
+    ScopedWLock lock(mRWLock);
+    Network* network = getNetworkLocked(netId);
+    if (int ret = isWrongNetworkForUidRanges(netId, network)) {
+        return ret;
+    }
+    int ret = network->updateUsers(uidRanges, subPriority);
+    publishConnectSnapshotLocked();
+    if (!ret) bumpGeneration(GenerationRegistry::UID_RANGES);
+    return ret;
+}
+
+int NetworkController::setUidRangesOnNetwork(unsigned netId, const UidRanges& uidRanges,
+                                             int32_t subPriority, int64_t version) {
+    ScopedWLock lock(mRWLock);
+    Network* network = getNetworkLocked(netId);
+    if (int ret = isWrongNetworkForUidRanges(netId, network)) {
+        return ret;
+    }
+    const auto key = std::make_pair(netId, subPriority);
+    const auto iter = mUidRangeVersions.find(key);
+    if (iter != mUidRangeVersions.end() && version <= iter->second) {
+        ALOGI("dropping stale uid range update for netId %u subPriority %d: version %" PRId64
+              " <= %" PRId64,
+              netId, subPriority, version, iter->second);
+        return 0;
+    }
+    int ret = network->updateUsers(uidRanges, subPriority);
+    publishConnectSnapshotLocked();
+    // On failure the version is left untouched, so a retry carrying the same version is applied
+    // rather than dropped as stale.
+    if (!ret) {
+        mUidRangeVersions[key] = version;
+        bumpGeneration(GenerationRegistry::UID_RANGES);
+    }
+    return ret;
 }
 
 int NetworkController::removeUsersFromNetwork(unsigned netId, const UidRanges& uidRanges,
@@ -632,7 +1003,10 @@ int NetworkController::removeUsersFromNetwork(unsigned netId, const UidRanges& u
     if (int ret = isWrongNetworkForUidRanges(netId, network)) {
         return ret;
     }
-    return network->removeUsers(uidRanges, subPriority);
+    int ret = network->removeUsers(uidRanges, subPriority);
+    publishConnectSnapshotLocked();
+    if (!ret) bumpGeneration(GenerationRegistry::UID_RANGES);
+    return ret;
 }
 
 int NetworkController::addRoute(unsigned netId, const char* interface, const char* destination,
@@ -720,65 +1094,386 @@ void NetworkController::denyProtect(const std::vector<uid_t>& uids) {
     }
 }
 
-void NetworkController::dump(DumpWriter& dw) {
+namespace {
+
+// State journal payload serialization. The payload format is internal to this file; versioning
+// and checksumming are handled by StateJournal, so any format change here must bump the journal
+// version there.
+
+constexpr uint8_t JOURNAL_NETWORK_PHYSICAL = 0;
+constexpr uint8_t JOURNAL_NETWORK_VIRTUAL = 1;
+
+void appendU8(std::string* out, uint8_t value) {
+    out->push_back(static_cast<char>(value));
+}
+
+void appendU32(std::string* out, uint32_t value) {
+    out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendString(std::string* out, const std::string& value) {
+    appendU32(out, static_cast<uint32_t>(value.size()));
+    out->append(value);
+}
+
+// 64-bit FNV-1a over a serialized byte string. Not cryptographic: the network digests only need
+// to make unequal states compare unequal with overwhelming probability.
+uint64_t fnv1a64(const std::string& bytes) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char c : bytes) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Bounds-checked cursor over a journal payload. Reads return zero values and keep failing once
+// the payload runs short, so callers can check ok() once instead of after every read.
+class JournalReader {
+  public:
+    explicit JournalReader(const std::string& payload) : mData(payload) {}
+
+    uint8_t readU8() {
+        uint8_t value = 0;
+        readBytes(&value, sizeof(value));
+        return value;
+    }
+
+    uint32_t readU32() {
+        uint32_t value = 0;
+        readBytes(&value, sizeof(value));
+        return value;
+    }
+
+    std::string readString() {
+        const uint32_t size = readU32();
+        if (!mOk || mData.size() - mPos < size) {
+            mOk = false;
+            return std::string();
+        }
+        std::string value = mData.substr(mPos, size);
+        mPos += size;
+        return value;
+    }
+
+    bool ok() const { return mOk; }
+
+  private:
+    void readBytes(void* out, size_t size) {
+        if (!mOk || mData.size() - mPos < size) {
+            mOk = false;
+            return;
+        }
+        memcpy(out, mData.data() + mPos, size);
+        mPos += size;
+    }
+
+    const std::string& mData;
+    size_t mPos = 0;
+    bool mOk = true;
+};
+
+}  // namespace
+
+std::string NetworkController::serializeStateLocked() const {
+    std::string networks;
+    uint32_t count = 0;
+    for (const auto& [netId, network] : mNetworks) {
+        // Only explicitly created networks are journaled; the local, dummy and unreachable
+        // networks are recreated by the constructor.
+        if (!network->isPhysical() && !network->isVirtual()) continue;
+        appendU8(&networks, network->isPhysical() ? JOURNAL_NETWORK_PHYSICAL
+                                                  : JOURNAL_NETWORK_VIRTUAL);
+        appendU32(&networks, netId);
+        if (network->isPhysical()) {
+            appendU32(&networks, static_cast<PhysicalNetwork*>(network)->getPermission());
+        } else {
+            appendU8(&networks, network->isSecure());
+            appendU8(&networks, static_cast<VirtualNetwork*>(network)->excludeLocalRoutes());
+        }
+        const auto& interfaces = network->getInterfaces();
+        appendU32(&networks, static_cast<uint32_t>(interfaces.size()));
+        for (const auto& interface : interfaces) {
+            appendString(&networks, interface);
+        }
+        count++;
+    }
+
+    std::string payload;
+    appendU32(&payload, count);
+    payload += networks;
+    appendU32(&payload, mDefaultNetId);
+    return payload;
+}
+
+void NetworkController::saveStateLocked() const {
+    if (!mJournal) {
+        return;
+    }
+    if (int ret = mJournal->write(serializeStateLocked())) {
+        ALOGE("cannot write state journal: %s", strerror(-ret));
+    }
+}
+
+int NetworkController::restoreFromStateJournal(const StateJournal* journal) {
+    std::string payload;
+    if (int ret = journal->read(&payload)) {
+        // No journal on first boot (or after the journal was disabled) is the normal case.
+        return ret == -ENOENT ? 0 : ret;
+    }
+
+    // As in destroyNetwork(), restore as much as possible even if parts fail, and return the
+    // first error: a partially restored topology still beats an empty one, and the framework's
+    // replay reconciles whatever is left.
+    JournalReader reader(payload);
+    int ret = 0;
+    const uint32_t count = reader.readU32();
+    for (uint32_t i = 0; i < count && reader.ok(); i++) {
+        const uint8_t type = reader.readU8();
+        const unsigned netId = reader.readU32();
+        int err = 0;
+        if (type == JOURNAL_NETWORK_PHYSICAL) {
+            const Permission permission = static_cast<Permission>(reader.readU32());
+            if (reader.ok()) {
+                err = createPhysicalNetwork(netId, permission);
+            }
+        } else if (type == JOURNAL_NETWORK_VIRTUAL) {
+            const bool secure = reader.readU8();
+            const bool excludeLocalRoutes = reader.readU8();
+            if (reader.ok()) {
+                // The VPN type is only validated at creation time, not stored, so restore with
+                // the most common one.
+                err = createVirtualNetwork(netId, secure, NativeVpnType::PLATFORM,
+                                           excludeLocalRoutes);
+            }
+        } else {
+            ALOGE("unknown network type %u in state journal", type);
+            return -EBADMSG;
+        }
+        if (err) {
+            ALOGE("cannot restore netId %u: %s", netId, strerror(-err));
+            if (!ret) ret = err;
+        }
+        const uint32_t interfaceCount = reader.readU32();
+        for (uint32_t j = 0; j < interfaceCount && reader.ok(); j++) {
+            const std::string interface = reader.readString();
+            if (!reader.ok() || err) continue;
+            if (int err2 = addInterfaceToNetwork(netId, interface.c_str())) {
+                ALOGE("cannot restore interface %s to netId %u: %s", interface.c_str(), netId,
+                      strerror(-err2));
+                if (!ret) ret = err2;
+            }
+        }
+    }
+    const unsigned defaultNetId = reader.readU32();
+    if (!reader.ok()) {
+        ALOGE("state journal payload truncated");
+        return -EBADMSG;
+    }
+    if (defaultNetId != NETID_UNSET) {
+        if (int err = setDefaultNetwork(defaultNetId)) {
+            ALOGE("cannot restore default network %u: %s", defaultNetId, strerror(-err));
+            if (!ret) ret = err;
+        }
+    }
+    return ret;
+}
+
+void NetworkController::getNetworkDigests(std::vector<NetworkDigest>* digests) const {
     ScopedRLock lock(mRWLock);
+    digests->clear();
+    for (const auto& [netId, network] : mNetworks) {
+        // As in the state journal, only explicitly created networks are covered; the local,
+        // dummy and unreachable networks are owned by netd itself.
+        if (!network->isPhysical() && !network->isVirtual()) continue;
+        NetworkDigest digest = {.netId = netId};
+
+        std::string attributes;
+        appendU8(&attributes, network->isPhysical() ? JOURNAL_NETWORK_PHYSICAL
+                                                    : JOURNAL_NETWORK_VIRTUAL);
+        if (network->isPhysical()) {
+            appendU32(&attributes, static_cast<PhysicalNetwork*>(network)->getPermission());
+        } else {
+            appendU8(&attributes, network->isSecure());
+            appendU8(&attributes, static_cast<VirtualNetwork*>(network)->excludeLocalRoutes());
+        }
+        appendU8(&attributes, netId == mDefaultNetId);
+        digest.attributesDigest = fnv1a64(attributes);
+
+        std::string interfaces;
+        // mInterfaces is sorted, so equal interface sets serialize identically.
+        for (const auto& interface : network->getInterfaces()) {
+            appendString(&interfaces, interface);
+        }
+        digest.interfacesDigest = fnv1a64(interfaces);
+
+        std::string uidRanges;
+        // The range map is sorted by sub-priority; ranges within an entry keep the order the
+        // framework pushed them in, which a framework replaying the same pushes reproduces.
+        for (const auto& [subPriority, ranges] : network->getUidRangeMap()) {
+            appendU32(&uidRanges, static_cast<uint32_t>(subPriority));
+            for (const auto& range : ranges.getRanges()) {
+                appendU32(&uidRanges, static_cast<uint32_t>(range.start));
+                appendU32(&uidRanges, static_cast<uint32_t>(range.stop));
+            }
+        }
+        digest.uidRangesDigest = fnv1a64(uidRanges);
+
+        digests->push_back(digest);
+    }
+}
+
+void NetworkController::enableStateJournal(StateJournal* journal) {
+    ScopedWLock lock(mRWLock);
+    mJournal = journal;
+    // Write an initial snapshot so a crash before the first topology change still restores
+    // whatever the restore pass just rebuilt.
+    saveStateLocked();
+}
+
+void NetworkController::dump(DumpWriter& dw) {
+    // Writing to the dump fd can block indefinitely on a slow bugreport reader, so never hold
+    // mRWLock across a DumpWriter call: snapshot state as preformatted strings under the lock,
+    // then emit after releasing it. A dump taken during a network transition then costs the
+    // mutation paths only the copy, not the formatting and the writes.
+    //
+    // The per-network sections are snapshotted one network at a time into a reused buffer rather
+    // than all at once: a VPN's UID ranges alone can run to many kilobytes, and bugreports are
+    // taken exactly when a low-RAM device can least afford the allocation spike. The cost is that
+    // networks mutated mid-dump may show torn state relative to each other, which a diagnostic
+    // dump tolerates.
+    struct NetworkSnapshot {
+        std::string description;
+        std::string requiredPermission;  // Empty unless the network is physical.
+        std::string uidRanges;
+    };
+
+    unsigned defaultNetId;
+    std::vector<unsigned> netIds;
+    {
+        ScopedRLock lock(mRWLock);
+        defaultNetId = mDefaultNetId;
+        netIds.reserve(mNetworks.size());
+        for (const auto& i : mNetworks) {
+            netIds.push_back(i.first);
+        }
+    }
 
     dw.incIndent();
     dw.println("NetworkController");
 
     dw.incIndent();
-    dw.println("Default network: %u", mDefaultNetId);
+    dw.println("Default network: %u", defaultNetId);
 
     dw.blankline();
     dw.println("Networks:");
     dw.incIndent();
-    for (const auto& i : mNetworks) {
-        Network* network = i.second;
-        dw.println(network->toString());
-        if (network->isPhysical()) {
+    NetworkSnapshot snapshot;
+    for (unsigned netId : netIds) {
+        {
+            ScopedRLock lock(mRWLock);
+            Network* network = getNetworkLocked(netId);
+            if (!network) {
+                continue;  // Destroyed while the dump was streaming.
+            }
+            snapshot.description = network->toString();
+            snapshot.requiredPermission.clear();
+            if (network->isPhysical()) {
+                Permission permission =
+                        reinterpret_cast<PhysicalNetwork*>(network)->getPermission();
+                snapshot.requiredPermission = permissionToName(permission);
+            }
+            snapshot.uidRanges = network->uidRangesToString();
+        }
+        dw.println(snapshot.description);
+        if (!snapshot.requiredPermission.empty()) {
             dw.incIndent();
-            Permission permission = reinterpret_cast<PhysicalNetwork*>(network)->getPermission();
-            dw.println("Required permission: %s", permissionToName(permission));
+            dw.println("Required permission: %s", snapshot.requiredPermission.c_str());
             dw.decIndent();
         }
-        if (const auto& str = network->uidRangesToString(); !str.empty()) {
+        if (!snapshot.uidRanges.empty()) {
             dw.incIndent();
-            dw.println(str);
+            dw.println(snapshot.uidRanges);
             dw.decIndent();
         }
         dw.blankline();
     }
     dw.decIndent();
 
+    // Heap profile of the per-network state, for chasing netd's footprint on low-RAM devices.
+    // Interface and UID range storage is allocated on first use, so idle networks should show
+    // up here as slab slots only.
+    size_t interfaceCount = 0;
+    size_t uidRangeEntryCount = 0;
+    size_t uidRangeCount = 0;
+    size_t networkCount;
+    {
+        ScopedRLock lock(mRWLock);
+        networkCount = mNetworks.size();
+        for (const auto& [netId, network] : mNetworks) {
+            interfaceCount += network->getInterfaces().size();
+            for (const auto& [subPriority, ranges] : network->getUidRangeMap()) {
+                uidRangeEntryCount++;
+                uidRangeCount += ranges.getRanges().size();
+            }
+        }
+    }
+    const Network::SlabStats slabStats = Network::getSlabStats();
+    dw.println("Memory:");
+    dw.incIndent();
+    dw.println("%zu networks holding %zu interfaces, %zu uid ranges in %zu sub-priority entries",
+               networkCount, interfaceCount, uidRangeCount, uidRangeEntryCount);
+    dw.println("network slab: %zu slab(s), %zu bytes reserved, %zu slots in use",
+               slabStats.slabs, slabStats.bytesReserved, slabStats.slotsInUse);
+    dw.decIndent();
+    dw.blankline();
+
+    std::vector<std::pair<uint32_t, unsigned>> ifindexToLastNetId;
+    std::vector<std::pair<std::string, std::string>> interfaceAddresses;
+    std::vector<uid_t> systemUids;
+    std::vector<uid_t> networkUids;
+    {
+        ScopedRLock lock(mRWLock);
+
+        ifindexToLastNetId.assign(mIfindexToLastNetId.begin(), mIfindexToLastNetId.end());
+
+        interfaceAddresses.reserve(mAddressToIfindices.size());
+        for (const auto& i : mAddressToIfindices) {
+            interfaceAddresses.emplace_back(i.first, android::base::Join(i.second, ", "));
+        }
+
+        for (const auto& [uid, permission] : mUsers) {
+            if ((permission & PERMISSION_SYSTEM) == PERMISSION_SYSTEM) {
+                systemUids.push_back(uid);
+            } else if ((permission & PERMISSION_NETWORK) == PERMISSION_NETWORK) {
+                networkUids.push_back(uid);
+            }
+        }
+    }
+
     dw.blankline();
     dw.println("Interface <-> last network map:");
     dw.incIndent();
-    for (const auto& i : mIfindexToLastNetId) {
+    for (const auto& i : ifindexToLastNetId) {
         dw.println("Ifindex: %u NetId: %u", i.first, i.second);
     }
     dw.decIndent();
 
+    dw.blankline();
+    // Process-wide table, locked internally; safe to read here without mRWLock.
+    dw.println("Interned interface names: %s", InterfaceNames::toString().c_str());
+
     dw.blankline();
     dw.println("Interface addresses:");
     dw.incIndent();
-    for (const auto& i : mAddressToIfindices) {
-        dw.println("address: %s ifindices: [%s]", i.first.c_str(),
-                android::base::Join(i.second, ", ").c_str());
+    for (const auto& i : interfaceAddresses) {
+        dw.println("address: %s ifindices: [%s]", i.first.c_str(), i.second.c_str());
     }
     dw.decIndent();
 
     dw.blankline();
     dw.println("Permission of users:");
     dw.incIndent();
-    std::vector<uid_t> systemUids;
-    std::vector<uid_t> networkUids;
-    for (const auto& [uid, permission] : mUsers) {
-        if ((permission & PERMISSION_SYSTEM) == PERMISSION_SYSTEM) {
-            systemUids.push_back(uid);
-        } else if ((permission & PERMISSION_NETWORK) == PERMISSION_NETWORK) {
-            networkUids.push_back(uid);
-        }
-    }
     dw.println("NETWORK: %s", android::base::Join(networkUids, ", ").c_str());
     dw.println("SYSTEM: %s", android::base::Join(systemUids, ", ").c_str());
     dw.decIndent();
@@ -836,13 +1531,32 @@ Network* NetworkController::getPhysicalOrUnreachableNetworkForUserLocked(uid_t u
 }
 
 Permission NetworkController::getPermissionForUserLocked(uid_t uid) const {
-    auto iter = mUsers.find(uid);
-    if (iter != mUsers.end()) {
-        return iter->second;
+    const size_t page = uid >> kPermissionPageShift;
+    if (page < mUserPermissionPages.size() && mUserPermissionPages[page]) {
+        const uint8_t permission = (*mUserPermissionPages[page])[uid & (kPermissionPageSize - 1)];
+        if (permission != kNoExplicitPermission) {
+            return static_cast<Permission>(permission);
+        }
     }
     return uid < FIRST_APPLICATION_UID ? PERMISSION_SYSTEM : PERMISSION_NONE;
 }
 
+void NetworkController::rebuildPermissionIndexLocked() {
+    mUserPermissionPages.clear();
+    for (const auto& [uid, permission] : mUsers) {
+        const size_t page = uid >> kPermissionPageShift;
+        if (page >= mUserPermissionPages.size()) {
+            mUserPermissionPages.resize(page + 1);
+        }
+        auto& entries = mUserPermissionPages[page];
+        if (!entries) {
+            entries = std::make_unique<std::array<uint8_t, kPermissionPageSize>>();
+            entries->fill(kNoExplicitPermission);
+        }
+        (*entries)[uid & (kPermissionPageSize - 1)] = static_cast<uint8_t>(permission);
+    }
+}
+
 int NetworkController::checkUserNetworkAccessLocked(uid_t uid, unsigned netId) const {
     Network* network = getNetworkLocked(netId);
     if (!network) {
@@ -919,17 +1633,22 @@ int NetworkController::modifyRoute(unsigned netId, const char* interface, const
         tableType = RouteController::INTERFACE;
     }
 
+    int ret = -EINVAL;
     switch (op) {
         case ROUTE_ADD:
-            return RouteController::addRoute(interface, destination, nexthop, tableType, mtu,
-                                             0 /* priority */);
+            ret = RouteController::addRoute(interface, destination, nexthop, tableType, mtu,
+                                            0 /* priority */);
+            break;
         case ROUTE_UPDATE:
-            return RouteController::updateRoute(interface, destination, nexthop, tableType, mtu);
+            ret = RouteController::updateRoute(interface, destination, nexthop, tableType, mtu);
+            break;
         case ROUTE_REMOVE:
-            return RouteController::removeRoute(interface, destination, nexthop, tableType,
-                                                0 /* priority */);
+            ret = RouteController::removeRoute(interface, destination, nexthop, tableType,
+                                               0 /* priority */);
+            break;
     }
-    return -EINVAL;
+    if (!ret) bumpGeneration(GenerationRegistry::ROUTES);
+    return ret;
 }
 
 int NetworkController::modifyFallthroughLocked(unsigned vpnNetId, bool add) {
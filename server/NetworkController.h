@@ -28,15 +28,21 @@
 #include "netdutils/DumpWriter.h"
 
 #include <sys/types.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <list>
 #include <map>
+#include <memory>
 #include <set>
 #include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 struct android_net_context;
+struct FwmarkSnapshot;
 
 namespace android::net {
 
@@ -73,9 +79,64 @@ static inline net_handle_t netIdToNetHandle(unsigned fromNetId) {
 }
 
 class Network;
+class StateJournal;
 class UidRanges;
 class VirtualNetwork;
 
+// Map from netId to Network*, stored as a sorted flat vector. A device rarely has more than a
+// handful of networks, but this map is searched and traversed on hot lookup paths, where the
+// pointer-chasing of std::map's red-black tree nodes costs more than it buys. Provides the subset
+// of the std::map interface that NetworkController uses; iteration order is ascending netId, as
+// with std::map.
+class NetworkMap {
+  public:
+    using value_type = std::pair<unsigned, Network*>;
+    using iterator = std::vector<value_type>::iterator;
+    using const_iterator = std::vector<value_type>::const_iterator;
+
+    iterator begin() { return mEntries.begin(); }
+    iterator end() { return mEntries.end(); }
+    const_iterator begin() const { return mEntries.begin(); }
+    const_iterator end() const { return mEntries.end(); }
+    size_t size() const { return mEntries.size(); }
+
+    iterator find(unsigned netId) {
+        iterator it = lowerBound(netId);
+        return (it != mEntries.end() && it->first == netId) ? it : mEntries.end();
+    }
+
+    const_iterator find(unsigned netId) const {
+        const_iterator it = const_cast<NetworkMap*>(this)->lowerBound(netId);
+        return (it != mEntries.end() && it->first == netId) ? it : mEntries.end();
+    }
+
+    Network*& operator[](unsigned netId) {
+        iterator it = lowerBound(netId);
+        if (it == mEntries.end() || it->first != netId) {
+            it = mEntries.insert(it, {netId, nullptr});
+        }
+        return it->second;
+    }
+
+    size_t erase(unsigned netId) {
+        iterator it = lowerBound(netId);
+        if (it == mEntries.end() || it->first != netId) {
+            return 0;
+        }
+        mEntries.erase(it);
+        return 1;
+    }
+
+  private:
+    iterator lowerBound(unsigned netId) {
+        return std::lower_bound(
+                mEntries.begin(), mEntries.end(), netId,
+                [](const value_type& entry, unsigned key) { return entry.first < key; });
+    }
+
+    std::vector<value_type> mEntries;
+};
+
 /*
  * Keeps track of default, per-pid, and per-uid-range network selection, as
  * well as the mark associated with each network. Networks are identified
@@ -99,12 +160,38 @@ public:
     unsigned getDefaultNetwork() const;
     [[nodiscard]] int setDefaultNetwork(unsigned netId);
 
-    unsigned getNetworkForUser(uid_t uid) const;
-    unsigned getNetworkForConnect(uid_t uid) const;
+    unsigned getNetworkForUser(uid_t uid) const NETD_HOT;
+    unsigned getNetworkForConnect(uid_t uid) const NETD_HOT;
     void getNetworkContext(unsigned netId, uid_t uid, struct android_net_context* netcontext) const;
     unsigned getNetworkForInterface(const char* interface) const;
     bool isVirtualNetwork(unsigned netId) const;
 
+    // A scoped read transaction over the network state. Construction takes the reader lock once;
+    // every lookup through the handle then answers from that one consistent state, so a caller
+    // that needs several answers pays a single lock acquisition and cannot observe a concurrent
+    // transition between its reads. Keep instances short-lived (they block writers for their
+    // whole lifetime) and never construct one while already inside a NetworkController call on
+    // the same thread.
+    class ReadTransaction {
+      public:
+        explicit ReadTransaction(const NetworkController& controller)
+            : mController(controller), mLock(controller.mRWLock) {}
+
+        ReadTransaction(const ReadTransaction&) = delete;
+        ReadTransaction& operator=(const ReadTransaction&) = delete;
+
+        unsigned getDefaultNetwork() const;
+        unsigned getNetworkForUser(uid_t uid) const;
+        Permission getPermissionForUser(uid_t uid) const;
+        int checkUserNetworkAccess(uid_t uid, unsigned netId) const;
+        bool canProtect(uid_t uid) const;
+        bool isVirtualNetwork(unsigned netId) const;
+
+      private:
+        const NetworkController& mController;
+        ScopedRLock mLock;
+    };
+
     [[nodiscard]] int createPhysicalNetwork(unsigned netId, Permission permission);
     [[nodiscard]] int createPhysicalOemNetwork(Permission permission, unsigned* netId);
     [[nodiscard]] int createVirtualNetwork(unsigned netId, bool secure, NativeVpnType vpnType,
@@ -114,16 +201,26 @@ public:
     [[nodiscard]] int addInterfaceToNetwork(unsigned netId, const char* interface);
     [[nodiscard]] int removeInterfaceFromNetwork(unsigned netId, const char* interface);
 
-    Permission getPermissionForUser(uid_t uid) const;
+    Permission getPermissionForUser(uid_t uid) const NETD_HOT;
     void setPermissionForUsers(Permission permission, const std::vector<uid_t>& uids);
-    int checkUserNetworkAccess(uid_t uid, unsigned netId) const;
+    int checkUserNetworkAccess(uid_t uid, unsigned netId) const NETD_HOT;
     [[nodiscard]] int setPermissionForNetworks(Permission permission,
                                                const std::vector<unsigned>& netIds);
 
-    [[nodiscard]] int addUsersToNetwork(unsigned netId, const UidRanges& uidRanges,
-                                        int32_t subPriority);
+    // Takes |uidRanges| by value so callers can move it all the way into the network's range map.
+    [[nodiscard]] int addUsersToNetwork(unsigned netId, UidRanges uidRanges, int32_t subPriority);
     [[nodiscard]] int removeUsersFromNetwork(unsigned netId, const UidRanges& uidRanges,
                                              int32_t subPriority);
+    // Replaces the UID ranges at |subPriority| with |uidRanges|, programming only the minimal
+    // add/remove delta against what is currently installed. See Network::updateUsers().
+    [[nodiscard]] int updateUsersOnNetwork(unsigned netId, const UidRanges& uidRanges,
+                                           int32_t subPriority);
+    // Versioned variant of updateUsersOnNetwork() for callers that send full-set updates from an
+    // asynchronous pipeline: an update whose |version| is not strictly greater than the last one
+    // applied to (netId, subPriority) is dropped, so out-of-order deliveries cannot roll the
+    // installed set back. Dropping a stale update is not an error and returns 0.
+    [[nodiscard]] int setUidRangesOnNetwork(unsigned netId, const UidRanges& uidRanges,
+                                            int32_t subPriority, int64_t version);
 
     // |nexthop| can be NULL (to indicate a directly-connected route), "unreachable" (to indicate a
     // route that's blocked), "throw" (to indicate the lack of a match), or a regular IP address.
@@ -143,11 +240,37 @@ public:
     // Returns true if we should destroy sockets on this address.
     bool removeInterfaceAddress(unsigned ifIndex, const char* address);
 
-    bool canProtect(uid_t uid) const;
+    bool canProtect(uid_t uid) const NETD_HOT;
     void allowProtect(const std::vector<uid_t>& uids);
     void denyProtect(const std::vector<uid_t>& uids);
 
-    void dump(netdutils::DumpWriter& dw);
+    void dump(netdutils::DumpWriter& dw) NETD_COLD;
+
+    // Warm-restart support. restoreFromStateJournal() replays the network topology (networks,
+    // their interfaces, permissions and the default network) recorded by a previous netd instance
+    // through the normal creation paths, so basic connectivity returns without waiting for the
+    // framework to replay it. enableStateJournal() then keeps |journal| updated after every
+    // topology mutation; it must be called after restore, or the restore's own mutations would
+    // rewrite the journal while it is being replayed. Both are meant to run single-threaded at
+    // startup, before any service that mutates networks is registered.
+    [[nodiscard]] int restoreFromStateJournal(const StateJournal* journal);
+    void enableStateJournal(StateJournal* journal);
+
+    // A compact fingerprint of one explicitly created network's programmed state, computed from
+    // the same books the state journal serializes plus the UID range map. After reconnecting to
+    // netd, the framework compares these against the digests it recorded after its last push and
+    // re-pushes only the networks (and only the aspects) that diverged, instead of replaying
+    // everything. Digests are only comparable against digests from this netd instance; any
+    // mismatch, including a format change across netd versions, simply causes a re-push.
+    struct NetworkDigest {
+        unsigned netId;
+        // Network type, permission (physical) or secure/exclude-local-routes (virtual), and
+        // whether this is the default network.
+        uint64_t attributesDigest;
+        uint64_t interfacesDigest;
+        uint64_t uidRangesDigest;
+    };
+    void getNetworkDigests(std::vector<NetworkDigest>* digests) const;
 
   private:
     bool isValidNetworkLocked(unsigned netId) const;
@@ -158,12 +281,14 @@ public:
     // fwmark value to set on the socket when performing the DNS request.
     uint32_t getNetworkForDnsLocked(unsigned* netId, uid_t uid) const;
     unsigned getNetworkForConnectLocked(uid_t uid) const;
+    unsigned getNetworkForUserLocked(uid_t uid) const;
     unsigned getNetworkForInterfaceLocked(const char* interface) const;
     bool canProtectLocked(uid_t uid) const;
     bool isVirtualNetworkLocked(unsigned netId) const;
     VirtualNetwork* getVirtualNetworkForUserLocked(uid_t uid) const;
     Network* getPhysicalOrUnreachableNetworkForUserLocked(uid_t uid) const;
     Permission getPermissionForUserLocked(uid_t uid) const;
+    void rebuildPermissionIndexLocked();
     int checkUserNetworkAccessLocked(uid_t uid, unsigned netId) const;
     [[nodiscard]] int createPhysicalNetworkLocked(unsigned netId, Permission permission);
 
@@ -173,15 +298,65 @@ public:
     [[nodiscard]] int modifyFallthroughLocked(unsigned vpnNetId, bool add);
     void updateTcpSocketMonitorPolling();
 
+    // Serializes the network topology for the state journal, and writes it out if a journal has
+    // been enabled. Called at the end of every successful topology mutation.
+    std::string serializeStateLocked() const;
+    void saveStateLocked() const;
+
+    // Immutable snapshot of the state consulted by getNetworkForConnect(): the default netId and
+    // the per-app default networks (physical or unreachable networks with UID ranges). Write
+    // operations rebuild the snapshot under mRWLock and publish it with std::atomic_store, so the
+    // connect-time lookup - which runs for every marked connect() on the device - never takes
+    // mRWLock and never contends with writers or other readers on the lock's cache line.
+    struct ConnectSnapshot {
+        unsigned defaultNetId = NETID_UNSET;
+        // Interval index over the per-app default networks: uidNetIds[i] is the per-app default
+        // netId (or NETID_UNSET if there is none) for UIDs in [uidBoundaries[i],
+        // uidBoundaries[i+1]), with the last span ending at uidBoundaries.back() - 1 inclusive.
+        // Overlaps between networks' UID ranges are already resolved in selection order (see
+        // getPhysicalOrUnreachableNetworkForUserLocked()), so a lookup is a single binary search
+        // no matter how many networks or ranges exist.
+        std::vector<uid_t> uidBoundaries;
+        std::vector<unsigned> uidNetIds;
+    };
+    void publishConnectSnapshotLocked();
+
+    // Shared-memory mirror of the connect snapshot plus the permission and virtual-network
+    // tables, mapped at FWMARK_SNAPSHOT_PATH so that libnetd_client can compute connect-time
+    // marks without a fwmark server round-trip. See include/FwmarkSnapshot.h for the layout and
+    // consistency protocol. nullptr if the mapping could not be created; written only while
+    // holding mRWLock for writing.
+    void initSharedSnapshot();
+    void writeSharedSnapshotLocked(const ConnectSnapshot& snapshot);
+    FwmarkSnapshot* mSharedSnapshot = nullptr;
+
     class DelegateImpl;
     DelegateImpl* const mDelegateImpl;
 
+    // The state journal, or nullptr if warm restart is disabled. Set once at startup via
+    // enableStateJournal(); written only while holding mRWLock for writing.
+    StateJournal* mJournal = nullptr;
+
     // mRWLock guards all accesses to mDefaultNetId, mNetworks, mUsers, mProtectableUsers,
     // mIfindexToLastNetId and mAddressToIfindices.
     mutable std::shared_mutex mRWLock;
     unsigned mDefaultNetId;
-    std::map<unsigned, Network*> mNetworks;  // Map keys are NetIds.
+    NetworkMap mNetworks;  // Map keys are NetIds.
+    // Last version applied per (netId, subPriority) by setUidRangesOnNetwork(). Entries are
+    // erased when the network is destroyed so a reused netId starts its sequence fresh. Guarded
+    // by mRWLock.
+    std::map<std::pair<unsigned, int32_t>, int64_t> mUidRangeVersions;
     std::map<uid_t, Permission> mUsers;
+
+    // Two-level index over uid space mirroring mUsers, so the per-connect permission fetch in
+    // getPermissionForUserLocked() is two indexed loads instead of a std::map find. Each page
+    // covers 256 uids and is only materialized where explicit entries exist; 0xff marks uids
+    // that fall through to the uid-range default. Rebuilt by setPermissionForUsers, the only
+    // writer of mUsers, and guarded by mRWLock like the map it shadows.
+    static constexpr int kPermissionPageShift = 8;
+    static constexpr size_t kPermissionPageSize = 1 << kPermissionPageShift;
+    static constexpr uint8_t kNoExplicitPermission = 0xff;
+    std::vector<std::unique_ptr<std::array<uint8_t, kPermissionPageSize>>> mUserPermissionPages;
     std::set<uid_t> mProtectableUsers;
     // Map interface (ifIndex) to its current NetId, or the last NetId if the interface was removed
     // from the network and not added to another network. This state facilitates the interface to
@@ -190,6 +365,12 @@ public:
     // An interface is added to this map when it is added to a network and removed from this map
     // when its network is destroyed.
     std::unordered_map<unsigned, unsigned> mIfindexToLastNetId;
+    // Map interned interface-name id (see InterfaceNames) to the NetId of the network the
+    // interface currently belongs to. Mirrors the per-network interface sets so that
+    // getNetworkForInterfaceLocked() is one lookup instead of a scan over every network; entries
+    // are added in addInterfaceToNetwork() and removed in removeInterfaceFromNetwork() and
+    // destroyNetwork().
+    std::unordered_map<uint16_t, unsigned> mIfaceIdToNetId;
     // Map IP address to the list of active interfaces (ifIndex) that have that address.
     // Also contains IP addresses configured on interfaces that have not been added to any network.
     // TODO: Does not track IP addresses present when netd is started or restarts after a crash.
@@ -197,6 +378,17 @@ public:
     // we should fix it.
     std::unordered_map<std::string, std::unordered_set<unsigned>> mAddressToIfindices;
 
+    // Memoized results of the common getNetworkForDnsLocked() fast path (no netId specified and
+    // no VPN applies to the uid), directly mapped by uid modulo the table size. Each entry is one
+    // word: the uid in the low 32 bits, the resolved netId in the high bits; 0 means empty.
+    // Entries are filled by queries racing under the read lock (every interleaving of whole-word
+    // stores leaves a self-consistent entry) and the table is cleared wholesale under the write
+    // lock by publishConnectSnapshotLocked(), so hits need no generation check.
+    static constexpr size_t kDnsMemoSize = 64;
+    mutable std::array<std::atomic<uint64_t>, kDnsMemoSize> mDnsMemo = {};
+
+    // Accessed only via std::atomic_load/std::atomic_store; see publishConnectSnapshotLocked().
+    std::shared_ptr<const ConnectSnapshot> mConnectSnapshot;
 };
 
 }  // namespace android::net
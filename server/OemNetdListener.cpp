@@ -18,18 +18,60 @@
 
 #include "OemNetdListener.h"
 
+#include <errno.h>
+
+#include <map>
+#include <set>
+
+#include <android/net/INetd.h>
+#include <binder/ParcelFileDescriptor.h>
+#include <log/log.h>
+#include <utils/String8.h>
+
+#include "Controllers.h"
+#include "InterfaceController.h"
+#include "RouteController.h"
+#include "SockDiag.h"
+#include "UidRanges.h"
+#include "binder_utils/BinderUtil.h"
+#include "binder_utils/NetdPermissions.h"
+
 namespace com {
 namespace android {
 namespace internal {
 namespace net {
 
-::android::sp<::android::IBinder> OemNetdListener::getListener() {
+namespace {
+
+constexpr bool kLegacyRoute = false;
+constexpr uid_t kNoUid = 0;  // UID is only meaningful for legacy routes.
+
+}  // namespace
+
+::android::sp<OemNetdListener> OemNetdListener::getInstance() {
     // Thread-safe initialization.
-    static ::android::sp<OemNetdListener> listener = ::android::sp<OemNetdListener>::make();
-    static ::android::sp<::android::IBinder> sIBinder = ::android::IInterface::asBinder(listener);
+    static ::android::sp<OemNetdListener> instance = ::android::sp<OemNetdListener>::make();
+    return instance;
+}
+
+::android::sp<::android::IBinder> OemNetdListener::getListener() {
+    static ::android::sp<::android::IBinder> sIBinder =
+            ::android::IInterface::asBinder(getInstance());
     return sIBinder;
 }
 
+void OemNetdListener::notifyNetlinkQueueOverflow(int netlinkFamily) {
+    getInstance()->notifyNetlinkQueueOverflowInternal(netlinkFamily);
+}
+
+void OemNetdListener::notifyNetlinkQueueOverflowInternal(int netlinkFamily) {
+    std::lock_guard lock(mOemUnsolicitedMutex);
+    for (const auto& [listener, deathRecipient] : mOemUnsolListenerMap) {
+        // Oneway call; a dead listener is reaped by its death recipient.
+        listener->onNetlinkQueueOverflow(netlinkFamily);
+    }
+}
+
 ::android::binder::Status OemNetdListener::isAlive(bool* alive) {
     *alive = true;
     return ::android::binder::Status::ok();
@@ -75,6 +117,286 @@ void OemNetdListener::unregisterOemUnsolicitedEventListenerInternal(
     mOemUnsolListenerMap.erase(listener);
 }
 
+::android::binder::Status OemNetdListener::networkAddRemoveRoutes(
+        int32_t netId, const std::vector<OemRouteParcel>& added,
+        const std::vector<OemRouteParcel>& removed) {
+    ::android::binder::Status status =
+            checkAnyPermission({PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK});
+    if (!status.isOk()) {
+        return status;
+    }
+
+    // Attempt every change even if one fails, the way a caller looping over the single-route
+    // calls would, and report the first error. Additions run first so that replacing a route set
+    // never leaves a window with no route.
+    int ret = 0;
+    for (const OemRouteParcel& route : added) {
+        int res = ::android::net::gCtls->netCtrl.addRoute(
+                netId, route.ifName.c_str(), route.destination.c_str(),
+                route.nextHop.empty() ? nullptr : route.nextHop.c_str(), kLegacyRoute, kNoUid,
+                route.mtu);
+        if (ret == 0) ret = res;
+    }
+    for (const OemRouteParcel& route : removed) {
+        int res = ::android::net::gCtls->netCtrl.removeRoute(
+                netId, route.ifName.c_str(), route.destination.c_str(),
+                route.nextHop.empty() ? nullptr : route.nextHop.c_str(), kLegacyRoute, kNoUid);
+        if (ret == 0) ret = res;
+    }
+    // When asynchronous route programming is enabled the calls above only enqueued the changes;
+    // collect any kernel error so the transaction's verdict covers the whole set.
+    int res = ::android::net::RouteController::waitForPendingRoutes();
+    if (ret == 0) ret = res;
+
+    return statusFromErrcode(ret);
+}
+
+::android::binder::Status OemNetdListener::getInterfaceStats(const std::string& ifName,
+                                                             OemInterfaceStatsParcel* stats) {
+    ::android::binder::Status status =
+            checkAnyPermission({PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK});
+    if (!status.isOk()) {
+        return status;
+    }
+
+    auto result = ::android::net::InterfaceController::getIfaceStats(ifName);
+    if (!::android::netdutils::isOk(result)) {
+        return statusFromErrcode(-result.status().code());
+    }
+    stats->ifName = ifName;
+    stats->rxBytes = result.value().rxBytes;
+    stats->rxPackets = result.value().rxPackets;
+    stats->txBytes = result.value().txBytes;
+    stats->txPackets = result.value().txPackets;
+    return ::android::binder::Status::ok();
+}
+
+::android::binder::Status OemNetdListener::countSocketsToDestroy(
+        const std::vector<int32_t>& uidRangeFirst, const std::vector<int32_t>& uidRangeLast,
+        const std::vector<int32_t>& skipUids, std::vector<int32_t>* counts) {
+    ::android::binder::Status status =
+            checkAnyPermission({PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK});
+    if (!status.isOk()) {
+        return status;
+    }
+
+    if (uidRangeFirst.size() != uidRangeLast.size()) {
+        return statusFromErrcode(-EINVAL);
+    }
+    std::vector<::android::net::UidRangeParcel> ranges;
+    ranges.reserve(uidRangeFirst.size());
+    for (size_t i = 0; i < uidRangeFirst.size(); ++i) {
+        ::android::net::UidRangeParcel range;
+        range.start = uidRangeFirst[i];
+        range.stop = uidRangeLast[i];
+        ranges.push_back(range);
+    }
+    ::android::net::UidRanges uidRanges(std::move(ranges));
+
+    ::android::net::SockDiag sd;
+    if (!sd.open()) {
+        return ::android::binder::Status::fromServiceSpecificError(
+                EIO, ::android::String8("Could not open SOCK_DIAG socket"));
+    }
+
+    // Same filter as INetd.socketDestroy(), including its excludeLoopback behavior, so the
+    // counts predict exactly what a destroy with these arguments would do.
+    std::map<uid_t, int> countMap;
+    int ret = sd.countSocketsToDestroy(uidRanges,
+                                       std::set<uid_t>(skipUids.begin(), skipUids.end()),
+                                       true /* excludeLoopback */, &countMap);
+    if (ret) {
+        return statusFromErrcode(ret);
+    }
+    counts->clear();
+    counts->reserve(countMap.size() * 2);
+    for (const auto& [uid, count] : countMap) {
+        counts->push_back(uid);
+        counts->push_back(count);
+    }
+    return ::android::binder::Status::ok();
+}
+
+::android::binder::Status OemNetdListener::networkSetUidRanges(
+        int32_t netId, const std::vector<int32_t>& uidRangeFirst,
+        const std::vector<int32_t>& uidRangeLast, int32_t subPriority, int64_t version) {
+    ::android::binder::Status status =
+            checkAnyPermission({PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK});
+    if (!status.isOk()) {
+        return status;
+    }
+
+    if (uidRangeFirst.size() != uidRangeLast.size()) {
+        return statusFromErrcode(-EINVAL);
+    }
+    std::vector<::android::net::UidRangeParcel> ranges;
+    ranges.reserve(uidRangeFirst.size());
+    for (size_t i = 0; i < uidRangeFirst.size(); ++i) {
+        ::android::net::UidRangeParcel range;
+        range.start = uidRangeFirst[i];
+        range.stop = uidRangeLast[i];
+        ranges.push_back(range);
+    }
+
+    int ret = ::android::net::gCtls->netCtrl.setUidRangesOnNetwork(
+            netId, ::android::net::UidRanges(std::move(ranges)), subPriority, version);
+    return statusFromErrcode(ret);
+}
+
+::android::binder::Status OemNetdListener::getWakeupEventRing(OemWakeupRingParcel* ring) {
+    ::android::binder::Status status =
+            checkAnyPermission({PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK});
+    if (!status.isOk()) {
+        return status;
+    }
+
+    ::android::base::unique_fd ringFd;
+    ::android::base::unique_fd signalFd;
+    if (int ret = ::android::net::gCtls->wakeupEventRing.attach(&ringFd, &signalFd)) {
+        return statusFromErrcode(ret);
+    }
+    ring->ringFd = ::android::os::ParcelFileDescriptor(std::move(ringFd));
+    ring->signalFd = ::android::os::ParcelFileDescriptor(std::move(signalFd));
+    ring->recordSize = sizeof(::android::net::WakeupEventRing::Record);
+    ring->recordCount = ::android::net::WakeupEventRing::kRecordCount;
+    return ::android::binder::Status::ok();
+}
+
+::android::binder::Status OemNetdListener::getTcpHealthStats(
+        std::vector<OemTcpHealthStatsParcel>* stats) {
+    ::android::binder::Status status =
+            checkAnyPermission({PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK});
+    if (!status.isOk()) {
+        return status;
+    }
+
+    // A lock-free copy of the monitor's per-network slots; this never blocks on (or delays) the
+    // monitor's poll.
+    stats->clear();
+    for (const auto& aggregate :
+         ::android::net::gCtls->tcpSocketMonitor.healthStore().snapshot()) {
+        OemTcpHealthStatsParcel parcel;
+        parcel.netId = aggregate.netId;
+        parcel.updatedMs = aggregate.updatedMs;
+        parcel.sentPackets = aggregate.latest.sentPackets;
+        parcel.lostPackets = aggregate.latest.lostPackets;
+        parcel.avgRttUs = aggregate.latest.avgRttUs;
+        parcel.ewmaRttUs = aggregate.ewmaRttUs;
+        parcel.avgSentAckDiffMs = aggregate.latest.avgSentAckDiffMs;
+        parcel.sockets = aggregate.latest.sockets;
+        parcel.totalSentPackets = aggregate.totalSentPackets;
+        parcel.totalLostPackets = aggregate.totalLostPackets;
+        stats->push_back(parcel);
+    }
+    return ::android::binder::Status::ok();
+}
+
+::android::binder::Status OemNetdListener::networkGetProgrammedState(
+        std::vector<OemNetworkDigestParcel>* digests) {
+    ::android::binder::Status status =
+            checkAnyPermission({PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK});
+    if (!status.isOk()) {
+        return status;
+    }
+
+    std::vector<::android::net::NetworkController::NetworkDigest> state;
+    ::android::net::gCtls->netCtrl.getNetworkDigests(&state);
+    digests->clear();
+    digests->reserve(state.size());
+    for (const auto& entry : state) {
+        OemNetworkDigestParcel parcel;
+        parcel.netId = entry.netId;
+        parcel.attributesDigest = static_cast<int64_t>(entry.attributesDigest);
+        parcel.interfacesDigest = static_cast<int64_t>(entry.interfacesDigest);
+        parcel.uidRangesDigest = static_cast<int64_t>(entry.uidRangesDigest);
+        digests->push_back(parcel);
+    }
+    return ::android::binder::Status::ok();
+}
+
+void OemNetdListener::notifyAsyncOperationComplete(int32_t opId, int errorCode) {
+    if (opId == 0) {
+        if (errorCode != 0) {
+            ALOGW("async operation without opId failed: %s", strerror(-errorCode));
+        }
+        return;
+    }
+    std::lock_guard lock(mOemUnsolicitedMutex);
+    for (const auto& [listener, deathRecipient] : mOemUnsolListenerMap) {
+        listener->onAsyncOperationComplete(opId, errorCode);
+    }
+}
+
+::android::binder::Status OemNetdListener::idletimerAddInterfaceAsync(
+        const std::string& ifName, int32_t timeout, const std::string& classLabel, int32_t opId) {
+    // The returned status is dropped by the oneway transport; the callback is the only reply.
+    if (!checkAnyPermission({PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK}).isOk()) {
+        notifyAsyncOperationComplete(opId, -EPERM);
+        return ::android::binder::Status::ok();
+    }
+    ::android::net::gCtls->waitForDeferredInit();
+    int res;
+    {
+        std::lock_guard lock(::android::net::gCtls->idletimerCtrl.lock);
+        res = ::android::net::gCtls->idletimerCtrl.addInterfaceIdletimer(ifName.c_str(), timeout,
+                                                                         classLabel.c_str());
+    }
+    notifyAsyncOperationComplete(opId, res);
+    return ::android::binder::Status::ok();
+}
+
+::android::binder::Status OemNetdListener::idletimerRemoveInterfaceAsync(
+        const std::string& ifName, int32_t timeout, const std::string& classLabel, int32_t opId) {
+    if (!checkAnyPermission({PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK}).isOk()) {
+        notifyAsyncOperationComplete(opId, -EPERM);
+        return ::android::binder::Status::ok();
+    }
+    ::android::net::gCtls->waitForDeferredInit();
+    int res;
+    {
+        std::lock_guard lock(::android::net::gCtls->idletimerCtrl.lock);
+        res = ::android::net::gCtls->idletimerCtrl.removeInterfaceIdletimer(ifName.c_str(),
+                                                                            timeout,
+                                                                            classLabel.c_str());
+    }
+    notifyAsyncOperationComplete(opId, res);
+    return ::android::binder::Status::ok();
+}
+
+::android::binder::Status OemNetdListener::strictUidCleartextPenaltyAsync(int32_t uid,
+                                                                          int32_t policyPenalty,
+                                                                          int32_t opId) {
+    if (!checkAnyPermission({PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK}).isOk()) {
+        notifyAsyncOperationComplete(opId, -EPERM);
+        return ::android::binder::Status::ok();
+    }
+    // Same penalty mapping as INetd.strictUidCleartextPenalty.
+    StrictPenalty penalty;
+    switch (policyPenalty) {
+        case ::android::net::INetd::PENALTY_POLICY_REJECT:
+            penalty = REJECT;
+            break;
+        case ::android::net::INetd::PENALTY_POLICY_LOG:
+            penalty = LOG;
+            break;
+        case ::android::net::INetd::PENALTY_POLICY_ACCEPT:
+            penalty = ACCEPT;
+            break;
+        default:
+            notifyAsyncOperationComplete(opId, -EINVAL);
+            return ::android::binder::Status::ok();
+    }
+    ::android::net::gCtls->waitForDeferredInit();
+    int res;
+    {
+        std::lock_guard lock(::android::net::gCtls->strictCtrl.lock);
+        res = ::android::net::gCtls->strictCtrl.setUidCleartextPenalty(static_cast<uid_t>(uid),
+                                                                       penalty);
+    }
+    notifyAsyncOperationComplete(opId, res);
+    return ::android::binder::Status::ok();
+}
+
 }  // namespace net
 }  // namespace internal
 }  // namespace android
@@ -20,9 +20,16 @@
 #include <map>
 #include <mutex>
 
+#include <vector>
+
 #include <android-base/thread_annotations.h>
 #include "com/android/internal/net/BnOemNetd.h"
 #include "com/android/internal/net/IOemNetdUnsolicitedEventListener.h"
+#include "com/android/internal/net/OemInterfaceStatsParcel.h"
+#include "com/android/internal/net/OemNetworkDigestParcel.h"
+#include "com/android/internal/net/OemRouteParcel.h"
+#include "com/android/internal/net/OemTcpHealthStatsParcel.h"
+#include "com/android/internal/net/OemWakeupRingParcel.h"
 
 namespace com {
 namespace android {
@@ -38,11 +45,47 @@ class OemNetdListener : public BnOemNetd {
     ~OemNetdListener() = default;
     static ::android::sp<::android::IBinder> getListener();
 
+    // Broadcasts to every registered listener that one of netd's kernel netlink sockets
+    // overflowed and events from the given NETLINK_* family were dropped. Invoked from the
+    // netlink reactor thread via the overflow handler installed in main().
+    static void notifyNetlinkQueueOverflow(int netlinkFamily);
+
     ::android::binder::Status isAlive(bool* alive) override;
     ::android::binder::Status registerOemUnsolicitedEventListener(
             const ::android::sp<IOemNetdUnsolicitedEventListener>& listener) override;
+    ::android::binder::Status networkAddRemoveRoutes(int32_t netId,
+                                                     const std::vector<OemRouteParcel>& added,
+                                                     const std::vector<OemRouteParcel>& removed)
+            override;
+    ::android::binder::Status getInterfaceStats(const std::string& ifName,
+                                                OemInterfaceStatsParcel* stats) override;
+    ::android::binder::Status countSocketsToDestroy(const std::vector<int32_t>& uidRangeFirst,
+                                                    const std::vector<int32_t>& uidRangeLast,
+                                                    const std::vector<int32_t>& skipUids,
+                                                    std::vector<int32_t>* counts) override;
+    ::android::binder::Status networkSetUidRanges(int32_t netId,
+                                                  const std::vector<int32_t>& uidRangeFirst,
+                                                  const std::vector<int32_t>& uidRangeLast,
+                                                  int32_t subPriority, int64_t version) override;
+    ::android::binder::Status idletimerAddInterfaceAsync(const std::string& ifName,
+                                                         int32_t timeout,
+                                                         const std::string& classLabel,
+                                                         int32_t opId) override;
+    ::android::binder::Status idletimerRemoveInterfaceAsync(const std::string& ifName,
+                                                            int32_t timeout,
+                                                            const std::string& classLabel,
+                                                            int32_t opId) override;
+    ::android::binder::Status strictUidCleartextPenaltyAsync(int32_t uid, int32_t policyPenalty,
+                                                             int32_t opId) override;
+    ::android::binder::Status getWakeupEventRing(OemWakeupRingParcel* ring) override;
+    ::android::binder::Status getTcpHealthStats(
+            std::vector<OemTcpHealthStatsParcel>* stats) override;
+    ::android::binder::Status networkGetProgrammedState(
+            std::vector<OemNetworkDigestParcel>* digests) override;
 
   private:
+    static ::android::sp<OemNetdListener> getInstance();
+
     std::mutex mOemUnsolicitedMutex;
 
     OemUnsolListenerMap mOemUnsolListenerMap GUARDED_BY(mOemUnsolicitedMutex);
@@ -53,6 +96,11 @@ class OemNetdListener : public BnOemNetd {
     void unregisterOemUnsolicitedEventListenerInternal(
             const ::android::sp<IOemNetdUnsolicitedEventListener>& listener)
             EXCLUDES(mOemUnsolicitedMutex);
+    void notifyNetlinkQueueOverflowInternal(int netlinkFamily) EXCLUDES(mOemUnsolicitedMutex);
+
+    // Reports completion of a oneway operation to every registered listener. A zero |opId| means
+    // the caller declined the callback; errors are then only logged.
+    void notifyAsyncOperationComplete(int32_t opId, int errorCode) EXCLUDES(mOemUnsolicitedMutex);
 };
 
 }  // namespace net
@@ -111,24 +111,42 @@ int PhysicalNetwork::setPermission(Permission permission) {
     }
 
     destroySocketsLackingPermission(permission);
-    for (const std::string& interface : mInterfaces) {
-        if (int ret = RouteController::modifyPhysicalNetworkPermission(mNetId, interface.c_str(),
-                                                                       mPermission, permission)) {
-            ALOGE("failed to change permission on interface %s of netId %u from %x to %x",
-                  interface.c_str(), mNetId, mPermission, permission);
-            return ret;
-        }
-        invalidateRouteCache(interface);
-    }
-    if (mIsDefault) {
+    {
+        // A permission flip is a one-field fwmark change replayed across many rules (explicit
+        // network, output interface, default network, fallthrough - times two families, times
+        // interfaces). Queue the whole flip as one batched netlink stream: the new rules still
+        // precede the deletions of the old ones, so there is never a routing gap, and the window
+        // where both exist shrinks from one request/ack round trip per rule to the kernel
+        // processing back-to-back messages from a single send.
+        RouteController::RuleBatch batch;
         for (const std::string& interface : mInterfaces) {
-            if (int ret = addToDefault(mNetId, interface, permission, mDelegate)) {
+            if (int ret = RouteController::modifyPhysicalNetworkPermission(
+                        mNetId, interface.c_str(), mPermission, permission)) {
+                ALOGE("failed to change permission on interface %s of netId %u from %x to %x",
+                      interface.c_str(), mNetId, mPermission, permission);
                 return ret;
             }
-            if (int ret = removeFromDefault(mNetId, interface, mPermission, mDelegate)) {
-                return ret;
+        }
+        if (mIsDefault) {
+            for (const std::string& interface : mInterfaces) {
+                if (int ret = addToDefault(mNetId, interface, permission, mDelegate)) {
+                    return ret;
+                }
+                if (int ret = removeFromDefault(mNetId, interface, mPermission, mDelegate)) {
+                    return ret;
+                }
             }
         }
+        if (int ret = batch.flush()) {
+            ALOGE("failed to change permission on netId %u from %x to %x: %s", mNetId, mPermission,
+                  permission, strerror(-ret));
+            return ret;
+        }
+    }
+    // Only invalidate the destination caches once the new rules are actually in the kernel, or
+    // entries could be repopulated from the old state between the invalidation and the flip.
+    for (const std::string& interface : mInterfaces) {
+        invalidateRouteCache(interface);
     }
     // Destroy sockets again in case any were opened after we called destroySocketsLackingPermission
     // above and before we changed the permissions. These sockets won't be able to send any RST
@@ -164,29 +182,31 @@ int PhysicalNetwork::removeAsDefault() {
     return 0;
 }
 
-int PhysicalNetwork::addUsers(const UidRanges& uidRanges, int32_t subPriority) {
+int PhysicalNetwork::addUsers(UidRanges uidRanges, int32_t subPriority) {
     if (!isValidSubPriority(subPriority) || !canAddUidRanges(uidRanges)) {
         return -EINVAL;
     }
 
+    const UidRangeMap uidRangeMap = {{subPriority, uidRanges}};
     for (const std::string& interface : mInterfaces) {
-        int ret = RouteController::addUsersToPhysicalNetwork(mNetId, interface.c_str(),
-                                                             {{subPriority, uidRanges}});
+        int ret =
+                RouteController::addUsersToPhysicalNetwork(mNetId, interface.c_str(), uidRangeMap);
         if (ret) {
             ALOGE("failed to add users on interface %s of netId %u", interface.c_str(), mNetId);
             return ret;
         }
     }
-    addToUidRangeMap(uidRanges, subPriority);
+    addToUidRangeMap(std::move(uidRanges), subPriority);
     return 0;
 }
 
 int PhysicalNetwork::removeUsers(const UidRanges& uidRanges, int32_t subPriority) {
     if (!isValidSubPriority(subPriority)) return -EINVAL;
 
+    const UidRangeMap uidRangeMap = {{subPriority, uidRanges}};
     for (const std::string& interface : mInterfaces) {
         int ret = RouteController::removeUsersFromPhysicalNetwork(mNetId, interface.c_str(),
-                                                                  {{subPriority, uidRanges}});
+                                                                  uidRangeMap);
         if (ret) {
             ALOGE("failed to remove users on interface %s of netId %u", interface.c_str(), mNetId);
             return ret;
@@ -210,7 +230,7 @@ int PhysicalNetwork::addInterface(const std::string& interface) {
             return ret;
         }
     }
-    mInterfaces.insert(interface);
+    insertInterface(interface);
     return 0;
 }
 
@@ -232,7 +252,7 @@ int PhysicalNetwork::removeInterface(const std::string& interface) {
         ALOGE("failed to remove interface %s from netId %u", interface.c_str(), mNetId);
         return ret;
     }
-    mInterfaces.erase(interface);
+    eraseInterface(interface);
     return 0;
 }
 
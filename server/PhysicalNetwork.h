@@ -40,9 +40,14 @@ class PhysicalNetwork : public Network {
     Permission getPermission() const;
     [[nodiscard]] int setPermission(Permission permission);
 
+    // Destroys live sockets on this network whose UID lacks |permission|. setPermission() sweeps
+    // internally; callers that batch the rule reprogramming of several networks sweep once more
+    // after the batch reaches the kernel, to close the window the deferred flush reopens.
+    int destroySocketsLackingPermission(Permission permission);
+
     [[nodiscard]] int addAsDefault();
     [[nodiscard]] int removeAsDefault();
-    [[nodiscard]] int addUsers(const UidRanges& uidRanges, int32_t subPriority) override;
+    [[nodiscard]] int addUsers(UidRanges uidRanges, int32_t subPriority) override;
     [[nodiscard]] int removeUsers(const UidRanges& uidRanges, int32_t subPriority) override;
     bool isPhysical() override { return true; }
     bool canAddUsers() override { return true; }
@@ -51,7 +56,6 @@ class PhysicalNetwork : public Network {
     std::string getTypeString() const override { return "PHYSICAL"; };
     [[nodiscard]] int addInterface(const std::string& interface) override;
     [[nodiscard]] int removeInterface(const std::string& interface) override;
-    int destroySocketsLackingPermission(Permission permission);
     void invalidateRouteCache(const std::string& interface);
     bool isValidSubPriority(int32_t priority) override;
 
@@ -18,7 +18,6 @@
 
 #include <errno.h>
 #include <fcntl.h>
-#include <signal.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -26,6 +25,7 @@
 
 #include <chrono>
 #include <sstream>
+#include <thread>
 
 #include "android-base/stringprintf.h"
 #define LOG_TAG "Netd"
@@ -77,19 +77,7 @@ std::string formatDuration(std::chrono::milliseconds duration) {
             days, hrs.count(), mins.count(), secs.count(), duration.count());
 }
 
-}  // unnamed namespace
-
-void blockSigPipe() {
-    sigset_t mask;
-
-    sigemptyset(&mask);
-    sigaddset(&mask, SIGPIPE);
-    if (sigprocmask(SIG_BLOCK, &mask, nullptr) != 0) {
-        ALOGW("WARNING: SIGPIPE not blocked\n");
-    }
-}
-
-void writePidFile(const std::string& pidFile) {
+void writePidFileBlocking(const std::string& pidFile) {
     const std::string pid_buf(StringPrintf("%d\n", (int) getpid()));
 
     Fd pidFd = open(pidFile.c_str(), PID_FILE_FLAGS, PID_FILE_MODE);
@@ -117,6 +105,17 @@ void writePidFile(const std::string& pidFile) {
     rmFile.release();  // Don't delete the pid file :-)
 }
 
+}  // unnamed namespace
+
+void writePidFile(const std::string& pidFile) {
+    // The pid file is advisory: nothing in the system reads it synchronously at startup, only
+    // humans and debugging tools. So don't make the startup path - which ends with netd's
+    // services going live - wait on /data; a busy flash can stall a synchronous write here for
+    // tens of milliseconds. A crash leaves a stale pid file regardless of ordering, so the
+    // detached write changes nothing for readers.
+    std::thread([pidFile] { writePidFileBlocking(pidFile); }).detach();
+}
+
 void removePidFile(const std::string& pidFile) {
     unlink(pidFile.c_str());
 }
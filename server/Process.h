@@ -25,9 +25,8 @@ namespace android {
 namespace net {
 namespace process {
 
-// Does what is says on the tin.
-void blockSigPipe();
-
+// Writes getpid() to |pidFile| from a detached thread, so startup never waits on /data. The file
+// is advisory and for debugging only; see Process.cpp.
 void writePidFile(const std::string& pidFile);
 void removePidFile(const std::string& pidFile);
 
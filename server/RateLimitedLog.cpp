@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RateLimitedLog.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace android {
+namespace net {
+
+bool LogRateLimiter::shouldLog(uint32_t* suppressed) {
+    const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                std::chrono::steady_clock::now().time_since_epoch())
+                                .count();
+
+    // Whoever wins the CAS on the refill timestamp adds the tokens earned since the last refill;
+    // losers just proceed to spend. A loser racing past an in-progress refill at worst sees the
+    // bucket one token early or late, which only shifts which exact line gets dropped.
+    int64_t last = mLastRefillMs.load(std::memory_order_relaxed);
+    if (now - last >= mIntervalMs && mLastRefillMs.compare_exchange_strong(last, now)) {
+        const int32_t earned =
+                static_cast<int32_t>(std::min<int64_t>((now - last) / mIntervalMs, mBurst));
+        int32_t tokens = mTokens.load(std::memory_order_relaxed);
+        while (!mTokens.compare_exchange_weak(tokens, std::min(tokens + earned, mBurst))) {
+        }
+    }
+
+    int32_t tokens = mTokens.load(std::memory_order_relaxed);
+    do {
+        if (tokens <= 0) {
+            mSuppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    } while (!mTokens.compare_exchange_weak(tokens, tokens - 1));
+
+    *suppressed = mSuppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+}  // namespace net
+}  // namespace android
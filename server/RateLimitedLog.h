@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_SERVER_RATE_LIMITED_LOG_H
+#define NETD_SERVER_RATE_LIMITED_LOG_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace android {
+namespace net {
+
+// How many log lines a call site may emit back to back before rate limiting kicks in, and how
+// often a spent bucket earns a line back. Sized so that isolated failures always log in full
+// while a storm (one failing rule per route in a several-thousand-route flush, one line per
+// kernel netlink event during an interface flap) is cut to a few lines per second per site.
+constexpr int32_t kLogRateLimitBurst = 10;
+constexpr int64_t kLogRateLimitIntervalMs = 1000;
+
+// Per-call-site token bucket deciding whether a log line may be emitted. Lock-free: a suppressed
+// call costs a couple of relaxed atomic operations and, used via the macros below, never
+// evaluates its format arguments. Counting is approximate under heavy contention - this is a log
+// limiter, not an accounting primitive.
+class LogRateLimiter {
+  public:
+    constexpr LogRateLimiter(int32_t burst, int64_t intervalMs)
+        : mTokens(burst), mBurst(burst), mIntervalMs(intervalMs) {}
+
+    // Returns whether the caller may log now. On true, *suppressed is the number of calls
+    // dropped since the last emitted line, so the caller can annotate its output.
+    bool shouldLog(uint32_t* suppressed);
+
+  private:
+    std::atomic<int64_t> mLastRefillMs{0};
+    std::atomic<int32_t> mTokens;
+    std::atomic<uint32_t> mSuppressed{0};
+    const int32_t mBurst;
+    const int64_t mIntervalMs;
+};
+
+}  // namespace net
+}  // namespace android
+
+// Rate-limited drop-ins for ALOGE/ALOGW at call sites that can log once per element of a storm
+// (per netlink rule, per route, per kernel event). The format arguments are only evaluated when
+// the line is actually emitted, so diagnosing a storm does not amplify it. When lines were
+// suppressed, the next emitted line is followed by a note saying how many.
+#define ALOGE_RATELIMITED(...) NETD_LOG_RATELIMITED(ALOGE, __VA_ARGS__)
+#define ALOGW_RATELIMITED(...) NETD_LOG_RATELIMITED(ALOGW, __VA_ARGS__)
+
+// Guards an arbitrary logging statement (e.g. libbase's streaming LOG(ERROR) << ...) with a
+// per-call-site bucket. The suppressed count is not reported on this path.
+#define LOG_STATEMENT_RATELIMITED(statement)                                              \
+    do {                                                                                  \
+        static ::android::net::LogRateLimiter _netdLogLimiter(                            \
+                ::android::net::kLogRateLimitBurst, ::android::net::kLogRateLimitIntervalMs); \
+        uint32_t _netdLogSuppressed = 0;                                                  \
+        if (_netdLogLimiter.shouldLog(&_netdLogSuppressed)) {                             \
+            statement;                                                                    \
+        }                                                                                 \
+    } while (0)
+
+#define NETD_LOG_RATELIMITED(emit, ...)                                                   \
+    do {                                                                                  \
+        static ::android::net::LogRateLimiter _netdLogLimiter(                            \
+                ::android::net::kLogRateLimitBurst, ::android::net::kLogRateLimitIntervalMs); \
+        uint32_t _netdLogSuppressed = 0;                                                  \
+        if (_netdLogLimiter.shouldLog(&_netdLogSuppressed)) {                             \
+            emit(__VA_ARGS__);                                                            \
+            if (_netdLogSuppressed > 0) {                                                 \
+                emit("(%u similar log lines suppressed)", _netdLogSuppressed);            \
+            }                                                                             \
+        }                                                                                 \
+    } while (0)
+
+#endif  // NETD_SERVER_RATE_LIMITED_LOG_H
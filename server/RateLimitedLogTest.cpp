@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RateLimitedLog.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+namespace android {
+namespace net {
+
+TEST(LogRateLimiterTest, BurstThenSuppression) {
+    // A long interval so the bucket cannot refill during the test.
+    LogRateLimiter limiter(3, 1'000'000);
+    uint32_t suppressed;
+
+    for (int i = 0; i < 3; ++i) {
+        suppressed = 42;
+        EXPECT_TRUE(limiter.shouldLog(&suppressed));
+        EXPECT_EQ(0U, suppressed);
+    }
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_FALSE(limiter.shouldLog(&suppressed));
+    }
+}
+
+TEST(LogRateLimiterTest, RefillReportsSuppressedCount) {
+    // A short interval so the bucket refills within the test, with a generous sleep so timing
+    // jitter can't starve the refill.
+    LogRateLimiter limiter(1, 5);
+    uint32_t suppressed = 42;
+
+    EXPECT_TRUE(limiter.shouldLog(&suppressed));
+    for (int i = 0; i < 7; ++i) {
+        EXPECT_FALSE(limiter.shouldLog(&suppressed));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_TRUE(limiter.shouldLog(&suppressed));
+    EXPECT_EQ(7U, suppressed);
+}
+
+TEST(LogRateLimiterTest, SuppressedCallsDoNotEvaluateArguments) {
+    LogRateLimiter limiter(1, 1'000'000);
+    uint32_t suppressed;
+    EXPECT_TRUE(limiter.shouldLog(&suppressed));
+
+    // The macros only evaluate their format arguments once shouldLog() returns true; model that
+    // here and check the side effect never happens while the bucket is empty.
+    int evaluations = 0;
+    auto expensiveArgument = [&evaluations]() {
+        ++evaluations;
+        return "formatted";
+    };
+    for (int i = 0; i < 10; ++i) {
+        if (limiter.shouldLog(&suppressed)) {
+            expensiveArgument();
+        }
+    }
+    EXPECT_EQ(0, evaluations);
+}
+
+}  // namespace net
+}  // namespace android
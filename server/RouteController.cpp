@@ -14,23 +14,40 @@
  * limitations under the License.
  */
 
+#define ATRACE_TAG ATRACE_TAG_NETWORK
+
 #include "RouteController.h"
 
 #include <arpa/inet.h>
+#include <cutils/properties.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/fib_rules.h>
 #include <net/if.h>
 #include <netdutils/InternetAddresses.h>
 #include <private/android_filesystem_config.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <utils/Trace.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "DummyNetwork.h"
 #include "Fwmark.h"
+#include "LatencyWatchdog.h"
 #include "NetdConstants.h"
 #include "NetlinkCommands.h"
+#include "RateLimitedLog.h"
+#include "RouteIntentLog.h"
 #include "TcUtils.h"
 
 #include <android-base/file.h>
@@ -43,6 +60,7 @@
 using android::base::StartsWith;
 using android::base::StringPrintf;
 using android::base::WriteStringToFile;
+using android::netdutils::IPAddress;
 using android::netdutils::IPPrefix;
 
 namespace android::net {
@@ -62,8 +80,6 @@ const char* const ROUTE_TABLE_NAME_LEGACY_SYSTEM  = "legacy_system";
 const char* const ROUTE_TABLE_NAME_LOCAL = "local";
 const char* const ROUTE_TABLE_NAME_MAIN  = "main";
 
-const char* const RouteController::LOCAL_MANGLE_INPUT = "routectrl_mangle_INPUT";
-
 const IPPrefix V4_LOCAL_PREFIXES[] = {
         IPPrefix::forString("169.254.0.0/16"),  // Link Local
         IPPrefix::forString("100.64.0.0/10"),   // CGNAT
@@ -117,6 +133,38 @@ uint8_t PADDING_BUFFER[RTA_ALIGNTO] = {0, 0, 0, 0};
 constexpr bool EXPLICIT = true;
 constexpr bool IMPLICIT = false;
 
+// Preencoded fwmark match patterns for the rule classes whose match criteria are fully known at
+// compile time (see the RULE_PRIORITY_* list in RouteController.h). Rule classes that match a
+// runtime netId, permission or UID range still assemble their fwmark in place.
+constexpr uint32_t MASK_EXPLICIT = Fwmark::makeMark(NETID_UNSET, true /* explicitlySelected */);
+constexpr uint32_t MASK_PROTECTED =
+        Fwmark::makeMark(NETID_UNSET, false, true /* protectedFromVpn */);
+constexpr uint32_t MARK_SYSTEM =
+        Fwmark::makeMark(NETID_UNSET, false, false, PERMISSION_SYSTEM);
+
+struct RuleClass {
+    int32_t priority;
+    uint32_t table;
+    uint32_t fwmark;
+    uint32_t mask;
+};
+
+// The fixed rules installed once by RouteController::Init(). Encoding the complete
+// (priority, table, fwmark, mask) tuples here turns their construction into plain loads and
+// documents each class's match pattern in one place.
+constexpr RuleClass kLegacyRouteRules[] = {
+        // Allows legacy routes to override the default network, for all apps...
+        {RULE_PRIORITY_LEGACY_SYSTEM, ROUTE_TABLE_LEGACY_SYSTEM, FWMARK_NONE, MASK_EXPLICIT},
+        {RULE_PRIORITY_LEGACY_NETWORK, ROUTE_TABLE_LEGACY_NETWORK, FWMARK_NONE, MASK_EXPLICIT},
+        // ... and to override VPNs, for system apps only.
+        {RULE_PRIORITY_VPN_OVERRIDE_SYSTEM, ROUTE_TABLE_LEGACY_SYSTEM, MARK_SYSTEM,
+         MASK_EXPLICIT | MARK_SYSTEM},
+};
+
+// Looks up the local network for traffic that hasn't explicitly selected a network.
+constexpr RuleClass kLocalNetworkRule = {RULE_PRIORITY_LOCAL_NETWORK, ROUTE_TABLE_LOCAL_NETWORK,
+                                         FWMARK_NONE, MASK_EXPLICIT};
+
 // END CONSTANTS ----------------------------------------------------------------------------------
 
 static const char* actionName(uint16_t action) {
@@ -142,7 +190,7 @@ static uint32_t getRouteTableIndexFromGlobalRouteTableIndex(uint32_t index, bool
     return local ? index + localTableOffset : index;
 }
 
-// Caller must hold sInterfaceToTableLock.
+// Caller must hold sInterfaceToTableLock exclusively: a lookup miss inserts into the map.
 uint32_t RouteController::getRouteTableForInterfaceLocked(const char* interface, bool local) {
     // If we already know the routing table for this interface name, use it.
     // This ensures we can remove rules and routes for an interface that has been removed,
@@ -158,7 +206,7 @@ uint32_t RouteController::getRouteTableForInterfaceLocked(const char* interface,
     // "global table - ROUTE_TABLE_OFFSET_FROM_INDEX + ROUTE_TABLE_OFFSET_FROM_INDEX_FOR_LOCAL"
     auto iter = sInterfaceToTable.find(interface);
     if (iter != sInterfaceToTable.end()) {
-        return getRouteTableIndexFromGlobalRouteTableIndex(iter->second, local);
+        return getRouteTableIndexFromGlobalRouteTableIndex(iter->second.table, local);
     }
 
     uint32_t index = RouteController::ifNameToIndexFunction(interface);
@@ -167,12 +215,12 @@ uint32_t RouteController::getRouteTableForInterfaceLocked(const char* interface,
         return RT_TABLE_UNSPEC;
     }
     index += RouteController::ROUTE_TABLE_OFFSET_FROM_INDEX;
-    sInterfaceToTable[interface] = index;
+    sInterfaceToTable[interface] = {index, classifyInterfaceName(interface)};
     return getRouteTableIndexFromGlobalRouteTableIndex(index, local);
 }
 
 uint32_t RouteController::getIfIndex(const char* interface) {
-    std::lock_guard lock(sInterfaceToTableLock);
+    std::shared_lock lock(sInterfaceToTableLock);
 
     auto iter = sInterfaceToTable.find(interface);
     if (iter == sInterfaceToTable.end()) {
@@ -185,7 +233,7 @@ uint32_t RouteController::getIfIndex(const char* interface) {
     // way to know the interface index from this table. Return 0 here so callers of this method do
     // not get confused.
     // TODO: stop calling this method from any caller that only wants interfaces in client mode.
-    int ifindex = iter->second;
+    int ifindex = iter->second.table;
     if (ifindex == ROUTE_TABLE_LOCAL_NETWORK) {
         return 0;
     }
@@ -193,7 +241,41 @@ uint32_t RouteController::getIfIndex(const char* interface) {
     return ifindex - ROUTE_TABLE_OFFSET_FROM_INDEX;
 }
 
+// One pass over an interface name producing its IF_CLASS_* bits. This runs when an interface
+// first enters sInterfaceToTable (or on a lookup for an untracked name); everything after that
+// reads the cached bits instead of re-inspecting the name.
+uint32_t RouteController::classifyInterfaceName(const char* interface) {
+    uint32_t classes = 0;
+    if (StartsWith(interface, "v4-")) {
+        classes |= IF_CLASS_CLAT;
+    }
+    return classes;
+}
+
+uint32_t RouteController::getInterfaceClasses(const char* interface) {
+    {
+        std::shared_lock lock(sInterfaceToTableLock);
+        auto iter = sInterfaceToTable.find(interface);
+        if (iter != sInterfaceToTable.end()) {
+            return iter->second.classes;
+        }
+    }
+    // Not tracked (yet): classify the name directly. Deliberately does not populate the map, which
+    // only tracks interfaces with an assigned routing table.
+    return classifyInterfaceName(interface);
+}
+
 uint32_t RouteController::getRouteTableForInterface(const char* interface, bool local) {
+    {
+        // Fast path: almost every lookup hits the cache, and concurrent lookups from different
+        // binder threads should not serialize on an exclusive lock.
+        std::shared_lock lock(sInterfaceToTableLock);
+        auto iter = sInterfaceToTable.find(interface);
+        if (iter != sInterfaceToTable.end()) {
+            return getRouteTableIndexFromGlobalRouteTableIndex(iter->second.table, local);
+        }
+    }
+    // Cache miss: retry with the exclusive lock needed to populate the map.
     std::lock_guard lock(sInterfaceToTableLock);
     return getRouteTableForInterfaceLocked(interface, local);
 }
@@ -207,7 +289,67 @@ void addTableName(uint32_t table, const std::string& name, std::string* contents
     *contents += "\n";
 }
 
-// Doesn't return success/failure as the file is optional; it's okay if we fail to update it.
+namespace {
+
+// Writes RT_TABLES_PATH off the interface bring-up critical path, at most once per burst of table
+// changes. updateTableNamesFile() snapshots the desired contents and hands them over; the writer
+// thread then waits briefly for the rest of the burst, with each new snapshot replacing the
+// pending one, so an interface storm results in a single write of the final state instead of one
+// full flash rewrite per change. Contents identical to the last write are not rewritten at all.
+class TableNamesFileWriter {
+  public:
+    static TableNamesFileWriter& instance() {
+        // Deliberately never destroyed.
+        static TableNamesFileWriter* sInstance = new TableNamesFileWriter();
+        return *sInstance;
+    }
+
+    void write(std::string contents) {
+        std::lock_guard lock(mLock);
+        mPending = std::move(contents);
+        mDirty = true;
+        mWork.notify_one();
+    }
+
+  private:
+    static constexpr std::chrono::milliseconds kWriteDelay{100};
+
+    TableNamesFileWriter() { std::thread(&TableNamesFileWriter::loop, this).detach(); }
+
+    void loop() {
+        std::unique_lock lock(mLock);
+        while (true) {
+            mWork.wait(lock, [this] { return mDirty; });
+            // Absorb the rest of the burst before writing; later snapshots replace mPending.
+            mWork.wait_for(lock, kWriteDelay, [] { return false; });
+            const std::string contents = std::move(mPending);
+            mDirty = false;
+            lock.unlock();
+            if (contents != mLastWritten) {
+                if (WriteStringToFile(contents, RouteController::RT_TABLES_PATH, RT_TABLES_MODE,
+                                      AID_SYSTEM, AID_WIFI)) {
+                    mLastWritten = contents;  // Only touched on this thread.
+                } else {
+                    ALOGE("failed to write to %s (%s)", RouteController::RT_TABLES_PATH,
+                          strerror(errno));
+                }
+            }
+            lock.lock();
+        }
+    }
+
+    std::mutex mLock;
+    std::condition_variable mWork;
+    std::string mPending;
+    bool mDirty = false;
+    std::string mLastWritten;
+};
+
+}  // namespace
+
+// Doesn't return success/failure as the file is optional; it's okay if we fail to update it. The
+// write itself is deferred and coalesced (see TableNamesFileWriter); only the cheap snapshot of
+// the table names happens on the calling thread.
 void RouteController::updateTableNamesFile() {
     std::string contents;
 
@@ -218,20 +360,21 @@ void RouteController::updateTableNamesFile() {
     addTableName(ROUTE_TABLE_LEGACY_NETWORK, ROUTE_TABLE_NAME_LEGACY_NETWORK, &contents);
     addTableName(ROUTE_TABLE_LEGACY_SYSTEM,  ROUTE_TABLE_NAME_LEGACY_SYSTEM,  &contents);
 
-    std::lock_guard lock(sInterfaceToTableLock);
-    for (const auto& [ifName, ifIndex] : sInterfaceToTable) {
-        addTableName(ifIndex, ifName, &contents);
-        // Add table for the local route of the network. It's expected to be used for excluding the
-        // local traffic in the VPN network.
-        // Start from ROUTE_TABLE_OFFSET_FROM_INDEX_FOR_LOCAL plus with the interface table index.
-        uint32_t offset = ROUTE_TABLE_OFFSET_FROM_INDEX_FOR_LOCAL - ROUTE_TABLE_OFFSET_FROM_INDEX;
-        addTableName(offset + ifIndex, ifName + INTERFACE_LOCAL_SUFFIX, &contents);
+    {
+        std::shared_lock lock(sInterfaceToTableLock);
+        for (const auto& [ifName, info] : sInterfaceToTable) {
+            addTableName(info.table, ifName, &contents);
+            // Add table for the local route of the network. It's expected to be used for
+            // excluding the local traffic in the VPN network.
+            // Start from ROUTE_TABLE_OFFSET_FROM_INDEX_FOR_LOCAL plus with the interface table
+            // index.
+            uint32_t offset =
+                    ROUTE_TABLE_OFFSET_FROM_INDEX_FOR_LOCAL - ROUTE_TABLE_OFFSET_FROM_INDEX;
+            addTableName(offset + info.table, ifName + INTERFACE_LOCAL_SUFFIX, &contents);
+        }
     }
 
-    if (!WriteStringToFile(contents, RT_TABLES_PATH, RT_TABLES_MODE, AID_SYSTEM, AID_WIFI)) {
-        ALOGE("failed to write to %s (%s)", RT_TABLES_PATH, strerror(errno));
-        return;
-    }
+    TableNamesFileWriter::instance().write(std::move(contents));
 }
 
 // Returns 0 on success or negative errno on failure.
@@ -250,6 +393,160 @@ int padInterfaceName(const char* input, char* name, size_t* length, uint16_t* pa
     return 0;
 }
 
+// When non-null, modifyIpRule() on this thread appends rule changes to this batch instead of
+// sending each one to the kernel individually. See ScopedRuleBatch below.
+static thread_local NetlinkRequestBatch* sActiveRuleBatch = nullptr;
+
+// Whether netd is reconciling against kernel state that survived a restart rather than starting
+// from a flushed kernel. In this mode, rule and route adds that hit an identical object
+// (-EEXIST) are treated as success: the object the add would have created is already programmed,
+// so the kernel is in the intended state. Set once by Init() and never cleared, because
+// reconciliation continues after Init when the state journal and the framework replay the
+// topology on top of the surviving rules. See RouteController::Init().
+static bool sReconcileMode = false;
+
+// Whether route mutations are programmed asynchronously on a dedicated thread instead of blocking
+// the calling (binder) thread on the netlink round trip. Set once by Init() from
+// persist.netd.async_routes. See AsyncRouteWorker and RouteController::waitForPendingRoutes().
+static bool sAsyncRoutes = false;
+
+// While an instance is in scope, all FIB rule changes made via modifyIpRule() on the same thread
+// are queued and sent to the kernel as a single stream of netlink messages. This collapses
+// operations that program many rules (e.g. VPN bring-up with large UID ranges) from one
+// request/ack round-trip per rule into a handful of syscalls.
+//
+// Callers should call flush() where they would otherwise have checked the result of the last rule
+// change; it returns the first kernel error from the whole batch. Rules still queued when the
+// scope exits are sent anyway, with errors logged but not reported.
+//
+// Batches nest: an inner scope queues to its own batch and the outer batch becomes active again
+// when the inner scope exits, so a helper with its own batch can be called from a batched caller.
+class ScopedRuleBatch {
+  public:
+    ScopedRuleBatch() : mPrevious(sActiveRuleBatch) {
+        if (sReconcileMode) mBatch.tolerateExisting();
+        sActiveRuleBatch = &mBatch;
+    }
+    ~ScopedRuleBatch() {
+        sActiveRuleBatch = mPrevious;
+        if (mBatch.size() > 0) {
+            (void) mBatch.flush();
+        }
+    }
+    [[nodiscard]] int flush() { return mBatch.flush(); }
+
+  private:
+    NetlinkRequestBatch mBatch;
+    NetlinkRequestBatch* const mPrevious;
+};
+
+// Like ScopedRuleBatch, but when a batch is already active on this thread, joins it instead of
+// opening (and separately flushing) a nested one. For helpers that batch their own rules when
+// called standalone but should contribute to the caller's single kernel send when one is in
+// progress - e.g. the per-interface UID-rule updates under VirtualNetwork::addUsers().
+class JoinedRuleBatch {
+  public:
+    JoinedRuleBatch() {
+        if (sActiveRuleBatch == nullptr) mOwn.emplace();
+    }
+    // Returns 0 when joined to an outer batch; the outer flush reports the kernel's verdict.
+    [[nodiscard]] int flush() { return mOwn ? mOwn->flush() : 0; }
+
+  private:
+    std::optional<ScopedRuleBatch> mOwn;
+};
+
+// Public face of ScopedRuleBatch, for callers outside this file (e.g. NetworkController batching
+// a bulk permission push). Thin wrapper so the thread-local batch plumbing stays private.
+RouteController::RuleBatch::RuleBatch() : mImpl(std::make_unique<ScopedRuleBatch>()) {}
+
+RouteController::RuleBatch::~RuleBatch() = default;
+
+int RouteController::RuleBatch::flush() {
+    return mImpl->flush();
+}
+
+namespace {
+
+// Executes route mutations on a dedicated thread, strictly in enqueue order, so that the calling
+// thread does not block on one netlink round trip per route (the framework adds dozens of routes
+// back to back after RA processing). The kernel's verdict on a queued op can no longer reach the
+// caller, but the route was fully parsed and validated (parseRouteKey) before it was enqueued;
+// kernel-side failures are logged by modifyIpRoute() and remembered for the next sync(). Only
+// engaged when persist.netd.async_routes is set (see RouteController::Init).
+class AsyncRouteWorker {
+  public:
+    struct Op {
+        uint16_t action;
+        uint16_t flags;
+        uint32_t table;
+        RouteKey route;
+        uint32_t mtu;
+        uint32_t priority;
+    };
+
+    static AsyncRouteWorker& instance() {
+        // Deliberately never destroyed.
+        static AsyncRouteWorker* sInstance = new AsyncRouteWorker();
+        return *sInstance;
+    }
+
+    void enqueue(Op op) {
+        {
+            std::lock_guard lock(mLock);
+            mQueue.push_back(std::move(op));
+        }
+        mWork.notify_one();
+    }
+
+    // Blocks until every op enqueued so far has been pushed to the kernel, and returns the first
+    // error seen since the last call (0 if none).
+    int sync() {
+        std::unique_lock lock(mLock);
+        mIdle.wait(lock, [this] { return mQueue.empty() && !mBusy; });
+        const int ret = mFirstError;
+        mFirstError = 0;
+        return ret;
+    }
+
+  private:
+    AsyncRouteWorker() { std::thread(&AsyncRouteWorker::loop, this).detach(); }
+
+    void loop() {
+        std::unique_lock lock(mLock);
+        while (true) {
+            mWork.wait(lock, [this] { return !mQueue.empty(); });
+            Op op = std::move(mQueue.front());
+            mQueue.pop_front();
+            mBusy = true;
+            lock.unlock();
+
+            int ret = modifyIpRoute(op.action, op.flags, op.table, op.route, op.mtu, op.priority);
+            // Trying to add a route that already exists shouldn't cause an error.
+            if (op.action == RTM_NEWROUTE && ret == -EEXIST) ret = 0;
+
+            lock.lock();
+            mBusy = false;
+            if (ret != 0 && mFirstError == 0) mFirstError = ret;
+            if (mQueue.empty()) mIdle.notify_all();
+        }
+    }
+
+    std::mutex mLock;
+    std::condition_variable mWork;
+    std::condition_variable mIdle;
+    std::deque<Op> mQueue;
+    bool mBusy = false;  // True while an op has been dequeued but not yet pushed to the kernel.
+    int mFirstError = 0;
+};
+
+}  // namespace
+
+// Mirror of every rule/route modification attempted below, read lock-free by dump(). This is
+// what diagnostics consume instead of walking sInterfaceToTable or the kernel tables, so a bug
+// report never contends with the programming path.
+static RouteIntentLog sRouteIntentLog;
+
 // Adds or removes a routing rule for IPv4 and IPv6.
 //
 // + If |table| is non-zero, the rule points at the specified routing table. Otherwise, the table is
@@ -338,20 +635,38 @@ int padInterfaceName(const char* input, char* name, size_t* length, uint16_t* pa
     };
 
     uint16_t flags = (action == RTM_NEWRULE) ? NETLINK_RULE_CREATE_FLAGS : NETLINK_REQUEST_FLAGS;
-    for (size_t i = 0; i < ARRAY_SIZE(AF_FAMILIES); ++i) {
+    int res = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(AF_FAMILIES) && res == 0; ++i) {
         rule.family = AF_FAMILIES[i];
+        if (sActiveRuleBatch != nullptr) {
+            // Queue the request; any kernel error surfaces when the batch is flushed.
+            sActiveRuleBatch->append(action, flags, iov, ARRAY_SIZE(iov));
+            continue;
+        }
         if (int ret = sendNetlinkRequest(action, flags, iov, ARRAY_SIZE(iov), nullptr)) {
+            if (sReconcileMode && action == RTM_NEWRULE && ret == -EEXIST) {
+                // An identical rule survived the restart; the add is a converging no-op.
+                continue;
+            }
             if (!(action == RTM_DELRULE && ret == -ENOENT && priority == RULE_PRIORITY_TETHERING)) {
                 // Don't log when deleting a tethering rule that's not there. This matches the
                 // behaviour of clearTetheringRules, which ignores ENOENT in this case.
-                ALOGE("Error %s %s rule: %s", actionName(action), familyName(rule.family),
-                      strerror(-ret));
+                ALOGE_RATELIMITED("Error %s %s rule: %s", actionName(action),
+                                  familyName(rule.family), strerror(-ret));
             }
-            return ret;
+            res = ret;
         }
     }
 
-    return 0;
+    char uidRangeText[32] = "";
+    if (isUidRule) {
+        snprintf(uidRangeText, sizeof(uidRangeText), " uid %u-%u", uidStart, uidEnd);
+    }
+    sRouteIntentLog.record(res, "%s%s rule prio %d table %u fwmark 0x%x/0x%x iif %s oif %s%s",
+                           sActiveRuleBatch != nullptr ? "batch " : "", actionName(action),
+                           priority, table, fwmark, mask, iif != IIF_NONE ? iif : "-",
+                           oif != OIF_NONE ? oif : "-", uidRangeText);
+    return res;
 }
 
 [[nodiscard]] static int modifyIpRule(uint16_t action, int32_t priority, uint32_t table,
@@ -367,10 +682,123 @@ int padInterfaceName(const char* input, char* name, size_t* length, uint16_t* pa
                         INVALID_UID);
 }
 
-// Adds or deletes an IPv4 or IPv6 route.
-// Returns 0 on success or negative errno on failure.
-int modifyIpRoute(uint16_t action, uint16_t flags, uint32_t table, const char* interface,
-                  const char* destination, const char* nexthop, uint32_t mtu, uint32_t priority) {
+// One priority variant of a UID-range rule group. See modifyUidRuleGroup().
+struct UidRuleVariant {
+    int32_t priority;
+    uint32_t table;
+    uint32_t fwmark;
+    uint32_t mask;
+};
+
+// Programs the same UID range at several rule priorities in one pass.
+//
+// A per-app network installs near-identical rules for each UID range at the UID_EXPLICIT_NETWORK,
+// UID_IMPLICIT_NETWORK, UID_DEFAULT_NETWORK and UID_LOCAL_ROUTES priorities. They differ only in
+// priority, table and fwmark/mask; the rule header, the UID range attribute and the loopback iif
+// are identical. This assembles the shared parts once and stamps out the variants by rewriting
+// the four fields the iovec already points at, instead of re-running modifyIpRule()'s validation,
+// name padding and iovec setup for every rule. All variants are FR_ACT_TO_TBL rules matching
+// iif lo with no oif, which is the only shape the per-UID rules come in.
+[[nodiscard]] static int modifyUidRuleGroup(bool add, const UidRuleVariant* variants, size_t count,
+                                            uid_t uidStart, uid_t uidEnd) {
+    if ((uidStart == INVALID_UID) || (uidEnd == INVALID_UID)) {
+        ALOGE("modifyUidRuleGroup, invalid UIDs (%u, %u)", uidStart, uidEnd);
+        return -EUSERS;
+    }
+
+    char iifName[IFNAMSIZ];
+    size_t iifLength;
+    uint16_t iifPadding;
+    if (int ret = padInterfaceName(IIF_LOOPBACK, iifName, &iifLength, &iifPadding)) {
+        return ret;
+    }
+
+    fib_rule_hdr rule = {
+        .action = FR_ACT_TO_TBL,
+    };
+
+    rtattr fraIifName = { U16_RTA_LENGTH(iifLength), FRA_IIFNAME };
+    struct fib_rule_uid_range uidRange = { uidStart, uidEnd };
+
+    // Rewritten in place for each variant; everything else in the iovec is shared.
+    int32_t priority = 0;
+    uint32_t table = 0;
+    uint32_t fwmark = 0;
+    uint32_t mask = 0;
+
+    iovec iov[] = {
+        { nullptr,              0 },
+        { &rule,             sizeof(rule) },
+        { &FRATTR_PRIORITY,  sizeof(FRATTR_PRIORITY) },
+        { &priority,         sizeof(priority) },
+        { &FRATTR_TABLE,     sizeof(FRATTR_TABLE) },
+        { &table,            sizeof(table) },
+        { &FRATTR_FWMARK,    sizeof(FRATTR_FWMARK) },
+        { &fwmark,           sizeof(fwmark) },
+        { &FRATTR_FWMASK,    sizeof(FRATTR_FWMASK) },
+        { &mask,             sizeof(mask) },
+        { &FRATTR_UID_RANGE, sizeof(FRATTR_UID_RANGE) },
+        { &uidRange,         sizeof(uidRange) },
+        { &fraIifName,       sizeof(fraIifName) },
+        { iifName,           iifLength },
+        { PADDING_BUFFER,    iifPadding },
+    };
+
+    uint16_t action = add ? RTM_NEWRULE : RTM_DELRULE;
+    uint16_t flags = add ? NETLINK_RULE_CREATE_FLAGS : NETLINK_REQUEST_FLAGS;
+    for (size_t v = 0; v < count; ++v) {
+        if (variants[v].priority < 0) {
+            ALOGE("invalid IP-rule priority %d", variants[v].priority);
+            return -ERANGE;
+        }
+        if (variants[v].fwmark & ~variants[v].mask) {
+            ALOGE("mask 0x%x does not select all the bits set in fwmark 0x%x", variants[v].mask,
+                  variants[v].fwmark);
+            return -ERANGE;
+        }
+        if (variants[v].table == RT_TABLE_UNSPEC && add) {
+            ALOGE("RT_TABLE_UNSPEC only allowed when deleting rules");
+            return -ENOTUNIQ;
+        }
+        priority = variants[v].priority;
+        table = variants[v].table;
+        fwmark = variants[v].fwmark;
+        mask = variants[v].mask;
+        int res = 0;
+        for (size_t i = 0; i < ARRAY_SIZE(AF_FAMILIES) && res == 0; ++i) {
+            rule.family = AF_FAMILIES[i];
+            if (sActiveRuleBatch != nullptr) {
+                // Queue the request; any kernel error surfaces when the batch is flushed.
+                sActiveRuleBatch->append(action, flags, iov, ARRAY_SIZE(iov));
+                continue;
+            }
+            if (int ret = sendNetlinkRequest(action, flags, iov, ARRAY_SIZE(iov), nullptr)) {
+                if (sReconcileMode && action == RTM_NEWRULE && ret == -EEXIST) {
+                    // An identical rule survived the restart; the add is a converging no-op.
+                    continue;
+                }
+                ALOGE_RATELIMITED("Error %s %s rule: %s", actionName(action),
+                                  familyName(rule.family), strerror(-ret));
+                res = ret;
+            }
+        }
+        sRouteIntentLog.record(res, "%s%s rule prio %d table %u fwmark 0x%x/0x%x uid %u-%u",
+                               sActiveRuleBatch != nullptr ? "batch " : "", actionName(action),
+                               priority, table, fwmark, mask, uidStart, uidEnd);
+        if (res != 0) {
+            return res;
+        }
+    }
+
+    return 0;
+}
+
+// Parses the string form of a route into a RouteKey. Returns 0 on success or negative errno on
+// failure.
+int parseRouteKey(const char* interface, const char* destination, const char* nexthop,
+                  RouteKey* route) {
+    *route = {};
+
     // At least the destination must be non-null.
     if (!destination) {
         ALOGE("null destination");
@@ -378,77 +806,84 @@ int modifyIpRoute(uint16_t action, uint16_t flags, uint32_t table, const char* i
     }
 
     // Parse the prefix.
-    uint8_t rawAddress[sizeof(in6_addr)];
-    uint8_t family;
-    uint8_t prefixLength;
-    int rawLength = parsePrefix(destination, &family, rawAddress, sizeof(rawAddress),
-                                &prefixLength);
+    int rawLength = parsePrefix(destination, &route->family, route->address,
+                                sizeof(route->address), &route->prefixLength);
     if (rawLength < 0) {
         ALOGE("parsePrefix failed for destination %s (%s)", destination, strerror(-rawLength));
         return rawLength;
     }
 
-    if (static_cast<size_t>(rawLength) > sizeof(rawAddress)) {
-        ALOGE("impossible! address too long (%d vs %zu)", rawLength, sizeof(rawAddress));
+    if (static_cast<size_t>(rawLength) > sizeof(route->address)) {
+        ALOGE("impossible! address too long (%d vs %zu)", rawLength, sizeof(route->address));
         return -ENOBUFS;  // Cannot happen; parsePrefix only supports IPv4 and IPv6.
     }
-
-    uint8_t type = RTN_UNICAST;
-    uint32_t ifindex;
-    uint8_t rawNexthop[sizeof(in6_addr)];
+    route->rawLength = rawLength;
+    route->type = RTN_UNICAST;
 
     if (nexthop && !strcmp(nexthop, "unreachable")) {
-        type = RTN_UNREACHABLE;
-        // 'interface' is likely non-NULL, as the caller (modifyRoute()) likely used it to lookup
-        // the table number. But it's an error to specify an interface ("dev ...") or a nexthop for
-        // unreachable routes, so nuke them. (IPv6 allows them to be specified; IPv4 doesn't.)
-        interface = OIF_NONE;
-        nexthop = nullptr;
+        // 'interface' is likely non-NULL, as the caller likely used it to look up the table
+        // number. But it's an error to specify an interface ("dev ...") or a nexthop for
+        // unreachable routes, so leave them unset. (IPv6 allows them to be specified; IPv4
+        // doesn't.)
+        route->type = RTN_UNREACHABLE;
     } else if (nexthop && !strcmp(nexthop, "throw")) {
-        type = RTN_THROW;
-        interface = OIF_NONE;
-        nexthop = nullptr;
+        route->type = RTN_THROW;
     } else {
         // If an interface was specified, find the ifindex.
         if (interface != OIF_NONE) {
-            ifindex = RouteController::ifNameToIndexFunction(interface);
+            route->ifindex = RouteController::ifNameToIndexFunction(interface);
 
-            if (!ifindex) {
+            if (!route->ifindex) {
                 ALOGE("cannot find interface %s", interface);
                 return -ENODEV;
             }
         }
 
         // If a nexthop was specified, parse it as the same family as the prefix.
-        if (nexthop && inet_pton(family, nexthop, rawNexthop) <= 0) {
-            ALOGE("inet_pton failed for nexthop %s", nexthop);
-            return -EINVAL;
+        if (nexthop) {
+            if (inet_pton(route->family, nexthop, route->nexthop) <= 0) {
+                ALOGE("inet_pton failed for nexthop %s", nexthop);
+                return -EINVAL;
+            }
+            route->hasNexthop = true;
         }
     }
 
+    return 0;
+}
+
+// Adds or deletes an IPv4 or IPv6 route that has already been parsed into a RouteKey.
+// Returns 0 on success or negative errno on failure.
+int modifyIpRoute(uint16_t action, uint16_t flags, uint32_t table, const RouteKey& route,
+                  uint32_t mtu, uint32_t priority) {
+    const bool hasOif = (route.ifindex != 0);
+    uint32_t ifindex = route.ifindex;
+
     // Assemble a rtmsg and put it in an array of iovec structures.
-    rtmsg route = {
-            .rtm_family = family,
-            .rtm_dst_len = prefixLength,
+    rtmsg msg = {
+            .rtm_family = route.family,
+            .rtm_dst_len = route.prefixLength,
             .rtm_protocol = RTPROT_STATIC,
-            .rtm_scope = static_cast<uint8_t>(nexthop ? RT_SCOPE_UNIVERSE : RT_SCOPE_LINK),
-            .rtm_type = type,
+            .rtm_scope = static_cast<uint8_t>(route.hasNexthop ? RT_SCOPE_UNIVERSE
+                                                               : RT_SCOPE_LINK),
+            .rtm_type = route.type,
     };
 
-    rtattr rtaDst     = { U16_RTA_LENGTH(rawLength), RTA_DST };
-    rtattr rtaGateway = { U16_RTA_LENGTH(rawLength), RTA_GATEWAY };
+    rtattr rtaDst     = { U16_RTA_LENGTH(route.rawLength), RTA_DST };
+    rtattr rtaGateway = { U16_RTA_LENGTH(route.rawLength), RTA_GATEWAY };
 
     iovec iov[] = {
             {nullptr, 0},
-            {&route, sizeof(route)},
+            {&msg, sizeof(msg)},
             {&RTATTR_TABLE, sizeof(RTATTR_TABLE)},
             {&table, sizeof(table)},
             {&rtaDst, sizeof(rtaDst)},
-            {rawAddress, static_cast<size_t>(rawLength)},
-            {&RTATTR_OIF, interface != OIF_NONE ? sizeof(RTATTR_OIF) : 0},
-            {&ifindex, interface != OIF_NONE ? sizeof(ifindex) : 0},
-            {&rtaGateway, nexthop ? sizeof(rtaGateway) : 0},
-            {rawNexthop, nexthop ? static_cast<size_t>(rawLength) : 0},
+            {const_cast<uint8_t*>(route.address), route.rawLength},
+            {&RTATTR_OIF, hasOif ? sizeof(RTATTR_OIF) : 0},
+            {&ifindex, hasOif ? sizeof(ifindex) : 0},
+            {&rtaGateway, route.hasNexthop ? sizeof(rtaGateway) : 0},
+            {const_cast<uint8_t*>(route.nexthop),
+             route.hasNexthop ? static_cast<size_t>(route.rawLength) : 0},
             {&RTATTR_METRICS, mtu != 0 ? sizeof(RTATTR_METRICS) : 0},
             {&RTATTRX_MTU, mtu != 0 ? sizeof(RTATTRX_MTU) : 0},
             {&mtu, mtu != 0 ? sizeof(mtu) : 0},
@@ -458,18 +893,177 @@ int modifyIpRoute(uint16_t action, uint16_t flags, uint32_t table, const char* i
 
     // Allow creating multiple link-local routes in the same table, so we can make IPv6
     // work on all interfaces in the local_network table.
-    if (family == AF_INET6 && IN6_IS_ADDR_LINKLOCAL(reinterpret_cast<in6_addr*>(rawAddress))) {
+    if (route.family == AF_INET6 &&
+        IN6_IS_ADDR_LINKLOCAL(reinterpret_cast<const in6_addr*>(route.address))) {
         flags &= ~NLM_F_EXCL;
     }
 
     int ret = sendNetlinkRequest(action, flags, iov, ARRAY_SIZE(iov), nullptr);
+    if (sReconcileMode && action == RTM_NEWROUTE && (flags & NLM_F_EXCL) && ret == -EEXIST) {
+        // A route to this prefix survived the restart. EEXIST cannot distinguish an identical
+        // route from one with a different nexthop, but callers that intend to change a route use
+        // ROUTE_UPDATE (NLM_F_REPLACE), which never returns EEXIST; plain adds of an existing
+        // prefix are replays converging on the surviving state.
+        ret = 0;
+    }
+    // The strings the route was parsed from are gone; reconstruct them once for the intent log
+    // (and, on failure, the error log).
+    char destination[INET6_ADDRSTRLEN];
+    char nexthop[INET6_ADDRSTRLEN] = "none";
+    formatIpAddress(route.family, route.address, destination);
+    if (route.hasNexthop) {
+        formatIpAddress(route.family, route.nexthop, nexthop);
+    }
+    sRouteIntentLog.record(ret, "%s route %s/%u -> %s oif %u table %u", actionName(action),
+                           destination, route.prefixLength, nexthop, route.ifindex, table);
     if (ret) {
-        ALOGE("Error %s route %s -> %s %s to table %u: %s",
-              actionName(action), destination, nexthop, interface, table, strerror(-ret));
+        ALOGE_RATELIMITED("Error %s route %s/%u -> %s oif %u to table %u: %s", actionName(action),
+                          destination, route.prefixLength, nexthop, route.ifindex, table,
+                          strerror(-ret));
     }
     return ret;
 }
 
+// String-based entry point: parses the route and programs it. Route-heavy paths parse once with
+// parseRouteKey() instead and reuse the key across tables.
+int modifyIpRoute(uint16_t action, uint16_t flags, uint32_t table, const char* interface,
+                  const char* destination, const char* nexthop, uint32_t mtu, uint32_t priority) {
+    RouteKey route;
+    if (int ret = parseRouteKey(interface, destination, nexthop, &route)) {
+        return ret;
+    }
+    return modifyIpRoute(action, flags, table, route, mtu, priority);
+}
+
+// MTU update fast path ---------------------------------------------------------------------------
+//
+// PMTUD learning and clat adjustments call updateRoute() over and over on the same few routes,
+// and every call re-parses the address strings, re-resolves the route tables and re-assembles the
+// netlink message just to change one 32-bit metric. Cache the serialized RTM_NEWROUTE replace
+// payload per route instead: a repeat update patches the four MTU bytes in place and hands the
+// buffer straight to sendNetlinkRequest(). The payloads bake in the table number and the ifindex,
+// so cached entries for an interface are dropped when its table mapping is released
+// (flushRoutes()).
+
+struct MtuUpdateEntry {
+    std::string interface;
+    std::string destination;
+    std::string nexthop;  // Empty when the route is directly connected.
+    RouteController::TableType tableType;
+    // The parsed key and resolved tables, for replaying through modifyRoute() when route
+    // programming is asynchronous and the update must keep its place in the worker's queue.
+    RouteKey route;
+    uint32_t tables[2];  // tables[1] is RT_TABLE_UNSPEC when there is no local-table mirror.
+    // One serialized payload (rtmsg + attributes; sendNetlinkRequest() prepends the nlmsghdr) per
+    // table, and the offset of the MTU value within each.
+    std::vector<uint8_t> payloads[2];
+    size_t mtuOffsets[2];
+};
+
+// A handful of entries covers every MTU learner on a device: one default route per active
+// physical network, plus clat. Linear scan, round-robin replacement.
+constexpr size_t kMtuUpdateCacheSize = 8;
+std::mutex sMtuUpdateCacheLock;
+std::vector<MtuUpdateEntry> sMtuUpdateCache;
+size_t sMtuUpdateCacheNext = 0;
+
+// Serializes the payload modifyIpRoute() would send for an RTM_NEWROUTE of |route| into |table|
+// with a nonzero MTU and no explicit priority. Every piece is a multiple of RTA_ALIGNTO bytes
+// (addresses are 4 or 16), so plain concatenation yields aligned attributes. Keep the layout in
+// sync with modifyIpRoute().
+static void serializeMtuUpdate(uint32_t table, const RouteKey& route, uint32_t mtu,
+                               std::vector<uint8_t>* payload, size_t* mtuOffset) {
+    rtmsg msg = {
+            .rtm_family = route.family,
+            .rtm_dst_len = route.prefixLength,
+            .rtm_protocol = RTPROT_STATIC,
+            .rtm_scope = static_cast<uint8_t>(route.hasNexthop ? RT_SCOPE_UNIVERSE
+                                                               : RT_SCOPE_LINK),
+            .rtm_type = route.type,
+    };
+
+    rtattr rtaDst     = { U16_RTA_LENGTH(route.rawLength), RTA_DST };
+    rtattr rtaGateway = { U16_RTA_LENGTH(route.rawLength), RTA_GATEWAY };
+
+    payload->clear();
+    auto append = [payload](const void* data, size_t len) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        payload->insert(payload->end(), bytes, bytes + len);
+    };
+    append(&msg, sizeof(msg));
+    append(&RTATTR_TABLE, sizeof(RTATTR_TABLE));
+    append(&table, sizeof(table));
+    append(&rtaDst, sizeof(rtaDst));
+    append(route.address, route.rawLength);
+    if (route.ifindex != 0) {
+        append(&RTATTR_OIF, sizeof(RTATTR_OIF));
+        append(&route.ifindex, sizeof(route.ifindex));
+    }
+    if (route.hasNexthop) {
+        append(&rtaGateway, sizeof(rtaGateway));
+        append(route.nexthop, route.rawLength);
+    }
+    append(&RTATTR_METRICS, sizeof(RTATTR_METRICS));
+    append(&RTATTRX_MTU, sizeof(RTATTRX_MTU));
+    *mtuOffset = payload->size();
+    append(&mtu, sizeof(mtu));
+}
+
+static MtuUpdateEntry* findMtuUpdateEntryLocked(const char* interface, const char* destination,
+                                                const char* nexthop,
+                                                RouteController::TableType tableType) {
+    for (MtuUpdateEntry& entry : sMtuUpdateCache) {
+        if (entry.tableType == tableType && entry.destination == destination &&
+            entry.interface == (interface ? interface : "") &&
+            entry.nexthop == (nexthop ? nexthop : "")) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// Records a successfully updated route so the next MTU update for it takes the fast path.
+static void rememberMtuUpdateRoute(const char* interface, const char* destination,
+                                   const char* nexthop, RouteController::TableType tableType,
+                                   const RouteKey& route, uint32_t table, uint32_t localTable,
+                                   uint32_t mtu) {
+    std::lock_guard lock(sMtuUpdateCacheLock);
+    MtuUpdateEntry* entry = findMtuUpdateEntryLocked(interface, destination, nexthop, tableType);
+    if (!entry) {
+        if (sMtuUpdateCache.size() < kMtuUpdateCacheSize) {
+            entry = &sMtuUpdateCache.emplace_back();
+        } else {
+            entry = &sMtuUpdateCache[sMtuUpdateCacheNext];
+            sMtuUpdateCacheNext = (sMtuUpdateCacheNext + 1) % kMtuUpdateCacheSize;
+        }
+        entry->interface = interface ? interface : "";
+        entry->destination = destination;
+        entry->nexthop = nexthop ? nexthop : "";
+        entry->tableType = tableType;
+    }
+    entry->route = route;
+    entry->tables[0] = table;
+    entry->tables[1] = localTable;
+    serializeMtuUpdate(table, route, mtu, &entry->payloads[0], &entry->mtuOffsets[0]);
+    if (localTable != RT_TABLE_UNSPEC) {
+        serializeMtuUpdate(localTable, route, mtu, &entry->payloads[1], &entry->mtuOffsets[1]);
+    } else {
+        entry->payloads[1].clear();
+    }
+}
+
+// Drops cached payloads for |interface|: its table number (and, if it reappears, its ifindex) are
+// no longer valid once its table mapping is released.
+static void forgetMtuUpdateRoutes(const char* interface) {
+    std::lock_guard lock(sMtuUpdateCacheLock);
+    sMtuUpdateCache.erase(std::remove_if(sMtuUpdateCache.begin(), sMtuUpdateCache.end(),
+                                         [interface](const MtuUpdateEntry& entry) {
+                                             return entry.interface == interface;
+                                         }),
+                          sMtuUpdateCache.end());
+    sMtuUpdateCacheNext = 0;
+}
+
 // An iptables rule to mark incoming packets on a network with the netId of the network.
 //
 // This is so that the kernel can:
@@ -517,26 +1111,21 @@ int modifyIncomingPacketMark(unsigned netId, const char* interface, Permission p
 [[nodiscard]] static int modifyVpnUidRangeRule(uint32_t table, uid_t uidStart, uid_t uidEnd,
                                                int32_t subPriority, bool secure, bool add,
                                                bool excludeLocalRoutes) {
-    Fwmark fwmark;
-    Fwmark mask;
-
-    fwmark.protectedFromVpn = false;
-    mask.protectedFromVpn = true;
-
     int32_t priority;
+    uint32_t mask;
 
     if (secure) {
         priority = RULE_PRIORITY_SECURE_VPN;
+        mask = MASK_PROTECTED;
     } else {
         priority = excludeLocalRoutes ? RULE_PRIORITY_BYPASSABLE_VPN_LOCAL_EXCLUSION
                                       : RULE_PRIORITY_BYPASSABLE_VPN_NO_LOCAL_EXCLUSION;
-
-        fwmark.explicitlySelected = false;
-        mask.explicitlySelected = true;
+        // A bypassable VPN additionally lets explicitly-selected traffic through.
+        mask = MASK_PROTECTED | MASK_EXPLICIT;
     }
 
     return modifyIpRule(add ? RTM_NEWRULE : RTM_DELRULE, priority + subPriority, table,
-                        fwmark.intValue, mask.intValue, IIF_LOOPBACK, OIF_NONE, uidStart, uidEnd);
+                        FWMARK_NONE, mask, IIF_LOOPBACK, OIF_NONE, uidStart, uidEnd);
 }
 
 // A rule to allow system apps to send traffic over this VPN even if they are not part of the target
@@ -630,26 +1219,28 @@ int RouteController::modifyVpnLocalExclusionRule(bool add, const char* physicalI
         return -ESRCH;
     }
 
-    Fwmark fwmark;
-    Fwmark mask;
-
-    fwmark.explicitlySelected = false;
-    mask.explicitlySelected = true;
-
-    fwmark.permission = PERMISSION_NONE;
-    mask.permission = PERMISSION_NONE;
-
+    // Matches implicitly-selected traffic regardless of permission (PERMISSION_NONE contributes
+    // no bits to the mask).
     return modifyIpRule(add ? RTM_NEWRULE : RTM_DELRULE, RULE_PRIORITY_LOCAL_ROUTES, table,
-                        fwmark.intValue, mask.intValue, IIF_LOOPBACK, OIF_NONE, INVALID_UID,
+                        FWMARK_NONE, MASK_EXPLICIT, IIF_LOOPBACK, OIF_NONE, INVALID_UID,
                         INVALID_UID);
 }
 
 int RouteController::addFixedLocalRoutes(const char* interface) {
+    // All the fixed prefixes go into the same local table; resolve it once, not per prefix.
+    uint32_t localTable = getRouteTableForInterface(interface, true /* local */);
+    if (localTable == RT_TABLE_UNSPEC) {
+        return -ESRCH;
+    }
+
     for (size_t i = 0; i < ARRAY_SIZE(V4_FIXED_LOCAL_PREFIXES); ++i) {
-        if (int ret = modifyRoute(RTM_NEWROUTE, NETLINK_ROUTE_CREATE_FLAGS, interface,
-                                  V4_FIXED_LOCAL_PREFIXES[i], nullptr /* nexthop */,
-                                  RouteController::INTERFACE, 0 /* mtu */, 0 /* priority */,
-                                  true /* isLocal */)) {
+        RouteKey route;
+        if (int ret = parseRouteKey(interface, V4_FIXED_LOCAL_PREFIXES[i], nullptr /* nexthop */,
+                                    &route)) {
+            return ret;
+        }
+        if (int ret = modifyRoute(RTM_NEWROUTE, NETLINK_ROUTE_CREATE_FLAGS, localTable, route,
+                                  0 /* mtu */, 0 /* priority */)) {
             return ret;
         }
     }
@@ -685,30 +1276,15 @@ int RouteController::modifyVpnFallthroughRule(uint16_t action, unsigned vpnNetId
                         mask.intValue);
 }
 
-// Add rules to allow legacy routes added through the requestRouteToHost() API.
+// Add rules to allow legacy routes added through the requestRouteToHost() API. The match
+// patterns are preencoded in kLegacyRouteRules.
 [[nodiscard]] static int addLegacyRouteRules() {
-    Fwmark fwmark;
-    Fwmark mask;
-
-    fwmark.explicitlySelected = false;
-    mask.explicitlySelected = true;
-
-    // Rules to allow legacy routes to override the default network.
-    if (int ret = modifyIpRule(RTM_NEWRULE, RULE_PRIORITY_LEGACY_SYSTEM, ROUTE_TABLE_LEGACY_SYSTEM,
-                               fwmark.intValue, mask.intValue)) {
-        return ret;
-    }
-    if (int ret = modifyIpRule(RTM_NEWRULE, RULE_PRIORITY_LEGACY_NETWORK,
-                               ROUTE_TABLE_LEGACY_NETWORK, fwmark.intValue, mask.intValue)) {
-        return ret;
+    for (const RuleClass& rc : kLegacyRouteRules) {
+        if (int ret = modifyIpRule(RTM_NEWRULE, rc.priority, rc.table, rc.fwmark, rc.mask)) {
+            return ret;
+        }
     }
-
-    fwmark.permission = PERMISSION_SYSTEM;
-    mask.permission = PERMISSION_SYSTEM;
-
-    // A rule to allow legacy routes from system apps to override VPNs.
-    return modifyIpRule(RTM_NEWRULE, RULE_PRIORITY_VPN_OVERRIDE_SYSTEM, ROUTE_TABLE_LEGACY_SYSTEM,
-                        fwmark.intValue, mask.intValue);
+    return 0;
 }
 
 // Add rules to lookup the local network when specified explicitly or otherwise.
@@ -719,14 +1295,8 @@ int RouteController::modifyVpnFallthroughRule(uint16_t action, unsigned vpnNetId
         return ret;
     }
 
-    Fwmark fwmark;
-    Fwmark mask;
-
-    fwmark.explicitlySelected = false;
-    mask.explicitlySelected = true;
-
-    return modifyIpRule(RTM_NEWRULE, RULE_PRIORITY_LOCAL_NETWORK, ROUTE_TABLE_LOCAL_NETWORK,
-                        fwmark.intValue, mask.intValue);
+    return modifyIpRule(RTM_NEWRULE, kLocalNetworkRule.priority, kLocalNetworkRule.table,
+                        kLocalNetworkRule.fwmark, kLocalNetworkRule.mask);
 }
 
 /* static */
@@ -785,13 +1355,13 @@ int RouteController::configureDummyNetwork() {
                                       add);
 }
 
-[[nodiscard]] static int modifyUidNetworkRule(unsigned netId, uint32_t table, uid_t uidStart,
-                                              uid_t uidEnd, int32_t subPriority, bool add,
-                                              bool explicitSelect) {
-    if ((uidStart == INVALID_UID) || (uidEnd == INVALID_UID)) {
-        ALOGE("modifyUidNetworkRule, invalid UIDs (%u, %u)", uidStart, uidEnd);
-        return -EUSERS;
-    }
+// Builds the rule-group variants for one sub-priority of a per-app network: the explicit and
+// implicit network-selection rules, and (unless the sub-priority opts out of a default network)
+// the default-network and local-routes rules. The variants depend only on the network and the
+// sub-priority, so one template serves every UID range programmed at that sub-priority.
+static size_t buildUidRuleVariants(unsigned netId, uint32_t table, uint32_t localTable,
+                                   int32_t subPriority, UidRuleVariant* variants) {
+    size_t count = 0;
 
     Fwmark fwmark;
     Fwmark mask;
@@ -799,77 +1369,83 @@ int RouteController::configureDummyNetwork() {
     fwmark.netId = netId;
     mask.netId = FWMARK_NET_ID_MASK;
 
-    fwmark.explicitlySelected = explicitSelect;
+    fwmark.explicitlySelected = true;
     mask.explicitlySelected = true;
 
     // Access to this network is controlled by UID rules, not permission bits.
     fwmark.permission = PERMISSION_NONE;
     mask.permission = PERMISSION_NONE;
 
-    return modifyIpRule(add ? RTM_NEWRULE : RTM_DELRULE,
-                        explicitSelect ? (RULE_PRIORITY_UID_EXPLICIT_NETWORK + subPriority)
-                                       : (RULE_PRIORITY_UID_IMPLICIT_NETWORK + subPriority),
-                        table, fwmark.intValue, mask.intValue, IIF_LOOPBACK, OIF_NONE, uidStart,
-                        uidEnd);
-}
+    variants[count++] = {RULE_PRIORITY_UID_EXPLICIT_NETWORK + subPriority, table, fwmark.intValue,
+                         mask.intValue};
 
-[[nodiscard]] static int modifyUidDefaultNetworkRule(uint32_t table, uid_t uidStart, uid_t uidEnd,
-                                                     int32_t subPriority, bool add) {
-    if ((uidStart == INVALID_UID) || (uidEnd == INVALID_UID)) {
-        ALOGE("modifyUidDefaultNetworkRule, invalid UIDs (%u, %u)", uidStart, uidEnd);
-        return -EUSERS;
-    }
-
-    Fwmark fwmark;
-    Fwmark mask;
+    fwmark.explicitlySelected = false;
+    variants[count++] = {RULE_PRIORITY_UID_IMPLICIT_NETWORK + subPriority, table, fwmark.intValue,
+                         mask.intValue};
 
-    fwmark.netId = NETID_UNSET;
-    mask.netId = FWMARK_NET_ID_MASK;
+    // SUB_PRIORITY_NO_DEFAULT is "special" and does not require a default network rule, see
+    // UidRanges.h.
+    if (subPriority != UidRanges::SUB_PRIORITY_NO_DEFAULT) {
+        fwmark.netId = NETID_UNSET;
+        mask.explicitlySelected = false;
+        variants[count++] = {RULE_PRIORITY_UID_DEFAULT_NETWORK + subPriority, table,
+                             fwmark.intValue, mask.intValue};
 
-    // Access to this network is controlled by UID rules, not permission bits.
-    fwmark.permission = PERMISSION_NONE;
-    mask.permission = PERMISSION_NONE;
+        // Per-UID local network rules must always match per-app default network rules, because
+        // their purpose is to allow the UIDs to use the default network for local destinations
+        // within it.
+        Fwmark localFwmark;
+        Fwmark localMask;
+        localFwmark.explicitlySelected = false;
+        localMask.explicitlySelected = true;
+        variants[count++] = {RULE_PRIORITY_UID_LOCAL_ROUTES, localTable, localFwmark.intValue,
+                             localMask.intValue};
+    }
 
-    return modifyIpRule(add ? RTM_NEWRULE : RTM_DELRULE,
-                        RULE_PRIORITY_UID_DEFAULT_NETWORK + subPriority, table, fwmark.intValue,
-                        mask.intValue, IIF_LOOPBACK, OIF_NONE, uidStart, uidEnd);
+    return count;
 }
 
 /* static */
 int RouteController::modifyPhysicalNetwork(unsigned netId, const char* interface,
                                            const UidRangeMap& uidRangeMap, Permission permission,
                                            bool add, bool modifyNonUidBasedRules) {
+    ATRACE_CALL();
+    LatencyWatchdog::Stage stage("physicalNetworkRules");
     uint32_t table = getRouteTableForInterface(interface, false /* local */);
     if (table == RT_TABLE_UNSPEC) {
         return -ESRCH;
     }
 
+    // The local table is only referenced by sub-priorities that get a default network rule.
+    uint32_t localTable = RT_TABLE_UNSPEC;
     for (const auto& [subPriority, uidRanges] : uidRangeMap) {
-        for (const UidRangeParcel& range : uidRanges.getRanges()) {
-            if (int ret = modifyUidNetworkRule(netId, table, range.start, range.stop, subPriority,
-                                               add, EXPLICIT)) {
-                return ret;
-            }
-            if (int ret = modifyUidNetworkRule(netId, table, range.start, range.stop, subPriority,
-                                               add, IMPLICIT)) {
-                return ret;
+        if (subPriority != UidRanges::SUB_PRIORITY_NO_DEFAULT) {
+            localTable = getRouteTableForInterface(interface, true /* local */);
+            if (localTable == RT_TABLE_UNSPEC) {
+                return -ESRCH;
             }
-            // SUB_PRIORITY_NO_DEFAULT is "special" and does not require a
-            // default network rule, see UidRanges.h.
-            if (subPriority != UidRanges::SUB_PRIORITY_NO_DEFAULT) {
-                if (int ret = modifyUidDefaultNetworkRule(table, range.start, range.stop,
-                                                          subPriority, add)) {
-                    return ret;
-                }
+            break;
+        }
+    }
 
-                // Per-UID local network rules must always match per-app default network rules,
-                // because their purpose is to allow the UIDs to use the default network for
-                // local destinations within it.
-                if (int ret = modifyUidLocalNetworkRule(interface, range.start, range.stop, add)) {
+    {
+        // Queue all the UID-based rules and program them in a single netlink batch. The rule
+        // variants for a sub-priority are built once and shared by all its UID ranges.
+        ScopedRuleBatch batch;
+        for (const auto& [subPriority, uidRanges] : uidRangeMap) {
+            UidRuleVariant variants[4];
+            size_t numVariants =
+                    buildUidRuleVariants(netId, table, localTable, subPriority, variants);
+            for (const UidRangeParcel& range : uidRanges.getRanges()) {
+                if (int ret = modifyUidRuleGroup(add, variants, numVariants, range.start,
+                                                 range.stop)) {
                     return ret;
                 }
             }
         }
+        if (int ret = batch.flush()) {
+            return ret;
+        }
     }
 
     if (!modifyNonUidBasedRules) {
@@ -972,6 +1548,9 @@ int RouteController::modifyUidLocalNetworkRule(const char* interface, uid_t uidS
 
 int RouteController::modifyUnreachableNetwork(unsigned netId, const UidRangeMap& uidRangeMap,
                                               bool add) {
+    ATRACE_CALL();
+    // Queue all the UID-based rules and program them in a single netlink batch.
+    ScopedRuleBatch batch;
     for (const auto& [subPriority, uidRanges] : uidRangeMap) {
         for (const UidRangeParcel& range : uidRanges.getRanges()) {
             if (int ret = modifyUidUnreachableRule(netId, range.start, range.stop, subPriority, add,
@@ -989,7 +1568,7 @@ int RouteController::modifyUnreachableNetwork(unsigned netId, const UidRangeMap&
         }
     }
 
-    return 0;
+    return batch.flush();
 }
 
 [[nodiscard]] static int modifyRejectNonSecureNetworkRule(const UidRanges& uidRanges, bool add) {
@@ -998,6 +1577,8 @@ int RouteController::modifyUnreachableNetwork(unsigned netId, const UidRangeMap&
     fwmark.protectedFromVpn = false;
     mask.protectedFromVpn = true;
 
+    // Queue one rule per range and program them all in a single netlink batch.
+    ScopedRuleBatch batch;
     for (const UidRangeParcel& range : uidRanges.getRanges()) {
         if (int ret = modifyIpRule(add ? RTM_NEWRULE : RTM_DELRULE, RULE_PRIORITY_PROHIBIT_NON_VPN,
                                    FR_ACT_PROHIBIT, RT_TABLE_UNSPEC, fwmark.intValue, mask.intValue,
@@ -1006,32 +1587,43 @@ int RouteController::modifyUnreachableNetwork(unsigned netId, const UidRangeMap&
         }
     }
 
-    return 0;
+    return batch.flush();
 }
 
 int RouteController::modifyVirtualNetwork(unsigned netId, const char* interface,
                                           const UidRangeMap& uidRangeMap, bool secure, bool add,
                                           bool modifyNonUidBasedRules, bool excludeLocalRoutes) {
+    ATRACE_CALL();
+    LatencyWatchdog::Stage stage("virtualNetworkRules");
     uint32_t table = getRouteTableForInterface(interface, false /* false */);
     if (table == RT_TABLE_UNSPEC) {
         return -ESRCH;
     }
 
-    for (const auto& [subPriority, uidRanges] : uidRangeMap) {
-        for (const UidRangeParcel& range : uidRanges.getRanges()) {
-            if (int ret = modifyVpnUidRangeRule(table, range.start, range.stop, subPriority, secure,
-                                                add, excludeLocalRoutes)) {
-                return ret;
-            }
-            if (int ret = modifyExplicitNetworkRule(netId, table, PERMISSION_NONE, range.start,
-                                                    range.stop, subPriority, add)) {
-                return ret;
-            }
-            if (int ret = modifyOutputInterfaceRules(interface, table, PERMISSION_NONE, range.start,
-                                                     range.stop, subPriority, add)) {
-                return ret;
+    {
+        // Queue all the UID-based rules and program them in a single netlink batch - the
+        // caller's, when it already has one open across several interfaces.
+        JoinedRuleBatch batch;
+        for (const auto& [subPriority, uidRanges] : uidRangeMap) {
+            for (const UidRangeParcel& range : uidRanges.getRanges()) {
+                if (int ret = modifyVpnUidRangeRule(table, range.start, range.stop, subPriority,
+                                                    secure, add, excludeLocalRoutes)) {
+                    return ret;
+                }
+                if (int ret = modifyExplicitNetworkRule(netId, table, PERMISSION_NONE, range.start,
+                                                        range.stop, subPriority, add)) {
+                    return ret;
+                }
+                if (int ret = modifyOutputInterfaceRules(interface, table, PERMISSION_NONE,
+                                                         range.start, range.stop, subPriority,
+                                                         add)) {
+                    return ret;
+                }
             }
         }
+        if (int ret = batch.flush()) {
+            return ret;
+        }
     }
 
     if (modifyNonUidBasedRules) {
@@ -1086,35 +1678,67 @@ int RouteController::modifyTetheredNetwork(uint16_t action, const char* inputInt
                         inputInterface, OIF_NONE, INVALID_UID, INVALID_UID);
 }
 
-// Adds or removes an IPv4 or IPv6 route to the specified table.
-// Returns 0 on success or negative errno on failure.
-int RouteController::modifyRoute(uint16_t action, uint16_t flags, const char* interface,
-                                 const char* destination, const char* nexthop, TableType tableType,
-                                 int mtu, int priority, bool isLocal) {
-    uint32_t table;
+// Resolves the routing tables a route mutation touches, exactly once per mutation: |table| for
+// |tableType|, and |localTable| for the local-network mirror of directly-connected routes
+// (RT_TABLE_UNSPEC when the route has no mirror). The mirror table is derived arithmetically from
+// |table| instead of taking sInterfaceToTableLock and searching sInterfaceToTable a second time:
+// isLocalRoute() implies tableType == INTERFACE, so |table| itself came from the map and the
+// derivation is exactly what a second lookup would compute. Debug builds check that equivalence.
+int RouteController::resolveRouteTables(const char* interface, TableType tableType,
+                                        const RouteKey& route, uint32_t* table,
+                                        uint32_t* localTable) {
     switch (tableType) {
         case RouteController::INTERFACE: {
-            table = getRouteTableForInterface(interface, isLocal);
-            if (table == RT_TABLE_UNSPEC) {
+            *table = getRouteTableForInterface(interface, false /* local */);
+            if (*table == RT_TABLE_UNSPEC) {
                 return -ESRCH;
             }
             break;
         }
         case RouteController::LOCAL_NETWORK: {
-            table = ROUTE_TABLE_LOCAL_NETWORK;
+            *table = ROUTE_TABLE_LOCAL_NETWORK;
             break;
         }
         case RouteController::LEGACY_NETWORK: {
-            table = ROUTE_TABLE_LEGACY_NETWORK;
+            *table = ROUTE_TABLE_LEGACY_NETWORK;
             break;
         }
         case RouteController::LEGACY_SYSTEM: {
-            table = ROUTE_TABLE_LEGACY_SYSTEM;
+            *table = ROUTE_TABLE_LEGACY_SYSTEM;
             break;
         }
     }
 
-    int ret = modifyIpRoute(action, flags, table, interface, destination, nexthop, mtu, priority);
+    *localTable = RT_TABLE_UNSPEC;
+    if (isLocalRoute(tableType, route)) {
+        *localTable = getRouteTableIndexFromGlobalRouteTableIndex(*table, true /* local */);
+        ALOG_ASSERT(*localTable == getRouteTableForInterface(interface, true /* local */),
+                    "derived local table %u does not match lookup for %s", *localTable, interface);
+    }
+    return 0;
+}
+
+// Programs one route into one table that the caller has already resolved via resolveRouteTables(),
+// so this path costs no table lookup or lock acquisition of its own.
+int RouteController::modifyRoute(uint16_t action, uint16_t flags, uint32_t table,
+                                 const RouteKey& route, int mtu, int priority) {
+    ATRACE_CALL();
+    if (sAsyncRoutes) {
+        // Anything a synchronous call would have rejected up front already failed in
+        // parseRouteKey(); the kernel's reply to the queued op can only be logged and collected
+        // by sync().
+        AsyncRouteWorker::instance().enqueue({
+                .action = action,
+                .flags = flags,
+                .table = table,
+                .route = route,
+                .mtu = static_cast<uint32_t>(mtu),
+                .priority = static_cast<uint32_t>(priority),
+        });
+        return 0;
+    }
+
+    int ret = modifyIpRoute(action, flags, table, route, mtu, priority);
     // Trying to add a route that already exists shouldn't cause an error.
     if (ret && !(action == RTM_NEWROUTE && ret == -EEXIST)) {
         return ret;
@@ -1129,7 +1753,9 @@ static void maybeModifyQdiscClsact(const char* interface, bool add) {
     // clat startup needs to add {in, e}gress filters.
     // TODO: remove this workaround once v4- tun interface clsact attaching is moved out from
     // ClatdController::maybeStartBpf.
-    if (StartsWith(interface, "v4-") && add) return;
+    if ((RouteController::getInterfaceClasses(interface) & RouteController::IF_CLASS_CLAT) && add) {
+        return;
+    }
 
     // The interface may have already gone away in the delete case.
     uint32_t ifindex = RouteController::ifNameToIndexFunction(interface);
@@ -1183,7 +1809,42 @@ uint32_t getRouteTable(const nlmsghdr *nlh) {
     return rtNetlinkFlush(RTM_GETRULE, RTM_DELRULE, "rules", shouldDelete);
 }
 
+// Reconcile variant of flushRules() for warm restart. Deleting every rule blackholes all traffic
+// until the framework has reprogrammed every network, which is exactly the window a warm restart
+// is meant to avoid. Instead, dump the rules and delete only the kernel's default catch-all
+// lookups (present on a cold boot, when nothing survived to reconcile against). Everything else
+// netd programs is left in place: re-adding the static base rules and replaying the per-network
+// rules then converge on the surviving state, with -EEXIST treated as success (see
+// sReconcileMode). Rules and routes are only ever stale if netd crashed mid-mutation, and the
+// replay of that same mutation corrects them.
+[[nodiscard]] static int reconcileRules() {
+    NetlinkDumpFilter shouldDelete = [](nlmsghdr* nlh) {
+        // 32766/32767 are the kernel's built-in "from all lookup main/default" rules.
+        const uint32_t priority = getRulePriority(nlh);
+        return priority == 32766 || priority == 32767;
+    };
+    return rtNetlinkFlush(RTM_GETRULE, RTM_DELRULE, "default kernel rules", shouldDelete);
+}
+
+int RouteController::waitForPendingRoutes() {
+    if (!sAsyncRoutes) {
+        return 0;
+    }
+    return AsyncRouteWorker::instance().sync();
+}
+
+void RouteController::dump(netdutils::DumpWriter& dw) {
+    dw.println("RouteIntentLog: (rule/route modifications as netd issued them, newest last)");
+    netdutils::ScopedIndent indent(dw);
+    sRouteIntentLog.forEachEntry([&dw](const std::string& entry) { dw.println(entry); });
+}
+
 int RouteController::flushRoutes(uint32_t table) {
+    ATRACE_CALL();
+    LatencyWatchdog::Stage stage("flushRoutes");
+    // Drain the async queue first so routes still waiting to be programmed don't reappear in the
+    // table after the flush. Any errors they hit were already logged.
+    waitForPendingRoutes();
     NetlinkDumpFilter shouldDelete = [table] (nlmsghdr *nlh) {
         return getRouteTable(nlh) == table;
     };
@@ -1218,13 +1879,18 @@ int RouteController::flushRoutes(const char* interface, bool local) {
     // Skip erasing local fake interface since it does not exist in sInterfaceToTable.
     if (ret == 0 && !local) {
         sInterfaceToTable.erase(interface);
+        forgetMtuUpdateRoutes(interface);
     }
 
     return ret;
 }
 
 int RouteController::Init(unsigned localNetId) {
-    if (int ret = flushRules()) {
+    // Same property as the state journal (see Controllers::init): the journal is what replays the
+    // per-network rules the reconcile path leaves in place.
+    sReconcileMode = property_get_bool("persist.netd.state_journal", false);
+    sAsyncRoutes = property_get_bool("persist.netd.async_routes", false);
+    if (int ret = sReconcileMode ? reconcileRules() : flushRules()) {
         return ret;
     }
     if (int ret = addLegacyRouteRules()) {
@@ -1248,7 +1914,7 @@ int RouteController::addInterfaceToLocalNetwork(unsigned netId, const char* inte
         return ret;
     }
     std::lock_guard lock(sInterfaceToTableLock);
-    sInterfaceToTable[interface] = ROUTE_TABLE_LOCAL_NETWORK;
+    sInterfaceToTable[interface] = {ROUTE_TABLE_LOCAL_NETWORK, classifyInterfaceName(interface)};
     return 0;
 }
 
@@ -1282,9 +1948,18 @@ int RouteController::addInterfaceToPhysicalNetwork(unsigned netId, const char* i
 int RouteController::removeInterfaceFromPhysicalNetwork(unsigned netId, const char* interface,
                                                         Permission permission,
                                                         const UidRangeMap& uidRangeMap) {
-    if (int ret = modifyPhysicalNetwork(netId, interface, uidRangeMap, permission, ACTION_DEL,
-                                        MODIFY_NON_UID_BASED_RULES)) {
-        return ret;
+    {
+        // Teardown transaction: every rule being removed here is about to be dead anyway, so queue
+        // all the deletions and push them to the kernel in one batched burst instead of one
+        // round trip per rule. The routes follow in a single flush below.
+        ScopedRuleBatch teardown;
+        if (int ret = modifyPhysicalNetwork(netId, interface, uidRangeMap, permission, ACTION_DEL,
+                                            MODIFY_NON_UID_BASED_RULES)) {
+            return ret;
+        }
+        if (int ret = teardown.flush()) {
+            return ret;
+        }
     }
 
     if (int ret = flushRoutes(interface)) {
@@ -1314,9 +1989,16 @@ int RouteController::addInterfaceToVirtualNetwork(unsigned netId, const char* in
 int RouteController::removeInterfaceFromVirtualNetwork(unsigned netId, const char* interface,
                                                        bool secure, const UidRangeMap& uidRangeMap,
                                                        bool excludeLocalRoutes) {
-    if (int ret = modifyVirtualNetwork(netId, interface, uidRangeMap, secure, ACTION_DEL,
-                                       MODIFY_NON_UID_BASED_RULES, excludeLocalRoutes)) {
-        return ret;
+    {
+        // Teardown transaction, as in removeInterfaceFromPhysicalNetwork().
+        ScopedRuleBatch teardown;
+        if (int ret = modifyVirtualNetwork(netId, interface, uidRangeMap, secure, ACTION_DEL,
+                                           MODIFY_NON_UID_BASED_RULES, excludeLocalRoutes)) {
+            return ret;
+        }
+        if (int ret = teardown.flush()) {
+            return ret;
+        }
     }
     if (int ret = flushRoutes(interface)) {
         return ret;
@@ -1363,43 +2045,69 @@ int RouteController::removeUsersFromVirtualNetwork(unsigned netId, const char* i
 }
 
 int RouteController::addInterfaceToDefaultNetwork(const char* interface, Permission permission) {
-    return modifyDefaultNetwork(RTM_NEWRULE, interface, permission);
+    if (int ret = modifyDefaultNetwork(RTM_NEWRULE, interface, permission)) {
+        return ret;
+    }
+    // The interface's local table is maintained incrementally as routes come and go (see
+    // isLocalRoute()), so becoming the default network only has to install one rule referencing
+    // that table; the directly-connected prefixes are never re-derived here. Implicitly-selected
+    // traffic then reaches local destinations on the default network even when a bypassable VPN
+    // with local exclusion is routing everything else.
+    return modifyVpnLocalExclusionRule(true, interface);
 }
 
 int RouteController::removeInterfaceFromDefaultNetwork(const char* interface,
                                                        Permission permission) {
-    return modifyDefaultNetwork(RTM_DELRULE, interface, permission);
+    if (int ret = modifyDefaultNetwork(RTM_DELRULE, interface, permission)) {
+        return ret;
+    }
+    return modifyVpnLocalExclusionRule(false, interface);
 }
 
-bool RouteController::isWithinIpv4LocalPrefix(const char* dst) {
+bool RouteController::isWithinIpv4LocalPrefix(const RouteKey& route) {
+    const IPPrefix prefix(IPAddress(*reinterpret_cast<const in_addr*>(route.address)),
+                          route.prefixLength);
     for (IPPrefix addr : V4_LOCAL_PREFIXES) {
-        if (addr.contains(IPPrefix::forString(dst))) {
+        if (addr.contains(prefix)) {
             return true;
         }
     }
     return false;
 }
 
-bool RouteController::isLocalRoute(TableType tableType, const char* destination,
-                                   const char* nexthop) {
-    IPPrefix prefix = IPPrefix::forString(destination);
-    return nexthop == nullptr && tableType == RouteController::INTERFACE &&
-           // Skip default route to prevent network being modeled as point-to-point interfaces.
-           ((prefix.family() == AF_INET6 && prefix != IPPrefix::forString("::/0")) ||
-            // Skip adding non-target local network range.
-            (prefix.family() == AF_INET && isWithinIpv4LocalPrefix(destination)));
+bool RouteController::isLocalRoute(TableType tableType, const RouteKey& route) {
+    if (route.hasNexthop || route.type != RTN_UNICAST || tableType != RouteController::INTERFACE) {
+        return false;
+    }
+    if (route.family == AF_INET6) {
+        // Skip default route to prevent network being modeled as point-to-point interfaces.
+        return route.prefixLength != 0;
+    }
+    // Skip adding non-target local network range.
+    return isWithinIpv4LocalPrefix(route);
 }
 
 int RouteController::addRoute(const char* interface, const char* destination, const char* nexthop,
                               TableType tableType, int mtu, int priority) {
-    if (int ret = modifyRoute(RTM_NEWROUTE, NETLINK_ROUTE_CREATE_FLAGS, interface, destination,
-                              nexthop, tableType, mtu, priority, false /* isLocal */)) {
+    RouteKey route;
+    if (int ret = parseRouteKey(interface, destination, nexthop, &route)) {
         return ret;
     }
 
-    if (isLocalRoute(tableType, destination, nexthop)) {
-        return modifyRoute(RTM_NEWROUTE, NETLINK_ROUTE_CREATE_FLAGS, interface, destination,
-                           nexthop, tableType, mtu, priority, true /* isLocal */);
+    uint32_t table;
+    uint32_t localTable;
+    if (int ret = resolveRouteTables(interface, tableType, route, &table, &localTable)) {
+        return ret;
+    }
+
+    if (int ret = modifyRoute(RTM_NEWROUTE, NETLINK_ROUTE_CREATE_FLAGS, table, route, mtu,
+                              priority)) {
+        return ret;
+    }
+
+    if (localTable != RT_TABLE_UNSPEC) {
+        return modifyRoute(RTM_NEWROUTE, NETLINK_ROUTE_CREATE_FLAGS, localTable, route, mtu,
+                           priority);
     }
 
     return 0;
@@ -1407,28 +2115,116 @@ int RouteController::addRoute(const char* interface, const char* destination, co
 
 int RouteController::removeRoute(const char* interface, const char* destination,
                                  const char* nexthop, TableType tableType, int priority) {
-    if (int ret = modifyRoute(RTM_DELROUTE, NETLINK_REQUEST_FLAGS, interface, destination, nexthop,
-                              tableType, 0 /* mtu */, priority, false /* isLocal */)) {
+    RouteKey route;
+    if (int ret = parseRouteKey(interface, destination, nexthop, &route)) {
+        return ret;
+    }
+
+    uint32_t table;
+    uint32_t localTable;
+    if (int ret = resolveRouteTables(interface, tableType, route, &table, &localTable)) {
         return ret;
     }
 
-    if (isLocalRoute(tableType, destination, nexthop)) {
-        return modifyRoute(RTM_DELROUTE, NETLINK_REQUEST_FLAGS, interface, destination, nexthop,
-                           tableType, 0 /* mtu */, priority, true /* isLocal */);
+    if (int ret = modifyRoute(RTM_DELROUTE, NETLINK_REQUEST_FLAGS, table, route, 0 /* mtu */,
+                              priority)) {
+        return ret;
+    }
+
+    if (localTable != RT_TABLE_UNSPEC) {
+        return modifyRoute(RTM_DELROUTE, NETLINK_REQUEST_FLAGS, localTable, route, 0 /* mtu */,
+                           priority);
+    }
+    return 0;
+}
+
+int RouteController::updateRouteMtu(const char* interface, const char* destination,
+                                    const char* nexthop, TableType tableType, int mtu) {
+    if (mtu <= 0) {
+        // Clearing the MTU drops the metrics attribute entirely, which reshapes the message; let
+        // the slow path rebuild it.
+        return -ENOENT;
+    }
+
+    std::lock_guard lock(sMtuUpdateCacheLock);
+    MtuUpdateEntry* entry = findMtuUpdateEntryLocked(interface, destination, nexthop, tableType);
+    if (!entry) {
+        return -ENOENT;
+    }
+
+    if (sAsyncRoutes) {
+        // The update must keep its place behind route mutations already queued to the worker, so
+        // replay the cached key through modifyRoute(); the cache still saves the string parse and
+        // the table resolution.
+        for (uint32_t table : entry->tables) {
+            if (table == RT_TABLE_UNSPEC) continue;
+            if (int ret = modifyRoute(RTM_NEWROUTE, NETLINK_ROUTE_REPLACE_FLAGS, table,
+                                      entry->route, mtu, 0 /* priority */)) {
+                return ret;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t mtuValue = mtu;
+    for (size_t i = 0; i < ARRAY_SIZE(entry->payloads); i++) {
+        std::vector<uint8_t>& payload = entry->payloads[i];
+        if (payload.empty()) continue;
+        memcpy(payload.data() + entry->mtuOffsets[i], &mtuValue, sizeof(mtuValue));
+        iovec iov[] = {
+                {nullptr, 0},  // Room for the nlmsghdr.
+                {payload.data(), payload.size()},
+        };
+        int ret = sendNetlinkRequest(RTM_NEWROUTE, NETLINK_ROUTE_REPLACE_FLAGS, iov,
+                                     ARRAY_SIZE(iov), nullptr);
+        sRouteIntentLog.record(ret, "update route mtu %s -> %u table %u", destination, mtuValue,
+                               entry->tables[i]);
+        if (ret) {
+            // -ENOENT means the route itself is gone (NLM_F_REPLACE without NLM_F_CREATE); the
+            // caller falls back to the full path, which reports the authoritative error.
+            if (ret != -ENOENT) {
+                ALOGE_RATELIMITED("Error updating mtu of route %s table %u to %u: %s", destination,
+                                  entry->tables[i], mtuValue, strerror(-ret));
+            }
+            return ret;
+        }
     }
     return 0;
 }
 
 int RouteController::updateRoute(const char* interface, const char* destination,
                                  const char* nexthop, TableType tableType, int mtu) {
-    if (int ret = modifyRoute(RTM_NEWROUTE, NETLINK_ROUTE_REPLACE_FLAGS, interface, destination,
-                              nexthop, tableType, mtu, 0 /* priority */, false /* isLocal */)) {
+    if (int ret = updateRouteMtu(interface, destination, nexthop, tableType, mtu);
+        ret != -ENOENT) {
+        return ret;
+    }
+
+    RouteKey route;
+    if (int ret = parseRouteKey(interface, destination, nexthop, &route)) {
+        return ret;
+    }
+
+    uint32_t table;
+    uint32_t localTable;
+    if (int ret = resolveRouteTables(interface, tableType, route, &table, &localTable)) {
+        return ret;
+    }
+
+    if (int ret = modifyRoute(RTM_NEWROUTE, NETLINK_ROUTE_REPLACE_FLAGS, table, route, mtu,
+                              0 /* priority */)) {
         return ret;
     }
 
-    if (isLocalRoute(tableType, destination, nexthop)) {
-        return modifyRoute(RTM_NEWROUTE, NETLINK_ROUTE_REPLACE_FLAGS, interface, destination,
-                           nexthop, tableType, mtu, 0 /* priority */, true /* isLocal */);
+    if (localTable != RT_TABLE_UNSPEC) {
+        if (int ret = modifyRoute(RTM_NEWROUTE, NETLINK_ROUTE_REPLACE_FLAGS, localTable, route,
+                                  mtu, 0 /* priority */)) {
+            return ret;
+        }
+    }
+
+    if (mtu > 0) {
+        rememberMtuUpdateRoute(interface, destination, nexthop, tableType, route, table,
+                               localTable, mtu);
     }
     return 0;
 }
@@ -1482,7 +2278,7 @@ int RouteController::removeUsersFromUnreachableNetwork(unsigned netId,
 }
 
 // Protects sInterfaceToTable.
-std::mutex RouteController::sInterfaceToTableLock;
-std::map<std::string, uint32_t> RouteController::sInterfaceToTable;
+std::shared_mutex RouteController::sInterfaceToTableLock;
+std::map<std::string, RouteController::InterfaceInfo> RouteController::sInterfaceToTable;
 
 }  // namespace android::net
@@ -22,11 +22,14 @@
 #include "Permission.h"
 
 #include <android-base/thread_annotations.h>
+#include <netdutils/DumpWriter.h>
 
 #include <linux/netlink.h>
 #include <sys/types.h>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 
 namespace android::net {
 
@@ -93,6 +96,22 @@ static const char* V4_FIXED_LOCAL_PREFIXES[] = {
 };
 
 class UidRanges;
+class ScopedRuleBatch;
+
+// A route in parsed, kernel-ready form: address family, raw prefix and nexthop bytes and the
+// output interface's ifindex instead of the strings they came from. Built once per request by
+// parseRouteKey() and passed through the modify calls, so a route that is programmed into several
+// tables (or queued for asynchronous programming) is parsed exactly once.
+struct RouteKey {
+    uint8_t family;        // AF_INET or AF_INET6.
+    uint8_t type;          // RTN_UNICAST, RTN_UNREACHABLE or RTN_THROW.
+    uint8_t prefixLength;
+    uint8_t rawLength;     // Bytes used in address/nexthop: 4 for IPv4, 16 for IPv6.
+    uint32_t ifindex;      // 0 if the route specifies no output interface.
+    bool hasNexthop;       // False for directly-connected, unreachable and throw routes.
+    uint8_t address[16];
+    uint8_t nexthop[16];
+};
 
 class RouteController {
 public:
@@ -110,7 +129,33 @@ public:
 
     static constexpr const char* INTERFACE_LOCAL_SUFFIX = "_local";
     static constexpr const char* RT_TABLES_PATH = "/data/misc/net/rt_tables";
-    static const char* const LOCAL_MANGLE_INPUT;
+    // constexpr so the chain topology table in Controllers.cpp can reference it at compile time.
+    static constexpr const char* LOCAL_MANGLE_INPUT = "routectrl_mangle_INPUT";
+
+    // Interface name classes. An interface's name is inspected exactly once, when it first enters
+    // the table map, and the resulting bits are cached alongside its routing table; per-operation
+    // code reads the cached classification instead of re-matching prefixes and suffixes.
+    static constexpr uint32_t IF_CLASS_CLAT = 1 << 0;  // clat tun device ("v4-" prefix).
+
+    // Returns the IF_CLASS_* bits for |interface|: the cached classification if the interface is
+    // tracked, or a direct (uncached) classification of the name if not.
+    static uint32_t getInterfaceClasses(const char* interface) EXCLUDES(sInterfaceToTableLock);
+
+    // While an instance is live, FIB rule changes made through RouteController on the same thread
+    // are queued and pushed to the kernel as one batched netlink stream instead of one
+    // request/ack round trip per rule. flush() sends the queue and returns the first kernel
+    // error; rules still queued at destruction are sent with errors logged but not reported.
+    // Batches nest. Used by callers that reprogram several networks back to back, e.g. a bulk
+    // permission push at boot.
+    class RuleBatch {
+      public:
+        RuleBatch();
+        ~RuleBatch();
+        [[nodiscard]] int flush();
+
+      private:
+        const std::unique_ptr<ScopedRuleBatch> mImpl;
+    };
 
     [[nodiscard]] static int Init(unsigned localNetId);
 
@@ -173,6 +218,18 @@ public:
     [[nodiscard]] static int updateRoute(const char* interface, const char* destination,
                                          const char* nexthop, TableType tableType, int mtu);
 
+    // When asynchronous route programming is enabled (persist.netd.async_routes), route
+    // mutations return once validated and enqueued, and a dedicated thread pushes them to the
+    // kernel in order. This call blocks until every mutation enqueued so far has been pushed,
+    // and returns the first kernel error seen since the last call, for callers that need
+    // confirmation. In the default synchronous mode it is a no-op returning 0.
+    static int waitForPendingRoutes();
+
+    // Prints the recent rule/route intent log: every FIB rule and route modification netd
+    // attempted, with its result. Reads a lock-free mirror maintained by the programming path,
+    // so dumping never takes sInterfaceToTableLock or queries the kernel.
+    static void dump(netdutils::DumpWriter& dw) NETD_COLD;
+
     [[nodiscard]] static int enableTethering(const char* inputInterface,
                                              const char* outputInterface);
     [[nodiscard]] static int disableTethering(const char* inputInterface,
@@ -205,8 +262,21 @@ public:
   private:
     friend class RouteControllerTest;
 
-    static std::mutex sInterfaceToTableLock;
-    static std::map<std::string, uint32_t> sInterfaceToTable GUARDED_BY(sInterfaceToTableLock);
+    // What the table map stores per tracked interface: the *global* routing table plus the name
+    // classification computed when the entry was created.
+    struct InterfaceInfo {
+        uint32_t table;
+        uint32_t classes;  // IF_CLASS_* bits.
+    };
+
+    // Reader/writer lock: table lookups from concurrent binder threads take it shared and only
+    // interface addition/removal (and a lookup that has to populate the cache) takes it
+    // exclusively.
+    static std::shared_mutex sInterfaceToTableLock;
+    static std::map<std::string, InterfaceInfo> sInterfaceToTable GUARDED_BY(sInterfaceToTableLock);
+
+    // The single classification pass behind the IF_CLASS_* bits; see getInterfaceClasses().
+    static uint32_t classifyInterfaceName(const char* interface);
 
     static int configureDummyNetwork();
     [[nodiscard]] static int flushRoutes(const char* interface) EXCLUDES(sInterfaceToTableLock);
@@ -222,9 +292,17 @@ public:
                                      const UidRangeMap& uidRangeMap, Permission permission,
                                      bool add, bool modifyNonUidBasedRules);
     static int modifyUnreachableNetwork(unsigned netId, const UidRangeMap& uidRangeMap, bool add);
-    static int modifyRoute(uint16_t action, uint16_t flags, const char* interface,
-                           const char* destination, const char* nexthop, TableType tableType,
-                           int mtu, int priority, bool isLocal);
+    static int resolveRouteTables(const char* interface, TableType tableType,
+                                  const RouteKey& route, uint32_t* table, uint32_t* localTable)
+            EXCLUDES(sInterfaceToTableLock);
+    static int modifyRoute(uint16_t action, uint16_t flags, uint32_t table, const RouteKey& route,
+                           int mtu, int priority);
+    // Serves an MTU-only route update from the preserialized-message cache in RouteController.cpp,
+    // skipping the string parse, table resolution and message assembly of the full path. Returns
+    // -ENOENT when the route is not cached (or the kernel no longer has it), in which case the
+    // caller takes - and thereby repopulates - the full updateRoute() path.
+    static int updateRouteMtu(const char* interface, const char* destination, const char* nexthop,
+                              TableType tableType, int mtu);
     static int modifyTetheredNetwork(uint16_t action, const char* inputInterface,
                                      const char* outputInterface);
     static int modifyVpnFallthroughRule(uint16_t action, unsigned vpnNetId,
@@ -237,11 +315,19 @@ public:
 
     static int modifyUidLocalNetworkRule(const char* interface, uid_t uidStart, uid_t uidEnd,
                                          bool add);
-    static bool isLocalRoute(TableType tableType, const char* destination, const char* nexthop);
-    static bool isWithinIpv4LocalPrefix(const char* addrstr);
+    static bool isLocalRoute(TableType tableType, const RouteKey& route);
+    static bool isWithinIpv4LocalPrefix(const RouteKey& route);
     static int addFixedLocalRoutes(const char* interface);
 };
 
+// Parses |destination|, |nexthop| and |interface| into |route|, performing the same validation a
+// synchronous route change would. Returns 0 on success or negative errno on failure.
+[[nodiscard]] int parseRouteKey(const char* interface, const char* destination, const char* nexthop,
+                                RouteKey* route);
+
+[[nodiscard]] int modifyIpRoute(uint16_t action, uint16_t flags, uint32_t table,
+                                const RouteKey& route, uint32_t mtu, uint32_t priority);
+
 // Public because they are called by by RouteControllerTest.cpp.
 // TODO: come up with a scheme of unit testing this code that does not rely on making all its
 // functions public.
@@ -132,6 +132,23 @@ TEST_F(RouteControllerTest, TestModifyIncomingPacketMark) {
       mask)});
 }
 
+TEST_F(RouteControllerTest, TestFwmarkMakeMark) {
+    // Fwmark::makeMark() duplicates the Fwmark bitfield layout with explicit shifts so that rule
+    // match patterns can be built at compile time. Check the two encodings against each other for
+    // every field, so a layout change in one place can't go unnoticed.
+    Fwmark fwmark;
+    fwmark.netId = 30;
+    EXPECT_EQ(fwmark.intValue, Fwmark::makeMark(30));
+    fwmark.explicitlySelected = true;
+    EXPECT_EQ(fwmark.intValue, Fwmark::makeMark(30, true));
+    fwmark.protectedFromVpn = true;
+    EXPECT_EQ(fwmark.intValue, Fwmark::makeMark(30, true, true));
+    fwmark.permission = PERMISSION_SYSTEM;
+    EXPECT_EQ(fwmark.intValue, Fwmark::makeMark(30, true, true, PERMISSION_SYSTEM));
+    fwmark.uidBillingDone = true;
+    EXPECT_EQ(fwmark.intValue, Fwmark::makeMark(30, true, true, PERMISSION_SYSTEM, true));
+}
+
 bool hasLocalInterfaceInRouteTable(const char* iface) {
     // Calculate the table index from interface index
     std::string index = std::to_string(RouteController::ROUTE_TABLE_OFFSET_FROM_INDEX_FOR_LOCAL +
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RouteIntentLog"
+
+#include "RouteIntentLog.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <android-base/stringprintf.h>
+
+namespace android {
+namespace net {
+
+namespace {
+
+int64_t nowMs() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+}  // namespace
+
+void RouteIntentLog::record(int result, const char* format, ...) {
+    const uint64_t index = mNext.fetch_add(1, std::memory_order_relaxed);
+    Entry& entry = mEntries[index % kEntryCount];
+
+    // Clear the sequence number before touching the slot, so a reader that copied the previous
+    // contents notices the overwrite when it re-checks.
+    entry.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    entry.whenMs = nowMs();
+    entry.result = result;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(entry.text, sizeof(entry.text), format, args);
+    va_end(args);
+
+    entry.seq.store(index + 1, std::memory_order_release);
+}
+
+void RouteIntentLog::forEachEntry(const std::function<void(const std::string&)>& callback) const {
+    const uint64_t next = mNext.load(std::memory_order_acquire);
+    const uint64_t first = (next > kEntryCount) ? (next - kEntryCount) : 0;
+    for (uint64_t index = first; index < next; ++index) {
+        const Entry& entry = mEntries[index % kEntryCount];
+        if (entry.seq.load(std::memory_order_acquire) != index + 1) {
+            continue;  // Still being written, or already lapped by a newer entry.
+        }
+        const int64_t whenMs = entry.whenMs;
+        const int32_t result = entry.result;
+        char text[sizeof(entry.text)];
+        memcpy(text, entry.text, sizeof(text));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.seq.load(std::memory_order_relaxed) != index + 1) {
+            continue;  // A writer reclaimed the slot mid-copy; the copy may be torn.
+        }
+        text[sizeof(text) - 1] = '\0';
+
+        const time_t seconds = whenMs / 1000;
+        tm tm;
+        localtime_r(&seconds, &tm);
+        std::string line;
+        base::StringAppendF(&line, "%02d-%02d %02d:%02d:%02d.%03d %s", tm.tm_mon + 1, tm.tm_mday,
+                            tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(whenMs % 1000),
+                            text);
+        if (result != 0) {
+            base::StringAppendF(&line, " -> %s", strerror(-result));
+        }
+        callback(line);
+    }
+}
+
+}  // namespace net
+}  // namespace android
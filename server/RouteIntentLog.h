@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_SERVER_ROUTE_INTENT_LOG_H
+#define NETD_SERVER_ROUTE_INTENT_LOG_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+namespace android {
+namespace net {
+
+// Append-only in-memory log of the FIB rules and routes netd has asked the kernel to program,
+// retaining the newest kEntryCount entries. The programming path appends with one atomic
+// increment and a vsnprintf into a preallocated slot - no locks, no allocation - so recording
+// does not slow down or reorder what it records. Readers (dumpsys, bug reports) walk the ring
+// without synchronizing with writers: each slot carries a sequence number that is cleared while
+// the slot is rewritten, so a reader detects and skips a slot it raced with instead of making
+// the programming path wait. The result is an authoritative record of what netd believes it
+// programmed, independent of whatever the kernel state has since become.
+class RouteIntentLog {
+  public:
+    static constexpr uint32_t kEntryCount = 512;  // Power of two; ~64KB retained.
+
+    // Appends one printf-formatted entry tagged with |result| (0 or negative errno) and the
+    // current wall-clock time. Safe to call from any thread. Text that does not fit in a slot
+    // is truncated.
+    void record(int result, const char* format, ...) __attribute__((__format__(printf, 3, 4)));
+
+    // Invokes |callback| on each retained entry, oldest first, formatted as one line including
+    // timestamp and result. Entries overwritten while being read are skipped.
+    void forEachEntry(const std::function<void(const std::string&)>& callback) const;
+
+  private:
+    struct Entry {
+        // 0 while the slot is being rewritten; its ring index + 1 once the contents below are
+        // published. Doubles as the torn-read detector: see forEachEntry().
+        std::atomic<uint64_t> seq{0};
+        int64_t whenMs;
+        int32_t result;
+        char text[108];
+    };
+
+    // Index of the next entry to be written; writers claim a slot by incrementing it.
+    std::atomic<uint64_t> mNext{0};
+    Entry mEntries[kEntryCount];
+};
+
+}  // namespace net
+}  // namespace android
+
+#endif  // NETD_SERVER_ROUTE_INTENT_LOG_H
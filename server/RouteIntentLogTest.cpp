@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RouteIntentLog.h"
+
+#include <errno.h>
+
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::HasSubstr;
+
+namespace android {
+namespace net {
+
+namespace {
+
+std::vector<std::string> collect(const RouteIntentLog& log) {
+    std::vector<std::string> entries;
+    log.forEachEntry([&](const std::string& entry) { entries.push_back(entry); });
+    return entries;
+}
+
+}  // namespace
+
+TEST(RouteIntentLogTest, RecordsInOrder) {
+    RouteIntentLog log;
+    log.record(0, "add rule prio %d table %u", 16000, 1002U);
+    log.record(-EEXIST, "add route %s table %u", "192.0.2.0/24", 1002U);
+    log.record(0, "del rule prio %d table %u", 16000, 1002U);
+
+    const auto entries = collect(log);
+    ASSERT_EQ(3U, entries.size());
+    EXPECT_THAT(entries[0], HasSubstr("add rule prio 16000 table 1002"));
+    EXPECT_THAT(entries[1], HasSubstr("add route 192.0.2.0/24 table 1002"));
+    EXPECT_THAT(entries[1], HasSubstr(strerror(EEXIST)));
+    EXPECT_THAT(entries[2], HasSubstr("del rule prio 16000 table 1002"));
+    // Successful entries carry no error annotation.
+    EXPECT_THAT(entries[0], testing::Not(HasSubstr("->")));
+}
+
+TEST(RouteIntentLogTest, WrapsAndKeepsNewest) {
+    RouteIntentLog log;
+    constexpr uint32_t kOverflow = 10;
+    for (uint32_t i = 0; i < RouteIntentLog::kEntryCount + kOverflow; ++i) {
+        log.record(0, "entry %u", i);
+    }
+
+    const auto entries = collect(log);
+    ASSERT_EQ(RouteIntentLog::kEntryCount, entries.size());
+    // The oldest kOverflow entries were overwritten; the retained window starts at kOverflow.
+    EXPECT_THAT(entries.front(), HasSubstr("entry 10"));
+    EXPECT_THAT(entries.back(),
+                HasSubstr("entry " + std::to_string(RouteIntentLog::kEntryCount + kOverflow - 1)));
+}
+
+TEST(RouteIntentLogTest, ConcurrentWritersAndReader) {
+    RouteIntentLog log;
+    constexpr int kWriters = 4;
+    constexpr int kWritesPerThread = 2000;
+
+    std::vector<std::thread> writers;
+    for (int w = 0; w < kWriters; ++w) {
+        writers.emplace_back([&log, w] {
+            for (int i = 0; i < kWritesPerThread; ++i) {
+                log.record(0, "writer %d entry %d", w, i);
+            }
+        });
+    }
+    // Read concurrently: every returned entry must be whole, even while slots are overwritten.
+    for (int i = 0; i < 20; ++i) {
+        for (const auto& entry : collect(log)) {
+            EXPECT_THAT(entry, HasSubstr("writer "));
+        }
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    EXPECT_EQ(RouteIntentLog::kEntryCount, collect(log).size());
+}
+
+}  // namespace net
+}  // namespace android
@@ -15,6 +15,7 @@
  */
 
 #define LOG_TAG "Netd"
+#define ATRACE_TAG ATRACE_TAG_NETWORK
 
 #include "SockDiag.h"
 
@@ -29,6 +30,7 @@
 #include <sys/socket.h>
 #include <sys/uio.h>
 
+#include <algorithm>
 #include <cinttypes>
 
 #include <android-base/properties.h>
@@ -37,6 +39,7 @@
 #include <log/log.h>
 #include <netdutils/InternetAddresses.h>
 #include <netdutils/Stopwatch.h>
+#include <utils/Trace.h>
 
 #include "Permission.h"
 
@@ -55,6 +58,15 @@ using netdutils::Stopwatch;
 namespace net {
 namespace {
 
+// Per-datagram receive buffer size for dump draining; matches the kernel's dump skb sizing and
+// the old processNetlinkDump() buffer.
+constexpr int kDumpBufferSize = 8192;
+// Upper bound on the number of pooled receive buffers per SockDiag.
+constexpr int kMaxDumpBuffers = 16;
+
+// Number of SOCK_DESTROY requests written out in one go by the batched destroy path.
+constexpr size_t kDestroyBatchSize = 256;
+
 int getAdbPort() {
     return android::base::GetIntProperty("service.adb.tcp.port", 0);
 }
@@ -64,6 +76,20 @@ bool isAdbSocket(const inet_diag_msg *msg, int adbPort) {
         (msg->idiag_uid == AID_ROOT || msg->idiag_uid == AID_SHELL);
 }
 
+// Renders the active predicates of a composite destroy for log messages.
+std::string describeSpec(const SockDiag::DestroySpec& spec) {
+    std::string what;
+    if (!spec.uidRanges.empty()) {
+        what = StringPrintf("%s skip={%s}", spec.uidRanges.toString().c_str(),
+                            android::base::Join(spec.skipUids, " ").c_str());
+    }
+    for (const auto& check : spec.permissionChecks) {
+        if (!what.empty()) what += " ";
+        what += StringPrintf("netId %u permission=%d", check.netId, check.permission);
+    }
+    return what;
+}
+
 int checkError(int fd) {
     struct {
         nlmsghdr h;
@@ -219,15 +245,71 @@ int SockDiag::sendDumpRequest(uint8_t proto, uint8_t family, const char *addrstr
     return sendDumpRequest(proto, family, 0, states, iov, ARRAY_SIZE(iov));
 }
 
+int SockDiag::processDump(const NetlinkDumpCallback& callback) {
+    if (mDumpMsgs.empty()) {
+        // Size the pool so one recvmmsg() can drain a full socket receive buffer.
+        int rcvbuf = 0;
+        socklen_t optlen = sizeof(rcvbuf);
+        if (getsockopt(mSock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen) == -1) {
+            rcvbuf = kDumpBufferSize;
+        }
+        int numBuffers = std::min(std::max(rcvbuf / kDumpBufferSize, 1), kMaxDumpBuffers);
+        mDumpBuffers.resize(numBuffers * kDumpBufferSize);
+        mDumpIovs.resize(numBuffers);
+        mDumpMsgs.resize(numBuffers);
+        for (int i = 0; i < numBuffers; i++) {
+            mDumpIovs[i] = {mDumpBuffers.data() + i * kDumpBufferSize, kDumpBufferSize};
+            mDumpMsgs[i] = {};
+            mDumpMsgs[i].msg_hdr.msg_iov = &mDumpIovs[i];
+            mDumpMsgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    while (true) {
+        // Block for the first datagram, then opportunistically drain whatever else the kernel
+        // has already queued.
+        int numMsgs = TEMP_FAILURE_RETRY(
+                recvmmsg(mSock, mDumpMsgs.data(), mDumpMsgs.size(), MSG_WAITFORONE, nullptr));
+        if (numMsgs == -1) {
+            return -errno;
+        }
+
+        for (int i = 0; i < numMsgs; i++) {
+            uint32_t len = mDumpMsgs[i].msg_len;
+            if (len == 0) {
+                return 0;
+            }
+            for (nlmsghdr *nlh = reinterpret_cast<nlmsghdr *>(mDumpIovs[i].iov_base);
+                 NLMSG_OK(nlh, len);
+                 nlh = NLMSG_NEXT(nlh, len)) {
+                switch (nlh->nlmsg_type) {
+                  case NLMSG_DONE:
+                    return 0;
+                  case NLMSG_ERROR: {
+                    nlmsgerr *err = reinterpret_cast<nlmsgerr *>(NLMSG_DATA(nlh));
+                    return err->error;
+                  }
+                  default:
+                    callback(nlh);
+                }
+            }
+        }
+    }
+}
+
 int SockDiag::readDiagMsg(uint8_t proto, const SockDiag::DestroyFilter& shouldDestroy) {
-    NetlinkDumpCallback callback = [this, proto, shouldDestroy] (nlmsghdr *nlh) {
+    // Capture the filter by reference: processDump() is synchronous, and copying a std::function
+    // per dump is an avoidable allocation.
+    NetlinkDumpCallback callback = [this, proto, &shouldDestroy](nlmsghdr* nlh) {
         const inet_diag_msg *msg = reinterpret_cast<inet_diag_msg *>(NLMSG_DATA(nlh));
         if (shouldDestroy(proto, msg)) {
-            sockDestroy(proto, msg);
+            sockDestroyBatched(proto, msg);
         }
     };
 
-    return processNetlinkDump(mSock, callback);
+    int ret = processDump(callback);
+    int flushRet = flushPendingDestroys();
+    return ret ? ret : flushRet;
 }
 
 int SockDiag::readDiagMsgWithTcpInfo(const TcpInfoReader& tcpInfoReader) {
@@ -256,7 +338,7 @@ int SockDiag::readDiagMsgWithTcpInfo(const TcpInfoReader& tcpInfoReader) {
         tcpInfoReader(mark, msg, tcpinfo, tcpinfoLength);
     };
 
-    return processNetlinkDump(mSock, callback);
+    return processDump(callback);
 }
 
 // Determines whether a socket is a loopback socket. Does not check socket state.
@@ -309,6 +391,72 @@ int SockDiag::sockDestroy(uint8_t proto, const inet_diag_msg *msg) {
     return ret;
 }
 
+int SockDiag::sockDestroyBatched(uint8_t proto, const inet_diag_msg *msg) {
+    if (msg == nullptr) {
+       return 0;
+    }
+
+    DestroyRequest request = {
+        .nlh = {
+            .nlmsg_type = SOCK_DESTROY,
+            .nlmsg_flags = NLM_F_REQUEST,
+        },
+        .req = {
+            .sdiag_family = msg->idiag_family,
+            .sdiag_protocol = proto,
+            .idiag_states = (uint32_t) (1 << msg->idiag_state),
+            .id = msg->id,
+        },
+    };
+    request.nlh.nlmsg_len = sizeof(request);
+
+    mPendingDestroys.push_back(request);
+    if (mPendingDestroys.size() >= kDestroyBatchSize) {
+        return flushPendingDestroys();
+    }
+    return 0;
+}
+
+int SockDiag::flushPendingDestroys() {
+    if (mPendingDestroys.empty()) {
+        return 0;
+    }
+
+    const int numRequests = mPendingDestroys.size();
+    const size_t len = numRequests * sizeof(DestroyRequest);
+    ssize_t written = write(mWriteSock, mPendingDestroys.data(), len);
+    mPendingDestroys.clear();
+    if (written < (ssize_t) len) {
+        return -errno;
+    }
+
+    // Reap whatever failure replies have arrived. Successful destroys are unacknowledged (the
+    // requests don't set NLM_F_ACK), so anything readable is an error report. As with the
+    // nonblocking error check in sockDestroy(), a reply that hasn't arrived yet is missed; the
+    // point is that all requests above were pipelined in one write instead of each awaiting its
+    // own error check.
+    int ret = 0;
+    int errors = 0;
+    struct {
+        nlmsghdr h;
+        nlmsgerr err;
+    } __attribute__((__packed__)) ack;
+    ssize_t bytesread;
+    while ((bytesread = recv(mWriteSock, &ack, sizeof(ack), MSG_DONTWAIT)) != -1) {
+        if (bytesread == (ssize_t) sizeof(ack) && ack.h.nlmsg_type == NLMSG_ERROR &&
+            ack.err.error != 0) {
+            ret = ack.err.error;
+            errors++;
+        }
+    }
+    if (errno != EAGAIN && ret == 0) {
+        ret = -errno;
+    }
+
+    mSocketsDestroyed += numRequests - errors;
+    return ret;
+}
+
 int SockDiag::destroySockets(uint8_t proto, int family, const char* addrstr, int ifindex) {
     if (!hasSocks()) {
         return -EBADFD;
@@ -327,6 +475,7 @@ int SockDiag::destroySockets(uint8_t proto, int family, const char* addrstr, int
 }
 
 int SockDiag::destroySockets(const char* addrstr, int ifindex) {
+    ATRACE_CALL();
     Stopwatch s;
     mSocketsDestroyed = 0;
 
@@ -397,6 +546,7 @@ int SockDiag::getLiveTcpInfos(const TcpInfoReader& tcpInfoReader) {
 }
 
 int SockDiag::destroySockets(uint8_t proto, const uid_t uid, bool excludeLoopback) {
+    ATRACE_CALL();
     mSocketsDestroyed = 0;
     Stopwatch s;
 
@@ -428,34 +578,135 @@ int SockDiag::destroySockets(uint8_t proto, const uid_t uid, bool excludeLoopbac
 
 int SockDiag::destroySockets(const UidRanges& uidRanges, const std::set<uid_t>& skipUids,
                              bool excludeLoopback) {
+    DestroySpec spec;
+    spec.uidRanges = uidRanges;
+    spec.skipUids = skipUids;
+    spec.excludeLoopback = excludeLoopback;
+    return destroySockets(spec);
+}
+
+int SockDiag::destroySockets(const DestroySpec& spec) {
+    ATRACE_CALL();
     mSocketsDestroyed = 0;
     Stopwatch s;
 
-    auto shouldDestroy = [&] (uint8_t, const inet_diag_msg *msg) {
-        return msg != nullptr &&
-               uidRanges.hasUid(msg->idiag_uid) &&
-               skipUids.find(msg->idiag_uid) == skipUids.end() &&
-               !(excludeLoopback && isLoopbackSocket(msg)) &&
-               !isAdbSocket(msg, getAdbPort());
+    if (spec.uidRanges.empty() && spec.permissionChecks.empty()) {
+        return 0;
+    }
+
+    // Precompute the fwmark comparisons; like the adb port below, they run against every live
+    // socket the kernel dumps. A socket fails a check - and is destroyed - if its mark carries
+    // the check's netId but not all of the explicitly-selected and permission bits.
+    struct MarkMatch {
+        uint32_t netIdMark;
+        uint32_t netIdMask;
+        uint32_t controlMark;
     };
+    std::vector<MarkMatch> markMatches;
+    markMatches.reserve(spec.permissionChecks.size());
+    for (const auto& check : spec.permissionChecks) {
+        Fwmark netIdMark, netIdMask, controlMark;
+        netIdMark.netId = check.netId;
+        netIdMask.netId = 0xffff;
+        controlMark.explicitlySelected = true;
+        controlMark.permission = check.permission;
+        markMatches.push_back({netIdMark.intValue, netIdMask.intValue, controlMark.intValue});
+    }
 
-    iovec iov[] = {
-        { nullptr, 0 },
+    // Fetch the adb port once per sweep: a property read per socket dwarfs the comparisons.
+    const int adbPort = getAdbPort();
+    const uint8_t proto = IPPROTO_TCP;
+    const uint32_t states = (1 << TCP_ESTABLISHED) | (1 << TCP_SYN_SENT) | (1 << TCP_SYN_RECV);
+
+    // Unlike destroySocketsLackingPermission(), the fwmark conditions cannot be pushed into
+    // kernel bytecode here: the bytecode would narrow the dump to its own matches and starve the
+    // other predicates of records. Instead the dump runs unfiltered, and the INET_DIAG_MARK
+    // attribute the kernel attaches for CAP_NET_ADMIN callers (already relied on by
+    // readDiagMsgWithTcpInfo()) supplies the mark for a userspace comparison. On kernels too old
+    // to report the mark, unmatched sockets are left alone rather than guessed at.
+    NetlinkDumpCallback callback = [&](nlmsghdr* nlh) {
+        inet_diag_msg *msg = reinterpret_cast<inet_diag_msg *>(NLMSG_DATA(nlh));
+        if (msg == nullptr || (spec.excludeLoopback && isLoopbackSocket(msg))) {
+            return;
+        }
+
+        if (!spec.uidRanges.empty() && spec.uidRanges.hasUid(msg->idiag_uid) &&
+            spec.skipUids.find(msg->idiag_uid) == spec.skipUids.end() &&
+            !isAdbSocket(msg, adbPort)) {
+            sockDestroyBatched(proto, msg);
+            return;
+        }
+
+        if (markMatches.empty()) {
+            return;
+        }
+        uint32_t attr_len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*msg));
+        for (rtattr *attr = reinterpret_cast<rtattr *>(msg + 1); RTA_OK(attr, attr_len);
+             attr = RTA_NEXT(attr, attr_len)) {
+            if (attr->rta_type != INET_DIAG_MARK) continue;
+            const uint32_t mark = *reinterpret_cast<uint32_t*>(RTA_DATA(attr));
+            for (const MarkMatch& match : markMatches) {
+                if ((mark & match.netIdMask) == match.netIdMark &&
+                    (mark & match.controlMark) != match.controlMark) {
+                    sockDestroyBatched(proto, msg);
+                    return;
+                }
+            }
+            return;
+        }
     };
 
-    if (int ret = destroyLiveSockets(shouldDestroy, "UID", iov, ARRAY_SIZE(iov))) {
-        return ret;
+    const std::string what = describeSpec(spec);
+    for (const int family : {AF_INET, AF_INET6}) {
+        const char *familyName = (family == AF_INET) ? "IPv4" : "IPv6";
+        if (int ret = sendDumpRequest(proto, family, states)) {
+            ALOGE("Failed to dump %s sockets for %s: %s", familyName, what.c_str(),
+                  strerror(-ret));
+            return ret;
+        }
+        int ret = processDump(callback);
+        int flushRet = flushPendingDestroys();
+        if (ret == 0) ret = flushRet;
+        if (ret) {
+            ALOGE("Failed to destroy %s sockets for %s: %s", familyName, what.c_str(),
+                  strerror(-ret));
+            return ret;
+        }
     }
 
     if (mSocketsDestroyed > 0) {
-        ALOGI("Destroyed %d sockets for %s skip={%s} in %" PRId64 "us", mSocketsDestroyed,
-              uidRanges.toString().c_str(), android::base::Join(skipUids, " ").c_str(),
+        ALOGI("Destroyed %d sockets for %s in %" PRId64 "us", mSocketsDestroyed, what.c_str(),
               s.timeTakenUs());
     }
 
     return 0;
 }
 
+int SockDiag::countSocketsToDestroy(const UidRanges& uidRanges, const std::set<uid_t>& skipUids,
+                                    bool excludeLoopback, std::map<uid_t, int>* counts) {
+    ATRACE_CALL();
+
+    // Must mirror the UID predicate of the composite destroySockets() above, so the report
+    // predicts exactly what a destroy with the same arguments would do.
+    const int adbPort = getAdbPort();
+    auto count = [&, adbPort](uint8_t, const inet_diag_msg* msg) {
+        if (msg != nullptr &&
+            uidRanges.hasUid(msg->idiag_uid) &&
+            skipUids.find(msg->idiag_uid) == skipUids.end() &&
+            !(excludeLoopback && isLoopbackSocket(msg)) &&
+            !isAdbSocket(msg, adbPort)) {
+            ++(*counts)[msg->idiag_uid];
+        }
+        return false;  // Dry run: never destroy.
+    };
+
+    iovec iov[] = {
+        { nullptr, 0 },
+    };
+
+    return destroyLiveSockets(count, "UID dry-run", iov, ARRAY_SIZE(iov));
+}
+
 // Destroys all "live" (CONNECTED, SYN_SENT, SYN_RECV) TCP sockets on the specified netId where:
 // 1. The opening app no longer has permission to use this network, or:
 // 2. The opening app does have permission, but did not explicitly select this network.
@@ -467,6 +718,7 @@ int SockDiag::destroySockets(const UidRanges& uidRanges, const std::set<uid_t>&
 // that they are now sending and receiving traffic on a network that is now restricted.
 int SockDiag::destroySocketsLackingPermission(unsigned netId, Permission permission,
                                               bool excludeLoopback) {
+    ATRACE_CALL();
     struct markmatch {
         inet_diag_bc_op op;
         // TODO: switch to inet_diag_markcond
@@ -25,7 +25,9 @@
 #include <linux/inet_diag.h>
 
 #include <functional>
+#include <map>
 #include <set>
+#include <vector>
 
 #include "Fwmark.h"
 #include "NetlinkCommands.h"
@@ -59,6 +61,27 @@ class SockDiag {
         inet_diag_req_v2 req;
     } __attribute__((__packed__));
 
+    // Composite destroy specification. Every active predicate is evaluated against each record
+    // of a single dump traversal, and a socket matching any of them is destroyed. Network
+    // transitions that previously issued several destroySockets() calls back to back can fold
+    // them into one pass over the kernel's socket tables.
+    struct DestroySpec {
+        // Destroys sockets owned by a UID inside |uidRanges| but not in |skipUids|, sparing the
+        // adb console. Inactive when |uidRanges| is empty.
+        UidRanges uidRanges;
+        std::set<uid_t> skipUids;
+        // Destroys sockets on |netId| whose owner either lacks |permission| or did not
+        // explicitly select the network; the same predicate as
+        // destroySocketsLackingPermission(), but evaluated in userspace so several networks
+        // share one dump. One entry per network.
+        struct PermissionCheck {
+            unsigned netId;
+            Permission permission;
+        };
+        std::vector<PermissionCheck> permissionChecks;
+        bool excludeLoopback = false;
+    };
+
     SockDiag() : mSock(-1), mWriteSock(-1), mSocketsDestroyed(0) {}
     bool open();
     virtual ~SockDiag() { closeSocks(); }
@@ -69,6 +92,9 @@ class SockDiag {
     int readDiagMsgWithTcpInfo(const TcpInfoReader& callback);
 
     int sockDestroy(uint8_t proto, const inet_diag_msg *);
+    // Pushes out any SOCK_DESTROY requests still queued by the batched destroy path and reaps
+    // the kernel's error replies. Returns the last error reported, or 0.
+    int flushPendingDestroys();
     // Destroys all sockets on the given IPv4 or IPv6 address.
     int destroySockets(const char* addrstr, int ifindex);
     // Destroys all sockets for the given protocol and UID.
@@ -76,6 +102,15 @@ class SockDiag {
     // Destroys all "live" (CONNECTED, SYN_SENT, SYN_RECV) TCP sockets for the given UID ranges.
     int destroySockets(const UidRanges& uidRanges, const std::set<uid_t>& skipUids,
                        bool excludeLoopback);
+    // Destroys all "live" TCP sockets matching any predicate of |spec|, in one dump per address
+    // family.
+    int destroySockets(const DestroySpec& spec);
+    // Dry-run counterpart of the UID-range destroySockets() above: counts, per UID, the sockets
+    // the same filter would destroy, using the same dump pipeline but never sending SOCK_DESTROY.
+    // Lets callers size a destroy before paying for it. UIDs with no matching sockets do not
+    // appear in |counts|.
+    int countSocketsToDestroy(const UidRanges& uidRanges, const std::set<uid_t>& skipUids,
+                              bool excludeLoopback, std::map<uid_t, int>* counts);
     // Destroys all "live" (CONNECTED, SYN_SENT, SYN_RECV) TCP sockets that no longer have
     // the permissions required by the specified network.
     int destroySocketsLackingPermission(unsigned netId, Permission permission,
@@ -91,11 +126,28 @@ class SockDiag {
     int mSocketsDestroyed;
     int sendDumpRequest(uint8_t proto, uint8_t family, uint8_t extensions, uint32_t states,
                         iovec *iov, int iovcnt);
+    // Drains the dump responses on mSock into the reusable buffer pool with recvmmsg(), invoking
+    // |callback| once per record. Large dumps complete in a handful of syscalls with no per-record
+    // allocation.
+    int processDump(const NetlinkDumpCallback& callback);
     int destroySockets(uint8_t proto, int family, const char* addrstr, int ifindex);
     int destroyLiveSockets(const DestroyFilter& destroy, const char *what, iovec *iov, int iovcnt);
+    // Queues a SOCK_DESTROY request for the socket instead of writing it immediately, so that a
+    // dump that destroys many sockets streams requests in large writes instead of paying a
+    // write/error-check round per socket. Flushed by flushPendingDestroys().
+    int sockDestroyBatched(uint8_t proto, const inet_diag_msg *msg);
     bool hasSocks() { return mSock != -1 && mWriteSock != -1; }
     void closeSocks() { close(mSock); close(mWriteSock); mSock = mWriteSock = -1; }
     static bool isLoopbackSocket(const inet_diag_msg *msg);
+
+    // Receive buffers for processDump(), allocated once per SockDiag based on the socket's
+    // SO_RCVBUF and reused across every dump (e.g. the v4 and v6 passes of destroySockets()).
+    std::vector<uint8_t> mDumpBuffers;
+    std::vector<iovec> mDumpIovs;
+    std::vector<mmsghdr> mDumpMsgs;
+
+    // SOCK_DESTROY requests queued by sockDestroyBatched() awaiting the next flush.
+    std::vector<DestroyRequest> mPendingDestroys;
 };
 
 }  // namespace net
@@ -272,6 +272,7 @@ enum MicroBenchmarkTestType {
     UIDRANGE,
     UIDRANGE_EXCLUDE_LOOPBACK,
     PERMISSION,
+    COMPOSITE,
 };
 
 const char *testTypeName(MicroBenchmarkTestType mode) {
@@ -283,6 +284,7 @@ const char *testTypeName(MicroBenchmarkTestType mode) {
         TO_STRING_TYPE(UIDRANGE);
         TO_STRING_TYPE(UIDRANGE_EXCLUDE_LOOPBACK);
         TO_STRING_TYPE(PERMISSION);
+        TO_STRING_TYPE(COMPOSITE);
     }
 #undef TO_STRING_TYPE
 }
@@ -339,6 +341,7 @@ protected:
         case UIDRANGE_EXCLUDE_LOOPBACK:
             return UID_SOCKETS;
         case PERMISSION:
+        case COMPOSITE:
             return ARRAY_SIZE(permissionTestcases);
         }
     }
@@ -353,6 +356,10 @@ protected:
             uid_t uid = START_UID + i;
             return fchown(s, uid, -1);
         }
+        case COMPOSITE:
+            // Sockets carry both a test UID and a test fwmark, so both predicates have matches.
+            if (fchown(s, START_UID + i, -1) == -1) return -1;
+            [[fallthrough]];
         case PERMISSION: {
             Fwmark fwmark;
             fwmark.netId = permissionTestcases[i].netId;
@@ -395,6 +402,17 @@ protected:
                 ret = mSd.destroySocketsLackingPermission(TEST_NETID, PERMISSION_NETWORK, false);
                 break;
             }
+            case COMPOSITE: {
+                // One pass must destroy the union of a UID-range predicate and a permission
+                // predicate.
+                const char *uidRangeStrings[] = { "8006-8008" };
+                SockDiag::DestroySpec spec;
+                spec.uidRanges.parseFrom(ARRAY_SIZE(uidRangeStrings), (char **) uidRangeStrings);
+                spec.skipUids = { 8007 };
+                spec.permissionChecks.push_back({ TEST_NETID, PERMISSION_NETWORK });
+                ret = mSd.destroySockets(spec);
+                break;
+            }
         }
         return ret;
     }
@@ -421,6 +439,13 @@ protected:
             case UID_EXCLUDE_LOOPBACK:
             case UIDRANGE_EXCLUDE_LOOPBACK:
                 return false;
+            case COMPOSITE: {
+                // The UID range covers netId-43 sockets that the permission predicate spares,
+                // so the union is strictly larger than either predicate alone.
+                uid_t uid = i + START_UID;
+                if (8006 <= uid && uid <= 8008 && uid != 8007) return true;
+                [[fallthrough]];
+            }
             case PERMISSION:
                 if (permissionTestcases[i].netId != 42) return false;
                 if (permissionTestcases[i].explicitlySelected != 1) return true;
@@ -526,7 +551,7 @@ constexpr int SockDiagMicroBenchmarkTest::CLOSE_UID;
 INSTANTIATE_TEST_CASE_P(Address, SockDiagMicroBenchmarkTest,
                         testing::Values(ADDRESS, UID, UIDRANGE,
                                         UID_EXCLUDE_LOOPBACK, UIDRANGE_EXCLUDE_LOOPBACK,
-                                        PERMISSION));
+                                        PERMISSION, COMPOSITE));
 
 }  // namespace net
 }  // namespace android
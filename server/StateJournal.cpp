@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StateJournal"
+
+#include "StateJournal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <log/log.h>
+
+namespace android {
+namespace net {
+
+namespace {
+
+constexpr uint32_t JOURNAL_MAGIC = 0x4a44544e;  // "NTDJ"
+constexpr uint32_t JOURNAL_VERSION = 1;
+
+struct JournalHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t payloadSize;
+    uint32_t payloadCrc;
+};
+
+// CRC-32 (IEEE 802.3 polynomial, bit-reflected). Computed bitwise: snapshots are a few KB at
+// most, so a lookup table isn't worth the cache footprint.
+uint32_t crc32(const uint8_t* data, size_t len) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+}  // namespace
+
+int StateJournal::write(const std::string& payload) const {
+    const JournalHeader header = {
+            .magic = JOURNAL_MAGIC,
+            .version = JOURNAL_VERSION,
+            .payloadSize = static_cast<uint32_t>(payload.size()),
+            .payloadCrc = crc32(reinterpret_cast<const uint8_t*>(payload.data()), payload.size()),
+    };
+
+    const std::string tmpPath = mPath + ".tmp";
+    android::base::unique_fd fd(
+            open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+    if (fd == -1) {
+        ALOGE("cannot open %s: %s", tmpPath.c_str(), strerror(errno));
+        return -errno;
+    }
+    if (!android::base::WriteFully(fd, &header, sizeof(header)) ||
+        !android::base::WriteFully(fd, payload.data(), payload.size())) {
+        ALOGE("cannot write %s: %s", tmpPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return -EIO;
+    }
+    if (fsync(fd) == -1) {
+        ALOGE("cannot sync %s: %s", tmpPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return -errno;
+    }
+    if (rename(tmpPath.c_str(), mPath.c_str()) == -1) {
+        ALOGE("cannot rename %s to %s: %s", tmpPath.c_str(), mPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return -errno;
+    }
+    return 0;
+}
+
+int StateJournal::read(std::string* payload) const {
+    std::string contents;
+    if (!android::base::ReadFileToString(mPath, &contents)) {
+        return errno ? -errno : -ENOENT;
+    }
+
+    if (contents.size() < sizeof(JournalHeader)) {
+        ALOGE("journal %s truncated: %zu bytes", mPath.c_str(), contents.size());
+        return -EBADMSG;
+    }
+    JournalHeader header;
+    memcpy(&header, contents.data(), sizeof(header));
+    if (header.magic != JOURNAL_MAGIC) {
+        ALOGE("journal %s has bad magic %08x", mPath.c_str(), header.magic);
+        return -EBADMSG;
+    }
+    if (header.version != JOURNAL_VERSION) {
+        // A journal from a different netd version is expected across updates; don't log an error.
+        ALOGI("journal %s has version %u, expected %u", mPath.c_str(), header.version,
+              JOURNAL_VERSION);
+        return -EBADMSG;
+    }
+    if (contents.size() - sizeof(header) != header.payloadSize) {
+        ALOGE("journal %s has payload %zu bytes, header says %u", mPath.c_str(),
+              contents.size() - sizeof(header), header.payloadSize);
+        return -EBADMSG;
+    }
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(contents.data()) + sizeof(header);
+    if (crc32(data, header.payloadSize) != header.payloadCrc) {
+        ALOGE("journal %s failed checksum", mPath.c_str());
+        return -EBADMSG;
+    }
+
+    payload->assign(contents, sizeof(header), header.payloadSize);
+    return 0;
+}
+
+}  // namespace net
+}  // namespace android
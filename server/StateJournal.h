@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_SERVER_STATE_JOURNAL_H
+#define NETD_SERVER_STATE_JOURNAL_H
+
+#include <stdint.h>
+
+#include <string>
+
+namespace android {
+namespace net {
+
+// A compact on-disk snapshot of controller state, used to warm-restart netd after a crash without
+// waiting for the framework to replay every network from scratch.
+//
+// The file is a fixed header (magic, format version, payload size, payload CRC) followed by an
+// opaque payload serialized by the owning controller. Writes replace the whole file atomically
+// (write to a temp file, fsync, rename), so a crash mid-write leaves the previous snapshot
+// intact. Reads verify the header and checksum and fail closed: a corrupt or version-mismatched
+// journal reads as absent, and netd falls back to the cold-start path.
+class StateJournal {
+  public:
+    explicit StateJournal(const std::string& path) : mPath(path) {}
+
+    // Atomically replaces the journal with |payload|. Returns 0 on success or negative errno.
+    [[nodiscard]] int write(const std::string& payload) const;
+
+    // Reads the journal into |payload| after validating the header and checksum. Returns 0 on
+    // success, -ENOENT if no journal exists, or another negative errno (corrupt journals return
+    // -EBADMSG).
+    [[nodiscard]] int read(std::string* payload) const;
+
+  private:
+    const std::string mPath;
+};
+
+}  // namespace net
+}  // namespace android
+
+#endif  // NETD_SERVER_STATE_JOURNAL_H
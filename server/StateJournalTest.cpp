@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "StateJournal.h"
+
+namespace android {
+namespace net {
+
+class StateJournalTest : public ::testing::Test {
+  protected:
+    StateJournalTest() : mPath(mTempDir.path + std::string("/state.journal")) {}
+
+    TemporaryDir mTempDir;
+    const std::string mPath;
+};
+
+TEST_F(StateJournalTest, RoundTrip) {
+    StateJournal journal(mPath);
+    std::string payload = "some opaque controller state";
+    payload.push_back('\0');  // Payloads are binary; embedded NULs must survive.
+    payload += "with embedded NULs";
+
+    EXPECT_EQ(0, journal.write(payload));
+
+    std::string readBack;
+    EXPECT_EQ(0, journal.read(&readBack));
+    EXPECT_EQ(payload, readBack);
+
+    // A rewrite replaces the previous snapshot.
+    EXPECT_EQ(0, journal.write("v2"));
+    EXPECT_EQ(0, journal.read(&readBack));
+    EXPECT_EQ("v2", readBack);
+}
+
+TEST_F(StateJournalTest, EmptyPayload) {
+    StateJournal journal(mPath);
+    EXPECT_EQ(0, journal.write(""));
+
+    std::string readBack = "stale";
+    EXPECT_EQ(0, journal.read(&readBack));
+    EXPECT_EQ("", readBack);
+}
+
+TEST_F(StateJournalTest, MissingFileReturnsEnoent) {
+    StateJournal journal(mPath);
+    std::string readBack;
+    EXPECT_EQ(-ENOENT, journal.read(&readBack));
+}
+
+TEST_F(StateJournalTest, CorruptJournalIsRejected) {
+    StateJournal journal(mPath);
+    ASSERT_EQ(0, journal.write("payload to corrupt"));
+
+    std::string contents;
+    ASSERT_TRUE(android::base::ReadFileToString(mPath, &contents));
+
+    // Flip a payload bit: the checksum must catch it.
+    std::string corrupt = contents;
+    corrupt.back() ^= 0x01;
+    ASSERT_TRUE(android::base::WriteStringToFile(corrupt, mPath));
+    std::string readBack;
+    EXPECT_EQ(-EBADMSG, journal.read(&readBack));
+
+    // Truncate mid-payload: the size check must catch it.
+    ASSERT_TRUE(android::base::WriteStringToFile(contents.substr(0, contents.size() - 1), mPath));
+    EXPECT_EQ(-EBADMSG, journal.read(&readBack));
+
+    // Garbage that is too short even for a header.
+    ASSERT_TRUE(android::base::WriteStringToFile("junk", mPath));
+    EXPECT_EQ(-EBADMSG, journal.read(&readBack));
+}
+
+}  // namespace net
+}  // namespace android
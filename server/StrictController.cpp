@@ -35,7 +35,6 @@
 
 auto StrictController::execIptablesRestore = ::execIptablesRestore;
 
-const char* StrictController::LOCAL_OUTPUT = "st_OUTPUT";
 const char* StrictController::LOCAL_CLEAR_DETECT = "st_clear_detect";
 const char* StrictController::LOCAL_CLEAR_CAUGHT = "st_clear_caught";
 const char* StrictController::LOCAL_PENALTY_LOG = "st_penalty_log";
@@ -152,11 +151,18 @@ int StrictController::resetChains(void) {
         "COMMIT\n"
     };
     const std::string commands = Join(commandList, '\n');
-    return (execIptablesRestore(V4V6, commands) == 0) ? 0 : -EREMOTEIO;
+    if (execIptablesRestore(V4V6, commands) != 0) return -EREMOTEIO;
+    // Every penalty chain was just flushed, so no UID has rules any more.
+    mLogUids.clearAll();
+    mRejectUids.clearAll();
+    return 0;
 #undef CLEAR_CHAIN
 }
 
-int StrictController::setUidCleartextPenalty(uid_t uid, StrictPenalty penalty) {
+const std::string& StrictController::penaltyCommands(uid_t uid, StrictPenalty penalty) {
+    std::string& cached = mUidCommandCache[uid][penalty];
+    if (!cached.empty()) return cached;
+
     // When a penalty is set, we don't know what penalty the UID previously had. In order to be able
     // to clear the previous penalty without causing an iptables error by deleting rules that don't
     // exist, put each UID's rules in a chain specific to that UID. That way, the commands we need
@@ -168,7 +174,6 @@ int StrictController::setUidCleartextPenalty(uid_t uid, StrictPenalty penalty) {
     if (penalty == ACCEPT) {
         // Clean up any old rules
         commands = {
-            "*filter",
             StringPrintf("-D %s -m owner --uid-owner %d -j %s",
                          LOCAL_OUTPUT, uid, LOCAL_CLEAR_DETECT),
             StringPrintf("-D %s -m owner --uid-owner %d -j %s",
@@ -178,7 +183,6 @@ int StrictController::setUidCleartextPenalty(uid_t uid, StrictPenalty penalty) {
         };
     } else {
         // Always take a detour to investigate this UID
-        commands.push_back("*filter");
         commands.push_back(StringPrintf(":%s -", perUidChain.c_str()));
         commands.push_back(StringPrintf("-I %s -m owner --uid-owner %d -j %s",
                                         LOCAL_OUTPUT, uid, LOCAL_CLEAR_DETECT));
@@ -192,7 +196,52 @@ int StrictController::setUidCleartextPenalty(uid_t uid, StrictPenalty penalty) {
                                             LOCAL_PENALTY_REJECT));
         }
     }
-    commands.push_back("COMMIT\n");
 
-    return (execIptablesRestore(V4V6, Join(commands, "\n")) == 0) ? 0 : -EREMOTEIO;
+    for (const auto& command : commands) {
+        cached += command;
+        cached += '\n';
+    }
+    return cached;
+}
+
+int StrictController::setUidCleartextPenalty(uid_t uid, StrictPenalty penalty) {
+    return setUidsCleartextPenalty({uid}, penalty);
+}
+
+StrictPenalty StrictController::getUidCleartextPenalty(uid_t uid) const {
+    if (mRejectUids.test(uid)) return REJECT;
+    if (mLogUids.test(uid)) return LOG;
+    return ACCEPT;
+}
+
+int StrictController::setUidsCleartextPenalty(const std::vector<uid_t>& uids,
+                                              StrictPenalty penalty) {
+    if (uids.empty()) return 0;
+
+    // Each UID's rules live in their own chain, so any number of UIDs can share one commit.
+    std::string commands = "*filter\n";
+    size_t changed = 0;
+    for (uid_t uid : uids) {
+        if (getUidCleartextPenalty(uid) == penalty) {
+            // Already programmed; re-inserting the rules would only duplicate them.
+            continue;
+        }
+        commands += penaltyCommands(uid, penalty);
+        ++changed;
+    }
+    if (changed == 0) return 0;
+    commands += "COMMIT\n";
+
+    if (execIptablesRestore(V4V6, commands) != 0) return -EREMOTEIO;
+
+    for (uid_t uid : uids) {
+        mLogUids.clear(uid);
+        mRejectUids.clear(uid);
+        if (penalty == LOG) {
+            mLogUids.set(uid);
+        } else if (penalty == REJECT) {
+            mRejectUids.set(uid);
+        }
+    }
+    return 0;
 }
@@ -17,9 +17,13 @@
 #ifndef _STRICT_CONTROLLER_H
 #define _STRICT_CONTROLLER_H
 
+#include <array>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "NetdConstants.h"
+#include "UidBitmap.h"
 
 enum StrictPenalty { INVALID, ACCEPT, LOG, REJECT };
 
@@ -36,7 +40,18 @@ public:
 
     int setUidCleartextPenalty(uid_t, StrictPenalty);
 
-    static const char* LOCAL_OUTPUT;
+    // Applies |penalty| to every UID in |uids| in a single iptables-restore commit, instead of
+    // one transaction per UID. Policy pushes that set the cleartext penalty for many UIDs at
+    // once belong on this path.
+    int setUidsCleartextPenalty(const std::vector<uid_t>& uids, StrictPenalty penalty);
+
+    // Returns the penalty netd believes is currently programmed for |uid|, answered in O(1) from
+    // the membership bitmaps maintained alongside rule programming - no iptables text is listed
+    // or parsed. UIDs with no penalty rules report ACCEPT. Callers must hold |lock|.
+    StrictPenalty getUidCleartextPenalty(uid_t uid) const;
+
+    // constexpr so the chain topology table in Controllers.cpp can reference it at compile time.
+    static constexpr const char* LOCAL_OUTPUT = "st_OUTPUT";
     static const char* LOCAL_CLEAR_DETECT;
     static const char* LOCAL_CLEAR_CAUGHT;
     static const char* LOCAL_PENALTY_LOG;
@@ -47,6 +62,24 @@ public:
     // For testing.
     friend class StrictControllerTest;
     static int (*execIptablesRestore)(IptablesTarget target, const std::string& commands);
+
+  private:
+    // Returns the rule lines (newline-terminated, without the surrounding *filter/COMMIT) that
+    // apply |penalty| to |uid|, formatting them on first use and serving them from the cache
+    // afterwards. The text of a UID's rules depends only on the UID and the penalty, so policy
+    // pushes that reapply penalties to the same UIDs skip the formatting entirely.
+    const std::string& penaltyCommands(uid_t uid, StrictPenalty penalty);
+
+    // Preformatted rule lines per UID, indexed by penalty. This caches command text only.
+    // Guarded by |lock|, which RPC callers already hold.
+    std::unordered_map<uid_t, std::array<std::string, REJECT + 1>> mUidCommandCache;
+
+    // One bit per UID mirroring which UIDs currently have rules in the LOG and REJECT penalty
+    // chains, updated on every successful restore commit and cleared by resetChains() along with
+    // the kernel state it mirrors. Lets penalty pushes skip UIDs already in the requested state
+    // (most of a full policy replay) and backs the O(1) query above. Guarded by |lock|.
+    android::net::UidBitmap mLogUids;
+    android::net::UidBitmap mRejectUids;
 };
 
 #endif
@@ -154,13 +154,94 @@ TEST_F(StrictControllerTest, TestSetUidCleartextPenalty) {
     mStrictCtrl.setUidCleartextPenalty(12345, ACCEPT);
     expectIptablesRestoreCommands(acceptCommands);
 
-    // StrictController doesn't keep any state and it is not correct to call its methods in the
-    // wrong order (e.g., to go from LOG to REJECT without passing through ACCEPT).
-    // NetworkManagementService does keep state (not just to ensure correctness, but also so it can
-    // reprogram the rules when netd crashes).
+    // It is not correct to call these methods in the wrong order (e.g., to go from LOG to REJECT
+    // without passing through ACCEPT). NetworkManagementService keeps the policy state (not just
+    // to ensure correctness, but also so it can reprogram the rules when netd crashes).
     mStrictCtrl.setUidCleartextPenalty(12345, REJECT);
     expectIptablesRestoreCommands(rejectCommands);
 
     mStrictCtrl.setUidCleartextPenalty(12345, ACCEPT);
     expectIptablesRestoreCommands(acceptCommands);
+
+    // The command text is served from the per-UID cache on repeat calls; it must not change.
+    mStrictCtrl.setUidCleartextPenalty(12345, LOG);
+    expectIptablesRestoreCommands(logCommands);
+    mStrictCtrl.setUidCleartextPenalty(12345, ACCEPT);
+    expectIptablesRestoreCommands(acceptCommands);
+}
+
+TEST_F(StrictControllerTest, TestSetUidsCleartextPenalty) {
+    std::vector<std::string> logCommands = {
+        "*filter\n"
+        ":st_clear_caught_10001 -\n"
+        "-I st_OUTPUT -m owner --uid-owner 10001 -j st_clear_detect\n"
+        "-I st_clear_caught -m owner --uid-owner 10001 -j st_clear_caught_10001\n"
+        "-A st_clear_caught_10001 -j st_penalty_log\n"
+        ":st_clear_caught_10002 -\n"
+        "-I st_OUTPUT -m owner --uid-owner 10002 -j st_clear_detect\n"
+        "-I st_clear_caught -m owner --uid-owner 10002 -j st_clear_caught_10002\n"
+        "-A st_clear_caught_10002 -j st_penalty_log\n"
+        "COMMIT\n"
+    };
+    std::vector<std::string> acceptCommands = {
+        "*filter\n"
+        "-D st_OUTPUT -m owner --uid-owner 10001 -j st_clear_detect\n"
+        "-D st_clear_caught -m owner --uid-owner 10001 -j st_clear_caught_10001\n"
+        "-F st_clear_caught_10001\n"
+        "-X st_clear_caught_10001\n"
+        "-D st_OUTPUT -m owner --uid-owner 10002 -j st_clear_detect\n"
+        "-D st_clear_caught -m owner --uid-owner 10002 -j st_clear_caught_10002\n"
+        "-F st_clear_caught_10002\n"
+        "-X st_clear_caught_10002\n"
+        "COMMIT\n"
+    };
+
+    // The whole batch is applied in a single restore command.
+    std::vector<uid_t> uids = {10001, 10002};
+    mStrictCtrl.setUidsCleartextPenalty(uids, LOG);
+    expectIptablesRestoreCommands(logCommands);
+
+    mStrictCtrl.setUidsCleartextPenalty(uids, ACCEPT);
+    expectIptablesRestoreCommands(acceptCommands);
+
+    // An empty batch runs no commands at all.
+    mStrictCtrl.setUidsCleartextPenalty({}, REJECT);
+    expectIptablesRestoreCommands(ExpectedIptablesCommands{});
+}
+
+TEST_F(StrictControllerTest, TestPenaltyMembershipTracking) {
+    // Penalties are answered from the in-memory membership bitmaps, not from iptables.
+    EXPECT_EQ(ACCEPT, mStrictCtrl.getUidCleartextPenalty(12345));
+
+    EXPECT_EQ(0, mStrictCtrl.setUidCleartextPenalty(12345, LOG));
+    EXPECT_EQ(LOG, mStrictCtrl.getUidCleartextPenalty(12345));
+    sRestoreCmds.clear();
+
+    // Reapplying the penalty a UID already has runs no commands: the rules are already in place,
+    // and inserting them again would duplicate them.
+    EXPECT_EQ(0, mStrictCtrl.setUidCleartextPenalty(12345, LOG));
+    expectIptablesRestoreCommands(ExpectedIptablesCommands{});
+
+    // A batch where only some UIDs change programs only those UIDs.
+    EXPECT_EQ(0, mStrictCtrl.setUidsCleartextPenalty({12345, 10001}, LOG));
+    std::vector<std::string> newUidCommands = {
+        "*filter\n"
+        ":st_clear_caught_10001 -\n"
+        "-I st_OUTPUT -m owner --uid-owner 10001 -j st_clear_detect\n"
+        "-I st_clear_caught -m owner --uid-owner 10001 -j st_clear_caught_10001\n"
+        "-A st_clear_caught_10001 -j st_penalty_log\n"
+        "COMMIT\n"
+    };
+    expectIptablesRestoreCommands(newUidCommands);
+    EXPECT_EQ(LOG, mStrictCtrl.getUidCleartextPenalty(10001));
+
+    EXPECT_EQ(0, mStrictCtrl.setUidCleartextPenalty(12345, REJECT));
+    EXPECT_EQ(REJECT, mStrictCtrl.getUidCleartextPenalty(12345));
+    sRestoreCmds.clear();
+
+    // Flushing the chains resets the mirrored membership along with the kernel state.
+    EXPECT_EQ(0, mStrictCtrl.resetChains());
+    EXPECT_EQ(ACCEPT, mStrictCtrl.getUidCleartextPenalty(12345));
+    EXPECT_EQ(ACCEPT, mStrictCtrl.getUidCleartextPenalty(10001));
+    sRestoreCmds.clear();
 }
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TcpHealthStore"
+
+#include "TcpHealthStore.h"
+
+#include <cinttypes>
+
+namespace android {
+namespace net {
+
+void TcpHealthStore::update(uint32_t netId, const Sample& sample, int64_t whenMs) {
+    // Find the network's slot, or failing that a free slot, or failing that the stalest slot.
+    // Only this (single) writer examines netId and updatedMs outside the seq protocol.
+    Slot* target = nullptr;
+    Slot* freeSlot = nullptr;
+    Slot* stalest = nullptr;
+    for (Slot& slot : mSlots) {
+        if (slot.data.netId == netId) {
+            target = &slot;
+            break;
+        }
+        if (slot.data.netId == 0) {
+            if (freeSlot == nullptr) freeSlot = &slot;
+        } else if (stalest == nullptr || slot.data.updatedMs < stalest->data.updatedMs) {
+            stalest = &slot;
+        }
+    }
+    if (target == nullptr) {
+        target = (freeSlot != nullptr) ? freeSlot : stalest;
+    }
+
+    const bool isNew = (target->data.netId != netId);
+    const uint32_t seq = target->seq.load(std::memory_order_relaxed);
+    target->seq.store(seq + 1, std::memory_order_relaxed);  // Now odd: readers stand back.
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Aggregate& data = target->data;
+    if (isNew) {
+        data = {};
+        data.netId = netId;
+        data.ewmaRttUs = sample.avgRttUs;
+    } else if (sample.sockets > 0) {
+        // Same gain as the kernel's srtt smoothing: new = old + (sample - old) / 8.
+        data.ewmaRttUs += (static_cast<int64_t>(sample.avgRttUs) - data.ewmaRttUs) / 8;
+    }
+    data.updatedMs = whenMs;
+    data.latest = sample;
+    data.totalSentPackets += sample.sentPackets;
+    data.totalLostPackets += sample.lostPackets;
+
+    target->seq.store(seq + 2, std::memory_order_release);
+}
+
+std::vector<TcpHealthStore::Aggregate> TcpHealthStore::snapshot() const {
+    std::vector<Aggregate> aggregates;
+    aggregates.reserve(kMaxNetworks);
+    for (const Slot& slot : mSlots) {
+        const uint32_t before = slot.seq.load(std::memory_order_acquire);
+        if (before & 1) continue;  // Mid-rewrite; at most one slot, skip rather than spin.
+        Aggregate copy = slot.data;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != before) continue;
+        if (copy.netId == 0) continue;  // Free slot.
+        aggregates.push_back(copy);
+    }
+    return aggregates;
+}
+
+void TcpHealthStore::dump(netdutils::DumpWriter& dw) const {
+    dw.println("TCP health aggregates:");
+    netdutils::ScopedIndent indent(dw);
+    for (const Aggregate& data : snapshot()) {
+        dw.println("netId=%u updatedMs=%" PRId64
+                   " sent=%u lost=%u avgRttMs=%g ewmaRttMs=%g sentAckDiffMs=%d sockets=%d"
+                   " totalSent=%" PRIu64 " totalLost=%" PRIu64,
+                   data.netId, data.updatedMs, data.latest.sentPackets, data.latest.lostPackets,
+                   data.latest.avgRttUs / 1000.0, data.ewmaRttUs / 1000.0,
+                   data.latest.avgSentAckDiffMs, data.latest.sockets, data.totalSentPackets,
+                   data.totalLostPackets);
+    }
+}
+
+}  // namespace net
+}  // namespace android
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_SERVER_TCP_HEALTH_STORE_H
+#define NETD_SERVER_TCP_HEALTH_STORE_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include <netdutils/DumpWriter.h>
+
+namespace android {
+namespace net {
+
+// Per-network rolling TCP health aggregates, published by TcpSocketMonitor's poll and consumed
+// by the framework's network scoring instead of running a second sock_diag pipeline in
+// system_server.
+//
+// The store is a fixed array of per-network slots, each protected by its own sequence counter.
+// There is exactly one writer (the poll), so updates are plain stores bracketed by the counter;
+// readers copy a slot and re-check the counter, retrying past the rare concurrent rewrite.
+// Neither side ever takes a lock or allocates, so a binder query cannot delay the poll and the
+// poll cannot block a query. When all slots are taken, a new network evicts the stalest one.
+class TcpHealthStore {
+  public:
+    // More slots than concurrent networks on any real device.
+    static constexpr size_t kMaxNetworks = 32;
+
+    // One poll interval's aggregate for one network, as computed by TcpSocketMonitor.
+    struct Sample {
+        // Packets sent/lost during the poll interval, summed across the network's sockets.
+        uint32_t sentPackets;
+        uint32_t lostPackets;
+        // Smoothed RTT and time between last send and last ack, averaged across sockets.
+        uint32_t avgRttUs;
+        int32_t avgSentAckDiffMs;
+        // Number of sockets aggregated.
+        int32_t sockets;
+    };
+
+    // The rolling state of one network, as returned to readers.
+    struct Aggregate {
+        uint32_t netId;
+        // CLOCK_BOOTTIME timestamp of the poll that last updated this entry, so readers can
+        // judge freshness against the polling interval.
+        int64_t updatedMs;
+        // The most recent poll's Sample.
+        Sample latest;
+        // Exponentially weighted moving average of avgRttUs across polls, gain 1/8 (matching
+        // the kernel's own srtt smoothing), so scoring sees trend rather than one interval.
+        uint32_t ewmaRttUs;
+        // Cumulative counters since the network first appeared in the store.
+        uint64_t totalSentPackets;
+        uint64_t totalLostPackets;
+    };
+
+    // Folds one poll's aggregate for |netId| into the store. Must only ever be called from one
+    // thread at a time (TcpSocketMonitor's poll, under its lock).
+    void update(uint32_t netId, const Sample& sample, int64_t whenMs);
+
+    // Copies the current aggregates, skipping slots caught mid-rewrite. Safe from any thread.
+    std::vector<Aggregate> snapshot() const;
+
+    void dump(netdutils::DumpWriter& dw) const;
+
+  private:
+    struct Slot {
+        // Even while stable, odd while the writer is rewriting the body.
+        std::atomic<uint32_t> seq{0};
+        // netId 0 (NETID_UNSET) marks a free slot.
+        Aggregate data{};
+    };
+
+    Slot mSlots[kMaxNetworks];
+};
+
+}  // namespace net
+}  // namespace android
+
+#endif  // NETD_SERVER_TCP_HEALTH_STORE_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TcpHealthStore.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace net {
+
+namespace {
+
+const TcpHealthStore::Aggregate* findNetwork(const std::vector<TcpHealthStore::Aggregate>& all,
+                                             uint32_t netId) {
+    for (const auto& aggregate : all) {
+        if (aggregate.netId == netId) return &aggregate;
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+TEST(TcpHealthStoreTest, UpdateAndSnapshot) {
+    TcpHealthStore store;
+    EXPECT_TRUE(store.snapshot().empty());
+
+    store.update(101, {.sentPackets = 100,
+                       .lostPackets = 2,
+                       .avgRttUs = 40000,
+                       .avgSentAckDiffMs = 15,
+                       .sockets = 4},
+                 1000);
+
+    const auto all = store.snapshot();
+    ASSERT_EQ(1U, all.size());
+    const TcpHealthStore::Aggregate& data = all[0];
+    EXPECT_EQ(101U, data.netId);
+    EXPECT_EQ(1000, data.updatedMs);
+    EXPECT_EQ(100U, data.latest.sentPackets);
+    EXPECT_EQ(2U, data.latest.lostPackets);
+    EXPECT_EQ(40000U, data.latest.avgRttUs);
+    EXPECT_EQ(15, data.latest.avgSentAckDiffMs);
+    EXPECT_EQ(4, data.latest.sockets);
+    // The first sample seeds the moving average and the cumulative counters.
+    EXPECT_EQ(40000U, data.ewmaRttUs);
+    EXPECT_EQ(100U, data.totalSentPackets);
+    EXPECT_EQ(2U, data.totalLostPackets);
+}
+
+TEST(TcpHealthStoreTest, RollingAggregates) {
+    TcpHealthStore store;
+    store.update(101, {.sentPackets = 100, .lostPackets = 1, .avgRttUs = 40000, .sockets = 2},
+                 1000);
+    store.update(101, {.sentPackets = 50, .lostPackets = 0, .avgRttUs = 48000, .sockets = 2},
+                 2000);
+
+    const auto all = store.snapshot();
+    ASSERT_EQ(1U, all.size());
+    const TcpHealthStore::Aggregate& data = all[0];
+    EXPECT_EQ(2000, data.updatedMs);
+    // The latest sample replaces the previous one; totals accumulate.
+    EXPECT_EQ(50U, data.latest.sentPackets);
+    EXPECT_EQ(150U, data.totalSentPackets);
+    EXPECT_EQ(1U, data.totalLostPackets);
+    // EWMA with gain 1/8: 40000 + (48000 - 40000) / 8.
+    EXPECT_EQ(41000U, data.ewmaRttUs);
+}
+
+TEST(TcpHealthStoreTest, SocketlessSampleDoesNotMoveEwma) {
+    TcpHealthStore store;
+    store.update(101, {.sentPackets = 10, .avgRttUs = 40000, .sockets = 1}, 1000);
+    store.update(101, {.sockets = 0}, 2000);
+
+    const auto all = store.snapshot();
+    ASSERT_EQ(1U, all.size());
+    EXPECT_EQ(40000U, all[0].ewmaRttUs);
+    EXPECT_EQ(2000, all[0].updatedMs);
+}
+
+TEST(TcpHealthStoreTest, EvictsStalestWhenFull) {
+    TcpHealthStore store;
+    for (uint32_t i = 0; i < TcpHealthStore::kMaxNetworks; ++i) {
+        store.update(100 + i, {.sentPackets = 1, .sockets = 1}, 1000 + i);
+    }
+    ASSERT_EQ(TcpHealthStore::kMaxNetworks, store.snapshot().size());
+
+    // One more network than slots: the entry updated longest ago makes way.
+    store.update(999, {.sentPackets = 1, .sockets = 1}, 5000);
+    const auto all = store.snapshot();
+    EXPECT_EQ(TcpHealthStore::kMaxNetworks, all.size());
+    EXPECT_EQ(nullptr, findNetwork(all, 100));
+    EXPECT_NE(nullptr, findNetwork(all, 999));
+    EXPECT_NE(nullptr, findNetwork(all, 101));
+}
+
+}  // namespace net
+}  // namespace android
@@ -16,14 +16,24 @@
 
 #define LOG_TAG "TcpSocketMonitor"
 
+#include <algorithm>
 #include <chrono>
 #include <cinttypes>
 #include <thread>
 #include <vector>
 
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
 #include <netinet/tcp.h>
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
 #include <linux/tcp.h>
+#include <sys/socket.h>
 
 #include "Controllers.h"
 #include "SockDiag.h"
@@ -39,6 +49,16 @@ namespace net {
 using std::chrono::duration_cast;
 using std::chrono::steady_clock;
 
+namespace {
+
+int64_t bootTimeMs() {
+    timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+}  // namespace
+
 constexpr const char* getTcpStateName(int t) {
     switch (t) {
         case TCP_ESTABLISHED:
@@ -77,10 +97,10 @@ constexpr const char* getTcpStateName(int t) {
 
 static void tcpInfoPrint(DumpWriter &dw, Fwmark mark, const struct inet_diag_msg *sockinfo,
                          const struct tcp_info *tcpinfo, uint32_t tcpinfoLen) {
-    char saddr[INET6_ADDRSTRLEN] = {};
-    char daddr[INET6_ADDRSTRLEN] = {};
-    inet_ntop(sockinfo->idiag_family, &(sockinfo->id.idiag_src), saddr, sizeof(saddr));
-    inet_ntop(sockinfo->idiag_family, &(sockinfo->id.idiag_dst), daddr, sizeof(daddr));
+    char saddr[INET6_ADDRSTRLEN];
+    char daddr[INET6_ADDRSTRLEN];
+    formatIpAddress(sockinfo->idiag_family, &(sockinfo->id.idiag_src), saddr);
+    formatIpAddress(sockinfo->idiag_family, &(sockinfo->id.idiag_dst), daddr);
 
     dw.println(
             "netId=%d uid=%u mark=0x%x saddr=%s daddr=%s sport=%u dport=%u tcp_state=%s(%u) "
@@ -100,6 +120,8 @@ static void tcpInfoPrint(DumpWriter &dw, Fwmark mark, const struct inet_diag_msg
 
 const String16 TcpSocketMonitor::DUMP_KEYWORD = String16("tcp_socket_info");
 const milliseconds TcpSocketMonitor::kDefaultPollingInterval = milliseconds(30000);
+const milliseconds TcpSocketMonitor::kDefaultReconciliationInterval = milliseconds(300000);
+const milliseconds TcpSocketMonitor::kMaxPollingInterval = milliseconds(600000);
 
 void TcpSocketMonitor::dump(DumpWriter& dw) {
     std::lock_guard guard(mLock);
@@ -109,8 +131,8 @@ void TcpSocketMonitor::dump(DumpWriter& dw) {
 
     const auto now = steady_clock::now();
     const auto d = duration_cast<milliseconds>(now - mLastPoll);
-    dw.println("running=%d, suspended=%d, last poll %lld ms ago",
-            mIsRunning, mIsSuspended, d.count());
+    dw.println("suspended=%d, poll armed=%d, last poll %lld ms ago",
+            mIsSuspended, mPollTimer != TimerWheel::INVALID_TIMER, d.count());
 
     if (!mNetworkStats.empty()) {
         dw.blankline();
@@ -128,6 +150,9 @@ void TcpSocketMonitor::dump(DumpWriter& dw) {
         }
     }
 
+    dw.blankline();
+    mHealthStore.dump(dw);
+
     if (!mSocketEntries.empty()) {
         dw.blankline();
         dw.println("Socket entries:");
@@ -157,35 +182,48 @@ void TcpSocketMonitor::dump(DumpWriter& dw) {
 void TcpSocketMonitor::setPollingInterval(milliseconds nextSleepDurationMs) {
     std::lock_guard guard(mLock);
 
+    mBaseSleepDurationMs = nextSleepDurationMs;
     mNextSleepDurationMs = nextSleepDurationMs;
 
     ALOGD("tcpinfo polling interval set to %lld ms", mNextSleepDurationMs.count());
 }
 
 void TcpSocketMonitor::resumePolling() {
-    bool wasSuspended;
-    {
-        std::lock_guard guard(mLock);
+    std::lock_guard guard(mLock);
 
-        wasSuspended = mIsSuspended;
-        mIsSuspended = false;
-        ALOGD("resuming tcpinfo polling (interval=%lldms)", mNextSleepDurationMs.count());
-    }
+    // Start from the configured cadence again; the backoff re-arms if the device is idle.
+    mNextSleepDurationMs = mBaseSleepDurationMs;
+    ALOGD("resuming tcpinfo polling (interval=%lldms)", mNextSleepDurationMs.count());
 
-    if (wasSuspended) {
-        mCv.notify_all();
+    if (mIsSuspended) {
+        mIsSuspended = false;
+        // Poll right away, like waking the old polling thread did.
+        mPollTimer = TimerWheel::get().scheduleAfter(milliseconds::zero(), [this] { pollCycle(); });
     }
 }
 
 void TcpSocketMonitor::suspendPolling() {
-    std::lock_guard guard(mLock);
+    TimerWheel::TimerId pollTimer = TimerWheel::INVALID_TIMER;
+    {
+        std::lock_guard guard(mLock);
 
-    bool wasSuspended = mIsSuspended;
-    mIsSuspended = true;
-    ALOGD("suspending tcpinfo polling");
+        bool wasSuspended = mIsSuspended;
+        mIsSuspended = true;
+        ALOGD("suspending tcpinfo polling");
 
-    if (!wasSuspended) {
-        mSocketEntries.clear();
+        if (!wasSuspended) {
+            mSocketEntries.clear();
+            mEventStats.clear();
+            mNetworkSocketCounts.clear();
+        }
+        pollTimer = mPollTimer;
+        mPollTimer = TimerWheel::INVALID_TIMER;
+    }
+    // Outside mLock: cancel() may wait out an in-flight pollCycle(), which takes mLock. A cycle
+    // that is already past its suspension check re-arms mPollTimer, but then it did so before
+    // the suspension above and that is the timer cancelled here; either way no timer survives.
+    if (pollTimer != TimerWheel::INVALID_TIMER) {
+        TimerWheel::get().cancel(pollTimer);
     }
 }
 
@@ -209,7 +247,7 @@ void TcpSocketMonitor::poll() {
         if (sockinfo == nullptr || tcpinfo == nullptr || tcpinfoLen == 0 || mark.intValue == 0) {
             return;
         }
-        updateSocketStats(now, mark, sockinfo, tcpinfo, tcpinfoLen);
+        updateSocketStats(now, mark, sockinfo, tcpinfo, tcpinfoLen, &mNetworkStats);
     };
 
     // Reset mNetworkStats
@@ -229,56 +267,209 @@ void TcpSocketMonitor::poll() {
         }
     }
 
+    // Fold in the final stats of sockets destroyed since the last poll, harvested by the destroy
+    // notification thread. Those sockets are gone from the dump above but their last diff still
+    // belongs in this reporting interval.
+    for (const auto& [netId, eventStats] : mEventStats) {
+        TcpStats& stats = mNetworkStats[netId];
+        stats.sent += eventStats.sent;
+        stats.lost += eventStats.lost;
+        stats.rttUs += eventStats.rttUs;
+        stats.sentAckDiffMs += eventStats.sentAckDiffMs;
+        stats.nSockets += eventStats.nSockets;
+    }
+    mEventStats.clear();
+
+    // Recompute each network's socket population; a network is dirty when its population or
+    // traffic counters moved since the previous dump.
+    std::unordered_map<uint32_t, int32_t> networkSocketCounts;
+    for (const auto& [cookie, entry] : mSocketEntries) {
+        networkSocketCounts[entry.mark.netId]++;
+    }
+    bool anyActivity = (networkSocketCounts.size() != mNetworkSocketCounts.size());
+    const auto isDirty = [&](uint32_t netId, const TcpStats& stats) {
+        if (stats.sent != 0 || stats.lost != 0) return true;
+        const auto previous = mNetworkSocketCounts.find(netId);
+        const int32_t previousCount = (previous != mNetworkSocketCounts.end())
+                ? previous->second : 0;
+        const auto current = networkSocketCounts.find(netId);
+        const int32_t currentCount = (current != networkSocketCounts.end()) ? current->second : 0;
+        return currentCount != previousCount;
+    };
+
+    // Publish this interval's aggregates to the lock-free health store whether or not the
+    // network is dirty; consumers judge freshness from the timestamp.
+    const int64_t nowBootMs = bootTimeMs();
+    for (const auto& [netId, stats] : mNetworkStats) {
+        if (stats.nSockets == 0) {
+            continue;
+        }
+        mHealthStore.update(netId,
+                            {.sentPackets = stats.sent,
+                             .lostPackets = stats.lost,
+                             .avgRttUs = stats.rttUs / static_cast<uint32_t>(stats.nSockets),
+                             .avgSentAckDiffMs = stats.sentAckDiffMs / stats.nSockets,
+                             .sockets = stats.nSockets},
+                            nowBootMs);
+    }
+
     const auto listener = gCtls->eventReporter.getNetdEventListener();
-    if (listener != nullptr) {
-        std::vector<int> netIds;
-        std::vector<int> sentPackets;
-        std::vector<int> lostPackets;
-        std::vector<int> rtts;
-        std::vector<int> sentAckDiffs;
-        for (auto const& stats : mNetworkStats) {
-            int32_t nSockets = stats.second.nSockets;
-            if (nSockets == 0) {
-                continue;
-            }
-            netIds.push_back(stats.first);
-            sentPackets.push_back(stats.second.sent);
-            lostPackets.push_back(stats.second.lost);
-            rtts.push_back(stats.second.rttUs / nSockets);
-            sentAckDiffs.push_back(stats.second.sentAckDiffMs / nSockets);
+    std::vector<int> netIds;
+    std::vector<int> sentPackets;
+    std::vector<int> lostPackets;
+    std::vector<int> rtts;
+    std::vector<int> sentAckDiffs;
+    for (auto const& stats : mNetworkStats) {
+        int32_t nSockets = stats.second.nSockets;
+        if (nSockets == 0) {
+            continue;
+        }
+        if (!isDirty(stats.first, stats.second)) {
+            continue;
         }
+        anyActivity = true;
+        netIds.push_back(stats.first);
+        sentPackets.push_back(stats.second.sent);
+        lostPackets.push_back(stats.second.lost);
+        rtts.push_back(stats.second.rttUs / nSockets);
+        sentAckDiffs.push_back(stats.second.sentAckDiffMs / nSockets);
+    }
+    if (listener != nullptr && !netIds.empty()) {
         listener->onTcpSocketStatsEvent(netIds, sentPackets, lostPackets, rtts, sentAckDiffs);
     }
+    mNetworkSocketCounts = std::move(networkSocketCounts);
+
+    // Back off while the device is idle; return to the configured cadence on activity.
+    if (anyActivity) {
+        mNextSleepDurationMs = mBaseSleepDurationMs;
+    } else if (mNextSleepDurationMs < kMaxPollingInterval) {
+        mNextSleepDurationMs = std::min(mNextSleepDurationMs * 2, kMaxPollingInterval);
+        ALOGD("no tcpinfo activity, backing off to %lldms polls", mNextSleepDurationMs.count());
+    }
 
     mLastPoll = now;
 }
 
-void TcpSocketMonitor::waitForNextPoll() {
-    bool isSuspended;
-    milliseconds nextSleepDurationMs;
-    {
-        std::lock_guard guard(mLock);
-        isSuspended = mIsSuspended;
-        nextSleepDurationMs= mNextSleepDurationMs;
+void TcpSocketMonitor::pollCycle() {
+    poll();
+
+    std::lock_guard guard(mLock);
+    if (mIsSuspended) {
+        // suspendPolling() won the race; it owns cancelling whatever mPollTimer held.
+        return;
+    }
+    mPollTimer = TimerWheel::get().scheduleAfter(mNextSleepDurationMs, [this] { pollCycle(); });
+}
+
+bool TcpSocketMonitor::subscribeToDestroyEvents() {
+    mEventSock.reset(socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG));
+    if (mEventSock < 0) {
+        ALOGE("Error opening sock diag socket for TCP destroy notifications: %s", strerror(errno));
+        return false;
     }
 
-    std::unique_lock<std::mutex> ul(mLock);
-    if (isSuspended) {
-        mCv.wait(ul);
-    } else {
-        mCv.wait_for(ul, nextSleepDurationMs);
+    for (const int group : {SKNLGRP_INET_TCP_DESTROY, SKNLGRP_INET6_TCP_DESTROY}) {
+        if (setsockopt(mEventSock, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) ==
+            -1) {
+            // Kernel without CONFIG_INET_DIAG_DESTROY; stay in pure polling mode.
+            ALOGI("TCP destroy notifications unavailable, falling back to polling: %s",
+                  strerror(errno));
+            mEventSock.reset();
+            return false;
+        }
+    }
+
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) == -1) {
+        ALOGE("Error opening wakeup pipe for TCP destroy notifications: %s", strerror(errno));
+        mEventSock.reset();
+        return false;
     }
+    mEventWakeupReadFd.reset(pipeFds[0]);
+    mEventWakeupWriteFd.reset(pipeFds[1]);
+    return true;
 }
 
-bool TcpSocketMonitor::isRunning() {
+void TcpSocketMonitor::eventLoop() {
+    while (true) {
+        struct pollfd fds[] = {
+                {.fd = mEventSock.get(), .events = POLLIN},
+                {.fd = mEventWakeupReadFd.get(), .events = POLLIN},
+        };
+
+        if (TEMP_FAILURE_RETRY(::poll(fds, 2, -1)) == -1) {
+            ALOGE("poll failed for TCP destroy notifications: %s", strerror(errno));
+            return;
+        }
+        if (fds[1].revents != 0) {
+            // Woken up by the destructor.
+            return;
+        }
+        if ((fds[0].revents & POLLIN) == 0) {
+            continue;
+        }
+
+        uint8_t buf[4096];
+        ssize_t bytesread = TEMP_FAILURE_RETRY(recv(mEventSock.get(), buf, sizeof(buf), 0));
+        if (bytesread < 0) {
+            if (errno == ENOBUFS) {
+                // Notifications were dropped; the next reconciliation dump catches up.
+                continue;
+            }
+            ALOGE("recv failed for TCP destroy notifications: %s", strerror(errno));
+            return;
+        }
+
+        size_t len = bytesread;
+        for (const nlmsghdr *nlh = reinterpret_cast<const nlmsghdr*>(buf); NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == SOCK_DIAG_BY_FAMILY) {
+                processDestroyNotification(nlh);
+            }
+        }
+    }
+}
+
+void TcpSocketMonitor::processDestroyNotification(const struct nlmsghdr *nlh) {
+    // Same layout as the messages of a sock_diag dump: an inet_diag_msg followed by attributes.
+    Fwmark mark;
+    const struct tcp_info *tcpinfo = nullptr;
+    uint32_t tcpinfoLen = 0;
+    const inet_diag_msg *msg = reinterpret_cast<const inet_diag_msg*>(NLMSG_DATA(nlh));
+    uint32_t attr_len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*msg));
+    const struct rtattr *attr = reinterpret_cast<const struct rtattr*>(msg + 1);
+    while (RTA_OK(attr, attr_len)) {
+        if (attr->rta_type == INET_DIAG_INFO) {
+            tcpinfo = reinterpret_cast<const struct tcp_info*>(RTA_DATA(attr));
+            tcpinfoLen = RTA_PAYLOAD(attr);
+        }
+        if (attr->rta_type == INET_DIAG_MARK) {
+            mark.intValue = *reinterpret_cast<const uint32_t*>(RTA_DATA(attr));
+        }
+        attr = RTA_NEXT(attr, attr_len);
+    }
+
+    if (tcpinfo == nullptr || tcpinfoLen == 0 || mark.intValue == 0) {
+        return;
+    }
+
     std::lock_guard guard(mLock);
-    return mIsRunning;
+    if (mIsSuspended) {
+        return;
+    }
+
+    // Harvest the socket's final stats into mEventStats and forget about it; the next poll
+    // reports the aggregate.
+    updateSocketStats(steady_clock::now(), mark, msg, tcpinfo, tcpinfoLen, &mEventStats);
+    const uint64_t cookie = (static_cast<uint64_t>(msg->id.idiag_cookie[0]) << 32)
+            | static_cast<uint64_t>(msg->id.idiag_cookie[1]);
+    mSocketEntries.erase(cookie);
 }
 
-void TcpSocketMonitor::updateSocketStats(time_point now, Fwmark mark,
-                                         const struct inet_diag_msg *sockinfo,
-                                         const struct tcp_info *tcpinfo,
-                                         uint32_t tcpinfoLen) NO_THREAD_SAFETY_ANALYSIS {
+void TcpSocketMonitor::updateSocketStats(
+        time_point now, Fwmark mark, const struct inet_diag_msg *sockinfo,
+        const struct tcp_info *tcpinfo, uint32_t tcpinfoLen,
+        std::unordered_map<uint32_t, TcpStats> *aggregate) NO_THREAD_SAFETY_ANALYSIS {
     int32_t lastAck = TCPINFO_GET(tcpinfo, tcpi_last_ack_recv, tcpinfoLen, 0);
     int32_t lastSent = TCPINFO_GET(tcpinfo, tcpi_last_data_sent, tcpinfoLen, 0);
     TcpStats diff = {
@@ -308,7 +499,7 @@ void TcpSocketMonitor::updateSocketStats(time_point now, Fwmark mark,
 
     {
         // Aggregate the diff per network id.
-        auto& stats = mNetworkStats[mark.netId];
+        auto& stats = (*aggregate)[mark.netId];
         stats.sent += diff.sent;
         stats.lost += diff.lost;
         stats.rttUs += diff.rttUs;
@@ -320,26 +511,39 @@ void TcpSocketMonitor::updateSocketStats(time_point now, Fwmark mark,
 TcpSocketMonitor::TcpSocketMonitor() {
     std::lock_guard guard(mLock);
 
+    mBaseSleepDurationMs = kDefaultPollingInterval;
     mNextSleepDurationMs = kDefaultPollingInterval;
-    mIsRunning = true;
+    // Suspended until resumePolling(); the first poll is scheduled on the shared TimerWheel
+    // there, so a monitor that is never resumed costs neither a thread nor any wakeups.
     mIsSuspended = true;
-    mPollingThread = std::thread([this] {
-        (void) this;
-        while (isRunning()) {
-            poll();
-            waitForNextPoll();
-        }
-    });
+    if (subscribeToDestroyEvents()) {
+        // With destroy notifications streaming in, the periodic dump only needs to pick up newly
+        // established sockets, so it can run at the much slower reconciliation cadence.
+        mBaseSleepDurationMs = kDefaultReconciliationInterval;
+        mNextSleepDurationMs = kDefaultReconciliationInterval;
+        mEventThread = std::thread([this] { eventLoop(); });
+    }
 }
 
 TcpSocketMonitor::~TcpSocketMonitor() {
+    TimerWheel::TimerId pollTimer = TimerWheel::INVALID_TIMER;
     {
         std::lock_guard guard(mLock);
-        mIsRunning = false;
+        // Stops any in-flight pollCycle() from re-arming.
         mIsSuspended = true;
+        pollTimer = mPollTimer;
+        mPollTimer = TimerWheel::INVALID_TIMER;
+    }
+    // Blocks out a pollCycle() that is still executing, so no timer callback touches this
+    // monitor once destruction proceeds.
+    if (pollTimer != TimerWheel::INVALID_TIMER) {
+        TimerWheel::get().cancel(pollTimer);
+    }
+    if (mEventThread.joinable()) {
+        const char byte = 0;
+        TEMP_FAILURE_RETRY(write(mEventWakeupWriteFd, &byte, sizeof(byte)));
+        mEventThread.join();
     }
-    mCv.notify_all();
-    mPollingThread.join();
 }
 
 }  // namespace net
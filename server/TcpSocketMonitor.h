@@ -18,18 +18,21 @@
 #define TCP_SOCKET_MONITOR_H
 
 #include <chrono>
-#include <condition_variable>
 #include <mutex>
 #include <thread>
 #include <unordered_map>
 
 #include <android-base/thread_annotations.h>
+#include <android-base/unique_fd.h>
 #include "netdutils/DumpWriter.h"
 #include "utils/String16.h"
 
 #include "Fwmark.h"
+#include "TcpHealthStore.h"
+#include "TimerWheel.h"
 
 struct inet_diag_msg;
+struct nlmsghdr;
 struct tcp_info;
 
 namespace android {
@@ -43,6 +46,14 @@ class TcpSocketMonitor {
 
     static const String16 DUMP_KEYWORD;
     static const milliseconds kDefaultPollingInterval;
+    // Interval between full sock_diag dumps when the kernel delivers TCP destroy notifications.
+    // Dumps then only reconcile sockets established since the last dump, so they can run far
+    // less often than in pure polling mode.
+    static const milliseconds kDefaultReconciliationInterval;
+    // Ceiling for the adaptive backoff: when consecutive polls observe no socket population
+    // change and no traffic on any network, the sleep duration doubles up to this bound and
+    // snaps back to the configured interval on the first sign of activity.
+    static const milliseconds kMaxPollingInterval;
 
     // A subset of fields found in struct inet_diag_msg and struct tcp_info.
     struct TcpStats {
@@ -82,28 +93,38 @@ class TcpSocketMonitor {
     void resumePolling();
     void suspendPolling();
 
+    // The per-network rolling aggregates published by every poll. Reading is lock-free and safe
+    // from any thread (binder queries included); only poll() writes.
+    TcpHealthStore& healthStore() { return mHealthStore; }
+
   private:
     void poll();
-    void waitForNextPoll();
-    bool isRunning();
+    // One turn of the polling loop, run on the shared TimerWheel thread: polls, then re-arms
+    // mPollTimer for mNextSleepDurationMs unless the monitor has been suspended meanwhile.
+    void pollCycle();
+    // Subscribes mEventSock to the kernel's TCP destroy notification groups. Returns false (and
+    // leaves the monitor in pure polling mode) on kernels without CONFIG_INET_DIAG_DESTROY.
+    bool subscribeToDestroyEvents();
+    void eventLoop();
+    void processDestroyNotification(const struct nlmsghdr *nlh);
     void updateSocketStats(time_point now, Fwmark mark, const struct inet_diag_msg *sockinfo,
-                           const struct tcp_info *tcpinfo, uint32_t tcpinfoLen) REQUIRES(mLock);
+                           const struct tcp_info *tcpinfo, uint32_t tcpinfoLen,
+                           std::unordered_map<uint32_t, TcpStats> *aggregate) REQUIRES(mLock);
 
     // Lock guarding all reads and writes to member variables.
     std::mutex mLock;
-    // Used by the polling thread for sleeping between poll operations.
-    std::condition_variable mCv;
-    // The thread that polls sock_diag continuously.
-    std::thread mPollingThread;
-    // The duration of a sleep between polls. Can be updated by the instance owner for dynamically
-    // adjusting the polling rate.
+    // The pending poll timer on the shared TimerWheel, or INVALID_TIMER while suspended. Polls
+    // are scheduled one-shot at a time because the sleep duration adapts between polls.
+    TimerWheel::TimerId mPollTimer GUARDED_BY(mLock) = TimerWheel::INVALID_TIMER;
+    // The configured sleep duration between polls, set by the instance owner.
+    milliseconds mBaseSleepDurationMs GUARDED_BY(mLock);
+    // The duration of the next sleep between polls: mBaseSleepDurationMs while networks show
+    // activity, progressively doubled towards kMaxPollingInterval while the device is idle.
     milliseconds mNextSleepDurationMs GUARDED_BY(mLock);
     // The time of the last successful poll operation.
     time_point mLastPoll GUARDED_BY(mLock);
-    // True if the polling thread should sleep until notified.
+    // True if polling is suspended; no poll timer is armed while set.
     bool mIsSuspended GUARDED_BY(mLock);
-    // True while the polling thread should poll.
-    bool mIsRunning GUARDED_BY(mLock);
     // Map of SocketEntry structs keyed by socket cookie. This map tracks per-socket data needed for
     // computing diffs between sock_diag dumps. Entries for closed sockets are continuously cleaned
     // after every dump operation based on timestamps of last updates.
@@ -112,6 +133,23 @@ class TcpSocketMonitor {
     // This map tracks per-network data for a single sock_diag dump and is cleared before every dump
     // operation.
     std::unordered_map<uint32_t, TcpStats> mNetworkStats GUARDED_BY(mLock);
+    // Final stats of sockets destroyed since the last poll, harvested from the kernel's destroy
+    // notifications and folded into mNetworkStats by the next poll.
+    std::unordered_map<uint32_t, TcpStats> mEventStats GUARDED_BY(mLock);
+    // Per-network socket population observed by the previous dump, keyed by network id. A
+    // network is only reported to listeners when its population or traffic counters moved
+    // since the previous dump.
+    std::unordered_map<uint32_t, int32_t> mNetworkSocketCounts GUARDED_BY(mLock);
+    // Rolling per-network aggregates, rewritten by every poll. Internally synchronized (per-slot
+    // sequence counters), so readers don't need mLock.
+    TcpHealthStore mHealthStore;
+    // The thread that reads TCP destroy notifications; only started when the kernel supports them.
+    std::thread mEventThread;
+    // NETLINK_SOCK_DIAG socket subscribed to the TCP destroy notification groups.
+    base::unique_fd mEventSock;
+    // Pipe used to wake the event thread out of poll() on shutdown.
+    base::unique_fd mEventWakeupReadFd;
+    base::unique_fd mEventWakeupWriteFd;
 };
 
 }  // namespace net
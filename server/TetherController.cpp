@@ -30,9 +30,11 @@
 #include <arpa/inet.h>
 
 #include <array>
+#include <chrono>
 #include <cstdlib>
-#include <regex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #define LOG_TAG "TetherController"
@@ -104,18 +106,29 @@ void configureForTethering(bool enabled) {
 }
 
 bool configureForIPv6Router(const char *interface) {
-    return (InterfaceController::setEnableIPv6(interface, 0) == 0)
-            && (InterfaceController::setAcceptIPv6Ra(interface, 0) == 0)
-            && (InterfaceController::setAcceptIPv6Dad(interface, 0) == 0)
-            && (InterfaceController::setIPv6DadTransmits(interface, "0") == 0)
-            && (InterfaceController::setEnableIPv6(interface, 1) == 0);
+    // One transaction: the interface either ends up fully configured as a router, or a failed
+    // write rolls the earlier ones back and it keeps its client configuration. Toggling
+    // disable_ipv6 around the other writes makes the kernel clear autoconf state and then
+    // restart it under the new settings, as the individual setEnableIPv6() calls used to.
+    InterfaceController::SysctlTransaction tx;
+    tx.set("ipv6", "conf", interface, "disable_ipv6", "1");
+    tx.set("ipv6", "conf", interface, "accept_ra", "0");
+    tx.set("ipv6", "conf", interface, "accept_dad", "0");
+    tx.set("ipv6", "conf", interface, "dad_transmits", "0");
+    tx.set("ipv6", "conf", interface, "disable_ipv6", "0");
+    return tx.commit() == 0;
 }
 
 void configureForIPv6Client(const char *interface) {
-    InterfaceController::setAcceptIPv6Ra(interface, 1);
-    InterfaceController::setAcceptIPv6Dad(interface, 1);
-    InterfaceController::setIPv6DadTransmits(interface, "1");
-    InterfaceController::setEnableIPv6(interface, 0);
+    InterfaceController::SysctlTransaction tx;
+    // Mode "2": accept RAs even with forwarding enabled, matching setAcceptIPv6Ra().
+    tx.set("ipv6", "conf", interface, "accept_ra", "2");
+    tx.set("ipv6", "conf", interface, "accept_dad", "1");
+    tx.set("ipv6", "conf", interface, "dad_transmits", "1");
+    tx.set("ipv6", "conf", interface, "disable_ipv6", "1");
+    if (tx.commit() != 0) {
+        ALOGE("Failed to restore %s to IPv6 client mode", interface);
+    }
 }
 
 bool inBpToolsMode() {
@@ -403,10 +416,22 @@ int TetherController::setDnsForwarders(unsigned netId, char **servers, int numSe
     }
 
     mDnsNetId = netId;
+    if (daemonCmd == mDnsmasqState.update_dns_cmd) {
+        // Upstream switches routinely re-resolve to the same server set. The command string
+        // encodes both the fwmark and the servers in order, so equality means dnsmasq already
+        // has exactly this configuration; pushing it again only makes the daemon tear down and
+        // rebuild its forwarding state. (stopTethering() clears the cached command, so a freshly
+        // started daemon is never skipped.)
+        return 0;
+    }
     mDnsmasqState.update_dns_cmd = std::move(daemonCmd);
     if (mDaemonFd != -1) {
-        if (mDnsmasqState.sendAllState(mDaemonFd) != 0) {
+        // Only the DNS configuration changed; the downstream interface list is pushed
+        // separately by applyDnsInterfaces().
+        if (DnsmasqState::sendCmd(mDaemonFd, mDnsmasqState.update_dns_cmd) != 0) {
             mDnsForwarders.clear();
+            // Drop the cached command so a retry with the same servers is re-sent.
+            mDnsmasqState.update_dns_cmd.clear();
             errno = EREMOTEIO;
             return -errno;
         }
@@ -444,9 +469,17 @@ bool TetherController::applyDnsInterfaces() {
 
     if (!haveInterfaces) {
         mDnsmasqState.update_ifaces_cmd.clear();
+    } else if (daemonCmd == mDnsmasqState.update_ifaces_cmd) {
+        // Unchanged downstream set; dnsmasq already serves exactly these interfaces.
     } else {
         mDnsmasqState.update_ifaces_cmd = std::move(daemonCmd);
-        if (mDaemonFd != -1) return (mDnsmasqState.sendAllState(mDaemonFd) == 0);
+        if (mDaemonFd != -1) {
+            if (mDnsmasqState.sendAllState(mDaemonFd) != 0) {
+                // Drop the cached command so the next apply re-sends rather than skipping.
+                mDnsmasqState.update_ifaces_cmd.clear();
+                return false;
+            }
+        }
     }
     return true;
 }
@@ -607,6 +640,121 @@ int TetherController::enableNat(const char* intIface, const char* extIface) {
     return 0;
 }
 
+int TetherController::addTetherForwarding(
+        const std::vector<std::pair<std::string, std::string>>& intExtPairs) {
+    // Validate everything up front so that a bad pair can't leave the batch partially applied.
+    for (const auto& [intIface, extIface] : intExtPairs) {
+        if (!isIfaceName(intIface) || !isIfaceName(extIface)) {
+            return -ENODEV;
+        }
+        if (intIface == extIface) {
+            ALOGE("Duplicate interface specified: %s %s", intIface.c_str(), extIface.c_str());
+            return -EINVAL;
+        }
+    }
+
+    const bool firstNat = !isAnyForwardingPairEnabled();
+
+    std::vector<std::string> v4Raw;
+    std::vector<std::string> v4Filter;
+    std::vector<std::string> v4Nat;
+    std::vector<std::string> v6Raw;
+    std::vector<std::string> v6Filter;
+
+    if (firstNat) {
+        /*
+         * IPv6 tethering doesn't need the state-based conntrack rules, so
+         * it unconditionally jumps to the tether counters chain all the time.
+         */
+        v6Filter.push_back(StringPrintf("-A %s -g %s", LOCAL_FORWARD, LOCAL_TETHER_COUNTERS_CHAIN));
+        const std::string alertRule = StringPrintf("-I %s -j %s", LOCAL_FORWARD,
+                                                   BandwidthController::LOCAL_GLOBAL_ALERT);
+        v4Filter.push_back(alertRule);
+        v6Filter.push_back(alertRule);
+    }
+
+    std::set<std::string> newUpstreams;
+    std::set<std::pair<std::string, std::string>> newPairs;
+    for (const auto& [intIface, extIface] : intExtPairs) {
+        if (isForwardingPairEnabled(intIface, extIface)) continue;
+        if (!newPairs.insert({intIface, extIface}).second) continue;
+
+        // Masquerade the upstream if we are the first enabled nat for it.
+        if (!isAnyForwardingEnabledOnUpstream(extIface) && newUpstreams.insert(extIface).second) {
+            v4Nat.push_back(StringPrintf("-A %s -o %s -j MASQUERADE", LOCAL_NAT_POSTROUTING,
+                                         extIface.c_str()));
+        }
+
+        v6Raw.push_back(StringPrintf("-A %s -i %s -m rpfilter --invert ! -s fe80::/64 -j DROP",
+                                     LOCAL_RAW_PREROUTING, intIface.c_str()));
+        v4Raw.push_back(StringPrintf("-A %s -p tcp --dport 21 -i %s -j CT --helper ftp",
+                                     LOCAL_RAW_PREROUTING, intIface.c_str()));
+        v4Raw.push_back(StringPrintf("-A %s -p tcp --dport 1723 -i %s -j CT --helper pptp",
+                                     LOCAL_RAW_PREROUTING, intIface.c_str()));
+        v4Filter.push_back(
+                StringPrintf("-A %s -i %s -o %s -m state --state ESTABLISHED,RELATED -g %s",
+                             LOCAL_FORWARD, extIface.c_str(), intIface.c_str(),
+                             LOCAL_TETHER_COUNTERS_CHAIN));
+        v4Filter.push_back(StringPrintf("-A %s -i %s -o %s -m state --state INVALID -j DROP",
+                                        LOCAL_FORWARD, intIface.c_str(), extIface.c_str()));
+        v4Filter.push_back(StringPrintf("-A %s -i %s -o %s -g %s", LOCAL_FORWARD, intIface.c_str(),
+                                        extIface.c_str(), LOCAL_TETHER_COUNTERS_CHAIN));
+
+        // We only ever add tethering quota rules so that they stick.
+        if (!tetherCountingRuleExists(intIface, extIface)) {
+            v4Filter.push_back(makeTetherCountingRule(intIface.c_str(), extIface.c_str()));
+            v4Filter.push_back(makeTetherCountingRule(extIface.c_str(), intIface.c_str()));
+            v6Filter.push_back(makeTetherCountingRule(intIface.c_str(), extIface.c_str()));
+            v6Filter.push_back(makeTetherCountingRule(extIface.c_str(), intIface.c_str()));
+        }
+    }
+
+    if (newPairs.empty()) return 0;
+
+    // Always make sure the drop rule is at the end.
+    v4Filter.push_back(StringPrintf("-D %s -j DROP", LOCAL_FORWARD));
+    v4Filter.push_back(StringPrintf("-A %s -j DROP", LOCAL_FORWARD));
+
+    std::vector<std::string> v4 = {"*raw"};
+    v4.insert(v4.end(), v4Raw.begin(), v4Raw.end());
+    v4.push_back("COMMIT");
+    v4.push_back("*filter");
+    v4.insert(v4.end(), v4Filter.begin(), v4Filter.end());
+    v4.push_back("COMMIT");
+    v4.push_back("*nat");
+    v4.insert(v4.end(), v4Nat.begin(), v4Nat.end());
+    v4.push_back("COMMIT\n");
+
+    std::vector<std::string> v6 = {"*raw"};
+    v6.insert(v6.end(), v6Raw.begin(), v6Raw.end());
+    v6.push_back("COMMIT");
+    v6.push_back("*filter");
+    v6.insert(v6.end(), v6Filter.begin(), v6Filter.end());
+    v6.push_back("COMMIT\n");
+
+    if (iptablesRestoreFunction(V4, Join(v4, '\n'), nullptr) == -1 ||
+        iptablesRestoreFunction(V6, Join(v6, '\n'), nullptr) == -1) {
+        ALOGE("Failed to apply tether forwarding batch of %zu pairs", newPairs.size());
+        // Unwind what's been done, but don't care about success - what more could we do?
+        for (const auto& [intIface, extIface] : newPairs) {
+            setForwardRules(false, intIface.c_str(), extIface.c_str());
+        }
+        if (!isAnyForwardingPairEnabled()) {
+            setDefaults();
+        }
+        return -EREMOTEIO;
+    }
+
+    for (const auto& [intIface, extIface] : newPairs) {
+        addForwardingPair(intIface, extIface);
+    }
+
+    // The set of counter rules may have changed; don't serve stale interface pairs.
+    mCachedStatsValid = false;
+
+    return 0;
+}
+
 int TetherController::setTetherGlobalAlertRule() {
     // Only add this if we are the first enabled nat
     if (isAnyForwardingPairEnabled()) {
@@ -777,6 +925,9 @@ int TetherController::setForwardRules(bool add, const char *intIface, const char
         markForwardingPairDisabled(intIface, extIface);
     }
 
+    // The set of counter rules may have changed; don't serve stale interface pairs.
+    mCachedStatsValid = false;
+
     return 0;
 }
 
@@ -801,6 +952,41 @@ void TetherController::addStats(TetherStatsList& statsList, const TetherStats& s
     statsList.push_back(stats);
 }
 
+namespace {
+
+// Splits |line| into whitespace-delimited tokens. The returned views point into |line|; nothing
+// is copied. |tokens| is an out parameter so that its capacity is reused across the many lines
+// of an iptables dump.
+void tokenizeLine(std::string_view line, std::vector<std::string_view>* tokens) {
+    tokens->clear();
+    size_t pos = 0;
+    while (pos < line.size()) {
+        while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t')) pos++;
+        const size_t start = pos;
+        while (pos < line.size() && line[pos] != ' ' && line[pos] != '\t') pos++;
+        if (pos > start) tokens->push_back(line.substr(start, pos - start));
+    }
+}
+
+// Parses a decimal counter in place. Unlike strtoul(), rejects anything but digits outright.
+bool parseCounter(std::string_view token, int64_t* value) {
+    // 19 digits is enough for any int64_t; longer tokens can't be valid counters.
+    if (token.empty() || token.size() > 19) return false;
+    int64_t parsed = 0;
+    for (const char c : token) {
+        if (c < '0' || c > '9') return false;
+        parsed = parsed * 10 + (c - '0');
+    }
+    *value = parsed;
+    return true;
+}
+
+bool isUnspecifiedPrefix(std::string_view token) {
+    return token == "0.0.0.0/0" || token == "::/0";
+}
+
+}  // namespace
+
 /*
  * Parse the ptks and bytes out of:
  *   Chain tetherctrl_counters (4 references)
@@ -815,34 +1001,31 @@ void TetherController::addStats(TetherStatsList& statsList, const TetherStats& s
  *          0        0 RETURN     all      wlan0  rmnet_data0  ::/0                 ::/0
  *          0        0 RETURN     all      rmnet_data0 wlan0   ::/0                 ::/0
  *
+ * The tokens of a counter line are:
+ *     pkts bytes RETURN all [--] iface0 iface1 source destination
+ * where only IPv4 iptables prints the "--" fragment column. Lines are tokenized in place over
+ * the iptables output; only the interface names of correctly paired rules are ever copied out.
  */
 int TetherController::addForwardChainStats(TetherStatsList& statsList,
                                            const std::string& statsOutput,
                                            std::string &extraProcessingInfo) {
-    enum IndexOfIptChain {
-        ORIG_LINE,
-        PACKET_COUNTS,
-        BYTE_COUNTS,
-        HYPHEN,
-        IFACE0_NAME,
-        IFACE1_NAME,
-        SOURCE,
-        DESTINATION
-    };
     TetherStats stats;
     const TetherStats empty;
 
-    static const std::string NUM = "(\\d+)";
-    static const std::string IFACE = "([^\\s]+)";
-    static const std::string DST = "(0.0.0.0/0|::/0)";
-    static const std::string COUNTERS = "\\s*" + NUM + "\\s+" + NUM +
-                                        " RETURN     all(  --  |      )" + IFACE + "\\s+" + IFACE +
-                                        "\\s+" + DST + "\\s+" + DST;
-    static const std::regex IP_RE(COUNTERS);
-
-    const std::vector<std::string> lines = base::Split(statsOutput, "\n");
+    std::vector<std::string_view> tokens;
+    std::string_view remaining(statsOutput);
     int headerLine = 0;
-    for (const std::string& line : lines) {
+    for (bool lastLine = false; !lastLine;) {
+        const size_t eol = remaining.find('\n');
+        std::string_view line;
+        if (eol == std::string_view::npos) {
+            line = remaining;
+            lastLine = true;
+        } else {
+            line = remaining.substr(0, eol);
+            remaining.remove_prefix(eol + 1);
+        }
+
         // Skip headers.
         if (headerLine < 2) {
             if (line.empty()) {
@@ -855,39 +1038,40 @@ int TetherController::addForwardChainStats(TetherStatsList& statsList,
 
         if (line.empty()) continue;
 
-        extraProcessingInfo = line;
-        std::smatch matches;
-        if (!std::regex_search(line, matches, IP_RE)) return -EREMOTEIO;
-        // Here use IP_RE to distiguish IPv4 and IPv6 iptables.
-        // IPv4 has "--" indicating what to do with fragments...
-        //		 26 	2373 RETURN     all  --  wlan0	rmnet0	0.0.0.0/0			 0.0.0.0/0
-        // ... but IPv6 does not.
-        //		 26 	2373 RETURN 	all      wlan0	rmnet0	::/0				 ::/0
-        // TODO: Replace strtoXX() calls with ParseUint() /ParseInt()
-        int64_t packets = strtoul(matches[PACKET_COUNTS].str().c_str(), nullptr, 10);
-        int64_t bytes = strtoul(matches[BYTE_COUNTS].str().c_str(), nullptr, 10);
-        std::string iface0 = matches[IFACE0_NAME].str();
-        std::string iface1 = matches[IFACE1_NAME].str();
-        std::string rest = matches[SOURCE].str();
-
-        ALOGV("parse iface0=<%s> iface1=<%s> pkts=%" PRId64 " bytes=%" PRId64
-              " rest=<%s> orig line=<%s>",
-              iface0.c_str(), iface1.c_str(), packets, bytes, rest.c_str(), line.c_str());
+        extraProcessingInfo = std::string(line);
+
+        tokenizeLine(line, &tokens);
+        if (tokens.size() < 8 || tokens[2] != "RETURN" || tokens[3] != "all") return -EREMOTEIO;
+        size_t field = 4;
+        if (tokens[field] == "--") field++;
+        if (tokens.size() < field + 4) return -EREMOTEIO;
+
+        int64_t packets;
+        int64_t bytes;
+        if (!parseCounter(tokens[0], &packets) || !parseCounter(tokens[1], &bytes)) {
+            return -EREMOTEIO;
+        }
+        const std::string_view iface0 = tokens[field];
+        const std::string_view iface1 = tokens[field + 1];
+        if (!isUnspecifiedPrefix(tokens[field + 2]) || !isUnspecifiedPrefix(tokens[field + 3])) {
+            return -EREMOTEIO;
+        }
+
+        ALOGV("parse iface0=<%.*s> iface1=<%.*s> pkts=%" PRId64 " bytes=%" PRId64
+              " orig line=<%.*s>",
+              static_cast<int>(iface0.size()), iface0.data(), static_cast<int>(iface1.size()),
+              iface1.data(), packets, bytes, static_cast<int>(line.size()), line.data());
         /*
          * The following assumes that the 1st rule has in:extIface out:intIface,
          * which is what TetherController sets up.
          * The 1st matches rx, and sets up the pair for the tx side.
          */
         if (stats.intIface.empty()) {
-            ALOGV("0Filter RX iface_in=%s iface_out=%s rx_bytes=%" PRId64 " rx_packets=%" PRId64
-                  " ", iface0.c_str(), iface1.c_str(), bytes, packets);
             stats.intIface = iface0;
             stats.extIface = iface1;
             stats.txPackets = packets;
             stats.txBytes = bytes;
         } else if (stats.intIface == iface1 && stats.extIface == iface0) {
-            ALOGV("0Filter TX iface_in=%s iface_out=%s rx_bytes=%" PRId64 " rx_packets=%" PRId64
-                  " ", iface0.c_str(), iface1.c_str(), bytes, packets);
             stats.rxPackets = packets;
             stats.rxBytes = bytes;
         }
@@ -906,6 +1090,18 @@ int TetherController::addForwardChainStats(TetherStatsList& statsList,
 }
 
 StatusOr<TetherController::TetherStatsList> TetherController::getTetherStats() {
+    // Serve back-to-back polls from the cache instead of forking iptables-restore again.
+    const auto now = std::chrono::steady_clock::now();
+    if (mCachedStatsValid && mStatsCacheTimeout > std::chrono::milliseconds::zero()) {
+        if (now - mCachedStatsTime >= mStatsCacheTimeout) {
+            // Return the stale snapshot immediately and let a background refresh replace it:
+            // dashboards polling at a fixed rate then never block on the fork/exec and parse,
+            // and see counters at most one poll interval old.
+            refreshTetherStatsLocked();
+        }
+        return mCachedStats;
+    }
+
     TetherStatsList statsList;
     std::string parsedIptablesOutput;
 
@@ -923,9 +1119,47 @@ StatusOr<TetherController::TetherStatsList> TetherController::getTetherStats() {
         }
     }
 
+    mCachedStats = statsList;
+    mCachedStatsTime = now;
+    mCachedStatsValid = true;
+
     return statsList;
 }
 
+void TetherController::refreshTetherStatsLocked() {
+    if (mStatsRefreshInFlight) {
+        return;
+    }
+    mStatsRefreshInFlight = true;
+    std::thread([this] {
+        TetherStatsList statsList;
+        std::string parsedIptablesOutput;
+        int err = 0;
+        for (const IptablesTarget target : {V4, V6}) {
+            std::string statsString;
+            if ((err = iptablesRestoreFunction(target, GET_TETHER_STATS_COMMAND, &statsString))) {
+                ALOGE("failed to fetch tether stats in background (%d): %d", target, err);
+                break;
+            }
+            if ((err = addForwardChainStats(statsList, statsString, parsedIptablesOutput))) {
+                ALOGE("failed to parse %s tether stats in background:\n%s",
+                      target == V4 ? "IPv4" : "IPv6", parsedIptablesOutput.c_str());
+                break;
+            }
+        }
+
+        std::lock_guard guard(lock);
+        // Only publish if the snapshot is still wanted: a forwarding change mid-refresh
+        // invalidated the cache, and the next poll must fetch synchronously against the new
+        // rule set. On error keep serving the old snapshot; the next expired poll retries.
+        if (!err && mCachedStatsValid) {
+            mCachedStats = std::move(statsList);
+            mCachedStatsTime = std::chrono::steady_clock::now();
+        }
+        mStatsRefreshInFlight = false;
+    }).detach();
+}
+
 void TetherController::dumpIfaces(DumpWriter& dw) {
     dw.println("Interface pairs:");
 
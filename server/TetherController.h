@@ -17,9 +17,12 @@
 #ifndef _TETHER_CONTROLLER_H
 #define _TETHER_CONTROLLER_H
 
+#include <chrono>
 #include <list>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <netdutils/DumpWriter.h>
 #include <netdutils/StatusOr.h>
@@ -99,6 +102,12 @@ class TetherController {
 
     int enableNat(const char* intIface, const char* extIface);
     int disableNat(const char* intIface, const char* extIface);
+    // Enables forwarding for several (intIface, extIface) pairs at once. Unlike repeated
+    // enableNat() calls, which execute several iptables-restore transactions per pair, this
+    // builds one transaction per IP family for the whole batch, so multi-downstream hotspot
+    // bring-up (Wi-Fi + USB + BT) lands in a single commit per family. Pairs that are already
+    // forwarding are skipped. Returns 0 or negative errno; on failure no pair is enabled.
+    int addTetherForwarding(const std::vector<std::pair<std::string, std::string>>& intExtPairs);
     int setupIptablesHooks();
 
     class TetherStats {
@@ -176,6 +185,26 @@ class TetherController {
 
     static void addStats(TetherStatsList& statsList, const TetherStats& stats);
 
+    // Kicks off a background iptables fetch-and-parse that replaces the cached stats when it
+    // completes. At most one refresh runs at a time. Caller must hold |lock|.
+    void refreshTetherStatsLocked();
+
+    // How long a successful getTetherStats() result keeps being served to subsequent callers
+    // without re-running iptables. The framework polls stats frequently while tethering is
+    // active; serving back-to-back polls from this cache saves a fork/exec of iptables-restore
+    // and a full counter parse per poll. Once a valid snapshot exists, an expired poll returns
+    // it immediately and refreshes in the background, so no poll after the first ever blocks on
+    // iptables and the iptables cost is bounded by the poll rate. Forwarding rule changes
+    // invalidate the cache so new interface pairs show up immediately (at the cost of one
+    // synchronous fetch). A zero timeout disables caching entirely; the tests rely on that.
+    static constexpr std::chrono::milliseconds kTetherStatsCacheTimeout{500};
+
+    std::chrono::milliseconds mStatsCacheTimeout = kTetherStatsCacheTimeout;
+    TetherStatsList mCachedStats;
+    std::chrono::steady_clock::time_point mCachedStatsTime;
+    bool mCachedStatsValid = false;
+    bool mStatsRefreshInFlight = false;
+
     // For testing.
     friend class TetherControllerTest;
     static int (*iptablesRestoreFunction)(IptablesTarget, const std::string&, std::string *);
@@ -49,6 +49,9 @@ class TetherControllerTest : public IptablesBaseTest {
 public:
     TetherControllerTest() {
         TetherController::iptablesRestoreFunction = fakeExecIptablesRestoreWithOutput;
+        // These tests drive getTetherStats() back-to-back with different fake iptables outputs,
+        // so don't serve cached results. TestGetTetherStatsCached re-enables the cache.
+        mTetherCtrl.mStatsCacheTimeout = std::chrono::milliseconds::zero();
     }
 
 protected:
@@ -328,6 +331,68 @@ TEST_F(TetherControllerTest, TestMultipleUpstreams) {
     expectIptablesRestoreCommands(stopFirstNat);
 }
 
+TEST_F(TetherControllerTest, TestAddTetherForwarding) {
+    // Invalid pairs are rejected before anything is applied.
+    const ExpectedIptablesCommands NONE = {};
+    ASSERT_EQ(-EINVAL, mTetherCtrl.addTetherForwarding({{"wlan0", "wlan0"}}));
+    expectIptablesRestoreCommands(NONE);
+
+    // Two downstreams on one upstream produce one V4 and one V6 restore transaction containing
+    // the upstream setup, the forward rules for both pairs and the counter rules.
+    std::vector<std::string> v4Cmds = {
+            "*raw",
+            "-A tetherctrl_raw_PREROUTING -p tcp --dport 21 -i wlan0 -j CT --helper ftp",
+            "-A tetherctrl_raw_PREROUTING -p tcp --dport 1723 -i wlan0 -j CT --helper pptp",
+            "-A tetherctrl_raw_PREROUTING -p tcp --dport 21 -i usb0 -j CT --helper ftp",
+            "-A tetherctrl_raw_PREROUTING -p tcp --dport 1723 -i usb0 -j CT --helper pptp",
+            "COMMIT",
+            "*filter",
+            "-I tetherctrl_FORWARD -j bw_global_alert",
+            "-A tetherctrl_FORWARD -i rmnet0 -o wlan0 -m state --state ESTABLISHED,RELATED"
+            " -g tetherctrl_counters",
+            "-A tetherctrl_FORWARD -i wlan0 -o rmnet0 -m state --state INVALID -j DROP",
+            "-A tetherctrl_FORWARD -i wlan0 -o rmnet0 -g tetherctrl_counters",
+            "-A tetherctrl_counters -i wlan0 -o rmnet0 -j RETURN",
+            "-A tetherctrl_counters -i rmnet0 -o wlan0 -j RETURN",
+            "-A tetherctrl_FORWARD -i rmnet0 -o usb0 -m state --state ESTABLISHED,RELATED"
+            " -g tetherctrl_counters",
+            "-A tetherctrl_FORWARD -i usb0 -o rmnet0 -m state --state INVALID -j DROP",
+            "-A tetherctrl_FORWARD -i usb0 -o rmnet0 -g tetherctrl_counters",
+            "-A tetherctrl_counters -i usb0 -o rmnet0 -j RETURN",
+            "-A tetherctrl_counters -i rmnet0 -o usb0 -j RETURN",
+            "-D tetherctrl_FORWARD -j DROP",
+            "-A tetherctrl_FORWARD -j DROP",
+            "COMMIT",
+            "*nat",
+            "-A tetherctrl_nat_POSTROUTING -o rmnet0 -j MASQUERADE",
+            "COMMIT\n",
+    };
+    std::vector<std::string> v6Cmds = {
+            "*raw",
+            "-A tetherctrl_raw_PREROUTING -i wlan0 -m rpfilter --invert ! -s fe80::/64 -j DROP",
+            "-A tetherctrl_raw_PREROUTING -i usb0 -m rpfilter --invert ! -s fe80::/64 -j DROP",
+            "COMMIT",
+            "*filter",
+            "-A tetherctrl_FORWARD -g tetherctrl_counters",
+            "-I tetherctrl_FORWARD -j bw_global_alert",
+            "-A tetherctrl_counters -i wlan0 -o rmnet0 -j RETURN",
+            "-A tetherctrl_counters -i rmnet0 -o wlan0 -j RETURN",
+            "-A tetherctrl_counters -i usb0 -o rmnet0 -j RETURN",
+            "-A tetherctrl_counters -i rmnet0 -o usb0 -j RETURN",
+            "COMMIT\n",
+    };
+    ExpectedIptablesCommands expected = {
+            {V4, Join(v4Cmds, '\n')},
+            {V6, Join(v6Cmds, '\n')},
+    };
+    ASSERT_EQ(0, mTetherCtrl.addTetherForwarding({{"wlan0", "rmnet0"}, {"usb0", "rmnet0"}}));
+    expectIptablesRestoreCommands(expected);
+
+    // Re-adding already enabled pairs is a no-op.
+    ASSERT_EQ(0, mTetherCtrl.addTetherForwarding({{"wlan0", "rmnet0"}, {"usb0", "rmnet0"}}));
+    expectIptablesRestoreCommands(NONE);
+}
+
 std::string kTetherCounterHeaders = Join(std::vector<std::string> {
     "Chain tetherctrl_counters (4 references)",
     "    pkts      bytes target     prot opt in     out     source               destination",
@@ -438,5 +503,29 @@ TEST_F(TetherControllerTest, TestGetTetherStats) {
     EXPECT_TRUE(std::equal(expectedError.rbegin(), expectedError.rend(), err.rbegin()));
 }
 
+TEST_F(TetherControllerTest, TestGetTetherStatsCached) {
+    mTetherCtrl.mStatsCacheTimeout = std::chrono::hours(1);
+
+    TetherStats expected0("wlan0", "rmnet0", 20002002, 20027, 10002373, 10026);
+    TetherStats expected1("bt-pan", "rmnet0", 1708806, 1450, 107471, 1040);
+    addIptablesRestoreOutput(kIPv4TetherCounters, kIPv6TetherCounters);
+    StatusOr<TetherStatsList> result = mTetherCtrl.getTetherStats();
+    ASSERT_TRUE(isOk(result));
+    ASSERT_EQ(2U, result.value().size());
+    clearIptablesRestoreOutput();
+
+    // A second call within the cache timeout returns the same stats without running iptables
+    // again: no fake output is queued, so an actual fetch would parse an empty string and fail.
+    result = mTetherCtrl.getTetherStats();
+    ASSERT_TRUE(isOk(result));
+    ASSERT_EQ(2U, result.value().size());
+    expectTetherStatsEqual(expected0, result.value()[0]);
+    expectTetherStatsEqual(expected1, result.value()[1]);
+
+    // Changing forwarding rules invalidates the cache.
+    mTetherCtrl.enableNat("wlan0", "rmnet0");
+    ASSERT_FALSE(isOk(mTetherCtrl.getTetherStats()));
+}
+
 }  // namespace net
 }  // namespace android
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TimerWheel"
+
+#include "TimerWheel.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace android {
+namespace net {
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+TimerWheel& TimerWheel::get() {
+    static TimerWheel* instance = new TimerWheel();
+    return *instance;
+}
+
+TimerWheel::TimerWheel()
+    : mStartTime(steady_clock::now()), mThread([this] { loop(); }) {}
+
+TimerWheel::~TimerWheel() {
+    {
+        std::lock_guard guard(mLock);
+        mStopped = true;
+    }
+    mCv.notify_all();
+    mThread.join();
+}
+
+TimerWheel::TimerId TimerWheel::scheduleAfter(milliseconds delay,
+                                              std::function<void()> callback) {
+    return schedule(delay, milliseconds::zero(), std::move(callback));
+}
+
+TimerWheel::TimerId TimerWheel::schedulePeriodic(milliseconds interval,
+                                                 std::function<void()> callback) {
+    return schedule(interval, interval, std::move(callback));
+}
+
+TimerWheel::TimerId TimerWheel::schedule(milliseconds delay, milliseconds period,
+                                         std::function<void()> callback) {
+    std::lock_guard guard(mLock);
+    const TimerId id = mNextId++;
+    insertLocked(Timer{id, std::move(callback), period, 0}, delay);
+    // The timer thread may be sleeping towards a later deadline; have it recompute.
+    mCv.notify_all();
+    return id;
+}
+
+void TimerWheel::insertLocked(Timer timer, milliseconds delay) {
+    // Round the delay up to whole ticks so a timer never fires early, and always wait at least
+    // one tick so a callback arming a zero-delay timer cannot spin the timer thread.
+    const uint64_t ticks =
+            std::max<uint64_t>((delay.count() + kTick.count() - 1) / kTick.count(), 1);
+    timer.expiryTick = tickForNow() + ticks;
+    const size_t slotIndex = timer.expiryTick % kNumSlots;
+    const TimerId id = timer.id;
+    Slot& slot = mSlots[slotIndex];
+    slot.push_back(std::move(timer));
+    mTimers.emplace(id, std::make_pair(slotIndex, std::prev(slot.end())));
+}
+
+uint64_t TimerWheel::tickForNow() const {
+    return (steady_clock::now() - mStartTime) / kTick;
+}
+
+bool TimerWheel::nextExpiryLocked(uint64_t* expiryTick) const {
+    // Arming and cancelling are the hot O(1) operations; this scan runs once per sleep and netd
+    // only ever has a handful of timers armed.
+    bool found = false;
+    for (const auto& [id, where] : mTimers) {
+        const uint64_t expiry = where.second->expiryTick;
+        if (!found || expiry < *expiryTick) {
+            *expiryTick = expiry;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    std::unique_lock lock(mLock);
+    auto it = mTimers.find(id);
+    if (it != mTimers.end()) {
+        mSlots[it->second.first].erase(it->second.second);
+        mTimers.erase(it);
+        mCv.notify_all();
+        return true;
+    }
+    if (mRunningTimer == id) {
+        mRunningCancelled = true;
+        if (std::this_thread::get_id() != mThread.get_id()) {
+            // Block the caller out of the in-flight callback, so that after cancel() it can
+            // safely tear down anything the callback touches.
+            mCv.wait(lock, [&]() REQUIRES(mLock) { return mRunningTimer != id; });
+        }
+    }
+    return false;
+}
+
+void TimerWheel::runTimer(std::unique_lock<std::mutex>& lock,
+                          Timer timer) NO_THREAD_SAFETY_ANALYSIS {
+    mRunningTimer = timer.id;
+    mRunningCancelled = false;
+    lock.unlock();
+    timer.callback();
+    lock.lock();
+    if (timer.period > milliseconds::zero() && !mRunningCancelled && !mStopped) {
+        const milliseconds period = timer.period;
+        insertLocked(std::move(timer), period);
+    }
+    mRunningTimer = INVALID_TIMER;
+    // Wake both the sleep computation and any cancel() waiting the callback out.
+    mCv.notify_all();
+}
+
+void TimerWheel::loop() NO_THREAD_SAFETY_ANALYSIS {
+    std::unique_lock lock(mLock);
+    while (!mStopped) {
+        uint64_t nextExpiry;
+        if (!nextExpiryLocked(&nextExpiry)) {
+            mCv.wait(lock);
+            continue;
+        }
+        if (nextExpiry > tickForNow()) {
+            mCv.wait_until(lock, mStartTime + nextExpiry * kTick);
+            // Recompute: we may have been woken by a newly armed timer, a cancel, or stop.
+            continue;
+        }
+
+        // Advance the wheel to the present, firing every timer that has come due. The callback
+        // runs with the lock dropped and may mutate the slot, so restart the scan after each one.
+        const uint64_t nowTick = tickForNow();
+        if (nowTick > mCurrentTick + kNumSlots) {
+            // More than one revolution behind (the wheel sat idle, or the process was stalled):
+            // one pass over every slot fires everything due, then jump straight to the present
+            // instead of ticking through the gap.
+            for (Slot& slot : mSlots) {
+                auto it = slot.begin();
+                while (it != slot.end()) {
+                    if (it->expiryTick > nowTick) {
+                        ++it;
+                        continue;
+                    }
+                    Timer timer = std::move(*it);
+                    slot.erase(it);
+                    mTimers.erase(timer.id);
+                    runTimer(lock, std::move(timer));
+                    it = slot.begin();
+                }
+            }
+            mCurrentTick = nowTick;
+            continue;
+        }
+        while (mCurrentTick < nowTick && !mStopped) {
+            ++mCurrentTick;
+            Slot& slot = mSlots[mCurrentTick % kNumSlots];
+            auto it = slot.begin();
+            while (it != slot.end()) {
+                if (it->expiryTick > mCurrentTick) {
+                    // Due in a later revolution.
+                    ++it;
+                    continue;
+                }
+                Timer timer = std::move(*it);
+                slot.erase(it);
+                mTimers.erase(timer.id);
+                runTimer(lock, std::move(timer));
+                it = slot.begin();
+            }
+        }
+    }
+}
+
+}  // namespace net
+}  // namespace android
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_SERVER_TIMER_WHEEL_H
+#define NETD_SERVER_TIMER_WHEEL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/thread_annotations.h>
+
+namespace android {
+namespace net {
+
+// Shared timer service for the server's periodic and deferred work. Each controller that needs a
+// timer used to own a dedicated thread, condition variable and sleep loop; multiplexing them here
+// leaves one timer thread in the process, and that thread only wakes when a timer is actually due.
+//
+// Timers live in a timing wheel: an array of slots, each one tick wide, indexed by expiry time
+// modulo the slot count, so arming and cancelling are O(1). Timers further out than one revolution
+// stay in their slot and are skipped until their revolution comes around; with netd's handful of
+// timers this makes a second cascading level pointless, so there isn't one.
+//
+// Callbacks run on the timer thread, one at a time, without any TimerWheel lock held; they may
+// freely arm or cancel timers. Long-running work should not be done in a callback directly since
+// it delays every other timer.
+class TimerWheel {
+  public:
+    using TimerId = uint64_t;
+
+    // Never returned by scheduleAfter()/schedulePeriodic(); handy as a "no timer armed" sentinel.
+    static constexpr TimerId INVALID_TIMER = 0;
+
+    // Timer resolution. Timers never fire early; they fire at the first tick at or after their
+    // requested expiry, so they can be late by up to one tick (plus callback execution time).
+    static constexpr std::chrono::milliseconds kTick{100};
+    // One revolution covers kNumSlots ticks (51.2 seconds); longer delays simply wait out extra
+    // revolutions in their slot.
+    static constexpr size_t kNumSlots = 512;
+
+    // The process-wide instance. Deliberately leaked so timers never outlive their service during
+    // static destruction.
+    static TimerWheel& get();
+
+    // Instances can also be created directly (e.g. in tests); the destructor cancels all pending
+    // timers and joins the timer thread.
+    TimerWheel();
+    ~TimerWheel();
+
+    // Runs |callback| once, no earlier than |delay| from now. Returns an id for cancel().
+    TimerId scheduleAfter(std::chrono::milliseconds delay, std::function<void()> callback)
+            EXCLUDES(mLock);
+
+    // Runs |callback| every |interval| until cancelled. The next run is scheduled when the
+    // previous one returns, so runs never overlap and a slow callback stretches the period.
+    TimerId schedulePeriodic(std::chrono::milliseconds interval, std::function<void()> callback)
+            EXCLUDES(mLock);
+
+    // Cancels a timer. Returns true if the timer was still pending and will not fire. Returns
+    // false if it already fired (or never existed); for a periodic timer this also stops any
+    // further runs. If the timer's callback is executing on the timer thread, cancel() blocks
+    // until it returns — except when called from the callback itself — so when cancel() returns,
+    // no callback for |id| is running and none will run. Do not call it while holding a lock the
+    // callback takes.
+    bool cancel(TimerId id) EXCLUDES(mLock);
+
+  private:
+    struct Timer {
+        TimerId id;
+        std::function<void()> callback;
+        // Zero for one-shot timers.
+        std::chrono::milliseconds period;
+        // The tick at which the timer fires. The slot index is expiryTick % kNumSlots; an entry
+        // whose expiryTick lies beyond the wheel's current revolution just stays put.
+        uint64_t expiryTick;
+    };
+    using Slot = std::list<Timer>;
+
+    TimerId schedule(std::chrono::milliseconds delay, std::chrono::milliseconds period,
+                     std::function<void()> callback) EXCLUDES(mLock);
+    void insertLocked(Timer timer, std::chrono::milliseconds delay) REQUIRES(mLock);
+    // Number of ticks elapsed since mStartTime.
+    uint64_t tickForNow() const;
+    // The earliest expiry tick among all pending timers, or false if none are pending.
+    bool nextExpiryLocked(uint64_t* expiryTick) const REQUIRES(mLock);
+    // Runs one due timer's callback with mLock dropped, then re-arms it if periodic.
+    void runTimer(std::unique_lock<std::mutex>& lock, Timer timer);
+    void loop();
+
+    std::mutex mLock;
+    // Signalled when a timer is armed or cancelled, when the service stops, and when a running
+    // callback finishes (for cancel() waiters).
+    std::condition_variable mCv;
+    std::vector<Slot> mSlots GUARDED_BY(mLock){kNumSlots};
+    // Pending timers by id, for O(1) cancel. List iterators stay valid across splices and other
+    // erasures.
+    std::unordered_map<TimerId, std::pair<size_t, Slot::iterator>> mTimers GUARDED_BY(mLock);
+    // The last tick whose slot has been processed.
+    uint64_t mCurrentTick GUARDED_BY(mLock) = 0;
+    TimerId mNextId GUARDED_BY(mLock) = 1;
+    // The timer whose callback is currently executing, if any.
+    TimerId mRunningTimer GUARDED_BY(mLock) = INVALID_TIMER;
+    // Set by cancel() racing with the running callback; suppresses a periodic re-arm.
+    bool mRunningCancelled GUARDED_BY(mLock) = false;
+    bool mStopped GUARDED_BY(mLock) = false;
+    const std::chrono::steady_clock::time_point mStartTime;
+    // Initialized last so the thread never sees partially constructed members.
+    std::thread mThread;
+};
+
+}  // namespace net
+}  // namespace android
+
+#endif  // NETD_SERVER_TIMER_WHEEL_H
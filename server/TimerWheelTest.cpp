@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TimerWheel.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace net {
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Helper for waiting on a counter to reach a value, with a deadline generous enough for a loaded
+// test host.
+class Counter {
+  public:
+    void increment() {
+        {
+            std::lock_guard guard(mLock);
+            mCount++;
+        }
+        mCv.notify_all();
+    }
+
+    bool waitFor(int count, std::chrono::milliseconds timeout = 10s) {
+        std::unique_lock lock(mLock);
+        return mCv.wait_for(lock, timeout, [&] { return mCount >= count; });
+    }
+
+    int count() {
+        std::lock_guard guard(mLock);
+        return mCount;
+    }
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mCv;
+    int mCount = 0;
+};
+
+}  // namespace
+
+TEST(TimerWheelTest, OneShotFiresOnceNotEarly) {
+    // Declared before the wheel so the wheel's destructor joins the timer thread while the
+    // callback's captures are still alive. Same in every test below.
+    Counter fired;
+    TimerWheel wheel;
+    const auto armed = std::chrono::steady_clock::now();
+    const auto delay = 3 * TimerWheel::kTick;
+
+    wheel.scheduleAfter(delay, [&] { fired.increment(); });
+
+    ASSERT_TRUE(fired.waitFor(1));
+    EXPECT_GE(std::chrono::steady_clock::now() - armed, delay);
+
+    // A one-shot timer must not fire again.
+    EXPECT_FALSE(fired.waitFor(2, 5 * TimerWheel::kTick));
+}
+
+TEST(TimerWheelTest, PeriodicRepeatsUntilCancelled) {
+    Counter fired;
+    TimerWheel wheel;
+
+    TimerWheel::TimerId id = wheel.schedulePeriodic(TimerWheel::kTick, [&] { fired.increment(); });
+    ASSERT_TRUE(fired.waitFor(3));
+
+    // After cancel() returns, no further run may happen.
+    wheel.cancel(id);
+    const int countAtCancel = fired.count();
+    EXPECT_FALSE(fired.waitFor(countAtCancel + 1, 5 * TimerWheel::kTick));
+}
+
+TEST(TimerWheelTest, CancelPendingTimerNeverFires) {
+    std::atomic<bool> fired{false};
+    Counter sentinel;
+    TimerWheel wheel;
+
+    TimerWheel::TimerId id = wheel.scheduleAfter(1h, [&] { fired = true; });
+    EXPECT_TRUE(wheel.cancel(id));
+    // Cancelling again reports the timer as gone.
+    EXPECT_FALSE(wheel.cancel(id));
+
+    wheel.scheduleAfter(std::chrono::milliseconds::zero(), [&] { sentinel.increment(); });
+    ASSERT_TRUE(sentinel.waitFor(1));
+    EXPECT_FALSE(fired);
+}
+
+TEST(TimerWheelTest, CallbackMayRearmItself) {
+    Counter fired;
+    std::function<void()> cycle;
+    TimerWheel wheel;
+
+    // The pattern TcpSocketMonitor uses: a one-shot callback scheduling the next run itself,
+    // because its interval adapts between runs.
+    cycle = [&] {
+        fired.increment();
+        if (fired.count() < 3) {
+            wheel.scheduleAfter(TimerWheel::kTick, cycle);
+        }
+    };
+    wheel.scheduleAfter(TimerWheel::kTick, cycle);
+
+    ASSERT_TRUE(fired.waitFor(3));
+}
+
+TEST(TimerWheelTest, TimersBeyondOneRevolutionWait) {
+    Counter slowFired;
+    Counter fastFired;
+    TimerWheel wheel;
+
+    // Lives several revolutions out; must not fire when its slot is first visited.
+    wheel.scheduleAfter(1h, [&] { slowFired.increment(); });
+    wheel.scheduleAfter(TimerWheel::kTick, [&] { fastFired.increment(); });
+
+    ASSERT_TRUE(fastFired.waitFor(1));
+    EXPECT_EQ(0, slowFired.count());
+}
+
+}  // namespace net
+}  // namespace android
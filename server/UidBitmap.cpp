@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "UidBitmap.h"
+
+namespace android {
+namespace net {
+
+namespace {
+
+// Invokes |callback| for each set bit in |word|, offset from |base|.
+void forEachBit(uint64_t word, uid_t base, const std::function<void(uid_t)>& callback) {
+    while (word != 0) {
+        callback(base + __builtin_ctzll(word));
+        word &= word - 1;  // Clear the lowest set bit.
+    }
+}
+
+}  // namespace
+
+bool UidBitmap::test(uid_t uid) const {
+    const auto it = mPages.find(uid / kPageSize);
+    if (it == mPages.end()) return false;
+    const uint32_t bit = uid % kPageSize;
+    return (it->second.words[bit / 64] >> (bit % 64)) & 1;
+}
+
+bool UidBitmap::set(uid_t uid) {
+    Page& page = mPages[uid / kPageSize];
+    uint64_t& word = page.words[(uid % kPageSize) / 64];
+    const uint64_t mask = 1ULL << (uid % 64);
+    if (word & mask) return false;
+    word |= mask;
+    ++mCount;
+    return true;
+}
+
+bool UidBitmap::clear(uid_t uid) {
+    const auto it = mPages.find(uid / kPageSize);
+    if (it == mPages.end()) return false;
+    uint64_t& word = it->second.words[(uid % kPageSize) / 64];
+    const uint64_t mask = 1ULL << (uid % 64);
+    if (!(word & mask)) return false;
+    word &= ~mask;
+    --mCount;
+    return true;
+}
+
+void UidBitmap::clearAll() {
+    mPages.clear();
+    mCount = 0;
+}
+
+void UidBitmap::forEachUid(const std::function<void(uid_t)>& callback) const {
+    for (const auto& [index, page] : mPages) {
+        const uid_t base = static_cast<uid_t>(index) * kPageSize;
+        for (uint32_t w = 0; w < kWordsPerPage; ++w) {
+            forEachBit(page.words[w], base + w * 64, callback);
+        }
+    }
+}
+
+void UidBitmap::diff(const UidBitmap& target, std::vector<uid_t>* added,
+                     std::vector<uid_t>* removed) const {
+    static const Page kEmptyPage = {};
+
+    // Merge-join the two page maps; a page present on only one side diffs against zeros. The
+    // per-word masks below are straight-line loops over whole pages that the compiler
+    // vectorizes; bit extraction only runs for words that actually differ.
+    auto itA = mPages.begin();
+    auto itB = target.mPages.begin();
+    while (itA != mPages.end() || itB != target.mPages.end()) {
+        uint32_t index;
+        const Page* pageA = &kEmptyPage;
+        const Page* pageB = &kEmptyPage;
+        if (itB == target.mPages.end() ||
+            (itA != mPages.end() && itA->first < itB->first)) {
+            index = itA->first;
+            pageA = &(itA++)->second;
+        } else if (itA == mPages.end() || itB->first < itA->first) {
+            index = itB->first;
+            pageB = &(itB++)->second;
+        } else {
+            index = itA->first;
+            pageA = &(itA++)->second;
+            pageB = &(itB++)->second;
+        }
+
+        const uid_t base = static_cast<uid_t>(index) * kPageSize;
+        for (uint32_t w = 0; w < kWordsPerPage; ++w) {
+            forEachBit(pageB->words[w] & ~pageA->words[w], base + w * 64,
+                       [added](uid_t uid) { added->push_back(uid); });
+            forEachBit(pageA->words[w] & ~pageB->words[w], base + w * 64,
+                       [removed](uid_t uid) { removed->push_back(uid); });
+        }
+    }
+}
+
+}  // namespace net
+}  // namespace android
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_SERVER_UID_BITMAP_H
+#define NETD_SERVER_UID_BITMAP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace android {
+namespace net {
+
+// Sparse bitmap over the UID space, one bit per UID, used to mirror per-UID chain membership in
+// memory. Storage is paged: a page covers kPageSize consecutive UIDs and is allocated the first
+// time a UID in its range is set, so the multi-user UID layout (app UIDs repeat every 100000)
+// costs a few hundred bytes per user instead of a flat array over all 2^32 UIDs. Membership
+// tests are O(1); bulk operations (diff, enumeration) run word-at-a-time over cache-aligned
+// pages - a shape the compiler vectorizes with NEON/SSE on its own, without intrinsics that
+// would tie the code to one of the ABIs netd builds for.
+//
+// Not internally synchronized; owners guard instances with whatever lock guards the state the
+// bitmap mirrors.
+class UidBitmap {
+  public:
+    // UIDs covered per page: 4096 bits = 512 bytes. All app UIDs of one Android user fit in
+    // three pages.
+    static constexpr uint32_t kPageSize = 4096;
+
+    bool test(uid_t uid) const;
+
+    // Set/clear |uid|'s bit. Returns true if the bit changed.
+    bool set(uid_t uid);
+    bool clear(uid_t uid);
+
+    uint32_t count() const { return mCount; }
+    void clearAll();
+
+    // Invokes |callback| for every set UID, in ascending order.
+    void forEachUid(const std::function<void(uid_t)>& callback) const;
+
+    // Appends the UIDs set in |target| but not here to |added|, and those set here but not in
+    // |target| to |removed|: the operations that turn this membership into |target|'s.
+    void diff(const UidBitmap& target, std::vector<uid_t>* added,
+              std::vector<uid_t>* removed) const;
+
+  private:
+    static constexpr uint32_t kWordsPerPage = kPageSize / 64;
+    struct alignas(64) Page {
+        uint64_t words[kWordsPerPage] = {};
+    };
+
+    // Ordered by page index so enumeration and diff visit UIDs in ascending order. Pages that
+    // become empty are kept: churn on the same UIDs should not reallocate.
+    std::map<uint32_t, Page> mPages;
+    uint32_t mCount = 0;
+};
+
+}  // namespace net
+}  // namespace android
+
+#endif  // NETD_SERVER_UID_BITMAP_H
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "UidBitmap.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+namespace android {
+namespace net {
+
+namespace {
+
+std::vector<uid_t> collect(const UidBitmap& bitmap) {
+    std::vector<uid_t> uids;
+    bitmap.forEachUid([&](uid_t uid) { uids.push_back(uid); });
+    return uids;
+}
+
+}  // namespace
+
+TEST(UidBitmapTest, SetTestClear) {
+    UidBitmap bitmap;
+    EXPECT_FALSE(bitmap.test(10001));
+    EXPECT_EQ(0U, bitmap.count());
+
+    EXPECT_TRUE(bitmap.set(10001));
+    EXPECT_FALSE(bitmap.set(10001));  // Already set.
+    EXPECT_TRUE(bitmap.test(10001));
+    EXPECT_FALSE(bitmap.test(10000));
+    EXPECT_FALSE(bitmap.test(10002));
+    EXPECT_EQ(1U, bitmap.count());
+
+    EXPECT_TRUE(bitmap.clear(10001));
+    EXPECT_FALSE(bitmap.clear(10001));  // Already clear.
+    EXPECT_FALSE(bitmap.test(10001));
+    EXPECT_EQ(0U, bitmap.count());
+}
+
+TEST(UidBitmapTest, SparseAcrossUidSpace) {
+    // UIDs from several users (and one near the top of the UID space) live on distinct pages.
+    UidBitmap bitmap;
+    const std::vector<uid_t> uids = {0, 1000, 10123, 1010123, 2010123, 4294967290U};
+    for (const uid_t uid : uids) {
+        EXPECT_TRUE(bitmap.set(uid));
+    }
+    EXPECT_EQ(uids.size(), bitmap.count());
+    for (const uid_t uid : uids) {
+        EXPECT_TRUE(bitmap.test(uid));
+        EXPECT_FALSE(bitmap.test(uid + 1));
+    }
+    // Enumeration is in ascending UID order regardless of insertion order.
+    EXPECT_THAT(collect(bitmap), ElementsAre(0U, 1000U, 10123U, 1010123U, 2010123U, 4294967290U));
+
+    bitmap.clearAll();
+    EXPECT_EQ(0U, bitmap.count());
+    EXPECT_THAT(collect(bitmap), IsEmpty());
+}
+
+TEST(UidBitmapTest, WordBoundaries) {
+    UidBitmap bitmap;
+    // Adjacent bits around word and page boundaries must not alias.
+    for (const uid_t uid : {63U, 64U, UidBitmap::kPageSize - 1, UidBitmap::kPageSize}) {
+        EXPECT_TRUE(bitmap.set(uid));
+    }
+    EXPECT_THAT(collect(bitmap),
+                ElementsAre(63U, 64U, UidBitmap::kPageSize - 1, UidBitmap::kPageSize));
+}
+
+TEST(UidBitmapTest, Diff) {
+    UidBitmap current;
+    UidBitmap target;
+    // Overlap on 10001; 10000 must be removed; 10002 and a UID on another page must be added.
+    current.set(10000);
+    current.set(10001);
+    target.set(10001);
+    target.set(10002);
+    target.set(1010123);
+
+    std::vector<uid_t> added;
+    std::vector<uid_t> removed;
+    current.diff(target, &added, &removed);
+    EXPECT_THAT(added, ElementsAre(10002U, 1010123U));
+    EXPECT_THAT(removed, ElementsAre(10000U));
+
+    // Diffing a bitmap against itself yields no operations.
+    added.clear();
+    removed.clear();
+    current.diff(current, &added, &removed);
+    EXPECT_THAT(added, IsEmpty());
+    EXPECT_THAT(removed, IsEmpty());
+}
+
+}  // namespace net
+}  // namespace android
@@ -22,6 +22,9 @@
 #include <limits.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <iterator>
+
 #include <android-base/stringprintf.h>
 #include <log/log.h>
 
@@ -59,17 +62,48 @@ uint32_t length(const UidRangeParcel& t) {
 
 }  // namespace
 
+void UidRanges::rebuildIndex() {
+    mStarts.resize(mRanges.size());
+    mStops.resize(mRanges.size());
+    for (size_t i = 0; i < mRanges.size(); i++) {
+        mStarts[i] = mRanges[i].start;
+        mStops[i] = mRanges[i].stop;
+    }
+}
+
+size_t UidRanges::lowerBound(int32_t uid) const {
+    // Branchless binary search: the conditional advance compiles to a conditional move, so the
+    // loop has no unpredictable branches and the hot path stays within the flat arrays.
+    const int32_t* base = mStarts.data();
+    size_t len = mStarts.size();
+    if (len == 0) return 0;
+    while (len > 1) {
+        const size_t half = len / 2;
+        base += (base[half - 1] < uid) ? half : 0;
+        len -= half;
+    }
+    return (base - mStarts.data()) + (*base < uid);
+}
+
+bool UidRanges::containsUid(int32_t uid) const {
+    const size_t i = lowerBound(uid);
+    return (i < mStarts.size() && mStarts[i] == uid) || (i > 0 && mStops[i - 1] >= uid);
+}
+
 bool UidRanges::hasUid(uid_t uid) const {
     if (uid > (unsigned) INT32_MAX) {
         ALOGW("UID larger than 32 bits: %" PRIu64, static_cast<uint64_t>(uid));
         return false;
     }
-    const int32_t intUid = static_cast<int32_t>(uid);
+    return containsUid(static_cast<int32_t>(uid));
+}
 
-    auto iter = std::lower_bound(mRanges.begin(), mRanges.end(), makeUidRangeParcel(intUid, intUid),
-                                 compUidRangeParcel);
-    return (iter != mRanges.end() && iter->start == intUid) ||
-           (iter != mRanges.begin() && (--iter)->stop >= intUid);
+void UidRanges::hasUids(std::span<const uid_t> uids, std::vector<bool>* results) const {
+    results->clear();
+    results->reserve(uids.size());
+    for (const uid_t uid : uids) {
+        results->push_back(uid <= (unsigned) INT32_MAX && containsUid(static_cast<int32_t>(uid)));
+    }
 }
 
 const std::vector<UidRangeParcel>& UidRanges::getRanges() const {
@@ -78,6 +112,7 @@ const std::vector<UidRangeParcel>& UidRanges::getRanges() const {
 
 bool UidRanges::parseFrom(int argc, char* argv[]) {
     mRanges.clear();
+    rebuildIndex();
     for (int i = 0; i < argc; ++i) {
         if (!*argv[i]) {
             // The UID string is empty.
@@ -114,23 +149,49 @@ bool UidRanges::parseFrom(int argc, char* argv[]) {
         mRanges.push_back(makeUidRangeParcel(uidStart, uidEnd));
     }
     std::sort(mRanges.begin(), mRanges.end(), compUidRangeParcel);
+    rebuildIndex();
     return true;
 }
 
 UidRanges::UidRanges(const std::vector<UidRangeParcel>& ranges) {
     mRanges = ranges;
     std::sort(mRanges.begin(), mRanges.end(), compUidRangeParcel);
+    rebuildIndex();
+}
+
+UidRanges::UidRanges(std::vector<UidRangeParcel>&& ranges) {
+    mRanges = std::move(ranges);
+    std::sort(mRanges.begin(), mRanges.end(), compUidRangeParcel);
+    rebuildIndex();
 }
 
 void UidRanges::add(const UidRanges& other) {
     auto middle = mRanges.insert(mRanges.end(), other.mRanges.begin(), other.mRanges.end());
     std::inplace_merge(mRanges.begin(), middle, mRanges.end(), compUidRangeParcel);
+    rebuildIndex();
 }
 
 void UidRanges::remove(const UidRanges& other) {
     auto end = std::set_difference(mRanges.begin(), mRanges.end(), other.mRanges.begin(),
                                    other.mRanges.end(), mRanges.begin(), compUidRangeParcel);
     mRanges.erase(end, mRanges.end());
+    rebuildIndex();
+}
+
+void UidRanges::diff(const UidRanges& oldRanges, const UidRanges& newRanges, UidRanges* toRemove,
+                     UidRanges* toAdd) {
+    toRemove->mRanges.clear();
+    toAdd->mRanges.clear();
+    // Both inputs are kept sorted by compUidRangeParcel, so the deltas are just the two set
+    // differences.
+    std::set_difference(oldRanges.mRanges.begin(), oldRanges.mRanges.end(),
+                        newRanges.mRanges.begin(), newRanges.mRanges.end(),
+                        std::back_inserter(toRemove->mRanges), compUidRangeParcel);
+    std::set_difference(newRanges.mRanges.begin(), newRanges.mRanges.end(),
+                        oldRanges.mRanges.begin(), oldRanges.mRanges.end(),
+                        std::back_inserter(toAdd->mRanges), compUidRangeParcel);
+    toRemove->rebuildIndex();
+    toAdd->rebuildIndex();
 }
 
 bool UidRanges::overlapsSelf() const {
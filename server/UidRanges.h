@@ -20,6 +20,7 @@
 #include "android/net/INetd.h"
 
 #include <sys/types.h>
+#include <span>
 #include <utility>
 #include <vector>
 
@@ -39,8 +40,14 @@ public:
 
     UidRanges() {}
     UidRanges(const std::vector<android::net::UidRangeParcel>& ranges);
+    // Adopts |ranges| without copying, for callers that own their parcel vector.
+    UidRanges(std::vector<android::net::UidRangeParcel>&& ranges);
 
     bool hasUid(uid_t uid) const;
+    // Bulk variant of hasUid() for callers that classify many UIDs at once (e.g. socket destroy
+    // filters). Fills |results| with one entry per input UID, in order. Taking the output vector
+    // by pointer lets callers reuse its allocation across calls.
+    void hasUids(std::span<const uid_t> uids, std::vector<bool>* results) const;
     const std::vector<UidRangeParcel>& getRanges() const;
 
     bool parseFrom(int argc, char* argv[]);
@@ -49,13 +56,31 @@ public:
     void add(const UidRanges& other);
     void remove(const UidRanges& other);
 
+    // Computes the minimal sets of ranges to tear down and to program in order to transition from
+    // |oldRanges| to |newRanges|. Ranges common to both sets appear in neither output. Ranges are
+    // compared at parcel granularity, which is the granularity at which rules are programmed into
+    // (and must be deleted from) the kernel.
+    static void diff(const UidRanges& oldRanges, const UidRanges& newRanges, UidRanges* toRemove,
+                     UidRanges* toAdd);
+
     // check if 'mRanges' has uid overlap between elements.
     bool overlapsSelf() const;
 
     bool empty() const { return mRanges.empty(); }
 
   private:
+    // Rebuilds mStarts/mStops from mRanges. Must be called after every mutation of mRanges.
+    void rebuildIndex();
+    // Returns the index of the first entry of mStarts that is >= |uid|, or mStarts.size().
+    size_t lowerBound(int32_t uid) const;
+    bool containsUid(int32_t uid) const;
+
     std::vector<UidRangeParcel> mRanges;
+    // The bounds of mRanges duplicated into parallel flat arrays, in the same (sorted) order.
+    // Parcels are 64 bits of bounds in a 3-word object, so scanning mRanges directly wastes most
+    // of each cache line; containment checks only ever look at the bounds.
+    std::vector<int32_t> mStarts;
+    std::vector<int32_t> mStops;
 };
 
 }  // namespace net
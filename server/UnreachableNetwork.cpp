@@ -26,7 +26,7 @@ namespace net {
 // The unreachable network is used to reject traffic. It is used for system purposes only.
 UnreachableNetwork::UnreachableNetwork(unsigned netId) : Network(netId) {}
 
-int UnreachableNetwork::addUsers(const UidRanges& uidRanges, int32_t subPriority) {
+int UnreachableNetwork::addUsers(UidRanges uidRanges, int32_t subPriority) {
     if (!isValidSubPriority(subPriority) || !canAddUidRanges(uidRanges)) {
         return -EINVAL;
     }
@@ -36,7 +36,7 @@ int UnreachableNetwork::addUsers(const UidRanges& uidRanges, int32_t subPriority
         ALOGE("failed to add users to unreachable network");
         return ret;
     }
-    addToUidRangeMap(uidRanges, subPriority);
+    addToUidRangeMap(std::move(uidRanges), subPriority);
     return 0;
 }
 
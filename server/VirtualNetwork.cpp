@@ -32,36 +32,49 @@ VirtualNetwork::VirtualNetwork(unsigned netId, bool secure, bool excludeLocalRou
 
 VirtualNetwork::~VirtualNetwork() {}
 
-int VirtualNetwork::addUsers(const UidRanges& uidRanges, int32_t subPriority) {
+int VirtualNetwork::addUsers(UidRanges uidRanges, int32_t subPriority) {
     if (!isValidSubPriority(subPriority) || !canAddUidRanges(uidRanges)) {
         return -EINVAL;
     }
 
+    const UidRangeMap uidRangeMap = {{subPriority, uidRanges}};
+    // UID-range updates run on the critical path of a user switch, so the rules for every
+    // interface are built up front and pushed to the kernel as one batched send.
+    RouteController::RuleBatch batch;
     for (const std::string& interface : mInterfaces) {
         int ret = RouteController::addUsersToVirtualNetwork(mNetId, interface.c_str(), mSecure,
-                                                            {{subPriority, uidRanges}},
-                                                            mExcludeLocalRoutes);
+                                                            uidRangeMap, mExcludeLocalRoutes);
         if (ret) {
             ALOGE("failed to add users on interface %s of netId %u", interface.c_str(), mNetId);
             return ret;
         }
     }
-    addToUidRangeMap(uidRanges, subPriority);
+    if (int ret = batch.flush()) {
+        ALOGE("failed to add users to netId %u", mNetId);
+        return ret;
+    }
+    addToUidRangeMap(std::move(uidRanges), subPriority);
     return 0;
 }
 
 int VirtualNetwork::removeUsers(const UidRanges& uidRanges, int32_t subPriority) {
     if (!isValidSubPriority(subPriority)) return -EINVAL;
 
+    const UidRangeMap uidRangeMap = {{subPriority, uidRanges}};
+    // As in addUsers(), one batched send covers every interface.
+    RouteController::RuleBatch batch;
     for (const std::string& interface : mInterfaces) {
         int ret = RouteController::removeUsersFromVirtualNetwork(mNetId, interface.c_str(), mSecure,
-                                                                 {{subPriority, uidRanges}},
-                                                                 mExcludeLocalRoutes);
+                                                                 uidRangeMap, mExcludeLocalRoutes);
         if (ret) {
             ALOGE("failed to remove users on interface %s of netId %u", interface.c_str(), mNetId);
             return ret;
         }
     }
+    if (int ret = batch.flush()) {
+        ALOGE("failed to remove users from netId %u", mNetId);
+        return ret;
+    }
     removeFromUidRangeMap(uidRanges, subPriority);
     return 0;
 }
@@ -75,7 +88,7 @@ int VirtualNetwork::addInterface(const std::string& interface) {
         ALOGE("failed to add interface %s to VPN netId %u", interface.c_str(), mNetId);
         return ret;
     }
-    mInterfaces.insert(interface);
+    insertInterface(interface);
     return 0;
 }
 
@@ -88,7 +101,7 @@ int VirtualNetwork::removeInterface(const std::string& interface) {
         ALOGE("failed to remove interface %s from VPN netId %u", interface.c_str(), mNetId);
         return ret;
     }
-    mInterfaces.erase(interface);
+    eraseInterface(interface);
     return 0;
 }
 
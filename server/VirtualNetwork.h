@@ -35,10 +35,11 @@ class VirtualNetwork : public Network {
 public:
   explicit VirtualNetwork(unsigned netId, bool secure, bool excludeLocalRoutes = false);
   virtual ~VirtualNetwork();
-  [[nodiscard]] int addUsers(const UidRanges& uidRanges, int32_t subPriority) override;
+  [[nodiscard]] int addUsers(UidRanges uidRanges, int32_t subPriority) override;
   [[nodiscard]] int removeUsers(const UidRanges& uidRanges, int32_t subPriority) override;
   bool isVirtual() override { return true; }
   bool canAddUsers() override { return true; }
+  bool excludeLocalRoutes() const { return mExcludeLocalRoutes; }
 
 private:
   std::string getTypeString() const override { return "VIRTUAL"; };
@@ -46,7 +47,7 @@ private:
   [[nodiscard]] int removeInterface(const std::string& interface) override;
   bool isValidSubPriority(int32_t priority) override;
   // Whether the local traffic will be excluded from the VPN network.
-  [[maybe_unused]] const bool mExcludeLocalRoutes;
+  const bool mExcludeLocalRoutes;
 };
 
 }  // namespace android::net
@@ -18,6 +18,7 @@
 
 #include <arpa/inet.h>
 #include <iostream>
+#include <time.h>
 #include <linux/netfilter/nfnetlink.h>
 #include <linux/netfilter/nfnetlink_log.h>
 #include <sys/socket.h>
@@ -45,8 +46,6 @@ using base::StringPrintf;
 using netdutils::Slice;
 using netdutils::Status;
 
-const char WakeupController::LOCAL_MANGLE_INPUT[] = "wakeupctrl_mangle_INPUT";
-
 const uint32_t WakeupController::kDefaultPacketCopyRange =
         sizeof(struct tcphdr) + sizeof(struct ip6_hdr);
 
@@ -83,11 +82,9 @@ static void extractIpHeader(WakeupController::ReportArgs& args, Slice payload) {
                 return;
             }
             args.ipNextHeader = header.protocol;
-            char addr[INET_ADDRSTRLEN] = {};
-            inet_ntop(AF_INET, &header.saddr, addr, sizeof(addr));
-            args.srcIp = addr;
-            inet_ntop(AF_INET, &header.daddr, addr, sizeof(addr));
-            args.dstIp = addr;
+            char addr[INET_ADDRSTRLEN];
+            args.srcIp.assign(addr, formatIpv4(&header.saddr, addr));
+            args.dstIp.assign(addr, formatIpv4(&header.daddr, addr));
             extractIpPorts(args, drop(payload, header.ihl * 4)); // ipv4 IHL counts 32 bit words.
             break;
         }
@@ -97,11 +94,9 @@ static void extractIpHeader(WakeupController::ReportArgs& args, Slice payload) {
                 return;
             }
             args.ipNextHeader = header.ip6_nxt;
-            char addr[INET6_ADDRSTRLEN] = {};
-            inet_ntop(AF_INET6, &header.ip6_src, addr, sizeof(addr));
-            args.srcIp = addr;
-            inet_ntop(AF_INET6, &header.ip6_dst, addr, sizeof(addr));
-            args.dstIp = addr;
+            char addr[INET6_ADDRSTRLEN];
+            args.srcIp.assign(addr, formatIpv6(&header.ip6_src, addr));
+            args.dstIp.assign(addr, formatIpv6(&header.ip6_dst, addr));
             // TODO: also deal with extension headers
             if (args.ipNextHeader == IPPROTO_TCP || args.ipNextHeader == IPPROTO_UDP) {
                 extractIpPorts(args, drop(payload, sizeof(header)));
@@ -115,6 +110,13 @@ static void extractIpHeader(WakeupController::ReportArgs& args, Slice payload) {
 
 WakeupController::~WakeupController() {
     expectOk(mListener->unsubscribe(NetlinkManager::NFLOG_WAKEUP_GROUP));
+    // Flush any aggregation summaries that have not hit a window rollover yet.
+    for (const auto& slot : mSlots) {
+        if (slot.suppressed > 0) {
+            ALOGI("aggregated %u wakeup events for uid %d protocol %d prefix %s", slot.suppressed,
+                  slot.uid, slot.ipNextHeader, slot.prefix.c_str());
+        }
+    }
 }
 
 netdutils::Status WakeupController::init(NFLogListenerInterface* listener) {
@@ -185,12 +187,49 @@ netdutils::Status WakeupController::init(NFLogListenerInterface* listener) {
             // Now that the ethertype is known, reparse msg for correctly extracting the payload.
             forEachNetlinkAttribute(msg, attrHandler);
         }
-        mReport(args);
+        if (shouldReport(args)) {
+            mReport(args);
+        }
     };
     return mListener->subscribe(NetlinkManager::NFLOG_WAKEUP_GROUP,
             WakeupController::kDefaultPacketCopyRange, msgHandler);
 }
 
+bool WakeupController::shouldReport(const ReportArgs& args) {
+    // NFULA_TIMESTAMP is optional, so window against the local monotonic clock instead of
+    // args.timestampNs.
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    constexpr uint64_t kNsPerS = 1000000000ULL;
+    const uint64_t nowNs = now.tv_sec * kNsPerS + now.tv_nsec;
+
+    const size_t hash = std::hash<std::string>()(args.prefix) ^ (args.uid * 2654435761UL) ^
+                        args.ipNextHeader;
+    AggregationSlot& slot = mSlots[hash & (kNumAggregationSlots - 1)];
+
+    const bool sameTuple = slot.uid == args.uid && slot.ipNextHeader == args.ipNextHeader &&
+                           slot.prefix == args.prefix;
+    if (sameTuple && nowNs < slot.windowEndNs) {
+        slot.suppressed++;
+        return false;
+    }
+
+    // Window rollover, or this slot now tracks a different tuple: flush the summary of whatever
+    // the slot absorbed and report the new event immediately.
+    if (slot.suppressed > 0) {
+        ALOGI("aggregated %u wakeup events for uid %d protocol %d prefix %s", slot.suppressed,
+              slot.uid, slot.ipNextHeader, slot.prefix.c_str());
+    }
+    if (!sameTuple) {
+        slot.uid = args.uid;
+        slot.ipNextHeader = args.ipNextHeader;
+        slot.prefix = args.prefix;
+    }
+    slot.windowEndNs = nowNs + kAggregationWindowNs;
+    slot.suppressed = 0;
+    return true;
+}
+
 Status WakeupController::addInterface(const std::string& ifName, const std::string& prefix,
                                     uint32_t mark, uint32_t mask) {
     return execIptables("-A", ifName, prefix, mark, mask);
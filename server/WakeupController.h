@@ -48,8 +48,9 @@ class WakeupController {
     // Callback that is triggered for every wakeup event.
     using ReportFn = std::function<void(const struct ReportArgs&)>;
 
-    // iptables chain where wakeup packets are matched
-    static const char LOCAL_MANGLE_INPUT[];
+    // iptables chain where wakeup packets are matched; constexpr so the chain topology table in
+    // Controllers.cpp can reference it at compile time.
+    static constexpr char LOCAL_MANGLE_INPUT[] = "wakeupctrl_mangle_INPUT";
 
     static const uint32_t kDefaultPacketCopyRange;
 
@@ -77,6 +78,27 @@ class WakeupController {
     netdutils::Status execIptables(const std::string& action, const std::string& ifName,
                                    const std::string& prefix, uint32_t mark, uint32_t mask);
 
+    // Returns true if |args| should be reported to the framework now, or false if it was absorbed
+    // into an aggregation slot. The first event of a (uid, prefix, IP protocol) tuple in a window
+    // is always reported immediately, so wakeup attribution stays timely; repeats of the same
+    // tuple within the window are only counted, and the count is logged when the window rolls
+    // over. This caps the binder traffic a wakeup storm can generate at one call per tuple per
+    // window; the per-packet cost of a storm is a hash and a few stores. The table is fixed-size
+    // and only ever touched from the NFLOG dispatch thread, so no locking is needed.
+    bool shouldReport(const ReportArgs& args);
+
+    struct AggregationSlot {
+        uint64_t windowEndNs = 0;
+        uint32_t suppressed = 0;
+        int uid = -1;
+        int ipNextHeader = -1;
+        std::string prefix;
+    };
+
+    static constexpr size_t kNumAggregationSlots = 32;  // Must be a power of two.
+    static constexpr uint64_t kAggregationWindowNs = 1000000000ULL;  // 1s.
+    AggregationSlot mSlots[kNumAggregationSlots];
+
     ReportFn const mReport;
     IptablesRestoreInterface* const mIptables;
     NFLogListenerInterface* mListener;
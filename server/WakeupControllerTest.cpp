@@ -209,6 +209,45 @@ TEST_F(WakeupControllerTest, msgHandler) {
     mMessageHandler(msg.nlmsg, msg.nfmsg, payload);
 }
 
+TEST_F(WakeupControllerTest, aggregatesRepeatedEvents) {
+    const char kPrefix[] = "test:prefix";
+    const uid_t kUid = 8734;
+    const uid_t kOtherUid = 8735;
+
+    struct Msg {
+        nlmsghdr nlmsg;
+        nfgenmsg nfmsg;
+        nlattr uidAttr;
+        uid_t uid;
+        nlattr prefixAttr;
+        char prefix[sizeof(kPrefix)];
+    } msg = {};
+
+    msg.uidAttr.nla_type = NFULA_UID;
+    msg.uidAttr.nla_len = sizeof(msg.uidAttr) + sizeof(msg.uid);
+    msg.uid = htonl(kUid);
+
+    msg.prefixAttr.nla_type = NFULA_PREFIX;
+    msg.prefixAttr.nla_len = sizeof(msg.prefixAttr) + sizeof(msg.prefix);
+    memcpy(msg.prefix, kPrefix, sizeof(kPrefix));
+
+    auto payload = drop(netdutils::makeSlice(msg), offsetof(Msg, uidAttr));
+
+    // The first event of a (uid, prefix, protocol) tuple is reported immediately; repeats within
+    // the aggregation window are absorbed. The StrictMock fails the test if a repeat leaks out.
+    EXPECT_CALL(mEventListener,
+            onWakeupEvent(kPrefix, kUid, -1, -1, std::vector<uint8_t>(), "", "", -1, -1, 0));
+    for (int i = 0; i < 5; i++) {
+        mMessageHandler(msg.nlmsg, msg.nfmsg, payload);
+    }
+
+    // A different tuple is not held back by the previous one's window.
+    msg.uid = htonl(kOtherUid);
+    EXPECT_CALL(mEventListener,
+            onWakeupEvent(kPrefix, kOtherUid, -1, -1, std::vector<uint8_t>(), "", "", -1, -1, 0));
+    mMessageHandler(msg.nlmsg, msg.nfmsg, payload);
+}
+
 TEST_F(WakeupControllerTest, badAttr) {
     const char kPrefix[] = "test:prefix";
     const uid_t kUid = 8734;
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "WakeupEventRing"
+
+#include "WakeupEventRing.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <log/log.h>
+
+namespace android {
+namespace net {
+
+int WakeupEventRing::ensureInitializedLocked() {
+    if (mHeader != nullptr) {
+        return 0;
+    }
+
+    const size_t size = sizeof(Header) + kRecordCount * sizeof(Record);
+    base::unique_fd memfd(memfd_create("netd_wakeup_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (memfd < 0) {
+        ALOGE("memfd_create failed: %s", strerror(errno));
+        return -errno;
+    }
+    if (ftruncate(memfd, size) == -1) {
+        ALOGE("ftruncate(%zu) failed: %s", size, strerror(errno));
+        return -errno;
+    }
+    // Seal the size so the consumer cannot truncate the file out from under our mapping.
+    if (fcntl(memfd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == -1) {
+        ALOGE("F_ADD_SEALS failed: %s", strerror(errno));
+        return -errno;
+    }
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd.get(), 0);
+    if (map == MAP_FAILED) {
+        ALOGE("mmap failed: %s", strerror(errno));
+        return -errno;
+    }
+    base::unique_fd signalFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (signalFd < 0) {
+        munmap(map, size);
+        ALOGE("eventfd failed: %s", strerror(errno));
+        return -errno;
+    }
+
+    Header* header = static_cast<Header*>(map);
+    header->magic = kMagic;
+    header->version = kVersion;
+    header->recordSize = sizeof(Record);
+    header->recordCount = kRecordCount;
+    header->head.store(0, std::memory_order_relaxed);
+
+    mMemfd = std::move(memfd);
+    mSignalFd = std::move(signalFd);
+    mHeader = header;
+    mRecords = reinterpret_cast<Record*>(header + 1);
+    return 0;
+}
+
+int WakeupEventRing::attach(base::unique_fd* ringFd, base::unique_fd* signalFd) {
+    std::lock_guard lock(mLock);
+    if (int ret = ensureInitializedLocked()) {
+        return ret;
+    }
+    ringFd->reset(dup(mMemfd.get()));
+    signalFd->reset(dup(mSignalFd.get()));
+    if (ringFd->get() < 0 || signalFd->get() < 0) {
+        return -errno;
+    }
+    // Only divert events away from the binder callback once a consumer actually holds the ring.
+    mAttached.store(true, std::memory_order_release);
+    return 0;
+}
+
+bool WakeupEventRing::write(const WakeupController::ReportArgs& args) {
+    if (!mAttached.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    const uint64_t seq = mHeader->head.load(std::memory_order_relaxed);
+    Record& rec = mRecords[seq & (kRecordCount - 1)];
+
+    // Seqlock write: mark the slot in progress, publish the body, then publish the sequence. The
+    // fence keeps the body stores from being hoisted above the in-progress marker.
+    rec.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    rec.timestampNs = args.timestampNs;
+    rec.uid = args.uid;
+    rec.gid = args.gid;
+    rec.ethertype = args.ethertype;
+    rec.ipNextHeader = args.ipNextHeader;
+    rec.srcPort = args.srcPort;
+    rec.dstPort = args.dstPort;
+    rec.dstHwLen = std::min(args.dstHw.size(), sizeof(rec.dstHw));
+    memcpy(rec.dstHw, args.dstHw.data(), rec.dstHwLen);
+    strlcpy(rec.prefix, args.prefix.c_str(), sizeof(rec.prefix));
+    strlcpy(rec.srcIp, args.srcIp.c_str(), sizeof(rec.srcIp));
+    strlcpy(rec.dstIp, args.dstIp.c_str(), sizeof(rec.dstIp));
+
+    rec.seq.store(seq + 1, std::memory_order_release);
+    mHeader->head.store(seq + 1, std::memory_order_release);
+
+    // Wake the consumer. EAGAIN means the eventfd counter is already saturated with unconsumed
+    // signals, which is exactly the coalescing we want during a storm.
+    const uint64_t one = 1;
+    TEMP_FAILURE_RETRY(::write(mSignalFd.get(), &one, sizeof(one)));
+    return true;
+}
+
+}  // namespace net
+}  // namespace android
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_SERVER_WAKEUP_EVENT_RING_H
+#define NETD_SERVER_WAKEUP_EVENT_RING_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+
+#include <android-base/thread_annotations.h>
+#include <android-base/unique_fd.h>
+
+#include "WakeupController.h"
+
+namespace android {
+namespace net {
+
+// Shared-memory ring carrying wakeup packet metadata to the framework.
+//
+// The one-binder-call-per-event path both loses events under rate limiting and burns CPU
+// marshalling during wakeup storms. Once a consumer has attached, each event instead costs a few
+// stores into a shared mapping plus one eventfd write, and the binder callback is skipped; on
+// devices whose framework never attaches, the callback path is untouched.
+//
+// The mapping is a Header followed by kRecordCount fixed-size Records used as a ring indexed by
+// sequence number modulo kRecordCount. netd is the only producer (the NFLOG dispatch thread).
+// Records are published with the classic seqlock protocol: the slot's seq field is zeroed while
+// the body is being written and set to sequence + 1 once it is valid, so a consumer that re-reads
+// seq after copying the body detects a torn read and skips the record. Header.head (the next
+// sequence to be written) only grows, so a consumer that falls more than kRecordCount behind can
+// detect the overrun from the sequence numbers alone; the producer never blocks on the consumer.
+class WakeupEventRing {
+  public:
+    // First bytes of the mapping. All fields except head are written once at creation.
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t recordSize;
+        uint32_t recordCount;
+        // Sequence number of the next record to be written; record |i| lives in slot
+        // i % recordCount and holds i + 1 in its seq field once valid.
+        std::atomic<uint64_t> head;
+    };
+
+    // One wakeup event. Strings are NUL-terminated and truncated to their field if longer.
+    struct Record {
+        std::atomic<uint64_t> seq;  // Sequence + 1 once the body below is valid; 0 in progress.
+        uint64_t timestampNs;
+        int32_t uid;
+        int32_t gid;
+        int32_t ethertype;
+        int32_t ipNextHeader;
+        int32_t srcPort;
+        int32_t dstPort;
+        uint8_t dstHwLen;
+        uint8_t dstHw[8];
+        char prefix[32];
+        char srcIp[INET6_ADDRSTRLEN];
+        char dstIp[INET6_ADDRSTRLEN];
+    };
+
+    static constexpr uint32_t kMagic = 0x57414b45;  // 'WAKE'
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kRecordCount = 256;  // Must be a power of two.
+
+    // Creates the ring on first call and returns dups of its memfd and "data available" eventfd
+    // for the consumer; later calls hand out the same ring. Returns 0 or negative errno.
+    [[nodiscard]] int attach(base::unique_fd* ringFd, base::unique_fd* signalFd) EXCLUDES(mLock);
+
+    // Appends one event and signals the eventfd. Returns false if no consumer has ever attached,
+    // in which case the caller falls back to the binder callback. Only ever called from the NFLOG
+    // dispatch thread, so producer-side writes need no lock.
+    bool write(const WakeupController::ReportArgs& args);
+
+  private:
+    [[nodiscard]] int ensureInitializedLocked() REQUIRES(mLock);
+
+    std::mutex mLock;
+    // Set (with release ordering) only after mHeader/mRecords are valid, and checked by write()
+    // with acquire ordering, so the NFLOG thread never observes a half-built ring.
+    std::atomic<bool> mAttached{false};
+    base::unique_fd mMemfd GUARDED_BY(mLock);
+    // Written once under mLock before mAttached is set and immutable afterwards, so write() can
+    // use them without the lock.
+    base::unique_fd mSignalFd;
+    Header* mHeader = nullptr;
+    Record* mRecords = nullptr;
+};
+
+}  // namespace net
+}  // namespace android
+
+#endif  // NETD_SERVER_WAKEUP_EVENT_RING_H
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WakeupEventRing.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace net {
+
+namespace {
+
+WakeupController::ReportArgs makeArgs(int uid) {
+    WakeupController::ReportArgs args = {};
+    args.prefix = "wlan0:100";
+    args.timestampNs = 1234567890ULL;
+    args.uid = uid;
+    args.gid = 1000;
+    args.ethertype = 0x0800;
+    args.ipNextHeader = 6;
+    args.dstHw = {0x02, 0x00, 0x00, 0x11, 0x22, 0x33};
+    args.srcIp = "192.0.2.1";
+    args.dstIp = "192.0.2.2";
+    args.srcPort = 4500;
+    args.dstPort = 443;
+    return args;
+}
+
+uint64_t drain(int fd) {
+    uint64_t value = 0;
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) return 0;
+    return value;
+}
+
+}  // namespace
+
+TEST(WakeupEventRingTest, NoWritesUntilAttached) {
+    WakeupEventRing ring;
+    EXPECT_FALSE(ring.write(makeArgs(10001)));
+}
+
+TEST(WakeupEventRingTest, RecordsAreVisibleToConsumer) {
+    WakeupEventRing ring;
+    base::unique_fd ringFd;
+    base::unique_fd signalFd;
+    ASSERT_EQ(0, ring.attach(&ringFd, &signalFd));
+
+    const size_t size = sizeof(WakeupEventRing::Header) +
+                        WakeupEventRing::kRecordCount * sizeof(WakeupEventRing::Record);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, ringFd.get(), 0);
+    ASSERT_NE(MAP_FAILED, map);
+    const auto* header = static_cast<const WakeupEventRing::Header*>(map);
+    const auto* records = reinterpret_cast<const WakeupEventRing::Record*>(header + 1);
+
+    EXPECT_EQ(WakeupEventRing::kMagic, header->magic);
+    EXPECT_EQ(WakeupEventRing::kVersion, header->version);
+    EXPECT_EQ(sizeof(WakeupEventRing::Record), header->recordSize);
+    EXPECT_EQ(WakeupEventRing::kRecordCount, header->recordCount);
+    EXPECT_EQ(0U, header->head.load());
+
+    EXPECT_TRUE(ring.write(makeArgs(10001)));
+    EXPECT_EQ(1U, header->head.load());
+    EXPECT_EQ(1U, records[0].seq.load());
+    EXPECT_EQ(10001, records[0].uid);
+    EXPECT_EQ(1234567890ULL, records[0].timestampNs);
+    EXPECT_EQ(6U, records[0].dstHwLen);
+    EXPECT_STREQ("wlan0:100", records[0].prefix);
+    EXPECT_STREQ("192.0.2.1", records[0].srcIp);
+    EXPECT_STREQ("192.0.2.2", records[0].dstIp);
+    EXPECT_EQ(4500, records[0].srcPort);
+    EXPECT_EQ(443, records[0].dstPort);
+    EXPECT_LE(1U, drain(signalFd.get()));
+
+    // Fill the ring past capacity: the oldest slot is overwritten and its sequence number shows
+    // that the consumer was lapped.
+    for (uint32_t i = 0; i < WakeupEventRing::kRecordCount; ++i) {
+        EXPECT_TRUE(ring.write(makeArgs(20000 + i)));
+    }
+    EXPECT_EQ(WakeupEventRing::kRecordCount + 1, header->head.load());
+    EXPECT_EQ(WakeupEventRing::kRecordCount + 1, records[0].seq.load());
+    EXPECT_EQ(20000 + static_cast<int>(WakeupEventRing::kRecordCount) - 1, records[0].uid);
+
+    munmap(map, size);
+}
+
+TEST(WakeupEventRingTest, AttachTwiceReturnsSameRing) {
+    WakeupEventRing ring;
+    base::unique_fd ringFd1, signalFd1, ringFd2, signalFd2;
+    ASSERT_EQ(0, ring.attach(&ringFd1, &signalFd1));
+    ASSERT_EQ(0, ring.attach(&ringFd2, &signalFd2));
+
+    EXPECT_TRUE(ring.write(makeArgs(10001)));
+    // Both signal fds alias the same eventfd, so one drain consumes the signal for both.
+    EXPECT_LE(1U, drain(signalFd1.get()));
+    EXPECT_EQ(0U, drain(signalFd2.get()));
+}
+
+}  // namespace net
+}  // namespace android
@@ -15,8 +15,12 @@
  * limitations under the License.
  */
 
+#include <map>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include <ctype.h>
@@ -45,6 +49,7 @@
 #include <linux/xfrm.h>
 
 #define LOG_TAG "XfrmController"
+#define ATRACE_TAG ATRACE_TAG_NETWORK
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
@@ -53,6 +58,7 @@
 #include <cutils/properties.h>
 #include <log/log.h>
 #include <log/log_properties.h>
+#include <utils/Trace.h>
 #include "Fwmark.h"
 #include "InterfaceController.h"
 #include "NetdConstants.h"
@@ -103,6 +109,67 @@ constexpr int LOOPBACK_IFINDEX = 1;
 
 bool mIsXfrmIntfSupported = false;
 
+// Interned descriptors for the algorithms the platform API hands out (android.net
+// IpSecAlgorithm); all bounds are in bits and mirror that API's documented limits. Names not in
+// the table are passed through untouched for the kernel to judge, so vendor algorithms keep
+// working; for the common ones, a malformed key or truncation length fails here with the same
+// EINVAL it would otherwise earn after serialization and a netlink round-trip. Ranged entries
+// (e.g. cbc(aes) taking 128/192/256-bit keys) are checked as a range, with the kernel remaining
+// the authority on the exact values in between.
+struct XfrmAlgoDescriptor {
+    const char* name;
+    uint16_t minKeyBits;
+    uint16_t maxKeyBits;
+    uint16_t minTruncBits;
+    uint16_t maxTruncBits;
+};
+
+constexpr uint16_t ALGO_TRUNC_UNCHECKED = 0xffff;
+
+constexpr XfrmAlgoDescriptor kXfrmAlgoDescriptors[] = {
+        // Authentication (XFRMA_ALG_AUTH_TRUNC); the truncation bounds are the ICV length.
+        {"hmac(md5)", 128, 128, 96, 128},
+        {"hmac(sha1)", 160, 160, 96, 160},
+        {"hmac(sha256)", 256, 256, 96, 256},
+        {"hmac(sha384)", 384, 384, 192, 384},
+        {"hmac(sha512)", 512, 512, 256, 512},
+        {"xcbc(aes)", 128, 128, 96, 96},
+        {"cmac(aes)", 128, 128, 96, 96},
+        // Encryption (XFRMA_ALG_CRYPT); the truncation length is unused and not checked.
+        {"ecb(cipher_null)", 0, 0, 0, ALGO_TRUNC_UNCHECKED},
+        {"cbc(aes)", 128, 256, 0, ALGO_TRUNC_UNCHECKED},
+        {"rfc3686(ctr(aes))", 160, 288, 0, ALGO_TRUNC_UNCHECKED},
+        // AEAD (XFRMA_ALG_AEAD); key bounds include the salt, truncation bounds are the ICV.
+        {"rfc4106(gcm(aes))", 160, 288, 64, 128},
+        {"rfc7539esp(chacha20,poly1305)", 288, 288, 128, 128},
+};
+
+const XfrmAlgoDescriptor* lookupXfrmAlgoDescriptor(const std::string& name) {
+    // At a dozen entries a scan over the interned table beats hashing the name.
+    for (const XfrmAlgoDescriptor& desc : kXfrmAlgoDescriptors) {
+        if (name == desc.name) return &desc;
+    }
+    return nullptr;
+}
+
+netdutils::Status validateXfrmAlgo(const XfrmAlgo& algo) {
+    if (algo.name.empty()) {
+        return netdutils::status::ok;
+    }
+    const XfrmAlgoDescriptor* desc = lookupXfrmAlgoDescriptor(algo.name);
+    if (desc == nullptr) {
+        return netdutils::status::ok;  // Unknown algorithm: let the kernel decide.
+    }
+    const size_t keyBits = algo.key.size() * 8;
+    if (keyBits < desc->minKeyBits || keyBits > desc->maxKeyBits) {
+        return netdutils::statusFromErrno(EINVAL, "Invalid key length for " + algo.name);
+    }
+    if (algo.truncLenBits < desc->minTruncBits || algo.truncLenBits > desc->maxTruncBits) {
+        return netdutils::statusFromErrno(EINVAL, "Invalid truncation length for " + algo.name);
+    }
+    return netdutils::status::ok;
+}
+
 static inline bool isEngBuild() {
     static const std::string sBuildType = android::base::GetProperty("ro.build.type", "user");
     return sBuildType == "eng";
@@ -326,6 +393,113 @@ public:
 
         return validateStatus;
     }
+
+    netdutils::Status sendBatch(const std::vector<XfrmMessage>& messages) const override {
+        if (messages.empty()) {
+            return netdutils::status::ok;
+        }
+
+        // Per-thread scratch reused across batches so assembling a batch is allocation-free at
+        // steady state; the capacity from the largest batch seen on this thread sticks around.
+        // The headers are resized before the iovecs are pointed into them, so they never move
+        // while a send is reading them.
+        static thread_local std::vector<nlmsghdr> headers;
+        static thread_local std::vector<iovec> iov;
+        headers.clear();
+        headers.resize(messages.size());
+        iov.clear();
+
+        size_t totalLen = 0;
+        for (size_t i = 0; i < messages.size(); i++) {
+            nlmsghdr& nlMsg = headers[i];
+            nlMsg = {
+                .nlmsg_type = messages[i].nlMsgType,
+                .nlmsg_flags = NETLINK_REQUEST_FLAGS,
+                .nlmsg_seq = static_cast<uint32_t>(i + 1),
+            };
+
+            (*messages[i].iovecs)[0] = {&nlMsg, NLMSG_HDRLEN};
+            for (const iovec& piece : *messages[i].iovecs) {
+                nlMsg.nlmsg_len += piece.iov_len;
+            }
+            totalLen += nlMsg.nlmsg_len;
+
+            ALOGD("Batching Netlink XFRM Message: %s", xfrmMsgTypeToString(messages[i].nlMsgType));
+            LOG_IOV(*messages[i].iovecs);
+
+            iov.insert(iov.end(), messages[i].iovecs->begin(), messages[i].iovecs->end());
+        }
+
+        StatusOr<size_t> writeResult = getSyscallInstance().writev(mSock, iov);
+        if (!isOk(writeResult)) {
+            ALOGE("netlink socket writev failed (%s)", toString(writeResult).c_str());
+            return writeResult;
+        }
+
+        if (totalLen != writeResult.value()) {
+            ALOGE("Invalid netlink message length sent %d", static_cast<int>(writeResult.value()));
+            return netdutils::statusFromErrno(EBADMSG, "Invalid message length");
+        }
+
+        // The kernel acks each message of the batch individually, but may coalesce several acks
+        // into one datagram; walk every header in each read until all are accounted for.
+        size_t acked = 0;
+        while (acked < messages.size()) {
+            NetlinkResponse response = {};
+
+            StatusOr<Slice> readResult =
+                getSyscallInstance().read(Fd(mSock), netdutils::makeSlice(response));
+            if (!isOk(readResult)) {
+                ALOGE("netlink response error (%s)", toString(readResult).c_str());
+                return readResult;
+            }
+
+            LOG_HEX("netlink msg resp", reinterpret_cast<char*>(readResult.value().base()),
+                    readResult.value().size());
+
+            size_t len = readResult.value().size();
+            if (len < sizeof(nlmsghdr)) {
+                return validateResponse(response, len);
+            }
+
+            for (const nlmsghdr* hdr = &response.hdr; NLMSG_OK(hdr, len);
+                 hdr = NLMSG_NEXT(hdr, len)) {
+                NetlinkResponse single = {};
+                memcpy(&single, hdr,
+                       hdr->nlmsg_len < sizeof(single) ? hdr->nlmsg_len : sizeof(single));
+                Status validateStatus = validateResponse(single, hdr->nlmsg_len);
+                if (!isOk(validateStatus)) {
+                    ALOGE("netlink response contains error (%s)",
+                          toString(validateStatus).c_str());
+                    return validateStatus;
+                }
+                acked++;
+            }
+        }
+
+        return netdutils::status::ok;
+    }
+
+    // Liveness probe for reusing a cached socket. Rejects sockets with a pending error (such as
+    // ENOBUFS from an earlier receive-queue overrun) and drains any response left unread by an
+    // operation that bailed out between its write and its ack read, which would otherwise
+    // desynchronize the next request from its ack.
+    bool isUsable() {
+        if (mSock < 0) {
+            return false;
+        }
+
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (::getsockopt(mSock, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0) {
+            return false;
+        }
+
+        char buf[NLMSG_DEFAULTSIZE];
+        while (::recv(mSock, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+        }
+        return true;
+    }
 };
 
 StatusOr<int> convertToXfrmAddr(const std::string& strAddr, xfrm_address_t* xfrmAddr) {
@@ -348,6 +522,26 @@ void fillXfrmNlaHdr(nlattr* hdr, uint16_t type, uint16_t len) {
     hdr->nla_len = len;
 }
 
+// Most XFRM attributes carry exactly one fixed-size kernel struct laid out immediately after
+// the attribute header, so their netlink length is a compile-time constant: the size of the
+// container struct itself. fillFixedNlAttrHdr() writes the header from that constant and
+// returns it, so the length and padding arithmetic at the message assembly sites constant-folds
+// into straight-line stores. The algorithm attributes stay on the runtime path, because their
+// payload ends in a key whose length is only known per transform.
+template <uint16_t nlaType, typename AttrStruct>
+int fillFixedNlAttrHdr(AttrStruct* attr) {
+    constexpr uint16_t len = sizeof(AttrStruct);
+    fillXfrmNlaHdr(&attr->hdr, nlaType, len);
+    return len;
+}
+
+// Sums the aligned on-the-wire lengths of a list of fixed-size attributes at compile time, for
+// sizing worst-case messages without runtime bookkeeping.
+template <typename... AttrStructs>
+constexpr size_t totalNlAttrLength() {
+    return (NLA_ALIGN(sizeof(AttrStructs)) + ... + 0);
+}
+
 void fillXfrmCurLifetimeDefaults(xfrm_lifetime_cur* cur) {
     memset(reinterpret_cast<char*>(cur), 0, sizeof(*cur));
 }
@@ -387,8 +581,91 @@ private:
     uint32_t mCount;
 };
 
+// Pre-serialized netlink message templates, cached per transform. A rekey of an existing tunnel
+// sends a message whose layout is identical to the previous one - only the SPI, the key material
+// and (with MOBIKE) the encap ports differ - so the attribute structs (several hundred bytes each,
+// dominated by the key buffers) and the iovec table are allocated, zeroed and laid out once per
+// transform, and the mutable fields are refilled in place on every send. Templates are dropped
+// when their SA or policy is deleted. The locks also keep a concurrent rekey from refilling the
+// buffers while a send is still reading them.
+struct SaMessageTemplate {
+    xfrm_usersa_info usersa{};
+    XfrmController::nlattr_algo_crypt crypt{};
+    XfrmController::nlattr_algo_auth auth{};
+    XfrmController::nlattr_algo_aead aead{};
+    XfrmController::nlattr_xfrm_mark xfrmmark{};
+    XfrmController::nlattr_xfrm_output_mark xfrmoutputmark{};
+    XfrmController::nlattr_encap_tmpl encap{};
+    XfrmController::nlattr_xfrm_interface_id xfrm_if_id{};
+    std::vector<iovec> iov;
+};
+
+struct SpMessageTemplate {
+    xfrm_userpolicy_info userpolicy{};
+    XfrmController::nlattr_user_tmpl usertmpl{};
+    XfrmController::nlattr_xfrm_mark xfrmmark{};
+    XfrmController::nlattr_xfrm_interface_id xfrm_if_id{};
+    std::vector<iovec> iov;
+};
+
+// Worst case of an UPDSA message: every attribute present, every key at MAX_KEY_LENGTH. Known
+// entirely at compile time, so prove once that the message always fits the socket's send buffer
+// (XfrmSocketImpl::NLMSG_DEFAULTSIZE) instead of checking lengths at runtime per send.
+constexpr size_t kMaxSaMessageLength =
+        NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(xfrm_usersa_info)) +
+        totalNlAttrLength<XfrmController::nlattr_algo_crypt, XfrmController::nlattr_algo_auth,
+                          XfrmController::nlattr_algo_aead, XfrmController::nlattr_xfrm_mark,
+                          XfrmController::nlattr_xfrm_output_mark,
+                          XfrmController::nlattr_encap_tmpl,
+                          XfrmController::nlattr_xfrm_interface_id>();
+static_assert(kMaxSaMessageLength <= 8192, "UPDSA message can exceed NLMSG_DEFAULTSIZE");
+
+std::mutex gSaTemplateLock;
+std::map<int32_t, std::unique_ptr<SaMessageTemplate>> gSaTemplates;
+
+std::mutex gSpTemplateLock;
+// Keyed by (transformId, direction, selector address family): a dual-stack transform installs
+// one policy per selector family in each direction, and a batched create points every entry at
+// its template's buffers until the whole batch is sent, so the policies of one direction must
+// not share a template.
+std::map<std::tuple<int32_t, int32_t, int32_t>, std::unique_ptr<SpMessageTemplate>> gSpTemplates;
+
+// Long-lived XFRM socket shared by every controller operation, so that steady-state IPsec
+// management does not pay a socket()/connect()/close() round per call. Guarded by
+// gXfrmSocketLock, which callers hold for the duration of the operation; the socket is
+// (re)opened on first use and whenever the liveness probe fails.
+std::mutex gXfrmSocketLock;
+XfrmSocketImpl gXfrmSocket;
+
+// Cache of XFRM-I tunnel interfaces created through ipSecAddTunnelInterface(): device name to
+// the xfrm_if_id the link carries. Lets an idempotent update skip its RTM_NEWLINK round-trip,
+// which multi-tunnel configurations hit every time they re-apply state. Invalidated from
+// RTM_DELLINK events via onInterfaceRemoved(), so a tunnel deleted behind netd's back is
+// recreated rather than skipped. VTI links are not cached: their state includes addresses and
+// keys beyond (name, id), so an update there is never known to be a no-op.
+std::mutex gTunnelInterfaceLock;
+std::map<std::string, int32_t> gTunnelInterfaces;
+
+// Returns the shared XFRM socket, opening or reopening it as needed. The caller must hold
+// gXfrmSocketLock until it is done with the socket.
+netdutils::Status getXfrmSocket(XfrmSocket** sock) {
+    if (!gXfrmSocket.isUsable()) {
+        gXfrmSocket.close();
+        RETURN_IF_NOT_OK(gXfrmSocket.open());
+    }
+    *sock = &gXfrmSocket;
+    return netdutils::status::ok;
+}
+
 } // namespace
 
+netdutils::Status XfrmSocket::sendBatch(const std::vector<XfrmMessage>& messages) const {
+    for (const XfrmMessage& message : messages) {
+        RETURN_IF_NOT_OK(sendMessage(message.nlMsgType, NETLINK_REQUEST_FLAGS, 0, message.iovecs));
+    }
+    return netdutils::status::ok;
+}
+
 //
 // Begin XfrmController Impl
 //
@@ -404,10 +681,11 @@ netdutils::Status XfrmController::Init() {
     RETURN_IF_NOT_OK(flushInterfaces());
     mIsXfrmIntfSupported = isXfrmIntfSupported();
 
-    XfrmSocketImpl sock;
-    RETURN_IF_NOT_OK(sock.open());
-    RETURN_IF_NOT_OK(flushSaDb(sock));
-    return flushPolicyDb(sock);
+    std::lock_guard guard(gXfrmSocketLock);
+    XfrmSocket* sock;
+    RETURN_IF_NOT_OK(getXfrmSocket(&sock));
+    RETURN_IF_NOT_OK(flushSaDb(*sock));
+    return flushPolicyDb(*sock);
 }
 
 netdutils::Status XfrmController::flushInterfaces() {
@@ -502,8 +780,9 @@ netdutils::Status XfrmController::ipSecAllocateSpi(int32_t transformId,
         return ret;
     }
 
-    XfrmSocketImpl sock;
-    netdutils::Status socketStatus = sock.open();
+    std::lock_guard guard(gXfrmSocketLock);
+    XfrmSocket* sock;
+    netdutils::Status socketStatus = getXfrmSocket(&sock);
     if (!isOk(socketStatus)) {
         ALOGD("Sock open failed for XFRM, line=%d", __LINE__);
         return socketStatus;
@@ -514,7 +793,7 @@ netdutils::Status XfrmController::ipSecAllocateSpi(int32_t transformId,
     if (inSpi)
         minSpi = maxSpi = inSpi;
 
-    ret = allocateSpi(saInfo, minSpi, maxSpi, reinterpret_cast<uint32_t*>(outSpi), sock);
+    ret = allocateSpi(saInfo, minSpi, maxSpi, reinterpret_cast<uint32_t*>(outSpi), *sock);
     if (!isOk(ret)) {
         // TODO: May want to return a new Status with a modified status string
         ALOGD("Failed to Allocate an SPI, line=%d", __LINE__);
@@ -532,6 +811,7 @@ netdutils::Status XfrmController::ipSecAddSecurityAssociation(
         const std::vector<uint8_t>& cryptKey, int32_t cryptTruncBits, const std::string& aeadAlgo,
         const std::vector<uint8_t>& aeadKey, int32_t aeadIcvBits, int32_t encapType,
         int32_t encapLocalPort, int32_t encapRemotePort, int32_t xfrmInterfaceId) {
+    ATRACE_CALL();
     ALOGD("XfrmController::%s, line=%d", __FUNCTION__, __LINE__);
     ALOGD("transformId=%d", transformId);
     ALOGD("mode=%d", mode);
@@ -553,60 +833,163 @@ netdutils::Status XfrmController::ipSecAddSecurityAssociation(
     ALOGD("xfrmInterfaceId=%d", xfrmInterfaceId);
 
     XfrmSaInfo saInfo{};
-    netdutils::Status ret = fillXfrmCommonInfo(sourceAddress, destinationAddress, spi, markValue,
-                                               markMask, transformId, xfrmInterfaceId, &saInfo);
+    netdutils::Status ret =
+            fillSaInfo({.transformId = transformId,
+                        .sourceAddress = sourceAddress,
+                        .destinationAddress = destinationAddress,
+                        .underlyingNetId = underlyingNetId,
+                        .spi = spi,
+                        .markValue = markValue,
+                        .markMask = markMask,
+                        .authAlgo = authAlgo,
+                        .authKey = authKey,
+                        .authTruncBits = authTruncBits,
+                        .cryptAlgo = cryptAlgo,
+                        .cryptKey = cryptKey,
+                        .cryptTruncBits = cryptTruncBits,
+                        .aeadAlgo = aeadAlgo,
+                        .aeadKey = aeadKey,
+                        .aeadIcvBits = aeadIcvBits,
+                        .encapType = encapType,
+                        .encapLocalPort = encapLocalPort,
+                        .encapRemotePort = encapRemotePort,
+                        .xfrmInterfaceId = xfrmInterfaceId},
+                       static_cast<XfrmMode>(mode), &saInfo);
     if (!isOk(ret)) {
         return ret;
     }
 
-    saInfo.auth = XfrmAlgo{
-        .name = authAlgo, .key = authKey, .truncLenBits = static_cast<uint16_t>(authTruncBits)};
+    std::lock_guard guard(gXfrmSocketLock);
+    XfrmSocket* sock;
+    netdutils::Status socketStatus = getXfrmSocket(&sock);
+    if (!isOk(socketStatus)) {
+        ALOGD("Sock open failed for XFRM, line=%d", __LINE__);
+        return socketStatus;
+    }
 
-    saInfo.crypt = XfrmAlgo{
-        .name = cryptAlgo, .key = cryptKey, .truncLenBits = static_cast<uint16_t>(cryptTruncBits)};
+    ret = updateSecurityAssociation(saInfo, *sock);
+    if (!isOk(ret)) {
+        ALOGD("Failed updating a Security Association, line=%d", __LINE__);
+    }
 
-    saInfo.aead = XfrmAlgo{
-        .name = aeadAlgo, .key = aeadKey, .truncLenBits = static_cast<uint16_t>(aeadIcvBits)};
+    return ret;
+}
 
-    switch (static_cast<XfrmMode>(mode)) {
+netdutils::Status XfrmController::fillSaInfo(const TunnelSaParams& params, XfrmMode mode,
+                                             XfrmSaInfo* saInfo) {
+    netdutils::Status ret = fillXfrmCommonInfo(params.sourceAddress, params.destinationAddress,
+                                               params.spi, params.markValue, params.markMask,
+                                               params.transformId, params.xfrmInterfaceId, saInfo);
+    if (!isOk(ret)) {
+        return ret;
+    }
+
+    saInfo->auth = XfrmAlgo{.name = params.authAlgo,
+                            .key = params.authKey,
+                            .truncLenBits = static_cast<uint16_t>(params.authTruncBits)};
+
+    saInfo->crypt = XfrmAlgo{.name = params.cryptAlgo,
+                             .key = params.cryptKey,
+                             .truncLenBits = static_cast<uint16_t>(params.cryptTruncBits)};
+
+    saInfo->aead = XfrmAlgo{.name = params.aeadAlgo,
+                            .key = params.aeadKey,
+                            .truncLenBits = static_cast<uint16_t>(params.aeadIcvBits)};
+
+    switch (mode) {
         case XfrmMode::TRANSPORT:
         case XfrmMode::TUNNEL:
-            saInfo.mode = static_cast<XfrmMode>(mode);
+            saInfo->mode = mode;
             break;
         default:
             return netdutils::statusFromErrno(EINVAL, "Invalid xfrm mode");
     }
 
-    XfrmSocketImpl sock;
-    netdutils::Status socketStatus = sock.open();
-    if (!isOk(socketStatus)) {
-        ALOGD("Sock open failed for XFRM, line=%d", __LINE__);
-        return socketStatus;
-    }
-
-    switch (static_cast<XfrmEncapType>(encapType)) {
+    switch (static_cast<XfrmEncapType>(params.encapType)) {
         case XfrmEncapType::ESPINUDP:
         case XfrmEncapType::ESPINUDP_NON_IKE:
-            if (saInfo.addrFamily != AF_INET) {
+            if (saInfo->addrFamily != AF_INET) {
                 return netdutils::statusFromErrno(EAFNOSUPPORT, "IPv6 encap not supported");
             }
             // The ports are not used on input SAs, so this is OK to be wrong when
             // direction is ultimately input.
-            saInfo.encap.srcPort = encapLocalPort;
-            saInfo.encap.dstPort = encapRemotePort;
+            saInfo->encap.srcPort = params.encapLocalPort;
+            saInfo->encap.dstPort = params.encapRemotePort;
             [[fallthrough]];
         case XfrmEncapType::NONE:
-            saInfo.encap.type = static_cast<XfrmEncapType>(encapType);
+            saInfo->encap.type = static_cast<XfrmEncapType>(params.encapType);
             break;
         default:
             return netdutils::statusFromErrno(EINVAL, "Invalid encap type");
     }
 
-    saInfo.netId = underlyingNetId;
+    saInfo->netId = params.underlyingNetId;
+
+    return netdutils::status::ok;
+}
+
+netdutils::Status XfrmController::ipSecCreateTunnel(const TunnelSaParams& inbound,
+                                                    const TunnelSaParams& outbound) {
+    ATRACE_CALL();
+    ALOGD("XfrmController::%s, line=%d", __FUNCTION__, __LINE__);
+    ALOGD("inbound transformId=%d", inbound.transformId);
+    ALOGD("outbound transformId=%d", outbound.transformId);
+
+    // The per-transform message templates are keyed by transform ID, so the two SAs of the batch
+    // must not share one.
+    if (inbound.transformId == outbound.transformId) {
+        return netdutils::statusFromErrno(EINVAL,
+                                          "Inbound and outbound SAs must use distinct transforms");
+    }
+
+    // Validate everything before anything is sent, so that the kernel either sees the whole
+    // tunnel or none of it.
+    XfrmSaInfo inSa{};
+    XfrmSaInfo outSa{};
+    RETURN_IF_NOT_OK(fillSaInfo(inbound, XfrmMode::TUNNEL, &inSa));
+    RETURN_IF_NOT_OK(fillSaInfo(outbound, XfrmMode::TUNNEL, &outSa));
+
+    std::vector<XfrmSpInfo> policies;
+    for (const auto& [params, direction] :
+         {std::pair<const TunnelSaParams&, XfrmDirection>{inbound, XfrmDirection::IN},
+          std::pair<const TunnelSaParams&, XfrmDirection>{outbound, XfrmDirection::OUT}}) {
+        for (int32_t selAddrFamily : params.selAddrFamilies) {
+            XfrmSpInfo spInfo{};
+            spInfo.mode = XfrmMode::TUNNEL;
+            spInfo.selAddrFamily = selAddrFamily;
+            spInfo.direction = direction;
+            RETURN_IF_NOT_OK(fillXfrmCommonInfo(params.sourceAddress, params.destinationAddress,
+                                                params.spi, params.markValue, params.markMask,
+                                                params.transformId, params.xfrmInterfaceId,
+                                                &spInfo));
+            policies.push_back(spInfo);
+        }
+    }
+
+    std::lock_guard socketGuard(gXfrmSocketLock);
+    XfrmSocket* sock;
+    RETURN_IF_NOT_OK(getXfrmSocket(&sock));
+
+    // The batch entries point into the cached per-transform template buffers, so both template
+    // locks are held across build and send.
+    std::scoped_lock guard(gSaTemplateLock, gSpTemplateLock);
+
+    std::vector<XfrmMessage> batch;
+    batch.reserve(2 + policies.size());
+
+    XfrmMessage msg;
+    RETURN_IF_NOT_OK(buildUpdateSaMessage(inSa, &msg));
+    batch.push_back(msg);
+    RETURN_IF_NOT_OK(buildUpdateSaMessage(outSa, &msg));
+    batch.push_back(msg);
+    for (const XfrmSpInfo& spInfo : policies) {
+        RETURN_IF_NOT_OK(buildUpdatePolicyMessage(spInfo, XFRM_MSG_UPDPOLICY, &msg));
+        batch.push_back(msg);
+    }
 
-    ret = updateSecurityAssociation(saInfo, sock);
+    netdutils::Status ret = sock->sendBatch(batch);
     if (!isOk(ret)) {
-        ALOGD("Failed updating a Security Association, line=%d", __LINE__);
+        ALOGD("Failed creating tunnel transaction, line=%d", __LINE__);
     }
 
     return ret;
@@ -616,6 +999,7 @@ netdutils::Status XfrmController::ipSecDeleteSecurityAssociation(
         int32_t transformId, const std::string& sourceAddress,
         const std::string& destinationAddress, int32_t spi, int32_t markValue, int32_t markMask,
         int32_t xfrmInterfaceId) {
+    ATRACE_CALL();
     ALOGD("XfrmController:%s, line=%d", __FUNCTION__, __LINE__);
     ALOGD("transformId=%d", transformId);
     ALOGD("sourceAddress=%s", sourceAddress.c_str());
@@ -632,14 +1016,15 @@ netdutils::Status XfrmController::ipSecDeleteSecurityAssociation(
         return ret;
     }
 
-    XfrmSocketImpl sock;
-    netdutils::Status socketStatus = sock.open();
+    std::lock_guard guard(gXfrmSocketLock);
+    XfrmSocket* sock;
+    netdutils::Status socketStatus = getXfrmSocket(&sock);
     if (!isOk(socketStatus)) {
         ALOGD("Sock open failed for XFRM, line=%d", __LINE__);
         return socketStatus;
     }
 
-    ret = deleteSecurityAssociation(saInfo, sock);
+    ret = deleteSecurityAssociation(saInfo, *sock);
     if (!isOk(ret)) {
         ALOGD("Failed to delete Security Association, line=%d", __LINE__);
     }
@@ -664,8 +1049,9 @@ netdutils::Status XfrmController::ipSecMigrate(int32_t transformId, int32_t selA
     ALOGD("newDestinationAddress=%s", newDestinationAddress.c_str());
     ALOGD("xfrmInterfaceId=%d", xfrmInterfaceId);
 
-    XfrmSocketImpl sock;
-    Status socketStatus = sock.open();
+    std::lock_guard guard(gXfrmSocketLock);
+    XfrmSocket* sock;
+    Status socketStatus = getXfrmSocket(&sock);
     if (!socketStatus.ok()) {
         ALOGD("Sock open failed for XFRM, line=%d", __LINE__);
         return socketStatus;
@@ -691,7 +1077,7 @@ netdutils::Status XfrmController::ipSecMigrate(int32_t transformId, int32_t selA
         return ret;
     }
 
-    ret = migrate(migrateInfo, sock);
+    ret = migrate(migrateInfo, *sock);
 
     if (!ret.ok()) {
         ALOGD("Failed to migrate Security Association, line=%d", __LINE__);
@@ -761,6 +1147,7 @@ netdutils::Status XfrmController::fillXfrmCommonInfo(int32_t spi, int32_t markVa
 netdutils::Status XfrmController::ipSecApplyTransportModeTransform(
         int socketFd, int32_t transformId, int32_t direction, const std::string& sourceAddress,
         const std::string& destinationAddress, int32_t spi) {
+    ATRACE_CALL();
     ALOGD("XfrmController::%s, line=%d", __FUNCTION__, __LINE__);
     ALOGD("transformId=%d", transformId);
     ALOGD("direction=%d", direction);
@@ -910,8 +1297,9 @@ netdutils::Status XfrmController::processSecurityPolicy(
     XfrmSpInfo spInfo{};
     spInfo.mode = XfrmMode::TUNNEL;
 
-    XfrmSocketImpl sock;
-    RETURN_IF_NOT_OK(sock.open());
+    std::lock_guard socketGuard(gXfrmSocketLock);
+    XfrmSocket* sock;
+    RETURN_IF_NOT_OK(getXfrmSocket(&sock));
 
     // Set the correct address families. Tunnel mode policies use wildcard selectors, while
     // templates have addresses set. These may be different address families. This method is called
@@ -924,12 +1312,12 @@ netdutils::Status XfrmController::processSecurityPolicy(
         RETURN_IF_NOT_OK(fillXfrmCommonInfo(spi, markValue, markMask, transformId, xfrmInterfaceId,
                                             &spInfo));
 
-        return deleteTunnelModeSecurityPolicy(spInfo, sock);
+        return deleteTunnelModeSecurityPolicy(spInfo, *sock);
     } else {
         RETURN_IF_NOT_OK(fillXfrmCommonInfo(tmplSrcAddress, tmplDstAddress, spi, markValue,
                                             markMask, transformId, xfrmInterfaceId, &spInfo));
 
-        return updateTunnelModeSecurityPolicy(spInfo, sock, msgType);
+        return updateTunnelModeSecurityPolicy(spInfo, *sock, msgType);
     }
 }
 
@@ -941,15 +1329,15 @@ void XfrmController::fillXfrmSelector(const int selAddrFamily, xfrm_selector* se
 
 netdutils::Status XfrmController::updateSecurityAssociation(const XfrmSaInfo& record,
                                                             const XfrmSocket& sock) {
-    xfrm_usersa_info usersa{};
-    nlattr_algo_crypt crypt{};
-    nlattr_algo_auth auth{};
-    nlattr_algo_aead aead{};
-    nlattr_xfrm_mark xfrmmark{};
-    nlattr_xfrm_output_mark xfrmoutputmark{};
-    nlattr_encap_tmpl encap{};
-    nlattr_xfrm_interface_id xfrm_if_id{};
+    // Serialize into the per-transform template, so that rekeys reuse the attribute buffers and
+    // iovec layout built on the first send; see SaMessageTemplate.
+    std::lock_guard guard(gSaTemplateLock);
+    XfrmMessage msg;
+    RETURN_IF_NOT_OK(buildUpdateSaMessage(record, &msg));
+    return sock.sendMessage(msg.nlMsgType, NETLINK_REQUEST_FLAGS, 0, msg.iovecs);
+}
 
+netdutils::Status XfrmController::buildUpdateSaMessage(const XfrmSaInfo& record, XfrmMessage* msg) {
     enum {
         NLMSG_HDR,
         USERSA,
@@ -970,26 +1358,6 @@ netdutils::Status XfrmController::updateSecurityAssociation(const XfrmSaInfo& re
         INTF_ID_PAD,
     };
 
-    std::vector<iovec> iov = {
-            {nullptr, 0},          // reserved for the eventual addition of a NLMSG_HDR
-            {&usersa, 0},          // main usersa_info struct
-            {kPadBytes, 0},        // up to NLMSG_ALIGNTO pad bytes of padding
-            {&crypt, 0},           // adjust size if crypt algo is present
-            {kPadBytes, 0},        // up to NLATTR_ALIGNTO pad bytes
-            {&auth, 0},            // adjust size if auth algo is present
-            {kPadBytes, 0},        // up to NLATTR_ALIGNTO pad bytes
-            {&aead, 0},            // adjust size if aead algo is present
-            {kPadBytes, 0},        // up to NLATTR_ALIGNTO pad bytes
-            {&xfrmmark, 0},        // adjust size if xfrm mark is present
-            {kPadBytes, 0},        // up to NLATTR_ALIGNTO pad bytes
-            {&xfrmoutputmark, 0},  // adjust size if xfrm output mark is present
-            {kPadBytes, 0},        // up to NLATTR_ALIGNTO pad bytes
-            {&encap, 0},           // adjust size if encapsulating
-            {kPadBytes, 0},        // up to NLATTR_ALIGNTO pad bytes
-            {&xfrm_if_id, 0},      // adjust size if interface ID is present
-            {kPadBytes, 0},        // up to NLATTR_ALIGNTO pad bytes
-    };
-
     if (!record.aead.name.empty() && (!record.auth.name.empty() || !record.crypt.name.empty())) {
         return netdutils::statusFromErrno(EINVAL, "Invalid xfrm algo selection; AEAD is mutually "
                                                   "exclusive with both Authentication and "
@@ -1001,6 +1369,12 @@ netdutils::Status XfrmController::updateSecurityAssociation(const XfrmSaInfo& re
         return netdutils::statusFromErrno(EINVAL, "Key length invalid; exceeds MAX_KEY_LENGTH");
     }
 
+    // Per-algorithm validation against the interned descriptor table: an out-of-bounds key or
+    // truncation length fails here, before any serialization or a kernel round-trip.
+    RETURN_IF_NOT_OK(validateXfrmAlgo(record.crypt));
+    RETURN_IF_NOT_OK(validateXfrmAlgo(record.auth));
+    RETURN_IF_NOT_OK(validateXfrmAlgo(record.aead));
+
     if (record.mode != XfrmMode::TUNNEL &&
         (record.xfrm_if_id != 0 || record.netId != 0 || record.mark.v != 0 || record.mark.m != 0)) {
         return netdutils::statusFromErrno(EINVAL,
@@ -1010,32 +1384,59 @@ netdutils::Status XfrmController::updateSecurityAssociation(const XfrmSaInfo& re
         return netdutils::statusFromErrno(EINVAL, "xfrm_if_id set for VTI Security Association");
     }
 
+    std::unique_ptr<SaMessageTemplate>& entry = gSaTemplates[record.transformId];
+    if (entry == nullptr) {
+        entry = std::make_unique<SaMessageTemplate>();
+        entry->iov = {
+                {nullptr, 0},                 // reserved for the eventual addition of a NLMSG_HDR
+                {&entry->usersa, 0},          // main usersa_info struct
+                {kPadBytes, 0},               // up to NLMSG_ALIGNTO pad bytes of padding
+                {&entry->crypt, 0},           // adjust size if crypt algo is present
+                {kPadBytes, 0},               // up to NLATTR_ALIGNTO pad bytes
+                {&entry->auth, 0},            // adjust size if auth algo is present
+                {kPadBytes, 0},               // up to NLATTR_ALIGNTO pad bytes
+                {&entry->aead, 0},            // adjust size if aead algo is present
+                {kPadBytes, 0},               // up to NLATTR_ALIGNTO pad bytes
+                {&entry->xfrmmark, 0},        // adjust size if xfrm mark is present
+                {kPadBytes, 0},               // up to NLATTR_ALIGNTO pad bytes
+                {&entry->xfrmoutputmark, 0},  // adjust size if xfrm output mark is present
+                {kPadBytes, 0},               // up to NLATTR_ALIGNTO pad bytes
+                {&entry->encap, 0},           // adjust size if encapsulating
+                {kPadBytes, 0},               // up to NLATTR_ALIGNTO pad bytes
+                {&entry->xfrm_if_id, 0},      // adjust size if interface ID is present
+                {kPadBytes, 0},               // up to NLATTR_ALIGNTO pad bytes
+        };
+    }
+    SaMessageTemplate* t = entry.get();
+    std::vector<iovec>& iov = t->iov;
+
     int len;
-    len = iov[USERSA].iov_len = fillUserSaInfo(record, &usersa);
+    len = iov[USERSA].iov_len = fillUserSaInfo(record, &t->usersa);
     iov[USERSA_PAD].iov_len = NLMSG_ALIGN(len) - len;
 
-    len = iov[CRYPT].iov_len = fillNlAttrXfrmAlgoEnc(record.crypt, &crypt);
+    len = iov[CRYPT].iov_len = fillNlAttrXfrmAlgoEnc(record.crypt, &t->crypt);
     iov[CRYPT_PAD].iov_len = NLA_ALIGN(len) - len;
 
-    len = iov[AUTH].iov_len = fillNlAttrXfrmAlgoAuth(record.auth, &auth);
+    len = iov[AUTH].iov_len = fillNlAttrXfrmAlgoAuth(record.auth, &t->auth);
     iov[AUTH_PAD].iov_len = NLA_ALIGN(len) - len;
 
-    len = iov[AEAD].iov_len = fillNlAttrXfrmAlgoAead(record.aead, &aead);
+    len = iov[AEAD].iov_len = fillNlAttrXfrmAlgoAead(record.aead, &t->aead);
     iov[AEAD_PAD].iov_len = NLA_ALIGN(len) - len;
 
-    len = iov[MARK].iov_len = fillNlAttrXfrmMark(record, &xfrmmark);
+    len = iov[MARK].iov_len = fillNlAttrXfrmMark(record, &t->xfrmmark);
     iov[MARK_PAD].iov_len = NLA_ALIGN(len) - len;
 
-    len = iov[OUTPUT_MARK].iov_len = fillNlAttrXfrmOutputMark(record, &xfrmoutputmark);
+    len = iov[OUTPUT_MARK].iov_len = fillNlAttrXfrmOutputMark(record, &t->xfrmoutputmark);
     iov[OUTPUT_MARK_PAD].iov_len = NLA_ALIGN(len) - len;
 
-    len = iov[ENCAP].iov_len = fillNlAttrXfrmEncapTmpl(record, &encap);
+    len = iov[ENCAP].iov_len = fillNlAttrXfrmEncapTmpl(record, &t->encap);
     iov[ENCAP_PAD].iov_len = NLA_ALIGN(len) - len;
 
-    len = iov[INTF_ID].iov_len = fillNlAttrXfrmIntfId(record.xfrm_if_id, &xfrm_if_id);
+    len = iov[INTF_ID].iov_len = fillNlAttrXfrmIntfId(record.xfrm_if_id, &t->xfrm_if_id);
     iov[INTF_ID_PAD].iov_len = NLA_ALIGN(len) - len;
 
-    return sock.sendMessage(XFRM_MSG_UPDSA, NETLINK_REQUEST_FLAGS, 0, &iov);
+    *msg = {XFRM_MSG_UPDSA, &iov};
+    return netdutils::status::ok;
 }
 
 int XfrmController::fillNlAttrXfrmAlgoEnc(const XfrmAlgo& inAlgo, nlattr_algo_crypt* algo) {
@@ -1099,12 +1500,11 @@ int XfrmController::fillNlAttrXfrmEncapTmpl(const XfrmSaInfo& record, nlattr_enc
         return 0;
     }
 
-    int len = NLA_HDRLEN + sizeof(xfrm_encap_tmpl);
+    static_assert(sizeof(*tmpl) == NLA_HDRLEN + sizeof(xfrm_encap_tmpl));
     tmpl->tmpl.encap_type = static_cast<uint16_t>(record.encap.type);
     tmpl->tmpl.encap_sport = htons(record.encap.srcPort);
     tmpl->tmpl.encap_dport = htons(record.encap.dstPort);
-    fillXfrmNlaHdr(&tmpl->hdr, XFRMA_ENCAP, len);
-    return len;
+    return fillFixedNlAttrHdr<XFRMA_ENCAP>(tmpl);
 }
 
 int XfrmController::fillUserSaInfo(const XfrmSaInfo& record, xfrm_usersa_info* usersa) {
@@ -1152,7 +1552,16 @@ netdutils::Status XfrmController::deleteSecurityAssociation(const XfrmCommonInfo
 
     enum { NLMSG_HDR, USERSAID, USERSAID_PAD, MARK, MARK_PAD, INTF_ID, INTF_ID_PAD };
 
-    std::vector<iovec> iov = {
+    // The SA is going away; drop its cached message template.
+    {
+        std::lock_guard guard(gSaTemplateLock);
+        gSaTemplates.erase(record.transformId);
+    }
+
+    // Per-thread scratch reused across calls, so one-shot operations don't pay a heap
+    // allocation per message; assign() keeps the capacity.
+    static thread_local std::vector<iovec> iov;
+    iov.assign({
             {nullptr, 0},      // reserved for the eventual addition of a NLMSG_HDR
             {&said, 0},        // main usersa_info struct
             {kPadBytes, 0},    // up to NLMSG_ALIGNTO pad bytes of padding
@@ -1160,7 +1569,7 @@ netdutils::Status XfrmController::deleteSecurityAssociation(const XfrmCommonInfo
             {kPadBytes, 0},    // up to NLATTR_ALIGNTO pad bytes
             {&xfrm_if_id, 0},  // adjust size if interface ID is present
             {kPadBytes, 0},    // up to NLATTR_ALIGNTO pad bytes
-    };
+    });
 
     int len;
     len = iov[USERSAID].iov_len = fillUserSaId(record, &said);
@@ -1182,13 +1591,14 @@ netdutils::Status XfrmController::migrate(const XfrmMigrateInfo& record, const X
     __kernel_size_t lenPolicyId = fillUserPolicyId(record, &xfrm_policyid);
     __kernel_size_t lenXfrmMigrate = fillNlAttrXfrmMigrate(record, &xfrm_migrate);
 
-    std::vector<iovec> iov = {
+    static thread_local std::vector<iovec> iov;
+    iov.assign({
             {nullptr, 0},  // reserved for the eventual addition of a NLMSG_HDR
             {&xfrm_policyid, lenPolicyId},
             {kPadBytes, NLMSG_ALIGN(lenPolicyId) - lenPolicyId},
             {&xfrm_migrate, lenXfrmMigrate},
             {kPadBytes, NLMSG_ALIGN(lenXfrmMigrate) - lenXfrmMigrate},
-    };
+    });
 
     return sock.sendMessage(XFRM_MSG_MIGRATE, NETLINK_REQUEST_FLAGS, 0, &iov);
 }
@@ -1200,11 +1610,12 @@ netdutils::Status XfrmController::allocateSpi(const XfrmSaInfo& record, uint32_t
 
     enum { NLMSG_HDR, USERSAID, USERSAID_PAD };
 
-    std::vector<iovec> iov = {
-        {nullptr, 0},      // reserved for the eventual addition of a NLMSG_HDR
+    static thread_local std::vector<iovec> iov;
+    iov.assign({
+        {nullptr, 0},   // reserved for the eventual addition of a NLMSG_HDR
         {&spiInfo, 0},  // main userspi_info struct
         {kPadBytes, 0}, // up to NLMSG_ALIGNTO pad bytes of padding
-    };
+    });
 
     int len;
     if (fillUserSaInfo(record, &spiInfo.info) == 0) {
@@ -1244,11 +1655,16 @@ netdutils::Status XfrmController::allocateSpi(const XfrmSaInfo& record, uint32_t
 netdutils::Status XfrmController::updateTunnelModeSecurityPolicy(const XfrmSpInfo& record,
                                                                  const XfrmSocket& sock,
                                                                  uint16_t msgType) {
-    xfrm_userpolicy_info userpolicy{};
-    nlattr_user_tmpl usertmpl{};
-    nlattr_xfrm_mark xfrmmark{};
-    nlattr_xfrm_interface_id xfrm_if_id{};
+    // As with updateSecurityAssociation(), serialize into the cached per-transform template so
+    // that policy updates during rekeys reuse the attribute buffers built on the first send.
+    std::lock_guard guard(gSpTemplateLock);
+    XfrmMessage msg;
+    RETURN_IF_NOT_OK(buildUpdatePolicyMessage(record, msgType, &msg));
+    return sock.sendMessage(msg.nlMsgType, NETLINK_REQUEST_FLAGS, 0, msg.iovecs);
+}
 
+netdutils::Status XfrmController::buildUpdatePolicyMessage(const XfrmSpInfo& record,
+                                                           uint16_t msgType, XfrmMessage* msg) {
     enum {
         NLMSG_HDR,
         USERPOLICY,
@@ -1261,32 +1677,41 @@ netdutils::Status XfrmController::updateTunnelModeSecurityPolicy(const XfrmSpInf
         INTF_ID_PAD,
     };
 
-    std::vector<iovec> iov = {
-            {nullptr, 0},      // reserved for the eventual addition of a NLMSG_HDR
-            {&userpolicy, 0},  // main xfrm_userpolicy_info struct
-            {kPadBytes, 0},    // up to NLMSG_ALIGNTO pad bytes of padding
-            {&usertmpl, 0},    // adjust size if xfrm_user_tmpl struct is present
-            {kPadBytes, 0},    // up to NLATTR_ALIGNTO pad bytes
-            {&xfrmmark, 0},    // adjust size if xfrm mark is present
-            {kPadBytes, 0},    // up to NLATTR_ALIGNTO pad bytes
-            {&xfrm_if_id, 0},  // adjust size if interface ID is present
-            {kPadBytes, 0},    // up to NLATTR_ALIGNTO pad bytes
-    };
+    std::unique_ptr<SpMessageTemplate>& entry =
+            gSpTemplates[{record.transformId, static_cast<int32_t>(record.direction),
+                          record.selAddrFamily}];
+    if (entry == nullptr) {
+        entry = std::make_unique<SpMessageTemplate>();
+        entry->iov = {
+                {nullptr, 0},              // reserved for the eventual addition of a NLMSG_HDR
+                {&entry->userpolicy, 0},   // main xfrm_userpolicy_info struct
+                {kPadBytes, 0},            // up to NLMSG_ALIGNTO pad bytes of padding
+                {&entry->usertmpl, 0},     // adjust size if xfrm_user_tmpl struct is present
+                {kPadBytes, 0},            // up to NLATTR_ALIGNTO pad bytes
+                {&entry->xfrmmark, 0},     // adjust size if xfrm mark is present
+                {kPadBytes, 0},            // up to NLATTR_ALIGNTO pad bytes
+                {&entry->xfrm_if_id, 0},   // adjust size if interface ID is present
+                {kPadBytes, 0},            // up to NLATTR_ALIGNTO pad bytes
+        };
+    }
+    SpMessageTemplate* t = entry.get();
+    std::vector<iovec>& iov = t->iov;
 
     int len;
-    len = iov[USERPOLICY].iov_len = fillUserSpInfo(record, &userpolicy);
+    len = iov[USERPOLICY].iov_len = fillUserSpInfo(record, &t->userpolicy);
     iov[USERPOLICY_PAD].iov_len = NLMSG_ALIGN(len) - len;
 
-    len = iov[USERTMPL].iov_len = fillNlAttrUserTemplate(record, &usertmpl);
+    len = iov[USERTMPL].iov_len = fillNlAttrUserTemplate(record, &t->usertmpl);
     iov[USERTMPL_PAD].iov_len = NLA_ALIGN(len) - len;
 
-    len = iov[MARK].iov_len = fillNlAttrXfrmMark(record, &xfrmmark);
+    len = iov[MARK].iov_len = fillNlAttrXfrmMark(record, &t->xfrmmark);
     iov[MARK_PAD].iov_len = NLA_ALIGN(len) - len;
 
-    len = iov[INTF_ID].iov_len = fillNlAttrXfrmIntfId(record.xfrm_if_id, &xfrm_if_id);
+    len = iov[INTF_ID].iov_len = fillNlAttrXfrmIntfId(record.xfrm_if_id, &t->xfrm_if_id);
     iov[INTF_ID_PAD].iov_len = NLA_ALIGN(len) - len;
 
-    return sock.sendMessage(msgType, NETLINK_REQUEST_FLAGS, 0, &iov);
+    *msg = {msgType, &iov};
+    return netdutils::status::ok;
 }
 
 netdutils::Status XfrmController::deleteTunnelModeSecurityPolicy(const XfrmSpInfo& record,
@@ -1305,7 +1730,15 @@ netdutils::Status XfrmController::deleteTunnelModeSecurityPolicy(const XfrmSpInf
         INTF_ID_PAD,
     };
 
-    std::vector<iovec> iov = {
+    // The policy is going away; drop its cached message template.
+    {
+        std::lock_guard guard(gSpTemplateLock);
+        gSpTemplates.erase({record.transformId, static_cast<int32_t>(record.direction),
+                            record.selAddrFamily});
+    }
+
+    static thread_local std::vector<iovec> iov;
+    iov.assign({
             {nullptr, 0},      // reserved for the eventual addition of a NLMSG_HDR
             {&policyid, 0},    // main xfrm_userpolicy_id struct
             {kPadBytes, 0},    // up to NLMSG_ALIGNTO pad bytes of padding
@@ -1313,7 +1746,7 @@ netdutils::Status XfrmController::deleteTunnelModeSecurityPolicy(const XfrmSpInf
             {kPadBytes, 0},    // up to NLATTR_ALIGNTO pad bytes
             {&xfrm_if_id, 0},  // adjust size if interface ID is present
             {kPadBytes, 0},    // up to NLATTR_ALIGNTO pad bytes
-    };
+    });
 
     int len = iov[USERPOLICYID].iov_len = fillUserPolicyId(record, &policyid);
     iov[USERPOLICYID_PAD].iov_len = NLMSG_ALIGN(len) - len;
@@ -1362,9 +1795,8 @@ void XfrmController::fillUserTemplate(const XfrmSpInfo& record, xfrm_user_tmpl*
 int XfrmController::fillNlAttrUserTemplate(const XfrmSpInfo& record, nlattr_user_tmpl* tmpl) {
     fillUserTemplate(record, &tmpl->tmpl);
 
-    int len = NLA_HDRLEN + sizeof(xfrm_user_tmpl);
-    fillXfrmNlaHdr(&tmpl->hdr, XFRMA_TMPL, len);
-    return len;
+    static_assert(sizeof(*tmpl) == NLA_HDRLEN + sizeof(xfrm_user_tmpl));
+    return fillFixedNlAttrHdr<XFRMA_TMPL>(tmpl);
 }
 
 int XfrmController::fillNlAttrXfrmMark(const XfrmCommonInfo& record, nlattr_xfrm_mark* mark) {
@@ -1375,9 +1807,8 @@ int XfrmController::fillNlAttrXfrmMark(const XfrmCommonInfo& record, nlattr_xfrm
 
     mark->mark.v = record.mark.v; // set to 0 if it's not used
     mark->mark.m = record.mark.m; // set to 0 if it's not used
-    int len = NLA_HDRLEN + sizeof(xfrm_mark);
-    fillXfrmNlaHdr(&mark->hdr, XFRMA_MARK, len);
-    return len;
+    static_assert(sizeof(*mark) == NLA_HDRLEN + sizeof(xfrm_mark));
+    return fillFixedNlAttrHdr<XFRMA_MARK>(mark);
 }
 
 // This function sets the output mark (or set-mark in newer kernels) to that of the underlying
@@ -1408,9 +1839,8 @@ int XfrmController::fillNlAttrXfrmOutputMark(const XfrmSaInfo& record,
 
     output_mark->outputMark = fwmark.intValue;
 
-    int len = NLA_HDRLEN + sizeof(__u32);
-    fillXfrmNlaHdr(&output_mark->hdr, XFRMA_OUTPUT_MARK, len);
-    return len;
+    static_assert(sizeof(*output_mark) == NLA_HDRLEN + sizeof(__u32));
+    return fillFixedNlAttrHdr<XFRMA_OUTPUT_MARK>(output_mark);
 }
 
 int XfrmController::fillNlAttrXfrmIntfId(const uint32_t intfIdValue,
@@ -1421,9 +1851,8 @@ int XfrmController::fillNlAttrXfrmIntfId(const uint32_t intfIdValue,
     }
 
     intf_id->if_id = intfIdValue;
-    int len = NLA_HDRLEN + sizeof(__u32);
-    fillXfrmNlaHdr(&intf_id->hdr, XFRMA_IF_ID, len);
-    return len;
+    static_assert(sizeof(*intf_id) == NLA_HDRLEN + sizeof(__u32));
+    return fillFixedNlAttrHdr<XFRMA_IF_ID>(intf_id);
 }
 
 int XfrmController::fillNlAttrXfrmMigrate(const XfrmMigrateInfo& record,
@@ -1438,10 +1867,8 @@ int XfrmController::fillNlAttrXfrmMigrate(const XfrmMigrateInfo& record,
     migrate->migrate.old_family = record.addrFamily;
     migrate->migrate.new_family = record.newEndpointInfo.addrFamily;
 
-    int len = NLA_HDRLEN + sizeof(xfrm_user_migrate);
-    fillXfrmNlaHdr(&migrate->hdr, XFRMA_MIGRATE, len);
-
-    return len;
+    static_assert(sizeof(*migrate) == NLA_HDRLEN + sizeof(xfrm_user_migrate));
+    return fillFixedNlAttrHdr<XFRMA_MIGRATE>(migrate);
 }
 
 int XfrmController::fillUserPolicyId(const XfrmSpInfo& record, xfrm_userpolicy_id* usersp) {
@@ -1483,6 +1910,17 @@ netdutils::Status XfrmController::ipSecAddXfrmInterface(const std::string& devic
         return netdutils::statusFromErrno(EINVAL, "XFRM Interface deviceName empty");
     }
 
+    if (!(flags & NLM_F_EXCL)) {
+        // Update of a link this controller created: if the cached if_id already matches, the
+        // RTM_NEWLINK would be a no-op, so skip the round-trip. Creations (NLM_F_EXCL) are
+        // always sent so that EEXIST surfaces the way it always has.
+        std::lock_guard guard(gTunnelInterfaceLock);
+        auto iter = gTunnelInterfaces.find(deviceName);
+        if (iter != gTunnelInterfaces.end() && iter->second == interfaceId) {
+            return netdutils::status::ok;
+        }
+    }
+
     ifinfomsg ifInfoMsg{};
 
     struct XfrmIntfCreateReq {
@@ -1561,6 +1999,10 @@ netdutils::Status XfrmController::ipSecAddXfrmInterface(const std::string& devic
 
     // sendNetlinkRequest returns -errno
     int ret = -sendNetlinkRequest(RTM_NEWLINK, flags, iov, ARRAY_SIZE(iov), nullptr);
+    if (ret == 0) {
+        std::lock_guard guard(gTunnelInterfaceLock);
+        gTunnelInterfaces[deviceName] = interfaceId;
+    }
     return netdutils::statusFromErrno(ret, "Add/update xfrm interface");
 }
 
@@ -1697,6 +2139,14 @@ netdutils::Status XfrmController::ipSecRemoveTunnelInterface(const std::string&
         return netdutils::statusFromErrno(EINVAL, "Required parameter not provided");
     }
 
+    {
+        // Drop the cache entry regardless of the outcome below: after a failed delete the link's
+        // state is unknown, and a stale entry would make a later update skip its recreation,
+        // while an unnecessary miss only costs one netlink round-trip.
+        std::lock_guard guard(gTunnelInterfaceLock);
+        gTunnelInterfaces.erase(deviceName);
+    }
+
     uint8_t PADDING_BUFFER[] = {0, 0, 0, 0};
 
     ifinfomsg ifInfoMsg{};
@@ -1723,12 +2173,21 @@ netdutils::Status XfrmController::ipSecRemoveTunnelInterface(const std::string&
     return netdutils::statusFromErrno(ret, "Error in deleting IpSec interface " + deviceName);
 }
 
+void XfrmController::onInterfaceRemoved(const std::string& deviceName) {
+    std::lock_guard guard(gTunnelInterfaceLock);
+    gTunnelInterfaces.erase(deviceName);
+}
+
 void XfrmController::dump(DumpWriter& dw) {
     ScopedIndent indentForXfrmController(dw);
     dw.println("XfrmController");
 
     ScopedIndent indentForXfrmISupport(dw);
     dw.println("XFRM-I support: %d", mIsXfrmIntfSupported);
+    {
+        std::lock_guard guard(gTunnelInterfaceLock);
+        dw.println("Cached tunnel interfaces: %zu", gTunnelInterfaces.size());
+    }
 }
 
 } // namespace net
@@ -50,9 +50,15 @@ extern const uint32_t ALGO_MASK_AEAD_ALL;
 extern const uint8_t REPLAY_WINDOW_SIZE;
 
 // Suggest we avoid the smallest and largest ints
-class XfrmMessage;
 class TransportModeSecurityAssociation;
 
+// One fully serialized XFRM request: the message type plus the iovec table holding its payload.
+// iovecs[0] is reserved for the netlink header, which the socket fills in when sending.
+struct XfrmMessage {
+    uint16_t nlMsgType;
+    std::vector<iovec>* iovecs;
+};
+
 class XfrmSocket {
 public:
     // called from destructor and thus cannot be virtual
@@ -73,8 +79,13 @@ public:
                                           uint16_t nlMsgSeqNum,
                                           std::vector<iovec>* iovecs) const = 0;
 
+    // Sends every message in the batch and collects one kernel ack per message. The base
+    // implementation falls back to one sendMessage() call per entry; XfrmSocketImpl overrides
+    // it with a single vectored write.
+    virtual netdutils::Status sendBatch(const std::vector<XfrmMessage>& messages) const;
+
 protected:
-    int mSock;
+    int mSock = -1;
 };
 
 enum struct XfrmDirection : uint8_t {
@@ -234,6 +245,41 @@ public:
                                                             int32_t markMask,
                                                             int32_t xfrmInterfaceId);
 
+    // Arguments for one direction of ipSecCreateTunnel(). Mirrors the parameter list of
+    // ipSecAddSecurityAssociation() (mode is implicitly TUNNEL), plus the inner selector
+    // address families to install tunnel-mode policies for.
+    struct TunnelSaParams {
+        int32_t transformId;
+        std::string sourceAddress;
+        std::string destinationAddress;
+        int32_t underlyingNetId;
+        int32_t spi;
+        int32_t markValue;
+        int32_t markMask;
+        std::string authAlgo;
+        std::vector<uint8_t> authKey;
+        int32_t authTruncBits;
+        std::string cryptAlgo;
+        std::vector<uint8_t> cryptKey;
+        int32_t cryptTruncBits;
+        std::string aeadAlgo;
+        std::vector<uint8_t> aeadKey;
+        int32_t aeadIcvBits;
+        int32_t encapType;
+        int32_t encapLocalPort;
+        int32_t encapRemotePort;
+        int32_t xfrmInterfaceId;
+        std::vector<int32_t> selAddrFamilies;  // AF_INET and/or AF_INET6
+    };
+
+    // Single-transaction tunnel bring-up: validates both SAs and all tunnel-mode policies up
+    // front, then emits every XFRM message over one socket in one batched send, so the kernel
+    // either sees the whole tunnel or (on validation failure) none of it. The inbound direction
+    // installs XFRM_POLICY_IN policies and the outbound direction XFRM_POLICY_OUT ones; forward
+    // policies and tunnel interface changes remain separate calls.
+    static netdutils::Status ipSecCreateTunnel(const TunnelSaParams& inbound,
+                                               const TunnelSaParams& outbound);
+
     static netdutils::Status ipSecApplyTransportModeTransform(int socketFd, int32_t transformId,
                                                               int32_t direction,
                                                               const std::string& localAddress,
@@ -268,6 +314,11 @@ public:
 
     static netdutils::Status ipSecRemoveTunnelInterface(const std::string& deviceName);
 
+    // Invoked from the netlink handler on every RTM_DELLINK, so that a tunnel interface deleted
+    // behind netd's back is dropped from the name cache and recreated by the next add/update
+    // instead of being skipped as already present.
+    static void onInterfaceRemoved(const std::string& deviceName);
+
     // Only available for Tunnel must already have a matching tunnel SA and policy
     static netdutils::Status ipSecMigrate(int32_t transformId, int32_t selAddrFamily,
                                           int32_t direction, const std::string& oldSourceAddress,
@@ -390,6 +441,14 @@ public:
     // Functions for updating a Transport Mode SA
     static netdutils::Status updateSecurityAssociation(const XfrmSaInfo& record,
                                                        const XfrmSocket& sock);
+    // Validates |params| and fills |saInfo| the same way ipSecAddSecurityAssociation() does,
+    // without touching the kernel.
+    static netdutils::Status fillSaInfo(const TunnelSaParams& params, XfrmMode mode,
+                                        XfrmSaInfo* saInfo);
+    // Serializes an XFRM_MSG_UPDSA request for |record| into its cached message template and
+    // points |msg| at the template's iovec table. The caller must hold the SA template cache
+    // lock (see XfrmController.cpp) until the message has been sent.
+    static netdutils::Status buildUpdateSaMessage(const XfrmSaInfo& record, XfrmMessage* msg);
     static int fillUserSaInfo(const XfrmSaInfo& record, xfrm_usersa_info* usersa);
 
     // Functions for deleting a Transport Mode SA
@@ -420,6 +479,10 @@ public:
     static netdutils::Status updateTunnelModeSecurityPolicy(const XfrmSpInfo& record,
                                                             const XfrmSocket& sock,
                                                             uint16_t msgType);
+    // Policy counterpart of buildUpdateSaMessage(); the caller must hold the policy template
+    // cache lock until the message has been sent.
+    static netdutils::Status buildUpdatePolicyMessage(const XfrmSpInfo& record, uint16_t msgType,
+                                                      XfrmMessage* msg);
     static netdutils::Status deleteTunnelModeSecurityPolicy(const XfrmSpInfo& record,
                                                             const XfrmSocket& sock);
     static netdutils::Status migrate(const XfrmMigrateInfo& record, const XfrmSocket& sock);
@@ -707,6 +707,95 @@ TEST_P(XfrmControllerParameterizedTest, TestIpSecAddSecurityPolicy) {
     }
 }
 
+TEST_F(XfrmControllerTest, TestIpSecCreateTunnelDualStackBatch) {
+    std::vector<uint8_t> authKey(KEY_LENGTH, 0);
+    std::vector<uint8_t> cryptKey(KEY_LENGTH, 1);
+
+    auto makeSaParams = [&](int32_t transformId, const std::string& src, const std::string& dst,
+                            int32_t spi) {
+        XfrmController::TunnelSaParams params{};
+        params.transformId = transformId;
+        params.sourceAddress = src;
+        params.destinationAddress = dst;
+        params.underlyingNetId = TEST_XFRM_UNDERLYING_NET;
+        params.spi = spi;
+        params.authAlgo = "hmac(sha256)";
+        params.authKey = authKey;
+        params.authTruncBits = 128;
+        params.cryptAlgo = "cbc(aes)";
+        params.cryptKey = cryptKey;
+        params.encapType = static_cast<int32_t>(XfrmEncapType::NONE);
+        params.xfrmInterfaceId = TEST_XFRM_IF_ID;
+        params.selAddrFamilies = {AF_INET, AF_INET6};
+        return params;
+    };
+    XfrmController::TunnelSaParams inbound =
+            makeSaParams(1 /* transformId */, TEST_ADDR_V4, LOCALHOST_V4, DROID_SPI);
+    XfrmController::TunnelSaParams outbound =
+            makeSaParams(2 /* transformId */, LOCALHOST_V4, TEST_ADDR_V4, DROID_SPI + 1);
+
+    // The kernel acks each message of the batch; pack one bare ack header per message.
+    constexpr size_t kExpectedMessages = 6;  // 2 SAs + one policy per (direction, family).
+    NetlinkResponse response{};
+    for (size_t i = 0; i < kExpectedMessages; i++) {
+        nlmsghdr ack = {.nlmsg_len = NLMSG_HDRLEN, .nlmsg_type = XFRM_MSG_UPDSA};
+        memcpy(reinterpret_cast<uint8_t*>(&response) + i * NLMSG_HDRLEN, &ack, sizeof(ack));
+    }
+    Slice responseSlice = netdutils::makeSlice(response);
+
+    // The batched send is a single writev; flatten it and echo back its total length.
+    std::vector<uint8_t> nlMsgBuf;
+    EXPECT_CALL(mockSyscalls, writev(_, _))
+        .WillOnce(Invoke([&nlMsgBuf](Fd, const std::vector<iovec>& iovs) {
+            for (const iovec& iov : iovs) {
+                nlMsgBuf.insert(nlMsgBuf.end(), reinterpret_cast<uint8_t*>(iov.iov_base),
+                                reinterpret_cast<uint8_t*>(iov.iov_base) + iov.iov_len);
+            }
+            return netdutils::StatusOr<size_t>(nlMsgBuf.size());
+        }));
+    EXPECT_CALL(mockSyscalls, read(_, _))
+        .WillOnce(DoAll(SetArgSlice<1>(responseSlice), Return(responseSlice)));
+
+    XfrmController ctrl(true /* xfrmIntfSupport */);
+    Status res = ctrl.ipSecCreateTunnel(inbound, outbound);
+    EXPECT_TRUE(isOk(res)) << res;
+
+    // Walk the batch: it must carry both UPDSA messages and a distinct UPDPOLICY per
+    // (direction, selector family) - a shared policy buffer would surface here as a duplicate.
+    size_t updsaCount = 0;
+    std::set<std::pair<int, int>> policySelectors;
+    size_t offset = 0;
+    while (offset + NLMSG_HDRLEN <= nlMsgBuf.size()) {
+        nlmsghdr hdr;
+        memcpy(&hdr, nlMsgBuf.data() + offset, sizeof(hdr));
+        ASSERT_GE(hdr.nlmsg_len, static_cast<uint32_t>(NLMSG_HDRLEN));
+        ASSERT_LE(offset + hdr.nlmsg_len, nlMsgBuf.size());
+        if (hdr.nlmsg_type == XFRM_MSG_UPDSA) {
+            updsaCount++;
+        } else {
+            ASSERT_EQ(XFRM_MSG_UPDPOLICY, hdr.nlmsg_type);
+            xfrm_userpolicy_info userpolicy;
+            ASSERT_GE(hdr.nlmsg_len, NLMSG_HDRLEN + sizeof(userpolicy));
+            memcpy(&userpolicy, nlMsgBuf.data() + offset + NLMSG_HDRLEN, sizeof(userpolicy));
+            EXPECT_TRUE(policySelectors
+                            .insert({static_cast<int>(userpolicy.dir),
+                                     static_cast<int>(userpolicy.sel.family)})
+                            .second)
+                << "duplicate policy for direction " << static_cast<int>(userpolicy.dir)
+                << " family " << static_cast<int>(userpolicy.sel.family);
+        }
+        offset += NLMSG_ALIGN(hdr.nlmsg_len);
+    }
+    EXPECT_EQ(2U, updsaCount);
+    const std::set<std::pair<int, int>> expectedSelectors = {
+            {static_cast<int>(XfrmDirection::IN), AF_INET},
+            {static_cast<int>(XfrmDirection::IN), AF_INET6},
+            {static_cast<int>(XfrmDirection::OUT), AF_INET},
+            {static_cast<int>(XfrmDirection::OUT), AF_INET6},
+    };
+    EXPECT_EQ(expectedSelectors, policySelectors);
+}
+
 TEST_P(XfrmControllerParameterizedTest, TestIpSecUpdateSecurityPolicy) {
     testCaseParams params = GetParam();
     const int version = params.version;
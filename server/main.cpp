@@ -45,7 +45,9 @@
 #include "NetdConstants.h"
 #include "NetdHwService.h"
 #include "NetdNativeService.h"
+#include "NetlinkHandler.h"
 #include "NetlinkManager.h"
+#include "OemNetdListener.h"
 #include "Process.h"
 
 #include "NetdUpdatablePublic.h"
@@ -114,7 +116,7 @@ int main() {
 
     android::net::process::removePidFile(PID_FILE_PATH);
     gLog.info("Pid file removed");
-    android::net::process::blockSigPipe();
+    android::net::blockSigpipe();
     gLog.info("SIGPIPE is blocked");
 
     // Before we do anything that could fork, mark CLOEXEC the UNIX sockets that we get from init.
@@ -148,6 +150,12 @@ int main() {
     gCtls = new android::net::Controllers();
     gCtls->init();
 
+    // When a netlink event socket overflows, tell unsolicited-event listeners which stream
+    // dropped messages so they resync just that state instead of everything.
+    nm->setOverflowHandler([](int netlinkFamily) {
+        com::android::internal::net::OemNetdListener::notifyNetlinkQueueOverflow(netlinkFamily);
+    });
+
     if (nm->start()) {
         ALOGE("Unable to start NetlinkManager (%s)", strerror(errno));
         exit(1);
@@ -166,6 +174,14 @@ int main() {
             gLog.error("Unable to init WakeupController: %s", toString(result).c_str());
             // We can still continue without wakeup packet logging.
         }
+        // Strict cleartext notifications share the same NFLOG socket; see
+        // NetlinkHandler::subscribeStrictCleartext.
+        status = android::net::NetlinkHandler::subscribeStrictCleartext(logListener.get());
+        if (!isOk(status)) {
+            gLog.error("Unable to subscribe strict cleartext logging: %s",
+                       toString(status).c_str());
+            // Strict-mode penalties still apply; only the detection callbacks are lost.
+        }
     }
 
     // Set local DNS mode, to prevent bionic from proxying
@@ -179,10 +195,17 @@ int main() {
         exit(1);
     }
 
-    FwmarkServer fwmarkServer(&gCtls->netCtrl, &gCtls->eventReporter);
-    if (fwmarkServer.startListener()) {
-        ALOGE("Unable to start FwmarkServer (%s)", strerror(errno));
-        exit(1);
+    // Run a small pool of FwmarkServer workers, all accepting from the listening socket inherited
+    // from init (which rules out SO_REUSEPORT), each with its own select loop. The listening
+    // socket must be non-blocking so that a worker losing the race for a new connection doesn't
+    // stall in accept(2). The instances are never destroyed; netd runs until it is killed.
+    setNonBlocking(FwmarkServer::SOCKET_NAME);
+    for (int i = 0; i < FwmarkServer::NUM_WORKERS; i++) {
+        auto* fwmarkServer = new FwmarkServer(&gCtls->netCtrl, &gCtls->eventReporter);
+        if (fwmarkServer->startListener()) {
+            ALOGE("Unable to start FwmarkServer (%s)", strerror(errno));
+            exit(1);
+        }
     }
 
     Stopwatch subTime;
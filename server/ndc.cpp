@@ -16,6 +16,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "NdcDispatcher.h"
 
@@ -23,9 +24,37 @@ namespace {
 
 void usage(char* progname) {
     fprintf(stderr, "Usage: %s (<cmd> [arg ...])\n", progname);
+    fprintf(stderr, "       %s -\n", progname);
+    fprintf(stderr, "With '-', newline-separated commands are read from stdin and dispatched\n");
+    fprintf(stderr, "in order by a single %s instance; responses appear on stdout in the same\n",
+            progname);
+    fprintf(stderr, "order. Blank lines and lines starting with '#' are ignored.\n");
     exit(1);
 }
 
+// Batch mode for scripted flows (factory provisioning, tests): one process launch and one
+// binder connection serve the whole script, instead of paying exec + service lookup once per
+// command.
+int runBatch(android::net::NdcDispatcher* nd) {
+    char* line = nullptr;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, stdin)) != -1) {
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        }
+        // Skip blank lines and #-comments so provisioning scripts can be fed as-is.
+        char* cmd = line;
+        while (*cmd == ' ' || *cmd == '\t') cmd++;
+        if (*cmd == '\0' || *cmd == '#') {
+            continue;
+        }
+        nd->dispatchCommand(cmd);
+    }
+    free(line);
+    return 0;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -34,5 +63,13 @@ int main(int argc, char** argv) {
     }
 
     android::net::NdcDispatcher nd;
+    if (argc == 2 && strcmp(argv[1], "-") == 0) {
+        exit(runBatch(&nd));
+    }
+    if (argc == 2) {
+        // A single argument may be a whole quoted command line, e.g. ndc "interface list";
+        // tokenize it in place. Single-word commands tokenize to themselves.
+        exit(nd.dispatchCommand(argv[1]));
+    }
     exit(nd.dispatchCommand(argc - 1, argv + 1));
 }
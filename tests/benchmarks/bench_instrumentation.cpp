@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bench_instrumentation.h"
+
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+
+#include <android-base/file.h>
+
+namespace {
+
+// Updated by the replacement operator new below. Relaxed: the reader only ever wants a
+// consistent-enough snapshot around a single-threaded benchmark loop.
+std::atomic<uint64_t> gAllocs{0};
+std::atomic<uint64_t> gAllocBytes{0};
+
+void countAlloc(size_t size) {
+    gAllocs.fetch_add(1, std::memory_order_relaxed);
+    gAllocBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+uint64_t contextSwitches() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return static_cast<uint64_t>(usage.ru_nvcsw) + static_cast<uint64_t>(usage.ru_nivcsw);
+}
+
+// Opens a counting perf event on the raw_syscalls:sys_enter tracepoint for this process on all
+// CPUs. Returns -1 if tracefs or perf_event_open are unavailable (not root, or lockdown).
+int openSyscallCounter() {
+    std::string id;
+    if (!android::base::ReadFileToString(
+                "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id", &id) &&
+        !android::base::ReadFileToString(
+                "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id", &id)) {
+        return -1;
+    }
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = strtoull(id.c_str(), nullptr, 10);
+    attr.inherit = 1;  // Count benchmark worker threads too.
+
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0 /* this process */,
+                                    -1 /* any cpu */, -1 /* no group */, PERF_FLAG_FD_CLOEXEC));
+}
+
+uint64_t readCounter(int fd) {
+    uint64_t value = 0;
+    if (fd >= 0 && read(fd, &value, sizeof(value)) != sizeof(value)) value = 0;
+    return value;
+}
+
+}  // namespace
+
+// Replacement global allocation functions. Sized deletes and array forms forward here via the
+// default definitions, so counting new/new[] is enough to see every C++ heap allocation.
+void* operator new(size_t size) {
+    countAlloc(size);
+    if (void* ptr = malloc(size)) return ptr;
+    abort();
+}
+
+void* operator new[](size_t size) {
+    countAlloc(size);
+    if (void* ptr = malloc(size)) return ptr;
+    abort();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    countAlloc(size);
+    return malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    countAlloc(size);
+    return malloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+ScopedOpCounters::ScopedOpCounters(benchmark::State& state)
+    : mState(state),
+      mStartAllocs(gAllocs.load(std::memory_order_relaxed)),
+      mStartAllocBytes(gAllocBytes.load(std::memory_order_relaxed)),
+      mStartCtxSwitches(contextSwitches()),
+      mSyscallFd(openSyscallCounter()) {}
+
+ScopedOpCounters::~ScopedOpCounters() {
+    using benchmark::Counter;
+
+    mState.counters["allocs/iter"] =
+            Counter(gAllocs.load(std::memory_order_relaxed) - mStartAllocs,
+                    Counter::kAvgIterations);
+    mState.counters["allocB/iter"] =
+            Counter(gAllocBytes.load(std::memory_order_relaxed) - mStartAllocBytes,
+                    Counter::kAvgIterations);
+
+    if (mSyscallFd >= 0) {
+        mState.counters["syscalls/iter"] =
+                Counter(readCounter(mSyscallFd), Counter::kAvgIterations);
+        close(mSyscallFd);
+    } else {
+        mState.counters["ctxsw/iter"] =
+                Counter(contextSwitches() - mStartCtxSwitches, Counter::kAvgIterations);
+    }
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_TESTS_BENCHMARKS_BENCH_INSTRUMENTATION_H
+#define NETD_TESTS_BENCHMARKS_BENCH_INSTRUMENTATION_H
+
+#include <stdint.h>
+
+#include <benchmark/benchmark.h>
+
+/*
+ * Allocation and syscall counting for the benchmarks in this directory. Wall time on a busy
+ * device is too noisy to see an eliminated allocation or syscall; these counters are exact, so
+ * a regression of one malloc per operation is visible even when the timing columns are mud.
+ *
+ * Usage: construct a ScopedOpCounters on |state| after benchmark setup is done and before the
+ * KeepRunning loop. On destruction it reports three per-iteration counters:
+ *
+ *   allocs/iter      C++ heap allocations (counted by replacement operator new, which is linked
+ *                    into the binary by including bench_instrumentation.cpp in srcs)
+ *   allocB/iter      bytes requested by those allocations
+ *   syscalls/iter    syscalls entered by this process, from a raw_syscalls:sys_enter perf
+ *                    tracepoint counter. Requires root; when the counter cannot be opened the
+ *                    fallback is voluntary+involuntary context switches from getrusage(), which
+ *                    still catches added blocking round-trips, and the counter is named
+ *                    ctxsw/iter to make the difference visible.
+ *
+ * Counters cover this process only: for benchmarks that drive the running netd over binder or
+ * the fwmark socket, server-side allocations are invisible and only the client's syscalls are
+ * counted.
+ */
+class ScopedOpCounters {
+  public:
+    explicit ScopedOpCounters(benchmark::State& state);
+    ~ScopedOpCounters();
+
+    ScopedOpCounters(const ScopedOpCounters&) = delete;
+    ScopedOpCounters& operator=(const ScopedOpCounters&) = delete;
+
+  private:
+    benchmark::State& mState;
+    uint64_t mStartAllocs;
+    uint64_t mStartAllocBytes;
+    uint64_t mStartCtxSwitches;
+    int mSyscallFd;
+};
+
+#endif  // NETD_TESTS_BENCHMARKS_BENCH_INSTRUMENTATION_H
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "fwmark_benchmark"
+
+/*
+ * Measures the fwmarkd round-trip that libnetd_client adds to socket operations. Every accept()
+ * and connect() in every process pays one of these, so the single-threaded FwmarkServer is a
+ * potential system-wide bottleneck.
+ *
+ * The benchmark drives FwmarkCommand::ON_ACCEPT and ON_CONNECT through FwmarkClient (reusing its
+ * per-thread cached connection, exactly like a real client in steady state) at increasing thread
+ * counts, so contention on the server shows up as rising latency. Besides the mean, the label
+ * records p50/p90/p99 in microseconds, because the interesting failure mode is tail latency when
+ * many clients queue behind the server's accept loop.
+ *
+ * Requires a running netd to serve the fwmarkd socket.
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <netdutils/Stopwatch.h>
+
+#include "FwmarkClient.h"
+#include "FwmarkCommand.h"
+#include "bench_instrumentation.h"
+
+using android::base::StringPrintf;
+using android::netdutils::Stopwatch;
+
+static void fwmarkRoundTrip(benchmark::State& state, const FwmarkCommand::CmdId cmdId) {
+    const int sock = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        state.SkipWithError(StringPrintf("socket() failed with errno=%d", errno).c_str());
+        return;
+    }
+
+    FwmarkClient client;
+    std::vector<uint64_t> latencies(state.max_iterations);
+    uint64_t iterations = 0;
+
+    ScopedOpCounters opCounters(state);
+    while (state.KeepRunning()) {
+        FwmarkCommand command = {cmdId, 0, 0, 0};
+
+        const Stopwatch stopwatch;
+        if (int ret = client.send(&command, sock, nullptr)) {
+            state.SkipWithError(
+                    StringPrintf("fwmark send failed with %d (is netd running?)", ret).c_str());
+            break;
+        }
+        latencies[iterations++] = stopwatch.timeTakenUs();
+    }
+    close(sock);
+
+    if (iterations > 0) {
+        latencies.resize(iterations);
+        sort(latencies.begin(), latencies.end());
+        state.SetLabel(StringPrintf("p50:%llu p90:%llu p99:%llu",
+                                    (long long unsigned) latencies[iterations / 2],
+                                    (long long unsigned) latencies[iterations * 9 / 10],
+                                    (long long unsigned) latencies[iterations * 99 / 100]));
+    }
+}
+
+static void fwmark_on_connect(benchmark::State& state) {
+    fwmarkRoundTrip(state, FwmarkCommand::ON_CONNECT);
+}
+BENCHMARK(fwmark_on_connect)->ThreadRange(1, 16);
+
+static void fwmark_on_accept(benchmark::State& state) {
+    fwmarkRoundTrip(state, FwmarkCommand::ON_ACCEPT);
+}
+BENCHMARK(fwmark_on_accept)->ThreadRange(1, 16);
+
+BENCHMARK_MAIN();
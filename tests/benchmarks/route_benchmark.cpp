@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "route_benchmark"
+
+/*
+ * Measures RouteController rule/route programming throughput against a tun interface. These are
+ * the operations that dominate VPN bring-up and network teardown latency:
+ *
+ *  - single route add/remove round-trips and bulk route churn via modifyIpRoute(), which is also
+ *    the path modifyRoute()/addRoute()/removeRoute() bottom out in, and
+ *  - full addInterfaceToPhysicalNetwork()/removeInterfaceFromPhysicalNetwork() cycles, which
+ *    exercise the fwmark rule programming (modifyIpRule) and the route flush on teardown.
+ *
+ * Must run as root: routes and FIB rules require CAP_NET_ADMIN. The interface cycle benchmark
+ * programs real rules for an otherwise unused netId and removes them again each iteration.
+ */
+
+#include <linux/rtnetlink.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+#include "NetlinkCommands.h"
+#include "Permission.h"
+#include "bench_instrumentation.h"
+#include "RouteController.h"
+#include "tun_interface.h"
+
+using android::base::StringPrintf;
+using android::net::modifyIpRoute;
+using android::net::NETLINK_REQUEST_FLAGS;
+using android::net::NETLINK_ROUTE_CREATE_FLAGS;
+using android::net::RouteController;
+using android::net::TunInterface;
+using android::net::UidRangeMap;
+
+namespace {
+
+// Unlikely to collide with netIds handed out by ConnectivityService.
+constexpr unsigned TEST_NETID = 65500;
+
+// The tun interface shared by all benchmarks, created on first use and leaked on exit.
+TunInterface* testInterface() {
+    static TunInterface* sTun = [] {
+        auto* tun = new TunInterface();
+        if (tun->init() != 0) {
+            delete tun;
+            tun = nullptr;
+        }
+        return tun;
+    }();
+    return sTun;
+}
+
+uint32_t routeTable(const TunInterface* tun) {
+    return RouteController::ROUTE_TABLE_OFFSET_FROM_INDEX + tun->ifindex();
+}
+
+}  // namespace
+
+// One route add + remove round-trip, the unit cost of every prefix a network brings up.
+static void benchmarkIpRouteAddRemove(benchmark::State& state) {
+    TunInterface* tun = testInterface();
+    if (tun == nullptr) {
+        state.SkipWithError("Cannot create tun interface (am I root?)");
+        return;
+    }
+    const uint32_t table = routeTable(tun);
+
+    ScopedOpCounters opCounters(state);
+    while (state.KeepRunning()) {
+        if (modifyIpRoute(RTM_NEWROUTE, NETLINK_ROUTE_CREATE_FLAGS, table, tun->name().c_str(),
+                          "2001:db8:cafe::/64", nullptr, 0, 0) != 0 ||
+            modifyIpRoute(RTM_DELROUTE, NETLINK_REQUEST_FLAGS, table, tun->name().c_str(),
+                          "2001:db8:cafe::/64", nullptr, 0, 0) != 0) {
+            state.SkipWithError("modifyIpRoute failed");
+            return;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(benchmarkIpRouteAddRemove);
+
+// Bulk churn: program N distinct routes, then tear them all down, as happens when a network with
+// a large route set connects and disconnects.
+static void benchmarkRouteTableChurn(benchmark::State& state) {
+    TunInterface* tun = testInterface();
+    if (tun == nullptr) {
+        state.SkipWithError("Cannot create tun interface (am I root?)");
+        return;
+    }
+    const uint32_t table = routeTable(tun);
+    const int numRoutes = state.range(0);
+
+    std::vector<std::string> destinations;
+    destinations.reserve(numRoutes);
+    for (int i = 0; i < numRoutes; i++) {
+        destinations.push_back(StringPrintf("2001:db8:%x:%x::/64", i >> 16, i & 0xffff));
+    }
+
+    ScopedOpCounters opCounters(state);
+    while (state.KeepRunning()) {
+        for (const auto& destination : destinations) {
+            if (modifyIpRoute(RTM_NEWROUTE, NETLINK_ROUTE_CREATE_FLAGS, table,
+                              tun->name().c_str(), destination.c_str(), nullptr, 0, 0) != 0) {
+                state.SkipWithError("route add failed");
+                return;
+            }
+        }
+        for (const auto& destination : destinations) {
+            if (modifyIpRoute(RTM_DELROUTE, NETLINK_REQUEST_FLAGS, table, tun->name().c_str(),
+                              destination.c_str(), nullptr, 0, 0) != 0) {
+                state.SkipWithError("route remove failed");
+                return;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * numRoutes * 2);
+}
+BENCHMARK(benchmarkRouteTableChurn)->Arg(10)->Arg(100)->Arg(1000);
+
+// The full interface attach/detach cycle: fwmark rules up, then rules down plus the route flush.
+// This is the RouteController share of a network coming and going.
+static void benchmarkInterfaceNetworkCycle(benchmark::State& state) {
+    TunInterface* tun = testInterface();
+    if (tun == nullptr) {
+        state.SkipWithError("Cannot create tun interface (am I root?)");
+        return;
+    }
+
+    // modifyPhysicalNetwork() also installs an iptables mark rule for incoming packets. Stub the
+    // restore hook out so the benchmark measures the netlink rule/route programming rather than
+    // fighting the live netd over iptables state.
+    RouteController::iptablesRestoreCommandFunction = [](IptablesTarget, const std::string&,
+                                                         const std::string&,
+                                                         std::string*) { return 0; };
+
+    ScopedOpCounters opCounters(state);
+    while (state.KeepRunning()) {
+        if (RouteController::addInterfaceToPhysicalNetwork(TEST_NETID, tun->name().c_str(),
+                                                           PERMISSION_NONE, UidRangeMap{}) != 0) {
+            state.SkipWithError("addInterfaceToPhysicalNetwork failed");
+            return;
+        }
+        if (RouteController::removeInterfaceFromPhysicalNetwork(TEST_NETID, tun->name().c_str(),
+                                                                PERMISSION_NONE,
+                                                                UidRangeMap{}) != 0) {
+            state.SkipWithError("removeInterfaceFromPhysicalNetwork failed");
+            return;
+        }
+    }
+}
+BENCHMARK(benchmarkInterfaceNetworkCycle);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "transition_benchmark"
+
+/*
+ * Measures the full netd half of the two network transitions users feel most: "VPN up" and
+ * "default network switch". Unlike the other benchmarks in this directory, this one drives the
+ * NetdNativeService binder API of the running netd with the same call sequence
+ * ConnectivityService issues, so it captures binder overhead and lock contention inside the
+ * real service, not just the controller cost.
+ *
+ * The VPN benchmark runs networkCreate + networkAddInterface + networkAddRoute +uid ranges +
+ * socketDestroy each iteration and reports per-phase p50 latency in the label; the benchmark's
+ * own timing is the total. The switch benchmark alternates networkSetDefault between two
+ * prepared physical networks.
+ *
+ * Must run as root on a device with netd running: it creates real networks (netIds far above
+ * anything ConnectivityService hands out) on tun interfaces and restores the default network
+ * when done.
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <binder/IServiceManager.h>
+#include <netdutils/Stopwatch.h>
+
+#include "android/net/INetd.h"
+#include "tun_interface.h"
+
+using android::IBinder;
+using android::interface_cast;
+using android::sp;
+using android::String16;
+using android::base::StringAppendF;
+using android::base::StringPrintf;
+using android::net::INetd;
+using android::net::NativeNetworkConfig;
+using android::net::NativeNetworkType;
+using android::net::NativeVpnType;
+using android::net::TunInterface;
+using android::net::UidRangeParcel;
+using android::netdutils::Stopwatch;
+
+namespace {
+
+// Unlikely to collide with netIds handed out by ConnectivityService.
+constexpr int TEST_NETID_VPN = 65490;
+constexpr int TEST_NETID_A = 65491;
+constexpr int TEST_NETID_B = 65492;
+
+// A uid range in a user that cannot have running apps.
+constexpr int TEST_UID_BASE = 99 * 100000;
+
+sp<INetd> netdService() {
+    static sp<INetd> sNetd = [] {
+        sp<IBinder> binder =
+                android::defaultServiceManager()->getService(String16("netd"));
+        return binder != nullptr ? interface_cast<INetd>(binder) : nullptr;
+    }();
+    return sNetd;
+}
+
+// The tun interfaces shared by all benchmarks, created on first use and leaked on exit.
+TunInterface* testInterface(int index) {
+    static TunInterface sTun[2];
+    static bool sInitialized = [] {
+        return sTun[0].init() == 0 && sTun[1].init() == 0;
+    }();
+    return sInitialized ? &sTun[index] : nullptr;
+}
+
+NativeNetworkConfig makeNativeNetworkConfig(int netId, NativeNetworkType networkType,
+                                            bool secure) {
+    NativeNetworkConfig config = {};
+    config.netId = netId;
+    config.networkType = networkType;
+    config.permission = INetd::PERMISSION_NONE;
+    config.secure = secure;
+    config.vpnType = NativeVpnType::PLATFORM;
+    config.excludeLocalRoutes = false;
+    return config;
+}
+
+UidRangeParcel makeUidRangeParcel(int start, int stop) {
+    UidRangeParcel res;
+    res.start = start;
+    res.stop = stop;
+    return res;
+}
+
+uint64_t p50(std::vector<uint64_t>* latencies) {
+    std::sort(latencies->begin(), latencies->end());
+    return (*latencies)[latencies->size() / 2];
+}
+
+}  // namespace
+
+// The netd call sequence of a VPN connecting, phase by phase. socketDestroy runs against the
+// same (appless) uid ranges the network was given, so it measures the two sock_diag dumps and
+// the range filtering without tearing down unrelated sockets.
+static void transitionVpnUp(benchmark::State& state) {
+    sp<INetd> netd = netdService();
+    TunInterface* tun = testInterface(0);
+    if (netd == nullptr || tun == nullptr) {
+        state.SkipWithError("Cannot reach netd or create tun interface (am I root?)");
+        return;
+    }
+
+    const std::vector<UidRangeParcel> uidRanges = {
+            makeUidRangeParcel(TEST_UID_BASE, TEST_UID_BASE + 999)};
+    const auto config = makeNativeNetworkConfig(TEST_NETID_VPN, NativeNetworkType::VIRTUAL,
+                                                /*secure=*/true);
+
+    // create, addInterface, routes, uidRanges, socketDestroy.
+    std::vector<uint64_t> phaseUs[5];
+
+    netd->networkDestroy(TEST_NETID_VPN);  // In case an earlier run left it behind.
+
+    while (state.KeepRunning()) {
+        Stopwatch watch;
+        if (!netd->networkCreate(config).isOk()) {
+            state.SkipWithError("networkCreate failed");
+            return;
+        }
+        phaseUs[0].push_back(watch.getTimeAndResetUs());
+
+        if (!netd->networkAddInterface(TEST_NETID_VPN, tun->name()).isOk()) {
+            state.SkipWithError("networkAddInterface failed");
+            return;
+        }
+        phaseUs[1].push_back(watch.getTimeAndResetUs());
+
+        if (!netd->networkAddRoute(TEST_NETID_VPN, tun->name(), "::/0", "").isOk() ||
+            !netd->networkAddRoute(TEST_NETID_VPN, tun->name(), "0.0.0.0/0", "").isOk()) {
+            state.SkipWithError("networkAddRoute failed");
+            return;
+        }
+        phaseUs[2].push_back(watch.getTimeAndResetUs());
+
+        if (!netd->networkAddUidRanges(TEST_NETID_VPN, uidRanges).isOk()) {
+            state.SkipWithError("networkAddUidRanges failed");
+            return;
+        }
+        phaseUs[3].push_back(watch.getTimeAndResetUs());
+
+        if (!netd->socketDestroy(uidRanges, {}).isOk()) {
+            state.SkipWithError("socketDestroy failed");
+            return;
+        }
+        phaseUs[4].push_back(watch.getTimeAndResetUs());
+
+        state.PauseTiming();
+        netd->networkDestroy(TEST_NETID_VPN);
+        state.ResumeTiming();
+    }
+
+    if (!phaseUs[0].empty()) {
+        std::string label;
+        static constexpr const char* kPhaseNames[5] = {"create", "addif", "routes", "uids",
+                                                       "sockdestroy"};
+        for (int i = 0; i < 5; i++) {
+            StringAppendF(&label, "%s%s_p50:%llu", i == 0 ? "" : " ", kPhaseNames[i],
+                          (long long unsigned) p50(&phaseUs[i]));
+        }
+        state.SetLabel(label);
+        state.SetItemsProcessed(phaseUs[0].size());
+    }
+}
+BENCHMARK(transitionVpnUp);
+
+// networkSetDefault between two connected physical networks: the tail of every Wi-Fi<->cellular
+// handover after the new network validates.
+static void transitionDefaultSwitch(benchmark::State& state) {
+    sp<INetd> netd = netdService();
+    TunInterface* tunA = testInterface(0);
+    TunInterface* tunB = testInterface(1);
+    if (netd == nullptr || tunA == nullptr || tunB == nullptr) {
+        state.SkipWithError("Cannot reach netd or create tun interfaces (am I root?)");
+        return;
+    }
+
+    int storedDefault = -1;
+    netd->networkGetDefault(&storedDefault);
+
+    const struct {
+        int netId;
+        TunInterface* tun;
+    } nets[2] = {{TEST_NETID_A, tunA}, {TEST_NETID_B, tunB}};
+    for (const auto& net : nets) {
+        netd->networkDestroy(net.netId);
+        const auto config =
+                makeNativeNetworkConfig(net.netId, NativeNetworkType::PHYSICAL, /*secure=*/false);
+        if (!netd->networkCreate(config).isOk() ||
+            !netd->networkAddInterface(net.netId, net.tun->name()).isOk() ||
+            !netd->networkAddRoute(net.netId, net.tun->name(), "::/0", "").isOk()) {
+            state.SkipWithError("physical network setup failed");
+            return;
+        }
+    }
+
+    int current = 0;
+    while (state.KeepRunning()) {
+        if (!netd->networkSetDefault(nets[current].netId).isOk()) {
+            state.SkipWithError("networkSetDefault failed");
+            break;
+        }
+        current ^= 1;
+    }
+
+    if (storedDefault >= 0) {
+        netd->networkSetDefault(storedDefault);
+    } else {
+        netd->networkClearDefault();
+    }
+    netd->networkDestroy(TEST_NETID_A);
+    netd->networkDestroy(TEST_NETID_B);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(transitionDefaultSwitch);
+
+BENCHMARK_MAIN();
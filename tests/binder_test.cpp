@@ -3385,12 +3385,26 @@ TEST_F(NetdBinderTest, OemNetdRelated) {
             mCv.notify_one();
             return android::binder::Status::ok();
         }
+        android::binder::Status onNetlinkQueueOverflow(int32_t /* netlinkFamily */) override {
+            return android::binder::Status::ok();
+        }
+        android::binder::Status onAsyncOperationComplete(int32_t opId, int32_t errorCode) override {
+            std::lock_guard lock(mCvMutex);
+            mLastOpId = opId;
+            mLastErrorCode = errorCode;
+            mCv.notify_one();
+            return android::binder::Status::ok();
+        }
         std::condition_variable& getCv() { return mCv; }
         std::mutex& getCvMutex() { return mCvMutex; }
+        int32_t lastOpId() { return mLastOpId; }
+        int32_t lastErrorCode() { return mLastErrorCode; }
 
       private:
         std::mutex mCvMutex;
         std::condition_variable mCv;
+        int32_t mLastOpId = 0;
+        int32_t mLastErrorCode = -1;
     };
 
     // Start the Binder thread pool.
@@ -3413,6 +3427,18 @@ TEST_F(NetdBinderTest, OemNetdRelated) {
         // Wait for receiving expected events.
         EXPECT_EQ(std::cv_status::no_timeout, cv.wait_for(lock, std::chrono::seconds(2)));
     }
+
+    // Fire-and-forget operations report completion through the registered listener.
+    {
+        std::unique_lock lock(cvMutex);
+        constexpr int32_t kOpId = 12345;
+        status = oemNetd->strictUidCleartextPenaltyAsync(TEST_UID1, INetd::PENALTY_POLICY_ACCEPT,
+                                                         kOpId);
+        EXPECT_TRUE(status.isOk()) << status.exceptionMessage();
+        EXPECT_EQ(std::cv_status::no_timeout, cv.wait_for(lock, std::chrono::seconds(2)));
+        EXPECT_EQ(kOpId, testListener->lastOpId());
+        EXPECT_EQ(0, testListener->lastErrorCode());
+    }
 }
 
 void NetdBinderTest::createVpnNetworkWithUid(bool secure, uid_t uid, int vpnNetId,